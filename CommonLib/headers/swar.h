@@ -0,0 +1,66 @@
+#pragma once
+
+// Helpers for examining the 8 bytes of a QWORD at once (SIMD within a register)
+
+#define SWAR_LOW_BITS                   0x0101010101010101ULL
+#define SWAR_HIGH_BITS                  0x8080808080808080ULL
+#define SWAR_LOW_7_BITS                 0x7F7F7F7F7F7F7F7FULL
+
+#define SwarBroadcast(Byte)             ((QWORD)(BYTE)(Byte) * SWAR_LOW_BITS)
+
+// Reads of a whole QWORD must not cross into the next page, 4KB is the smallest
+// page size => the bytes following a string terminator may be read only if they
+// are on the same page as the terminator
+#define SWAR_PAGE_SIZE                  0x1000
+
+//******************************************************************************
+// Function:     SwarZeroBytes
+// Description:  Returns a mask with the high bit of each zero byte of Value
+//               set. Unlike the (x - 1) & ~x trick there are no false positives
+//               so the mask can be used to find the last zero byte as well.
+// Returns:      QWORD
+// Parameter:    IN QWORD Value
+//******************************************************************************
+__forceinline
+static
+QWORD
+SwarZeroBytes(
+    IN      QWORD       Value
+    )
+{
+    return ~(((Value & SWAR_LOW_7_BITS) + SWAR_LOW_7_BITS) | Value | SWAR_LOW_7_BITS);
+}
+
+// The index of the first byte marked in a mask returned by SwarZeroBytes,
+// the mask must not be 0
+__forceinline
+static
+DWORD
+SwarFirstByte(
+    IN      QWORD       Mask
+    )
+{
+    unsigned long bitIndex;
+
+    // little endian => the lowest bits belong to the first byte
+    _BitScanForward64(&bitIndex, Mask);
+
+    return bitIndex / BITS_PER_BYTE;
+}
+
+__forceinline
+static
+DWORD
+SwarLastByte(
+    IN      QWORD       Mask
+    )
+{
+    unsigned long bitIndex;
+
+    _BitScanReverse64(&bitIndex, Mask);
+
+    return bitIndex / BITS_PER_BYTE;
+}
+
+// Mask of the bytes which precede the byte at Index
+#define SwarBytesBelow(Index)           ((Index) == 0 ? 0ULL : (MAX_QWORD >> ((sizeof(QWORD) - (Index)) * BITS_PER_BYTE)))
@@ -1,6 +1,10 @@
 #pragma once
 
+#ifdef CL_NON_NATIVE
+#include "native/string.h"
+#else
 #include "string.h"
+#endif
 
 //******************************************************************************
 // Function:     FUNC_AssertFunction
@@ -24,12 +28,22 @@ typedef FUNC_AssertFunction*        PFUNC_AssertFunction;
 // condition does not hold the registered FUNC_AssertFunction is called
 #define ASSERT(Cond)                ASSERT_INFO((Cond),"")
 
+#ifdef CL_HOST_BUILD
+// gcc does not paste string literals and the host paths use forward slashes
+#define ASSERT_INFO(Cond,Msg,...)   if((Cond)){} else                                                                                                    \
+                                    {                                                                                                                    \
+                                        AssertInfo( "[ASSERT][%s][%d]Condition: (" #Cond ") failed\n" Msg, strrchr(__FILE__, '/') + 1, __LINE__, ##__VA_ARGS__ );      \
+                                    }
+
+#define NOT_REACHED                 ASSERT(FALSE)
+#else
 #define ASSERT_INFO(Cond,Msg,...)   if((Cond)){} else                                                                                                    \
                                     {                                                                                                                    \
                                         AssertInfo( "[ASSERT][%s][%d]Condition: (" ## #Cond ## ") failed\n" ##Msg, strrchr(__FILE__, '\\') + 1, __LINE__, __VA_ARGS__ );      \
                                     }
 
 #define NOT_REACHED                 __pragma(warning(suppress: 4127)) ASSERT(FALSE)
+#endif // CL_HOST_BUILD
 
 void
 AssertInfo(
@@ -2,7 +2,7 @@
 
 #include "data_type.h"
 
-#define UNREFERENCED_PARAMETER(x)   (x);
+#define UNREFERENCED_PARAMETER(x)   ((void)(x));
 
 #define NOTHING                     ;
 
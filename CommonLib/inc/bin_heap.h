@@ -0,0 +1,210 @@
+#pragma once
+//******************************************************************************
+// Binary heap
+//
+//
+// An intrusive min-heap: the elements embed a BIN_HEAP_ENTRY and the heap is
+// an array of pointers to these entries, ordered by a compare function. The
+// smallest element is always at index 0, insertions and removals are
+// O(log n) instead of the O(n) of InsertOrderedList.
+//
+// Each entry remembers its index in the array => an arbitrary element may be
+// removed or moved closer to the top after its key decreased, which is what
+// timer queues need when a timer is cancelled or rescheduled earlier.
+//
+// typedef struct _FOO
+// {
+//      QWORD               Deadline;
+//      BIN_HEAP_ENTRY      HeapEntry;
+// } FOO, *PFOO;
+//
+// static
+// INT64
+// (__cdecl _FooCompare)(
+//      IN  PBIN_HEAP_ENTRY     First,
+//      IN  PBIN_HEAP_ENTRY     Second
+//      )
+// {
+//      return (INT64) (CONTAINING_RECORD(First, FOO, HeapEntry)->Deadline -
+//                      CONTAINING_RECORD(Second, FOO, HeapEntry)->Deadline);
+// }
+//
+// status = BinHeapInit(&heap, 16, _FooCompare, MyAllocFunction, MyFreeFunction, NULL);
+//
+// status = BinHeapInsert(&heap, &pFoo->HeapEntry);
+//
+// pFoo->Deadline = earlierDeadline;
+// BinHeapDecreaseKey(&heap, &pFoo->HeapEntry);
+//
+// pEntry = BinHeapExtractMin(&heap);
+//
+// BinHeapUninit(&heap);
+//******************************************************************************
+
+C_HEADER_START
+#include "ref_cnt.h"
+
+typedef struct _BIN_HEAP_ENTRY
+{
+    // The position of the element in the heap array
+    DWORD                       Index;
+} BIN_HEAP_ENTRY, *PBIN_HEAP_ENTRY;
+
+//******************************************************************************
+// Function:     FUNC_BinHeapCompareFunction
+// Description:  Compares two heap elements.
+// Returns:      INT64 - Returns a negative value if FirstElem is smaller than
+//               SecondElem, a positive value if FirstElem is greater than
+//               SecondElem and zero otherwise.
+// Parameter:    IN PBIN_HEAP_ENTRY FirstElem
+// Parameter:    IN PBIN_HEAP_ENTRY SecondElem
+//******************************************************************************
+typedef
+INT64
+(__cdecl FUNC_BinHeapCompareFunction) (
+    IN      PBIN_HEAP_ENTRY     FirstElem,
+    IN      PBIN_HEAP_ENTRY     SecondElem
+    );
+
+typedef FUNC_BinHeapCompareFunction*    PFUNC_BinHeapCompareFunction;
+
+//******************************************************************************
+// Function:     FUNC_BinHeapAllocFunction
+// Description:  Allocates the memory for the heap array, the memory does not
+//               need to be zeroed.
+// Returns:      PVOID - NULL if the memory could not be allocated
+// Parameter:    IN DWORD Size
+// Parameter:    IN_OPT PVOID Context
+//******************************************************************************
+typedef
+PVOID
+(__cdecl FUNC_BinHeapAllocFunction)(
+    IN      DWORD       Size,
+    IN_OPT  PVOID       Context
+    );
+
+typedef FUNC_BinHeapAllocFunction*      PFUNC_BinHeapAllocFunction;
+
+typedef struct _BIN_HEAP
+{
+    PFUNC_BinHeapCompareFunction    CompareFunc;
+
+    PFUNC_BinHeapAllocFunction      AllocFunc;
+    PFUNC_FreeFunction              FreeFunc;
+    PVOID                           AllocContext;
+
+    // The children of the element at index i are at 2 * i + 1 and 2 * i + 2,
+    // the array is doubled when it becomes full
+    PBIN_HEAP_ENTRY*                Elements;
+    DWORD                           NumberOfElements;
+    DWORD                           Capacity;
+} BIN_HEAP, *PBIN_HEAP;
+
+//******************************************************************************
+// Function:     BinHeapInit
+// Description:  Initializes an empty heap with room for InitialCapacity
+//               elements.
+// Returns:      STATUS
+// Parameter:    OUT PBIN_HEAP Heap
+// Parameter:    IN DWORD InitialCapacity
+// Parameter:    IN PFUNC_BinHeapCompareFunction CompareFunction
+// Parameter:    IN PFUNC_BinHeapAllocFunction AllocFunction
+// Parameter:    IN PFUNC_FreeFunction FreeFunction - Frees the array memory
+// Parameter:    IN_OPT PVOID AllocContext - Passed to both functions
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+BinHeapInit(
+    OUT     PBIN_HEAP                       Heap,
+    IN      DWORD                           InitialCapacity,
+    IN      PFUNC_BinHeapCompareFunction    CompareFunction,
+    IN      PFUNC_BinHeapAllocFunction      AllocFunction,
+    IN      PFUNC_FreeFunction              FreeFunction,
+    IN_OPT  PVOID                           AllocContext
+    );
+
+//******************************************************************************
+// Function:     BinHeapUninit
+// Description:  Frees the heap array, the elements still in the heap are not
+//               touched.
+// Returns:      void
+// Parameter:    INOUT PBIN_HEAP Heap
+//******************************************************************************
+void
+BinHeapUninit(
+    INOUT   PBIN_HEAP                       Heap
+    );
+
+DWORD
+BinHeapSize(
+    IN      PBIN_HEAP                       Heap
+    );
+
+//******************************************************************************
+// Function:     BinHeapInsert
+// Description:  Inserts an element into the heap.
+// Returns:      STATUS - STATUS_HEAP_INSUFFICIENT_RESOURCES if the heap is
+//               full and a bigger array could not be allocated
+// Parameter:    INOUT PBIN_HEAP Heap
+// Parameter:    INOUT PBIN_HEAP_ENTRY Element
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+BinHeapInsert(
+    INOUT   PBIN_HEAP                       Heap,
+    INOUT   PBIN_HEAP_ENTRY                 Element
+    );
+
+//******************************************************************************
+// Function:     BinHeapPeekMin
+// Description:  Returns the smallest element without removing it.
+// Returns:      PBIN_HEAP_ENTRY - NULL if the heap is empty
+// Parameter:    IN PBIN_HEAP Heap
+//******************************************************************************
+PTR_SUCCESS
+PBIN_HEAP_ENTRY
+BinHeapPeekMin(
+    IN      PBIN_HEAP                       Heap
+    );
+
+//******************************************************************************
+// Function:     BinHeapExtractMin
+// Description:  Removes the smallest element from the heap.
+// Returns:      PBIN_HEAP_ENTRY - NULL if the heap is empty
+// Parameter:    INOUT PBIN_HEAP Heap
+//******************************************************************************
+PTR_SUCCESS
+PBIN_HEAP_ENTRY
+BinHeapExtractMin(
+    INOUT   PBIN_HEAP                       Heap
+    );
+
+//******************************************************************************
+// Function:     BinHeapRemoveEntry
+// Description:  Removes an element which is in the heap.
+// Returns:      void
+// Parameter:    INOUT PBIN_HEAP Heap
+// Parameter:    INOUT PBIN_HEAP_ENTRY Element
+//******************************************************************************
+void
+BinHeapRemoveEntry(
+    INOUT   PBIN_HEAP                       Heap,
+    INOUT   PBIN_HEAP_ENTRY                 Element
+    );
+
+//******************************************************************************
+// Function:     BinHeapDecreaseKey
+// Description:  Restores the heap order after the key of Element was
+//               decreased.
+// Returns:      void
+// Parameter:    INOUT PBIN_HEAP Heap
+// Parameter:    INOUT PBIN_HEAP_ENTRY Element
+// NOTE:         If the key was increased the element must be removed and
+//               inserted again.
+//******************************************************************************
+void
+BinHeapDecreaseKey(
+    INOUT   PBIN_HEAP                       Heap,
+    INOUT   PBIN_HEAP_ENTRY                 Element
+    );
+C_HEADER_END
@@ -1,6 +1,20 @@
 #pragma once
 
 C_HEADER_START
+//******************************************************************************
+// Function:     MemoryInitFeatures
+// Description:  Selects the fastest implementation of the functions below
+//               supported by the CPU. Until it is called the functions use
+//               the generic implementation.
+// Returns:      void
+// Parameter:    void
+// NOTE:         Called by CommonLibInit.
+//******************************************************************************
+void
+cl_MemoryInitFeatures(
+    void
+    );
+
 //******************************************************************************
 // Function:        memset
 // Description:     Sets bytes in a memory area to a value.
@@ -6,7 +6,12 @@
 #include "status.h"
 #include "va_list.h"
 #include "intutils.h"
+#ifdef CL_NON_NATIVE
+// usermode builds use the cl_ functions, the C runtime owns the plain names
+#include "native/memory.h"
+#else
 #include "memory.h"
+#endif
 #include "assert.h"
 
 #pragma pack(push,16)
@@ -51,6 +51,12 @@ typedef struct _LIST_ENTRY
 } LIST_ENTRY, *PLIST_ENTRY;
 #pragma pack(pop)
 
+typedef struct _LIST_ITERATOR
+{
+    PLIST_ENTRY             ListHead;
+    PLIST_ENTRY             CurrentEntry;
+} LIST_ITERATOR, *PLIST_ITERATOR;
+
 typedef
 STATUS
 (__cdecl FUNC_ListFunction) (
@@ -262,4 +268,31 @@ ListSearchForElement(
     IN      PLIST_ENTRY             ListHead,
     IN      PLIST_ENTRY             ElementToSearchFor,
     IN      PFUNC_CompareFunction   CompareFunction
+    );
+
+//******************************************************************************
+// Function:     ListIteratorInit
+// Description:  Prepares an iterator for walking the list from the first
+//               element to the last one.
+// Returns:      void
+// Parameter:    IN PLIST_ENTRY ListHead
+// Parameter:    OUT PLIST_ITERATOR ListIterator
+//******************************************************************************
+void
+ListIteratorInit(
+    IN      PLIST_ENTRY             ListHead,
+    OUT     PLIST_ITERATOR          ListIterator
+    );
+
+//******************************************************************************
+// Function:     ListIteratorNext
+// Description:  Advances the iterator. The element returned may be removed
+//               from the list before the next call.
+// Returns:      PLIST_ENTRY - NULL when the end of the list was reached
+// Parameter:    INOUT PLIST_ITERATOR ListIterator
+//******************************************************************************
+PTR_SUCCESS
+PLIST_ENTRY
+ListIteratorNext(
+    INOUT   PLIST_ITERATOR          ListIterator
     );
\ No newline at end of file
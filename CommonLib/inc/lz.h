@@ -0,0 +1,66 @@
+#pragma once
+
+// Byte oriented LZ77 compressor using the LZ4 block layout: each sequence is
+// a token (literal length in the upper nibble, match length - LZ_MIN_MATCH in
+// the lower one), the literals and a 2 byte match offset. The last sequence
+// has no match.
+
+#define LZ_MIN_MATCH                4
+#define LZ_MAX_OFFSET               MAX_WORD
+
+#define LZ_HASH_BITS                12
+
+// Size of the scratch buffer required by LzCompress
+#define LZ_WORK_BUFFER_SIZE         ((1 << LZ_HASH_BITS) * sizeof(DWORD))
+
+// Worst case size of the compressed data, incompressible input is stored as a
+// single run of literals
+#define LzCompressBound(Size)       ((Size) + (Size) / 255 + 16)
+
+//******************************************************************************
+// Function:     LzCompress
+// Description:  Compresses InputSize bytes from Input to Output.
+// Returns:      DWORD - Size of the compressed data, 0 if it does not fit in
+//               OutputSize bytes.
+// Parameter:    IN_READS_BYTES(InputSize) PVOID Input
+// Parameter:    IN DWORD InputSize
+// Parameter:    OUT_WRITES_BYTES(OutputSize) PVOID Output
+// Parameter:    IN DWORD OutputSize
+// Parameter:    OUT_WRITES_BYTES(LZ_WORK_BUFFER_SIZE) PVOID WorkBuffer - no
+//               need to be initialized, it is cleared on each call. Allows
+//               the caller to keep the match table off the stack.
+//******************************************************************************
+DWORD
+LzCompress(
+    IN_READS_BYTES(InputSize)
+                PVOID       Input,
+    IN          DWORD       InputSize,
+    OUT_WRITES_BYTES(OutputSize)
+                PVOID       Output,
+    IN          DWORD       OutputSize,
+    OUT_WRITES_BYTES(LZ_WORK_BUFFER_SIZE)
+                PVOID       WorkBuffer
+    );
+
+//******************************************************************************
+// Function:     LzDecompress
+// Description:  Decompresses data produced by LzCompress. Corrupted input
+//               never causes accesses outside the two buffers.
+// Returns:      STATUS - STATUS_BUFFER_TOO_SMALL if the data does not fit in
+//               Output, STATUS_INVALID_BUFFER if the input is malformed.
+// Parameter:    IN_READS_BYTES(InputSize) PVOID Input
+// Parameter:    IN DWORD InputSize
+// Parameter:    OUT_WRITES_BYTES(OutputSize) PVOID Output
+// Parameter:    IN DWORD OutputSize
+// Parameter:    OUT DWORD* BytesDecompressed
+//******************************************************************************
+STATUS
+LzDecompress(
+    IN_READS_BYTES(InputSize)
+                PVOID       Input,
+    IN          DWORD       InputSize,
+    OUT_WRITES_BYTES(OutputSize)
+                PVOID       Output,
+    IN          DWORD       OutputSize,
+    OUT         DWORD*      BytesDecompressed
+    );
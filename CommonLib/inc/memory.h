@@ -1,5 +1,19 @@
 #pragma once
 
+//******************************************************************************
+// Function:     MemoryInitFeatures
+// Description:  Selects the fastest implementation of the functions below
+//               supported by the CPU. Until it is called the functions use
+//               the generic implementation.
+// Returns:      void
+// Parameter:    void
+// NOTE:         Called by CommonLibInit.
+//******************************************************************************
+void
+MemoryInitFeatures(
+    void
+    );
+
 //******************************************************************************
 // Function:        memset
 // Description:     Sets bytes in a memory area to a value.
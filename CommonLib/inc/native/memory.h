@@ -7,4 +7,6 @@
 #define memcpy          cl_memcpy
 #define memmove         cl_memmove
 #define memcmp          cl_memcmp
+#define rmemcmp         cl_rmemcmp
 #define memscan         cl_memscan
+#define MemoryInitFeatures cl_MemoryInitFeatures
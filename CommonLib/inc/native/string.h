@@ -10,7 +10,10 @@
 #define strrchr         cl_strrchr
 #define strcpy          cl_strcpy
 #define strncpy         cl_strncpy
+#define strlen          cl_strlen
+#define strlen_s        cl_strlen_s
 #define snprintf        cl_snprintf
 #define sprintf         cl_sprintf
 #define vsnprintf       cl_vsnprintf
-#define strtok_s        cl_strtok_s
\ No newline at end of file
+#define strtok_s        cl_strtok_s
+#define strcelem        cl_strcelem
\ No newline at end of file
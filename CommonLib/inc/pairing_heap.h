@@ -0,0 +1,140 @@
+#pragma once
+//******************************************************************************
+// Pairing heap
+//
+//
+// An intrusive min-heap which needs no memory besides the PAIRING_HEAP_ENTRY
+// embedded in each element: the elements form a tree in which each node keeps
+// a pointer to its leftmost child, to its next sibling and to its previous
+// sibling (or to its parent if it is the leftmost child).
+//
+// Insertion and decrease-key are O(1): the element (or the subtree it roots)
+// is linked under the root or becomes the root. Extracting the minimum melds
+// the children of the root in pairs, in amortized O(log n). Compared to
+// BIN_HEAP insertions never fail and there is no array to grow, which makes
+// it the better choice when the keys are decreased often.
+//
+// typedef struct _FOO
+// {
+//      QWORD                   Deadline;
+//      PAIRING_HEAP_ENTRY      HeapEntry;
+// } FOO, *PFOO;
+//
+// PairingHeapInit(&heap, _FooCompare);
+//
+// PairingHeapInsert(&heap, &pFoo->HeapEntry);
+//
+// pFoo->Deadline = earlierDeadline;
+// PairingHeapDecreaseKey(&heap, &pFoo->HeapEntry);
+//
+// pEntry = PairingHeapExtractMin(&heap);
+//******************************************************************************
+
+C_HEADER_START
+
+typedef struct _PAIRING_HEAP_ENTRY
+{
+    struct _PAIRING_HEAP_ENTRY*     Child;
+    struct _PAIRING_HEAP_ENTRY*     Sibling;
+
+    // The previous sibling or the parent for the leftmost child, NULL for the
+    // root
+    struct _PAIRING_HEAP_ENTRY*     Prev;
+} PAIRING_HEAP_ENTRY, *PPAIRING_HEAP_ENTRY;
+
+//******************************************************************************
+// Function:     FUNC_PairingHeapCompareFunction
+// Description:  Compares two heap elements.
+// Returns:      INT64 - Returns a negative value if FirstElem is smaller than
+//               SecondElem, a positive value if FirstElem is greater than
+//               SecondElem and zero otherwise.
+// Parameter:    IN PPAIRING_HEAP_ENTRY FirstElem
+// Parameter:    IN PPAIRING_HEAP_ENTRY SecondElem
+//******************************************************************************
+typedef
+INT64
+(__cdecl FUNC_PairingHeapCompareFunction) (
+    IN      PPAIRING_HEAP_ENTRY     FirstElem,
+    IN      PPAIRING_HEAP_ENTRY     SecondElem
+    );
+
+typedef FUNC_PairingHeapCompareFunction*    PFUNC_PairingHeapCompareFunction;
+
+typedef struct _PAIRING_HEAP
+{
+    PFUNC_PairingHeapCompareFunction    CompareFunc;
+
+    PPAIRING_HEAP_ENTRY                 Root;
+    DWORD                               NumberOfElements;
+} PAIRING_HEAP, *PPAIRING_HEAP;
+
+void
+PairingHeapInit(
+    OUT     PPAIRING_HEAP                       Heap,
+    IN      PFUNC_PairingHeapCompareFunction    CompareFunction
+    );
+
+DWORD
+PairingHeapSize(
+    IN      PPAIRING_HEAP                       Heap
+    );
+
+void
+PairingHeapInsert(
+    INOUT   PPAIRING_HEAP                       Heap,
+    INOUT   PPAIRING_HEAP_ENTRY                 Element
+    );
+
+//******************************************************************************
+// Function:     PairingHeapPeekMin
+// Description:  Returns the smallest element without removing it.
+// Returns:      PPAIRING_HEAP_ENTRY - NULL if the heap is empty
+// Parameter:    IN PPAIRING_HEAP Heap
+//******************************************************************************
+PTR_SUCCESS
+PPAIRING_HEAP_ENTRY
+PairingHeapPeekMin(
+    IN      PPAIRING_HEAP                       Heap
+    );
+
+//******************************************************************************
+// Function:     PairingHeapExtractMin
+// Description:  Removes the smallest element from the heap.
+// Returns:      PPAIRING_HEAP_ENTRY - NULL if the heap is empty
+// Parameter:    INOUT PPAIRING_HEAP Heap
+//******************************************************************************
+PTR_SUCCESS
+PPAIRING_HEAP_ENTRY
+PairingHeapExtractMin(
+    INOUT   PPAIRING_HEAP                       Heap
+    );
+
+//******************************************************************************
+// Function:     PairingHeapRemoveEntry
+// Description:  Removes an element which is in the heap.
+// Returns:      void
+// Parameter:    INOUT PPAIRING_HEAP Heap
+// Parameter:    INOUT PPAIRING_HEAP_ENTRY Element
+//******************************************************************************
+void
+PairingHeapRemoveEntry(
+    INOUT   PPAIRING_HEAP                       Heap,
+    INOUT   PPAIRING_HEAP_ENTRY                 Element
+    );
+
+//******************************************************************************
+// Function:     PairingHeapDecreaseKey
+// Description:  Restores the heap order after the key of Element was
+//               decreased.
+// Returns:      void
+// Parameter:    INOUT PPAIRING_HEAP Heap
+// Parameter:    INOUT PPAIRING_HEAP_ENTRY Element
+// NOTE:         If the key was increased the element must be removed and
+//               inserted again.
+//******************************************************************************
+void
+PairingHeapDecreaseKey(
+    INOUT   PPAIRING_HEAP                       Heap,
+    INOUT   PPAIRING_HEAP_ENTRY                 Element
+    );
+C_HEADER_END
@@ -0,0 +1,273 @@
+#pragma once
+//******************************************************************************
+// Red-black tree
+//
+//
+// An intrusive balanced binary search tree: the elements embed an RB_NODE and
+// are ordered by a compare function given at initialization. Insertions,
+// removals and lookups are O(log n), the tree never allocates memory.
+//
+// Besides exact lookups the tree finds the first element greater or equal and
+// the last element smaller or equal than a key => a range [Low, High] is
+// walked with RbTreeLookupCeiling(Low) followed by RbTreeNext until an
+// element greater than High is reached.
+//
+// Elements with equal keys may be inserted with RbTreeInsert, they are kept
+// in the order in which they were inserted. RbTreeInsertUnique refuses them.
+//
+// An augment function may be given to keep per subtree data in the elements
+// (e.g. the maximum end address of the intervals in the subtree of an
+// interval tree). It is called for each element whose subtree changed, after
+// it was called for its children => it only has to combine the data of the
+// element with the data of its Left and Right children.
+//
+// typedef struct _FOO
+// {
+//      QWORD           Start;
+//      RB_NODE         TreeNode;
+// } FOO, *PFOO;
+//
+// static
+// INT64
+// (__cdecl _FooCompare)(
+//      IN  PRB_NODE    FirstElem,
+//      IN  PRB_NODE    SecondElem
+//      )
+// {
+//      return RbCompareQword(CONTAINING_RECORD(FirstElem, FOO, TreeNode)->Start,
+//                            CONTAINING_RECORD(SecondElem, FOO, TreeNode)->Start);
+// }
+//
+// static
+// INT64
+// (__cdecl _FooKeyCompare)(
+//      IN  PVOID       Key,
+//      IN  PRB_NODE    Node
+//      )
+// {
+//      return RbCompareQword(*(PQWORD)Key, CONTAINING_RECORD(Node, FOO, TreeNode)->Start);
+// }
+//
+// RbTreeInit(&tree, _FooCompare, _FooKeyCompare, NULL);
+//
+// RbTreeInsert(&tree, &pFoo->TreeNode);
+//
+// for (pNode = RbTreeLookupCeiling(&tree, &low);
+//      pNode != NULL && CONTAINING_RECORD(pNode, FOO, TreeNode)->Start <= high;
+//      pNode = RbTreeNext(pNode))
+// {
+//      // do whatever with the element, it must not be removed while iterating
+// }
+//
+// RbTreeRemove(&tree, &pFoo->TreeNode);
+//******************************************************************************
+
+C_HEADER_START
+
+typedef struct _RB_NODE
+{
+    // The children may be walked directly by searches which use augmented data
+    struct _RB_NODE*        Left;
+    struct _RB_NODE*        Right;
+    struct _RB_NODE*        Parent;
+
+    BOOLEAN                 Red;
+} RB_NODE, *PRB_NODE;
+
+// Compares two QWORD keys without the overflow of a subtraction
+#define RbCompareQword(First,Second)    ((INT64) ((First) > (Second)) - (INT64) ((First) < (Second)))
+
+//******************************************************************************
+// Function:     FUNC_RbTreeCompareFunction
+// Description:  Compares two tree elements.
+// Returns:      INT64 - Returns a negative value if FirstElem is smaller than
+//               SecondElem, a positive value if FirstElem is greater than
+//               SecondElem and zero otherwise.
+// Parameter:    IN PRB_NODE FirstElem
+// Parameter:    IN PRB_NODE SecondElem
+//******************************************************************************
+typedef
+INT64
+(__cdecl FUNC_RbTreeCompareFunction) (
+    IN      PRB_NODE        FirstElem,
+    IN      PRB_NODE        SecondElem
+    );
+
+typedef FUNC_RbTreeCompareFunction*     PFUNC_RbTreeCompareFunction;
+
+//******************************************************************************
+// Function:     FUNC_RbTreeKeyCompareFunction
+// Description:  Compares a key with the key of a tree element, must order the
+//               elements the same way FUNC_RbTreeCompareFunction does.
+// Returns:      INT64 - Returns a negative value if Key is smaller than the
+//               key of Node, a positive value if it is greater and zero
+//               otherwise.
+// Parameter:    IN PVOID Key
+// Parameter:    IN PRB_NODE Node
+//******************************************************************************
+typedef
+INT64
+(__cdecl FUNC_RbTreeKeyCompareFunction) (
+    IN      PVOID           Key,
+    IN      PRB_NODE        Node
+    );
+
+typedef FUNC_RbTreeKeyCompareFunction*  PFUNC_RbTreeKeyCompareFunction;
+
+//******************************************************************************
+// Function:     FUNC_RbTreeAugmentFunction
+// Description:  Recomputes the augmented data of Node from the data of Node
+//               and from the augmented data of its children.
+// Returns:      void
+// Parameter:    INOUT PRB_NODE Node
+//******************************************************************************
+typedef
+void
+(__cdecl FUNC_RbTreeAugmentFunction) (
+    INOUT   PRB_NODE        Node
+    );
+
+typedef FUNC_RbTreeAugmentFunction*     PFUNC_RbTreeAugmentFunction;
+
+typedef struct _RB_TREE
+{
+    PRB_NODE                            Root;
+    DWORD                               NumberOfElements;
+
+    PFUNC_RbTreeCompareFunction         CompareFunc;
+    PFUNC_RbTreeKeyCompareFunction      KeyCompareFunc;
+    PFUNC_RbTreeAugmentFunction         AugmentFunc;
+} RB_TREE, *PRB_TREE;
+
+//******************************************************************************
+// Function:     RbTreeInit
+// Description:  Initializes an empty tree.
+// Returns:      void
+// Parameter:    OUT PRB_TREE Tree
+// Parameter:    IN PFUNC_RbTreeCompareFunction CompareFunction
+// Parameter:    IN_OPT PFUNC_RbTreeKeyCompareFunction KeyCompareFunction -
+//               Needed only by the lookup functions
+// Parameter:    IN_OPT PFUNC_RbTreeAugmentFunction AugmentFunction
+//******************************************************************************
+void
+RbTreeInit(
+    OUT     PRB_TREE                        Tree,
+    IN      PFUNC_RbTreeCompareFunction     CompareFunction,
+    IN_OPT  PFUNC_RbTreeKeyCompareFunction  KeyCompareFunction,
+    IN_OPT  PFUNC_RbTreeAugmentFunction     AugmentFunction
+    );
+
+DWORD
+RbTreeSize(
+    IN      PRB_TREE                        Tree
+    );
+
+//******************************************************************************
+// Function:     RbTreeInsert
+// Description:  Inserts an element into the tree, after the elements which
+//               compare equal to it.
+// Returns:      void
+// Parameter:    INOUT PRB_TREE Tree
+// Parameter:    INOUT PRB_NODE Node
+//******************************************************************************
+void
+RbTreeInsert(
+    INOUT   PRB_TREE                        Tree,
+    INOUT   PRB_NODE                        Node
+    );
+
+//******************************************************************************
+// Function:     RbTreeInsertUnique
+// Description:  Inserts an element into the tree if no element compares equal
+//               to it.
+// Returns:      STATUS - STATUS_ELEMENT_FOUND if an equal element is already
+//               in the tree
+// Parameter:    INOUT PRB_TREE Tree
+// Parameter:    INOUT PRB_NODE Node
+// Parameter:    OUT_OPT PRB_NODE* ExistingNode - The equal element, NULL if
+//               Node was inserted
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+RbTreeInsertUnique(
+    INOUT   PRB_TREE                        Tree,
+    INOUT   PRB_NODE                        Node,
+    OUT_OPT PRB_NODE*                       ExistingNode
+    );
+
+void
+RbTreeRemove(
+    INOUT   PRB_TREE                        Tree,
+    INOUT   PRB_NODE                        Node
+    );
+
+//******************************************************************************
+// Function:     RbTreeLookup
+// Description:  Searches for the first element whose key is equal to Key.
+// Returns:      PRB_NODE - NULL if no element with Key is present
+// Parameter:    IN PRB_TREE Tree
+// Parameter:    IN PVOID Key
+//******************************************************************************
+PTR_SUCCESS
+PRB_NODE
+RbTreeLookup(
+    IN      PRB_TREE                        Tree,
+    IN      PVOID                           Key
+    );
+
+//******************************************************************************
+// Function:     RbTreeLookupCeiling
+// Description:  Searches for the first element whose key is greater or equal
+//               to Key.
+// Returns:      PRB_NODE - NULL if all the elements are smaller than Key
+// Parameter:    IN PRB_TREE Tree
+// Parameter:    IN PVOID Key
+//******************************************************************************
+PTR_SUCCESS
+PRB_NODE
+RbTreeLookupCeiling(
+    IN      PRB_TREE                        Tree,
+    IN      PVOID                           Key
+    );
+
+//******************************************************************************
+// Function:     RbTreeLookupFloor
+// Description:  Searches for the last element whose key is smaller or equal
+//               to Key.
+// Returns:      PRB_NODE - NULL if all the elements are greater than Key
+// Parameter:    IN PRB_TREE Tree
+// Parameter:    IN PVOID Key
+//******************************************************************************
+PTR_SUCCESS
+PRB_NODE
+RbTreeLookupFloor(
+    IN      PRB_TREE                        Tree,
+    IN      PVOID                           Key
+    );
+
+// The smallest and the greatest elements, NULL if the tree is empty
+PTR_SUCCESS
+PRB_NODE
+RbTreeFirst(
+    IN      PRB_TREE                        Tree
+    );
+
+PTR_SUCCESS
+PRB_NODE
+RbTreeLast(
+    IN      PRB_TREE                        Tree
+    );
+
+// The in-order successor and predecessor, NULL at the ends of the tree
+PTR_SUCCESS
+PRB_NODE
+RbTreeNext(
+    IN      PRB_NODE                        Node
+    );
+
+PTR_SUCCESS
+PRB_NODE
+RbTreePrev(
+    IN      PRB_NODE                        Node
+    );
+C_HEADER_END
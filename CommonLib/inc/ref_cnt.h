@@ -58,6 +58,21 @@ RfcReference(
     INOUT   REF_COUNT*              Object
     );
 
+//******************************************************************************
+// Function:     RfcTryReference
+// Description:  Increments the reference count of the object only if it did
+//               not already reach 0, i.e. if the object is not being destroyed.
+//               Used when the object is found through a structure it is still
+//               linked in while its destruction is under way.
+// Returns:      BOOLEAN - TRUE if the reference was taken
+// Parameter:    INOUT REF_COUNT * Object
+//******************************************************************************
+BOOL_SUCCESS
+BOOLEAN
+RfcTryReference(
+    INOUT   REF_COUNT*              Object
+    );
+
 //******************************************************************************
 // Function:     RfcReference
 // Description:  Decrements the reference count of the object
@@ -0,0 +1,263 @@
+#pragma once
+//******************************************************************************
+// Robin Hood hash table
+//
+//
+// An open addressing alternative to HASH_TABLE: the elements are not chained,
+// the table is an array of slots, each slot holding a pointer to the element
+// and a fingerprint of its key (the 32 bit hash). A lookup walks consecutive
+// slots and only dereferences an element if its fingerprint matches => most
+// probes stay within one or two cache lines.
+//
+// Robin Hood insertion keeps the probe sequences short: an element which is
+// further from its home slot than the element occupying a slot takes that
+// slot and the displaced element continues probing. This also allows a lookup
+// to stop as soon as it reaches an element closer to its home than the probe.
+// Removal shifts the following elements back instead of leaving tombstones.
+//
+// Unlike HASH_TABLE the number of slots is not fixed: when the table gets 7/8
+// full a table twice as big is allocated and the elements are moved a few
+// slots at a time by each of the following insertions and removals, there is
+// never a pause in which the whole table is rehashed. While the elements are
+// moved both tables are searched.
+//
+// The usage is the same as for HASH_TABLE, with the memory for the slots
+// coming from the allocation functions given at initialization:
+//
+// typedef struct _FOO
+// {
+//      DWORD           SomeData;
+//      WORD            Id;
+//      RH_HASH_ENTRY   HashEntry;
+// } FOO, *PFOO;
+//
+// RH_HASH_TABLE hashTable;
+//
+// status = RhHashTableInit(&hashTable,
+//                          16,
+//                          sizeof(WORD),
+//                          HashFuncGenericIncremental,
+//                          FIELD_OFFSET(FOO, Id) - FIELD_OFFSET(FOO, HashEntry),
+//                          MyAllocFunction,
+//                          MyFreeFunction,
+//                          NULL);
+//
+// status = RhHashTableInsert(&hashTable, &pMyData->HashEntry, NULL);
+//
+// pEntry = RhHashTableLookup(&hashTable, &idToSearchFor);
+//
+// RhHashTableRemoveEntry(&hashTable, &pMyData->HashEntry);
+//
+// RhHashTableUninit(&hashTable);
+//
+// The hash function receives MAX_DWORD as the number of keys and the table
+// mixes the bits of the result itself => HashFuncGenericIncremental is a good
+// choice for any key. HashFuncUniversal produces few distinct values and
+// should not be used.
+//******************************************************************************
+
+C_HEADER_START
+#include "hash_table.h"
+
+typedef struct _RH_HASH_SLOT*       PRH_HASH_SLOT;
+
+typedef struct _RH_HASH_ENTRY
+{
+    // The hash of the key, lets an element be removed without hashing its key
+    // again
+    DWORD                       Hash;
+} RH_HASH_ENTRY, *PRH_HASH_ENTRY;
+
+//******************************************************************************
+// Function:     FUNC_RhHashAllocFunction
+// Description:  Allocates the memory for the slots of the table, the memory
+//               does not need to be zeroed.
+// Returns:      PVOID - NULL if the memory could not be allocated
+// Parameter:    IN DWORD Size
+// Parameter:    IN_OPT PVOID Context
+//******************************************************************************
+typedef
+PVOID
+(__cdecl FUNC_RhHashAllocFunction)(
+    IN      DWORD       Size,
+    IN_OPT  PVOID       Context
+    );
+
+typedef FUNC_RhHashAllocFunction*   PFUNC_RhHashAllocFunction;
+
+typedef struct _RH_HASH_TABLE
+{
+    // Size of the key in bytes, maximum is currently 8 bytes
+    DWORD                       KeySize;
+
+    // The offset difference in bytes between the RH_HASH_ENTRY and the key
+    INT32                       OffsetToKey;
+
+    // The number of elements in both tables
+    DWORD                       NumberOfElements;
+
+    PFUNC_HashFunction          HashFunc;
+
+    PFUNC_RhHashAllocFunction   AllocFunc;
+    PFUNC_FreeFunction          FreeFunc;
+    PVOID                       AllocContext;
+
+    // The table in which the new elements are inserted, the number of slots
+    // is always a power of 2
+    PRH_HASH_SLOT               Slots;
+    DWORD                       NumberOfSlots;
+    DWORD                       NumberOfUsedSlots;
+
+    // The table which is being emptied after a resize, NULL if no resize is
+    // in progress. The slots below NextSlotToMove have already been moved.
+    PRH_HASH_SLOT               OldSlots;
+    DWORD                       OldNumberOfSlots;
+    DWORD                       NextSlotToMove;
+} RH_HASH_TABLE, *PRH_HASH_TABLE;
+
+typedef struct _RH_HASH_ITERATOR
+{
+    PRH_HASH_TABLE              HashTable;
+
+    // Iterates over the slots of the new table first, then over the slots
+    // of the old one
+    DWORD                       SlotIndex;
+    BOOLEAN                     InOldSlots;
+} RH_HASH_ITERATOR, *PRH_HASH_ITERATOR;
+
+//******************************************************************************
+// Function:     RhHashTableInit
+// Description:  Initializes a hash table with at least InitialSlots slots.
+// Returns:      STATUS
+// Parameter:    OUT PRH_HASH_TABLE HashTable
+// Parameter:    IN DWORD InitialSlots - Rounded up to a power of 2
+// Parameter:    IN DWORD KeySize - The length in bytes of a key
+// Parameter:    IN PFUNC_HashFunction HashFunction
+// Parameter:    IN INT32 OffsetToKey - FIELD_OFFSET(MY_STRUCT,Key) -
+//               FIELD_OFFSET(MY_STRUCT,HashEntry)
+// Parameter:    IN PFUNC_RhHashAllocFunction AllocFunction
+// Parameter:    IN PFUNC_FreeFunction FreeFunction - Frees the slot memory
+// Parameter:    IN_OPT PVOID AllocContext - Passed to both functions
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+RhHashTableInit(
+    OUT     PRH_HASH_TABLE              HashTable,
+    IN      DWORD                       InitialSlots,
+    IN      DWORD                       KeySize,
+    IN      PFUNC_HashFunction          HashFunction,
+    IN      INT32                       OffsetToKey,
+    IN      PFUNC_RhHashAllocFunction   AllocFunction,
+    IN      PFUNC_FreeFunction          FreeFunction,
+    IN_OPT  PVOID                       AllocContext
+    );
+
+//******************************************************************************
+// Function:     RhHashTableUninit
+// Description:  Frees the memory of the slots, the elements still in the
+//               table are not touched.
+// Returns:      void
+// Parameter:    INOUT PRH_HASH_TABLE HashTable
+//******************************************************************************
+void
+RhHashTableUninit(
+    INOUT   PRH_HASH_TABLE              HashTable
+    );
+
+//******************************************************************************
+// Function:     RhHashTableClear
+// Description:  Removes all the elements from the hash table, optionally
+//               calling a free function for each element: this function
+//               receives a pointer to the RH_HASH_ENTRY field of the element.
+// Returns:      void
+// Parameter:    INOUT PRH_HASH_TABLE HashTable
+// Parameter:    IN_OPT PFUNC_FreeFunction FreeFunction
+// Parameter:    IN_OPT PVOID FreeContext
+//******************************************************************************
+void
+RhHashTableClear(
+    INOUT   PRH_HASH_TABLE              HashTable,
+    IN_OPT  PFUNC_FreeFunction          FreeFunction,
+    IN_OPT  PVOID                       FreeContext
+    );
+
+DWORD
+RhHashTableSize(
+    IN      PRH_HASH_TABLE              HashTable
+    );
+
+//******************************************************************************
+// Function:     RhHashTableInsert
+// Description:  Inserts a new element into the hash table, replacing the
+//               element with the same key if there is one.
+// Returns:      STATUS - STATUS_HEAP_INSUFFICIENT_RESOURCES if the table is
+//               full and a bigger table could not be allocated
+// Parameter:    INOUT PRH_HASH_TABLE HashTable
+// Parameter:    INOUT PRH_HASH_ENTRY Element
+// Parameter:    OUT_OPT PRH_HASH_ENTRY* PreviousElement - The replaced
+//               element, NULL if there was none
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+RhHashTableInsert(
+    INOUT   PRH_HASH_TABLE              HashTable,
+    INOUT   PRH_HASH_ENTRY              Element,
+    OUT_OPT PRH_HASH_ENTRY*             PreviousElement
+    );
+
+//******************************************************************************
+// Function:     RhHashTableRemove
+// Description:  Removes from the hash table the element with key Key.
+// Returns:      PRH_HASH_ENTRY - NULL if no element with Key present
+// Parameter:    INOUT PRH_HASH_TABLE HashTable
+// Parameter:    IN PHASH_KEY Key
+//******************************************************************************
+PTR_SUCCESS
+PRH_HASH_ENTRY
+RhHashTableRemove(
+    INOUT   PRH_HASH_TABLE              HashTable,
+    IN      PHASH_KEY                   Key
+    );
+
+void
+RhHashTableRemoveEntry(
+    INOUT   PRH_HASH_TABLE              HashTable,
+    IN      PRH_HASH_ENTRY              Element
+    );
+
+//******************************************************************************
+// Function:     RhHashTableLookup
+// Description:  Searches for the element with key Key in the hash table.
+// Returns:      PRH_HASH_ENTRY - NULL if no element with Key present
+// Parameter:    IN PRH_HASH_TABLE HashTable
+// Parameter:    IN PHASH_KEY Key
+// NOTE:         Lookups never modify the table => they may run concurrently
+//               as long as no insertion or removal runs at the same time.
+//******************************************************************************
+PTR_SUCCESS
+PRH_HASH_ENTRY
+RhHashTableLookup(
+    IN      PRH_HASH_TABLE              HashTable,
+    IN      PHASH_KEY                   Key
+    );
+
+//******************************************************************************
+// Function:     RhHashTableIteratorInit
+// Description:  Initializes an iterator over the hash table.
+// Returns:      void
+// Parameter:    IN PRH_HASH_TABLE HashTable
+// Parameter:    OUT PRH_HASH_ITERATOR HashIterator
+// NOTE:         Removals shift the elements between slots => unlike for
+//               HASH_TABLE the table must not be modified while iterating.
+//******************************************************************************
+void
+RhHashTableIteratorInit(
+    IN      PRH_HASH_TABLE              HashTable,
+    OUT     PRH_HASH_ITERATOR           HashIterator
+    );
+
+PRH_HASH_ENTRY
+RhHashTableIteratorNext(
+    INOUT   PRH_HASH_ITERATOR           HashIterator
+    );
+C_HEADER_END
@@ -64,4 +64,7 @@
 // return types
 #define RET_NOT_NULL                                _Ret_notnull_
 
-#include "sal_intrinsic.h"
\ No newline at end of file
+// the host build maps the intrinsics to compiler builtins in host_compat.h
+#ifndef CL_HOST_BUILD
+#include "sal_intrinsic.h"
+#endif
\ No newline at end of file
@@ -34,6 +34,34 @@ __movsq(
     IN                                          QWORD   Count
     );
 
+void
+__stosb(
+    OUT_WRITES_BYTES_ALL(Count)                 PBYTE   Destination,
+    IN                                          BYTE    Data,
+    IN                                          QWORD   Count
+    );
+
+void
+__stosq(
+    OUT_WRITES_BYTES_ALL(Count*sizeof(QWORD))   PQWORD  Destination,
+    IN                                          QWORD   Data,
+    IN                                          QWORD   Count
+    );
+
+_Success_(return != 0)
+unsigned char
+_BitScanForward64(
+    OUT  unsigned long*     Index,
+    IN   unsigned __int64   Mask
+    );
+
+_Success_(return != 0)
+unsigned char
+_BitScanReverse64(
+    OUT  unsigned long*     Index,
+    IN   unsigned __int64   Mask
+    );
+
 _Success_(return == 0)
 VMX_RESULT
 __vmx_vmread(
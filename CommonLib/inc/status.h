@@ -1,7 +1,7 @@
 #pragma once
 
 // every error status code has the MSB set to 1
-#define FAIL_MASK                                       (1<<31)
+#define FAIL_MASK                                       (1UL<<31)
 #define WARNING_MASK                                    (1<<30)
 #define INFO_MASK                                       (1<<29)
 
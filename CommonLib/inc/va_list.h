@@ -1,5 +1,13 @@
 #pragma once
 
+#ifdef CL_HOST_BUILD
+// The host ABI passes the first variadic arguments in registers => the walk
+// over the stack below cannot be used, rely on the compiler instead
+typedef __builtin_va_list   va_list;
+
+#define va_start(List,LastArg)  __builtin_va_start(List,LastArg)
+#define va_arg(List,Type)       __builtin_va_arg(List,Type)
+#else
 typedef PBYTE               va_list;
 
 #define STACKITEM_SIZE      sizeof(PVOID)
@@ -11,4 +19,5 @@ typedef PBYTE               va_list;
 // Retrieves the value of the next argument
 // And increases the List pointer
 #define va_arg(List, Type)	\
-	((List) += STACKITEM_SIZE, *((Type *)((List) - STACKITEM_SIZE)))
\ No newline at end of file
+	((List) += STACKITEM_SIZE, *((Type *)((List) - STACKITEM_SIZE)))
+#endif // CL_HOST_BUILD
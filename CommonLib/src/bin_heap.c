@@ -0,0 +1,306 @@
+#include "common_lib.h"
+#include "bin_heap.h"
+
+#define BIN_HEAP_MIN_CAPACITY           8
+
+// the size of the array is a DWORD
+#define BIN_HEAP_MAX_CAPACITY           (MAX_DWORD / (DWORD) sizeof(PBIN_HEAP_ENTRY))
+
+#define BinHeapParent(Index)            (((Index) - 1) / 2)
+#define BinHeapLeftChild(Index)         (2 * (Index) + 1)
+
+__forceinline
+static
+void
+_BinHeapPlace(
+    INOUT   PBIN_HEAP               Heap,
+    IN      PBIN_HEAP_ENTRY         Element,
+    IN      DWORD                   Index
+    )
+{
+    Heap->Elements[Index] = Element;
+    Element->Index = Index;
+}
+
+// Moves the parents smaller than Element one level down until the position of
+// Element is found, the element is written only once
+static
+void
+_BinHeapSiftUp(
+    INOUT   PBIN_HEAP               Heap,
+    IN      PBIN_HEAP_ENTRY         Element,
+    IN      DWORD                   Index
+    )
+{
+    DWORD index = Index;
+
+    while (index > 0)
+    {
+        DWORD parent = BinHeapParent(index);
+
+        if (Heap->CompareFunc(Element, Heap->Elements[parent]) >= 0)
+        {
+            break;
+        }
+
+        _BinHeapPlace(Heap, Heap->Elements[parent], index);
+        index = parent;
+    }
+
+    _BinHeapPlace(Heap, Element, index);
+}
+
+static
+void
+_BinHeapSiftDown(
+    INOUT   PBIN_HEAP               Heap,
+    IN      PBIN_HEAP_ENTRY         Element,
+    IN      DWORD                   Index
+    )
+{
+    DWORD index = Index;
+    DWORD child;
+
+    // the indexes fit in a DWORD as long as the capacity is at most MAX_DWORD / 8
+    while ((child = BinHeapLeftChild(index)) < Heap->NumberOfElements)
+    {
+        if (child + 1 < Heap->NumberOfElements &&
+            Heap->CompareFunc(Heap->Elements[child + 1], Heap->Elements[child]) < 0)
+        {
+            child = child + 1;
+        }
+
+        if (Heap->CompareFunc(Heap->Elements[child], Element) >= 0)
+        {
+            break;
+        }
+
+        _BinHeapPlace(Heap, Heap->Elements[child], index);
+        index = child;
+    }
+
+    _BinHeapPlace(Heap, Element, index);
+}
+
+static
+STATUS
+_BinHeapGrow(
+    INOUT   PBIN_HEAP               Heap
+    )
+{
+    PBIN_HEAP_ENTRY* pElements;
+    DWORD capacity;
+
+    if (Heap->Capacity > BIN_HEAP_MAX_CAPACITY / 2)
+    {
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    capacity = Heap->Capacity * 2;
+
+    pElements = Heap->AllocFunc(capacity * (DWORD) sizeof(PBIN_HEAP_ENTRY), Heap->AllocContext);
+    if (pElements == NULL)
+    {
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    memcpy(pElements, Heap->Elements, Heap->NumberOfElements * sizeof(PBIN_HEAP_ENTRY));
+
+    Heap->FreeFunc(Heap->Elements, Heap->AllocContext);
+
+    Heap->Elements = pElements;
+    Heap->Capacity = capacity;
+
+    return STATUS_SUCCESS;
+}
+
+SAL_SUCCESS
+STATUS
+BinHeapInit(
+    OUT     PBIN_HEAP                       Heap,
+    IN      DWORD                           InitialCapacity,
+    IN      PFUNC_BinHeapCompareFunction    CompareFunction,
+    IN      PFUNC_BinHeapAllocFunction      AllocFunction,
+    IN      PFUNC_FreeFunction              FreeFunction,
+    IN_OPT  PVOID                           AllocContext
+    )
+{
+    DWORD capacity;
+
+    if (Heap == NULL)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (InitialCapacity > BIN_HEAP_MAX_CAPACITY)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (CompareFunction == NULL)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (AllocFunction == NULL)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (FreeFunction == NULL)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    capacity = max(InitialCapacity, BIN_HEAP_MIN_CAPACITY);
+
+    memzero(Heap, sizeof(BIN_HEAP));
+
+    Heap->Elements = AllocFunction(capacity * (DWORD) sizeof(PBIN_HEAP_ENTRY), AllocContext);
+    if (Heap->Elements == NULL)
+    {
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    Heap->CompareFunc = CompareFunction;
+    Heap->AllocFunc = AllocFunction;
+    Heap->FreeFunc = FreeFunction;
+    Heap->AllocContext = AllocContext;
+    Heap->Capacity = capacity;
+
+    return STATUS_SUCCESS;
+}
+
+void
+BinHeapUninit(
+    INOUT   PBIN_HEAP                       Heap
+    )
+{
+    ASSERT(Heap != NULL);
+
+    if (Heap->Elements != NULL)
+    {
+        Heap->FreeFunc(Heap->Elements, Heap->AllocContext);
+        Heap->Elements = NULL;
+    }
+
+    Heap->NumberOfElements = 0;
+    Heap->Capacity = 0;
+}
+
+DWORD
+BinHeapSize(
+    IN      PBIN_HEAP                       Heap
+    )
+{
+    ASSERT(Heap != NULL);
+
+    return Heap->NumberOfElements;
+}
+
+SAL_SUCCESS
+STATUS
+BinHeapInsert(
+    INOUT   PBIN_HEAP                       Heap,
+    INOUT   PBIN_HEAP_ENTRY                 Element
+    )
+{
+    ASSERT(Heap != NULL);
+    ASSERT(Element != NULL);
+
+    if (Heap->NumberOfElements == Heap->Capacity)
+    {
+        STATUS status = _BinHeapGrow(Heap);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+    }
+
+    Heap->NumberOfElements++;
+
+    _BinHeapSiftUp(Heap, Element, Heap->NumberOfElements - 1);
+
+    return STATUS_SUCCESS;
+}
+
+PTR_SUCCESS
+PBIN_HEAP_ENTRY
+BinHeapPeekMin(
+    IN      PBIN_HEAP                       Heap
+    )
+{
+    ASSERT(Heap != NULL);
+
+    return (Heap->NumberOfElements != 0) ? Heap->Elements[0] : NULL;
+}
+
+PTR_SUCCESS
+PBIN_HEAP_ENTRY
+BinHeapExtractMin(
+    INOUT   PBIN_HEAP                       Heap
+    )
+{
+    PBIN_HEAP_ENTRY pMin;
+
+    ASSERT(Heap != NULL);
+
+    if (Heap->NumberOfElements == 0)
+    {
+        return NULL;
+    }
+
+    pMin = Heap->Elements[0];
+
+    BinHeapRemoveEntry(Heap, pMin);
+
+    return pMin;
+}
+
+void
+BinHeapRemoveEntry(
+    INOUT   PBIN_HEAP                       Heap,
+    INOUT   PBIN_HEAP_ENTRY                 Element
+    )
+{
+    PBIN_HEAP_ENTRY pLast;
+    DWORD index;
+
+    ASSERT(Heap != NULL);
+    ASSERT(Element != NULL);
+
+    index = Element->Index;
+    ASSERT(index < Heap->NumberOfElements && Heap->Elements[index] == Element);
+
+    Heap->NumberOfElements--;
+    pLast = Heap->Elements[Heap->NumberOfElements];
+
+    if (pLast == Element)
+    {
+        return;
+    }
+
+    // the last element takes the place of the removed one, it may need to go
+    // either way because it comes from another subtree
+    if (index > 0 && Heap->CompareFunc(pLast, Heap->Elements[BinHeapParent(index)]) < 0)
+    {
+        _BinHeapSiftUp(Heap, pLast, index);
+    }
+    else
+    {
+        _BinHeapSiftDown(Heap, pLast, index);
+    }
+}
+
+void
+BinHeapDecreaseKey(
+    INOUT   PBIN_HEAP                       Heap,
+    INOUT   PBIN_HEAP_ENTRY                 Element
+    )
+{
+    ASSERT(Heap != NULL);
+    ASSERT(Element != NULL);
+    ASSERT(Element->Index < Heap->NumberOfElements && Heap->Elements[Element->Index] == Element);
+
+    _BinHeapSiftUp(Heap, Element, Element->Index);
+}
@@ -5,6 +5,9 @@
 // BITS_FOR_STRUCTURE for each index calculation
 #define BITMAP_ENTRY_BITS           8
 
+// scans are done a QWORD at a time
+#define BITMAP_WORD_BITS            (sizeof(QWORD) * BITMAP_ENTRY_BITS)
+
 static
 void
 _BitmapChangeBit(
@@ -29,6 +32,23 @@ _BitmapGetBit(
     IN          DWORD       Index
     );
 
+static
+QWORD
+_BitmapGetWord(
+    IN          PBITMAP     Bitmap,
+    IN          DWORD       WordIndex
+    );
+
+static
+SIZE_SUCCESS
+DWORD
+_BitmapFindNextBit(
+    IN          PBITMAP     Bitmap,
+    IN          DWORD       StartIndex,
+    IN          DWORD       FirstInvalidBitIndex,
+    IN          BOOLEAN     Set
+    );
+
 static
 SIZE_SUCCESS
 DWORD
@@ -282,11 +302,65 @@ _BitmapChangeBits(
     IN          DWORD       Count
     )
 {
+    DWORD firstByte;
+    DWORD lastByte;
+    BYTE firstMask;
+    BYTE lastMask;
     DWORD i;
+    QWORD value;
+
+    ASSERT(NULL != BitmapBuffer);
+
+    if (0 == Count)
+    {
+        return;
+    }
+
+    firstByte = Index / BITMAP_ENTRY_BITS;
+    lastByte = (Index + Count - 1) / BITMAP_ENTRY_BITS;
+
+    firstMask = (BYTE) (MAX_BYTE << (Index % BITMAP_ENTRY_BITS));
+    lastMask = (BYTE) (MAX_BYTE >> (BITMAP_ENTRY_BITS - 1 - (Index + Count - 1) % BITMAP_ENTRY_BITS));
+
+    if (firstByte == lastByte)
+    {
+        firstMask = firstMask & lastMask;
+    }
+
+    if (Set)
+    {
+        BitmapBuffer[firstByte] |= firstMask;
+    }
+    else
+    {
+        BitmapBuffer[firstByte] &= ~firstMask;
+    }
+
+    if (firstByte == lastByte)
+    {
+        return;
+    }
 
-    for (i = 0; i < Count; ++i)
+    // all the bytes between the first and the last one are changed entirely,
+    // a QWORD at a time for as long as possible
+    value = Set ? MAX_QWORD : 0;
+    for (i = firstByte + 1; i + sizeof(QWORD) <= lastByte; i += sizeof(QWORD))
     {
-        _BitmapChangeBit(BitmapBuffer, Index + i, Set);
+        *((PQWORD)&BitmapBuffer[i]) = value;
+    }
+
+    for (; i < lastByte; ++i)
+    {
+        BitmapBuffer[i] = (BYTE) value;
+    }
+
+    if (Set)
+    {
+        BitmapBuffer[lastByte] |= lastMask;
+    }
+    else
+    {
+        BitmapBuffer[lastByte] &= ~lastMask;
     }
 }
 
@@ -308,6 +382,91 @@ _BitmapGetBit(
     return IsBooleanFlagOn( BitmapBuffer[byteIndex], ( (BYTE) 1 << bitIndex ) );
 }
 
+static
+QWORD
+_BitmapGetWord(
+    IN          PBITMAP     Bitmap,
+    IN          DWORD       WordIndex
+    )
+{
+    QWORD byteIndex;
+    QWORD result;
+    DWORD i;
+
+    ASSERT(NULL != Bitmap);
+
+    byteIndex = (QWORD) WordIndex * sizeof(QWORD);
+    ASSERT(byteIndex < Bitmap->BufferSize);
+
+    if (byteIndex + sizeof(QWORD) <= Bitmap->BufferSize)
+    {
+        return *((PQWORD)&Bitmap->BitmapBuffer[byteIndex]);
+    }
+
+    // the buffer size is not necessarily a multiple of sizeof(QWORD) => the
+    // last word must be built byte by byte so we don't read past the buffer
+    result = 0;
+    for (i = 0; byteIndex + i < Bitmap->BufferSize; ++i)
+    {
+        result = result | ((QWORD) Bitmap->BitmapBuffer[byteIndex + i] << (i * BITMAP_ENTRY_BITS));
+    }
+
+    return result;
+}
+
+static
+SIZE_SUCCESS
+DWORD
+_BitmapFindNextBit(
+    IN          PBITMAP     Bitmap,
+    IN          DWORD       StartIndex,
+    IN          DWORD       FirstInvalidBitIndex,
+    IN          BOOLEAN     Set
+    )
+{
+    DWORD wordIndex;
+    DWORD lastWordIndex;
+    QWORD invertMask;
+    QWORD word;
+    QWORD result;
+    unsigned long bitIndex;
+
+    ASSERT(NULL != Bitmap);
+    ASSERT(FirstInvalidBitIndex <= Bitmap->BitCount);
+
+    if (StartIndex >= FirstInvalidBitIndex)
+    {
+        return MAX_DWORD;
+    }
+
+    // we always search for set bits, if we're looking for cleared bits we
+    // invert each word read from the bitmap
+    invertMask = Set ? 0 : MAX_QWORD;
+
+    wordIndex = StartIndex / BITMAP_WORD_BITS;
+    lastWordIndex = (FirstInvalidBitIndex - 1) / BITMAP_WORD_BITS;
+
+    // discard the bits preceding StartIndex
+    word = (_BitmapGetWord(Bitmap, wordIndex) ^ invertMask) & (MAX_QWORD << (StartIndex % BITMAP_WORD_BITS));
+
+    // words in which no bit has the value we're searching for are skipped
+    // entirely
+    while (!_BitScanForward64(&bitIndex, word))
+    {
+        if (wordIndex == lastWordIndex)
+        {
+            return MAX_DWORD;
+        }
+
+        wordIndex++;
+        word = _BitmapGetWord(Bitmap, wordIndex) ^ invertMask;
+    }
+
+    result = (QWORD) wordIndex * BITMAP_WORD_BITS + bitIndex;
+
+    return result < FirstInvalidBitIndex ? (DWORD) result : MAX_DWORD;
+}
+
 static
 SIZE_SUCCESS
 DWORD
@@ -319,10 +478,9 @@ _BitmapScanInternal(
     IN          BOOLEAN     Set
     )
 {
-    DWORD i, j;
+    DWORD i;
     DWORD lastIndex;
-    DWORD firstIndex;
-    BOOLEAN found;
+    DWORD runEnd;
 
     ASSERT( NULL != Bitmap );
     ASSERT( 0 != ConsecutiveBits );
@@ -336,26 +494,28 @@ _BitmapScanInternal(
     }
 
     lastIndex = FirstInvalidBitIndex - ConsecutiveBits;
-    firstIndex = StartIndex;
-    found = FALSE;
+    i = StartIndex;
 
-    for (i = firstIndex; i <= lastIndex; ++i)
+    while (i <= lastIndex)
     {
-        found = TRUE;
-        for (j = 0; j < ConsecutiveBits; ++j)
+        // find where the next candidate run starts
+        i = _BitmapFindNextBit(Bitmap, i, lastIndex + 1, Set);
+        if (MAX_DWORD == i)
         {
-            if (Set != _BitmapGetBit(Bitmap->BitmapBuffer, i + j))
-            {
-                found = FALSE;
-                break;
-            }
+            return MAX_DWORD;
         }
 
-        if (found)
+        // search for the first bit which breaks the run, if there is none we
+        // found our bits
+        runEnd = _BitmapFindNextBit(Bitmap, i, i + ConsecutiveBits, !Set);
+        if (MAX_DWORD == runEnd)
         {
             return i;
         }
+
+        // no run containing runEnd can satisfy the request
+        i = runEnd + 1;
     }
 
     return MAX_DWORD;
-}
\ No newline at end of file
+}
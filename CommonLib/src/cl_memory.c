@@ -1,8 +1,66 @@
 #include "common_lib.h"
 #include "cl_memory.h"
+#include <emmintrin.h>
 
 extern void CpuClearDirectionFlag();
 
+// This version of the library runs in processes of the host OS which preserves
+// the SSE state => unlike memory.c it can use the XMM registers
+
+// Below this size the start-up cost of the string instructions is higher than
+// the cost of moving 16 bytes at a time through the XMM registers
+#define CL_MEMORY_FAST_STRING_THRESHOLD     512
+
+#define CL_MEMORY_CPUID_FEATURE_LEAF        1
+#define CL_MEMORY_CPUID_SSE2_BIT            (1UL << 26)
+
+#define CL_MEMORY_CPUID_STRUCTURED_LEAF     7
+#define CL_MEMORY_CPUID_ERMS_BIT            (1UL << 9)
+
+#define CL_MEMORY_XMM_SIZE                  ((DWORD) sizeof(__m128i))
+#define CL_MEMORY_XMM_MASK_ALL              0xFFFF
+
+static BOOLEAN m_clMemoryUseFastStrings = FALSE;
+static BOOLEAN m_clMemoryUseSse2 = FALSE;
+
+__forceinline
+static
+DWORD
+_ClMemoryFirstClearBit(
+    IN          DWORD       Mask
+    )
+{
+    unsigned long bitIndex;
+
+    _BitScanForward64(&bitIndex, (~Mask) & CL_MEMORY_XMM_MASK_ALL);
+
+    return bitIndex;
+}
+
+void
+cl_MemoryInitFeatures(
+    void
+    )
+{
+    int cpuInfo[4];
+    DWORD maxLeaf;
+
+    __cpuid(cpuInfo, 0);
+    maxLeaf = (DWORD) cpuInfo[0];
+
+    if (maxLeaf >= CL_MEMORY_CPUID_FEATURE_LEAF)
+    {
+        __cpuid(cpuInfo, CL_MEMORY_CPUID_FEATURE_LEAF);
+        m_clMemoryUseSse2 = IsBooleanFlagOn((DWORD) cpuInfo[3], CL_MEMORY_CPUID_SSE2_BIT);
+    }
+
+    if (maxLeaf >= CL_MEMORY_CPUID_STRUCTURED_LEAF)
+    {
+        __cpuidex(cpuInfo, CL_MEMORY_CPUID_STRUCTURED_LEAF, 0);
+        m_clMemoryUseFastStrings = IsBooleanFlagOn((DWORD) cpuInfo[1], CL_MEMORY_CPUID_ERMS_BIT);
+    }
+}
+
 _At_buffer_( address, i, size, _Post_satisfies_( ((PBYTE)address)[i] == value ))
 void
 cl_memset(
@@ -12,6 +70,7 @@ cl_memset(
     )
 {
     DWORD i;
+    PBYTE dst;
 
     // validate parameters
     // size validation is done implicitly in the for loop
@@ -20,9 +79,31 @@ cl_memset(
         return;
     }
 
-    for (i = 0; i < size; ++i)
+    dst = address;
+    i = 0;
+
+    if (m_clMemoryUseFastStrings && size >= CL_MEMORY_FAST_STRING_THRESHOLD)
+    {
+        CpuClearDirectionFlag();
+
+        __stosb(dst, value, size);
+
+        return;
+    }
+
+    if (m_clMemoryUseSse2)
+    {
+        __m128i pattern = _mm_set1_epi8((char) value);
+
+        for (; i + CL_MEMORY_XMM_SIZE <= size; i = i + CL_MEMORY_XMM_SIZE)
+        {
+            _mm_storeu_si128((__m128i*) &dst[i], pattern);
+        }
+    }
+
+    for (; i < size; ++i)
     {
-        ((BYTE*)address)[i] = value;
+        dst[i] = value;
     }
 }
 
@@ -45,6 +126,15 @@ cl_memcpy(
         return;
     }
 
+    if (m_clMemoryUseFastStrings && Count >= CL_MEMORY_FAST_STRING_THRESHOLD)
+    {
+        CpuClearDirectionFlag();
+
+        __movsb(Destination, Source, Count);
+
+        return;
+    }
+
     unalignedCount = Count & 0x7;
     alignedCount = Count - unalignedCount;
 
@@ -106,9 +196,37 @@ cl_memmove(
     dst = Destination;
     src = Source;
 
-    for (i = 0; i < Count; ++i)
+    // cl_memcpy copies from the lowest address up, each chunk is read before
+    // any byte of it is overwritten => it is safe if the destination is below
+    // the source
+    if (dst <= src || dst >= src + Count)
+    {
+        cl_memcpy(Destination, Source, Count);
+        return;
+    }
+
+    // the destination overlaps the end of the source => copy backwards, each
+    // chunk is loaded before it is stored
+    i = Count;
+
+    if (m_clMemoryUseSse2)
+    {
+        for (; i >= CL_MEMORY_XMM_SIZE; i = i - CL_MEMORY_XMM_SIZE)
+        {
+            __m128i data = _mm_loadu_si128((const __m128i*) &src[i - CL_MEMORY_XMM_SIZE]);
+
+            _mm_storeu_si128((__m128i*) &dst[i - CL_MEMORY_XMM_SIZE], data);
+        }
+    }
+
+    for (; i >= sizeof(QWORD); i = i - sizeof(QWORD))
     {
-        dst[i] = src[i];
+        *((PQWORD) &dst[i - sizeof(QWORD)]) = *((const QWORD*) &src[i - sizeof(QWORD)]);
+    }
+
+    for (; i > 0; --i)
+    {
+        dst[i - 1] = src[i - 1];
     }
 }
 
@@ -132,8 +250,24 @@ cl_memcmp(
 
     p1 = ptr1;
     p2 = ptr2;
+    i = 0;
+
+    if (m_clMemoryUseSse2)
+    {
+        for (; i + (INT64) CL_MEMORY_XMM_SIZE <= size; i = i + CL_MEMORY_XMM_SIZE)
+        {
+            DWORD mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) &p1[i]),
+                                                          _mm_loadu_si128((const __m128i*) &p2[i])));
+
+            if (CL_MEMORY_XMM_MASK_ALL != mask)
+            {
+                i = i + _ClMemoryFirstClearBit(mask);
+                return p1[i] - p2[i];
+            }
+        }
+    }
 
-    for (i = 0; i < size; ++i)
+    for (; i < size; ++i)
     {
         if (p1[i] != p2[i])
         {
@@ -192,8 +326,25 @@ cl_memscan(
     }
 
     pData = buffer;
+    i = 0;
+
+    if (m_clMemoryUseSse2)
+    {
+        __m128i pattern = _mm_set1_epi8((char) value);
+
+        for (; i + CL_MEMORY_XMM_SIZE <= size; i = i + CL_MEMORY_XMM_SIZE)
+        {
+            DWORD mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) &pData[i]), pattern));
+
+            if (CL_MEMORY_XMM_MASK_ALL != mask)
+            {
+                // game over
+                return i + _ClMemoryFirstClearBit(mask);
+            }
+        }
+    }
 
-    for (i = 0; i < size; ++i)
+    for (; i < size; ++i)
     {
         if (pData[i] != value)
         {
@@ -1,18 +1,150 @@
 #include "common_lib.h"
 #include "cl_string.h"
 #include "strutils.h"
+#include "swar.h"
+#include <emmintrin.h>
 
 // 64 characters needed in case of %B specifier
 // with NULL terminator => 65 characters are required
 #define VSNPRINTF_BUFFER_SIZE               65
 
+// This version of the library runs in processes of the host OS which preserves
+// the SSE state => the scans which don't need the position of the last match
+// look at 16 bytes at a time, SSE2 is part of the x64 baseline
+#define CL_STRING_XMM_SIZE                  ((DWORD) sizeof(__m128i))
+#define CL_STRING_XMM_MASK_ALL              0xFFFF
+
+__forceinline
+static
+DWORD
+_ClStrFirstSetBit(
+    IN          DWORD       Mask
+    )
+{
+    unsigned long bitIndex;
+
+    _BitScanForward64(&bitIndex, Mask);
+
+    return bitIndex;
+}
+
+//******************************************************************************
+// Function:     _ClStrFindCharOrEnd
+// Description:  Returns the index of the first occurrence of c in str or the
+//               index of the NULL terminator if c is not found.
+// Returns:      QWORD
+// Parameter:    IN_Z char* str
+// Parameter:    IN char c
+// NOTE:         The string is read 16 bytes at a time from an aligned address,
+//               an aligned block never crosses a page boundary so the bytes
+//               read past the terminator are always mapped.
+//******************************************************************************
+static
+QWORD
+_ClStrFindCharOrEnd(
+    IN_Z    char*   str,
+    IN      char    c
+    )
+{
+    const __m128i* pBlock;
+    __m128i zero;
+    __m128i pattern;
+    __m128i block;
+    QWORD offset;
+    DWORD mask;
+
+    offset = (QWORD)str & (CL_STRING_XMM_SIZE - 1);
+    pBlock = (const __m128i*)(str - offset);
+    zero = _mm_setzero_si128();
+    pattern = _mm_set1_epi8(c);
+
+    // the bytes preceding the string in the first block are ignored
+    block = _mm_load_si128(pBlock);
+    mask = (DWORD)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, zero),
+                                                 _mm_cmpeq_epi8(block, pattern)));
+    mask = mask & ((CL_STRING_XMM_MASK_ALL << offset) & CL_STRING_XMM_MASK_ALL);
+
+    while (0 == mask)
+    {
+        pBlock = pBlock + 1;
+        block = _mm_load_si128(pBlock);
+        mask = (DWORD)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, zero),
+                                                     _mm_cmpeq_epi8(block, pattern)));
+    }
+
+    return (PBYTE)pBlock + _ClStrFirstSetBit(mask) - (PBYTE)str;
+}
+
+//******************************************************************************
+// Function:     _ClStrFirstMismatch
+// Description:  Returns the first index at which the strings differ or at
+//               which str1 ends, at most maxLen.
+// Returns:      QWORD
+// Parameter:    IN_Z char* str1
+// Parameter:    IN_Z char* str2
+// Parameter:    IN QWORD maxLen
+// NOTE:         The two strings are usually not equally aligned => unaligned
+//               QWORDs are read but only up to the end of the current page of
+//               either string, the bytes before the boundary are compared one
+//               at a time.
+//******************************************************************************
+static
+QWORD
+_ClStrFirstMismatch(
+    IN_Z    char*   str1,
+    IN_Z    char*   str2,
+    IN      QWORD   maxLen
+    )
+{
+    QWORD i;
+
+    i = 0;
+
+    while (i < maxLen)
+    {
+        QWORD pageLeft1 = SWAR_PAGE_SIZE - ((QWORD)&str1[i] & (SWAR_PAGE_SIZE - 1));
+        QWORD pageLeft2 = SWAR_PAGE_SIZE - ((QWORD)&str2[i] & (SWAR_PAGE_SIZE - 1));
+        QWORD chunkEnd = i + min(min(pageLeft1, pageLeft2), maxLen - i);
+
+        while (i + sizeof(QWORD) <= chunkEnd)
+        {
+            QWORD word1 = *((PQWORD)&str1[i]);
+            QWORD word2 = *((PQWORD)&str2[i]);
+
+            // the bytes which differ and the terminators of the first string,
+            // if the second string ends first its terminator differs from the
+            // byte of the first string
+            QWORD mask = (SwarZeroBytes(word1 ^ word2) ^ SWAR_HIGH_BITS) | SwarZeroBytes(word1);
+
+            if (0 != mask)
+            {
+                return i + SwarFirstByte(mask);
+            }
+
+            i = i + sizeof(QWORD);
+        }
+
+        while (i < chunkEnd)
+        {
+            if ((str1[i] != str2[i]) || ('\0' == str1[i]))
+            {
+                return i;
+            }
+
+            ++i;
+        }
+    }
+
+    return maxLen;
+}
+
 int
 cl_strcmp(
     IN_Z  char* str1,
     IN_Z  char* str2
     )
 {
-    DWORD i;
+    QWORD i;
 
     if (NULL == str1)
     {
@@ -24,31 +156,26 @@ cl_strcmp(
         return STATUS_INVALID_PARAMETER2;
     }
 
-    i = 0;
+    i = _ClStrFirstMismatch(str1, str2, MAX_QWORD);
 
-    while (('\0' != str1[i]) && ('\0' != str2[i]))
+    // it means the second string is over but the first still has
+    // some characters
+    if ('\0' == str2[i] && '\0' != str1[i])
     {
-        if (str1[i] > str2[i])
-        {
-            return 1;
-        }
-
-        if (str1[i] < str2[i])
-        {
-            return -1;
-        }
+        return 1;
+    }
 
-        ++i;
+    if ('\0' == str1[i] && '\0' != str2[i])
+    {
+        return -1;
     }
 
-    // it means the second string is over but the first still has
-    // some characters
-    if ('\0' != str1[i])
+    if (str1[i] > str2[i])
     {
         return 1;
     }
 
-    if ('\0' != str2[i])
+    if (str1[i] < str2[i])
     {
         return -1;
     }
@@ -116,7 +243,7 @@ cl_strncmp(
     IN  DWORD length
     )
 {
-    DWORD i;
+    QWORD i;
 
     if (NULL == str1)
     {
@@ -133,20 +260,7 @@ cl_strncmp(
         return STATUS_INVALID_PARAMETER3;
     }
 
-    i = 0;
-
-    for (i = 0; i < length && '\0' != str1[i] && '\0' != str2[i]; ++i)
-    {
-        if (str1[i] > str2[i])
-        {
-            return 1;
-        }
-
-        if (str1[i] < str2[i])
-        {
-            return -1;
-        }
-    }
+    i = _ClStrFirstMismatch(str1, str2, length);
 
     if (i == length)
     {
@@ -154,6 +268,11 @@ cl_strncmp(
         return 0;
     }
 
+    if ('\0' != str1[i] && '\0' != str2[i])
+    {
+        return (str1[i] > str2[i]) ? 1 : -1;
+    }
+
     if ('\0' != str1[i])
     {
         // string 1 is bigger
@@ -229,25 +348,16 @@ cl_strchr(
     IN  char c
     )
 {
-    DWORD i;
+    QWORD i;
 
     if (NULL == str)
     {
         return NULL;
     }
 
-    i = 0;
+    i = _ClStrFindCharOrEnd(str, c);
 
-    while ('\0' != str[i])
-    {
-        if (str[i] == c)
-        {
-            return (str + i);
-        }
-        ++i;
-    }
-
-    return str;
+    return ('\0' != str[i]) ? (str + i) : str;
 }
 
 const
@@ -257,24 +367,49 @@ cl_strrchr(
     IN  char c
     )
 {
-    DWORD i;
+    const QWORD* pWord;
     const char* charIndex;
+    QWORD offset;
+    QWORD pattern;
+    QWORD ignoredBytes;
 
     if (NULL == str)
     {
         return NULL;
     }
 
-    i = 0;
     charIndex = str;
+    offset = (QWORD)str & (sizeof(QWORD) - 1);
+    pWord = (const QWORD*)(str - offset);
+    pattern = SwarBroadcast(c);
+    ignoredBytes = SwarBytesBelow(offset);
 
-    while ('\0' != str[i])
+    for (;;)
     {
-        if (str[i] == c)
+        QWORD word = *pWord;
+        QWORD zeroMask = SwarZeroBytes(word) & ~ignoredBytes;
+        QWORD matchMask = SwarZeroBytes(word ^ pattern) & ~ignoredBytes;
+
+        if (0 != zeroMask)
         {
-            charIndex = (str + i);
+            // only the matches before the terminator count
+            DWORD terminatorIndex = SwarFirstByte(zeroMask);
+
+            matchMask = matchMask & SwarBytesBelow(terminatorIndex);
         }
-        ++i;
+
+        if (0 != matchMask)
+        {
+            charIndex = (const char*)pWord + SwarLastByte(matchMask);
+        }
+
+        if (0 != zeroMask)
+        {
+            break;
+        }
+
+        ignoredBytes = 0;
+        pWord = pWord + 1;
     }
 
     return charIndex;
@@ -286,20 +421,11 @@ cl_strcpy(
     IN_Z  char* src
     )
 {
-    DWORD i;
-
     ASSERT( NULL != dst );
     ASSERT( NULL != src );
 
-    i = 0;
-
-    while ('\0' != src[i])
-    {
-        dst[i] = src[i];
-        ++i;
-    }
-
-    dst[i] = '\0';
+    // copy the NULL terminator too
+    cl_memcpy(dst, src, cl_strlen(src) + 1);
 }
 
 void
@@ -315,12 +441,9 @@ cl_strncpy(
     ASSERT( NULL != src );
     ASSERT( 0 != length );
 
-    i = 0;
+    i = cl_strlen_s(src, length);
 
-    for (i = 0; i < length && src[i] != '\0'; ++i)
-    {
-        dst[i] = src[i];
-    }
+    cl_memcpy(dst, src, i);
 
     dst[i] = '\0';
 }
@@ -331,21 +454,32 @@ cl_strlen(
     IN_Z  char* str
     )
 {
-    DWORD i;
+    const __m128i* pBlock;
+    __m128i zero;
+    QWORD offset;
+    DWORD mask;
 
     if (NULL == str)
     {
         return INVALID_STRING_SIZE;
     }
 
-    i = 0;
+    offset = (QWORD)str & (CL_STRING_XMM_SIZE - 1);
+    pBlock = (const __m128i*)(str - offset);
+    zero = _mm_setzero_si128();
 
-    while ('\0' != str[i])
+    // aligned reads never cross a page boundary, the bytes preceding the
+    // string in the first block are ignored
+    mask = (DWORD)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(pBlock), zero));
+    mask = mask & ((CL_STRING_XMM_MASK_ALL << offset) & CL_STRING_XMM_MASK_ALL);
+
+    while (0 == mask)
     {
-        ++i;
+        pBlock = pBlock + 1;
+        mask = (DWORD)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(pBlock), zero));
     }
 
-    return i;
+    return (DWORD)((PBYTE)pBlock + _ClStrFirstSetBit(mask) - (PBYTE)str);
 }
 
 SIZE_SUCCESS
@@ -356,21 +490,45 @@ cl_strlen_s(
     IN          DWORD   maxLen
     )
 {
-    DWORD i;
+    const QWORD* pWord;
+    QWORD offset;
+    QWORD mask;
+    QWORD scanned;
+    QWORD length;
 
     if (NULL == str)
     {
         return INVALID_STRING_SIZE;
     }
 
-    i = 0;
+    if (0 == maxLen)
+    {
+        return 0;
+    }
+
+    offset = (QWORD)str & (sizeof(QWORD) - 1);
+    pWord = (const QWORD*)(str - offset);
 
-    while (i < maxLen && '\0' != str[i])
+    // the QWORD containing the last allowed byte is on the same page as that
+    // byte => reading it whole is safe even if no terminator is found
+    mask = SwarZeroBytes(*pWord) & ~SwarBytesBelow(offset);
+    scanned = sizeof(QWORD) - offset;
+
+    while (0 == mask && scanned < maxLen)
     {
-        ++i;
+        pWord = pWord + 1;
+        mask = SwarZeroBytes(*pWord);
+        scanned = scanned + sizeof(QWORD);
+    }
+
+    if (0 == mask)
+    {
+        return maxLen;
     }
 
-    return i;
+    length = (PBYTE)pWord + SwarFirstByte(mask) - (PBYTE)str;
+
+    return (DWORD) min(length, maxLen);
 }
 
 STATUS
@@ -460,52 +618,55 @@ cl_vsnprintf(
             case 'b':
                 // we have an unsigned 32 bit value to print
                 temp_value = va_arg(argptr, DWORD);
-                itoa(&temp_value, FALSE, temp_str, BASE_TWO, FALSE);
+                temp_len = itoa(&temp_value, FALSE, temp_str, BASE_TWO, FALSE);
                 break;
             case 'B':
                 // we have an unsigned 64 bit value to print
                 temp_value = va_arg(argptr, QWORD);
-                itoa(&temp_value, FALSE, temp_str, BASE_TWO, TRUE);
+                temp_len = itoa(&temp_value, FALSE, temp_str, BASE_TWO, TRUE);
                 break;
             case 'u':
                 // we have an unsigned 32 bit value to print
                 temp_value = va_arg(argptr, DWORD);
-                itoa(&temp_value, FALSE, temp_str, BASE_TEN, FALSE);
+                temp_len = itoa(&temp_value, FALSE, temp_str, BASE_TEN, FALSE);
                 break;
             case 'U':
                 // we have an unsigned 64 bit value to print
                 temp_value = va_arg(argptr, QWORD);
-                itoa(&temp_value, FALSE, temp_str, BASE_TEN, TRUE);
+                temp_len = itoa(&temp_value, FALSE, temp_str, BASE_TEN, TRUE);
                 break;
             case 'd':
                 // we have a signed 32 bit value to print
                 temp_value = va_arg(argptr, DWORD);
-                itoa(&temp_value, TRUE, temp_str, BASE_TEN, FALSE);
+                temp_len = itoa(&temp_value, TRUE, temp_str, BASE_TEN, FALSE);
                 break;
             case 'D':
                 // we have a signed 64 bit value
                 temp_value = va_arg(argptr, QWORD);
-                itoa(&temp_value, TRUE, temp_str, BASE_TEN, TRUE);
+                temp_len = itoa(&temp_value, TRUE, temp_str, BASE_TEN, TRUE);
                 break;
             case 'x':
                 // we have a 32 bit hexadecimal value to print
                 temp_value = va_arg(argptr, DWORD);
-                itoa(&temp_value, FALSE, temp_str, BASE_HEXA, FALSE);
+                temp_len = itoa(&temp_value, FALSE, temp_str, BASE_HEXA, FALSE);
                 break;
             case 'X':
                 // we have a 64 bit hexadecimal value to print
                 temp_value = va_arg(argptr, QWORD);
-                itoa(&temp_value, FALSE, temp_str, BASE_HEXA, TRUE);
+                temp_len = itoa(&temp_value, FALSE, temp_str, BASE_HEXA, TRUE);
                 break;
             case 'c':
-                // we have a character value to print
-                temp_value = va_arg(argptr, char);
+                // we have a character value to print, it was promoted to
+                // an int when it was passed through the ellipsis
+                temp_value = (char) va_arg(argptr, DWORD);
                 cl_strncpy(temp_str, (char*)&temp_value, sizeof(char));
+                temp_len = cl_strlen(temp_str);
                 break;
             case 's':
             case 'S':
                 // we have a string to print
                 temp_str = va_arg(argptr, char*);
+                temp_len = cl_strlen(temp_str);
                 break;
             default:
                 // A parsing error - an incorrect string was supplied =>
@@ -513,7 +674,6 @@ cl_vsnprintf(
                 return STATUS_PARSE_FAILED;
             }
 
-            temp_len = strlen(temp_str);
             ASSERT(temp_len != INVALID_STRING_SIZE);
 
             charsToCopy = (next == 'S') ? min(digits, temp_len) : temp_len;
@@ -539,7 +699,7 @@ cl_vsnprintf(
 
             if (charsToCopy != 0)
             {
-                cl_strncpy(outputBuffer + outBufferOffset, temp_str, charsToCopy);
+                cl_memcpy(outputBuffer + outBufferOffset, temp_str, charsToCopy);
             }
             outBufferOffset = outBufferOffset + charsToCopy;
 
@@ -551,17 +711,22 @@ cl_vsnprintf(
         }
         else
         {
-            if (outBufferOffset + 1 >= buffSize)
+            // copy all the characters up to the next specifier at once
+            DWORD runLength = (DWORD) _ClStrFindCharOrEnd(&inputBuffer[index], '%');
+            DWORD spaceLeft = buffSize - 1 - outBufferOffset;
+
+            if (runLength > spaceLeft)
             {
-                // we don't have any more space
-                outputBuffer[outBufferOffset] = '\0';
+                // we don't have any more space, copy what fits
+                cl_memcpy(outputBuffer + outBufferOffset, &inputBuffer[index], spaceLeft);
+                outputBuffer[outBufferOffset + spaceLeft] = '\0';
                 return STATUS_BUFFER_TOO_SMALL;
             }
 
-            outputBuffer[outBufferOffset] = inputBuffer[index];
+            cl_memcpy(outputBuffer + outBufferOffset, &inputBuffer[index], runLength);
 
-            outBufferOffset++;
-            index++;
+            outBufferOffset = outBufferOffset + runLength;
+            index = index + runLength;
         }
 
     }
@@ -20,6 +20,8 @@ CommonLibInit(
 
     status = STATUS_SUCCESS;
 
+    MemoryInitFeatures();
+
 #ifndef _COMMONLIB_NO_LOCKS_
     LockSystemInit(InitSettings->MonitorSupport);
 #endif // _COMMONLIB_NO_LOCKS_
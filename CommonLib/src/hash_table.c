@@ -11,17 +11,6 @@ typedef struct _HASH_TABLE_DATA
 } HASH_TABLE_DATA, *PHASH_TABLE_DATA;
 #pragma warning(pop)
 
-static FUNC_CompareFunction _HashTableSearchElem;
-
-typedef struct _HASH_ELEM_SEARCH_CTX
-{
-    PHASH_TABLE             HashTable;
-
-    PHASH_ENTRY             PlaceholderEntry;
-
-    INT32                   Result;
-} HASH_ELEM_SEARCH_CTX, *PHASH_ELEM_SEARCH_CTX;
-
 static
 __forceinline
 PHASH_KEY
@@ -46,33 +35,39 @@ _HashTableSearchKeyInBucket(
     OUT_PTR PHASH_ENTRY*        Placeholder
     )
 {
-    PHASH_ENTRY pResult;
-    HASH_ELEM_SEARCH_CTX searchCtx = { 0 };
+    PHASH_ENTRY pCurEntry;
+    INT32 result;
 
     ASSERT(HashTable != NULL);
     ASSERT(Bucket != NULL);
     ASSERT(Key != NULL);
     ASSERT(Placeholder != NULL);
 
-    searchCtx.HashTable = HashTable;
-    searchCtx.PlaceholderEntry = Bucket;
-    searchCtx.Result = 0;
+    // The buckets are kept ordered by key => the search stops at the first
+    // element which is not smaller than Key and a new element would be
+    // inserted after the last smaller one (or after the bucket head)
+    *Placeholder = Bucket;
 
-    // ListSearchForElement takes as the second argument (entry to compare with) a HASH_ENTRY, however because the only
-    // place that parameter is used is in our own _HashTableSearchElem function we do a 'hackish' optimization so as
-    // not to perform two extra operations
-    pResult = ListSearchForElement(Bucket, (PHASH_ENTRY) Key, TRUE, _HashTableSearchElem, &searchCtx);
-    if (pResult != NULL)
+    for (pCurEntry = Bucket->Flink; pCurEntry != Bucket; pCurEntry = pCurEntry->Flink)
     {
-        ASSERT(pResult == searchCtx.PlaceholderEntry);
-        ASSERT(searchCtx.Result == 0);
-    }
+        result = rmemcmp(_HashTableObtainKeyAddress(HashTable, pCurEntry),
+                         Key,
+                         HashTable->KeySize);
+        if (result == 0)
+        {
+            *Placeholder = pCurEntry;
+            return TRUE;
+        }
+
+        if (result > 0)
+        {
+            break;
+        }
 
-    // If the result > 0 => the element we reached has a higher value than the one which we may want to insert, as a
-    // result the insertion will be done after the Blink pointer
-    *Placeholder = (searchCtx.Result > 0) ? searchCtx.PlaceholderEntry->Blink : searchCtx.PlaceholderEntry;
+        *Placeholder = pCurEntry;
+    }
 
-    return (pResult != NULL);
+    return FALSE;
 }
 
 DWORD
@@ -287,7 +282,10 @@ HashTableIteratorNext(
         if (pResult) break;
 
         HashIterator->KeyIndex++;
-        ListIteratorInit(&HashIterator->HashTable->TableData->Entries[HashIterator->KeyIndex], &HashIterator->CurrentKeyIterator);
+        if (HashIterator->KeyIndex < HashIterator->HashTable->MaxKeys)
+        {
+            ListIteratorInit(&HashIterator->HashTable->TableData->Entries[HashIterator->KeyIndex], &HashIterator->CurrentKeyIterator);
+        }
     }
 
     return pResult;
@@ -303,7 +301,7 @@ QWORD
     QWORD keyValue;
 
     ASSERT(Key != NULL);
-    ASSERT(KeyLength <= MAX_QWORD);
+    ASSERT(KeyLength <= sizeof(QWORD));
 
     keyValue = 0;
     cl_memcpy(&keyValue, Key, KeyLength);
@@ -329,7 +327,7 @@ QWORD
     QWORD result;
 
     ASSERT(Key != NULL);
-    ASSERT(KeyLength <= MAX_QWORD);
+    ASSERT(KeyLength <= sizeof(QWORD));
 
     keyValue = 0;
     cl_memcpy(&keyValue, Key, KeyLength);
@@ -346,29 +344,3 @@ QWORD
                     % HASH_UNIVERSAL_P)
                         % MaxKeys;
 }
-
-static
-INT64
-(__cdecl _HashTableSearchElem) (
-    IN      PLIST_ENTRY     FirstElem,
-    IN      PLIST_ENTRY     SecondElem,
-    IN_OPT  PVOID           Context
-    )
-{
-    PHASH_ELEM_SEARCH_CTX pCtx;
-
-    ASSERT(FirstElem != NULL);
-    ASSERT(SecondElem != NULL);
-    ASSERT(Context != NULL);
-
-    pCtx = (PHASH_ELEM_SEARCH_CTX)Context;
-
-    pCtx->PlaceholderEntry = FirstElem;
-
-    pCtx->Result = rmemcmp(
-        _HashTableObtainKeyAddress(pCtx->HashTable, FirstElem),
-        SecondElem, // This is actually a PHASH_KEY
-        pCtx->HashTable->KeySize);
-
-    return pCtx->Result;
-}
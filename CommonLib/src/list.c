@@ -332,4 +332,39 @@ ListSearchForElement(
     }
 
     return NULL;
-}
\ No newline at end of file
+}
+
+void
+ListIteratorInit(
+    IN      PLIST_ENTRY             ListHead,
+    OUT     PLIST_ITERATOR          ListIterator
+    )
+{
+    ASSERT(NULL != ListHead);
+    ASSERT(NULL != ListIterator);
+
+    ListIterator->ListHead = ListHead;
+    ListIterator->CurrentEntry = ListHead->Flink;
+}
+
+PTR_SUCCESS
+PLIST_ENTRY
+ListIteratorNext(
+    INOUT   PLIST_ITERATOR          ListIterator
+    )
+{
+    PLIST_ENTRY pResult;
+
+    ASSERT(NULL != ListIterator);
+
+    pResult = ListIterator->CurrentEntry;
+    if (pResult == ListIterator->ListHead)
+    {
+        return NULL;
+    }
+
+    // move on before the caller gets the chance to unlink the element
+    ListIterator->CurrentEntry = pResult->Flink;
+
+    return pResult;
+}
@@ -0,0 +1,389 @@
+#include "common_lib.h"
+#include "lz.h"
+
+// lengths which don't fit in a token nibble continue in the following bytes
+#define LZ_LENGTH_IN_TOKEN          0xF
+#define LZ_LENGTH_BYTE_MAX          0xFF
+
+// the search step grows by one every 2^LZ_SKIP_SHIFT consecutive misses so
+// incompressible data is skipped quickly
+#define LZ_SKIP_SHIFT               6
+
+__forceinline
+static
+DWORD
+_LzRead32(
+    IN          PBYTE       Address
+    )
+{
+    return (DWORD) Address[0]
+        | ((DWORD) Address[1] << 8)
+        | ((DWORD) Address[2] << 16)
+        | ((DWORD) Address[3] << 24);
+}
+
+__forceinline
+static
+DWORD
+_LzHash(
+    IN          DWORD       Sequence
+    )
+{
+    // Knuth's multiplicative hash, the upper bits are the best mixed
+    return (DWORD) (Sequence * 2654435761UL) >> (32 - LZ_HASH_BITS);
+}
+
+__forceinline
+static
+DWORD
+_LzExtraLengthBytes(
+    IN          DWORD       Length
+    )
+{
+    return (Length < LZ_LENGTH_IN_TOKEN) ? 0 : (Length - LZ_LENGTH_IN_TOKEN) / LZ_LENGTH_BYTE_MAX + 1;
+}
+
+static
+void
+_LzWriteExtraLength(
+    INOUT       PBYTE*      Output,
+    IN          DWORD       Length
+    );
+
+static
+BOOL_SUCCESS
+BOOLEAN
+_LzReadExtraLength(
+    INOUT       PBYTE*      Input,
+    IN          PBYTE       InputEnd,
+    INOUT       DWORD*      Length
+    );
+
+//******************************************************************************
+// Function:     _LzEmitSequence
+// Description:  Writes a token followed by the literals and, if MatchLength is
+//               not 0, by the match description.
+// Returns:      BOOLEAN - FALSE if the sequence does not fit before OutputEnd
+// Parameter:    INOUT PBYTE* Output
+// Parameter:    IN PBYTE OutputEnd
+// Parameter:    IN PBYTE Literals
+// Parameter:    IN DWORD LiteralLength
+// Parameter:    IN DWORD MatchLength - 0 for the last sequence
+// Parameter:    IN DWORD Offset
+//******************************************************************************
+static
+BOOL_SUCCESS
+BOOLEAN
+_LzEmitSequence(
+    INOUT       PBYTE*      Output,
+    IN          PBYTE       OutputEnd,
+    IN          PBYTE       Literals,
+    IN          DWORD       LiteralLength,
+    IN          DWORD       MatchLength,
+    IN          DWORD       Offset
+    );
+
+DWORD
+LzCompress(
+    IN_READS_BYTES(InputSize)
+                PVOID       Input,
+    IN          DWORD       InputSize,
+    OUT_WRITES_BYTES(OutputSize)
+                PVOID       Output,
+    IN          DWORD       OutputSize,
+    OUT_WRITES_BYTES(LZ_WORK_BUFFER_SIZE)
+                PVOID       WorkBuffer
+    )
+{
+    PBYTE pInput;
+    PBYTE pOutput;
+    PBYTE pOutputEnd;
+    DWORD* pTable;
+    DWORD pos;
+    DWORD anchor;
+    DWORD candidate;
+    DWORD sequence;
+    DWORD matchLength;
+    DWORD misses;
+    DWORD hash;
+
+    ASSERT(NULL != Input || 0 == InputSize);
+    ASSERT(NULL != Output);
+    ASSERT(NULL != WorkBuffer);
+
+    pInput = (PBYTE) Input;
+    pOutput = (PBYTE) Output;
+    pOutputEnd = pOutput + OutputSize;
+    pTable = (DWORD*) WorkBuffer;
+    pos = 0;
+    anchor = 0;
+    misses = 0;
+
+    // Entries left by a previous call would still be valid matches if their
+    // bytes happen to match, the output must depend only on the input
+    memzero(pTable, LZ_WORK_BUFFER_SIZE);
+
+    while (InputSize >= LZ_MIN_MATCH && pos <= InputSize - LZ_MIN_MATCH)
+    {
+        sequence = _LzRead32(pInput + pos);
+        hash = _LzHash(sequence);
+        candidate = pTable[hash];
+        pTable[hash] = pos;
+
+        if (candidate >= pos
+            || pos - candidate > LZ_MAX_OFFSET
+            || _LzRead32(pInput + candidate) != sequence)
+        {
+            misses++;
+            pos = pos + 1 + (misses >> LZ_SKIP_SHIFT);
+            continue;
+        }
+
+        matchLength = LZ_MIN_MATCH;
+        while (pos + matchLength < InputSize && pInput[candidate + matchLength] == pInput[pos + matchLength])
+        {
+            matchLength++;
+        }
+
+        if (!_LzEmitSequence(&pOutput,
+                             pOutputEnd,
+                             pInput + anchor,
+                             pos - anchor,
+                             matchLength,
+                             pos - candidate))
+        {
+            return 0;
+        }
+
+        pos = pos + matchLength;
+        anchor = pos;
+        misses = 0;
+    }
+
+    // whatever is left after the last match is stored as literals
+    if (!_LzEmitSequence(&pOutput, pOutputEnd, pInput + anchor, InputSize - anchor, 0, 0))
+    {
+        return 0;
+    }
+
+    return (DWORD) (pOutput - (PBYTE) Output);
+}
+
+STATUS
+LzDecompress(
+    IN_READS_BYTES(InputSize)
+                PVOID       Input,
+    IN          DWORD       InputSize,
+    OUT_WRITES_BYTES(OutputSize)
+                PVOID       Output,
+    IN          DWORD       OutputSize,
+    OUT         DWORD*      BytesDecompressed
+    )
+{
+    PBYTE pInput;
+    PBYTE pInputEnd;
+    PBYTE pOutput;
+    PBYTE pOutputEnd;
+    BYTE token;
+    DWORD literalLength;
+    DWORD matchLength;
+    DWORD offset;
+
+    if (NULL == Input || 0 == InputSize)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Output && 0 != OutputSize)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (NULL == BytesDecompressed)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    pInput = (PBYTE) Input;
+    pInputEnd = pInput + InputSize;
+    pOutput = (PBYTE) Output;
+    pOutputEnd = pOutput + OutputSize;
+
+    *BytesDecompressed = 0;
+
+    while (pInput < pInputEnd)
+    {
+        token = *pInput++;
+
+        literalLength = token >> 4;
+        if (!_LzReadExtraLength(&pInput, pInputEnd, &literalLength))
+        {
+            return STATUS_INVALID_BUFFER;
+        }
+
+        if (literalLength > (DWORD) (pInputEnd - pInput))
+        {
+            return STATUS_INVALID_BUFFER;
+        }
+
+        if (literalLength > (DWORD) (pOutputEnd - pOutput))
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+
+        memcpy(pOutput, pInput, literalLength);
+        pInput = pInput + literalLength;
+        pOutput = pOutput + literalLength;
+
+        if (pInput == pInputEnd)
+        {
+            // the last sequence has no match
+            break;
+        }
+
+        if ((DWORD) (pInputEnd - pInput) < sizeof(WORD))
+        {
+            return STATUS_INVALID_BUFFER;
+        }
+
+        offset = (DWORD) pInput[0] | ((DWORD) pInput[1] << 8);
+        pInput = pInput + sizeof(WORD);
+
+        if (0 == offset || offset > (DWORD) (pOutput - (PBYTE) Output))
+        {
+            return STATUS_INVALID_BUFFER;
+        }
+
+        matchLength = token & LZ_LENGTH_IN_TOKEN;
+        if (!_LzReadExtraLength(&pInput, pInputEnd, &matchLength))
+        {
+            return STATUS_INVALID_BUFFER;
+        }
+        matchLength = matchLength + LZ_MIN_MATCH;
+
+        if (matchLength > (DWORD) (pOutputEnd - pOutput))
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+
+        // the match may overlap the bytes it produces (e.g. runs of the same
+        // byte have an offset of 1) => copy byte by byte
+        for (DWORD i = 0; i < matchLength; ++i)
+        {
+            pOutput[i] = pOutput[(INT64) i - offset];
+        }
+        pOutput = pOutput + matchLength;
+    }
+
+    *BytesDecompressed = (DWORD) (pOutput - (PBYTE) Output);
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_LzWriteExtraLength(
+    INOUT       PBYTE*      Output,
+    IN          DWORD       Length
+    )
+{
+    DWORD remaining;
+
+    if (Length < LZ_LENGTH_IN_TOKEN)
+    {
+        return;
+    }
+
+    for (remaining = Length - LZ_LENGTH_IN_TOKEN;
+         remaining >= LZ_LENGTH_BYTE_MAX;
+         remaining = remaining - LZ_LENGTH_BYTE_MAX)
+    {
+        *(*Output)++ = LZ_LENGTH_BYTE_MAX;
+    }
+
+    *(*Output)++ = (BYTE) remaining;
+}
+
+static
+BOOL_SUCCESS
+BOOLEAN
+_LzReadExtraLength(
+    INOUT       PBYTE*      Input,
+    IN          PBYTE       InputEnd,
+    INOUT       DWORD*      Length
+    )
+{
+    BYTE value;
+
+    if (*Length != LZ_LENGTH_IN_TOKEN)
+    {
+        return TRUE;
+    }
+
+    do
+    {
+        if (*Input >= InputEnd)
+        {
+            return FALSE;
+        }
+
+        value = *(*Input)++;
+
+        if (*Length > MAX_DWORD - value)
+        {
+            return FALSE;
+        }
+        *Length = *Length + value;
+    } while (LZ_LENGTH_BYTE_MAX == value);
+
+    return TRUE;
+}
+
+static
+BOOL_SUCCESS
+BOOLEAN
+_LzEmitSequence(
+    INOUT       PBYTE*      Output,
+    IN          PBYTE       OutputEnd,
+    IN          PBYTE       Literals,
+    IN          DWORD       LiteralLength,
+    IN          DWORD       MatchLength,
+    IN          DWORD       Offset
+    )
+{
+    QWORD requiredSize;
+    DWORD matchCode;
+
+    ASSERT(0 == MatchLength || MatchLength >= LZ_MIN_MATCH);
+    ASSERT(0 == MatchLength || (0 != Offset && Offset <= LZ_MAX_OFFSET));
+
+    matchCode = (0 == MatchLength) ? 0 : MatchLength - LZ_MIN_MATCH;
+
+    requiredSize = 1 + _LzExtraLengthBytes(LiteralLength) + (QWORD) LiteralLength;
+    if (0 != MatchLength)
+    {
+        requiredSize = requiredSize + sizeof(WORD) + _LzExtraLengthBytes(matchCode);
+    }
+
+    if (requiredSize > (QWORD) (OutputEnd - *Output))
+    {
+        return FALSE;
+    }
+
+    *(*Output)++ = (BYTE) ((min(LiteralLength, LZ_LENGTH_IN_TOKEN) << 4) | min(matchCode, LZ_LENGTH_IN_TOKEN));
+
+    _LzWriteExtraLength(Output, LiteralLength);
+
+    memcpy(*Output, Literals, LiteralLength);
+    *Output = *Output + LiteralLength;
+
+    if (0 != MatchLength)
+    {
+        *(*Output)++ = (BYTE) (Offset & 0xFF);
+        *(*Output)++ = (BYTE) (Offset >> 8);
+
+        _LzWriteExtraLength(Output, matchCode);
+    }
+
+    return TRUE;
+}
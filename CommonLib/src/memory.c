@@ -3,6 +3,54 @@
 
 extern void CpuClearDirectionFlag();
 
+// Below this size the start-up cost of the string instructions is higher than
+// the cost of moving QWORDs with general purpose registers
+#define MEMORY_FAST_STRING_THRESHOLD        256
+
+// CPUID.(EAX=07H, ECX=0H):EBX.ERMSB[bit 9]
+#define MEMORY_CPUID_STRUCTURED_LEAF        7
+#define MEMORY_CPUID_ERMS_BIT               (1UL << 9)
+
+// The byte value replicated in each byte of a QWORD
+#define MEMORY_BYTE_PATTERN(Value)          ((QWORD)(Value) * 0x0101010101010101ULL)
+
+// The XMM registers are not saved on interrupts or thread switches => only the
+// general purpose registers and the string instructions may be used here
+static BOOLEAN m_memoryUseFastStrings = FALSE;
+
+__forceinline
+static
+DWORD
+_MemoryFirstDifferentByte(
+    IN          QWORD       Difference
+    )
+{
+    unsigned long bitIndex;
+
+    // little endian => the lowest set bit belongs to the first different byte
+    _BitScanForward64(&bitIndex, Difference);
+
+    return bitIndex / BITS_PER_BYTE;
+}
+
+void
+MemoryInitFeatures(
+    void
+    )
+{
+    int cpuInfo[4];
+
+    __cpuid(cpuInfo, 0);
+    if ((DWORD) cpuInfo[0] < MEMORY_CPUID_STRUCTURED_LEAF)
+    {
+        return;
+    }
+
+    __cpuidex(cpuInfo, MEMORY_CPUID_STRUCTURED_LEAF, 0);
+
+    m_memoryUseFastStrings = IsBooleanFlagOn((DWORD) cpuInfo[1], MEMORY_CPUID_ERMS_BIT);
+}
+
 _At_buffer_( address, i, size, _Post_satisfies_( ((PBYTE)address)[i] == value ))
 void
 memset(
@@ -11,18 +59,60 @@ memset(
     IN                          DWORD size
     )
 {
-    DWORD i;
+    PBYTE dst;
+    QWORD pattern;
+    QWORD remaining;
 
     // validate parameters
-    // size validation is done implicitly in the for loop
+    // size validation is done implicitly in the loops
     if (NULL == address)
     {
         return;
     }
 
-    for (i = 0; i < size; ++i)
+    dst = (PBYTE)address;
+    remaining = size;
+
+    if (m_memoryUseFastStrings && remaining >= MEMORY_FAST_STRING_THRESHOLD)
+    {
+        CpuClearDirectionFlag();
+
+        __stosb(dst, value, remaining);
+
+        return;
+    }
+
+    pattern = MEMORY_BYTE_PATTERN(value);
+
+    // align the destination so the QWORD stores never cross a cache line
+    while (remaining != 0 && !IsAddressAligned(dst, sizeof(QWORD)))
+    {
+        *dst = value;
+        dst = dst + sizeof(BYTE);
+        remaining = remaining - sizeof(BYTE);
+    }
+
+    if (remaining >= MEMORY_FAST_STRING_THRESHOLD)
+    {
+        CpuClearDirectionFlag();
+
+        __stosq((PQWORD)dst, pattern, remaining / sizeof(QWORD));
+        dst = dst + AlignAddressLower(remaining, sizeof(QWORD));
+        remaining = remaining % sizeof(QWORD);
+    }
+
+    while (remaining >= sizeof(QWORD))
     {
-        ((BYTE*)address)[i] = value;
+        *((PQWORD)dst) = pattern;
+        dst = dst + sizeof(QWORD);
+        remaining = remaining - sizeof(QWORD);
+    }
+
+    while (remaining != 0)
+    {
+        *dst = value;
+        dst = dst + sizeof(BYTE);
+        remaining = remaining - sizeof(BYTE);
     }
 }
 
@@ -45,6 +135,15 @@ memcpy(
         return;
     }
 
+    if (m_memoryUseFastStrings && Count >= MEMORY_FAST_STRING_THRESHOLD)
+    {
+        CpuClearDirectionFlag();
+
+        __movsb(Destination, Source, Count);
+
+        return;
+    }
+
     unalignedCount = Count & 0x7;
     alignedCount = Count - unalignedCount;
 
@@ -64,7 +163,7 @@ memcpy(
         dst = dst + sizeof(WORD);
         src = src + sizeof(WORD);
     }
-    
+
     if (unalignedCount & 0x1)
     {
         *((PBYTE)dst) = *((PBYTE)src);
@@ -96,7 +195,7 @@ memmove(
 {
     PBYTE dst;
     PBYTE src;
-    QWORD i;
+    QWORD remaining;
 
     if ((NULL == Destination) || (NULL == Source))
     {
@@ -106,9 +205,43 @@ memmove(
     dst = Destination;
     src = Source;
 
-    for (i = 0; i < Count; ++i)
+    // memcpy copies from the lowest address up, each chunk is read before any
+    // byte of it is overwritten => it is safe if the destination is below the
+    // source
+    if (dst <= src || dst >= src + Count)
+    {
+        memcpy(Destination, Source, Count);
+        return;
+    }
+
+    // the destination overlaps the end of the source => copy backwards,
+    // backward string instructions are not optimized by the CPU
+    dst = dst + Count;
+    src = src + Count;
+    remaining = Count;
+
+    while (remaining != 0 && !IsAddressAligned(dst, sizeof(QWORD)))
+    {
+        dst = dst - sizeof(BYTE);
+        src = src - sizeof(BYTE);
+        *dst = *src;
+        remaining = remaining - sizeof(BYTE);
+    }
+
+    while (remaining >= sizeof(QWORD))
     {
-        dst[i] = src[i];
+        dst = dst - sizeof(QWORD);
+        src = src - sizeof(QWORD);
+        *((PQWORD)dst) = *((PQWORD)src);
+        remaining = remaining - sizeof(QWORD);
+    }
+
+    while (remaining != 0)
+    {
+        dst = dst - sizeof(BYTE);
+        src = src - sizeof(BYTE);
+        *dst = *src;
+        remaining = remaining - sizeof(BYTE);
     }
 }
 
@@ -119,7 +252,7 @@ memcmp(
     IN                      DWORD size
     )
 {
-    INT64 i = size;
+    QWORD i;
     PBYTE p1;
     PBYTE p2;
 
@@ -133,7 +266,20 @@ memcmp(
     p1 = (PBYTE)ptr1;
     p2 = (PBYTE)ptr2;
 
-    for (i = 0; i < size; ++i)
+    // compare a QWORD at a time, only the first mismatch is resolved byte by
+    // byte
+    for (i = 0; i + sizeof(QWORD) <= size; i = i + sizeof(QWORD))
+    {
+        QWORD difference = *((PQWORD)&p1[i]) ^ *((PQWORD)&p2[i]);
+
+        if (0 != difference)
+        {
+            i = i + _MemoryFirstDifferentByte(difference);
+            return p1[i] - p2[i];
+        }
+    }
+
+    for (; i < size; ++i)
     {
         if (p1[i] != p2[i])
         {
@@ -151,8 +297,9 @@ memscan(
     IN                      BYTE  value
     )
 {
-    DWORD i;
+    QWORD i;
     PBYTE pData;
+    QWORD pattern;
 
     if (NULL == buffer)
     {
@@ -160,15 +307,27 @@ memscan(
     }
 
     pData = (PBYTE)buffer;
+    pattern = MEMORY_BYTE_PATTERN(value);
+
+    for (i = 0; i + sizeof(QWORD) <= size; i = i + sizeof(QWORD))
+    {
+        QWORD difference = *((PQWORD)&pData[i]) ^ pattern;
+
+        if (0 != difference)
+        {
+            // game over
+            return (int)(i + _MemoryFirstDifferentByte(difference));
+        }
+    }
 
-    for (i = 0; i < size; ++i)
+    for (; i < size; ++i)
     {
         if (pData[i] != value)
         {
             // game over
-            return i;
+            return (int)i;
         }
     }
 
-    return i;
+    return (int)i;
 }
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "common_lib.h"
+#include "pairing_heap.h"
+
+// Both elements must be roots of their trees, the greater one becomes the
+// leftmost child of the smaller one. On ties First stays on top.
+__forceinline
+static
+PPAIRING_HEAP_ENTRY
+_PairingHeapMeld(
+    IN      PPAIRING_HEAP           Heap,
+    IN      PPAIRING_HEAP_ENTRY     First,
+    IN      PPAIRING_HEAP_ENTRY     Second
+    )
+{
+    PPAIRING_HEAP_ENTRY pParent;
+    PPAIRING_HEAP_ENTRY pChild;
+
+    if (Heap->CompareFunc(Second, First) < 0)
+    {
+        pParent = Second;
+        pChild = First;
+    }
+    else
+    {
+        pParent = First;
+        pChild = Second;
+    }
+
+    pChild->Sibling = pParent->Child;
+    if (pParent->Child != NULL)
+    {
+        pParent->Child->Prev = pChild;
+    }
+    pChild->Prev = pParent;
+    pParent->Child = pChild;
+
+    return pParent;
+}
+
+// Detaches the subtree rooted by Element from its parent, Element must not be
+// the root of the heap
+static
+void
+_PairingHeapCut(
+    IN      PPAIRING_HEAP_ENTRY     Element
+    )
+{
+    ASSERT(Element->Prev != NULL);
+
+    if (Element->Prev->Child == Element)
+    {
+        Element->Prev->Child = Element->Sibling;
+    }
+    else
+    {
+        Element->Prev->Sibling = Element->Sibling;
+    }
+
+    if (Element->Sibling != NULL)
+    {
+        Element->Sibling->Prev = Element->Prev;
+    }
+
+    Element->Prev = NULL;
+    Element->Sibling = NULL;
+}
+
+// Melds a list of sibling trees into a single tree: the first pass melds them
+// in pairs from left to right, the second one melds the pairs from right to
+// left. Done iteratively, a list of n siblings would need a recursion n / 2
+// levels deep.
+static
+PPAIRING_HEAP_ENTRY
+_PairingHeapMergePairs(
+    IN      PPAIRING_HEAP           Heap,
+    IN_OPT  PPAIRING_HEAP_ENTRY     First
+    )
+{
+    PPAIRING_HEAP_ENTRY pNext;
+    PPAIRING_HEAP_ENTRY pPairs;
+    PPAIRING_HEAP_ENTRY pResult;
+
+    // the melded pairs are linked in reverse order through Sibling
+    pPairs = NULL;
+    pNext = First;
+
+    while (pNext != NULL)
+    {
+        PPAIRING_HEAP_ENTRY pFirst = pNext;
+        PPAIRING_HEAP_ENTRY pSecond = pNext->Sibling;
+        PPAIRING_HEAP_ENTRY pPair;
+
+        pNext = (pSecond != NULL) ? pSecond->Sibling : NULL;
+
+        pFirst->Sibling = pFirst->Prev = NULL;
+        pPair = pFirst;
+
+        if (pSecond != NULL)
+        {
+            pSecond->Sibling = pSecond->Prev = NULL;
+            pPair = _PairingHeapMeld(Heap, pFirst, pSecond);
+        }
+
+        pPair->Sibling = pPairs;
+        pPairs = pPair;
+    }
+
+    pResult = NULL;
+
+    while (pPairs != NULL)
+    {
+        pNext = pPairs->Sibling;
+        pPairs->Sibling = NULL;
+
+        pResult = (pResult != NULL) ? _PairingHeapMeld(Heap, pPairs, pResult) : pPairs;
+
+        pPairs = pNext;
+    }
+
+    return pResult;
+}
+
+void
+PairingHeapInit(
+    OUT     PPAIRING_HEAP                       Heap,
+    IN      PFUNC_PairingHeapCompareFunction    CompareFunction
+    )
+{
+    ASSERT(Heap != NULL);
+    ASSERT(CompareFunction != NULL);
+
+    Heap->CompareFunc = CompareFunction;
+    Heap->Root = NULL;
+    Heap->NumberOfElements = 0;
+}
+
+DWORD
+PairingHeapSize(
+    IN      PPAIRING_HEAP                       Heap
+    )
+{
+    ASSERT(Heap != NULL);
+
+    return Heap->NumberOfElements;
+}
+
+void
+PairingHeapInsert(
+    INOUT   PPAIRING_HEAP                       Heap,
+    INOUT   PPAIRING_HEAP_ENTRY                 Element
+    )
+{
+    ASSERT(Heap != NULL);
+    ASSERT(Element != NULL);
+
+    Element->Child = Element->Sibling = Element->Prev = NULL;
+
+    Heap->Root = (Heap->Root != NULL) ? _PairingHeapMeld(Heap, Heap->Root, Element) : Element;
+    Heap->NumberOfElements++;
+}
+
+PTR_SUCCESS
+PPAIRING_HEAP_ENTRY
+PairingHeapPeekMin(
+    IN      PPAIRING_HEAP                       Heap
+    )
+{
+    ASSERT(Heap != NULL);
+
+    return Heap->Root;
+}
+
+PTR_SUCCESS
+PPAIRING_HEAP_ENTRY
+PairingHeapExtractMin(
+    INOUT   PPAIRING_HEAP                       Heap
+    )
+{
+    PPAIRING_HEAP_ENTRY pMin;
+
+    ASSERT(Heap != NULL);
+
+    pMin = Heap->Root;
+    if (pMin == NULL)
+    {
+        return NULL;
+    }
+
+    Heap->Root = _PairingHeapMergePairs(Heap, pMin->Child);
+    Heap->NumberOfElements--;
+
+    pMin->Child = NULL;
+
+    return pMin;
+}
+
+void
+PairingHeapRemoveEntry(
+    INOUT   PPAIRING_HEAP                       Heap,
+    INOUT   PPAIRING_HEAP_ENTRY                 Element
+    )
+{
+    PPAIRING_HEAP_ENTRY pSubtree;
+
+    ASSERT(Heap != NULL);
+    ASSERT(Element != NULL);
+    ASSERT(Heap->NumberOfElements != 0);
+
+    if (Element == Heap->Root)
+    {
+        PairingHeapExtractMin(Heap);
+        return;
+    }
+
+    _PairingHeapCut(Element);
+
+    pSubtree = _PairingHeapMergePairs(Heap, Element->Child);
+    Element->Child = NULL;
+
+    if (pSubtree != NULL)
+    {
+        Heap->Root = _PairingHeapMeld(Heap, Heap->Root, pSubtree);
+    }
+
+    Heap->NumberOfElements--;
+}
+
+void
+PairingHeapDecreaseKey(
+    INOUT   PPAIRING_HEAP                       Heap,
+    INOUT   PPAIRING_HEAP_ENTRY                 Element
+    )
+{
+    ASSERT(Heap != NULL);
+    ASSERT(Element != NULL);
+
+    if (Element == Heap->Root)
+    {
+        return;
+    }
+
+    // the subtree stays ordered, only its link to the parent may be broken
+    _PairingHeapCut(Element);
+
+    Heap->Root = _PairingHeapMeld(Heap, Heap->Root, Element);
+}
@@ -0,0 +1,675 @@
+#include "common_lib.h"
+#include "rb_tree.h"
+
+// The missing children are NULL and are considered black
+#define RbIsRed(Node)                   ((Node) != NULL && (Node)->Red)
+#define RbIsBlack(Node)                 (!RbIsRed(Node))
+
+__forceinline
+static
+void
+_RbTreeReplaceChild(
+    INOUT   PRB_TREE        Tree,
+    IN_OPT  PRB_NODE        Parent,
+    IN      PRB_NODE        OldChild,
+    IN_OPT  PRB_NODE        NewChild
+    )
+{
+    if (Parent == NULL)
+    {
+        Tree->Root = NewChild;
+    }
+    else if (Parent->Left == OldChild)
+    {
+        Parent->Left = NewChild;
+    }
+    else
+    {
+        Parent->Right = NewChild;
+    }
+}
+
+// Recomputes the augmented data of Node and of all its ancestors
+static
+void
+_RbTreeAugmentPath(
+    IN      PRB_TREE        Tree,
+    IN_OPT  PRB_NODE        Node
+    )
+{
+    PRB_NODE pNode;
+
+    if (Tree->AugmentFunc == NULL)
+    {
+        return;
+    }
+
+    for (pNode = Node; pNode != NULL; pNode = pNode->Parent)
+    {
+        Tree->AugmentFunc(pNode);
+    }
+}
+
+// A rotation does not change the elements under the subtree root => only the
+// data of the two rotated nodes must be recomputed, the lower one first
+static
+void
+_RbTreeRotateLeft(
+    INOUT   PRB_TREE        Tree,
+    INOUT   PRB_NODE        Node
+    )
+{
+    PRB_NODE pPivot = Node->Right;
+
+    Node->Right = pPivot->Left;
+    if (pPivot->Left != NULL)
+    {
+        pPivot->Left->Parent = Node;
+    }
+
+    pPivot->Parent = Node->Parent;
+    _RbTreeReplaceChild(Tree, Node->Parent, Node, pPivot);
+
+    pPivot->Left = Node;
+    Node->Parent = pPivot;
+
+    if (Tree->AugmentFunc != NULL)
+    {
+        Tree->AugmentFunc(Node);
+        Tree->AugmentFunc(pPivot);
+    }
+}
+
+static
+void
+_RbTreeRotateRight(
+    INOUT   PRB_TREE        Tree,
+    INOUT   PRB_NODE        Node
+    )
+{
+    PRB_NODE pPivot = Node->Left;
+
+    Node->Left = pPivot->Right;
+    if (pPivot->Right != NULL)
+    {
+        pPivot->Right->Parent = Node;
+    }
+
+    pPivot->Parent = Node->Parent;
+    _RbTreeReplaceChild(Tree, Node->Parent, Node, pPivot);
+
+    pPivot->Right = Node;
+    Node->Parent = pPivot;
+
+    if (Tree->AugmentFunc != NULL)
+    {
+        Tree->AugmentFunc(Node);
+        Tree->AugmentFunc(pPivot);
+    }
+}
+
+static
+void
+_RbTreeInsertFixup(
+    INOUT   PRB_TREE        Tree,
+    INOUT   PRB_NODE        Node
+    )
+{
+    PRB_NODE pNode = Node;
+
+    while (RbIsRed(pNode->Parent))
+    {
+        PRB_NODE pParent = pNode->Parent;
+
+        // the parent is red => it is not the root and the grandparent exists
+        PRB_NODE pGrandparent = pParent->Parent;
+
+        if (pParent == pGrandparent->Left)
+        {
+            PRB_NODE pUncle = pGrandparent->Right;
+
+            if (RbIsRed(pUncle))
+            {
+                pParent->Red = FALSE;
+                pUncle->Red = FALSE;
+                pGrandparent->Red = TRUE;
+                pNode = pGrandparent;
+                continue;
+            }
+
+            if (pNode == pParent->Right)
+            {
+                _RbTreeRotateLeft(Tree, pParent);
+                pNode = pParent;
+                pParent = pNode->Parent;
+            }
+
+            pParent->Red = FALSE;
+            pGrandparent->Red = TRUE;
+            _RbTreeRotateRight(Tree, pGrandparent);
+        }
+        else
+        {
+            PRB_NODE pUncle = pGrandparent->Left;
+
+            if (RbIsRed(pUncle))
+            {
+                pParent->Red = FALSE;
+                pUncle->Red = FALSE;
+                pGrandparent->Red = TRUE;
+                pNode = pGrandparent;
+                continue;
+            }
+
+            if (pNode == pParent->Left)
+            {
+                _RbTreeRotateRight(Tree, pParent);
+                pNode = pParent;
+                pParent = pNode->Parent;
+            }
+
+            pParent->Red = FALSE;
+            pGrandparent->Red = TRUE;
+            _RbTreeRotateLeft(Tree, pGrandparent);
+        }
+    }
+
+    Tree->Root->Red = FALSE;
+}
+
+// Node took the place of a removed black node and is missing a black node on
+// its paths, Node may be NULL => its parent is given separately
+static
+void
+_RbTreeRemoveFixup(
+    INOUT   PRB_TREE        Tree,
+    INOUT_OPT PRB_NODE      Node,
+    INOUT_OPT PRB_NODE      Parent
+    )
+{
+    PRB_NODE pNode = Node;
+    PRB_NODE pParent = Parent;
+
+    while (pNode != Tree->Root && RbIsBlack(pNode))
+    {
+        PRB_NODE pSibling;
+
+        // the removed node was black => the sibling subtree has at least a
+        // black node and the sibling exists
+        if (pNode == pParent->Left)
+        {
+            pSibling = pParent->Right;
+
+            if (pSibling->Red)
+            {
+                pSibling->Red = FALSE;
+                pParent->Red = TRUE;
+                _RbTreeRotateLeft(Tree, pParent);
+                pSibling = pParent->Right;
+            }
+
+            if (RbIsBlack(pSibling->Left) && RbIsBlack(pSibling->Right))
+            {
+                pSibling->Red = TRUE;
+                pNode = pParent;
+                pParent = pNode->Parent;
+                continue;
+            }
+
+            if (RbIsBlack(pSibling->Right))
+            {
+                pSibling->Left->Red = FALSE;
+                pSibling->Red = TRUE;
+                _RbTreeRotateRight(Tree, pSibling);
+                pSibling = pParent->Right;
+            }
+
+            pSibling->Red = pParent->Red;
+            pParent->Red = FALSE;
+            pSibling->Right->Red = FALSE;
+            _RbTreeRotateLeft(Tree, pParent);
+        }
+        else
+        {
+            pSibling = pParent->Left;
+
+            if (pSibling->Red)
+            {
+                pSibling->Red = FALSE;
+                pParent->Red = TRUE;
+                _RbTreeRotateRight(Tree, pParent);
+                pSibling = pParent->Left;
+            }
+
+            if (RbIsBlack(pSibling->Left) && RbIsBlack(pSibling->Right))
+            {
+                pSibling->Red = TRUE;
+                pNode = pParent;
+                pParent = pNode->Parent;
+                continue;
+            }
+
+            if (RbIsBlack(pSibling->Left))
+            {
+                pSibling->Right->Red = FALSE;
+                pSibling->Red = TRUE;
+                _RbTreeRotateLeft(Tree, pSibling);
+                pSibling = pParent->Left;
+            }
+
+            pSibling->Red = pParent->Red;
+            pParent->Red = FALSE;
+            pSibling->Left->Red = FALSE;
+            _RbTreeRotateRight(Tree, pParent);
+        }
+
+        pNode = Tree->Root;
+        break;
+    }
+
+    if (pNode != NULL)
+    {
+        pNode->Red = FALSE;
+    }
+}
+
+static
+void
+_RbTreeLink(
+    INOUT   PRB_TREE        Tree,
+    INOUT   PRB_NODE        Node,
+    IN_OPT  PRB_NODE        Parent,
+    IN      BOOLEAN         LeftChild
+    )
+{
+    Node->Left = Node->Right = NULL;
+    Node->Parent = Parent;
+    Node->Red = TRUE;
+
+    if (Parent == NULL)
+    {
+        Tree->Root = Node;
+    }
+    else if (LeftChild)
+    {
+        Parent->Left = Node;
+    }
+    else
+    {
+        Parent->Right = Node;
+    }
+
+    // the data is brought up to date before rebalancing, the rotations keep
+    // it that way
+    _RbTreeAugmentPath(Tree, Node);
+
+    _RbTreeInsertFixup(Tree, Node);
+
+    Tree->NumberOfElements++;
+}
+
+static
+PRB_NODE
+_RbTreeLeftmost(
+    IN      PRB_NODE        Node
+    )
+{
+    PRB_NODE pNode = Node;
+
+    while (pNode->Left != NULL)
+    {
+        pNode = pNode->Left;
+    }
+
+    return pNode;
+}
+
+static
+PRB_NODE
+_RbTreeRightmost(
+    IN      PRB_NODE        Node
+    )
+{
+    PRB_NODE pNode = Node;
+
+    while (pNode->Right != NULL)
+    {
+        pNode = pNode->Right;
+    }
+
+    return pNode;
+}
+
+void
+RbTreeInit(
+    OUT     PRB_TREE                        Tree,
+    IN      PFUNC_RbTreeCompareFunction     CompareFunction,
+    IN_OPT  PFUNC_RbTreeKeyCompareFunction  KeyCompareFunction,
+    IN_OPT  PFUNC_RbTreeAugmentFunction     AugmentFunction
+    )
+{
+    ASSERT(Tree != NULL);
+    ASSERT(CompareFunction != NULL);
+
+    Tree->Root = NULL;
+    Tree->NumberOfElements = 0;
+    Tree->CompareFunc = CompareFunction;
+    Tree->KeyCompareFunc = KeyCompareFunction;
+    Tree->AugmentFunc = AugmentFunction;
+}
+
+DWORD
+RbTreeSize(
+    IN      PRB_TREE                        Tree
+    )
+{
+    ASSERT(Tree != NULL);
+
+    return Tree->NumberOfElements;
+}
+
+void
+RbTreeInsert(
+    INOUT   PRB_TREE                        Tree,
+    INOUT   PRB_NODE                        Node
+    )
+{
+    PRB_NODE pParent;
+    PRB_NODE pCurrent;
+    BOOLEAN bLeftChild;
+
+    ASSERT(Tree != NULL);
+    ASSERT(Node != NULL);
+
+    pParent = NULL;
+    bLeftChild = FALSE;
+
+    // equal elements go to the right => they are iterated in insertion order
+    for (pCurrent = Tree->Root; pCurrent != NULL; )
+    {
+        pParent = pCurrent;
+        bLeftChild = Tree->CompareFunc(Node, pCurrent) < 0;
+        pCurrent = bLeftChild ? pCurrent->Left : pCurrent->Right;
+    }
+
+    _RbTreeLink(Tree, Node, pParent, bLeftChild);
+}
+
+SAL_SUCCESS
+STATUS
+RbTreeInsertUnique(
+    INOUT   PRB_TREE                        Tree,
+    INOUT   PRB_NODE                        Node,
+    OUT_OPT PRB_NODE*                       ExistingNode
+    )
+{
+    PRB_NODE pParent;
+    PRB_NODE pCurrent;
+    BOOLEAN bLeftChild;
+
+    ASSERT(Tree != NULL);
+    ASSERT(Node != NULL);
+
+    pParent = NULL;
+    bLeftChild = FALSE;
+
+    for (pCurrent = Tree->Root; pCurrent != NULL; )
+    {
+        INT64 result = Tree->CompareFunc(Node, pCurrent);
+
+        if (result == 0)
+        {
+            if (ExistingNode != NULL)
+            {
+                *ExistingNode = pCurrent;
+            }
+
+            return STATUS_ELEMENT_FOUND;
+        }
+
+        pParent = pCurrent;
+        bLeftChild = result < 0;
+        pCurrent = bLeftChild ? pCurrent->Left : pCurrent->Right;
+    }
+
+    _RbTreeLink(Tree, Node, pParent, bLeftChild);
+
+    if (ExistingNode != NULL)
+    {
+        *ExistingNode = NULL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void
+RbTreeRemove(
+    INOUT   PRB_TREE                        Tree,
+    INOUT   PRB_NODE                        Node
+    )
+{
+    PRB_NODE pChild;
+    PRB_NODE pParent;
+    BOOLEAN bRemovedRed;
+
+    ASSERT(Tree != NULL);
+    ASSERT(Node != NULL);
+    ASSERT(Tree->NumberOfElements != 0);
+
+    if (Node->Left == NULL || Node->Right == NULL)
+    {
+        pChild = (Node->Left != NULL) ? Node->Left : Node->Right;
+        pParent = Node->Parent;
+        bRemovedRed = Node->Red;
+
+        _RbTreeReplaceChild(Tree, pParent, Node, pChild);
+        if (pChild != NULL)
+        {
+            pChild->Parent = pParent;
+        }
+    }
+    else
+    {
+        // the successor has no left child, it is unlinked from its place and
+        // takes the place and the color of Node
+        PRB_NODE pSuccessor = _RbTreeLeftmost(Node->Right);
+
+        pChild = pSuccessor->Right;
+        bRemovedRed = pSuccessor->Red;
+
+        if (pSuccessor->Parent == Node)
+        {
+            pParent = pSuccessor;
+        }
+        else
+        {
+            pParent = pSuccessor->Parent;
+
+            pParent->Left = pChild;
+            if (pChild != NULL)
+            {
+                pChild->Parent = pParent;
+            }
+
+            pSuccessor->Right = Node->Right;
+            pSuccessor->Right->Parent = pSuccessor;
+        }
+
+        pSuccessor->Left = Node->Left;
+        pSuccessor->Left->Parent = pSuccessor;
+
+        pSuccessor->Parent = Node->Parent;
+        _RbTreeReplaceChild(Tree, Node->Parent, Node, pSuccessor);
+
+        pSuccessor->Red = Node->Red;
+    }
+
+    // pParent is the lowest node whose subtree changed, the successor is one
+    // of its ancestors (or pParent itself)
+    _RbTreeAugmentPath(Tree, pParent);
+
+    if (!bRemovedRed)
+    {
+        _RbTreeRemoveFixup(Tree, pChild, pParent);
+    }
+
+    Node->Left = Node->Right = Node->Parent = NULL;
+
+    Tree->NumberOfElements--;
+}
+
+PTR_SUCCESS
+PRB_NODE
+RbTreeLookup(
+    IN      PRB_TREE                        Tree,
+    IN      PVOID                           Key
+    )
+{
+    PRB_NODE pCurrent;
+    PRB_NODE pResult;
+
+    ASSERT(Tree != NULL);
+    ASSERT(Tree->KeyCompareFunc != NULL);
+
+    pResult = NULL;
+
+    for (pCurrent = Tree->Root; pCurrent != NULL; )
+    {
+        INT64 result = Tree->KeyCompareFunc(Key, pCurrent);
+
+        if (result == 0)
+        {
+            // there may be equal elements on the left
+            pResult = pCurrent;
+        }
+
+        pCurrent = (result <= 0) ? pCurrent->Left : pCurrent->Right;
+    }
+
+    return pResult;
+}
+
+PTR_SUCCESS
+PRB_NODE
+RbTreeLookupCeiling(
+    IN      PRB_TREE                        Tree,
+    IN      PVOID                           Key
+    )
+{
+    PRB_NODE pCurrent;
+    PRB_NODE pResult;
+
+    ASSERT(Tree != NULL);
+    ASSERT(Tree->KeyCompareFunc != NULL);
+
+    pResult = NULL;
+
+    for (pCurrent = Tree->Root; pCurrent != NULL; )
+    {
+        if (Tree->KeyCompareFunc(Key, pCurrent) <= 0)
+        {
+            pResult = pCurrent;
+            pCurrent = pCurrent->Left;
+        }
+        else
+        {
+            pCurrent = pCurrent->Right;
+        }
+    }
+
+    return pResult;
+}
+
+PTR_SUCCESS
+PRB_NODE
+RbTreeLookupFloor(
+    IN      PRB_TREE                        Tree,
+    IN      PVOID                           Key
+    )
+{
+    PRB_NODE pCurrent;
+    PRB_NODE pResult;
+
+    ASSERT(Tree != NULL);
+    ASSERT(Tree->KeyCompareFunc != NULL);
+
+    pResult = NULL;
+
+    for (pCurrent = Tree->Root; pCurrent != NULL; )
+    {
+        if (Tree->KeyCompareFunc(Key, pCurrent) >= 0)
+        {
+            pResult = pCurrent;
+            pCurrent = pCurrent->Right;
+        }
+        else
+        {
+            pCurrent = pCurrent->Left;
+        }
+    }
+
+    return pResult;
+}
+
+PTR_SUCCESS
+PRB_NODE
+RbTreeFirst(
+    IN      PRB_TREE                        Tree
+    )
+{
+    ASSERT(Tree != NULL);
+
+    return (Tree->Root != NULL) ? _RbTreeLeftmost(Tree->Root) : NULL;
+}
+
+PTR_SUCCESS
+PRB_NODE
+RbTreeLast(
+    IN      PRB_TREE                        Tree
+    )
+{
+    ASSERT(Tree != NULL);
+
+    return (Tree->Root != NULL) ? _RbTreeRightmost(Tree->Root) : NULL;
+}
+
+PTR_SUCCESS
+PRB_NODE
+RbTreeNext(
+    IN      PRB_NODE                        Node
+    )
+{
+    PRB_NODE pNode;
+
+    ASSERT(Node != NULL);
+
+    if (Node->Right != NULL)
+    {
+        return _RbTreeLeftmost(Node->Right);
+    }
+
+    // go up until we come from a left child
+    for (pNode = Node; pNode->Parent != NULL && pNode == pNode->Parent->Right; pNode = pNode->Parent);
+
+    return pNode->Parent;
+}
+
+PTR_SUCCESS
+PRB_NODE
+RbTreePrev(
+    IN      PRB_NODE                        Node
+    )
+{
+    PRB_NODE pNode;
+
+    ASSERT(Node != NULL);
+
+    if (Node->Left != NULL)
+    {
+        return _RbTreeRightmost(Node->Left);
+    }
+
+    for (pNode = Node; pNode->Parent != NULL && pNode == pNode->Parent->Left; pNode = pNode->Parent);
+
+    return pNode->Parent;
+}
@@ -1,6 +1,5 @@
 #include "common_lib.h"
 #include "ref_cnt.h"
-#include "memory.h"
 
 void
 RfcPreInit(
@@ -55,6 +54,30 @@ RfcReference(
     return newRefCount;
 }
 
+BOOL_SUCCESS
+BOOLEAN
+RfcTryReference(
+    INOUT   REF_COUNT*              Object
+    )
+{
+    DWORD refCount;
+
+    ASSERT(NULL != Object);
+
+    do
+    {
+        refCount = Object->ReferenceCount;
+        if (0 == refCount)
+        {
+            return FALSE;
+        }
+
+        ASSERT_INFO(MAX_DWORD > refCount + 1, "Reached max reference count");
+    } while (refCount != _InterlockedCompareExchange(&Object->ReferenceCount, refCount + 1, refCount));
+
+    return TRUE;
+}
+
 SIZE_SUCCESS
 DWORD
 RfcDereference(
@@ -0,0 +1,625 @@
+#include "common_lib.h"
+#include "rh_hash_table.h"
+
+#define RH_HASH_MIN_SLOTS               8
+
+// the table is resized when it becomes 7/8 full
+#define RH_HASH_MAX_LOAD_NUMERATOR      7
+#define RH_HASH_MAX_LOAD_DENOMINATOR    8
+
+// Slots moved from the old table by each insertion or removal. The new table
+// is resized again only after receiving 7/8 * N more elements (N being the
+// number of slots of the old table) and the old table is emptied after at
+// most N / 4 operations => a resize never finds the previous one unfinished
+#define RH_HASH_SLOTS_TO_MOVE           4
+
+// the size of the slot array is a DWORD and the number of slots a power of 2
+#define RH_HASH_MAX_SLOTS               ((MAX_DWORD / RH_HASH_SLOT_SIZE + 1) / 2)
+#define RH_HASH_SLOT_SIZE               ((DWORD) sizeof(RH_HASH_SLOT))
+
+typedef struct _RH_HASH_SLOT
+{
+    // The hash of the key, compared before the element is dereferenced
+    DWORD                   Fingerprint;
+
+    // 1 + the distance from the home slot of the element, 0 if the slot is
+    // empty
+    DWORD                   Distance;
+
+    // In the old table a slot whose element was moved or removed keeps its
+    // distance but has no element => lookups continue past it
+    PRH_HASH_ENTRY          Entry;
+} RH_HASH_SLOT;
+
+__forceinline
+static
+DWORD
+_RhHashTableHash(
+    IN      PRH_HASH_TABLE      HashTable,
+    IN      PHASH_KEY           Key
+    )
+{
+    QWORD hash;
+
+    hash = HashTable->HashFunc(Key, HashTable->KeySize, MAX_DWORD);
+
+    // the finalizer of MurmurHash3: each bit of the input affects all the bits
+    // of the result => consecutive keys don't end up in consecutive slots
+    hash = hash ^ (hash >> 33);
+    hash = hash * 0xFF51AFD7ED558CCDULL;
+    hash = hash ^ (hash >> 33);
+    hash = hash * 0xC4CEB9FE1A85EC53ULL;
+    hash = hash ^ (hash >> 33);
+
+    return (DWORD) hash;
+}
+
+__forceinline
+static
+PHASH_KEY
+_RhHashTableObtainKeyAddress(
+    IN      PRH_HASH_TABLE      HashTable,
+    IN      PRH_HASH_ENTRY      Element
+    )
+{
+    return (PHASH_KEY) ((PBYTE)Element + HashTable->OffsetToKey);
+}
+
+static
+PRH_HASH_SLOT
+_RhHashTableFindSlot(
+    IN      PRH_HASH_TABLE      HashTable,
+    IN      PRH_HASH_SLOT       Slots,
+    IN      DWORD               NumberOfSlots,
+    IN      DWORD               Hash,
+    IN      PHASH_KEY           Key
+    )
+{
+    DWORD mask;
+    DWORD index;
+    DWORD distance;
+
+    mask = NumberOfSlots - 1;
+    index = Hash & mask;
+
+    for (distance = 1; ; ++distance)
+    {
+        PRH_HASH_SLOT pSlot = &Slots[index];
+
+        // an element closer to its home slot than the probe means the key
+        // would have taken this slot when it was inserted
+        if (pSlot->Distance < distance)
+        {
+            return NULL;
+        }
+
+        if (pSlot->Fingerprint == Hash
+            && pSlot->Entry != NULL
+            && 0 == memcmp(_RhHashTableObtainKeyAddress(HashTable, pSlot->Entry), Key, HashTable->KeySize))
+        {
+            return pSlot;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+static
+void
+_RhHashTablePlace(
+    INOUT   PRH_HASH_SLOT       Slots,
+    IN      DWORD               NumberOfSlots,
+    IN      DWORD               Hash,
+    IN      PRH_HASH_ENTRY      Entry
+    )
+{
+    RH_HASH_SLOT current;
+    DWORD mask;
+    DWORD index;
+
+    mask = NumberOfSlots - 1;
+    index = Hash & mask;
+
+    current.Fingerprint = Hash;
+    current.Distance = 1;
+    current.Entry = Entry;
+
+    for (;;)
+    {
+        PRH_HASH_SLOT pSlot = &Slots[index];
+
+        if (0 == pSlot->Distance)
+        {
+            *pSlot = current;
+            return;
+        }
+
+        // take the slot from the richer element and continue placing it
+        if (pSlot->Distance < current.Distance)
+        {
+            RH_HASH_SLOT displaced = *pSlot;
+
+            *pSlot = current;
+            current = displaced;
+        }
+
+        index = (index + 1) & mask;
+        current.Distance++;
+    }
+}
+
+static
+void
+_RhHashTableRemoveSlot(
+    INOUT   PRH_HASH_TABLE      HashTable,
+    INOUT   PRH_HASH_SLOT       Slot
+    )
+{
+    DWORD mask;
+    DWORD index;
+    DWORD next;
+
+    mask = HashTable->NumberOfSlots - 1;
+    index = (DWORD) (Slot - HashTable->Slots);
+    next = (index + 1) & mask;
+
+    // shift back the following elements which are not in their home slot
+    while (HashTable->Slots[next].Distance > 1)
+    {
+        HashTable->Slots[index] = HashTable->Slots[next];
+        HashTable->Slots[index].Distance--;
+
+        index = next;
+        next = (next + 1) & mask;
+    }
+
+    memzero(&HashTable->Slots[index], RH_HASH_SLOT_SIZE);
+
+    ASSERT(HashTable->NumberOfUsedSlots > 0);
+    HashTable->NumberOfUsedSlots--;
+}
+
+static
+void
+_RhHashTableMoveSlots(
+    INOUT   PRH_HASH_TABLE      HashTable,
+    IN      DWORD               SlotsToMove
+    )
+{
+    for (DWORD i = 0; i < SlotsToMove && HashTable->OldSlots != NULL; ++i)
+    {
+        PRH_HASH_SLOT pSlot = &HashTable->OldSlots[HashTable->NextSlotToMove];
+
+        if (pSlot->Entry != NULL)
+        {
+            _RhHashTablePlace(HashTable->Slots,
+                              HashTable->NumberOfSlots,
+                              pSlot->Fingerprint,
+                              pSlot->Entry);
+            HashTable->NumberOfUsedSlots++;
+
+            // lookups must not find the element in both tables
+            pSlot->Entry = NULL;
+        }
+
+        HashTable->NextSlotToMove++;
+        if (HashTable->NextSlotToMove == HashTable->OldNumberOfSlots)
+        {
+            HashTable->FreeFunc(HashTable->OldSlots, HashTable->AllocContext);
+
+            HashTable->OldSlots = NULL;
+            HashTable->OldNumberOfSlots = 0;
+            HashTable->NextSlotToMove = 0;
+        }
+    }
+}
+
+static
+PRH_HASH_SLOT
+_RhHashTableAllocateSlots(
+    IN      PRH_HASH_TABLE      HashTable,
+    IN      DWORD               NumberOfSlots
+    )
+{
+    PRH_HASH_SLOT pSlots;
+    DWORD size;
+
+    ASSERT(NumberOfSlots <= RH_HASH_MAX_SLOTS);
+
+    size = NumberOfSlots * RH_HASH_SLOT_SIZE;
+
+    pSlots = HashTable->AllocFunc(size, HashTable->AllocContext);
+    if (pSlots != NULL)
+    {
+        memzero(pSlots, size);
+    }
+
+    return pSlots;
+}
+
+static
+STATUS
+_RhHashTableGrow(
+    INOUT   PRH_HASH_TABLE      HashTable
+    )
+{
+    PRH_HASH_SLOT pSlots;
+
+    if (HashTable->NumberOfSlots >= RH_HASH_MAX_SLOTS)
+    {
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    // should not happen, see RH_HASH_SLOTS_TO_MOVE
+    if (HashTable->OldSlots != NULL)
+    {
+        _RhHashTableMoveSlots(HashTable, HashTable->OldNumberOfSlots - HashTable->NextSlotToMove);
+    }
+
+    pSlots = _RhHashTableAllocateSlots(HashTable, HashTable->NumberOfSlots * 2);
+    if (pSlots == NULL)
+    {
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    HashTable->OldSlots = HashTable->Slots;
+    HashTable->OldNumberOfSlots = HashTable->NumberOfSlots;
+    HashTable->NextSlotToMove = 0;
+
+    HashTable->Slots = pSlots;
+    HashTable->NumberOfSlots = HashTable->NumberOfSlots * 2;
+    HashTable->NumberOfUsedSlots = 0;
+
+    return STATUS_SUCCESS;
+}
+
+SAL_SUCCESS
+STATUS
+RhHashTableInit(
+    OUT     PRH_HASH_TABLE              HashTable,
+    IN      DWORD                       InitialSlots,
+    IN      DWORD                       KeySize,
+    IN      PFUNC_HashFunction          HashFunction,
+    IN      INT32                       OffsetToKey,
+    IN      PFUNC_RhHashAllocFunction   AllocFunction,
+    IN      PFUNC_FreeFunction          FreeFunction,
+    IN_OPT  PVOID                       AllocContext
+    )
+{
+    DWORD numberOfSlots;
+
+    if (HashTable == NULL)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (InitialSlots > RH_HASH_MAX_SLOTS)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (KeySize == 0 || KeySize > sizeof(QWORD))
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (HashFunction == NULL)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (AllocFunction == NULL)
+    {
+        return STATUS_INVALID_PARAMETER6;
+    }
+
+    if (FreeFunction == NULL)
+    {
+        return STATUS_INVALID_PARAMETER7;
+    }
+
+    memzero(HashTable, sizeof(RH_HASH_TABLE));
+
+    HashTable->KeySize = KeySize;
+    HashTable->OffsetToKey = OffsetToKey;
+    HashTable->HashFunc = HashFunction;
+    HashTable->AllocFunc = AllocFunction;
+    HashTable->FreeFunc = FreeFunction;
+    HashTable->AllocContext = AllocContext;
+
+    numberOfSlots = RH_HASH_MIN_SLOTS;
+    while (numberOfSlots < InitialSlots)
+    {
+        numberOfSlots = numberOfSlots * 2;
+    }
+
+    HashTable->Slots = _RhHashTableAllocateSlots(HashTable, numberOfSlots);
+    if (HashTable->Slots == NULL)
+    {
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    HashTable->NumberOfSlots = numberOfSlots;
+
+    return STATUS_SUCCESS;
+}
+
+void
+RhHashTableUninit(
+    INOUT   PRH_HASH_TABLE              HashTable
+    )
+{
+    ASSERT(HashTable != NULL);
+
+    if (HashTable->OldSlots != NULL)
+    {
+        HashTable->FreeFunc(HashTable->OldSlots, HashTable->AllocContext);
+        HashTable->OldSlots = NULL;
+    }
+
+    if (HashTable->Slots != NULL)
+    {
+        HashTable->FreeFunc(HashTable->Slots, HashTable->AllocContext);
+        HashTable->Slots = NULL;
+    }
+
+    HashTable->NumberOfElements = 0;
+}
+
+void
+RhHashTableClear(
+    INOUT   PRH_HASH_TABLE              HashTable,
+    IN_OPT  PFUNC_FreeFunction          FreeFunction,
+    IN_OPT  PVOID                       FreeContext
+    )
+{
+    RH_HASH_ITERATOR it;
+    PRH_HASH_ENTRY pEntry;
+
+    ASSERT(HashTable != NULL);
+
+    if (FreeFunction != NULL)
+    {
+        RhHashTableIteratorInit(HashTable, &it);
+
+        while ((pEntry = RhHashTableIteratorNext(&it)) != NULL)
+        {
+            FreeFunction(pEntry, FreeContext);
+        }
+    }
+
+    // no need to finish moving the elements
+    if (HashTable->OldSlots != NULL)
+    {
+        HashTable->FreeFunc(HashTable->OldSlots, HashTable->AllocContext);
+
+        HashTable->OldSlots = NULL;
+        HashTable->OldNumberOfSlots = 0;
+        HashTable->NextSlotToMove = 0;
+    }
+
+    memzero(HashTable->Slots, HashTable->NumberOfSlots * RH_HASH_SLOT_SIZE);
+    HashTable->NumberOfUsedSlots = 0;
+    HashTable->NumberOfElements = 0;
+}
+
+DWORD
+RhHashTableSize(
+    IN      PRH_HASH_TABLE              HashTable
+    )
+{
+    ASSERT(HashTable != NULL);
+
+    return HashTable->NumberOfElements;
+}
+
+SAL_SUCCESS
+STATUS
+RhHashTableInsert(
+    INOUT   PRH_HASH_TABLE              HashTable,
+    INOUT   PRH_HASH_ENTRY              Element,
+    OUT_OPT PRH_HASH_ENTRY*             PreviousElement
+    )
+{
+    PHASH_KEY pKey;
+    PRH_HASH_SLOT pSlot;
+    PRH_HASH_ENTRY pPrevious;
+    DWORD hash;
+
+    ASSERT(HashTable != NULL);
+    ASSERT(Element != NULL);
+
+    _RhHashTableMoveSlots(HashTable, RH_HASH_SLOTS_TO_MOVE);
+
+    pKey = _RhHashTableObtainKeyAddress(HashTable, Element);
+    hash = _RhHashTableHash(HashTable, pKey);
+    pPrevious = NULL;
+
+    Element->Hash = hash;
+
+    pSlot = _RhHashTableFindSlot(HashTable, HashTable->Slots, HashTable->NumberOfSlots, hash, pKey);
+    if (pSlot != NULL)
+    {
+        // same key => the element takes the place of the previous one
+        pPrevious = pSlot->Entry;
+        pSlot->Entry = Element;
+        goto done;
+    }
+
+    if ((QWORD) (HashTable->NumberOfUsedSlots + 1) * RH_HASH_MAX_LOAD_DENOMINATOR
+        > (QWORD) HashTable->NumberOfSlots * RH_HASH_MAX_LOAD_NUMERATOR)
+    {
+        STATUS status = _RhHashTableGrow(HashTable);
+
+        // the table can still be filled, just with longer probe sequences
+        if (!SUCCEEDED(status) && HashTable->NumberOfUsedSlots + 1 >= HashTable->NumberOfSlots)
+        {
+            return status;
+        }
+    }
+
+    // after a resize the table searched above is the old table
+    if (HashTable->OldSlots != NULL)
+    {
+        pSlot = _RhHashTableFindSlot(HashTable, HashTable->OldSlots, HashTable->OldNumberOfSlots, hash, pKey);
+        if (pSlot != NULL)
+        {
+            // the element goes to the new table while the previous one is
+            // dropped from the old table
+            pPrevious = pSlot->Entry;
+            pSlot->Entry = NULL;
+            HashTable->NumberOfElements--;
+        }
+    }
+
+    _RhHashTablePlace(HashTable->Slots, HashTable->NumberOfSlots, hash, Element);
+    HashTable->NumberOfUsedSlots++;
+    HashTable->NumberOfElements++;
+
+done:
+    if (PreviousElement != NULL)
+    {
+        *PreviousElement = pPrevious;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+PTR_SUCCESS
+PRH_HASH_ENTRY
+RhHashTableRemove(
+    INOUT   PRH_HASH_TABLE              HashTable,
+    IN      PHASH_KEY                   Key
+    )
+{
+    PRH_HASH_ENTRY pEntry;
+
+    ASSERT(HashTable != NULL);
+    ASSERT(Key != NULL);
+
+    pEntry = RhHashTableLookup(HashTable, Key);
+    if (pEntry != NULL)
+    {
+        RhHashTableRemoveEntry(HashTable, pEntry);
+    }
+
+    return pEntry;
+}
+
+void
+RhHashTableRemoveEntry(
+    INOUT   PRH_HASH_TABLE              HashTable,
+    IN      PRH_HASH_ENTRY              Element
+    )
+{
+    PHASH_KEY pKey;
+    PRH_HASH_SLOT pSlot;
+
+    ASSERT(HashTable != NULL);
+    ASSERT(Element != NULL);
+
+    _RhHashTableMoveSlots(HashTable, RH_HASH_SLOTS_TO_MOVE);
+
+    pKey = _RhHashTableObtainKeyAddress(HashTable, Element);
+
+    pSlot = _RhHashTableFindSlot(HashTable, HashTable->Slots, HashTable->NumberOfSlots, Element->Hash, pKey);
+    if (pSlot != NULL)
+    {
+        _RhHashTableRemoveSlot(HashTable, pSlot);
+    }
+    else
+    {
+        ASSERT(HashTable->OldSlots != NULL);
+
+        pSlot = _RhHashTableFindSlot(HashTable, HashTable->OldSlots, HashTable->OldNumberOfSlots, Element->Hash, pKey);
+        ASSERT(pSlot != NULL);
+
+        // the old table is never inserted into, the slot only loses its
+        // element
+        pSlot->Entry = NULL;
+    }
+
+    ASSERT(HashTable->NumberOfElements > 0);
+    HashTable->NumberOfElements--;
+}
+
+PTR_SUCCESS
+PRH_HASH_ENTRY
+RhHashTableLookup(
+    IN      PRH_HASH_TABLE              HashTable,
+    IN      PHASH_KEY                   Key
+    )
+{
+    PRH_HASH_SLOT pSlot;
+    DWORD hash;
+
+    ASSERT(HashTable != NULL);
+    ASSERT(Key != NULL);
+
+    hash = _RhHashTableHash(HashTable, Key);
+
+    pSlot = _RhHashTableFindSlot(HashTable, HashTable->Slots, HashTable->NumberOfSlots, hash, Key);
+    if (pSlot == NULL && HashTable->OldSlots != NULL)
+    {
+        pSlot = _RhHashTableFindSlot(HashTable, HashTable->OldSlots, HashTable->OldNumberOfSlots, hash, Key);
+    }
+
+    return pSlot != NULL ? pSlot->Entry : NULL;
+}
+
+void
+RhHashTableIteratorInit(
+    IN      PRH_HASH_TABLE              HashTable,
+    OUT     PRH_HASH_ITERATOR           HashIterator
+    )
+{
+    ASSERT(HashTable != NULL);
+    ASSERT(HashIterator != NULL);
+
+    HashIterator->HashTable = HashTable;
+    HashIterator->SlotIndex = 0;
+    HashIterator->InOldSlots = FALSE;
+}
+
+PRH_HASH_ENTRY
+RhHashTableIteratorNext(
+    INOUT   PRH_HASH_ITERATOR           HashIterator
+    )
+{
+    PRH_HASH_TABLE pHashTable;
+
+    ASSERT(HashIterator != NULL);
+
+    pHashTable = HashIterator->HashTable;
+
+    if (!HashIterator->InOldSlots)
+    {
+        while (HashIterator->SlotIndex < pHashTable->NumberOfSlots)
+        {
+            PRH_HASH_SLOT pSlot = &pHashTable->Slots[HashIterator->SlotIndex];
+
+            HashIterator->SlotIndex++;
+
+            if (pSlot->Entry != NULL)
+            {
+                return pSlot->Entry;
+            }
+        }
+
+        HashIterator->InOldSlots = TRUE;
+        HashIterator->SlotIndex = pHashTable->NextSlotToMove;
+    }
+
+    while (pHashTable->OldSlots != NULL && HashIterator->SlotIndex < pHashTable->OldNumberOfSlots)
+    {
+        PRH_HASH_SLOT pSlot = &pHashTable->OldSlots[HashIterator->SlotIndex];
+
+        HashIterator->SlotIndex++;
+
+        if (pSlot->Entry != NULL)
+        {
+            return pSlot->Entry;
+        }
+    }
+
+    return NULL;
+}
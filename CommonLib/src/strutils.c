@@ -1,19 +1,37 @@
 #include "common_lib.h"
 #include "strutils.h"
 
-__forceinline
-void
-swap(
-    INOUT   BYTE* a,
-    INOUT   BYTE* b
-    )
-{
-    *a ^= *b;
-    *b ^= *a;
-    *a ^= *b;
-}
+// The longest number is a 64 bit value written in base 2
+#define ITOA_MAX_DIGITS         64
 
-void
+// Two digits are produced for each division (or shift) => the number of
+// expensive 64 bit divisions is halved
+static const char DECIMAL_DIGIT_PAIRS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char HEXADECIMAL_DIGIT_PAIRS[] =
+    "000102030405060708090A0B0C0D0E0F"
+    "101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F"
+    "303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F"
+    "505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F"
+    "707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F"
+    "909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+    "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+    "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+    "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+DWORD
 itoa(
     IN      PVOID       valueAddress,
     IN      BOOLEAN     signedValue,
@@ -22,7 +40,11 @@ itoa(
     IN      BOOLEAN     is64BitValue
     )
 {
-    DWORD index = 0;
+    // the digits are generated from the least significant one and placed
+    // from the end of the buffer => no reversal is needed
+    char digits[ITOA_MAX_DIGITS];
+    DWORD index;
+    DWORD length;
     DWORD i;
     QWORD value;
     BOOLEAN negative;
@@ -72,49 +94,97 @@ itoa(
         }
     }
 
+    index = sizeof(digits);
 
-
-    if (0 == value)
+    if (BASE_TEN == base)
     {
-        buffer[index] = '0';
-        index++;
-    }
+        while (value >= 100)
+        {
+            DWORD pair = (DWORD)(value % 100);
+
+            value = value / 100;
+            index = index - 2;
+            digits[index] = DECIMAL_DIGIT_PAIRS[2 * pair];
+            digits[index + 1] = DECIMAL_DIGIT_PAIRS[2 * pair + 1];
+        }
 
-    // we convert the number and get a 
-    // reversed ordered string
-    while (0 != value)
+        if (value >= 10)
+        {
+            index = index - 2;
+            digits[index] = DECIMAL_DIGIT_PAIRS[2 * value];
+            digits[index + 1] = DECIMAL_DIGIT_PAIRS[2 * value + 1];
+        }
+        else
+        {
+            index = index - 1;
+            digits[index] = (char)value + '0';
+        }
+    }
+    else if (BASE_HEXA == base)
     {
-        // we get the current digit
-        int digit = (value % base);
+        while (value > MAX_BYTE)
+        {
+            DWORD pair = (DWORD)(value & MAX_BYTE);
+
+            value = value >> BITS_PER_BYTE;
+            index = index - 2;
+            digits[index] = HEXADECIMAL_DIGIT_PAIRS[2 * pair];
+            digits[index + 1] = HEXADECIMAL_DIGIT_PAIRS[2 * pair + 1];
+        }
 
-        // we convert it to an ASCII character
-        if (digit > 9)
+        // the last byte may have a single significant digit
+        if (value > 0xF)
         {
-            buffer[index] = (char)(digit - 10) + 'A';
+            index = index - 2;
+            digits[index] = HEXADECIMAL_DIGIT_PAIRS[2 * value];
+            digits[index + 1] = HEXADECIMAL_DIGIT_PAIRS[2 * value + 1];
         }
         else
         {
-            buffer[index] = (char)digit + '0';
+            index = index - 1;
+            digits[index] = HEXADECIMAL_DIGIT_PAIRS[2 * value + 1];
         }
+    }
+    else
+    {
+        do
+        {
+            // we get the current digit
+            int digit = (value % base);
+
+            // we convert it to an ASCII character
+            index = index - 1;
+            if (digit > 9)
+            {
+                digits[index] = (char)(digit - 10) + 'A';
+            }
+            else
+            {
+                digits[index] = (char)digit + '0';
+            }
 
-        value = value / base;
-        index++;
+            value = value / base;
+        } while (0 != value);
     }
 
+    length = 0;
+
     if (negative)
     {
-        buffer[index] = '-';
-        index++;
+        buffer[length] = '-';
+        length++;
     }
 
-    // we null terminate the string
-    buffer[index] = '\0';
-
-    for (i = 0; i < index / 2; ++i)
+    for (i = index; i < sizeof(digits); ++i)
     {
-        // we reverse the string to have it ordered right
-        swap((BYTE*)&buffer[i], (BYTE*)&buffer[index - i - 1]);
+        buffer[length] = digits[i];
+        length++;
     }
+
+    // we null terminate the string
+    buffer[length] = '\0';
+
+    return length;
 }
 
 void
@@ -176,7 +246,7 @@ atoi(
         value = value * base + currentCharValue;
     }
 
-    value = negative ? - (INT64)value : value;
+    value = negative ? (QWORD) - (INT64)value : value;
 
     if (is64BitValue)
     {
@@ -0,0 +1,234 @@
+#pragma once
+
+//******************************************************************************
+// Host compatibility layer
+//
+//
+// CommonLib is written for the MSVC x64 toolchain. This header is forced into
+// every translation unit of the host benchmark build (see CMakeLists.txt) and
+// maps the compiler specific keywords and intrinsics used by the library to
+// their gcc/clang equivalents, so that the library sources compile unchanged
+// on a Linux x64 host.
+//
+// Only the intrinsics which make sense in user mode are implemented, the
+// privileged ones (CR/MSR accesses, VMX) are only declared by
+// sal_intrinsic.h and must not be used by the sources built on the host.
+//******************************************************************************
+
+#if !defined(__GNUC__) || !defined(__x86_64__)
+#error The host compatibility layer supports only gcc or clang on x64
+#endif
+
+#ifdef __cplusplus
+#define C_HEADER_START              extern "C" {
+#define C_HEADER_END                }
+#else
+#define C_HEADER_START
+#define C_HEADER_END
+#endif
+
+// MSVC type keywords, long is 64 bits wide on the host => long long is used
+#define __int8                      char
+#define __int16                     short
+#define __int32                     int
+#define __int64                     long long
+
+#define __forceinline               inline __attribute__((always_inline))
+#define __cdecl
+#define _cdecl
+#define __declspec(x)
+#define __pragma(x)
+
+// Termination handlers are emulated with a block left by break => __leave
+// must not be used from inside a loop nested in the __try block
+#define __try                       do
+#define __leave                     break
+#define __finally                   while (0);
+
+// CommonLib declares its own atoi and itoa => the SSE intrinsic headers must
+// not pull in the declarations from the C library stdlib.h
+#define _MM_MALLOC_H_INCLUDED
+#define __MM_MALLOC_H
+
+// MSVC exposes _mm_pause without any include
+#include <xmmintrin.h>
+
+#ifndef __cplusplus
+#define static_assert               _Static_assert
+#endif
+
+#define _AddressOfReturnAddress()   ((void*)((char*)__builtin_frame_address(0) + sizeof(void*)))
+
+C_HEADER_START
+
+static __forceinline
+void
+__debugbreak(
+    void
+    )
+{
+    __builtin_trap();
+}
+
+static __forceinline
+void
+__halt(
+    void
+    )
+{
+    __builtin_trap();
+}
+
+static __forceinline
+void
+__cpuidex(
+    int                 cpuInfo[4],
+    int                 function_id,
+    int                 sub_id
+    )
+{
+    __asm__ __volatile__("cpuid"
+                         : "=a"(cpuInfo[0]), "=b"(cpuInfo[1]), "=c"(cpuInfo[2]), "=d"(cpuInfo[3])
+                         : "a"(function_id), "c"(sub_id));
+}
+
+static __forceinline
+void
+__cpuid(
+    int                 cpuInfo[4],
+    int                 function_id
+    )
+{
+    __cpuidex(cpuInfo, function_id, 0);
+}
+
+static __forceinline
+unsigned long long
+__readeflags(
+    void
+    )
+{
+    unsigned long long flags;
+
+    __asm__ __volatile__("pushfq; popq %0" : "=r"(flags));
+
+    return flags;
+}
+
+static __forceinline
+void
+__writeeflags(
+    unsigned long long  Value
+    )
+{
+    __asm__ __volatile__("pushq %0; popfq" : : "r"(Value) : "cc");
+}
+
+static __forceinline
+void
+__movsb(
+    void*               Destination,
+    const void*         Source,
+    unsigned long long  Count
+    )
+{
+    __asm__ __volatile__("rep movsb"
+                         : "+D"(Destination), "+S"(Source), "+c"(Count)
+                         :
+                         : "memory");
+}
+
+static __forceinline
+void
+__movsq(
+    void*               Destination,
+    const void*         Source,
+    unsigned long long  Count
+    )
+{
+    __asm__ __volatile__("rep movsq"
+                         : "+D"(Destination), "+S"(Source), "+c"(Count)
+                         :
+                         : "memory");
+}
+
+static __forceinline
+void
+__stosb(
+    unsigned char*      Destination,
+    unsigned char       Data,
+    unsigned long long  Count
+    )
+{
+    __asm__ __volatile__("rep stosb"
+                         : "+D"(Destination), "+c"(Count)
+                         : "a"(Data)
+                         : "memory");
+}
+
+static __forceinline
+void
+__stosq(
+    unsigned long long* Destination,
+    unsigned long long  Data,
+    unsigned long long  Count
+    )
+{
+    __asm__ __volatile__("rep stosq"
+                         : "+D"(Destination), "+c"(Count)
+                         : "a"(Data)
+                         : "memory");
+}
+
+// The index is a 32 bit value on MSVC, CommonLib passes both unsigned long*
+// and DWORD* and unsigned long is 64 bits wide on the host => the index is
+// assigned through the caller's type so the upper half is not left undefined
+#define _BitScanForward64(Index,Mask)   _HOST_BIT_SCAN(Index, Mask, 0)
+#define _BitScanReverse64(Index,Mask)   _HOST_BIT_SCAN(Index, Mask, 1)
+
+#define _HOST_BIT_SCAN(Index,Mask,Reverse)                                  \
+    __extension__ ({                                                        \
+        unsigned int __hostIndex = 0;                                       \
+        unsigned char __hostFound = _HostBitScan(&__hostIndex, (Mask), (Reverse)); \
+        *(Index) = __hostIndex;                                             \
+        __hostFound;                                                        \
+    })
+
+static __forceinline
+unsigned char
+_HostBitScan(
+    unsigned int*       Index,
+    unsigned long long  Mask,
+    int                 Reverse
+    )
+{
+    if (0 == Mask)
+    {
+        return 0;
+    }
+
+    *Index = Reverse ? 63 - __builtin_clzll(Mask) : __builtin_ctzll(Mask);
+
+    return 1;
+}
+
+#define _InterlockedExchange8(Target,Value)                     __atomic_exchange_n((Target), (Value), __ATOMIC_SEQ_CST)
+#define _InterlockedCompareExchange8(Dest,Exchange,Comparand)   __sync_val_compare_and_swap((Dest), (Comparand), (Exchange))
+#define _InterlockedCompareExchange16(Dest,Exchange,Comparand)  __sync_val_compare_and_swap((Dest), (Comparand), (Exchange))
+#define _InterlockedCompareExchange(Dest,Exchange,Comparand)    __sync_val_compare_and_swap((Dest), (Comparand), (Exchange))
+#define _InterlockedIncrement16(Addend)                         __sync_add_and_fetch((Addend), 1)
+#define _InterlockedIncrement(Addend)                           __sync_add_and_fetch((Addend), 1)
+#define _InterlockedDecrement16(Addend)                         __sync_sub_and_fetch((Addend), 1)
+#define _InterlockedDecrement(Addend)                           __sync_sub_and_fetch((Addend), 1)
+#define _InterlockedOr16(Dest,Value)                            __sync_fetch_and_or((Dest), (Value))
+
+#ifndef __cplusplus
+// cl_strtrim uses the C runtime isspace, ctype.h cannot be included because
+// strutils.h defines its own isupper, islower, tolower and toupper macros
+int
+isspace(
+    int         c
+    );
+#endif // __cplusplus
+
+C_HEADER_END
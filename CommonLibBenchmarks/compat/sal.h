@@ -0,0 +1,88 @@
+#pragma once
+
+// gcc and clang do not ship the source annotation language header, all the
+// annotations used by CommonLib expand to nothing on the host build
+
+#define _In_
+#define _In_z_
+#define _In_opt_
+#define _In_opt_z_
+#define _In_range_(...)
+#define _In_reads_(...)
+#define _In_reads_bytes_(...)
+#define _In_reads_or_z_(...)
+#define _In_reads_opt_z_(...)
+
+#define _Inout_
+#define _Inout_opt_
+#define _Inout_updates_(...)
+#define _Inout_updates_to_(...)
+#define _Inout_updates_all_(...)
+#define _Inout_updates_z_(...)
+
+#define _Out_
+#define __out_z
+#define _Out_opt_
+#define _Outptr_
+#define _Outref_
+#define _Outptr_opt_
+#define _Outptr_result_maybenull_
+#define _Outptr_opt_result_maybenull_
+#define _Outptr_result_buffer_(...)
+#define _Out_writes_(...)
+#define _Out_writes_z_(...)
+#define _Out_writes_opt_(...)
+#define _Out_writes_to_opt_(...)
+#define _Out_writes_all_(...)
+#define _Out_writes_all_opt_(...)
+#define _Out_writes_bytes_(...)
+#define _Out_writes_bytes_opt_(...)
+#define _Out_writes_bytes_all_(...)
+#define _Out_writes_bytes_all_opt_(...)
+
+#define _Ret_notnull_
+#define _Ret_maybenull_
+#define _Ret_range_(...)
+#define _Ret_writes_maybenull_(...)
+#define _Success_(...)
+#define _Return_type_success_(...)
+#define _Must_inspect_result_
+
+#define _Pre_valid_
+#define _Pre_notnull_
+#define _Pre_satisfies_(...)
+#define _Post_invalid_
+#define _Post_ptr_invalid_
+#define _Post_satisfies_(...)
+#define _When_(...)
+#define _At_(...)
+#define _At_buffer_(...)
+#define _Always_(...)
+
+#define _Notnull_
+#define _Null_terminated_
+#define _Reserved_
+#define _Strict_type_match_
+#define _Interlocked_operand_
+#define _Field_size_part_(...)
+#define _Struct_size_bytes_(...)
+#define _Guarded_by_(...)
+
+#define _Acquires_exclusive_lock_(...)
+#define _Acquires_shared_lock_(...)
+#define _Acquires_nonreentrant_lock_(...)
+#define _Releases_exclusive_lock_(...)
+#define _Releases_shared_lock_(...)
+#define _Releases_nonreentrant_lock_(...)
+#define _Requires_lock_held_(...)
+#define _Requires_exclusive_lock_held_(...)
+#define _Requires_shared_lock_held_(...)
+#define _Requires_lock_not_held_(...)
+#define _No_competing_thread_
+
+#define _Analysis_assume_(...)      ((void)sizeof(__VA_ARGS__))
+#define _Analysis_assume_lock_acquired_(...)
+#define _Analysis_assume_lock_held_(...)
+#define _Analysis_assume_lock_released_(...)
+#define _Benign_race_begin_
+#define _Benign_race_end_
@@ -0,0 +1,109 @@
+#pragma once
+
+// the C++ library must be included before CommonLib redefines min, max and
+// the string functions
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+
+C_HEADER_START
+#include "common_lib.h"
+#include "list.h"
+#include "bitmap.h"
+C_HEADER_END
+
+#include "bench_log.h"
+
+//******************************************************************************
+// Benchmark framework
+//
+//
+// A benchmark is a timed body executed for a number of samples, each sample
+// performing the same number of operations. The time per operation of each
+// sample gives the distribution from which the percentiles are computed, the
+// batching keeps the clock overhead out of the measurement.
+//
+// An untimed prepare function may restore the state consumed by the body
+// between samples (e.g. free the memory allocated by the previous sample).
+// One extra sample is executed before the measurement to warm up the caches.
+//******************************************************************************
+
+typedef struct _BENCH_RESULT
+{
+    std::string                 Name;
+
+    DWORD                       Samples;
+    DWORD                       OperationsPerSample;
+
+    // 0 if the operations do not process any data
+    QWORD                       BytesPerOperation;
+
+    double                      MeanNs;
+    double                      MinNs;
+    double                      P50Ns;
+    double                      P90Ns;
+    double                      P99Ns;
+    double                      MaxNs;
+
+    double                      OperationsPerSecond;
+    double                      MegabytesPerSecond;
+} BENCH_RESULT, *PBENCH_RESULT;
+
+typedef struct _BENCH_CONTEXT
+{
+    // the results are printed as a single JSON document at the end
+    BOOLEAN                     Json;
+
+    // fewer samples, used to validate the benchmarks from ctest
+    BOOLEAN                     Quick;
+
+    // only the benchmarks whose name contains the filter are run
+    std::string                 Filter;
+
+    std::vector<BENCH_RESULT>   Results;
+} BENCH_CONTEXT, *PBENCH_CONTEXT;
+
+typedef std::function<void(DWORD Sample)>   BENCH_FUNCTION;
+
+//******************************************************************************
+// Function:     BenchRun
+// Description:  Measures Body and appends the result to Context->Results.
+// Returns:      void
+// Parameter:    INOUT BENCH_CONTEXT& Context
+// Parameter:    IN std::string& Name - Group/Benchmark
+// Parameter:    IN DWORD Samples - Reduced to a tenth in quick mode
+// Parameter:    IN DWORD OperationsPerSample - Operations done by one Body call
+// Parameter:    IN QWORD BytesPerOperation
+// Parameter:    IN BENCH_FUNCTION& Body
+// Parameter:    IN BENCH_FUNCTION& Prepare - Untimed, may be empty
+//******************************************************************************
+void
+BenchRun(
+    _Inout_     BENCH_CONTEXT&          Context,
+    _In_        const std::string&      Name,
+    _In_        DWORD                   Samples,
+    _In_        DWORD                   OperationsPerSample,
+    _In_        QWORD                   BytesPerOperation,
+    _In_        const BENCH_FUNCTION&   Body,
+    _In_        const BENCH_FUNCTION&   Prepare = BENCH_FUNCTION()
+    );
+
+void
+BenchPrintResults(
+    _In_        const BENCH_CONTEXT&    Context
+    );
+
+// Keeps the compiler from discarding the results of the measured functions
+template <typename T>
+inline
+void
+BenchDoNotOptimize(
+    _In_        const T&                Value
+    )
+{
+    __asm__ __volatile__("" : : "r"(&Value) : "memory");
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+STATUS
+BenchClBitmap(
+    _Inout_     BENCH_CONTEXT&      Context
+    );
@@ -0,0 +1,6 @@
+#pragma once
+
+STATUS
+BenchClHashTable(
+    _Inout_     BENCH_CONTEXT&      Context
+    );
@@ -0,0 +1,6 @@
+#pragma once
+
+STATUS
+BenchClHeap(
+    _Inout_     BENCH_CONTEXT&      Context
+    );
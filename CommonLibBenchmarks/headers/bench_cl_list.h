@@ -0,0 +1,6 @@
+#pragma once
+
+STATUS
+BenchClList(
+    _Inout_     BENCH_CONTEXT&      Context
+    );
@@ -0,0 +1,6 @@
+#pragma once
+
+STATUS
+BenchClMemory(
+    _Inout_     BENCH_CONTEXT&      Context
+    );
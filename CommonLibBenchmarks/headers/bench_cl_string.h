@@ -0,0 +1,6 @@
+#pragma once
+
+STATUS
+BenchClString(
+    _Inout_     BENCH_CONTEXT&      Context
+    );
@@ -0,0 +1,6 @@
+#pragma once
+
+// stdout is reserved for the results => the messages go to stderr
+#define LOG(buf,...)                fprintf(stderr, "[%s][%u]" buf, __FILE__, __LINE__, ##__VA_ARGS__)
+#define LOG_ERROR(buf, ...)         LOG("[ERROR]" buf, ##__VA_ARGS__)
+#define LOG_FUNC_ERROR(func,err)    LOG_ERROR("Function [%s] failed with status 0x%X\n", (func), (err))
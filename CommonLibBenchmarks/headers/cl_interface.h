@@ -0,0 +1,41 @@
+#pragma once
+
+// The functions CommonLib expects from the environment it runs in, the
+// benchmarks run as a single threaded user mode process
+C_HEADER_START
+
+#define RFLAGS_DIRECTION_BIT                        ((QWORD)1<<10)
+
+void
+CpuClearDirectionFlag(
+    void
+    );
+
+INTR_STATE
+CpuIntrGetState(
+    void
+    );
+
+INTR_STATE
+CpuIntrSetState(
+    IN      INTR_STATE          IntrState
+    );
+
+INTR_STATE
+CpuIntrDisable(
+    void
+    );
+
+INTR_STATE
+CpuIntrEnable(
+    void
+    );
+
+PVOID
+CpuGetCurrent(
+    void
+    );
+
+FUNC_AssertFunction                 BenchCommonLibAssert;
+
+C_HEADER_END
@@ -0,0 +1,137 @@
+#include "bench_base.h"
+#include "cl_interface.h"
+#include "bench_cl_bitmap.h"
+#include "bench_cl_hash_table.h"
+#include "bench_cl_heap.h"
+#include "bench_cl_list.h"
+#include "bench_cl_memory.h"
+#include "bench_cl_string.h"
+
+typedef STATUS
+(*PFUNC_BenchGroup)(
+    _Inout_     BENCH_CONTEXT&      Context
+    );
+
+typedef struct _BENCH_GROUP
+{
+    const char*                 Name;
+    PFUNC_BenchGroup            Function;
+} BENCH_GROUP, *PBENCH_GROUP;
+
+static const BENCH_GROUP BENCH_GROUPS[] =
+{
+    { "Bitmap", BenchClBitmap },
+    { "HashTable", BenchClHashTable },
+    { "Heap", BenchClHeap },
+    { "List", BenchClList },
+    { "Memory", BenchClMemory },
+    { "String", BenchClString },
+};
+
+static
+void
+_BenchUsage(
+    _In_z_      const char*         Program
+    )
+{
+    fprintf(stderr,
+            "Usage: %s [--json] [--quick] [--filter <substring>]\n"
+            "  --json     print the results as a JSON document\n"
+            "  --quick    run fewer samples, used to validate the benchmarks\n"
+            "  --filter   run only the benchmarks whose name contains the substring,\n"
+            "             e.g. Memory/ or Bitmap/ScanFull64K\n",
+            Program);
+}
+
+static
+BOOLEAN
+_BenchGroupSelected(
+    _In_        const BENCH_CONTEXT&    Context,
+    _In_        const BENCH_GROUP&      Group
+    )
+{
+    size_t separator;
+
+    // the benchmark names are checked against the filter by BenchRun, the
+    // groups are skipped only when the filter names another group
+    separator = Context.Filter.find('/');
+    if (separator == std::string::npos)
+    {
+        return TRUE;
+    }
+
+    return Context.Filter.compare(0, separator, Group.Name) == 0;
+}
+
+int
+main(
+    int                 argc,
+    char*               argv[]
+    )
+{
+    STATUS status;
+    BENCH_CONTEXT context;
+    COMMON_LIB_INIT initSettings;
+
+    context.Json = FALSE;
+    context.Quick = FALSE;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--json")
+        {
+            context.Json = TRUE;
+        }
+        else if (arg == "--quick")
+        {
+            context.Quick = TRUE;
+        }
+        else if (arg == "--filter" && i + 1 < argc)
+        {
+            context.Filter = argv[++i];
+        }
+        else
+        {
+            _BenchUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    initSettings.Size = sizeof(COMMON_LIB_INIT);
+    initSettings.AssertFunction = BenchCommonLibAssert;
+    initSettings.MonitorSupport = FALSE;
+
+    status = CommonLibInit(&initSettings);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("CommonLibInit", status);
+        return 1;
+    }
+
+    for (const auto& group : BENCH_GROUPS)
+    {
+        if (!_BenchGroupSelected(context, group))
+        {
+            continue;
+        }
+
+        status = group.Function(context);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Benchmark group [%s] failed with status 0x%X\n", group.Name, status);
+            return 1;
+        }
+    }
+
+    if (context.Results.empty())
+    {
+        LOG_ERROR("No benchmark matches the filter [%s]\n", context.Filter.c_str());
+        return 1;
+    }
+
+    BenchPrintResults(context);
+
+    return 0;
+}
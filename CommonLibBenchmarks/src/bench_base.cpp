@@ -0,0 +1,170 @@
+#include "bench_base.h"
+
+#define BENCH_QUICK_SAMPLES_DIVISOR         10
+#define BENCH_MIN_SAMPLES                   5
+
+static
+double
+_BenchPercentile(
+    _In_        const std::vector<double>&  SortedValues,
+    _In_        DWORD                       Percentile
+    )
+{
+    // nearest rank, the values are never empty
+    QWORD rank = (Percentile * (QWORD) SortedValues.size() + 99) / 100;
+
+    return SortedValues[rank == 0 ? 0 : rank - 1];
+}
+
+void
+BenchRun(
+    _Inout_     BENCH_CONTEXT&          Context,
+    _In_        const std::string&      Name,
+    _In_        DWORD                   Samples,
+    _In_        DWORD                   OperationsPerSample,
+    _In_        QWORD                   BytesPerOperation,
+    _In_        const BENCH_FUNCTION&   Body,
+    _In_        const BENCH_FUNCTION&   Prepare
+    )
+{
+    BENCH_RESULT result;
+    std::vector<double> nsPerOperation;
+    DWORD samples;
+    double totalNs;
+
+    if (!Context.Filter.empty() && Name.find(Context.Filter) == std::string::npos)
+    {
+        return;
+    }
+
+    samples = Samples;
+    if (Context.Quick)
+    {
+        samples = std::max<DWORD>(Samples / BENCH_QUICK_SAMPLES_DIVISOR, BENCH_MIN_SAMPLES);
+    }
+
+    if (!Context.Json)
+    {
+        LOG("Running [%s]\n", Name.c_str());
+    }
+
+    // warm up
+    if (Prepare)
+    {
+        Prepare(0);
+    }
+    Body(0);
+
+    nsPerOperation.reserve(samples);
+    totalNs = 0;
+
+    for (DWORD i = 0; i < samples; ++i)
+    {
+        if (Prepare)
+        {
+            Prepare(i + 1);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        Body(i + 1);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        double ns = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+        totalNs += ns;
+        nsPerOperation.push_back(ns / OperationsPerSample);
+    }
+
+    std::sort(nsPerOperation.begin(), nsPerOperation.end());
+
+    result.Name = Name;
+    result.Samples = samples;
+    result.OperationsPerSample = OperationsPerSample;
+    result.BytesPerOperation = BytesPerOperation;
+
+    result.MeanNs = totalNs / ((double) samples * OperationsPerSample);
+    result.MinNs = nsPerOperation.front();
+    result.P50Ns = _BenchPercentile(nsPerOperation, 50);
+    result.P90Ns = _BenchPercentile(nsPerOperation, 90);
+    result.P99Ns = _BenchPercentile(nsPerOperation, 99);
+    result.MaxNs = nsPerOperation.back();
+
+    result.OperationsPerSecond = result.MeanNs != 0 ? SEC_IN_NS / result.MeanNs : 0;
+    result.MegabytesPerSecond = result.OperationsPerSecond * BytesPerOperation / MB_SIZE;
+
+    Context.Results.push_back(result);
+}
+
+static
+void
+_BenchPrintText(
+    _In_        const BENCH_CONTEXT&    Context
+    )
+{
+    printf("%-40s %10s %10s %10s %10s %10s %14s %10s\n",
+           "Benchmark", "mean ns", "min ns", "p50 ns", "p90 ns", "p99 ns", "ops/s", "MB/s");
+
+    for (const auto& result : Context.Results)
+    {
+        printf("%-40s %10.2f %10.2f %10.2f %10.2f %10.2f %14.0f",
+               result.Name.c_str(), result.MeanNs, result.MinNs,
+               result.P50Ns, result.P90Ns, result.P99Ns,
+               result.OperationsPerSecond);
+
+        if (result.BytesPerOperation != 0)
+        {
+            printf(" %10.1f\n", result.MegabytesPerSecond);
+        }
+        else
+        {
+            printf(" %10s\n", "-");
+        }
+    }
+}
+
+static
+void
+_BenchPrintJson(
+    _In_        const BENCH_CONTEXT&    Context
+    )
+{
+    // the names are made only of letters, digits and '/' => no escaping
+    printf("{\n");
+    printf("  \"suite\": \"CommonLib\",\n");
+    printf("  \"compiler\": \"%s\",\n", __VERSION__);
+    printf("  \"quick\": %s,\n", Context.Quick ? "true" : "false");
+    printf("  \"benchmarks\": [");
+
+    for (size_t i = 0; i < Context.Results.size(); ++i)
+    {
+        const BENCH_RESULT& result = Context.Results[i];
+
+        printf("%s\n    {\n", i == 0 ? "" : ",");
+        printf("      \"name\": \"%s\",\n", result.Name.c_str());
+        printf("      \"samples\": %u,\n", result.Samples);
+        printf("      \"ops_per_sample\": %u,\n", result.OperationsPerSample);
+        printf("      \"bytes_per_op\": %llu,\n", result.BytesPerOperation);
+        printf("      \"ns_per_op\": { \"mean\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f },\n",
+               result.MeanNs, result.MinNs, result.P50Ns, result.P90Ns, result.P99Ns, result.MaxNs);
+        printf("      \"ops_per_sec\": %.1f,\n", result.OperationsPerSecond);
+        printf("      \"mb_per_sec\": %.3f\n", result.MegabytesPerSecond);
+        printf("    }");
+    }
+
+    printf("\n  ]\n}\n");
+}
+
+void
+BenchPrintResults(
+    _In_        const BENCH_CONTEXT&    Context
+    )
+{
+    if (Context.Json)
+    {
+        _BenchPrintJson(Context);
+    }
+    else
+    {
+        _BenchPrintText(Context);
+    }
+}
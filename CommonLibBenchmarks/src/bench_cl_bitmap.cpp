@@ -0,0 +1,156 @@
+#include "bench_base.h"
+#include "bench_cl_bitmap.h"
+
+typedef struct _BENCH_BITMAP_SCAN_PARAMS
+{
+    const std::string           Name;
+
+    DWORD                       NumberOfBits;
+
+    // Runs of FragmentationStep clear bits separated by a set bit are spread
+    // through the bitmap, 0 if the bitmap is completely set
+    DWORD                       FragmentationStep;
+
+    // The only run long enough is at the end of the bitmap
+    DWORD                       ConsecutiveBits;
+
+    DWORD                       Samples;
+} BENCH_BITMAP_SCAN_PARAMS, *PBENCH_BITMAP_SCAN_PARAMS;
+
+static const BENCH_BITMAP_SCAN_PARAMS BENCH_SCAN_PARAMS[] =
+{
+    {"Bitmap/ScanFull64K", 64 * 1024, 0, 1, 2'000},
+    {"Bitmap/ScanFull1M", 1024 * 1024, 0, 16, 200},
+    {"Bitmap/ScanFragmented64K", 64 * 1024, 7, 32, 500},
+    {"Bitmap/ScanFragmented1M", 1024 * 1024, 63, 128, 100},
+};
+
+// the number of bits allocated one by one by ScanAndFlip, like the PMM does
+#define BENCH_FLIP_BITS                 4096
+#define BENCH_FLIP_SAMPLES              200
+
+typedef struct _BENCH_BITMAP
+{
+    BITMAP                      Bitmap;
+
+    // QWORDs keep the buffer aligned for the word at a time scans
+    std::vector<QWORD>          Buffer;
+} BENCH_BITMAP, *PBENCH_BITMAP;
+
+static
+void
+_BenchBitmapCreate(
+    _In_        DWORD               NumberOfBits,
+    _In_        BOOLEAN             Set,
+    _Out_       BENCH_BITMAP&       Bitmap
+    )
+{
+    DWORD bufferSize = BitmapPreinit(&Bitmap.Bitmap, NumberOfBits);
+
+    Bitmap.Buffer.resize((bufferSize + sizeof(QWORD) - 1) / sizeof(QWORD));
+
+    BitmapInitEx(&Bitmap.Bitmap, (PBYTE) Bitmap.Buffer.data(), Set);
+}
+
+static
+STATUS
+_BenchBitmapScan(
+    _Inout_     BENCH_CONTEXT&                      Context,
+    _In_        const BENCH_BITMAP_SCAN_PARAMS&     Params
+    )
+{
+    BENCH_BITMAP bitmap;
+    DWORD expected;
+    DWORD result;
+
+    _BenchBitmapCreate(Params.NumberOfBits, TRUE, bitmap);
+
+    if (Params.FragmentationStep != 0)
+    {
+        for (DWORD i = 0; i + Params.FragmentationStep < Params.NumberOfBits - Params.ConsecutiveBits; i += Params.FragmentationStep + 1)
+        {
+            BitmapClearBits(&bitmap.Bitmap, i, Params.FragmentationStep);
+        }
+    }
+
+    expected = Params.NumberOfBits - Params.ConsecutiveBits;
+    BitmapClearBits(&bitmap.Bitmap, expected, Params.ConsecutiveBits);
+
+    result = MAX_DWORD;
+
+    BenchRun(Context, Params.Name, Params.Samples, 1, Params.NumberOfBits / BITS_PER_BYTE,
+             [&](DWORD)
+             {
+                 result = BitmapScan(&bitmap.Bitmap, Params.ConsecutiveBits, FALSE);
+             });
+
+    // the benchmark was filtered out
+    if (result == MAX_DWORD)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    if (result != expected)
+    {
+        LOG_ERROR("[%s] BitmapScan returned %u, expected %u\n", Params.Name.c_str(), result, expected);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_BenchBitmapScanAndFlip(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    BENCH_BITMAP bitmap;
+    BOOLEAN mismatch;
+
+    _BenchBitmapCreate(BENCH_FLIP_BITS, FALSE, bitmap);
+
+    mismatch = FALSE;
+
+    // each scan starts from the beginning and has to skip the bits taken by
+    // the previous ones
+    BenchRun(Context, "Bitmap/ScanAndFlip4K", BENCH_FLIP_SAMPLES, BENCH_FLIP_BITS, 0,
+             [&](DWORD)
+             {
+                 for (DWORD i = 0; i < BENCH_FLIP_BITS; ++i)
+                 {
+                     mismatch |= BitmapScanAndFlip(&bitmap.Bitmap, 1, FALSE) != i;
+                 }
+             },
+             [&](DWORD)
+             {
+                 BitmapClearBits(&bitmap.Bitmap, 0, BENCH_FLIP_BITS);
+             });
+
+    if (mismatch)
+    {
+        LOG_ERROR("BitmapScanAndFlip did not return the first clear bit\n");
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+BenchClBitmap(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    STATUS status;
+
+    for (const auto& params : BENCH_SCAN_PARAMS)
+    {
+        status = _BenchBitmapScan(Context, params);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+    }
+
+    return _BenchBitmapScanAndFlip(Context);
+}
@@ -0,0 +1,254 @@
+#include "bench_base.h"
+#include "bench_cl_hash_table.h"
+
+C_HEADER_START
+#include "hash_table.h"
+#include "rh_hash_table.h"
+C_HEADER_END
+
+#define BENCH_HASH_ELEMENTS             (64 * 1024)
+#define BENCH_HASH_SAMPLES              50
+
+// odd => multiplying the element index by it gives distinct keys spread over
+// the whole QWORD range
+#define BENCH_HASH_KEY_MULTIPLIER       0x9E37'79B9'7F4A'7C15ULL
+
+typedef struct _BENCH_HASH_ELEM
+{
+    QWORD               Key;
+
+    HASH_ENTRY          HashEntry;
+    RH_HASH_ENTRY       RhHashEntry;
+} BENCH_HASH_ELEM, *PBENCH_HASH_ELEM;
+
+static
+QWORD
+_BenchHashKey(
+    _In_        DWORD               Index
+    )
+{
+    return (Index + 1ULL) * BENCH_HASH_KEY_MULTIPLIER;
+}
+
+static FUNC_RhHashAllocFunction _BenchRhHashAlloc;
+static FUNC_FreeFunction _BenchRhHashFree;
+
+static
+PVOID
+(__cdecl _BenchRhHashAlloc)(
+    IN      DWORD       Size,
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    return malloc(Size);
+}
+
+static
+void
+(__cdecl _BenchRhHashFree)(
+    IN      PVOID       Object,
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    free(Object);
+}
+
+static
+STATUS
+_BenchHashTable(
+    _Inout_     BENCH_CONTEXT&                  Context,
+    _Inout_     std::vector<BENCH_HASH_ELEM>&   Elements
+    )
+{
+    HASH_TABLE hashTable;
+    std::vector<QWORD> tableData;
+    DWORD tableDataSize;
+    DWORD misses;
+
+    // one bucket per element, the buckets are kept short
+    tableDataSize = HashTablePreinit(&hashTable, BENCH_HASH_ELEMENTS, sizeof(QWORD));
+    tableData.resize((tableDataSize + sizeof(QWORD) - 1) / sizeof(QWORD));
+
+    HashTableInit(&hashTable,
+                  (PHASH_TABLE_DATA) tableData.data(),
+                  HashFuncGenericIncremental,
+                  (INT32) (FIELD_OFFSET(BENCH_HASH_ELEM, Key) - FIELD_OFFSET(BENCH_HASH_ELEM, HashEntry)));
+
+    BenchRun(Context, "HashTable/Insert", BENCH_HASH_SAMPLES, BENCH_HASH_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 for (auto& elem : Elements)
+                 {
+                     HashTableInsert(&hashTable, &elem.HashEntry);
+                 }
+             },
+             [&](DWORD)
+             {
+                 HashTableClear(&hashTable, NULL, NULL);
+             });
+
+    // the lookups need a populated table whether the insertions ran or not
+    HashTableClear(&hashTable, NULL, NULL);
+    for (auto& elem : Elements)
+    {
+        HashTableInsert(&hashTable, &elem.HashEntry);
+    }
+
+    if (HashTableSize(&hashTable) != BENCH_HASH_ELEMENTS)
+    {
+        LOG_ERROR("Hash table has %u elements instead of %u\n", HashTableSize(&hashTable), BENCH_HASH_ELEMENTS);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    misses = 0;
+    BenchRun(Context, "HashTable/LookupHit", BENCH_HASH_SAMPLES, BENCH_HASH_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 for (auto& elem : Elements)
+                 {
+                     misses += HashTableLookup(&hashTable, (PHASH_KEY) &elem.Key) != &elem.HashEntry;
+                 }
+             });
+
+    BenchRun(Context, "HashTable/LookupMiss", BENCH_HASH_SAMPLES, BENCH_HASH_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 for (DWORD i = 0; i < BENCH_HASH_ELEMENTS; ++i)
+                 {
+                     QWORD key = _BenchHashKey(BENCH_HASH_ELEMENTS + i);
+
+                     misses += HashTableLookup(&hashTable, (PHASH_KEY) &key) != NULL;
+                 }
+             });
+
+    HashTableClear(&hashTable, NULL, NULL);
+
+    if (misses != 0)
+    {
+        LOG_ERROR("%u hash table lookups returned the wrong element\n", misses);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_BenchRhHashTable(
+    _Inout_     BENCH_CONTEXT&                  Context,
+    _Inout_     std::vector<BENCH_HASH_ELEM>&   Elements
+    )
+{
+    STATUS status;
+    RH_HASH_TABLE hashTable;
+    DWORD failures;
+    DWORD misses;
+
+    status = RhHashTableInit(&hashTable,
+                             0,
+                             sizeof(QWORD),
+                             HashFuncGenericIncremental,
+                             (INT32) (FIELD_OFFSET(BENCH_HASH_ELEM, Key) - FIELD_OFFSET(BENCH_HASH_ELEM, RhHashEntry)),
+                             _BenchRhHashAlloc,
+                             _BenchRhHashFree,
+                             NULL);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("RhHashTableInit", status);
+        return status;
+    }
+
+    failures = 0;
+
+    // the table starts empty each time => the resizes are measured too
+    BenchRun(Context, "HashTable/RhInsert", BENCH_HASH_SAMPLES, BENCH_HASH_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 for (auto& elem : Elements)
+                 {
+                     failures += !SUCCEEDED(RhHashTableInsert(&hashTable, &elem.RhHashEntry, NULL));
+                 }
+             },
+             [&](DWORD)
+             {
+                 RhHashTableUninit(&hashTable);
+                 failures += !SUCCEEDED(RhHashTableInit(&hashTable,
+                                          0,
+                                          sizeof(QWORD),
+                                          HashFuncGenericIncremental,
+                                          (INT32) (FIELD_OFFSET(BENCH_HASH_ELEM, Key) - FIELD_OFFSET(BENCH_HASH_ELEM, RhHashEntry)),
+                                          _BenchRhHashAlloc,
+                                          _BenchRhHashFree,
+                                          NULL));
+             });
+
+    RhHashTableClear(&hashTable, NULL, NULL);
+    for (auto& elem : Elements)
+    {
+        failures += !SUCCEEDED(RhHashTableInsert(&hashTable, &elem.RhHashEntry, NULL));
+    }
+
+    if (failures != 0)
+    {
+        LOG_ERROR("%u RH hash table insertions failed\n", failures);
+        RhHashTableUninit(&hashTable);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    misses = 0;
+    BenchRun(Context, "HashTable/RhLookupHit", BENCH_HASH_SAMPLES, BENCH_HASH_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 for (auto& elem : Elements)
+                 {
+                     misses += RhHashTableLookup(&hashTable, (PHASH_KEY) &elem.Key) != &elem.RhHashEntry;
+                 }
+             });
+
+    BenchRun(Context, "HashTable/RhLookupMiss", BENCH_HASH_SAMPLES, BENCH_HASH_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 for (DWORD i = 0; i < BENCH_HASH_ELEMENTS; ++i)
+                 {
+                     QWORD key = _BenchHashKey(BENCH_HASH_ELEMENTS + i);
+
+                     misses += RhHashTableLookup(&hashTable, (PHASH_KEY) &key) != NULL;
+                 }
+             });
+
+    RhHashTableUninit(&hashTable);
+
+    if (misses != 0)
+    {
+        LOG_ERROR("%u RH hash table lookups returned the wrong element\n", misses);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+BenchClHashTable(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    STATUS status;
+    std::vector<BENCH_HASH_ELEM> elements(BENCH_HASH_ELEMENTS);
+
+    for (DWORD i = 0; i < BENCH_HASH_ELEMENTS; ++i)
+    {
+        elements[i].Key = _BenchHashKey(i);
+    }
+
+    status = _BenchHashTable(Context, elements);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    return _BenchRhHashTable(Context, elements);
+}
@@ -0,0 +1,212 @@
+#include "bench_base.h"
+#include "bench_cl_heap.h"
+
+C_HEADER_START
+#include "cl_heap.h"
+C_HEADER_END
+
+#define BENCH_HEAP_SIZE                 (4 * MB_SIZE)
+#define BENCH_HEAP_TAG                  'HCNB'
+
+#define BENCH_HEAP_ALLOCATIONS          4096
+#define BENCH_HEAP_ALLOCATION_SIZE      64
+#define BENCH_HEAP_SAMPLES              100
+
+typedef struct _BENCH_HEAP
+{
+    PHEAP_HEADER                Header;
+
+    // QWORDs keep the heap aligned like the pages the kernel gives it
+    std::vector<QWORD>          Buffer;
+} BENCH_HEAP, *PBENCH_HEAP;
+
+static
+STATUS
+_BenchHeapReset(
+    _Inout_     BENCH_HEAP&         Heap
+    )
+{
+    STATUS status;
+
+    if (Heap.Buffer.empty())
+    {
+        Heap.Buffer.resize(BENCH_HEAP_SIZE / sizeof(QWORD));
+    }
+
+    status = ClHeapInit(Heap.Buffer.data(), BENCH_HEAP_SIZE, &Heap.Header);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ClHeapInit", status);
+    }
+
+    return status;
+}
+
+static
+STATUS
+_BenchHeapAllocate(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    STATUS status;
+    BENCH_HEAP heap;
+    DWORD failures;
+
+    status = _BenchHeapReset(heap);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    failures = 0;
+
+    // the allocations are never freed => each sample starts with a new heap
+    BenchRun(Context, "Heap/Allocate64", BENCH_HEAP_SAMPLES, BENCH_HEAP_ALLOCATIONS, 0,
+             [&](DWORD)
+             {
+                 for (DWORD i = 0; i < BENCH_HEAP_ALLOCATIONS; ++i)
+                 {
+                     failures += ClHeapAllocatePoolWithTag(heap.Header, 0, BENCH_HEAP_ALLOCATION_SIZE,
+                                                           BENCH_HEAP_TAG, 0) == NULL;
+                 }
+             },
+             [&](DWORD)
+             {
+                 failures += !SUCCEEDED(_BenchHeapReset(heap));
+             });
+
+    if (failures != 0)
+    {
+        LOG_ERROR("%u heap allocations failed\n", failures);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_BenchHeapAllocateFree(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    STATUS status;
+    BENCH_HEAP heap;
+    DWORD failures;
+
+    status = _BenchHeapReset(heap);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    failures = 0;
+
+    // short lived allocations, each one is freed before the next is made
+    BenchRun(Context, "Heap/AllocateFree", BENCH_HEAP_SAMPLES, BENCH_HEAP_ALLOCATIONS, 0,
+             [&](DWORD)
+             {
+                 for (DWORD i = 0; i < BENCH_HEAP_ALLOCATIONS; ++i)
+                 {
+                     PVOID pAddress = ClHeapAllocatePoolWithTag(heap.Header, 0, BENCH_HEAP_ALLOCATION_SIZE,
+                                                                BENCH_HEAP_TAG, 0);
+                     if (pAddress == NULL)
+                     {
+                         failures++;
+                         continue;
+                     }
+
+                     ClHeapFreePoolWithTag(heap.Header, pAddress, BENCH_HEAP_TAG);
+                 }
+             });
+
+    if (failures != 0)
+    {
+        LOG_ERROR("%u heap allocations failed\n", failures);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_BenchHeapAllocateFragmented(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    STATUS status;
+    BENCH_HEAP heap;
+    std::vector<PVOID> allocations(BENCH_HEAP_ALLOCATIONS);
+    DWORD failures;
+
+    status = _BenchHeapReset(heap);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    failures = 0;
+
+    // every other block is freed => the holes are found by walking the
+    // allocation list instead of at the end of the heap
+    BenchRun(Context, "Heap/AllocateFragmented", BENCH_HEAP_SAMPLES, BENCH_HEAP_ALLOCATIONS / 2, 0,
+             [&](DWORD)
+             {
+                 for (DWORD i = 0; i < BENCH_HEAP_ALLOCATIONS; i += 2)
+                 {
+                     allocations[i] = ClHeapAllocatePoolWithTag(heap.Header, 0, BENCH_HEAP_ALLOCATION_SIZE,
+                                                                BENCH_HEAP_TAG, 0);
+                     failures += allocations[i] == NULL;
+                 }
+             },
+             [&](DWORD)
+             {
+                 failures += !SUCCEEDED(_BenchHeapReset(heap));
+
+                 for (DWORD i = 0; i < BENCH_HEAP_ALLOCATIONS; ++i)
+                 {
+                     allocations[i] = ClHeapAllocatePoolWithTag(heap.Header, 0, BENCH_HEAP_ALLOCATION_SIZE,
+                                                                BENCH_HEAP_TAG, 0);
+                     failures += allocations[i] == NULL;
+                 }
+
+                 for (DWORD i = 0; i < BENCH_HEAP_ALLOCATIONS; i += 2)
+                 {
+                     if (allocations[i] != NULL)
+                     {
+                         ClHeapFreePoolWithTag(heap.Header, allocations[i], BENCH_HEAP_TAG);
+                     }
+                 }
+             });
+
+    if (failures != 0)
+    {
+        LOG_ERROR("%u heap allocations failed\n", failures);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+BenchClHeap(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    STATUS status;
+
+    status = _BenchHeapAllocate(Context);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    status = _BenchHeapAllocateFree(Context);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    return _BenchHeapAllocateFragmented(Context);
+}
@@ -0,0 +1,162 @@
+#include "bench_base.h"
+#include "bench_cl_list.h"
+
+#define BENCH_LIST_ELEMENTS             4096
+#define BENCH_LIST_SAMPLES              200
+
+// the ordered insertions and the searches walk half of the list on average
+#define BENCH_LIST_WALK_ELEMENTS        512
+#define BENCH_LIST_WALK_SAMPLES         50
+
+typedef struct _BENCH_LIST_ELEM
+{
+    QWORD               Key;
+
+    LIST_ENTRY          ListEntry;
+} BENCH_LIST_ELEM, *PBENCH_LIST_ELEM;
+
+static FUNC_CompareFunction _BenchListCompare;
+
+static
+INT64
+(__cdecl _BenchListCompare)(
+    IN      PLIST_ENTRY     FirstElem,
+    IN      PLIST_ENTRY     SecondElem
+    )
+{
+    PBENCH_LIST_ELEM pFirst = CONTAINING_RECORD(FirstElem, BENCH_LIST_ELEM, ListEntry);
+    PBENCH_LIST_ELEM pSecond = CONTAINING_RECORD(SecondElem, BENCH_LIST_ELEM, ListEntry);
+
+    return pFirst->Key < pSecond->Key ? -1 : pFirst->Key > pSecond->Key;
+}
+
+static
+STATUS
+_BenchListInsertRemove(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    std::vector<BENCH_LIST_ELEM> elements(BENCH_LIST_ELEMENTS);
+    LIST_ENTRY head;
+    DWORD mismatches;
+
+    InitializeListHead(&head);
+    mismatches = 0;
+
+    // FIFO usage, like the ready list of the scheduler
+    BenchRun(Context, "List/InsertTailRemoveHead", BENCH_LIST_SAMPLES, BENCH_LIST_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 for (auto& elem : elements)
+                 {
+                     InsertTailList(&head, &elem.ListEntry);
+                 }
+
+                 for (auto& elem : elements)
+                 {
+                     mismatches += RemoveHeadList(&head) != &elem.ListEntry;
+                 }
+             });
+
+    if (mismatches != 0 || !IsListEmpty(&head))
+    {
+        LOG_ERROR("The list did not preserve the insertion order, %u mismatches\n", mismatches);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_BenchListOrdered(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    std::vector<BENCH_LIST_ELEM> elements(BENCH_LIST_WALK_ELEMENTS);
+    LIST_ENTRY head;
+    DWORD mismatches;
+    DWORD size;
+
+    // the multiplier is odd => the keys are distinct and come out of order,
+    // the insertion point is spread through the list
+    for (DWORD i = 0; i < BENCH_LIST_WALK_ELEMENTS; ++i)
+    {
+        elements[i].Key = (DWORD) (i * 0x9E3779B1U);
+    }
+
+    InitializeListHead(&head);
+
+    BenchRun(Context, "List/InsertOrdered", BENCH_LIST_WALK_SAMPLES, BENCH_LIST_WALK_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 for (auto& elem : elements)
+                 {
+                     InsertOrderedList(&head, &elem.ListEntry, _BenchListCompare);
+                 }
+             },
+             [&](DWORD)
+             {
+                 InitializeListHead(&head);
+             });
+
+    // the walks below need the list populated whether the insertions ran or not
+    InitializeListHead(&head);
+    for (auto& elem : elements)
+    {
+        InsertOrderedList(&head, &elem.ListEntry, _BenchListCompare);
+    }
+
+    size = 0;
+    BenchRun(Context, "List/Walk", BENCH_LIST_WALK_SAMPLES * 10, BENCH_LIST_WALK_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 size = ListSize(&head);
+             });
+
+    mismatches = 0;
+    BenchRun(Context, "List/Search", BENCH_LIST_WALK_SAMPLES, BENCH_LIST_WALK_ELEMENTS, 0,
+             [&](DWORD)
+             {
+                 for (auto& elem : elements)
+                 {
+                     mismatches += ListSearchForElement(&head, &elem.ListEntry, _BenchListCompare) != &elem.ListEntry;
+                 }
+             });
+
+    for (PLIST_ENTRY pEntry = head.Flink; pEntry->Flink != &head; pEntry = pEntry->Flink)
+    {
+        mismatches += _BenchListCompare(pEntry, pEntry->Flink) > 0;
+    }
+
+    if (mismatches != 0)
+    {
+        LOG_ERROR("The ordered list is inconsistent, %u mismatches\n", mismatches);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    // 0 if the benchmark was filtered out
+    if (size != 0 && size != BENCH_LIST_WALK_ELEMENTS)
+    {
+        LOG_ERROR("ListSize returned %u, expected %u\n", size, BENCH_LIST_WALK_ELEMENTS);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+BenchClList(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    STATUS status;
+
+    status = _BenchListInsertRemove(Context);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    return _BenchListOrdered(Context);
+}
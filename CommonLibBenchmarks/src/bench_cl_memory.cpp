@@ -0,0 +1,143 @@
+#include "bench_base.h"
+#include "bench_cl_memory.h"
+
+typedef struct _BENCH_MEMORY_PARAMS
+{
+    const std::string           Name;
+
+    DWORD                       Size;
+
+    // the number of copies done by one sample, the small sizes need more to
+    // stay above the clock resolution
+    DWORD                       Operations;
+
+    DWORD                       Samples;
+} BENCH_MEMORY_PARAMS, *PBENCH_MEMORY_PARAMS;
+
+static const BENCH_MEMORY_PARAMS BENCH_MEMCPY_PARAMS[] =
+{
+    {"Memory/Memcpy64", 64, 4096, 500},
+    {"Memory/Memcpy4K", 4 * KB_SIZE, 256, 500},
+    {"Memory/Memcpy1M", MB_SIZE, 1, 200},
+};
+
+static const BENCH_MEMORY_PARAMS BENCH_MEMSET_PARAMS[] =
+{
+    {"Memory/Memset64", 64, 4096, 500},
+    {"Memory/Memset4K", 4 * KB_SIZE, 256, 500},
+    {"Memory/Memset1M", MB_SIZE, 1, 200},
+};
+
+static
+STATUS
+_BenchMemcpy(
+    _Inout_     BENCH_CONTEXT&                  Context,
+    _In_        const BENCH_MEMORY_PARAMS&      Params
+    )
+{
+    std::vector<BYTE> source(Params.Size);
+    std::vector<BYTE> destination(Params.Size);
+    BOOLEAN executed;
+
+    for (DWORD i = 0; i < Params.Size; ++i)
+    {
+        source[i] = (BYTE) (i * 7 + 1);
+    }
+
+    executed = FALSE;
+
+    BenchRun(Context, Params.Name, Params.Samples, Params.Operations, Params.Size,
+             [&](DWORD)
+             {
+                 for (DWORD i = 0; i < Params.Operations; ++i)
+                 {
+                     cl_memcpy(destination.data(), source.data(), Params.Size);
+                     BenchDoNotOptimize(destination[0]);
+                 }
+
+                 executed = TRUE;
+             });
+
+    if (!executed)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    if (cl_memcmp(destination.data(), source.data(), Params.Size) != 0)
+    {
+        LOG_ERROR("[%s] The destination differs from the source\n", Params.Name.c_str());
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_BenchMemset(
+    _Inout_     BENCH_CONTEXT&                  Context,
+    _In_        const BENCH_MEMORY_PARAMS&      Params
+    )
+{
+    std::vector<BYTE> buffer(Params.Size);
+    BOOLEAN executed;
+    BYTE value;
+
+    executed = FALSE;
+    value = 0;
+
+    // a different value each time => the stores cannot be skipped
+    BenchRun(Context, Params.Name, Params.Samples, Params.Operations, Params.Size,
+             [&](DWORD Sample)
+             {
+                 for (DWORD i = 0; i < Params.Operations; ++i)
+                 {
+                     value = (BYTE) (Sample + i + 1);
+                     cl_memset(buffer.data(), value, Params.Size);
+                     BenchDoNotOptimize(buffer[0]);
+                 }
+
+                 executed = TRUE;
+             });
+
+    if (!executed)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    if (cl_memcmp(buffer.data(), std::vector<BYTE>(Params.Size, value).data(), Params.Size) != 0)
+    {
+        LOG_ERROR("[%s] The buffer was not completely set\n", Params.Name.c_str());
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+BenchClMemory(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    STATUS status;
+
+    for (const auto& params : BENCH_MEMCPY_PARAMS)
+    {
+        status = _BenchMemcpy(Context, params);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+    }
+
+    for (const auto& params : BENCH_MEMSET_PARAMS)
+    {
+        status = _BenchMemset(Context, params);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,133 @@
+#include "bench_base.h"
+#include "bench_cl_string.h"
+
+C_HEADER_START
+#include "cl_string.h"
+C_HEADER_END
+
+#define BENCH_STRING_BUFFER_SIZE        256
+#define BENCH_STRING_OPERATIONS         1024
+#define BENCH_STRING_SAMPLES            200
+
+// the same format is used by the kernel for its log lines
+#define BENCH_STRING_LOG_FORMAT         "[%s][%u][CPU:%02x] Thread 0x%X: %s\n"
+#define BENCH_STRING_LOG_EXPECTED       "[thread.c][1234][CPU:03] Thread 0xFFFF800000100000: exiting\n"
+
+#define BENCH_STRING_MIXED_FORMAT       "%d %D %x %b %c %8S|"
+#define BENCH_STRING_MIXED_EXPECTED     "-17 -4294967296 BEEF 101 z abcdefgh|"
+
+typedef struct _BENCH_STRING_PARAMS
+{
+    const std::string           Name;
+
+    const char*                 Expected;
+
+    // formats the string into the buffer
+    std::function<STATUS(char* Buffer)> Format;
+} BENCH_STRING_PARAMS, *PBENCH_STRING_PARAMS;
+
+static
+STATUS
+_BenchVsnprintf(
+    _Out_writes_(BufferSize)    char*       Buffer,
+    _In_                        DWORD       BufferSize,
+    _In_z_                      const char* Format,
+    ...
+    )
+{
+    STATUS status;
+    va_list va;
+
+    va_start(va, Format);
+    status = cl_vsnprintf(Buffer, BufferSize, Format, va);
+
+    return status;
+}
+
+static
+STATUS
+_BenchStringFormat(
+    _Inout_     BENCH_CONTEXT&                  Context,
+    _In_        const BENCH_STRING_PARAMS&      Params
+    )
+{
+    char buffer[BENCH_STRING_BUFFER_SIZE];
+    DWORD failures;
+
+    buffer[0] = '\0';
+    failures = 0;
+
+    BenchRun(Context, Params.Name, BENCH_STRING_SAMPLES, BENCH_STRING_OPERATIONS, 0,
+             [&](DWORD)
+             {
+                 for (DWORD i = 0; i < BENCH_STRING_OPERATIONS; ++i)
+                 {
+                     failures += !SUCCEEDED(Params.Format(buffer));
+                     BenchDoNotOptimize(buffer[0]);
+                 }
+             });
+
+    if (failures != 0)
+    {
+        LOG_ERROR("[%s] %u formatting operations failed\n", Params.Name.c_str(), failures);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    // the buffer is still empty if the benchmark was filtered out
+    if (buffer[0] != '\0' && cl_strcmp(buffer, Params.Expected) != 0)
+    {
+        LOG_ERROR("[%s] Formatted [%s], expected [%s]\n", Params.Name.c_str(), buffer, Params.Expected);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+BenchClString(
+    _Inout_     BENCH_CONTEXT&      Context
+    )
+{
+    STATUS status;
+
+    const BENCH_STRING_PARAMS params[] =
+    {
+        {
+            "String/SnprintfLiteral",
+            "The quick brown fox jumps over the lazy dog",
+            [](char* Buffer)
+            {
+                return cl_snprintf(Buffer, BENCH_STRING_BUFFER_SIZE, "The quick brown fox jumps over the lazy dog");
+            }
+        },
+        {
+            "String/SnprintfLogLine",
+            BENCH_STRING_LOG_EXPECTED,
+            [](char* Buffer)
+            {
+                return cl_snprintf(Buffer, BENCH_STRING_BUFFER_SIZE, BENCH_STRING_LOG_FORMAT,
+                                   "thread.c", 1234, 3, 0xFFFF800000100000ULL, "exiting");
+            }
+        },
+        {
+            "String/VsnprintfMixed",
+            BENCH_STRING_MIXED_EXPECTED,
+            [](char* Buffer)
+            {
+                return _BenchVsnprintf(Buffer, BENCH_STRING_BUFFER_SIZE, BENCH_STRING_MIXED_FORMAT,
+                                       -17, -4294967296LL, 0xBEEF, 5, 'z', "abcdefghijkl");
+            }
+        },
+    };
+
+    for (const auto& param : params)
+    {
+        status = _BenchStringFormat(Context, param);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,66 @@
+#include "bench_base.h"
+#include "cl_interface.h"
+
+#define CURRENT_CPU_MASK        0x8000'0000'0000'0000ULL
+
+void
+CpuClearDirectionFlag(
+    void
+    )
+{
+    __writeeflags(__readeflags() & (~RFLAGS_DIRECTION_BIT));
+}
+
+INTR_STATE
+CpuIntrGetState(
+    void
+    )
+{
+    return INTR_OFF;
+}
+
+INTR_STATE
+CpuIntrSetState(
+    IN      INTR_STATE          IntrState
+    )
+{
+    UNREFERENCED_PARAMETER(IntrState);
+
+    return INTR_OFF;
+}
+
+INTR_STATE
+CpuIntrDisable(
+    void
+    )
+{
+    return CpuIntrSetState(INTR_OFF);
+}
+
+INTR_STATE
+CpuIntrEnable(
+    void
+    )
+{
+    return CpuIntrSetState(INTR_ON);
+}
+
+PVOID
+CpuGetCurrent(
+    void
+    )
+{
+    // there is a single thread => a single CPU
+    return (PVOID) CURRENT_CPU_MASK;
+}
+
+void
+(__cdecl BenchCommonLibAssert)(
+    IN_Z            char*       Message
+    )
+{
+    fprintf(stderr, "Assert reached\n");
+    fprintf(stderr, "Message is %s\n", Message);
+
+    abort();
+}
@@ -3,4 +3,10 @@
 BOOLEAN
 TcBitmapRun(
     void
-    );
\ No newline at end of file
+    );
+
+STATUS
+UtClBitmap();
+
+STATUS
+UtClBitmapBenchmark();
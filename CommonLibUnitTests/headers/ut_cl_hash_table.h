@@ -2,3 +2,9 @@
 
 STATUS
 UtClHashTable();
+
+STATUS
+UtClRhHashTable();
+
+STATUS
+UtClHashTableBenchmark();
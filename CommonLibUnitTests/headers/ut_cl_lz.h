@@ -0,0 +1,7 @@
+#pragma once
+
+STATUS
+UtClLz();
+
+STATUS
+UtClLzBenchmark();
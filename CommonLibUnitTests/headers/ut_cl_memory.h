@@ -0,0 +1,7 @@
+#pragma once
+
+STATUS
+UtClMemory();
+
+STATUS
+UtClMemoryBenchmark();
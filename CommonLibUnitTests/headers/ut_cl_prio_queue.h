@@ -0,0 +1,10 @@
+#pragma once
+
+STATUS
+UtClBinHeap();
+
+STATUS
+UtClPairingHeap();
+
+STATUS
+UtClPrioQueueBenchmark();
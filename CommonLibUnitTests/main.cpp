@@ -7,6 +7,11 @@
 #include "ut_cl_string.h"
 #include "ut_cl_stack_dynamic.h"
 #include "ut_cl_hash_table.h"
+#include "ut_cl_bitmap.h"
+#include "ut_cl_lz.h"
+#include "ut_cl_memory.h"
+#include "ut_cl_prio_queue.h"
+#include "ut_cl_rb_tree.h"
 
 typedef struct _CL_UNIT_TEST
 {
@@ -27,6 +32,20 @@ const CL_UNIT_TEST CL_TESTS[] =
     {"Memory", TstStrings},
     {"DynamicStack", UtClStackDynamic},
     {"HashTable", UtClHashTable},
+    {"RhHashTable", UtClRhHashTable},
+    {"HashTableBenchmark", UtClHashTableBenchmark},
+    {"Bitmap", UtClBitmap},
+    {"BitmapBenchmark", UtClBitmapBenchmark},
+    {"Lz", UtClLz},
+    {"LzBenchmark", UtClLzBenchmark},
+    {"MemoryFunctions", UtClMemory},
+    {"MemoryBenchmark", UtClMemoryBenchmark},
+    {"StringsBenchmark", UtClStringsBenchmark},
+    {"BinHeap", UtClBinHeap},
+    {"PairingHeap", UtClPairingHeap},
+    {"PrioQueueBenchmark", UtClPrioQueueBenchmark},
+    {"RbTree", UtClRbTree},
+    {"RbTreeBenchmark", UtClRbTreeBenchmark},
 };
 
 static constexpr auto NO_OF_CL_TESTS = ARRAYSIZE(CL_TESTS);
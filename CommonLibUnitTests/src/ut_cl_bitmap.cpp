@@ -1,6 +1,317 @@
 #include "ut_base.h"
 #include "ut_cl_bitmap.h"
 #include "bitmap.h"
+#include <vector>
+#include <chrono>
+#include "ut_cl_rng.h"
+
+// after each operation only the bits it touched are compared against the
+// shadow bitmap, the whole bitmap is compared once every this many operations
+#define UT_BITMAP_FULL_COMPARE_INTERVAL         1000
+
+typedef struct _UT_BITMAP_PARAMS
+{
+    const std::string           TestName;
+
+    DWORD                       NumberOfBits;
+
+    // number of random set/clear/scan operations
+    DWORD                       NumberOfOperations;
+
+    // maximum length of a range changed or searched for
+    DWORD                       MaxRunLength;
+} UT_BITMAP_PARAMS, *PUT_BITMAP_PARAMS;
+
+static const UT_BITMAP_PARAMS UT_PARAMS[] =
+{
+    {"Single byte", 5, 1000, 5},
+    {"Single word", 64, 1000, 64},
+    {"Unaligned size", 1001, 10000, 100},
+    {"Short runs", 4096, 10000, 8},
+    {"Long runs", 100'000, 10000, 5000},
+};
+
+typedef struct _UT_BITMAP_BENCH_PARAMS
+{
+    const std::string           TestName;
+
+    DWORD                       NumberOfBits;
+
+    // one bit out of FragmentationStep is set (0 means the bitmap is empty)
+    DWORD                       FragmentationStep;
+
+    DWORD                       ConsecutiveBits;
+
+    DWORD                       Iterations;
+} UT_BITMAP_BENCH_PARAMS, *PUT_BITMAP_BENCH_PARAMS;
+
+// the frame counts resemble those of the PMM bitmap (4GB of RAM => 1M frames)
+static const UT_BITMAP_BENCH_PARAMS UT_BENCH_PARAMS[] =
+{
+    {"Mostly full, single bit", 1 << 20, 0, 1, 10},
+    {"Fragmented, single bit", 1 << 20, 2, 1, 10},
+    {"Fragmented, 32 bits", 1 << 20, 31, 32, 10},
+    {"Fragmented, 512 bits", 1 << 20, 500, 512, 10},
+};
+
+static
+STATUS
+_BitmapCreate(
+    _In_        DWORD               NumberOfBits,
+    _In_        BOOLEAN             Set,
+    _Out_       BITMAP*             Bitmap
+    )
+{
+    ASSERT(Bitmap != nullptr);
+
+    DWORD requiredSize = BitmapPreinit(Bitmap, NumberOfBits);
+    if (requiredSize == 0) return CL_STATUS_SIZE_INVALID;
+
+    PBYTE pBuffer = new BYTE[requiredSize];
+
+    BitmapInitEx(Bitmap, pBuffer, Set);
+
+    return CL_STATUS_SUCCESS;
+}
+
+static
+void
+_BitmapDestroy(
+    _Inout_     BITMAP*             Bitmap
+    )
+{
+    ASSERT(Bitmap != nullptr);
+
+    delete[] Bitmap->BitmapBuffer;
+
+    BitmapUninit(Bitmap);
+}
+
+// the straightforward bit by bit search, used both for validating results
+// and as the baseline for the benchmarks, each bit is visited only once so a
+// long run request on a large bitmap does not turn quadratic
+static
+DWORD
+_BitmapReferenceScan(
+    _In_        const std::vector<bool>&    Bits,
+    _In_        DWORD                       StartIndex,
+    _In_        DWORD                       FirstInvalidBitIndex,
+    _In_        DWORD                       ConsecutiveBits,
+    _In_        bool                        Set
+    )
+{
+    if (StartIndex > FirstInvalidBitIndex) return MAX_DWORD;
+    if (FirstInvalidBitIndex - StartIndex < ConsecutiveBits) return MAX_DWORD;
+
+    if (ConsecutiveBits == 0) return StartIndex;
+
+    DWORD runLength = 0;
+
+    for (DWORD i = StartIndex; i < FirstInvalidBitIndex; ++i)
+    {
+        runLength = (Bits[i] == Set) ? runLength + 1 : 0;
+
+        if (runLength == ConsecutiveBits) return i + 1 - ConsecutiveBits;
+    }
+
+    return MAX_DWORD;
+}
+
+static
+STATUS
+_BitmapCompareRange(
+    _In_        BITMAP*                     Bitmap,
+    _In_        const std::vector<bool>&    Bits,
+    _In_        DWORD                       StartIndex,
+    _In_        DWORD                       Count
+    )
+{
+    ASSERT(Bitmap != nullptr);
+    ASSERT(StartIndex + Count <= Bits.size());
+
+    for (DWORD i = StartIndex; i < StartIndex + Count; ++i)
+    {
+        if (!!BitmapGetBitValue(Bitmap, i) != Bits[i])
+        {
+            LOG_ERROR("Bit %u has value %u in the bitmap, while the shadow bitmap has %u\n",
+                i, BitmapGetBitValue(Bitmap, i), (DWORD) Bits[i]);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+static
+STATUS
+_BitmapCompare(
+    _In_        BITMAP*                     Bitmap,
+    _In_        const std::vector<bool>&    Bits
+    )
+{
+    return _BitmapCompareRange(Bitmap, Bits, 0, (DWORD) Bits.size());
+}
+
+static
+STATUS
+_UtClRunTestcase(
+    _In_ const UT_BITMAP_PARAMS&            Params
+    )
+{
+    STATUS status;
+    BITMAP bitmap;
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    bool initialValue = (rng.GetNextRandom() % 2) != 0;
+    std::vector<bool> shadowBits(Params.NumberOfBits, initialValue);
+
+    status = _BitmapCreate(Params.NumberOfBits, initialValue, &bitmap);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_BitmapCreate", status);
+        return status;
+    }
+
+    for (DWORD op = 0; op < Params.NumberOfOperations; ++op)
+    {
+        DWORD index = rng.GetNextRandom() % Params.NumberOfBits;
+        DWORD touchedIndex = index;
+        DWORD maxCount = (std::min)(Params.MaxRunLength, Params.NumberOfBits - index);
+        DWORD count = 1 + rng.GetNextRandom() % maxCount;
+        bool set = (rng.GetNextRandom() % 2) != 0;
+
+        if (rng.GetNextRandom() % 3 == 0)
+        {
+            BitmapSetBitsValue(&bitmap, index, count, set);
+
+            for (DWORD i = 0; i < count; ++i)
+            {
+                shadowBits[index + i] = set;
+            }
+        }
+        else
+        {
+            DWORD firstInvalid = index + rng.GetNextRandom() % (Params.NumberOfBits - index + 1);
+            DWORD expected = _BitmapReferenceScan(shadowBits, index, firstInvalid, count, set);
+            DWORD result = BitmapScanFromToAndFlip(&bitmap, index, firstInvalid, count, set);
+
+            if (result != expected)
+            {
+                LOG_ERROR("Scan for %u bits with value %u in [%u, %u) returned %u, expected %u\n",
+                    count, (DWORD) set, index, firstInvalid, result, expected);
+                status = CL_STATUS_VALUE_MISMATCH;
+                break;
+            }
+
+            touchedIndex = result;
+
+            if (result != MAX_DWORD)
+            {
+                for (DWORD i = 0; i < count; ++i)
+                {
+                    shadowBits[result + i] = !set;
+                }
+            }
+        }
+
+        // a failed scan must not have changed anything, there is no range to check
+        if (touchedIndex != MAX_DWORD)
+        {
+            status = _BitmapCompareRange(&bitmap, shadowBits, touchedIndex, count);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_BitmapCompareRange", status);
+                break;
+            }
+        }
+
+        if ((op + 1) % UT_BITMAP_FULL_COMPARE_INTERVAL == 0)
+        {
+            status = _BitmapCompare(&bitmap, shadowBits);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_BitmapCompare", status);
+                break;
+            }
+        }
+    }
+
+    if (SUCCEEDED(status))
+    {
+        status = _BitmapCompare(&bitmap, shadowBits);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_BitmapCompare", status);
+        }
+    }
+
+    _BitmapDestroy(&bitmap);
+
+    return status;
+}
+
+static
+STATUS
+_UtClRunBenchmark(
+    _In_ const UT_BITMAP_BENCH_PARAMS&      Params
+    )
+{
+    STATUS status;
+    BITMAP bitmap;
+    std::vector<bool> shadowBits(Params.NumberOfBits, true);
+    DWORD expected;
+    DWORD result;
+
+    status = _BitmapCreate(Params.NumberOfBits, TRUE, &bitmap);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_BitmapCreate", status);
+        return status;
+    }
+
+    // the clear bits are scattered through the bitmap so no run is long enough
+    // to satisfy the request, the only fitting run is at the very end
+    if (Params.FragmentationStep != 0)
+    {
+        for (DWORD i = 0; i < Params.NumberOfBits - Params.ConsecutiveBits; i += Params.FragmentationStep + 1)
+        {
+            BitmapClearBits(&bitmap, i, Params.FragmentationStep);
+            std::fill(shadowBits.begin() + i, shadowBits.begin() + i + Params.FragmentationStep, false);
+        }
+    }
+    BitmapClearBits(&bitmap, Params.NumberOfBits - Params.ConsecutiveBits, Params.ConsecutiveBits);
+    std::fill(shadowBits.end() - Params.ConsecutiveBits, shadowBits.end(), false);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < Params.Iterations; ++i)
+    {
+        expected = _BitmapReferenceScan(shadowBits, 0, Params.NumberOfBits, Params.ConsecutiveBits, false);
+    }
+    auto referenceTime = std::chrono::high_resolution_clock::now() - start;
+
+    start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < Params.Iterations; ++i)
+    {
+        result = BitmapScan(&bitmap, Params.ConsecutiveBits, FALSE);
+    }
+    auto bitmapTime = std::chrono::high_resolution_clock::now() - start;
+
+    _BitmapDestroy(&bitmap);
+
+    if (result != expected)
+    {
+        LOG_ERROR("BitmapScan returned %u, expected %u\n", result, expected);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    auto referenceUs = std::chrono::duration_cast<std::chrono::microseconds>(referenceTime).count() / Params.Iterations;
+    auto bitmapUs = std::chrono::duration_cast<std::chrono::microseconds>(bitmapTime).count() / Params.Iterations;
+
+    LOG("[%s] bit by bit scan: %lld us, BitmapScan: %lld us, speedup: %.2fx\n",
+        Params.TestName.c_str(), referenceUs, bitmapUs,
+        bitmapUs != 0 ? (double) referenceUs / bitmapUs : (double) referenceUs);
+
+    return CL_STATUS_SUCCESS;
+}
 
 BOOLEAN
 TcBitmapRun(
@@ -14,4 +325,40 @@ TcBitmapRun(
     BitmapPreinit(&bmp, 10 );
 
     return TRUE;
-}
\ No newline at end of file
+}
+
+STATUS
+UtClBitmap()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    for (const auto& ut : UT_PARAMS)
+    {
+        status = _UtClRunTestcase(ut);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Test [%s] failed with status 0x%X\n", ut.TestName.c_str(), status);
+            break;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+UtClBitmapBenchmark()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    for (const auto& bench : UT_BENCH_PARAMS)
+    {
+        status = _UtClRunBenchmark(bench);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Benchmark [%s] failed with status 0x%X\n", bench.TestName.c_str(), status);
+            break;
+        }
+    }
+
+    return status;
+}
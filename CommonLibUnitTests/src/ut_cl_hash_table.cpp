@@ -1,7 +1,10 @@
 #include "ut_base.h"
 #include "ut_cl_hash_table.h"
 #include "hash_table.h"
+#include "rh_hash_table.h"
 #include <unordered_map>
+#include <vector>
+#include <chrono>
 #include "ut_cl_rng.h"
 
 typedef struct _UT_HASH_ELEM
@@ -54,6 +57,29 @@ static const DWORD KEY_SIZES[] =
     1, 2, 3, 4, 5, 6, 7, 8
 };
 
+typedef struct _UT_RH_HASH_ELEM
+{
+    RH_HASH_ENTRY               HashEntry;
+
+    QWORD                       Value;
+} UT_RH_HASH_ELEM, *PUT_RH_HASH_ELEM;
+
+// random operations done on each Robin Hood table, the first ones are mostly
+// insertions so the table goes through several resizes
+static const DWORD UT_RH_OPERATIONS[] =
+{
+    100, 10'000, 200'000
+};
+
+static const DWORD UT_RH_BENCH_ELEMENTS[] =
+{
+    1'000, 100'000, 1'000'000
+};
+
+// the chained table is sized at initialization, the benchmark uses it with a
+// bucket for each UT_CHAINED_BENCH_LOAD elements
+#define UT_CHAINED_BENCH_LOAD           8
+
 static
 STATUS
 _HashTableCreate(
@@ -531,3 +557,339 @@ UtClHashTable()
 
     return status;
 }
+
+static
+PVOID
+(__cdecl _RhHashAlloc)(
+    IN      DWORD       Size,
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    return new BYTE[Size];
+}
+
+static
+void
+(__cdecl _RhHashFree)(
+    IN      PVOID       Object,
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    delete[] (PBYTE) Object;
+}
+
+static
+void
+(__cdecl _RhHashFreeItem)(
+    IN      PVOID       Object,
+    IN_OPT  PVOID       Context
+    )
+{
+    std::vector<QWORD>* vect = (std::vector<QWORD>*) Context;
+
+    ASSERT(Object != nullptr);
+    ASSERT(Context != nullptr);
+
+    vect->push_back(CONTAINING_RECORD(Object, UT_RH_HASH_ELEM, HashEntry)->Value);
+}
+
+static
+STATUS
+_UtClRunRhTestcase(
+    _In_ DWORD                          Operations,
+    _In_ DWORD                          KeySize
+    )
+{
+    STATUS status;
+    RH_HASH_TABLE hashTable;
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    std::unordered_map<QWORD, PUT_RH_HASH_ELEM> shadowHash;
+    std::vector<UT_RH_HASH_ELEM> elems(Operations);
+    std::vector<QWORD> clearedValues;
+    QWORD keyMask = CREATE_BIT_MASK_FOR_N_BITS(BITS_PER_BYTE * KeySize);
+
+    status = RhHashTableInit(&hashTable,
+                             0,
+                             KeySize,
+                             HashFuncGenericIncremental,
+                             FIELD_OFFSET(UT_RH_HASH_ELEM, Value) - FIELD_OFFSET(UT_RH_HASH_ELEM, HashEntry),
+                             _RhHashAlloc,
+                             _RhHashFree,
+                             NULL);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("RhHashTableInit", status);
+        return status;
+    }
+
+    for (DWORD i = 0; i < Operations && SUCCEEDED(status); ++i)
+    {
+        // a small key space makes replacements and successful removals common
+        QWORD key = (((QWORD) rng.GetNextRandom() << 32) | rng.GetNextRandom()) % (Operations / 2 + 1) & keyMask;
+        DWORD operation = rng.GetNextRandom() % 8;
+        auto shadowIt = shadowHash.find(key);
+        PUT_RH_HASH_ELEM pExpected = shadowIt != shadowHash.end() ? shadowIt->second : nullptr;
+
+        PRH_HASH_ENTRY pEntry = RhHashTableLookup(&hashTable, (PHASH_KEY) &key);
+        if (pEntry != (pExpected != nullptr ? &pExpected->HashEntry : nullptr))
+        {
+            LOG_ERROR("Lookup of key 0x%I64X returned 0x%p instead of 0x%p\n", key, pEntry, pExpected);
+            status = CL_STATUS_VALUE_MISMATCH;
+            break;
+        }
+
+        if (operation < 5)
+        {
+            PRH_HASH_ENTRY pPrevious;
+
+            elems[i].Value = key;
+
+            status = RhHashTableInsert(&hashTable, &elems[i].HashEntry, &pPrevious);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("RhHashTableInsert", status);
+                break;
+            }
+
+            if (pPrevious != pEntry)
+            {
+                LOG_ERROR("Insert of key 0x%I64X replaced 0x%p instead of 0x%p\n", key, pPrevious, pEntry);
+                status = CL_STATUS_VALUE_MISMATCH;
+                break;
+            }
+
+            shadowHash[key] = &elems[i];
+        }
+        else if (pEntry != nullptr)
+        {
+            if (operation == 5)
+            {
+                RhHashTableRemoveEntry(&hashTable, pEntry);
+            }
+            else if (RhHashTableRemove(&hashTable, (PHASH_KEY) &key) != pEntry)
+            {
+                LOG_ERROR("Remove of key 0x%I64X did not return 0x%p\n", key, pEntry);
+                status = CL_STATUS_VALUE_MISMATCH;
+                break;
+            }
+
+            shadowHash.erase(key);
+        }
+
+        if (RhHashTableSize(&hashTable) != shadowHash.size())
+        {
+            LOG_ERROR("Our reported hash size is %u, while the shadow hash size is %zu\n",
+                RhHashTableSize(&hashTable), shadowHash.size());
+            status = CL_STATUS_SIZE_INVALID;
+        }
+    }
+
+    if (SUCCEEDED(status))
+    {
+        RH_HASH_ITERATOR it;
+        DWORD iteratedElements = 0;
+        PRH_HASH_ENTRY pEntry;
+
+        RhHashTableIteratorInit(&hashTable, &it);
+
+        while ((pEntry = RhHashTableIteratorNext(&it)) != nullptr)
+        {
+            QWORD value = CONTAINING_RECORD(pEntry, UT_RH_HASH_ELEM, HashEntry)->Value;
+            auto shadowIt = shadowHash.find(value);
+
+            if (shadowIt == shadowHash.end() || &shadowIt->second->HashEntry != pEntry)
+            {
+                LOG_ERROR("Iterator returned entry 0x%p with value 0x%I64X which is not in the shadow hash\n",
+                    pEntry, value);
+                status = CL_STATUS_ELEMENT_NOT_FOUND;
+                break;
+            }
+
+            iteratedElements++;
+        }
+
+        if (SUCCEEDED(status) && iteratedElements != shadowHash.size())
+        {
+            LOG_ERROR("Iterated over %u elements, while the shadow hash size is %zu\n",
+                iteratedElements, shadowHash.size());
+            status = CL_STATUS_SIZE_INVALID;
+        }
+    }
+
+    if (SUCCEEDED(status))
+    {
+        RhHashTableClear(&hashTable, _RhHashFreeItem, &clearedValues);
+
+        for (const auto& value : clearedValues)
+        {
+            if (shadowHash.erase(value) != 1)
+            {
+                LOG_ERROR("Clear returned value 0x%I64X which is not in the shadow hash\n", value);
+                status = CL_STATUS_ELEMENT_FOUND;
+                break;
+            }
+        }
+
+        if (SUCCEEDED(status) && (!shadowHash.empty() || RhHashTableSize(&hashTable) != 0))
+        {
+            LOG_ERROR("After clear the shadow hash still has %zu elements and our hash %u elements\n",
+                shadowHash.size(), RhHashTableSize(&hashTable));
+            status = CL_STATUS_SIZE_INVALID;
+        }
+    }
+
+    RhHashTableUninit(&hashTable);
+
+    return status;
+}
+
+STATUS
+UtClRhHashTable()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    for (const auto& keySize : KEY_SIZES)
+    {
+        for (const auto& operations : UT_RH_OPERATIONS)
+        {
+            status = _UtClRunRhTestcase(operations, keySize);
+            if (!SUCCEEDED(status))
+            {
+                LOG_ERROR("Failed test with %u operations and key size %u with status 0x%X\n",
+                    operations, keySize, status);
+                return status;
+            }
+        }
+    }
+
+    return status;
+}
+
+template <typename Function>
+static
+double
+_MeasureNsPerOperation(
+    _In_ DWORD                          Operations,
+    _In_ Function                       Operation
+    )
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < Operations; ++i)
+    {
+        Operation(i);
+    }
+    double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+
+    return nanoseconds / Operations;
+}
+
+static
+STATUS
+_UtClRunHashBenchmark(
+    _In_ DWORD                          NumberOfElements
+    )
+{
+    STATUS status;
+    RH_HASH_TABLE rhTable;
+    HASH_TABLE chainedTable;
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    std::vector<UT_RH_HASH_ELEM> rhElems(NumberOfElements);
+    std::vector<UT_HASH_ELEM> chainedElems(NumberOfElements);
+    std::vector<QWORD> missingKeys(NumberOfElements);
+    DWORD buckets = std::max<DWORD>(NumberOfElements / UT_CHAINED_BENCH_LOAD, 1);
+    volatile QWORD found = 0;
+
+    // distinct keys: the odd ones are in the tables, the even ones are not
+    for (DWORD i = 0; i < NumberOfElements; ++i)
+    {
+        QWORD key = (((QWORD) rng.GetNextRandom() << 32) | rng.GetNextRandom()) & ~1ULL;
+
+        rhElems[i].Value = chainedElems[i].Value = key | (QWORD) 1;
+        missingKeys[i] = key;
+    }
+
+    status = RhHashTableInit(&rhTable,
+                             0,
+                             sizeof(QWORD),
+                             HashFuncGenericIncremental,
+                             FIELD_OFFSET(UT_RH_HASH_ELEM, Value) - FIELD_OFFSET(UT_RH_HASH_ELEM, HashEntry),
+                             _RhHashAlloc,
+                             _RhHashFree,
+                             NULL);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("RhHashTableInit", status);
+        return status;
+    }
+
+    status = _HashTableCreate(buckets, sizeof(QWORD), HashFuncGenericIncremental, &chainedTable);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_HashTableCreate", status);
+        RhHashTableUninit(&rhTable);
+        return status;
+    }
+
+    double rhInsert = _MeasureNsPerOperation(NumberOfElements, [&](DWORD i) {
+        found = found + (QWORD) RhHashTableInsert(&rhTable, &rhElems[i].HashEntry, NULL); });
+    double chainedInsert = _MeasureNsPerOperation(NumberOfElements, [&](DWORD i) {
+        found = found + (QWORD) HashTableInsert(&chainedTable, &chainedElems[i].HashEntry); });
+
+    double rhHit = _MeasureNsPerOperation(NumberOfElements, [&](DWORD i) {
+        found = found + (QWORD) RhHashTableLookup(&rhTable, (PHASH_KEY) &rhElems[i].Value); });
+    double chainedHit = _MeasureNsPerOperation(NumberOfElements, [&](DWORD i) {
+        found = found + (QWORD) HashTableLookup(&chainedTable, (PHASH_KEY) &chainedElems[i].Value); });
+
+    double rhMiss = _MeasureNsPerOperation(NumberOfElements, [&](DWORD i) {
+        found = found + (QWORD) RhHashTableLookup(&rhTable, (PHASH_KEY) &missingKeys[i]); });
+    double chainedMiss = _MeasureNsPerOperation(NumberOfElements, [&](DWORD i) {
+        found = found + (QWORD) HashTableLookup(&chainedTable, (PHASH_KEY) &missingKeys[i]); });
+
+    double rhRemove = _MeasureNsPerOperation(NumberOfElements, [&](DWORD i) {
+        RhHashTableRemoveEntry(&rhTable, &rhElems[i].HashEntry); });
+    double chainedRemove = _MeasureNsPerOperation(NumberOfElements, [&](DWORD i) {
+        HashTableRemoveEntry(&chainedTable, &chainedElems[i].HashEntry); });
+
+    LOG("[%7u elements] insert: %6.1f / %6.1f ns, lookup hit: %6.1f / %6.1f ns, lookup miss: %6.1f / %6.1f ns, remove: %6.1f / %6.1f ns\n",
+        NumberOfElements,
+        rhInsert, chainedInsert,
+        rhHit, chainedHit,
+        rhMiss, chainedMiss,
+        rhRemove, chainedRemove);
+
+    if (RhHashTableSize(&rhTable) != 0 || HashTableSize(&chainedTable) != 0)
+    {
+        LOG_ERROR("The tables should be empty, sizes are %u and %u\n",
+            RhHashTableSize(&rhTable), HashTableSize(&chainedTable));
+        status = CL_STATUS_SIZE_INVALID;
+    }
+
+    RhHashTableUninit(&rhTable);
+    delete[] (PBYTE) chainedTable.TableData;
+
+    return status;
+}
+
+STATUS
+UtClHashTableBenchmark()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    LOG("Time per operation for Robin Hood (grown from the minimum size) / chained (a bucket for each %u elements)\n",
+        UT_CHAINED_BENCH_LOAD);
+
+    for (const auto& elements : UT_RH_BENCH_ELEMENTS)
+    {
+        status = _UtClRunHashBenchmark(elements);
+        if (!SUCCEEDED(status))
+        {
+            break;
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,228 @@
+#include "ut_base.h"
+#include "ut_cl_lz.h"
+#include "lz.h"
+#include "cl_memory.h"
+#include <vector>
+#include <chrono>
+#include "ut_cl_rng.h"
+
+typedef enum _UT_LZ_CONTENT
+{
+    UtLzContentZeroes,
+    UtLzContentRandom,
+    UtLzContentText,
+    UtLzContentMixed,
+} UT_LZ_CONTENT;
+
+typedef struct _UT_LZ_PARAMS
+{
+    const std::string           TestName;
+
+    UT_LZ_CONTENT               Content;
+
+    DWORD                       MaxSize;
+
+    DWORD                       Iterations;
+} UT_LZ_PARAMS, *PUT_LZ_PARAMS;
+
+static const UT_LZ_PARAMS UT_PARAMS[] =
+{
+    {"Empty and tiny", UtLzContentMixed, 8, 100},
+    {"Zero pages", UtLzContentZeroes, 4096, 100},
+    {"Random pages", UtLzContentRandom, 4096, 100},
+    {"Text pages", UtLzContentText, 4096, 100},
+    {"Mixed pages", UtLzContentMixed, 4096, 1000},
+    {"Long offsets", UtLzContentText, 200'000, 20},
+};
+
+// the swap tier compresses single pages, these resemble what it sees
+static const UT_LZ_PARAMS UT_BENCH_PARAMS[] =
+{
+    {"Zero page", UtLzContentZeroes, 4096, 100'000},
+    {"Text page", UtLzContentText, 4096, 100'000},
+    {"Mixed page", UtLzContentMixed, 4096, 100'000},
+    {"Random page", UtLzContentRandom, 4096, 100'000},
+};
+
+static
+std::vector<BYTE>
+_LzGenerateInput(
+    _In_        UT_LZ_CONTENT       Content,
+    _In_        DWORD               Size
+    )
+{
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    std::vector<BYTE> data(Size, 0);
+    static const char* WORDS[] = { "memory ", "page ", "frame ", "swap ", "the ", "of ", "HAL9000 " };
+
+    switch (Content)
+    {
+    case UtLzContentZeroes:
+        break;
+    case UtLzContentRandom:
+        for (auto& b : data) b = (BYTE) rng.GetNextRandom();
+        break;
+    case UtLzContentText:
+        for (DWORD i = 0; i < Size; )
+        {
+            const char* word = WORDS[rng.GetNextRandom() % ARRAYSIZE(WORDS)];
+            for (DWORD j = 0; word[j] != '\0' && i < Size; ++j, ++i) data[i] = word[j];
+        }
+        break;
+    case UtLzContentMixed:
+        // runs of structured data separated by random bytes, like a heap page
+        for (DWORD i = 0; i < Size; ++i)
+        {
+            data[i] = (rng.GetNextRandom() % 8 == 0) ? (BYTE) rng.GetNextRandom() : (BYTE) (i % 64);
+        }
+        break;
+    }
+
+    return data;
+}
+
+static
+STATUS
+_UtClRunTestcase(
+    _In_ const UT_LZ_PARAMS&            Params
+    )
+{
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    std::vector<BYTE> workBuffer(LZ_WORK_BUFFER_SIZE);
+
+    for (DWORD it = 0; it < Params.Iterations; ++it)
+    {
+        DWORD size = rng.GetNextRandom() % (Params.MaxSize + 1);
+        std::vector<BYTE> input = _LzGenerateInput(Params.Content, size);
+        std::vector<BYTE> compressed(LzCompressBound(size));
+        std::vector<BYTE> output(size + 1);
+        DWORD bytesDecompressed;
+
+        DWORD compressedSize = LzCompress(input.data(), size, compressed.data(), (DWORD) compressed.size(), workBuffer.data());
+        if (compressedSize == 0)
+        {
+            LOG_ERROR("LzCompress failed for %u bytes with a %u bytes output buffer\n", size, (DWORD) compressed.size());
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        STATUS status = LzDecompress(compressed.data(), compressedSize, output.data(), size, &bytesDecompressed);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("LzDecompress", status);
+            return status;
+        }
+
+        if (bytesDecompressed != size || (size != 0 && cl_memcmp(input.data(), output.data(), size) != 0))
+        {
+            LOG_ERROR("Decompressed %u bytes, expected %u bytes\n", bytesDecompressed, size);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        // an output buffer one byte too small must be detected
+        if (size != 0)
+        {
+            status = LzDecompress(compressed.data(), compressedSize, output.data(), size - 1, &bytesDecompressed);
+            if (status != STATUS_BUFFER_TOO_SMALL)
+            {
+                LOG_ERROR("LzDecompress returned 0x%X for a too small buffer\n", status);
+                return CL_STATUS_VALUE_MISMATCH;
+            }
+        }
+
+        // a compressed output buffer which is too small must be detected as well
+        if (compressedSize > 1
+            && LzCompress(input.data(), size, compressed.data(), compressedSize - 1, workBuffer.data()) != 0)
+        {
+            LOG_ERROR("LzCompress succeeded with a buffer smaller than the compressed data\n");
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        // corrupted data may fail to decompress but must stay inside the buffers
+        compressedSize = LzCompress(input.data(), size, compressed.data(), (DWORD) compressed.size(), workBuffer.data());
+        compressed[rng.GetNextRandom() % compressedSize] ^= (BYTE) (1 + rng.GetNextRandom() % 255);
+        LzDecompress(compressed.data(), compressedSize, output.data(), size, &bytesDecompressed);
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+static
+STATUS
+_UtClRunBenchmark(
+    _In_ const UT_LZ_PARAMS&            Params
+    )
+{
+    std::vector<BYTE> workBuffer(LZ_WORK_BUFFER_SIZE);
+    std::vector<BYTE> input = _LzGenerateInput(Params.Content, Params.MaxSize);
+    std::vector<BYTE> compressed(LzCompressBound(Params.MaxSize));
+    std::vector<BYTE> output(Params.MaxSize);
+    DWORD compressedSize = 0;
+    DWORD bytesDecompressed = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < Params.Iterations; ++i)
+    {
+        compressedSize = LzCompress(input.data(), Params.MaxSize, compressed.data(), (DWORD) compressed.size(), workBuffer.data());
+    }
+    auto compressTime = std::chrono::high_resolution_clock::now() - start;
+
+    start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < Params.Iterations; ++i)
+    {
+        LzDecompress(compressed.data(), compressedSize, output.data(), Params.MaxSize, &bytesDecompressed);
+    }
+    auto decompressTime = std::chrono::high_resolution_clock::now() - start;
+
+    if (bytesDecompressed != Params.MaxSize || cl_memcmp(input.data(), output.data(), Params.MaxSize) != 0)
+    {
+        LOG_ERROR("Round trip of %u bytes failed\n", Params.MaxSize);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    double totalMb = (double) Params.MaxSize * Params.Iterations / (1024 * 1024);
+    double compressSec = std::chrono::duration<double>(compressTime).count();
+    double decompressSec = std::chrono::duration<double>(decompressTime).count();
+
+    LOG("[%s] ratio: %.2f, compress: %.0f MB/s, decompress: %.0f MB/s\n",
+        Params.TestName.c_str(), (double) compressedSize / Params.MaxSize,
+        compressSec != 0 ? totalMb / compressSec : 0.0,
+        decompressSec != 0 ? totalMb / decompressSec : 0.0);
+
+    return CL_STATUS_SUCCESS;
+}
+
+STATUS
+UtClLz()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    for (const auto& ut : UT_PARAMS)
+    {
+        status = _UtClRunTestcase(ut);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Test [%s] failed with status 0x%X\n", ut.TestName.c_str(), status);
+            break;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+UtClLzBenchmark()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    for (const auto& bench : UT_BENCH_PARAMS)
+    {
+        status = _UtClRunBenchmark(bench);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Benchmark [%s] failed with status 0x%X\n", bench.TestName.c_str(), status);
+            break;
+        }
+    }
+
+    return status;
+}
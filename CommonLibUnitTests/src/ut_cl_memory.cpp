@@ -0,0 +1,291 @@
+#include "ut_base.h"
+#include "ut_cl_memory.h"
+#include "cl_memory.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "ut_cl_rng.h"
+
+// some slack around the buffers so unaligned starts and overlapping moves
+// can be tested without leaving the allocation
+#define UT_MEMORY_SLACK                 64
+
+typedef struct _UT_MEMORY_PARAMS
+{
+    const std::string           TestName;
+
+    DWORD                       MaxSize;
+
+    DWORD                       Iterations;
+} UT_MEMORY_PARAMS, *PUT_MEMORY_PARAMS;
+
+static const UT_MEMORY_PARAMS UT_PARAMS[] =
+{
+    {"Tiny", 32, 10'000},
+    {"Small", 512, 10'000},
+    {"Pages", 16 * 1024, 1'000},
+    {"Large", 1024 * 1024, 20},
+};
+
+// the sizes the kernel works with: short strings, structures, pages and
+// whole screens or buffers
+static const DWORD UT_BENCH_SIZES[] =
+{
+    8, 64, 512, 4 * 1024, 64 * 1024, 1024 * 1024
+};
+
+// each benchmark touches roughly this many bytes
+#define UT_BENCH_BYTES_PER_RUN          (256ULL * 1024 * 1024)
+#define UT_BENCH_MAX_ITERATIONS         4'000'000
+
+// The byte at a time implementations the library had before, used both as
+// reference for the results and as the baseline of the benchmarks
+static
+void
+_RefMemset(
+    _Out_writes_bytes_all_(Size)    PBYTE       Address,
+    _In_                            BYTE        Value,
+    _In_                            DWORD       Size
+    )
+{
+    for (DWORD i = 0; i < Size; ++i)
+    {
+        Address[i] = Value;
+    }
+}
+
+static
+void
+_RefMemmove(
+    _Out_writes_bytes_all_(Count)   PBYTE       Destination,
+    _In_reads_bytes_(Count)         const BYTE* Source,
+    _In_                            QWORD       Count
+    )
+{
+    if (Destination <= Source)
+    {
+        for (QWORD i = 0; i < Count; ++i)
+        {
+            Destination[i] = Source[i];
+        }
+    }
+    else
+    {
+        for (QWORD i = Count; i > 0; --i)
+        {
+            Destination[i - 1] = Source[i - 1];
+        }
+    }
+}
+
+static
+int
+_RefMemcmp(
+    _In_reads_bytes_(Size)          const BYTE* Ptr1,
+    _In_reads_bytes_(Size)          const BYTE* Ptr2,
+    _In_                            DWORD       Size
+    )
+{
+    for (DWORD i = 0; i < Size; ++i)
+    {
+        if (Ptr1[i] != Ptr2[i])
+        {
+            return Ptr1[i] - Ptr2[i];
+        }
+    }
+
+    return 0;
+}
+
+static
+int
+_RefMemscan(
+    _In_reads_bytes_(Size)          const BYTE* Buffer,
+    _In_                            DWORD       Size,
+    _In_                            BYTE        Value
+    )
+{
+    DWORD i;
+
+    for (i = 0; i < Size && Buffer[i] == Value; ++i);
+
+    return i;
+}
+
+static
+void
+_FillRandom(
+    _Inout_                         std::vector<BYTE>& Buffer
+    )
+{
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+
+    for (auto& b : Buffer) b = (BYTE) rng.GetNextRandom();
+}
+
+static
+STATUS
+_UtClRunTestcase(
+    _In_ const UT_MEMORY_PARAMS&        Params
+    )
+{
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    std::vector<BYTE> actual(Params.MaxSize + 2 * UT_MEMORY_SLACK);
+    std::vector<BYTE> expected(actual.size());
+
+    for (DWORD it = 0; it < Params.Iterations; ++it)
+    {
+        DWORD size = rng.GetNextRandom() % (Params.MaxSize + 1);
+        DWORD dstOffset = rng.GetNextRandom() % UT_MEMORY_SLACK;
+        DWORD srcOffset = rng.GetNextRandom() % (2 * UT_MEMORY_SLACK);
+        BYTE value = (BYTE) rng.GetNextRandom();
+
+        // memset
+        _FillRandom(actual);
+        expected = actual;
+        cl_memset(&actual[dstOffset], value, size);
+        _RefMemset(&expected[dstOffset], value, size);
+        if (actual != expected)
+        {
+            LOG_ERROR("memset of %u bytes at offset %u failed\n", size, dstOffset);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        // memmove inside the same buffer, the ranges overlap in both
+        // directions depending on the offsets
+        _FillRandom(actual);
+        expected = actual;
+        cl_memmove(&actual[dstOffset], &actual[srcOffset], size);
+        _RefMemmove(&expected[dstOffset], &expected[srcOffset], size);
+        if (actual != expected)
+        {
+            LOG_ERROR("memmove of %u bytes from offset %u to offset %u failed\n", size, srcOffset, dstOffset);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        // memcmp of equal buffers and of buffers differing in a single byte
+        std::vector<BYTE> other(actual);
+        if (cl_memcmp(&actual[srcOffset], &other[srcOffset], size) != 0)
+        {
+            LOG_ERROR("memcmp of %u equal bytes failed\n", size);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        if (size != 0)
+        {
+            DWORD diffIndex = rng.GetNextRandom() % size;
+
+            other[srcOffset + diffIndex] = (BYTE) (other[srcOffset + diffIndex] + 1 + rng.GetNextRandom() % 255);
+            if (cl_memcmp(&actual[srcOffset], &other[srcOffset], size)
+                != _RefMemcmp(&actual[srcOffset], &other[srcOffset], size))
+            {
+                LOG_ERROR("memcmp of %u bytes differing at index %u failed\n", size, diffIndex);
+                return CL_STATUS_VALUE_MISMATCH;
+            }
+        }
+
+        // memscan stopping at a random position or running to the end
+        _RefMemset(&actual[srcOffset], value, size);
+        if (size != 0 && rng.GetNextRandom() % 2 == 0)
+        {
+            actual[srcOffset + rng.GetNextRandom() % size] = (BYTE) (value ^ 0x80);
+        }
+
+        if (cl_memscan(&actual[srcOffset], size, value) != _RefMemscan(&actual[srcOffset], size, value))
+        {
+            LOG_ERROR("memscan of %u bytes failed\n", size);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+template <typename Function>
+static
+double
+_MeasureMbPerSec(
+    _In_ DWORD                          Size,
+    _In_ Function                       Operation
+    )
+{
+    DWORD iterations = (DWORD) std::min<QWORD>(std::max<QWORD>(UT_BENCH_BYTES_PER_RUN / Size, 1), UT_BENCH_MAX_ITERATIONS);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < iterations; ++i)
+    {
+        Operation();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    return seconds != 0 ? ((double) Size * iterations / (1024 * 1024)) / seconds : 0.0;
+}
+
+static
+void
+_UtClRunBenchmark(
+    _In_ DWORD                          Size
+    )
+{
+    // one extra byte so the moves can be done on overlapping, unaligned ranges
+    std::vector<BYTE> dst(Size + 1);
+    std::vector<BYTE> src(Size + 1);
+    volatile int result = 0;
+
+    _FillRandom(src);
+    dst = src;
+
+    LOG("[%7u B] memset: %8.0f / %8.0f MB/s, memmove: %8.0f / %8.0f MB/s (overlapping: %8.0f / %8.0f MB/s)\n",
+        Size,
+        _MeasureMbPerSec(Size, [&]() { cl_memset(dst.data(), 0xAB, Size); }),
+        _MeasureMbPerSec(Size, [&]() { _RefMemset(dst.data(), 0xAB, Size); }),
+        _MeasureMbPerSec(Size, [&]() { cl_memmove(dst.data(), src.data(), Size); }),
+        _MeasureMbPerSec(Size, [&]() { _RefMemmove(dst.data(), src.data(), Size); }),
+        _MeasureMbPerSec(Size, [&]() { cl_memmove(dst.data() + 1, dst.data(), Size); }),
+        _MeasureMbPerSec(Size, [&]() { _RefMemmove(dst.data() + 1, dst.data(), Size); }));
+
+    // equal buffers and a buffer with a single value force the whole range
+    // to be examined
+    cl_memcpy(dst.data(), src.data(), Size);
+    cl_memset(src.data(), 0, Size);
+
+    std::vector<BYTE> copy(dst);
+
+    LOG("[%7u B] memcmp: %8.0f / %8.0f MB/s, memscan: %8.0f / %8.0f MB/s\n",
+        Size,
+        _MeasureMbPerSec(Size, [&]() { result = result + cl_memcmp(dst.data(), copy.data(), Size); }),
+        _MeasureMbPerSec(Size, [&]() { result = result + _RefMemcmp(dst.data(), copy.data(), Size); }),
+        _MeasureMbPerSec(Size, [&]() { result = result + cl_memscan(src.data(), Size, 0); }),
+        _MeasureMbPerSec(Size, [&]() { result = result + _RefMemscan(src.data(), Size, 0); }));
+}
+
+STATUS
+UtClMemory()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    for (const auto& ut : UT_PARAMS)
+    {
+        status = _UtClRunTestcase(ut);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Test [%s] failed with status 0x%X\n", ut.TestName.c_str(), status);
+            break;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+UtClMemoryBenchmark()
+{
+    LOG("Optimized / byte at a time throughput\n");
+
+    for (const auto size : UT_BENCH_SIZES)
+    {
+        _UtClRunBenchmark(size);
+    }
+
+    return CL_STATUS_SUCCESS;
+}
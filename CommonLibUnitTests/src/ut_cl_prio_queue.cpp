@@ -0,0 +1,484 @@
+#include "ut_base.h"
+#include "ut_cl_prio_queue.h"
+#include "bin_heap.h"
+#include "pairing_heap.h"
+#include "list.h"
+#include <set>
+#include <vector>
+#include <chrono>
+#include "ut_cl_rng.h"
+
+typedef struct _UT_PQ_ELEM
+{
+    QWORD                       Key;
+
+    DWORD                       Id;
+    BOOLEAN                     InHeap;
+
+    BIN_HEAP_ENTRY              BinEntry;
+    PAIRING_HEAP_ENTRY          PairingEntry;
+    LIST_ENTRY                  ListEntry;
+} UT_PQ_ELEM, *PUT_PQ_ELEM;
+
+typedef struct _UT_PQ_PARAMS
+{
+    const std::string           TestName;
+
+    DWORD                       Operations;
+
+    // the keys are taken from [0, KeyRange) => a small range produces many
+    // equal keys
+    DWORD                       KeyRange;
+} UT_PQ_PARAMS, *PUT_PQ_PARAMS;
+
+static const UT_PQ_PARAMS UT_PARAMS[] =
+{
+    {"Few elements", 100, 1000},
+    {"Equal keys", 10'000, 4},
+    {"Basic test", 10'000, 1'000'000},
+    {"Many elements", 200'000, MAX_DWORD},
+};
+
+static const DWORD UT_PQ_BENCH_ELEMENTS[] =
+{
+    1'000, 10'000, 100'000, 1'000'000
+};
+
+// InsertOrderedList is O(n), the benchmark runs it only up to this size
+#define UT_PQ_LIST_BENCH_MAX            10'000
+
+static
+INT64
+(__cdecl _BinHeapCompare)(
+    IN      PBIN_HEAP_ENTRY     FirstElem,
+    IN      PBIN_HEAP_ENTRY     SecondElem
+    )
+{
+    QWORD first = CONTAINING_RECORD(FirstElem, UT_PQ_ELEM, BinEntry)->Key;
+    QWORD second = CONTAINING_RECORD(SecondElem, UT_PQ_ELEM, BinEntry)->Key;
+
+    return (first > second) - (first < second);
+}
+
+static
+INT64
+(__cdecl _PairingHeapCompare)(
+    IN      PPAIRING_HEAP_ENTRY FirstElem,
+    IN      PPAIRING_HEAP_ENTRY SecondElem
+    )
+{
+    QWORD first = CONTAINING_RECORD(FirstElem, UT_PQ_ELEM, PairingEntry)->Key;
+    QWORD second = CONTAINING_RECORD(SecondElem, UT_PQ_ELEM, PairingEntry)->Key;
+
+    return (first > second) - (first < second);
+}
+
+static
+INT64
+(__cdecl _ListCompare)(
+    IN      PLIST_ENTRY         FirstElem,
+    IN      PLIST_ENTRY         SecondElem
+    )
+{
+    QWORD first = CONTAINING_RECORD(FirstElem, UT_PQ_ELEM, ListEntry)->Key;
+    QWORD second = CONTAINING_RECORD(SecondElem, UT_PQ_ELEM, ListEntry)->Key;
+
+    return (first > second) - (first < second);
+}
+
+static
+PVOID
+(__cdecl _BinHeapAlloc)(
+    IN      DWORD       Size,
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    return new BYTE[Size];
+}
+
+static
+void
+(__cdecl _BinHeapFree)(
+    IN      PVOID       Object,
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    delete[] (PBYTE) Object;
+}
+
+// Gives both heaps the same interface so the tests and the benchmarks are
+// written once
+class UtBinHeap
+{
+public:
+    STATUS Init() { return BinHeapInit(&m_heap, 0, _BinHeapCompare, _BinHeapAlloc, _BinHeapFree, NULL); }
+    void Uninit() { BinHeapUninit(&m_heap); }
+    DWORD Size() { return BinHeapSize(&m_heap); }
+    STATUS Insert(PUT_PQ_ELEM Elem) { return BinHeapInsert(&m_heap, &Elem->BinEntry); }
+    PUT_PQ_ELEM PeekMin() { return _ToElem(BinHeapPeekMin(&m_heap)); }
+    PUT_PQ_ELEM ExtractMin() { return _ToElem(BinHeapExtractMin(&m_heap)); }
+    void Remove(PUT_PQ_ELEM Elem) { BinHeapRemoveEntry(&m_heap, &Elem->BinEntry); }
+    void DecreaseKey(PUT_PQ_ELEM Elem) { BinHeapDecreaseKey(&m_heap, &Elem->BinEntry); }
+
+    static constexpr const char* NAME = "binary heap";
+
+private:
+    static PUT_PQ_ELEM _ToElem(PBIN_HEAP_ENTRY Entry) { return Entry != NULL ? CONTAINING_RECORD(Entry, UT_PQ_ELEM, BinEntry) : nullptr; }
+
+    BIN_HEAP m_heap;
+};
+
+class UtPairingHeap
+{
+public:
+    STATUS Init() { PairingHeapInit(&m_heap, _PairingHeapCompare); return CL_STATUS_SUCCESS; }
+    void Uninit() {}
+    DWORD Size() { return PairingHeapSize(&m_heap); }
+    STATUS Insert(PUT_PQ_ELEM Elem) { PairingHeapInsert(&m_heap, &Elem->PairingEntry); return CL_STATUS_SUCCESS; }
+    PUT_PQ_ELEM PeekMin() { return _ToElem(PairingHeapPeekMin(&m_heap)); }
+    PUT_PQ_ELEM ExtractMin() { return _ToElem(PairingHeapExtractMin(&m_heap)); }
+    void Remove(PUT_PQ_ELEM Elem) { PairingHeapRemoveEntry(&m_heap, &Elem->PairingEntry); }
+    void DecreaseKey(PUT_PQ_ELEM Elem) { PairingHeapDecreaseKey(&m_heap, &Elem->PairingEntry); }
+
+    static constexpr const char* NAME = "pairing heap";
+
+private:
+    static PUT_PQ_ELEM _ToElem(PPAIRING_HEAP_ENTRY Entry) { return Entry != NULL ? CONTAINING_RECORD(Entry, UT_PQ_ELEM, PairingEntry) : nullptr; }
+
+    PAIRING_HEAP m_heap;
+};
+
+typedef std::set<std::pair<QWORD, DWORD>> UT_PQ_SHADOW;
+
+static
+STATUS
+_UtClCheckMin(
+    _In_ PUT_PQ_ELEM                    Elem,
+    _In_ const UT_PQ_SHADOW&            Shadow
+    )
+{
+    if (Shadow.empty())
+    {
+        if (Elem != nullptr)
+        {
+            LOG_ERROR("The heap should be empty but returned element %u\n", Elem->Id);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        return CL_STATUS_SUCCESS;
+    }
+
+    // with equal keys any of the elements may come first
+    if (Elem == nullptr || Elem->Key != Shadow.begin()->first)
+    {
+        LOG_ERROR("The minimum should have key 0x%I64X, the heap returned 0x%I64X\n",
+            Shadow.begin()->first, Elem != nullptr ? Elem->Key : MAX_QWORD);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    if (Shadow.find({Elem->Key, Elem->Id}) == Shadow.end())
+    {
+        LOG_ERROR("The heap returned element %u which was already removed\n", Elem->Id);
+        return CL_STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+template <typename Heap>
+static
+STATUS
+_UtClRunPqTestcase(
+    _In_ const UT_PQ_PARAMS&            Params
+    )
+{
+    STATUS status;
+    Heap heap;
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    UT_PQ_SHADOW shadow;
+    std::vector<UT_PQ_ELEM> elems(Params.Operations);
+    std::vector<PUT_PQ_ELEM> inHeap;
+
+    status = heap.Init();
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("Init", status);
+        return status;
+    }
+
+    for (DWORD i = 0; i < Params.Operations && SUCCEEDED(status); ++i)
+    {
+        // insertions are the most frequent so the heap keeps growing
+        DWORD operation = rng.GetNextRandom() % 8;
+
+        if (operation < 4 || inHeap.empty())
+        {
+            PUT_PQ_ELEM pElem = &elems[i];
+
+            pElem->Key = rng.GetNextRandom() % Params.KeyRange;
+            pElem->Id = i;
+
+            status = heap.Insert(pElem);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("Insert", status);
+                break;
+            }
+
+            pElem->InHeap = TRUE;
+            shadow.insert({pElem->Key, pElem->Id});
+            inHeap.push_back(pElem);
+        }
+        else if (operation < 6)
+        {
+            PUT_PQ_ELEM pElem = heap.PeekMin();
+
+            status = _UtClCheckMin(pElem, shadow);
+            if (!SUCCEEDED(status))
+            {
+                break;
+            }
+
+            if (heap.ExtractMin() != pElem)
+            {
+                LOG_ERROR("ExtractMin did not return the element returned by PeekMin\n");
+                status = CL_STATUS_VALUE_MISMATCH;
+                break;
+            }
+
+            if (pElem != nullptr)
+            {
+                pElem->InHeap = FALSE;
+                shadow.erase({pElem->Key, pElem->Id});
+            }
+        }
+        else
+        {
+            DWORD index = rng.GetNextRandom() % (DWORD) inHeap.size();
+            PUT_PQ_ELEM pElem = inHeap[index];
+
+            // the vector also keeps the extracted elements, they are dropped
+            // lazily
+            inHeap[index] = inHeap.back();
+            inHeap.pop_back();
+
+            if (!pElem->InHeap)
+            {
+                continue;
+            }
+
+            shadow.erase({pElem->Key, pElem->Id});
+
+            if (operation == 6)
+            {
+                heap.Remove(pElem);
+                pElem->InHeap = FALSE;
+            }
+            else
+            {
+                pElem->Key = pElem->Key - pElem->Key / (rng.GetNextRandom() % 4 + 1);
+                heap.DecreaseKey(pElem);
+
+                shadow.insert({pElem->Key, pElem->Id});
+                inHeap.push_back(pElem);
+            }
+        }
+
+        if (heap.Size() != shadow.size())
+        {
+            LOG_ERROR("Our reported heap size is %u, while the shadow size is %zu\n",
+                heap.Size(), shadow.size());
+            status = CL_STATUS_SIZE_INVALID;
+        }
+    }
+
+    // the heap must give back all the elements in order
+    while (SUCCEEDED(status) && !shadow.empty())
+    {
+        PUT_PQ_ELEM pElem = heap.ExtractMin();
+
+        status = _UtClCheckMin(pElem, shadow);
+        if (SUCCEEDED(status))
+        {
+            shadow.erase({pElem->Key, pElem->Id});
+        }
+    }
+
+    if (SUCCEEDED(status) && (heap.Size() != 0 || heap.ExtractMin() != nullptr))
+    {
+        LOG_ERROR("After extracting all the elements the heap size is %u\n", heap.Size());
+        status = CL_STATUS_SIZE_INVALID;
+    }
+
+    heap.Uninit();
+
+    return status;
+}
+
+template <typename Heap>
+static
+STATUS
+_UtClRunPqTestcases()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    for (const auto& params : UT_PARAMS)
+    {
+        status = _UtClRunPqTestcase<Heap>(params);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Test [%s] failed for the %s with status 0x%X\n",
+                params.TestName.c_str(), Heap::NAME, status);
+            break;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+UtClBinHeap()
+{
+    return _UtClRunPqTestcases<UtBinHeap>();
+}
+
+STATUS
+UtClPairingHeap()
+{
+    return _UtClRunPqTestcases<UtPairingHeap>();
+}
+
+template <typename Function>
+static
+double
+_MeasureMillionOpsPerSecond(
+    _In_ DWORD                          Operations,
+    _In_ Function                       Operation
+    )
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < Operations; ++i)
+    {
+        Operation(i);
+    }
+    double microseconds = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+    return microseconds > 0 ? Operations / microseconds : 0;
+}
+
+// Measures insertions of random keys, a hold phase in which each extracted
+// element is inserted back with a later key (what a timer queue does), key
+// decreases and finally the extraction of all the elements
+template <typename Heap>
+static
+STATUS
+_UtClRunPqBenchmark(
+    _In_ DWORD                          NumberOfElements
+    )
+{
+    STATUS status;
+    Heap heap;
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    std::vector<UT_PQ_ELEM> elems(NumberOfElements);
+    std::vector<QWORD> keys(NumberOfElements);
+    volatile QWORD sum = 0;
+
+    for (DWORD i = 0; i < NumberOfElements; ++i)
+    {
+        keys[i] = ((QWORD) rng.GetNextRandom() << 16) + 1;
+    }
+
+    status = heap.Init();
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("Init", status);
+        return status;
+    }
+
+    double insert = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        elems[i].Key = keys[i];
+        sum = sum + (QWORD) heap.Insert(&elems[i]); });
+
+    double hold = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        PUT_PQ_ELEM pElem = heap.ExtractMin();
+        pElem->Key = pElem->Key + keys[i];
+        sum = sum + (QWORD) heap.Insert(pElem); });
+
+    double decrease = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        elems[i].Key = elems[i].Key / 2;
+        heap.DecreaseKey(&elems[i]); });
+
+    double extract = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        UNREFERENCED_PARAMETER(i);
+        sum = sum + heap.ExtractMin()->Key; });
+
+    LOG("[%7u elements] %-12s insert: %6.2f, hold: %6.2f, decrease key: %6.2f, extract min: %6.2f Mops/s\n",
+        NumberOfElements, Heap::NAME, insert, hold, decrease, extract);
+
+    if (heap.Size() != 0)
+    {
+        LOG_ERROR("The heap should be empty, size is %u\n", heap.Size());
+        status = CL_STATUS_SIZE_INVALID;
+    }
+
+    heap.Uninit();
+
+    return status;
+}
+
+static
+void
+_UtClRunListBenchmark(
+    _In_ DWORD                          NumberOfElements
+    )
+{
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    std::vector<UT_PQ_ELEM> elems(NumberOfElements);
+    LIST_ENTRY head;
+    volatile QWORD sum = 0;
+
+    InitializeListHead(&head);
+
+    double insert = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        elems[i].Key = rng.GetNextRandom();
+        InsertOrderedList(&head, &elems[i].ListEntry, _ListCompare); });
+
+    double extract = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        UNREFERENCED_PARAMETER(i);
+        sum = sum + CONTAINING_RECORD(RemoveHeadList(&head), UT_PQ_ELEM, ListEntry)->Key; });
+
+    LOG("[%7u elements] %-12s insert: %6.2f, extract min: %6.2f Mops/s\n",
+        NumberOfElements, "ordered list", insert, extract);
+}
+
+STATUS
+UtClPrioQueueBenchmark()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    for (const auto& elements : UT_PQ_BENCH_ELEMENTS)
+    {
+        status = _UtClRunPqBenchmark<UtBinHeap>(elements);
+        if (!SUCCEEDED(status))
+        {
+            break;
+        }
+
+        status = _UtClRunPqBenchmark<UtPairingHeap>(elements);
+        if (!SUCCEEDED(status))
+        {
+            break;
+        }
+
+        if (elements <= UT_PQ_LIST_BENCH_MAX)
+        {
+            _UtClRunListBenchmark(elements);
+        }
+    }
+
+    return status;
+}
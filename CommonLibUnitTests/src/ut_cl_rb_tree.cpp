@@ -0,0 +1,570 @@
+#include "ut_base.h"
+#include "ut_cl_rb_tree.h"
+#include "rb_tree.h"
+#include <map>
+#include <set>
+#include <vector>
+#include <chrono>
+#include "ut_cl_rng.h"
+
+typedef struct _UT_RB_ELEM
+{
+    RB_NODE                     Node;
+
+    QWORD                       Key;
+
+    // orders the elements with equal keys, they must be iterated in the order
+    // in which they were inserted
+    DWORD                       Sequence;
+    BOOLEAN                     InTree;
+
+    // the element is also the interval [Key, End], MaxEnd is the augmented
+    // data: the greatest End in the subtree of the element
+    QWORD                       End;
+    QWORD                       MaxEnd;
+} UT_RB_ELEM, *PUT_RB_ELEM;
+
+typedef struct _UT_RB_PARAMS
+{
+    const std::string           TestName;
+
+    DWORD                       Operations;
+
+    // the keys are taken from [0, KeyRange) => a small range produces many
+    // equal keys
+    DWORD                       KeyRange;
+
+    BOOLEAN                     Augmented;
+} UT_RB_PARAMS, *PUT_RB_PARAMS;
+
+static const UT_RB_PARAMS UT_PARAMS[] =
+{
+    {"Few elements", 100, 50, FALSE},
+    {"Equal keys", 10'000, 16, FALSE},
+    {"Basic test", 10'000, 1'000'000, FALSE},
+    {"Many elements", 200'000, MAX_DWORD, FALSE},
+    {"Interval tree", 10'000, 100'000, TRUE},
+    {"Big interval tree", 100'000, MAX_DWORD, TRUE},
+};
+
+// the whole tree is checked after each operation for the small tests and
+// after every UT_RB_VALIDATE_PERIOD operations for the others
+#define UT_RB_VALIDATE_ALWAYS_MAX       1'000
+#define UT_RB_VALIDATE_PERIOD           1'000
+
+static const DWORD UT_RB_BENCH_ELEMENTS[] =
+{
+    1'000, 100'000, 1'000'000
+};
+
+typedef std::set<std::pair<QWORD, DWORD>> UT_RB_SHADOW;
+
+static
+INT64
+(__cdecl _RbCompare)(
+    IN      PRB_NODE        FirstElem,
+    IN      PRB_NODE        SecondElem
+    )
+{
+    return RbCompareQword(CONTAINING_RECORD(FirstElem, UT_RB_ELEM, Node)->Key,
+                          CONTAINING_RECORD(SecondElem, UT_RB_ELEM, Node)->Key);
+}
+
+static
+INT64
+(__cdecl _RbKeyCompare)(
+    IN      PVOID           Key,
+    IN      PRB_NODE        Node
+    )
+{
+    return RbCompareQword(*(PQWORD) Key, CONTAINING_RECORD(Node, UT_RB_ELEM, Node)->Key);
+}
+
+static
+void
+(__cdecl _RbAugmentMaxEnd)(
+    INOUT   PRB_NODE        Node
+    )
+{
+    PUT_RB_ELEM pElem = CONTAINING_RECORD(Node, UT_RB_ELEM, Node);
+
+    pElem->MaxEnd = pElem->End;
+
+    if (Node->Left != NULL)
+    {
+        pElem->MaxEnd = std::max<QWORD>(pElem->MaxEnd, CONTAINING_RECORD(Node->Left, UT_RB_ELEM, Node)->MaxEnd);
+    }
+
+    if (Node->Right != NULL)
+    {
+        pElem->MaxEnd = std::max<QWORD>(pElem->MaxEnd, CONTAINING_RECORD(Node->Right, UT_RB_ELEM, Node)->MaxEnd);
+    }
+}
+
+static
+PUT_RB_ELEM
+_RbToElem(
+    _In_opt_ PRB_NODE                   Node
+    )
+{
+    return Node != NULL ? CONTAINING_RECORD(Node, UT_RB_ELEM, Node) : nullptr;
+}
+
+// Checks the red-black properties of the subtree and returns its black height,
+// 0 if a property does not hold
+static
+DWORD
+_UtClRbValidateSubtree(
+    _In_opt_ PRB_NODE                   Node,
+    _In_ BOOLEAN                        Augmented
+    )
+{
+    DWORD leftHeight;
+    DWORD rightHeight;
+
+    if (Node == NULL)
+    {
+        return 1;
+    }
+
+    if ((Node->Left != NULL && Node->Left->Parent != Node) ||
+        (Node->Right != NULL && Node->Right->Parent != Node))
+    {
+        LOG_ERROR("The children of element with key 0x%I64X don't point back to it\n", _RbToElem(Node)->Key);
+        return 0;
+    }
+
+    if (Node->Red &&
+        ((Node->Left != NULL && Node->Left->Red) || (Node->Right != NULL && Node->Right->Red)))
+    {
+        LOG_ERROR("Red element with key 0x%I64X has a red child\n", _RbToElem(Node)->Key);
+        return 0;
+    }
+
+    leftHeight = _UtClRbValidateSubtree(Node->Left, Augmented);
+    rightHeight = _UtClRbValidateSubtree(Node->Right, Augmented);
+
+    if (leftHeight == 0 || rightHeight == 0)
+    {
+        return 0;
+    }
+
+    if (leftHeight != rightHeight)
+    {
+        LOG_ERROR("Element with key 0x%I64X has black heights %u and %u\n",
+            _RbToElem(Node)->Key, leftHeight, rightHeight);
+        return 0;
+    }
+
+    if (Augmented)
+    {
+        QWORD maxEnd = _RbToElem(Node)->MaxEnd;
+
+        _RbAugmentMaxEnd(Node);
+
+        if (maxEnd != _RbToElem(Node)->MaxEnd)
+        {
+            LOG_ERROR("Element with key 0x%I64X has max end 0x%I64X instead of 0x%I64X\n",
+                _RbToElem(Node)->Key, maxEnd, _RbToElem(Node)->MaxEnd);
+            return 0;
+        }
+    }
+
+    return leftHeight + (Node->Red ? 0 : 1);
+}
+
+static
+STATUS
+_UtClRbValidate(
+    _In_ PRB_TREE                       Tree,
+    _In_ const UT_RB_SHADOW&            Shadow,
+    _In_ BOOLEAN                        Augmented
+    )
+{
+    PRB_NODE pNode;
+
+    if (Tree->Root != NULL && (Tree->Root->Red || Tree->Root->Parent != NULL))
+    {
+        LOG_ERROR("The root is red or has a parent\n");
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    if (_UtClRbValidateSubtree(Tree->Root, Augmented) == 0)
+    {
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    if (RbTreeSize(Tree) != Shadow.size())
+    {
+        LOG_ERROR("Our reported tree size is %u, while the shadow size is %zu\n",
+            RbTreeSize(Tree), Shadow.size());
+        return CL_STATUS_SIZE_INVALID;
+    }
+
+    // the iteration order must match the shadow exactly in both directions
+    pNode = RbTreeFirst(Tree);
+    for (const auto& expected : Shadow)
+    {
+        PUT_RB_ELEM pElem = _RbToElem(pNode);
+
+        if (pElem == nullptr || pElem->Key != expected.first || pElem->Sequence != expected.second)
+        {
+            LOG_ERROR("Iteration returned 0x%p instead of key 0x%I64X inserted %u-th\n",
+                pElem, expected.first, expected.second);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        pNode = RbTreeNext(pNode);
+    }
+
+    if (pNode != NULL)
+    {
+        LOG_ERROR("Iteration returned more elements than the shadow has\n");
+        return CL_STATUS_SIZE_INVALID;
+    }
+
+    pNode = RbTreeLast(Tree);
+    for (auto it = Shadow.rbegin(); it != Shadow.rend(); ++it)
+    {
+        if (pNode == NULL || _RbToElem(pNode)->Sequence != it->second)
+        {
+            LOG_ERROR("Reverse iteration does not match the shadow at key 0x%I64X\n", it->first);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        pNode = RbTreePrev(pNode);
+    }
+
+    return (pNode == NULL) ? CL_STATUS_SUCCESS : CL_STATUS_SIZE_INVALID;
+}
+
+static
+STATUS
+_UtClRbCheckLookups(
+    _In_ PRB_TREE                       Tree,
+    _In_ const UT_RB_SHADOW&            Shadow,
+    _In_ QWORD                          Key
+    )
+{
+    auto ceilingIt = Shadow.lower_bound({Key, 0});
+    auto upperIt = Shadow.upper_bound({Key, MAX_DWORD});
+    PUT_RB_ELEM pElem;
+    DWORD expected;
+
+    // the first element with Key is also the ceiling if it exists
+    pElem = _RbToElem(RbTreeLookup(Tree, &Key));
+    expected = (ceilingIt != Shadow.end() && ceilingIt->first == Key) ? ceilingIt->second : MAX_DWORD;
+    if ((pElem != nullptr ? pElem->Sequence : MAX_DWORD) != expected)
+    {
+        LOG_ERROR("Lookup of key 0x%I64X returned element %u instead of %u\n",
+            Key, pElem != nullptr ? pElem->Sequence : MAX_DWORD, expected);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    pElem = _RbToElem(RbTreeLookupCeiling(Tree, &Key));
+    expected = (ceilingIt != Shadow.end()) ? ceilingIt->second : MAX_DWORD;
+    if ((pElem != nullptr ? pElem->Sequence : MAX_DWORD) != expected)
+    {
+        LOG_ERROR("Ceiling of key 0x%I64X returned element %u instead of %u\n",
+            Key, pElem != nullptr ? pElem->Sequence : MAX_DWORD, expected);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    pElem = _RbToElem(RbTreeLookupFloor(Tree, &Key));
+    expected = (upperIt != Shadow.begin()) ? std::prev(upperIt)->second : MAX_DWORD;
+    if ((pElem != nullptr ? pElem->Sequence : MAX_DWORD) != expected)
+    {
+        LOG_ERROR("Floor of key 0x%I64X returned element %u instead of %u\n",
+            Key, pElem != nullptr ? pElem->Sequence : MAX_DWORD, expected);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+// Counts the intervals which intersect [Low, High], the subtrees whose
+// maximum end is below Low are skipped
+static
+DWORD
+_UtClRbCountOverlaps(
+    _In_opt_ PRB_NODE                   Node,
+    _In_ QWORD                          Low,
+    _In_ QWORD                          High
+    )
+{
+    PUT_RB_ELEM pElem = _RbToElem(Node);
+    DWORD count;
+
+    if (pElem == nullptr || pElem->MaxEnd < Low)
+    {
+        return 0;
+    }
+
+    count = _UtClRbCountOverlaps(Node->Left, Low, High);
+
+    // the elements on the right start after this one
+    if (pElem->Key <= High)
+    {
+        count += (pElem->End >= Low) ? 1 : 0;
+        count += _UtClRbCountOverlaps(Node->Right, Low, High);
+    }
+
+    return count;
+}
+
+static
+STATUS
+_UtClRunRbTestcase(
+    _In_ const UT_RB_PARAMS&            Params
+    )
+{
+    STATUS status;
+    RB_TREE tree;
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    UT_RB_SHADOW shadow;
+    std::vector<UT_RB_ELEM> elems(Params.Operations);
+    std::vector<PUT_RB_ELEM> inTree;
+
+    RbTreeInit(&tree, _RbCompare, _RbKeyCompare, Params.Augmented ? _RbAugmentMaxEnd : NULL);
+
+    status = CL_STATUS_SUCCESS;
+
+    for (DWORD i = 0; i < Params.Operations && SUCCEEDED(status); ++i)
+    {
+        DWORD operation = rng.GetNextRandom() % 8;
+        QWORD key = rng.GetNextRandom() % Params.KeyRange;
+
+        if (operation < 3 || inTree.empty())
+        {
+            PUT_RB_ELEM pElem = &elems[i];
+
+            pElem->Key = key;
+            pElem->End = key + rng.GetNextRandom() % (Params.KeyRange / 16 + 1);
+            pElem->Sequence = i;
+
+            if (operation == 0)
+            {
+                PRB_NODE pExisting;
+                auto it = shadow.lower_bound({key, 0});
+                BOOLEAN bExists = it != shadow.end() && it->first == key;
+
+                status = RbTreeInsertUnique(&tree, &pElem->Node, &pExisting);
+                if (bExists != (status == STATUS_ELEMENT_FOUND) ||
+                    (bExists && _RbToElem(pExisting)->Key != key) ||
+                    (!bExists && (!SUCCEEDED(status) || pExisting != NULL)))
+                {
+                    LOG_ERROR("Unique insert of key 0x%I64X returned status 0x%X and 0x%p\n",
+                        key, status, pExisting);
+                    status = CL_STATUS_VALUE_MISMATCH;
+                    break;
+                }
+
+                status = CL_STATUS_SUCCESS;
+
+                if (bExists)
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                RbTreeInsert(&tree, &pElem->Node);
+            }
+
+            pElem->InTree = TRUE;
+            shadow.insert({pElem->Key, pElem->Sequence});
+            inTree.push_back(pElem);
+        }
+        else if (operation < 6)
+        {
+            DWORD index = rng.GetNextRandom() % (DWORD) inTree.size();
+            PUT_RB_ELEM pElem = inTree[index];
+
+            inTree[index] = inTree.back();
+            inTree.pop_back();
+
+            RbTreeRemove(&tree, &pElem->Node);
+            pElem->InTree = FALSE;
+            shadow.erase({pElem->Key, pElem->Sequence});
+        }
+        else if (operation == 6 || !Params.Augmented)
+        {
+            // keys which are in the tree and keys which are not
+            status = _UtClRbCheckLookups(&tree, shadow, (operation == 6) ? inTree[0]->Key : key);
+        }
+        else
+        {
+            QWORD high = key + rng.GetNextRandom() % (Params.KeyRange / 8 + 1);
+            DWORD expected = 0;
+
+            for (const auto pElem : inTree)
+            {
+                expected += (pElem->Key <= high && pElem->End >= key) ? 1 : 0;
+            }
+
+            DWORD found = _UtClRbCountOverlaps(tree.Root, key, high);
+            if (found != expected)
+            {
+                LOG_ERROR("Found %u intervals intersecting [0x%I64X, 0x%I64X] instead of %u\n",
+                    found, key, high, expected);
+                status = CL_STATUS_VALUE_MISMATCH;
+            }
+        }
+
+        if (SUCCEEDED(status) && (Params.Operations <= UT_RB_VALIDATE_ALWAYS_MAX || i % UT_RB_VALIDATE_PERIOD == 0))
+        {
+            status = _UtClRbValidate(&tree, shadow, Params.Augmented);
+        }
+    }
+
+    if (SUCCEEDED(status))
+    {
+        status = _UtClRbValidate(&tree, shadow, Params.Augmented);
+    }
+
+    // emptying the tree goes through all the removal cases once more
+    while (SUCCEEDED(status) && !inTree.empty())
+    {
+        RbTreeRemove(&tree, &inTree.back()->Node);
+        shadow.erase({inTree.back()->Key, inTree.back()->Sequence});
+        inTree.pop_back();
+
+        if (inTree.size() % UT_RB_VALIDATE_PERIOD == 0)
+        {
+            status = _UtClRbValidate(&tree, shadow, Params.Augmented);
+        }
+    }
+
+    if (SUCCEEDED(status) && (tree.Root != NULL || RbTreeFirst(&tree) != NULL))
+    {
+        LOG_ERROR("The tree should be empty\n");
+        status = CL_STATUS_SIZE_INVALID;
+    }
+
+    return status;
+}
+
+STATUS
+UtClRbTree()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    for (const auto& params : UT_PARAMS)
+    {
+        status = _UtClRunRbTestcase(params);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Test [%s] failed with status 0x%X\n", params.TestName.c_str(), status);
+            break;
+        }
+    }
+
+    return status;
+}
+
+template <typename Function>
+static
+double
+_MeasureMillionOpsPerSecond(
+    _In_ DWORD                          Operations,
+    _In_ Function                       Operation
+    )
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < Operations; ++i)
+    {
+        Operation(i);
+    }
+    double microseconds = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+    return microseconds > 0 ? Operations / microseconds : 0;
+}
+
+static
+STATUS
+_UtClRunRbBenchmark(
+    _In_ DWORD                          NumberOfElements
+    )
+{
+    RB_TREE tree;
+    std::multimap<QWORD, PUT_RB_ELEM> map;
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+    std::vector<UT_RB_ELEM> elems(NumberOfElements);
+    volatile QWORD sum = 0;
+
+    for (DWORD i = 0; i < NumberOfElements; ++i)
+    {
+        elems[i].Key = ((QWORD) rng.GetNextRandom() << 32) | rng.GetNextRandom();
+    }
+
+    RbTreeInit(&tree, _RbCompare, _RbKeyCompare, NULL);
+
+    double rbInsert = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        RbTreeInsert(&tree, &elems[i].Node); });
+    double mapInsert = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        map.insert({elems[i].Key, &elems[i]}); });
+
+    double rbLookup = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        sum = sum + (QWORD) RbTreeLookup(&tree, &elems[i].Key); });
+    double mapLookup = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        sum = sum + (QWORD) map.find(elems[i].Key)->second; });
+
+    // keys which are not in the tree, the nearest element is returned
+    double rbCeiling = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        QWORD key = elems[i].Key + 1;
+        sum = sum + (QWORD) RbTreeLookupCeiling(&tree, &key); });
+    double mapCeiling = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        auto it = map.lower_bound(elems[i].Key + 1);
+        sum = sum + (QWORD) (it != map.end() ? it->second : nullptr); });
+
+    PRB_NODE pNode = RbTreeFirst(&tree);
+    double rbIterate = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        UNREFERENCED_PARAMETER(i);
+        sum = sum + _RbToElem(pNode)->Key;
+        pNode = RbTreeNext(pNode); });
+    auto mapIt = map.begin();
+    double mapIterate = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        UNREFERENCED_PARAMETER(i);
+        sum = sum + mapIt->first;
+        ++mapIt; });
+
+    double rbRemove = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        RbTreeRemove(&tree, &elems[i].Node); });
+    double mapRemove = _MeasureMillionOpsPerSecond(NumberOfElements, [&](DWORD i) {
+        map.erase(map.find(elems[i].Key)); });
+
+    LOG("[%7u elements] insert: %6.2f / %6.2f, lookup: %6.2f / %6.2f, ceiling: %6.2f / %6.2f, next: %7.2f / %7.2f, remove: %6.2f / %6.2f Mops/s\n",
+        NumberOfElements,
+        rbInsert, mapInsert,
+        rbLookup, mapLookup,
+        rbCeiling, mapCeiling,
+        rbIterate, mapIterate,
+        rbRemove, mapRemove);
+
+    if (RbTreeSize(&tree) != 0 || !map.empty())
+    {
+        LOG_ERROR("The trees should be empty, sizes are %u and %zu\n", RbTreeSize(&tree), map.size());
+        return CL_STATUS_SIZE_INVALID;
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+STATUS
+UtClRbTreeBenchmark()
+{
+    STATUS status = CL_STATUS_SUCCESS;
+
+    LOG("Operations per second for RB_TREE / std::multimap\n");
+
+    for (const auto& elements : UT_RB_BENCH_ELEMENTS)
+    {
+        status = _UtClRunRbBenchmark(elements);
+        if (!SUCCEEDED(status))
+        {
+            break;
+        }
+    }
+
+    return status;
+}
@@ -1,8 +1,25 @@
 #include "ut_base.h"
 #include "ut_cl_string.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "ut_cl_rng.h"
 
 #define MAX_STRING_LENGTH           100
 
+// the word at a time scans are checked for strings starting at each offset of
+// a QWORD and ending on the last byte of their buffer
+#define UT_STRING_SCAN_MAX_LENGTH           80
+#define UT_STRING_SCAN_ITERATIONS           20'000
+
+static const DWORD UT_STRING_BENCH_SIZES[] =
+{
+    8, 32, 128, 1024, 16 * 1024
+};
+
+#define UT_STRING_BENCH_BYTES_PER_RUN       (128ULL * 1024 * 1024)
+#define UT_STRING_BENCH_LOG_LINES           1'000'000
+
 typedef enum _UT_STRING_TESTED_FUNCS
 {
     UtStringTrim = 0,
@@ -80,6 +97,12 @@ static const UT_STRING_TC_ARGS TC_ARGS =
 };
 
 
+static
+STATUS
+_UtStringTestScans(
+    void
+    );
+
 STATUS
 UtClStrings(
     void
@@ -101,7 +124,7 @@ UtClStrings(
 
     }
 
-    return CL_STATUS_SUCCESS;
+    return _UtStringTestScans();
 }
 
 static
@@ -126,3 +149,259 @@ BOOLEAN
 
     return bSuccess;
 }
+
+// The byte at a time implementations the library had before, used both as
+// reference for the results and as the baseline of the benchmarks
+static
+DWORD
+_RefStrlen(
+    _In_z_  const char*     String
+    )
+{
+    DWORD i = 0;
+
+    while ('\0' != String[i])
+    {
+        ++i;
+    }
+
+    return i;
+}
+
+static
+const char*
+_RefStrchr(
+    _In_z_  const char*     String,
+    _In_    char            Character
+    )
+{
+    for (DWORD i = 0; '\0' != String[i]; ++i)
+    {
+        if (String[i] == Character)
+        {
+            return &String[i];
+        }
+    }
+
+    return String;
+}
+
+static
+const char*
+_RefStrrchr(
+    _In_z_  const char*     String,
+    _In_    char            Character
+    )
+{
+    const char* result = String;
+
+    for (DWORD i = 0; '\0' != String[i]; ++i)
+    {
+        if (String[i] == Character)
+        {
+            result = &String[i];
+        }
+    }
+
+    return result;
+}
+
+static
+int
+_RefStrcmp(
+    _In_z_  const char*     String1,
+    _In_z_  const char*     String2
+    )
+{
+    DWORD i = 0;
+
+    while ('\0' != String1[i] && '\0' != String2[i])
+    {
+        if (String1[i] != String2[i])
+        {
+            return String1[i] > String2[i] ? 1 : -1;
+        }
+
+        ++i;
+    }
+
+    if ('\0' != String1[i])
+    {
+        return 1;
+    }
+
+    return '\0' != String2[i] ? -1 : 0;
+}
+
+static
+void
+_FillRandomString(
+    _Out_writes_(Length + 1)    char*       String,
+    _In_                        DWORD       Length
+    )
+{
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+
+    // a small alphabet makes the searched characters appear several times
+    for (DWORD i = 0; i < Length; ++i)
+    {
+        String[i] = (char) (rng.GetNextRandom() % 2 == 0 ? 'a' + rng.GetNextRandom() % 4 : 1 + rng.GetNextRandom() % MAX_BYTE);
+    }
+
+    String[Length] = '\0';
+}
+
+static
+STATUS
+_UtStringTestScans(
+    void
+    )
+{
+    UtCl::RNG& rng = UtCl::RNG::GetInstance();
+
+    for (DWORD iteration = 0; iteration < UT_STRING_SCAN_ITERATIONS; ++iteration)
+    {
+        DWORD length = rng.GetNextRandom() % UT_STRING_SCAN_MAX_LENGTH;
+        DWORD offset = rng.GetNextRandom() % (DWORD) sizeof(QWORD);
+        std::vector<char> first(offset + length + 1);
+        std::vector<char> second(first.size());
+        char* str1 = &first[offset];
+        char* str2 = &second[offset];
+
+        _FillRandomString(str1, length);
+        cl_memcpy(second.data(), first.data(), first.size());
+
+        // make the second string differ, end earlier or be equal
+        if (length != 0)
+        {
+            DWORD index = rng.GetNextRandom() % length;
+
+            switch (rng.GetNextRandom() % 3)
+            {
+            case 0:
+                str2[index] = (char) (str2[index] ^ (1 + rng.GetNextRandom() % 0x7F));
+                break;
+            case 1:
+                str2[index] = '\0';
+                break;
+            default:
+                break;
+            }
+        }
+
+        char searched = (length != 0 && rng.GetNextRandom() % 4 != 0) ? str1[rng.GetNextRandom() % length] : 'z';
+        DWORD maxLength = rng.GetNextRandom() % (UT_STRING_SCAN_MAX_LENGTH + 1);
+
+        if (cl_strlen(str1) != _RefStrlen(str1)
+            || cl_strlen_s(str1, maxLength) != (std::min)(maxLength, _RefStrlen(str1)))
+        {
+            LOG_ERROR("strlen of a string of %u characters at offset %u failed\n", length, offset);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        if (cl_strchr(str1, searched) != _RefStrchr(str1, searched)
+            || cl_strrchr(str1, searched) != _RefStrrchr(str1, searched))
+        {
+            LOG_ERROR("Searching for 0x%x in a string of %u characters at offset %u failed\n",
+                      (BYTE) searched, length, offset);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+
+        if (cl_strcmp(str1, str2) != _RefStrcmp(str1, str2)
+            || cl_strcmp(str2, str1) != _RefStrcmp(str2, str1))
+        {
+            LOG_ERROR("strcmp of strings of %u characters at offset %u failed\n", length, offset);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+template <typename Function>
+static
+double
+_MeasureMbPerSec(
+    _In_ DWORD                          Size,
+    _In_ Function                       Operation
+    )
+{
+    DWORD iterations = (DWORD) std::max<QWORD>(UT_STRING_BENCH_BYTES_PER_RUN / Size, 1);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < iterations; ++i)
+    {
+        Operation();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    return seconds != 0 ? ((double) Size * iterations / (1024 * 1024)) / seconds : 0.0;
+}
+
+static
+void
+_UtClRunStringBenchmark(
+    _In_ DWORD                          Size
+    )
+{
+    std::vector<char> first(Size + 1);
+    std::vector<char> second(Size + 1);
+    volatile QWORD result = 0;
+
+    // no 'z' in the strings => strchr has to go through the whole string
+    for (DWORD i = 0; i < Size; ++i)
+    {
+        first[i] = (char) ('a' + i % ('z' - 'a'));
+    }
+    first[Size] = '\0';
+    second = first;
+
+    LOG("[%6u B] strlen: %8.0f / %8.0f MB/s, strchr: %8.0f / %8.0f MB/s, strcmp: %8.0f / %8.0f MB/s\n",
+        Size,
+        _MeasureMbPerSec(Size, [&]() { result = result + cl_strlen(first.data()); }),
+        _MeasureMbPerSec(Size, [&]() { result = result + _RefStrlen(first.data()); }),
+        _MeasureMbPerSec(Size, [&]() { result = result + (QWORD) cl_strchr(first.data(), 'z'); }),
+        _MeasureMbPerSec(Size, [&]() { result = result + (QWORD) _RefStrchr(first.data(), 'z'); }),
+        _MeasureMbPerSec(Size, [&]() { result = result + cl_strcmp(first.data(), second.data()); }),
+        _MeasureMbPerSec(Size, [&]() { result = result + _RefStrcmp(first.data(), second.data()); }));
+}
+
+STATUS
+UtClStringsBenchmark(
+    void
+    )
+{
+    char line[MAX_PATH];
+    QWORD totalBytes = 0;
+
+    LOG("Optimized / byte at a time throughput\n");
+
+    for (const auto size : UT_STRING_BENCH_SIZES)
+    {
+        _UtClRunStringBenchmark(size);
+    }
+
+    // a line similar to the ones the kernel logs: literal runs, strings and
+    // decimal and hexadecimal numbers of both sizes
+    auto start = std::chrono::high_resolution_clock::now();
+    for (DWORD i = 0; i < UT_STRING_BENCH_LOG_LINES; ++i)
+    {
+        STATUS status = cl_snprintf(line, MAX_PATH,
+                                    "[%s][CPU:%02x] Thread 0x%X allocated %u bytes at 0x%X, %d frames left\n",
+                                    "HAL9000", i % 8, (QWORD) i, i * 16, (QWORD) i << 12, (DWORD) (1000 - i));
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("cl_snprintf failed with status 0x%x\n", status);
+            return status;
+        }
+
+        totalBytes = totalBytes + cl_strlen(line);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    LOG("Formatted log lines: %.0f lines/s, %.1f MB/s\n",
+        seconds != 0 ? UT_STRING_BENCH_LOG_LINES / seconds : 0.0,
+        seconds != 0 ? ((double) totalBytes / (1024 * 1024)) / seconds : 0.0);
+
+    return CL_STATUS_SUCCESS;
+}
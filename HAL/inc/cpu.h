@@ -25,6 +25,7 @@
 
 // CR4 related definitions
 #define CR4_PAE                                     ((QWORD)1<<5)
+#define CR4_PGE                                     ((QWORD)1<<7)
 #define CR4_VMXE                                    ((QWORD)1<<13)
 #define CR4_SMXE                                    ((QWORD)1<<14)
 #define CR4_PCIDE                                   ((QWORD)1<<17)
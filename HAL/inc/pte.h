@@ -170,13 +170,37 @@ typedef struct _PT_ENTRY
     QWORD           Dirty               :   1;
     QWORD           PAT                 :   1;
     QWORD           Global              :   1;
-    QWORD           Ignored0            :   3;
+
+    // Software bits, ignored by the CPU
+    // The frame is owned by the page cache and must not be released on unmap
+    QWORD           SharedFrame         :   1;
+    // The page is writable, on the first write the frame will be copied
+    QWORD           CopyOnWrite         :   1;
+    // The frame is private to the address space and may be written to the
+    // swap file when memory runs low
+    QWORD           Pageable            :   1;
+
     QWORD           PhysicalAddress     :   MAXPHYADDR-12;          
     QWORD           Ignored1            :   11;
     QWORD           XD                  :   1;
 } PT_ENTRY, *PPT_ENTRY;
 STATIC_ASSERT( sizeof( PT_ENTRY ) == sizeof( QWORD ) );
 
+// A PT_ENTRY whose page was evicted to the swap file, because the entry is not
+// present the CPU ignores all the other bits
+typedef struct _PT_ENTRY_SWAPPED
+{
+    QWORD           Present             :   1;  // Must be 0
+    QWORD           SwappedOut          :   1;  // Must be 1
+    // The page contents are still being stored, SwapSlot holds a tag instead
+    // of the swap handle
+    QWORD           WriteInProgress     :   1;
+    QWORD           Ignored0            :   9;
+    QWORD           SwapSlot            :   MAXPHYADDR-12;
+    QWORD           Ignored1            :   12;
+} PT_ENTRY_SWAPPED, *PPT_ENTRY_SWAPPED;
+STATIC_ASSERT( sizeof( PT_ENTRY_SWAPPED ) == sizeof( QWORD ) );
+
 // the next structures are only valid for PAE paging
 #define MASK_PAE_PDPTE_OFFSET(va)        (((QWORD)(va)>>30)&0x3)
 
@@ -331,9 +355,30 @@ typedef struct _PTE_MAP_FLAGS
     WORD            PagingStructure      :    1;
     WORD            UserAccess           :    1;
     WORD            GlobalPage           :    1;
-    WORD            __Reserved0          :    7;
+    WORD            SharedFrame          :    1;
+    WORD            CopyOnWrite          :    1;
+    WORD            Pageable             :    1;
+    WORD            __Reserved0          :    4;
 } PTE_MAP_FLAGS, *PPTE_MAP_FLAGS;
 STATIC_ASSERT(sizeof(PTE_MAP_FLAGS) == sizeof(WORD));
+
+// Intel System Programming Manual Vol 2A
+// INVPCID - Invalidate Process-Context Identifier
+typedef enum _INVPCID_TYPE
+{
+    InvpcidIndividualAddress            = 0,
+    InvpcidSingleContext,
+    InvpcidAllContextsIncludingGlobal,
+    InvpcidAllContextsExceptGlobal,
+} INVPCID_TYPE;
+
+typedef struct _INVPCID_DESCRIPTOR
+{
+    QWORD           Pcid                 :   12;
+    QWORD           Reserved             :   52;
+    QWORD           LinearAddress;
+} INVPCID_DESCRIPTOR, *PINVPCID_DESCRIPTOR;
+STATIC_ASSERT(sizeof(INVPCID_DESCRIPTOR) == 2 * sizeof(QWORD));
 #pragma warning(default:4214)
 #pragma warning(default:4201)
 #pragma pack(pop)
@@ -360,7 +405,51 @@ PteLargePageGetPhysicalAddress(
     IN          PVOID           PageTable
     );
 
+void
+PteMapLargePage(
+    IN          PVOID               PageDirectoryEntry,
+    IN_OPT      PHYSICAL_ADDRESS    PhysicalAddress,
+    IN          PTE_MAP_FLAGS       Flags
+    );
+
+BOOLEAN
+PteIsLargePage(
+    IN          PVOID           PageDirectoryEntry
+    );
+
 BOOLEAN
 PteIsPresent(
+    IN          PVOID           PageTable
+    );
+
+BOOLEAN
+PteIsSharedFrame(
+    IN          PVOID           PageTable
+    );
+
+BOOLEAN
+PteIsCopyOnWrite(
+    IN          PVOID           PageTable
+    );
+
+BOOLEAN
+PteIsPageable(
+    IN          PVOID           PageTable
+    );
+
+void
+PteMapSwapped(
+    IN          PVOID           PageTable,
+    IN          QWORD           SwapSlot,
+    IN          BOOLEAN         WriteInProgress
+    );
+
+BOOLEAN
+PteIsSwappedOut(
+    IN          PVOID           PageTable
+    );
+
+QWORD
+PteGetSwapSlot(
     IN          PVOID           PageTable
     );
\ No newline at end of file
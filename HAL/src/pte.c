@@ -32,6 +32,10 @@ PteMap(
         pTablePointer->PWT = (Flags.PatIndex >> 0) & 1;
 
         pTablePointer->Global = Flags.GlobalPage;
+
+        pTablePointer->SharedFrame = Flags.SharedFrame;
+        pTablePointer->CopyOnWrite = Flags.CopyOnWrite;
+        pTablePointer->Pageable = Flags.Pageable;
     }
 }
 
@@ -74,6 +78,54 @@ PteLargePageGetPhysicalAddress(
 
 }
 
+void
+PteMapLargePage(
+    IN          PVOID               PageDirectoryEntry,
+    IN_OPT      PHYSICAL_ADDRESS    PhysicalAddress,
+    IN          PTE_MAP_FLAGS       Flags
+    )
+{
+    PD_ENTRY_2MB* pEntry;
+
+    ASSERT(NULL != PageDirectoryEntry);
+    ASSERT(IsAddressAligned(PhysicalAddress, PAGE_2MB_OFFSET + 1));
+    ASSERT(!Flags.PagingStructure);
+
+    pEntry = PageDirectoryEntry;
+    memzero(pEntry, sizeof(PD_ENTRY_2MB));
+
+    pEntry->PhysicalAddress = (QWORD) PhysicalAddress >> SHIFT_FOR_LARGE_PAGE;
+    pEntry->PageSize = 1;
+    pEntry->Present = 1;
+
+    pEntry->ReadWrite = Flags.Writable;
+    pEntry->XD = !Flags.Executable;
+
+    // 0 means user-mode accesses are forbidden
+    pEntry->UserSupervisor = Flags.UserAccess;
+
+    // for large pages the PAT bit is bit 12, not bit 7 as for PTEs
+    pEntry->PAT = (Flags.PatIndex >> 2) & 1;
+    pEntry->PCD = (Flags.PatIndex >> 1) & 1;
+    pEntry->PWT = (Flags.PatIndex >> 0) & 1;
+
+    pEntry->Global = Flags.GlobalPage;
+}
+
+BOOLEAN
+PteIsLargePage(
+    IN          PVOID           PageDirectoryEntry
+    )
+{
+    PD_ENTRY_2MB* pEntry;
+
+    ASSERT(NULL != PageDirectoryEntry);
+
+    pEntry = PageDirectoryEntry;
+
+    return (1 == pEntry->Present) && (1 == pEntry->PageSize);
+}
+
 BOOLEAN
 PteIsPresent(
     IN          PVOID           PageTable
@@ -86,4 +138,97 @@ PteIsPresent(
     pTablePointer = PageTable;
 
     return ( 1== pTablePointer->Present );
+}
+
+BOOLEAN
+PteIsSharedFrame(
+    IN          PVOID           PageTable
+    )
+{
+    PT_ENTRY* pTablePointer;
+
+    ASSERT(NULL != PageTable);
+
+    pTablePointer = PageTable;
+
+    return (1 == pTablePointer->Present) && (1 == pTablePointer->SharedFrame);
+}
+
+BOOLEAN
+PteIsCopyOnWrite(
+    IN          PVOID           PageTable
+    )
+{
+    PT_ENTRY* pTablePointer;
+
+    ASSERT(NULL != PageTable);
+
+    pTablePointer = PageTable;
+
+    return (1 == pTablePointer->Present) && (1 == pTablePointer->CopyOnWrite);
+}
+
+BOOLEAN
+PteIsPageable(
+    IN          PVOID           PageTable
+    )
+{
+    PT_ENTRY* pTablePointer;
+
+    ASSERT(NULL != PageTable);
+
+    pTablePointer = PageTable;
+
+    return (1 == pTablePointer->Present) && (1 == pTablePointer->Pageable);
+}
+
+void
+PteMapSwapped(
+    IN          PVOID           PageTable,
+    IN          QWORD           SwapSlot,
+    IN          BOOLEAN         WriteInProgress
+    )
+{
+    PT_ENTRY_SWAPPED* pEntry;
+
+    ASSERT(NULL != PageTable);
+
+    pEntry = PageTable;
+    memzero(pEntry, sizeof(PT_ENTRY_SWAPPED));
+
+    pEntry->SwappedOut = 1;
+    pEntry->WriteInProgress = WriteInProgress;
+    pEntry->SwapSlot = SwapSlot;
+
+    ASSERT(pEntry->SwapSlot == SwapSlot);
+}
+
+BOOLEAN
+PteIsSwappedOut(
+    IN          PVOID           PageTable
+    )
+{
+    PT_ENTRY_SWAPPED* pEntry;
+
+    ASSERT(NULL != PageTable);
+
+    pEntry = PageTable;
+
+    return (0 == pEntry->Present) && (1 == pEntry->SwappedOut);
+}
+
+QWORD
+PteGetSwapSlot(
+    IN          PVOID           PageTable
+    )
+{
+    PT_ENTRY_SWAPPED* pEntry;
+
+    ASSERT(NULL != PageTable);
+
+    pEntry = PageTable;
+
+    ASSERT(PteIsSwappedOut(pEntry));
+
+    return pEntry->SwapSlot;
 }
\ No newline at end of file
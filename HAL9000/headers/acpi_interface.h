@@ -54,6 +54,39 @@ AcpiRetrieveNextMcfgEntry(
     OUT_PTR ACPI_MCFG_ALLOCATION**      AcpiEntry
     );
 
+//******************************************************************************
+// Function:     AcpiRetrieveNextSratEntry
+// Description:  Iterates over the CPU and memory affinity structures found in
+//               the SRAT, the caller distinguishes them by their type.
+// Returns:      STATUS - STATUS_NO_MORE_OBJECTS after the last entry, there
+//               are no entries at all if the system has no SRAT.
+// Parameter:    IN BOOLEAN RestartSearch
+// Parameter:    OUT_PTR ACPI_SUBTABLE_HEADER** AcpiEntry
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+AcpiRetrieveNextSratEntry(
+    IN      BOOLEAN                     RestartSearch,
+    OUT_PTR ACPI_SUBTABLE_HEADER**      AcpiEntry
+    );
+
+//******************************************************************************
+// Function:     AcpiRetrieveLocalityDistance
+// Description:  Retrieves the relative distance between two proximity domains
+//               from the SLIT, 10 is the distance of a domain to itself.
+// Returns:      STATUS - STATUS_DEVICE_DOES_NOT_EXIST if there is no SLIT
+// Parameter:    IN DWORD FromProximityDomain
+// Parameter:    IN DWORD ToProximityDomain
+// Parameter:    OUT BYTE* Distance
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+AcpiRetrieveLocalityDistance(
+    IN      DWORD                       FromProximityDomain,
+    IN      DWORD                       ToProximityDomain,
+    OUT     BYTE*                       Distance
+    );
+
 SAL_SUCCESS
 STATUS
 AcpiRetrieveNextPrtEntry(
@@ -3,7 +3,14 @@
 #include "cmd_common.h"
 
 FUNC_GenericCommand CmdDisplaySysInfo;
+FUNC_GenericCommand CmdDisplayMemoryInfo;
+FUNC_GenericCommand CmdSetZeroBudget;
+FUNC_GenericCommand CmdSetFaultAround;
+FUNC_GenericCommand CmdMeasureSwitchCost;
 FUNC_GenericCommand CmdSetIdle;
 FUNC_GenericCommand CmdGetIdle;
 FUNC_GenericCommand CmdResetSystem;
 FUNC_GenericCommand CmdShutdownSystem;
+FUNC_GenericCommand CmdProfilerStart;
+FUNC_GenericCommand CmdProfilerStop;
+FUNC_GenericCommand CmdProfilerDump;
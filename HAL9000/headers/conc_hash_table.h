@@ -0,0 +1,180 @@
+#pragma once
+
+//******************************************************************************
+// Concurrent hash table
+//
+//
+// A chained hash table keyed by a QWORD ID (TID, PID) which may be searched
+// without taking any lock while elements are inserted and removed on other
+// CPUs. The writers serialize on a lock stripe: each lock protects the buckets
+// whose index is equal to the lock index modulo the number of locks => writers
+// working on different buckets rarely contend.
+//
+// Readers only disable interrupts and announce themselves in one of two
+// counters. A removal unlinks the element and then waits until all the readers
+// which may still be looking at it are done, after which the element memory
+// may be freed. Because the lookup runs concurrently with the removal of the
+// element it finds, the element must be referenced before the lookup returns:
+// this is what the reference function given to ConcHashTableLookup is for.
+//
+// typedef struct _FOO
+// {
+//      REF_COUNT           RefCnt;
+//      QWORD               Id;
+//      CONC_HASH_ENTRY     HashEntry;
+// } FOO, *PFOO;
+//
+// static PCONC_HASH_ENTRY m_buckets[64];
+// static LOCK m_locks[8];
+//
+// status = ConcHashTableInit(&hashTable,
+//                            m_buckets,
+//                            ARRAYSIZE(m_buckets),
+//                            m_locks,
+//                            ARRAYSIZE(m_locks),
+//                            FIELD_OFFSET(FOO, Id) - FIELD_OFFSET(FOO, HashEntry));
+//
+// status = ConcHashTableInsert(&hashTable, &pFoo->HashEntry);
+//
+// pEntry = ConcHashTableLookup(&hashTable, idToSearchFor, _FooTryReference);
+//
+// // when the reference count of the object reaches 0
+// ConcHashTableRemoveEntry(&hashTable, &pFoo->HashEntry);
+// ExFreePoolWithTag(pFoo, ...);
+//******************************************************************************
+
+typedef struct _CONC_HASH_ENTRY
+{
+    // Readers may walk through an element while it is being removed => the
+    // link is left untouched when the element is unlinked
+    struct _CONC_HASH_ENTRY* volatile   Next;
+} CONC_HASH_ENTRY, *PCONC_HASH_ENTRY;
+
+//******************************************************************************
+// Function:     FUNC_ConcHashReferenceFunction
+// Description:  Called by ConcHashTableLookup for the element found, while the
+//               element is guaranteed not to be freed. Must take a reference
+//               on the element unless its removal is already under way.
+// Returns:      BOOLEAN - FALSE if the element is being destroyed, in this case
+//               the lookup returns NULL
+// Parameter:    IN PCONC_HASH_ENTRY Entry
+// NOTE:         Must not remove elements from the table.
+//******************************************************************************
+typedef
+BOOLEAN
+(__cdecl FUNC_ConcHashReferenceFunction)(
+    IN      PCONC_HASH_ENTRY        Entry
+    );
+
+typedef FUNC_ConcHashReferenceFunction*     PFUNC_ConcHashReferenceFunction;
+
+typedef struct _CONC_HASH_TABLE
+{
+    // The offset difference in bytes between the CONC_HASH_ENTRY and the
+    // QWORD key
+    INT32                                   OffsetToKey;
+
+    // Both are powers of 2, the lock of a bucket is at index
+    // BucketIndex & (NumberOfLocks - 1)
+    DWORD                                   NumberOfBuckets;
+    DWORD                                   NumberOfLocks;
+
+    PCONC_HASH_ENTRY volatile*              Buckets;
+    PLOCK                                   Locks;
+
+    _Interlocked_
+    volatile DWORD                          NumberOfElements;
+
+    // Readers increment the counter selected by ReaderPhase, a removal flips
+    // the phase and waits for the counter of the previous phase to drain =>
+    // readers which start later cannot delay it
+    volatile DWORD                          ReaderPhase;
+
+    _Interlocked_
+    volatile DWORD                          ActiveReaders[2];
+
+    // Serializes the removals waiting for the readers
+    LOCK                                    PhaseLock;
+} CONC_HASH_TABLE, *PCONC_HASH_TABLE;
+
+//******************************************************************************
+// Function:     ConcHashTableInit
+// Description:  Initializes a concurrent hash table using the bucket and lock
+//               arrays supplied by the caller.
+// Returns:      STATUS
+// Parameter:    OUT PCONC_HASH_TABLE HashTable
+// Parameter:    OUT_WRITES(NumberOfBuckets) PCONC_HASH_ENTRY* Buckets
+// Parameter:    IN DWORD NumberOfBuckets - Must be a power of 2
+// Parameter:    OUT_WRITES(NumberOfLocks) PLOCK Locks
+// Parameter:    IN DWORD NumberOfLocks - Must be a power of 2, at most
+//               NumberOfBuckets
+// Parameter:    IN INT32 OffsetToKey - FIELD_OFFSET(MY_STRUCT,Key) -
+//               FIELD_OFFSET(MY_STRUCT,HashEntry)
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+ConcHashTableInit(
+    OUT                         PCONC_HASH_TABLE        HashTable,
+    OUT_WRITES(NumberOfBuckets) PCONC_HASH_ENTRY*       Buckets,
+    IN                          DWORD                   NumberOfBuckets,
+    OUT_WRITES(NumberOfLocks)   PLOCK                   Locks,
+    IN                          DWORD                   NumberOfLocks,
+    IN                          INT32                   OffsetToKey
+    );
+
+DWORD
+ConcHashTableSize(
+    IN      PCONC_HASH_TABLE        HashTable
+    );
+
+//******************************************************************************
+// Function:     ConcHashTableInsert
+// Description:  Inserts an element in the hash table, the element becomes
+//               visible to the lookups as soon as it is linked.
+// Returns:      STATUS - STATUS_ELEMENT_FOUND if an element with the same key
+//               is already in the table
+// Parameter:    INOUT PCONC_HASH_TABLE HashTable
+// Parameter:    INOUT PCONC_HASH_ENTRY Element
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+ConcHashTableInsert(
+    INOUT   PCONC_HASH_TABLE        HashTable,
+    INOUT   PCONC_HASH_ENTRY        Element
+    );
+
+//******************************************************************************
+// Function:     ConcHashTableRemoveEntry
+// Description:  Removes an element from the hash table. When the function
+//               returns no lookup references the element anymore => its
+//               memory may be freed.
+// Returns:      BOOLEAN - FALSE if the element was not in the table
+// Parameter:    INOUT PCONC_HASH_TABLE HashTable
+// Parameter:    IN PCONC_HASH_ENTRY Element
+// NOTE:         Waits for the lookups in progress on the other CPUs to finish
+//               => must not be called from a FUNC_ConcHashReferenceFunction.
+//******************************************************************************
+BOOLEAN
+ConcHashTableRemoveEntry(
+    INOUT   PCONC_HASH_TABLE        HashTable,
+    IN      PCONC_HASH_ENTRY        Element
+    );
+
+//******************************************************************************
+// Function:     ConcHashTableLookup
+// Description:  Searches for the element with key Key without taking any lock.
+// Returns:      PCONC_HASH_ENTRY - NULL if no element with Key is present or
+//               if ReferenceFunction failed for the element found
+// Parameter:    IN PCONC_HASH_TABLE HashTable
+// Parameter:    IN QWORD Key
+// Parameter:    IN_OPT PFUNC_ConcHashReferenceFunction ReferenceFunction - May
+//               be NULL only if the caller otherwise guarantees the element is
+//               not removed and freed while it uses it
+//******************************************************************************
+PTR_SUCCESS
+PCONC_HASH_ENTRY
+ConcHashTableLookup(
+    IN      PCONC_HASH_TABLE                    HashTable,
+    IN      QWORD                               Key,
+    IN_OPT  PFUNC_ConcHashReferenceFunction     ReferenceFunction
+    );
@@ -6,6 +6,8 @@
 #include "list.h"
 #include "synch.h"
 #include "cpu_structures.h"
+#include "pmm.h"
+#include "vmm.h"
 
 #define STACK_DEFAULT_SIZE          (4*PAGE_SIZE)
 #define STACK_GUARD_SIZE            (2*PAGE_SIZE)
@@ -32,6 +34,9 @@ typedef struct _PCPU
     APIC_ID                     LogicalApicId;
     BOOLEAN                     BspProcessor;
 
+    // Node whose memory is preferred for the frames allocated on this CPU
+    NUMA_NODE                   NumaNode;
+
     // TSS base address
     TSS                         Tss;
     PVOID                       TssStacks[NO_OF_IST];
@@ -56,6 +61,16 @@ typedef struct _PCPU
     BOOLEAN                     VmmMemoryAccess;
     QWORD                       PageFaults;
 
+    // Free frames used for single frame allocations, see PmmReserveMemoryEx
+    PMM_CPU_CACHE               FrameCache;
+
+    // TLB invalidations requested by other CPUs, see VmmFlushUnmapBatch
+    VMM_TLB_CPU_DATA            TlbData;
+
+    // Virtual range of MMU_CPU_WINDOW_FRAMES pages in which only this CPU maps
+    // frames temporarily, see MmuMapFramesOnCurrentCpu
+    PVOID                       MappingWindow;
+
     QWORD                       InterruptsTriggered[NO_OF_TOTAL_INTERRUPTS];
 } PCPU, *PPCPU;
 STATIC_ASSERT_INFO(FIELD_OFFSET(PCPU,StackTop) == 0x0, "Used by _syscall.yasm:20 on syscalls to determine the user thread's kernel stack!");
@@ -82,6 +97,20 @@ CpuMuSetMonitorFilterSize(
     IN          WORD        FilterSize
     );
 
+// Returns TRUE if REP MOVSB/STOSB are the preferred way of copying and
+// initializing memory (CPUID.(EAX=07H, ECX=0H):EBX.ERMSB[bit 9])
+BOOLEAN
+CpuMuIsEnhancedFastStringSupported(
+    void
+    );
+
+// Returns TRUE if the INVPCID instruction is available
+// (CPUID.(EAX=07H, ECX=0H):EBX.INVPCID[bit 10])
+BOOLEAN
+CpuMuIsInvpcidSupported(
+    void
+    );
+
 STATUS
 CpuMuAllocAndInitCpu(
     OUT_PTR     PPCPU*      PhysicalCpu,
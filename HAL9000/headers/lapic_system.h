@@ -35,6 +35,11 @@ LapicSystemEnableTimer(
     IN      DWORD                           Microseconds
     );
 
+void
+LapicSystemDisableTimer(
+    void
+    );
+
 void
 LapicSystemSendIpi(
     _When_(ApicDestinationShorthandNone == DeliveryMode, IN)
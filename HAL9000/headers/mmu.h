@@ -5,19 +5,42 @@
 
 typedef struct _PROCESS* PPROCESS;
 typedef struct _PE_NT_HEADER_INFO *PPE_NT_HEADER_INFO;
+typedef struct _FILE_OBJECT* PFILE_OBJECT;
+typedef struct _VMM_RESERVATION_SPACE* PVMM_RESERVATION_SPACE;
 
 /// TODO: Move BasePhysicalAddress and KernelSpace outside protected region
 typedef struct _PAGING_DATA
 {
     PHYSICAL_ADDRESS        BasePhysicalAddress;
 
-    // because we don't have any functions to unmap
-    // paging structures (and we probably won't need to)
-    // there is no use in using a bitmap
+    // The frames in [0, CurrentIndex) were handed out at least once, the
+    // ones after it were never used
     DWORD                   NumberOfFrames;
     DWORD                   CurrentIndex;
 
+    // Pool of the paging structures freed once they became empty, the frames
+    // are zeroed except for the first entry which links them together. The
+    // unmap batches return frames here without holding the paging lock
+    LOCK                    StructuresLock;
+
+    _Guarded_by_(StructuresLock)
+    PHYSICAL_ADDRESS        FreeStructuresHead;
+
+    _Guarded_by_(StructuresLock)
+    DWORD                   NumberOfFreeStructures;
+
     BOOLEAN                 KernelSpace;
+
+    // PCID used when these tables are loaded in CR3
+    WORD                    Pcid;
+
+    // CPU_AFFINITY mask of the CPUs which have used these tables since they
+    // last invalidated their translations, only these CPUs need to be notified
+    // when a mapping is removed
+    volatile BYTE           ActiveCpus;
+
+    // Address from which the next search for pages to evict continues
+    PVOID                   ReclaimClockHand;
 } PAGING_DATA, *PPAGING_DATA;
 
 typedef struct _PAGING_LOCK_DATA
@@ -33,6 +56,10 @@ typedef struct _PAGING_LOCK_DATA
 #define MmuMapSystemMemory(Pa,Sz)   MmuMapMemoryEx((Pa),(Sz),PAGE_RIGHTS_READWRITE, FALSE, FALSE, NULL)
 #define MmuUnmapSystemMemory(Va,Sz) MmuUnmapMemoryEx((Va),(Sz),FALSE, NULL)
 
+// Number of frames which can be mapped at once in the window of each CPU, see
+// MmuMapFramesOnCurrentCpu
+#define MMU_CPU_WINDOW_FRAMES       2
+
 _No_competing_thread_
 void
 MmuPreinitSystem(
@@ -128,6 +155,24 @@ MmuMapMemoryEx(
     IN_OPT  PPAGING_LOCK_DATA       PagingDatas
     );
 
+//******************************************************************************
+// Function:     MmuMapSystemFrames
+// Description:  Maps frames which need not be contiguous one after another in
+//               the system address space. The whole range is unmapped with a
+//               single MmuUnmapSystemMemory call => the other CPUs are
+//               interrupted only once for all the frames.
+// Returns:      PVOID - Resulting mapping for the first frame
+// Parameter:    IN_READS(NoOfFrames) PHYSICAL_ADDRESS* Frames
+// Parameter:    IN DWORD NoOfFrames
+//******************************************************************************
+PTR_SUCCESS
+PVOID
+MmuMapSystemFrames(
+    IN_READS(NoOfFrames)
+            PHYSICAL_ADDRESS*       Frames,
+    IN      DWORD                   NoOfFrames
+    );
+
 //******************************************************************************
 // Function:     MmuMapMemoryInternal
 // Description:  Maps a physical address range into the specified virtual
@@ -152,6 +197,29 @@ MmuMapMemoryInternal(
     IN_OPT  PPAGING_LOCK_DATA       PagingData
     );
 
+//******************************************************************************
+// Function:     MmuMapAnonymousMemory
+// Description:  Same as MmuMapMemoryInternal except the frames were reserved
+//               from the PMM for an anonymous region, 2MB aligned chunks are
+//               mapped using large pages.
+// Returns:      void
+// Parameter:    IN PHYSICAL_ADDRESS PhysicalAddress
+// Parameter:    IN DWORD Size
+// Parameter:    IN PAGE_RIGHTS PageRights
+// Parameter:    IN PVOID VirtualAddress
+// Parameter:    IN BOOLEAN Uncacheable
+/// NOTE:        This should only be used by the vmm.
+//******************************************************************************
+void
+MmuMapAnonymousMemory(
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      QWORD                   Size,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      PVOID                   VirtualAddress,
+    IN      BOOLEAN                 Uncacheable,
+    IN_OPT  PPAGING_LOCK_DATA       PagingData
+    );
+
 //******************************************************************************
 // Function:     MmuUnmapMemory
 // Description:  Unmaps a previously mapped memory region.
@@ -167,6 +235,41 @@ MmuUnmapMemoryEx(
     IN_OPT  PPAGING_LOCK_DATA       PagingData
     );
 
+//******************************************************************************
+// Function:     MmuMapFramesOnCurrentCpu
+// Description:  Maps the frames one after another in the mapping window
+//               reserved for the current CPU. No other CPU can cache these
+//               translations => unmapping them sends no IPIs, unlike
+//               MmuUnmapSystemMemory.
+// Returns:      PVOID - Address of the first frame in the window
+// Parameter:    IN_READS(NoOfFrames) PHYSICAL_ADDRESS* Frames
+// Parameter:    IN DWORD NoOfFrames - at most MMU_CPU_WINDOW_FRAMES
+/// NOTE:        The interrupts must be disabled until the frames are unmapped
+///              with MmuUnmapFramesOnCurrentCpu, else the thread could continue
+///              on another CPU => the window can't be used across operations
+///              which may block, such as disk I/O.
+//******************************************************************************
+PVOID
+MmuMapFramesOnCurrentCpu(
+    IN_READS(NoOfFrames)
+            PHYSICAL_ADDRESS*       Frames,
+    IN      DWORD                   NoOfFrames
+    );
+
+//******************************************************************************
+// Function:     MmuUnmapFramesOnCurrentCpu
+// Description:  Unmaps the frames mapped by MmuMapFramesOnCurrentCpu and
+//               invalidates their translations on the current CPU.
+// Returns:      void
+// Parameter:    IN PVOID Window
+// Parameter:    IN DWORD NoOfFrames
+//******************************************************************************
+void
+MmuUnmapFramesOnCurrentCpu(
+    IN      PVOID                   Window,
+    IN      DWORD                   NoOfFrames
+    );
+
 //******************************************************************************
 // Function:     MmuReleaseMemory
 // Description:  Schedules NoOfFrames frames of physical memory to be released
@@ -181,6 +284,56 @@ MmuReleaseMemory(
     IN          DWORD                   NoOfFrames
     );
 
+//******************************************************************************
+// Function:     MmuReserveZeroedFrame
+// Description:  Retrieves a physical frame already zeroed by the zero worker
+//               thread. The frame is released like any other frame.
+// Returns:      PHYSICAL_ADDRESS - NULL if there are no zeroed frames available
+// Parameter:    void
+//******************************************************************************
+PTR_SUCCESS
+PHYSICAL_ADDRESS
+MmuReserveZeroedFrame(
+    void
+    );
+
+//******************************************************************************
+// Function:     MmuGetNumberOfZeroedFrames
+// Description:  Returns the number of frames currently held zeroed by the zero
+//               worker thread.
+// Returns:      DWORD
+// Parameter:    void
+//******************************************************************************
+DWORD
+MmuGetNumberOfZeroedFrames(
+    void
+    );
+
+//******************************************************************************
+// Function:     MmuDrainZeroedFrames
+// Description:  Returns the frames held zeroed by the zero worker thread to
+//               the PMM, called before a reservation reports there is no more
+//               physical memory. Does nothing for the zero worker thread.
+// Returns:      DWORD - number of frames released
+// Parameter:    void
+//******************************************************************************
+DWORD
+MmuDrainZeroedFrames(
+    void
+    );
+
+//******************************************************************************
+// Function:     MmuSetZeroWorkerBudget
+// Description:  Limits the number of bytes the zero worker thread may clear
+//               during a scheduler tick.
+// Returns:      DWORD - The previous budget
+// Parameter:    IN DWORD BytesPerTick - 0 means the worker is not limited
+//******************************************************************************
+DWORD
+MmuSetZeroWorkerBudget(
+    IN          DWORD                   BytesPerTick
+    );
+
 //******************************************************************************
 // Function:     MmuGetPhysicalAddress
 // Description:  Returns the physical address mapping for VirtualAddress using
@@ -283,17 +436,25 @@ MmuSolvePageFault(
 
 //******************************************************************************
 // Function:     MmuLoadPe
-// Description:  Maps a PE eagerly to a VA using the paging structures specified
-//               as a parameter. Currently the file alignment and the section
-//               alignment need to be equal for this to be possible.
+// Description:  Maps a PE at its preferred address in a process. If the file
+//               and section alignments are multiples of PAGE_SIZE each section
+//               is mapped lazily from the file, else the whole image is read
+//               and mapped eagerly (in which case the two alignments need to
+//               be equal).
 // Returns:      STATUS
 // Parameter:    IN PPE_NT_HEADER_INFO NtHeader - The parsed PE header
+// Parameter:    IN PFILE_OBJECT ImageFile - The file from which NtHeader was
+//               parsed, must be kept open while the image is mapped.
+// Parameter:    IN PVMM_RESERVATION_SPACE VaSpace - The VA space of the
+//               process, must start at the preferred image base.
 // Parameter:    IN PPAGING_LOCK_DATA PagingData - The paging data of the process
 //               in which to map.
 //******************************************************************************
 STATUS
 MmuLoadPe(
     IN      PPE_NT_HEADER_INFO      NtHeader,
+    IN      PFILE_OBJECT            ImageFile,
+    IN      PVMM_RESERVATION_SPACE  VaSpace,
     IN      PPAGING_LOCK_DATA       PagingData
     );
 
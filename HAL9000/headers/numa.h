@@ -0,0 +1,102 @@
+#pragma once
+
+// Index of a NUMA node, nodes are numbered from 0 in the order in which their
+// proximity domains appear in the SRAT
+typedef BYTE NUMA_NODE, *PNUMA_NODE;
+
+#define NUMA_MAX_NODES                  8
+#define NUMA_MAX_MEMORY_RANGES          32
+
+#define NUMA_INVALID_NODE               MAX_BYTE
+
+// Distances used when the firmware does not provide a SLIT, these are the
+// values the ACPI specification defines for local and remote accesses
+#define NUMA_LOCAL_DISTANCE             10
+#define NUMA_REMOTE_DISTANCE            20
+
+typedef struct _NUMA_MEMORY_RANGE
+{
+    PHYSICAL_ADDRESS        BaseAddress;
+    QWORD                   Length;
+    NUMA_NODE               Node;
+} NUMA_MEMORY_RANGE, *PNUMA_MEMORY_RANGE;
+
+_No_competing_thread_
+void
+NumaPreinit(
+    void
+    );
+
+//******************************************************************************
+// Function:     NumaInit
+// Description:  Builds the node topology from the SRAT and SLIT. If the
+//               firmware provides no SRAT the system is described as a single
+//               node containing all the CPUs and all the memory.
+// Returns:      STATUS
+// Parameter:    void
+// NOTE:         Must be called after AcpiInterfaceInit.
+//******************************************************************************
+_No_competing_thread_
+STATUS
+NumaInit(
+    void
+    );
+
+DWORD
+NumaGetNumberOfNodes(
+    void
+    );
+
+//******************************************************************************
+// Function:     NumaGetNodeOfCpu
+// Description:  Returns the node to which the CPU belongs, CPUs missing from
+//               the SRAT are placed on node 0.
+// Returns:      NUMA_NODE
+// Parameter:    IN APIC_ID ApicId
+//******************************************************************************
+NUMA_NODE
+NumaGetNodeOfCpu(
+    IN          APIC_ID                 ApicId
+    );
+
+//******************************************************************************
+// Function:     NumaGetNodeOfAddress
+// Description:  Returns the node whose memory contains PhysicalAddress.
+// Returns:      NUMA_NODE - NUMA_INVALID_NODE if the address is not described
+//               by any memory affinity structure
+// Parameter:    IN PHYSICAL_ADDRESS PhysicalAddress
+//******************************************************************************
+NUMA_NODE
+NumaGetNodeOfAddress(
+    IN          PHYSICAL_ADDRESS        PhysicalAddress
+    );
+
+BYTE
+NumaGetDistance(
+    IN          NUMA_NODE               FromNode,
+    IN          NUMA_NODE               ToNode
+    );
+
+//******************************************************************************
+// Function:     NumaGetFallbackOrder
+// Description:  Returns the nodes sorted by their distance from Node, the
+//               first one is always Node itself.
+// Returns:      const NUMA_NODE* - NumaGetNumberOfNodes() entries
+// Parameter:    IN NUMA_NODE Node
+//******************************************************************************
+const NUMA_NODE*
+NumaGetFallbackOrder(
+    IN          NUMA_NODE               Node
+    );
+
+//******************************************************************************
+// Function:     NumaGetMemoryRanges
+// Description:  Returns the physical memory ranges of all the nodes, sorted
+//               by their base address.
+// Returns:      const NUMA_MEMORY_RANGE*
+// Parameter:    OUT DWORD* NumberOfRanges
+//******************************************************************************
+const NUMA_MEMORY_RANGE*
+NumaGetMemoryRanges(
+    OUT         DWORD*                  NumberOfRanges
+    );
@@ -0,0 +1,93 @@
+#pragma once
+
+typedef struct _FILE_OBJECT *PFILE_OBJECT;
+typedef struct _PAGE_CACHE_FILE *PPAGE_CACHE_FILE;
+
+// Maximum number of pages read from the disk with a single IoReadFile call
+// when filling the page cache
+#define PAGE_CACHE_MAX_READ_PAGES           16
+
+// Once the page cache holds more than this many pages the files which are no
+// longer referenced are evicted when a new file is opened
+#define PAGE_CACHE_TRIM_THRESHOLD_PAGES     8192
+
+typedef struct _PAGE_CACHE_STATISTICS
+{
+    DWORD               NumberOfFiles;
+    DWORD               NumberOfReferencedFiles;
+    QWORD               NumberOfPages;
+
+    // Pages found in the cache vs pages which had to be read from the disk
+    QWORD               Hits;
+    QWORD               Misses;
+
+    QWORD               NumberOfEvictedPages;
+} PAGE_CACHE_STATISTICS, *PPAGE_CACHE_STATISTICS;
+
+_No_competing_thread_
+void
+PageCachePreinit(
+    void
+    );
+
+//******************************************************************************
+// Function:     PageCacheOpenFile
+// Description:  Retrieves the page cache of a file, creating it if this is the
+//               first time the file is cached. Two file objects opened on the
+//               same file share the same cache.
+// Returns:      STATUS
+// Parameter:    IN PFILE_OBJECT FileObject
+// Parameter:    OUT_PTR PPAGE_CACHE_FILE* CacheFile - referenced cache, must
+//               be released with PageCacheCloseFile.
+// NOTE:         There is no way of writing files, so the cached pages never
+//               become stale.
+//******************************************************************************
+STATUS
+PageCacheOpenFile(
+    IN          PFILE_OBJECT            FileObject,
+    OUT_PTR     PPAGE_CACHE_FILE*       CacheFile
+    );
+
+//******************************************************************************
+// Function:     PageCacheCloseFile
+// Description:  Drops a reference taken by PageCacheOpenFile. The cached pages
+//               are kept until the cache needs to evict them, so the next
+//               process using the same file will find them in memory.
+// Returns:      void
+// Parameter:    INOUT PPAGE_CACHE_FILE CacheFile
+// NOTE:         The caller must no longer have any of the file's frames mapped.
+//******************************************************************************
+void
+PageCacheCloseFile(
+    INOUT       PPAGE_CACHE_FILE        CacheFile
+    );
+
+//******************************************************************************
+// Function:     PageCacheGetPages
+// Description:  Retrieves the physical frames holding NumberOfPages pages of
+//               the file starting at FileOffset, reading the ones not yet
+//               cached from the disk. The part of the last page past the end
+//               of the file is zeroed.
+// Returns:      STATUS
+// Parameter:    IN PPAGE_CACHE_FILE CacheFile
+// Parameter:    IN PFILE_OBJECT FileObject - used for reading the file
+// Parameter:    IN QWORD FileOffset - must be page aligned
+// Parameter:    IN DWORD NumberOfPages
+// Parameter:    OUT_WRITES(NumberOfPages) PHYSICAL_ADDRESS* Frames
+// NOTE:         The frames are shared between all the users of the file and
+//               must be mapped read-only.
+//******************************************************************************
+STATUS
+PageCacheGetPages(
+    IN          PPAGE_CACHE_FILE        CacheFile,
+    IN          PFILE_OBJECT            FileObject,
+    IN          QWORD                   FileOffset,
+    IN          DWORD                   NumberOfPages,
+    OUT_WRITES(NumberOfPages)
+                PHYSICAL_ADDRESS*       Frames
+    );
+
+void
+PageCacheGetStatistics(
+    OUT         PPAGE_CACHE_STATISTICS  Statistics
+    );
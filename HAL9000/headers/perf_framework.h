@@ -5,8 +5,38 @@ typedef struct _PERFORMANCE_STATS
     QWORD               Mean;
     QWORD               Min;
     QWORD               Max;
+
+    // taken from a log-linear histogram => each percentile is within 1% of
+    // the measured value
+    QWORD               P50;
+    QWORD               P90;
+    QWORD               P99;
+    QWORD               P999;
+
+    // the number of measured iterations summed over all the CPUs
+    QWORD               Samples;
+    DWORD               NumberOfCpus;
+    BOOLEAN             MeasuredInUs;
 } PERFORMANCE_STATS, *PPERFORMANCE_STATS;
 
+typedef struct _PERFORMANCE_OPTIONS
+{
+    // measured iterations executed by each CPU
+    DWORD               IterationCount;
+
+    // iterations executed by each CPU before the measurement starts, they
+    // warm up the caches and the TLBs and are not recorded
+    DWORD               WarmupIterations;
+
+    // if greater than 1 the function is executed concurrently by this many
+    // CPUs, the calling CPU included, and the results are aggregated
+    // NOTE: the other CPUs run the function from an IPI handler with the
+    // interrupts disabled => it must not block
+    DWORD               NumberOfCpus;
+
+    BOOLEAN             MeasureInUs;
+} PERFORMANCE_OPTIONS, *PPERFORMANCE_OPTIONS;
+
 typedef
 void
 (__cdecl FUNC_TestPerformance)(
@@ -15,6 +45,17 @@ void
 
 typedef FUNC_TestPerformance*   PFUNC_TestPerformance;
 
+//******************************************************************************
+// Function:     RunPerformanceFunction
+// Description:  Measures IterationCount executions of Function on the current
+//               CPU without any warm-up.
+// Returns:      void
+// Parameter:    IN PFUNC_TestPerformance Function
+// Parameter:    IN_OPT PVOID Context
+// Parameter:    IN DWORD IterationCount
+// Parameter:    IN BOOLEAN MeasureInUs
+// Parameter:    OUT PPERFORMANCE_STATS PerfStats
+//******************************************************************************
 void
 RunPerformanceFunction(
     IN      PFUNC_TestPerformance   Function,
@@ -24,6 +65,34 @@ RunPerformanceFunction(
     OUT     PPERFORMANCE_STATS      PerfStats
     );
 
+//******************************************************************************
+// Function:     RunPerformanceFunctionEx
+// Description:  Measures the executions of Function as described by Options.
+// Returns:      STATUS
+// Parameter:    IN PFUNC_TestPerformance Function
+// Parameter:    IN_OPT PVOID Context - Shared by all the CPUs
+// Parameter:    IN PPERFORMANCE_OPTIONS Options
+// Parameter:    OUT PPERFORMANCE_STATS PerfStats
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+RunPerformanceFunctionEx(
+    IN      PFUNC_TestPerformance   Function,
+    IN_OPT  PVOID                   Context,
+    IN      PPERFORMANCE_OPTIONS    Options,
+    OUT     PPERFORMANCE_STATS      PerfStats
+    );
+
+//******************************************************************************
+// Function:     DisplayPerformanceStats
+// Description:  Logs the statistics and writes a PERF record for each of them
+//               to the serial port. If there are two statistics the speed-up
+//               of the second one over the first one is also logged.
+// Returns:      void
+// Parameter:    IN PPERFORMANCE_STATS PerfStats
+// Parameter:    IN DWORD NumberOfStats
+// Parameter:    IN char** StatNames
+//******************************************************************************
 void
 DisplayPerformanceStats(
     IN_READS(NumberOfStats)
@@ -31,4 +100,22 @@ DisplayPerformanceStats(
     IN      DWORD                   NumberOfStats,
     IN_READS(NumberOfStats)
             char**                  StatNames
-    );
\ No newline at end of file
+    );
+
+//******************************************************************************
+// Function:     PerfWriteStatsRecord
+// Description:  Writes the statistics to the serial port as a single line:
+//               PERF {"name":"...","cpus":N,"samples":N,"unit":"ticks|us",
+//                     "mean":N,"min":N,"p50":N,"p90":N,"p99":N,"p999":N,
+//                     "max":N}
+//               The line is meant to be extracted from the serial log by the
+//               host tools comparing two runs.
+// Returns:      void
+// Parameter:    IN_Z char* Name - Must not contain quotes or backslashes
+// Parameter:    IN PPERFORMANCE_STATS PerfStats
+//******************************************************************************
+void
+PerfWriteStatsRecord(
+    IN_Z    char*                   Name,
+    IN      PPERFORMANCE_STATS      PerfStats
+    );
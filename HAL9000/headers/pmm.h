@@ -1,9 +1,47 @@
 #pragma once
 
 #include "mmu.h"
+#include "numa.h"
 
 #define PmmReserveMemory(Frames)        PmmReserveMemoryEx((Frames), NULL )
 
+// Maximum number of free frames each CPU keeps for servicing single frame
+// requests without taking the global allocation lock
+#define PMM_CPU_CACHE_CAPACITY          64
+
+// Number of frames moved between a CPU cache and the global allocator at once
+#define PMM_CPU_CACHE_BATCH_SIZE        (PMM_CPU_CACHE_CAPACITY / 2)
+
+// Per-CPU cache of free physical frames, only the CPU which owns it takes frames
+// from it or gives frames back. The lock is contended only when the global
+// allocator runs out of frames and another CPU drains all the caches, or when
+// the statistics are collected
+typedef struct _PMM_CPU_CACHE
+{
+    LOCK                Lock;
+
+    _Guarded_by_(Lock)
+    DWORD               NumberOfFrames;
+
+    _Guarded_by_(Lock)
+    PHYSICAL_ADDRESS    Frames[PMM_CPU_CACHE_CAPACITY];
+
+    // Statistics
+    QWORD               Hits;
+    QWORD               Misses;
+    QWORD               Refills;
+    QWORD               Drains;
+} PMM_CPU_CACHE, *PPMM_CPU_CACHE;
+
+typedef struct _PMM_NODE_STATISTICS
+{
+    // Usable frames belonging to the node
+    QWORD               TotalFrames;
+
+    // Frames not yet handed out, including the ones sitting in the CPU caches
+    QWORD               FreeFrames;
+} PMM_NODE_STATISTICS, *PPMM_NODE_STATISTICS;
+
 _No_competing_thread_
 void
 PmmPreinitSystem(
@@ -19,6 +57,32 @@ PmmInitSystem(
     OUT         DWORD*                  SizeReserved
     );
 
+//******************************************************************************
+// Function:     PmmInitNuma
+// Description:  Starts keeping track of the free frames of each NUMA node, from
+//               now on the frames are preferably allocated from the node of
+//               the requesting CPU.
+// Returns:      void
+// Parameter:    void
+// NOTE:         Must be called after NumaInit and before any CPU caches frames.
+//******************************************************************************
+_No_competing_thread_
+void
+PmmInitNuma(
+    void
+    );
+
+//******************************************************************************
+// Function:     PmmInitCpuCache
+// Description:  Initializes the free frame cache of a CPU.
+// Returns:      void
+// Parameter:    OUT PPMM_CPU_CACHE Cache
+//******************************************************************************
+void
+PmmInitCpuCache(
+    OUT         PPMM_CPU_CACHE          Cache
+    );
+
 //******************************************************************************
 // Function:     PmmRequestMemoryEx
 // Description:  Reserves the first free frames available after MinPhysAddr.
@@ -34,6 +98,21 @@ PmmReserveMemoryEx(
     IN_OPT      PHYSICAL_ADDRESS        MinPhysAddr
     );
 
+//******************************************************************************
+// Function:     PmmReserveAlignedMemory
+// Description:  Reserves NoOfFrames continuous frames, the first of which is
+//               aligned to AlignmentInFrames frames (used for large pages).
+// Returns:      PHYSICAL_ADDRESS - start address of physical address reserved
+// Parameter:    IN DWORD NoOfFrames - frames to reserve.
+// Parameter:    IN DWORD AlignmentInFrames - must be a power of 2.
+//******************************************************************************
+PTR_SUCCESS
+PHYSICAL_ADDRESS
+PmmReserveAlignedMemory(
+    IN          DWORD                   NoOfFrames,
+    IN          DWORD                   AlignmentInFrames
+    );
+
 //******************************************************************************
 // Function:     PmmReleaseMemory
 // Description:  Releases previously reserved memory
@@ -47,6 +126,21 @@ PmmReleaseMemory(
     IN          DWORD                   NoOfFrames
     );
 
+//******************************************************************************
+// Function:     PmmGetNodeStatistics
+// Description:  Retrieves the frame counters of a NUMA node, the frames cached
+//               by the CPUs are counted as free. The caches are walked after
+//               the counters are copied => the result is only a snapshot.
+// Returns:      STATUS - STATUS_INVALID_PARAMETER1 if Node does not exist
+// Parameter:    IN NUMA_NODE Node
+// Parameter:    OUT PPMM_NODE_STATISTICS Statistics
+//******************************************************************************
+STATUS
+PmmGetNodeStatistics(
+    IN          NUMA_NODE               Node,
+    OUT         PPMM_NODE_STATISTICS    Statistics
+    );
+
 //******************************************************************************
 // Function:     PmmGetTotalSystemMemory
 // Description:
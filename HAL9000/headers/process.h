@@ -90,6 +90,19 @@ ProcessIsSystem(
     IN_OPT      PPROCESS    Process
     );
 
+//******************************************************************************
+// Function:     ProcessGetTimeToFirstInstruction
+// Description:  Returns the number of microseconds which passed from the call
+//               to ProcessCreate until the first user-mode instruction of the
+//               process could execute.
+// Returns:      QWORD - 0 if the process didn't reach its entry point yet
+// Parameter:    IN PPROCESS Process
+//******************************************************************************
+QWORD
+ProcessGetTimeToFirstInstruction(
+    IN          PPROCESS    Process
+    );
+
 //******************************************************************************
 // Function:     ProcessTerminate
 // Description:  Signals a process for termination (the current process will be
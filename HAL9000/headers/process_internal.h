@@ -5,6 +5,7 @@
 #include "process.h"
 #include "synch.h"
 #include "ex_event.h"
+#include "conc_hash_table.h"
 
 typedef struct _PROCESS
 {
@@ -47,12 +48,25 @@ typedef struct _PROCESS
     // Links all the processes in the global process list
     LIST_ENTRY                      NextProcess;
 
+    // Links the process in the PID table until it is destroyed
+    CONC_HASH_ENTRY                 PidTableEntry;
+
     // Pointer to the process' paging structures
     struct _PAGING_LOCK_DATA*       PagingData;
 
     // Pointer to the process' NT header information
     struct _PE_NT_HEADER_INFO*      HeaderInfo;
 
+    // The executable file, the image sections are mapped lazily from it so it
+    // must be kept open until the address space is destroyed
+    struct _FILE_OBJECT*            ImageFile;
+
+    // Time at which ProcessCreate was called and the time it took until the
+    // page holding the entry point was mapped, i.e. until the first user-mode
+    // instruction could execute (0 if it didn't happen yet)
+    QWORD                           CreationTimeUs;
+    volatile QWORD                  TimeToFirstInstructionUs;
+
     // VaSpace used only for UM virtual memory allocations
     struct _VMM_RESERVATION_SPACE*  VaSpace;
 } PROCESS, *PPROCESS;
@@ -145,6 +159,21 @@ ProcessExecuteForEachProcessEntry(
     IN_OPT  PVOID               Context
     );
 
+//******************************************************************************
+// Function:     ProcessRetrieveById
+// Description:  Finds the process with the given PID without taking any lock.
+//               The process returned is referenced, the reference must be
+//               dropped with ProcessCloseHandle.
+// Returns:      PPROCESS - NULL if there is no such process or if it is being
+//               destroyed
+// Parameter:    IN PID ProcessId
+//******************************************************************************
+PTR_SUCCESS
+PPROCESS
+ProcessRetrieveById(
+    IN      PID                 ProcessId
+    );
+
 //******************************************************************************
 // Function:     ProcessActivatePagingTables
 // Description:  Performs a switch to the Process paging tables.
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "isr.h"
+
+// the interrupted RIP followed by the return addresses found by unwinding
+#define PROFILER_MAX_FRAMES                 8
+
+// each CPU keeps only its latest samples
+#define PROFILER_SAMPLES_PER_CPU            4096
+
+#define PROFILER_DEFAULT_PERIOD_US          1000
+
+// LapicSystemEnableTimer needs at least one timer interrupt each second, the
+// lower limit keeps the interrupt handling from starving the interrupted code
+#define PROFILER_MIN_PERIOD_US              100
+#define PROFILER_MAX_PERIOD_US              SEC_IN_US
+
+#define PROFILER_DEFAULT_FUNCTIONS          20
+
+typedef struct _PROFILER_SAMPLE
+{
+    TID                 ThreadId;
+    APIC_ID             CpuId;
+    BOOLEAN             UserMode;
+
+    // Frames[0] is the interrupted RIP, the frames are not unwound for the
+    // samples taken in user-mode
+    BYTE                NumberOfFrames;
+    QWORD               Frames[PROFILER_MAX_FRAMES];
+} PROFILER_SAMPLE, *PPROFILER_SAMPLE;
+
+//******************************************************************************
+// Function:     ProfilerStart
+// Description:  Discards the previous samples and arms the LAPIC timer of each
+//               CPU, each of its interrupts records a sample of the code it
+//               interrupted. The timer does not depend on any performance
+//               counters => it also works on virtual machines which do not
+//               expose them.
+// Returns:      STATUS - STATUS_ALREADY_INITIALIZED if the profiler is running
+// Parameter:    IN DWORD PeriodUs - Sampling period of each CPU, in the
+//               [PROFILER_MIN_PERIOD_US, PROFILER_MAX_PERIOD_US] range
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+ProfilerStart(
+    IN      DWORD                           PeriodUs
+    );
+
+//******************************************************************************
+// Function:     ProfilerStop
+// Description:  Stops the LAPIC timers, the samples are kept for ProfilerDump.
+// Returns:      STATUS - STATUS_NOT_INITIALIZED if the profiler is not running
+// Parameter:    void
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+ProfilerStop(
+    void
+    );
+
+//******************************************************************************
+// Function:     ProfilerRecordSample
+// Description:  Called for each interrupt before its handler, records a
+//               sample if the profiler is running and the interrupt is the
+//               profiling timer.
+//               NOTE: the interrupts which find the interrupts disabled are
+//               delivered when they are enabled again => the time spent with
+//               the interrupts disabled is attributed to the code enabling
+//               them.
+// Returns:      void
+// Parameter:    IN BYTE InterruptIndex
+// Parameter:    IN PINTERRUPT_STACK_COMPLETE StackPointer
+// Parameter:    IN PROCESSOR_STATE* ProcessorState
+//******************************************************************************
+void
+ProfilerRecordSample(
+    IN      BYTE                            InterruptIndex,
+    IN      PINTERRUPT_STACK_COMPLETE       StackPointer,
+    IN      PROCESSOR_STATE*                ProcessorState
+    );
+
+//******************************************************************************
+// Function:     ProfilerDump
+// Description:  Aggregates the samples by function and logs the functions in
+//               which the most samples were taken. The self count of a
+//               function is the number of samples taken in its own code, the
+//               total count also includes the samples taken in its callees.
+//               The functions not exported by the kernel are named by their
+//               RVA, which can be looked up in the linker map file.
+// Returns:      STATUS - STATUS_DEVICE_BUSY if the profiler is running,
+//               STATUS_NO_DATA_AVAILABLE if there are no samples
+// Parameter:    IN DWORD MaxFunctions
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+ProfilerDump(
+    IN      DWORD                           MaxFunctions
+    );
@@ -139,6 +139,26 @@ SmpGetNumberOfActiveCpus(
     void
     );
 
+//******************************************************************************
+// Function:     SmpSendTlbShootdownIpi
+// Description:  Interrupts the CPUs in Affinity on the vector reserved for TLB
+//               invalidations, each of them calls VmmProcessTlbShootdown.
+//               Unlike SmpSendGenericIpiEx nothing is allocated => it may be
+//               called from any context, including while memory is reclaimed.
+// Returns:      void
+// Parameter:    IN CPU_AFFINITY Affinity - logical APIC IDs of the targets
+//******************************************************************************
+void
+SmpSendTlbShootdownIpi(
+    IN      CPU_AFFINITY    Affinity
+    );
+
+// The vector on which the LAPIC timer of each CPU interrupts
+BYTE
+SmpGetApicTimerVector(
+    void
+    );
+
 void
 SmpNotifyCpuWakeup(
     void
@@ -0,0 +1,130 @@
+#pragma once
+
+// Maximum number of pages written to the swap partition with a single
+// IoWriteFile call when evicting memory
+#define SWAP_MAX_PAGES_PER_IO               16
+
+// Part of the physical memory set aside for holding compressed pages before
+// spilling them to the swap partition (1 / ratio), 0 disables the tier
+#define SWAP_COMPRESSED_POOL_RATIO          16
+#define SWAP_COMPRESSED_POOL_MAX_SIZE       (32 * MB_SIZE)
+
+// The compressed pool is split in chunks of this size, a page occupies as
+// many consecutive chunks as needed by its compressed data
+#define SWAP_COMPRESSED_CHUNK_SIZE          64
+
+// Pages which don't compress below this size are written to the swap
+// partition, keeping them in RAM would save too little memory
+#define SWAP_COMPRESSED_MAX_PAGE_SIZE       (3 * PAGE_SIZE / 4)
+
+// Identifies a page stored by the swap module, it fits in the swap slot field
+// of a non-present PTE
+typedef QWORD SWAP_HANDLE;
+
+#define SWAP_INVALID_HANDLE                 MAX_QWORD
+
+typedef struct _SWAP_STATISTICS
+{
+    QWORD               NumberOfSlots;
+    QWORD               NumberOfUsedSlots;
+
+    QWORD               PagesWritten;
+    QWORD               PagesRead;
+
+    // Number of write requests sent to the file system, each one covers at
+    // most SWAP_MAX_PAGES_PER_IO pages
+    QWORD               NumberOfWrites;
+
+    // Compressed tier, the sizes are in bytes
+    QWORD               CompressedPoolSize;
+    QWORD               CompressedPoolUsed;
+    QWORD               NumberOfCompressedPages;
+
+    // Zero filled pages take no space at all
+    QWORD               NumberOfZeroPages;
+} SWAP_STATISTICS, *PSWAP_STATISTICS;
+
+_No_competing_thread_
+void
+SwapPreinit(
+    void
+    );
+
+//******************************************************************************
+// Function:     SwapInit
+// Description:  Reserves the compressed pool and opens the first volume on
+//               which SwapFS is mounted.
+// Returns:      STATUS - STATUS_DEVICE_DOES_NOT_EXIST if neither tier is
+//               available
+// Parameter:    void
+// NOTE:         Must be called after the file system drivers were loaded. If no
+//               swap partition exists pages are only compressed in memory.
+//******************************************************************************
+STATUS
+SwapInit(
+    void
+    );
+
+BOOLEAN
+SwapIsAvailable(
+    void
+    );
+
+//******************************************************************************
+// Function:     SwapStorePages
+// Description:  Saves the contents of NumberOfPages pages. Zero filled pages
+//               are only remembered as such, the others are compressed in
+//               the memory pool and the ones which don't fit are written to
+//               the swap partition with a single request.
+// Returns:      STATUS - STATUS_SUCCESS only if all the pages were stored
+// Parameter:    IN DWORD NumberOfPages - at most SWAP_MAX_PAGES_PER_IO
+// Parameter:    IN_READS(NumberOfPages) PVOID* Pages - kernel mappings of the
+//               pages, they need not be contiguous.
+// Parameter:    OUT_WRITES(NumberOfPages) SWAP_HANDLE* Handles -
+//               SWAP_INVALID_HANDLE for the pages which could not be stored
+//******************************************************************************
+STATUS
+SwapStorePages(
+    IN          DWORD                   NumberOfPages,
+    IN_READS(NumberOfPages)
+                PVOID*                  Pages,
+    OUT_WRITES(NumberOfPages)
+                SWAP_HANDLE*            Handles
+    );
+
+//******************************************************************************
+// Function:     SwapLoadPage
+// Description:  Retrieves the contents of a page saved by SwapStorePages. The
+//               handle remains valid until released with SwapFreePage.
+// Returns:      STATUS
+// Parameter:    IN SWAP_HANDLE Handle
+// Parameter:    OUT_WRITES_BYTES(PAGE_SIZE) PVOID Page
+//******************************************************************************
+STATUS
+SwapLoadPage(
+    IN          SWAP_HANDLE             Handle,
+    OUT_WRITES_BYTES(PAGE_SIZE)
+                PVOID                   Page
+    );
+
+//******************************************************************************
+// Function:     SwapIsPageInMemory
+// Description:  Checks if the page is retrieved by SwapLoadPage without any
+//               disk I/O, in which case SwapLoadPage never blocks.
+// Returns:      BOOLEAN
+// Parameter:    IN SWAP_HANDLE Handle
+//******************************************************************************
+BOOLEAN
+SwapIsPageInMemory(
+    IN          SWAP_HANDLE             Handle
+    );
+
+void
+SwapFreePage(
+    IN          SWAP_HANDLE             Handle
+    );
+
+void
+SwapGetStatistics(
+    OUT         PSWAP_STATISTICS        Statistics
+    );
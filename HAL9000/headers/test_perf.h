@@ -0,0 +1,49 @@
+#pragma once
+
+typedef
+STATUS
+(__cdecl FUNC_PerfTest)(
+    IN      DWORD           IterationCount
+    );
+
+typedef FUNC_PerfTest*      PFUNC_PerfTest;
+
+typedef struct _PERF_TEST
+{
+    char*                       TestName;
+    char*                       Description;
+    PFUNC_PerfTest              TestFunction;
+
+    // used when the command does not specify the number of iterations
+    DWORD                       DefaultIterations;
+} PERF_TEST, *PPERF_TEST;
+
+extern const PERF_TEST PERF_TESTS[];
+
+extern const DWORD PERF_TOTAL_NO_OF_TESTS;
+
+//******************************************************************************
+// Function:     TestPerfRun
+// Description:  Runs a kernel microbenchmark, the results are logged and
+//               written to the serial port as PERF records.
+// Returns:      STATUS - STATUS_ELEMENT_NOT_FOUND if there is no test named
+//               TestName
+// Parameter:    IN_Z char* TestName
+// Parameter:    IN DWORD IterationCount - 0 => the test's default
+//******************************************************************************
+STATUS
+TestPerfRun(
+    IN_Z    char*           TestName,
+    IN      DWORD           IterationCount
+    );
+
+//******************************************************************************
+// Function:     TestPerfRunAll
+// Description:  Runs all the kernel microbenchmarks.
+// Returns:      void
+// Parameter:    IN DWORD IterationCount - 0 => each test's default
+//******************************************************************************
+void
+TestPerfRunAll(
+    IN      DWORD           IterationCount
+    );
@@ -4,6 +4,7 @@
 #include "ref_cnt.h"
 #include "ex_event.h"
 #include "thread.h"
+#include "conc_hash_table.h"
 
 typedef enum _THREAD_STATE
 {
@@ -55,6 +56,10 @@ typedef struct _THREAD
     // List of all the threads in the system (including those blocked or dying)
     LIST_ENTRY              AllList;
 
+    // Links the thread in the TID table from its creation until it is
+    // destroyed
+    CONC_HASH_ENTRY         TidTableEntry;
+
     // List of the threads ready to run
     LIST_ENTRY              ReadyList;
 
@@ -250,6 +255,21 @@ ThreadExecuteForEachThreadEntry(
     IN_OPT  PVOID               Context
     );
 
+//******************************************************************************
+// Function:     ThreadRetrieveById
+// Description:  Finds the thread with the given TID without taking any lock.
+//               The thread returned is referenced, the reference must be
+//               dropped with ThreadCloseHandle.
+// Returns:      PTHREAD - NULL if there is no such thread or if it is being
+//               destroyed
+// Parameter:    IN TID ThreadId
+//******************************************************************************
+PTR_SUCCESS
+PTHREAD
+ThreadRetrieveById(
+    IN      TID                 ThreadId
+    );
+
 //******************************************************************************
 // Function:     GetCurrentThread
 // Description:  Returns the running thread.
@@ -2,11 +2,13 @@
 
 typedef struct _PROCESS* PPROCESS;
 typedef struct _PE_NT_HEADER_INFO* PPE_NT_HEADER_INFO;
+typedef struct _FILE_OBJECT* PFILE_OBJECT;
 
 STATUS
 UmApplicationRetrieveHeader(
     IN_Z        char*                   Path,
-    OUT         PPE_NT_HEADER_INFO      NtHeaderInfo
+    OUT         PPE_NT_HEADER_INFO      NtHeaderInfo,
+    OUT_PTR     PFILE_OBJECT*           ImageFile
     );
 
 STATUS
@@ -4,12 +4,13 @@
 #include "vmm.h"
 
 typedef struct _FILE_OBJECT *PFILE_OBJECT;
+typedef struct _PAGE_CACHE_FILE *PPAGE_CACHE_FILE;
 
 typedef struct _VMM_RESERVATION_SPACE
 {
     // Because we have an effectively infinite virtual address space
-    // we will never decrement this pointer and the virtual addresses
-    // allocated will be strictly monotonically increasing
+    // we will never decrement this pointer, the ranges of released
+    // reservations are reused through the gap tree below
     volatile PVOID      FreeVirtualAddressPointer;
 
     // Space from which we can allocate virtual addresses
@@ -27,6 +28,25 @@ typedef struct _VMM_RESERVATION_SPACE
 
     _Guarded_by_(ReservationLock)
     struct _VMM_RESERVATION*    ReservationList;
+
+    // Entries are handed out from here once the free list is empty, everything
+    // past this pointer was never used
+    _Guarded_by_(ReservationLock)
+    struct _VMM_RESERVATION*    NextUnusedReservation;
+
+    _Guarded_by_(ReservationLock)
+    struct _VMM_RESERVATION*    FreeReservationList;
+
+    // Balanced tree of all the reservations and of the free gaps between them
+    // ordered by their start VA - because the entries never overlap finding the
+    // one containing an address is a simple floor search
+    _Guarded_by_(ReservationLock)
+    struct _VMM_RESERVATION_NODE*   AddressTreeRoot;
+
+    // Balanced tree of the free gaps left by released reservations ordered by
+    // their size, used for best-fit placement of new reservations
+    _Guarded_by_(ReservationLock)
+    struct _VMM_RESERVATION_NODE*   GapTreeRoot;
 } VMM_RESERVATION_SPACE, *PVMM_RESERVATION_SPACE;
 
 //******************************************************************************
@@ -84,7 +104,16 @@ VmReservationSpaceDetermineNextFreeVirtualAddress(
 // Parameter:    OUT PAGE_RIGHTS * MemoryRights
 // Parameter:    OUT BOOLEAN * Uncacheable
 // Parameter:    OUT_PTR_MAYBE_NULL PFILE_OBJECT * BackingFile
+// Parameter:    OUT_PTR_MAYBE_NULL PPAGE_CACHE_FILE * CacheFile - if non-NULL
+//               the pages of BackingFile must be taken from the page cache.
 // Parameter:    OUT QWORD * FileOffset
+// Parameter:    OUT BOOLEAN * LargePage - TRUE if the whole 2MB page
+//               containing the address can be mapped at once.
+// Parameter:    IN DWORD FaultAroundPages - size in pages of the aligned
+//               window around FaultingAddress which may be mapped together.
+// Parameter:    OUT PVOID * RangeStart - first page of the committed run
+//               containing FaultingAddress, limited to the window.
+// Parameter:    OUT DWORD * RangePages - number of pages in the run.
 //******************************************************************************
 BOOLEAN
 VmReservationCanAddressBeAccessed(
@@ -94,7 +123,12 @@ VmReservationCanAddressBeAccessed(
     OUT                     PAGE_RIGHTS*            MemoryRights,
     OUT                     BOOLEAN*                Uncacheable,
     OUT_PTR_MAYBE_NULL      PFILE_OBJECT*           BackingFile,
-    OUT                     QWORD*                  FileOffset
+    OUT_PTR_MAYBE_NULL      PPAGE_CACHE_FILE*       CacheFile,
+    OUT                     QWORD*                  FileOffset,
+    OUT                     BOOLEAN*                LargePage,
+    IN                      DWORD                   FaultAroundPages,
+    OUT                     PVOID*                  RangeStart,
+    OUT                     DWORD*                  RangePages
     );
 
 STATUS
@@ -106,10 +140,26 @@ VmReservationSpaceAllocRegion(
     IN                      PAGE_RIGHTS             Rights,
     IN                      BOOLEAN                 Uncacheable,
     IN_OPT                  PFILE_OBJECT            FileObject,
+    IN                      QWORD                   FileOffset,
     OUT                     PVOID*                  MappedAddress,
     OUT                     QWORD*                  MappedSize
     );
 
+//******************************************************************************
+// Function:     VmReservationSpaceFreeRegion
+// Description:  Decommits or releases a range of a reservation. The range is
+//               not unmapped, this is the responsibility of the caller.
+// Returns:      void
+// Parameter:    INOUT PVMM_RESERVATION_SPACE ReservationSpace
+// Parameter:    IN PVOID Address
+// Parameter:    QWORD Size - must be 0 for VMM_FREE_TYPE_RELEASE
+// Parameter:    IN VMM_FREE_TYPE FreeType
+// Parameter:    OUT PVOID * AlignedAddress - start of the range to unmap.
+// Parameter:    OUT QWORD * AlignedSize - size of the range to unmap.
+// Parameter:    OUT_PTR_MAYBE_NULL PPAGE_CACHE_FILE * CacheFile - page cache
+//               reference held by a released reservation, the caller must
+//               close it with PageCacheCloseFile after unmapping the range.
+//******************************************************************************
 void
 VmReservationSpaceFreeRegion(
     INOUT                   PVMM_RESERVATION_SPACE  ReservationSpace,
@@ -119,7 +169,27 @@ VmReservationSpaceFreeRegion(
                             QWORD                   Size,
     IN                      VMM_FREE_TYPE           FreeType,
     OUT                     PVOID*                  AlignedAddress,
-    OUT                     QWORD*                  AlignedSize
+    OUT                     QWORD*                  AlignedSize,
+    OUT_PTR_MAYBE_NULL      PPAGE_CACHE_FILE*       CacheFile
+    );
+
+//******************************************************************************
+// Function:     VmReservationSpaceReturnRegion
+// Description:  Makes the virtual address range of a released reservation
+//               available for future reservations. Must be called only after
+//               the range was unmapped and the TLBs were invalidated.
+// Returns:      void
+// Parameter:    INOUT PVMM_RESERVATION_SPACE ReservationSpace
+// Parameter:    IN PVOID Address - the aligned address returned by
+//               VmReservationSpaceFreeRegion.
+// Parameter:    IN QWORD Size - the aligned size returned by
+//               VmReservationSpaceFreeRegion.
+//******************************************************************************
+void
+VmReservationSpaceReturnRegion(
+    INOUT                   PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN                      PVOID                   Address,
+    IN                      QWORD                   Size
     );
 
 STATUS
@@ -129,3 +199,17 @@ VmReservationReturnRightsForAddress(
     IN                      QWORD                   Size,
     OUT                     PAGE_RIGHTS*            Rights
     );
+
+//******************************************************************************
+// Function:     VmReservationSpaceRetrieveLastRegion
+// Description:  Returns the start of the reservation with the highest address.
+//               Used for releasing all the reservations of a space which is
+//               about to be destroyed.
+// Returns:      PVOID - NULL if there are no more reservations
+// Parameter:    IN PVMM_RESERVATION_SPACE ReservationSpace
+//******************************************************************************
+PTR_SUCCESS
+PVOID
+VmReservationSpaceRetrieveLastRegion(
+    IN                      PVMM_RESERVATION_SPACE  ReservationSpace
+    );
@@ -2,6 +2,7 @@
 
 #include "mmu.h"
 #include "pte.h"
+#include "bitmap.h"
 
 typedef struct _FILE_OBJECT* PFILE_OBJECT;
 
@@ -9,6 +10,105 @@ typedef struct _VMM_RESERVATION_SPACE* PVMM_RESERVATION_SPACE;
 
 typedef struct _MDL *PMDL;
 
+// Size of the memory mapped by a single PDE
+#define VMM_LARGE_PAGE_SIZE             (PAGE_2MB_OFFSET + 1)
+#define VMM_FRAMES_PER_LARGE_PAGE       (VMM_LARGE_PAGE_SIZE / PAGE_SIZE)
+
+// Number of pages around a faulting address which are mapped on the same #PF
+// if they are committed, these are mapped with the interrupts disabled
+#define VMM_DEFAULT_FAULT_AROUND_PAGES  16
+#define VMM_MAX_FAULT_AROUND_PAGES      64
+
+// Number of distinct VA ranges and physical frame runs collected by an unmap
+// batch before the translations must be invalidated and the frames released
+#define VMM_UNMAP_BATCH_MAX_RANGES      16
+#define VMM_UNMAP_BATCH_MAX_FRAME_RUNS  16
+#define VMM_UNMAP_BATCH_MAX_STRUCTURES  16
+
+// Number of ranges which can wait to be invalidated by a CPU, if more are
+// queued the CPU will invalidate all its translations instead
+#define VMM_TLB_MAX_PENDING_RANGES      16
+
+// Invalidating more pages than this one by one costs more than re-filling the
+// TLB after flushing the whole address space
+#define VMM_TLB_FULL_FLUSH_THRESHOLD    32
+
+// Maximum number of pages evicted by a single VmmReclaimMemory call, the dirty
+// ones are handed to the swap module at once
+#define VMM_RECLAIM_BATCH_PAGES         16
+
+typedef struct _VMM_TLB_RANGE
+{
+    PPAGING_DATA            PagingData;
+    PVOID                   Address;
+
+    // 0 => all the translations of PagingData are invalidated
+    DWORD                   NumberOfPages;
+} VMM_TLB_RANGE, *PVMM_TLB_RANGE;
+
+typedef struct _VMM_FRAME_RUN
+{
+    PHYSICAL_ADDRESS        Address;
+    DWORD                   NumberOfFrames;
+} VMM_FRAME_RUN, *PVMM_FRAME_RUN;
+
+// Collects the translations removed by VmmUnmapMemoryEx so that all of them
+// are invalidated on the other CPUs with a single IPI, the frames unmapped
+// can only be released after this happens
+typedef struct _VMM_UNMAP_BATCH
+{
+    PPAGING_DATA            PagingData;
+
+    DWORD                   NumberOfRanges;
+    VMM_TLB_RANGE           Ranges[VMM_UNMAP_BATCH_MAX_RANGES];
+
+    DWORD                   NumberOfFrameRuns;
+    VMM_FRAME_RUN           FrameRuns[VMM_UNMAP_BATCH_MAX_FRAME_RUNS];
+
+    // Empty paging structures unlinked from the tables, they return to the
+    // pool of PagingData only after no CPU can walk them anymore
+    DWORD                   NumberOfStructures;
+    PHYSICAL_ADDRESS        Structures[VMM_UNMAP_BATCH_MAX_STRUCTURES];
+} VMM_UNMAP_BATCH, *PVMM_UNMAP_BATCH;
+
+// Per-CPU TLB invalidation state
+typedef struct _VMM_TLB_CPU_DATA
+{
+    // Ranges other CPUs have asked this CPU to invalidate
+    LOCK                    PendingLock;
+
+    _Guarded_by_(PendingLock)
+    DWORD                   NumberOfPendingRanges;
+
+    _Guarded_by_(PendingLock)
+    VMM_TLB_RANGE           PendingRanges[VMM_TLB_MAX_PENDING_RANGES];
+
+    // Set when the pending ranges overflowed
+    _Guarded_by_(PendingLock)
+    BOOLEAN                 FlushAllPending;
+
+    // Each request queued increments RequestedGeneration, the requester waits
+    // until CompletedGeneration reaches the value it has received
+    _Guarded_by_(PendingLock)
+    QWORD                   RequestedGeneration;
+
+    volatile QWORD          CompletedGeneration;
+
+    // PCIDs for which this CPU may still hold stale translations, these are
+    // flushed the next time the CPU switches to them
+    // Accessed only by the owning CPU with the interrupts disabled
+    BITMAP                  StalePcids;
+    BYTE                    StalePcidsBuffer[PCID_TOTAL_NO_OF_VALUES / BITS_PER_BYTE];
+
+    // Statistics
+    QWORD                   ShootdownsSent;
+    QWORD                   ShootdownsReceived;
+    QWORD                   PagesInvalidated;
+    QWORD                   FullFlushes;
+    QWORD                   RoundTripTicks;
+    QWORD                   MaxRoundTripTicks;
+} VMM_TLB_CPU_DATA, *PVMM_TLB_CPU_DATA;
+
 _No_competing_thread_
 void
 VmmPreinit(
@@ -21,6 +121,126 @@ VmmInit(
     IN      PVOID                   BaseAddress
     );
 
+//******************************************************************************
+// Function:     VmmInitCpuTlbData
+// Description:  Initializes the TLB invalidation state of a CPU.
+// Returns:      void
+// Parameter:    OUT PVMM_TLB_CPU_DATA TlbData
+//******************************************************************************
+void
+VmmInitCpuTlbData(
+    OUT     PVMM_TLB_CPU_DATA       TlbData
+    );
+
+//******************************************************************************
+// Function:     VmmProcessTlbShootdown
+// Description:  Invalidates the ranges other CPUs have queued for the current
+//               CPU. Called with the interrupts disabled by the handler of the
+//               TLB shootdown IPI, see SmpSendTlbShootdownIpi.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+void
+VmmProcessTlbShootdown(
+    void
+    );
+
+//******************************************************************************
+// Function:     VmmSetFaultAroundPages
+// Description:  Changes the size of the aligned window of committed pages
+//               which are mapped together when solving a #PF.
+// Returns:      DWORD - The previous window size
+// Parameter:    IN DWORD NumberOfPages - 1 maps only the faulting page, the
+//               value is capped to VMM_MAX_FAULT_AROUND_PAGES.
+//******************************************************************************
+DWORD
+VmmSetFaultAroundPages(
+    IN      DWORD                   NumberOfPages
+    );
+
+//******************************************************************************
+// Function:     VmmGetNumberOfCopyOnWriteFaults
+// Description:  Returns the number of writes to shared pages which were
+//               solved by giving the process its own copy of the page.
+// Returns:      QWORD
+//******************************************************************************
+QWORD
+VmmGetNumberOfCopyOnWriteFaults(
+    void
+    );
+
+typedef struct _VMM_RECLAIM_STATISTICS
+{
+    // Dirty pages stored by the swap module vs clean pages dropped
+    QWORD                   PagesSwappedOut;
+    QWORD                   PagesDiscarded;
+
+    QWORD                   PagesSwappedIn;
+
+    // Page tables, directories and PDPTs freed because they became empty
+    QWORD                   PagingStructuresFreed;
+} VMM_RECLAIM_STATISTICS, *PVMM_RECLAIM_STATISTICS;
+
+void
+VmmGetReclaimStatistics(
+    OUT     PVMM_RECLAIM_STATISTICS Statistics
+    );
+
+typedef struct _VMM_PAGING_STRUCTURES_STATISTICS
+{
+    // Frames reserved for the paging structures of the address space
+    DWORD                   NumberOfFrames;
+
+    DWORD                   FramesInUse;
+
+    // Frames freed by unmapping which are kept zeroed for reuse
+    DWORD                   FramesInPool;
+} VMM_PAGING_STRUCTURES_STATISTICS, *PVMM_PAGING_STRUCTURES_STATISTICS;
+
+void
+VmmGetPagingStructuresStatistics(
+    IN      PPAGING_DATA                        PagingData,
+    OUT     PVMM_PAGING_STRUCTURES_STATISTICS   Statistics
+    );
+
+//******************************************************************************
+// Function:     VmmReclaimMemory
+// Description:  Evicts up to NumberOfPages pageable pages of an address space
+//               which were not accessed recently. Dirty pages are compressed
+//               in memory or written to the swap partition, clean ones are
+//               simply dropped and will be zeroed again on the next access.
+// Returns:      DWORD - Number of frames returned to the PMM
+// Parameter:    IN PPAGING_LOCK_DATA PagingData
+// Parameter:    IN DWORD NumberOfPages - capped to VMM_RECLAIM_BATCH_PAGES
+// NOTE:         The paging lock must not be held by the caller, the evicted
+//               translations are invalidated on all the CPUs.
+//******************************************************************************
+DWORD
+VmmReclaimMemory(
+    IN      PPAGING_LOCK_DATA       PagingData,
+    IN      DWORD                   NumberOfPages
+    );
+
+//******************************************************************************
+// Function:     VmmMapFramesEx
+// Description:  Maps frames which need not be contiguous one after another in
+//               a newly determined range of the kernel virtual space.
+// Returns:      PVOID - Virtual Address to which the first frame was mapped
+// Parameter:    IN PPAGING_DATA PagingData - Paging tables to use
+// Parameter:    IN_READS(NumberOfFrames) PHYSICAL_ADDRESS* Frames
+// Parameter:    IN DWORD NumberOfFrames
+// Parameter:    IN PAGE_RIGHTS PageRights
+//******************************************************************************
+PTR_SUCCESS
+PVOID
+VmmMapFramesEx(
+    IN      PPAGING_DATA            PagingData,
+    IN_READS(NumberOfFrames)
+            PHYSICAL_ADDRESS*       Frames,
+    IN      DWORD                   NumberOfFrames,
+    IN      PAGE_RIGHTS             PageRights
+    );
+
 //******************************************************************************
 // Function:     VmmMapMemoryEx
 // Description:  Maps a PA using the received paging data into virtual space.
@@ -46,7 +266,9 @@ VmmMapMemoryEx(
 //******************************************************************************
 // Function:     VmmMapMemoryInternal
 // Description:  Same as VmmMapMemoryEx except it maps the address to an
-//               explicit virtual address.
+//               explicit virtual address. The range is mapped using 4KB
+//               pages, it may describe device memory or memory whose type
+//               changes inside a 2MB range.
 /// NOTE:        This should be used used only in the vmm and mmu files
 //******************************************************************************
 void
@@ -60,21 +282,102 @@ VmmMapMemoryInternal(
     IN      BOOLEAN                 Uncacheable
     );
 
+//******************************************************************************
+// Function:     VmmMapAnonymousMemory
+// Description:  Same as VmmMapMemoryInternal except the frames were reserved
+//               from the PMM for an anonymous region => they are usable RAM.
+//               Each 2MB aligned chunk of the range whose physical address is
+//               also 2MB aligned is mapped using a large page. The previous
+//               translations are always invalidated.
+/// NOTE:        This should be used used only in the vmm and mmu files
+//******************************************************************************
+void
+VmmMapAnonymousMemory(
+    IN      PPAGING_DATA            PagingData,
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      QWORD                   Size,
+    IN      PVOID                   BaseAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Uncacheable
+    );
+
+//******************************************************************************
+// Function:     VmmMapSharedMemory
+// Description:  Same as VmmMapMemoryInternal except the frames belong to the
+//               page cache and are shared with other address spaces: they are
+//               mapped using 4KB pages, they are never released on unmap and
+//               if PageRights contains write rights the pages are mapped
+//               read-only and copied on the first write.
+/// NOTE:        This should be used used only in the vmm and mmu files
+//******************************************************************************
+void
+VmmMapSharedMemory(
+    IN      PPAGING_DATA            PagingData,
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      QWORD                   Size,
+    IN      PVOID                   BaseAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Invalidate,
+    IN      BOOLEAN                 Uncacheable
+    );
+
 //******************************************************************************
 // Function:     VmmUnmapMemoryEx
 // Description:  Unmaps a previously mapped VA with VmmMapMemoryEx or
-//               VmmMapMemoryInternal
-// Returns:      void
-// Parameter:    IN PML4 Cr3 - paging tables
+//               VmmMapMemoryInternal. Large pages only partially covered by
+//               the range are first split into 4KB pages. The translations
+//               are not invalidated and the frames are not released, these
+//               are recorded in Batch which must be flushed with
+//               VmmFlushUnmapBatch after the paging lock is released. In
+//               the process address spaces the paging structures left empty
+//               are freed as well.
+// Returns:      QWORD - Number of bytes processed, less than Size if the
+//               batch became full.
+// Parameter:    IN PPAGING_DATA PagingData - paging tables
 // Parameter:    IN PVOID VirtualAddress
 // Parameter:    IN DWORD Size - PAGE_SIZE aligned number of bytes to unmap
+// Parameter:    IN BOOLEAN ReleaseMemory - the frames mapped with
+//               VmmMapSharedMemory are never released.
+// Parameter:    INOUT PVMM_UNMAP_BATCH Batch - initialized with
+//               VmmInitUnmapBatch for the same PagingData.
 //******************************************************************************
-void
+QWORD
 VmmUnmapMemoryEx(
-    IN      PML4                    Cr3,
+    IN      PPAGING_DATA            PagingData,
     IN      PVOID                   VirtualAddress,
     IN      QWORD                   Size,
-    IN      BOOLEAN                 ReleaseMemory
+    IN      BOOLEAN                 ReleaseMemory,
+    INOUT   PVMM_UNMAP_BATCH        Batch
+    );
+
+void
+VmmInitUnmapBatch(
+    OUT     PVMM_UNMAP_BATCH        Batch,
+    IN      PPAGING_DATA            PagingData
+    );
+
+//******************************************************************************
+// Function:     VmmFlushUnmapBatch
+// Description:  Invalidates the translations collected in Batch on the
+//               current CPU and on each CPU which may have cached them, waits
+//               for the invalidations to finish and only then releases the
+//               frames and the paging structures collected.
+// Returns:      void
+// Parameter:    INOUT PVMM_UNMAP_BATCH Batch
+// Parameter:    IN BOOLEAN LocalOnly - TRUE if the caller guarantees the
+//               translations could have been cached only by the current CPU
+//               in the current address space (no IPIs are sent).
+/// NOTE:        Unless LocalOnly is set the caller must not hold any lock other
+///              CPUs may spin on: the paging locks, the PMM and VA space locks,
+///              the heap lock or any other spinlock. All of them are taken with
+///              the interrupts disabled, a CPU spinning on one of them would
+///              never acknowledge the invalidation request and both CPUs would
+///              wait forever.
+//******************************************************************************
+void
+VmmFlushUnmapBatch(
+    INOUT   PVMM_UNMAP_BATCH        Batch,
+    IN      BOOLEAN                 LocalOnly
     );
 
 //******************************************************************************
@@ -129,21 +432,35 @@ VmmSetupPageTables(
 
 //******************************************************************************
 // Function:     VmmChangeCr3
-// Description:  Performs a CR3 switch to Pml4Base using PCID Pcid.
+// Description:  Performs a CR3 switch to the paging tables described by
+//               PagingData using PCID Pcid. If another CPU has invalidated
+//               translations of Pcid while this CPU was not using it all the
+//               translations cached with Pcid are invalidated.
 // Returns:      void
-// Parameter:    IN PHYSICAL_ADDRESS Pml4Base
+// Parameter:    IN PPAGING_DATA PagingData
 // Parameter:    IN PCID Pcid
-// Parameter:    IN BOOLEAN Invalidate - if TRUE invalidates CPU caching
-//               translations made with Pcid.
+// Parameter:    IN BOOLEAN Invalidate - if TRUE invalidates the translations
+//               cached with Pcid on all the CPUs.
 //******************************************************************************
 void
 VmmChangeCr3(
-    IN      PHYSICAL_ADDRESS        Pml4Base,
+    IN      PPAGING_DATA            PagingData,
     IN_RANGE(PCID_FIRST_VALID_VALUE, PCID_TOTAL_NO_OF_VALUES - 1)
             PCID                    Pcid,
     IN      BOOLEAN                 Invalidate
     );
 
+//******************************************************************************
+// Function:     VmmInvalidateAllTranslations
+// Description:  Invalidates all the translations cached by the current CPU,
+//               for all the PCIDs, including the global ones.
+// Returns:      void
+//******************************************************************************
+void
+VmmInvalidateAllTranslations(
+    void
+    );
+
 _No_competing_thread_
 void
 VmmInitReservationSystem(
@@ -167,7 +484,9 @@ VmmInitReservationSystem(
 // Parameter:    IN PAGE_RIGHTS Rights
 // Parameter:    IN BOOLEAN Uncacheable
 // Parameter:    IN_OPT PFILE_OBJECT FileObject -if non-NULL, represents the
-//               file which backs up the newly allocated memory.
+//               file which backs up the newly allocated memory. The file is
+//               not closed by the VMM, it must be kept open until the region
+//               is released.
 // Parameter:    IN_OPT PVMM_RESERVATION_SPACE VaSpace
 // Parameter:    IN_OPT PPAGING_LOCK_DATA PagingData
 // Parameter:    IN_OPT PMDL Mdl - if non-NULL, describes the physical memory
@@ -189,6 +508,33 @@ VmmAllocRegionEx(
     IN_OPT  PMDL                    Mdl
     );
 
+//******************************************************************************
+// Function:     VmmMapFileRegion
+// Description:  Reserves and commits a region lazily backed by FileSize bytes
+//               of FileObject starting at FileOffset. The pages are read from
+//               the disk (or taken from the page cache) on the first access.
+// Returns:      PVOID - Virtual address of the region
+// Parameter:    IN_OPT PVOID BaseAddress
+// Parameter:    IN QWORD Size
+// Parameter:    IN PAGE_RIGHTS Rights
+// Parameter:    IN PFILE_OBJECT FileObject - must be kept open until the
+//               region is released.
+// Parameter:    IN QWORD FileOffset - must be PAGE_SIZE aligned
+// Parameter:    IN_OPT PVMM_RESERVATION_SPACE VaSpace
+// Parameter:    IN_OPT PPAGING_LOCK_DATA PagingData
+//******************************************************************************
+PTR_SUCCESS
+PVOID
+VmmMapFileRegion(
+    IN_OPT  PVOID                   BaseAddress,
+    IN      QWORD                   Size,
+    IN      PAGE_RIGHTS             Rights,
+    IN      PFILE_OBJECT            FileObject,
+    IN      QWORD                   FileOffset,
+    IN_OPT  PVMM_RESERVATION_SPACE  VaSpace,
+    IN_OPT  PPAGING_LOCK_DATA       PagingData
+    );
+
 #define VmmFreeRegion(...)          VmmFreeRegionEx(__VA_ARGS__,TRUE, NULL, NULL)
 
 //******************************************************************************
@@ -269,13 +615,17 @@ VmmCreateVirtualAddressSpace(
 //******************************************************************************
 // Function:     VmmDestroyVirtualAddressSpace
 // Description:  Destroys a previously created VAS by VmmCreateVirtualAddressSpace
+//               releasing all the reservations still found in it.
 // Returns:      void
 // Parameter:    PVMM_RESERVATION_SPACE ReservationSpace
+// Parameter:    IN PPAGING_LOCK_DATA PagingData - the paging structures in
+//               which the reservations were mapped.
 //******************************************************************************
 void
 VmmDestroyVirtualAddressSpace(
     _Pre_valid_ _Post_ptr_invalid_
-            PVMM_RESERVATION_SPACE          ReservationSpace
+            PVMM_RESERVATION_SPACE          ReservationSpace,
+    IN      PPAGING_LOCK_DATA               PagingData
     );
 
 //******************************************************************************
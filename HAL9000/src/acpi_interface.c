@@ -40,6 +40,14 @@ typedef struct _ACPI_MCFG_ENTRY
     LIST_ENTRY                  ListEntry;
 } ACPI_MCFG_ENTRY, *PACPI_MCFG_ENTRY;
 
+// The SRAT subtables have different sizes => each entry holds a copy of the
+// whole subtable
+typedef struct _ACPI_SRAT_ENTRY
+{
+    LIST_ENTRY                  ListEntry;
+    ACPI_SUBTABLE_HEADER        Data;
+} ACPI_SRAT_ENTRY, *PACPI_SRAT_ENTRY;
+
 typedef struct _ACPI_PRT_ENTRY
 {
     ACPI_PCI_ROUTING_TABLE      Data;
@@ -54,7 +62,11 @@ typedef struct _ACPI_INTERFACE_DATA
     LIST_ENTRY                  IoApicList;
     LIST_ENTRY                  IntOverrideList;
     LIST_ENTRY                  McfgList;
+    LIST_ENTRY                  SratList;
     LIST_ENTRY                  PrtList;
+
+    // NULL if the firmware does not describe the distances between nodes
+    ACPI_TABLE_SLIT*            Slit;
 } ACPI_INTERFACE_DATA, *PACPI_INTERFACE_DATA;
 
 static ACPI_INTERFACE_DATA      m_acpiData;
@@ -71,6 +83,18 @@ _AcpiInterfaceParseMcfg(
     void
     );
 
+static
+STATUS
+_AcpiInterfaceParseSrat(
+    void
+    );
+
+static
+STATUS
+_AcpiInterfaceParseSlit(
+    void
+    );
+
 static
 STATUS
 _AcpiInterfaceParsePrts(
@@ -104,7 +128,10 @@ AcpiInterfacePreinit(
     InitializeListHead(&m_acpiData.IoApicList);
     InitializeListHead(&m_acpiData.IntOverrideList);
     InitializeListHead(&m_acpiData.McfgList);
+    InitializeListHead(&m_acpiData.SratList);
     InitializeListHead(&m_acpiData.PrtList);
+
+    m_acpiData.Slit = NULL;
 }
 
 SAL_SUCCESS
@@ -154,6 +181,39 @@ AcpiInterfaceInit(
         LOGL("Successfully parsed MCFG\n");
     }
 
+    // without a SRAT all the memory and all the CPUs belong to a single node
+    status = _AcpiInterfaceParseSrat();
+    if (!SUCCEEDED(status))
+    {
+        if (status != STATUS_DEVICE_DOES_NOT_EXIST)
+        {
+            LOG_FUNC_ERROR("_AcpiInterfaceParseSrat", status);
+            return status;
+        }
+
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        LOGL("Successfully parsed SRAT\n");
+
+        status = _AcpiInterfaceParseSlit();
+        if (!SUCCEEDED(status))
+        {
+            if (status != STATUS_DEVICE_DOES_NOT_EXIST)
+            {
+                LOG_FUNC_ERROR("_AcpiInterfaceParseSlit", status);
+                return status;
+            }
+
+            status = STATUS_SUCCESS;
+        }
+        else
+        {
+            LOGL("Successfully parsed SLIT\n");
+        }
+    }
+
 
     LOG_FUNC_END;
 
@@ -379,6 +439,76 @@ AcpiRetrieveNextMcfgEntry(
     return STATUS_SUCCESS;
 }
 
+SAL_SUCCESS
+STATUS
+AcpiRetrieveNextSratEntry(
+    IN      BOOLEAN                     RestartSearch,
+    OUT_PTR ACPI_SUBTABLE_HEADER**      AcpiEntry
+    )
+{
+    PACPI_SRAT_ENTRY pEntry;
+
+    static PLIST_ENTRY __pCurEntry = NULL;
+
+    if (NULL == AcpiEntry)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (RestartSearch)
+    {
+        __pCurEntry = m_acpiData.SratList.Flink;
+    }
+
+    if (__pCurEntry == &m_acpiData.SratList)
+    {
+        return STATUS_NO_MORE_OBJECTS;
+    }
+
+    pEntry = CONTAINING_RECORD(__pCurEntry, ACPI_SRAT_ENTRY, ListEntry);
+    __pCurEntry = __pCurEntry->Flink;
+
+    *AcpiEntry = &pEntry->Data;
+
+    return STATUS_SUCCESS;
+}
+
+SAL_SUCCESS
+STATUS
+AcpiRetrieveLocalityDistance(
+    IN      DWORD                       FromProximityDomain,
+    IN      DWORD                       ToProximityDomain,
+    OUT     BYTE*                       Distance
+    )
+{
+    QWORD noOfLocalities;
+
+    if (NULL == Distance)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (NULL == m_acpiData.Slit)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    noOfLocalities = m_acpiData.Slit->LocalityCount;
+    if (FromProximityDomain >= noOfLocalities)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (ToProximityDomain >= noOfLocalities)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    *Distance = m_acpiData.Slit->Entry[FromProximityDomain * noOfLocalities + ToProximityDomain];
+
+    return STATUS_SUCCESS;
+}
+
 SAL_SUCCESS
 STATUS
 AcpiRetrieveNextPrtEntry(
@@ -567,6 +697,110 @@ _AcpiInterfaceParseMcfg(
     return STATUS_SUCCESS;
 }
 
+static
+STATUS
+_AcpiInterfaceParseSrat(
+    void
+    )
+{
+    ACPI_TABLE_HEADER* table;
+    ACPI_STATUS acpiStatus;
+    DWORD actualTableLength;
+    DWORD offsetInTable;
+    ACPI_SUBTABLE_HEADER* pHeader;
+    PBYTE pData;
+
+    acpiStatus = AcpiGetTable(ACPI_SIG_SRAT, 1, &table);
+    if (AE_OK != acpiStatus)
+    {
+        LOG_TRACE_ACPI("AcpiGetTable failed with status 0x%x\n", acpiStatus);
+        return acpiStatus == AE_NOT_FOUND ? STATUS_DEVICE_DOES_NOT_EXIST : STATUS_UNSUCCESSFUL;
+    }
+
+    offsetInTable = 0;
+    actualTableLength = table->Length - sizeof(ACPI_TABLE_SRAT);
+    pData = (BYTE*)table + sizeof(ACPI_TABLE_SRAT);
+    while (offsetInTable < actualTableLength)
+    {
+        PACPI_SRAT_ENTRY pEntry;
+        DWORD entrySize;
+
+        pHeader = (ACPI_SUBTABLE_HEADER*)&(pData[offsetInTable]);
+        if (pHeader->Length < sizeof(ACPI_SUBTABLE_HEADER))
+        {
+            LOG_ERROR("SRAT subtable at offset 0x%x has an invalid length of 0x%x\n", offsetInTable, pHeader->Length);
+            return STATUS_UNSUCCESSFUL;
+        }
+
+        // only the CPU and memory affinities are of any use to us
+        if ((ACPI_SRAT_TYPE_CPU_AFFINITY == pHeader->Type)
+            || (ACPI_SRAT_TYPE_MEMORY_AFFINITY == pHeader->Type)
+            || (ACPI_SRAT_TYPE_X2APIC_CPU_AFFINITY == pHeader->Type))
+        {
+            entrySize = FIELD_OFFSET(ACPI_SRAT_ENTRY, Data) + pHeader->Length;
+
+            pEntry = ExAllocatePoolWithTag(PoolAllocateZeroMemory, entrySize, HEAP_ACPIIF_TAG, 0);
+            if (NULL == pEntry)
+            {
+                LOG_FUNC_ERROR_ALLOC("HeapAllocatePoolWithTag", entrySize);
+                return STATUS_HEAP_NO_MORE_MEMORY;
+            }
+
+            memcpy(&pEntry->Data, pHeader, pHeader->Length);
+
+            InsertTailList(&m_acpiData.SratList, &pEntry->ListEntry);
+        }
+
+        if (ACPI_SRAT_TYPE_MEMORY_AFFINITY == pHeader->Type)
+        {
+            ACPI_SRAT_MEM_AFFINITY* pMemory = (ACPI_SRAT_MEM_AFFINITY*)pHeader;
+
+            LOG("SRAT memory [0x%X, 0x%X) in domain %u, flags 0x%x\n",
+                pMemory->BaseAddress, pMemory->BaseAddress + pMemory->Length,
+                pMemory->ProximityDomain, pMemory->Flags);
+        }
+
+        offsetInTable = offsetInTable + pHeader->Length;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_AcpiInterfaceParseSlit(
+    void
+    )
+{
+    ACPI_TABLE_HEADER* table;
+    ACPI_STATUS acpiStatus;
+    ACPI_TABLE_SLIT* pSlit;
+
+    acpiStatus = AcpiGetTable(ACPI_SIG_SLIT, 1, &table);
+    if (AE_OK != acpiStatus)
+    {
+        LOG_TRACE_ACPI("AcpiGetTable failed with status 0x%x\n", acpiStatus);
+        return acpiStatus == AE_NOT_FOUND ? STATUS_DEVICE_DOES_NOT_EXIST : STATUS_UNSUCCESSFUL;
+    }
+
+    pSlit = (ACPI_TABLE_SLIT*)table;
+
+    // the matrix must fit in the table, else we'd better not use it at all
+    if ((pSlit->LocalityCount > MAX_BYTE)
+        || (FIELD_OFFSET(ACPI_TABLE_SLIT, Entry) + pSlit->LocalityCount * pSlit->LocalityCount > table->Length))
+    {
+        LOG_ERROR("SLIT describes %U localities in only 0x%x bytes\n", pSlit->LocalityCount, table->Length);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    LOG("SLIT describes %U localities\n", pSlit->LocalityCount);
+
+    // the tables remain mapped, there is no need to copy it
+    m_acpiData.Slit = pSlit;
+
+    return STATUS_SUCCESS;
+}
+
 static
 STATUS
 _AcpiInterfaceParsePrts(
@@ -5,6 +5,7 @@
 #include "print.h"
 #include "iomu.h"
 #include "test_common.h"
+#include "test_perf.h"
 #include "strutils.h"
 
 void
@@ -142,12 +143,67 @@ void
     TestRunAllFunctional();
 }
 
+static
+void
+_CmdPrintPerfTests(
+    void
+    )
+{
+    for (DWORD i = 0; i < PERF_TOTAL_NO_OF_TESTS; ++i)
+    {
+        printf("%s - %s\n", PERF_TESTS[i].TestName, PERF_TESTS[i].Description);
+    }
+}
+
 void
 (__cdecl CmdRunAllPerformanceTests)(
-    IN          QWORD       NumberOfParameters
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       TestName,
+    IN_Z        char*       IterationsString
     )
 {
-    ASSERT(NumberOfParameters == 0);
+    STATUS status;
+    DWORD iterations;
+
+    ASSERT(NumberOfParameters <= 2);
+
+    if (NumberOfParameters == 0)
+    {
+        TestRunAllPerformance();
+        return;
+    }
 
-    TestRunAllPerformance();
+    if (0 == stricmp(TestName, "list"))
+    {
+        _CmdPrintPerfTests();
+        return;
+    }
+
+    // 0 => each test uses its default number of iterations
+    iterations = 0;
+    if (NumberOfParameters >= 2)
+    {
+        atoi32(&iterations, IterationsString, BASE_TEN);
+    }
+
+    if (0 == stricmp(TestName, "all"))
+    {
+        TestPerfRunAll(iterations);
+        return;
+    }
+
+    status = TestPerfRun(TestName, iterations);
+    if (STATUS_ELEMENT_NOT_FOUND == status)
+    {
+        pwarn("Test [%s] does not exist. Try one of the following tests:\n", TestName);
+        _CmdPrintPerfTests();
+    }
+    else if (!SUCCEEDED(status))
+    {
+        perror("Test [%s] failed with status 0x%x\n", TestName, status);
+    }
+    else
+    {
+        printf("Finished running test [%s]\n", TestName);
+    }
 }
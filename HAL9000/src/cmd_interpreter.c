@@ -76,8 +76,20 @@ static const COMMAND_DEFINITION COMMANDS[] =
     { "proctest", "$TEST_NAME - runs a process test", CmdTestProcess, 1, 1},
 
     { "sysinfo", "Retrieves system information", CmdDisplaySysInfo, 0, 0},
+    { "meminfo", "Displays physical memory allocator statistics", CmdDisplayMemoryInfo, 0, 0},
+    { "zerobudget", "$BYTES_PER_TICK - limits the memory cleared by the zero worker in a timer tick"
+                    "\n\t0 removes the limit", CmdSetZeroBudget, 1, 1},
+    { "faultaround", "$PAGES - number of committed pages mapped together on a page fault"
+                     "\n\t1 maps only the faulting page", CmdSetFaultAround, 1, 1},
+    { "switchcost", "Measures the cost of refilling the kernel TLB entries after an address space switch",
+                    CmdMeasureSwitchCost, 0, 0},
     { "getidle", "Retrieves idle timeout", CmdGetIdle, 0, 0},
     { "setidle", "$PERIOD_IN_SECONDS - Sets idle timeout", CmdSetIdle, 1, 1},
+    { "profstart", "[$PERIOD_US] - starts sampling the code running on each CPU"
+                   "\n\tThe default period is 1000 us", CmdProfilerStart, 0, 1},
+    { "profstop", "Stops the sampling profiler", CmdProfilerStop, 0, 0},
+    { "profdump", "[$MAX_FUNCTIONS] - displays the functions in which the most samples were taken"
+                  "\n\tThe default is 20 functions", CmdProfilerDump, 0, 1},
 
     { "rdmsr", "0x$INDEX\n\t$INDEX is the MSR to read", CmdRdmsr, 1, 1},
     { "wrmsr", "0x$INDEX 0x$VALUE\n\t$INDEX is the MSR to write\n\t$VALUE is the value to place in the MSR", CmdWrmsr, 2, 2},
@@ -94,7 +106,11 @@ static const COMMAND_DEFINITION COMMANDS[] =
                     CmdChangeDevStatus, 3, 3},
 
     { "tests", "Runs functional tests", CmdRunAllFunctionalTests, 0, 0},
-    { "perf", "Runs performance tests", CmdRunAllPerformanceTests, 0, 0},
+    { "perf", "[list|all|$TEST] [$ITERATIONS] - runs performance tests"
+              "\n\tWithout parameters runs all the performance tests"
+              "\n\tlist displays the kernel microbenchmarks"
+              "\n\t$ITERATIONS overrides the default number of iterations of the microbenchmarks",
+              CmdRunAllPerformanceTests, 0, 2},
 
     { "recursion", "Generates an infinite recursion", CmdInfiniteRecursion, 0, 0},
     { "rtcfail", "Causes an RTC check stack to assert", CmdRtcFail, 0, 0},
@@ -8,12 +8,6 @@
 #include "strutils.h"
 #include "test_process.h"
 
-typedef struct _PROC_STAT_CTX
-{
-    PID             ProcessPid;
-    BOOLEAN         FoundProcess;
-} PROC_STAT_CTX, *PPROC_STAT_CTX;
-
 #pragma warning(push)
 
 // warning C4212: nonstandard extension used: function declaration used ellipsis
@@ -64,22 +58,22 @@ void
     IN      char*       PidString
     )
 {
-    PROC_STAT_CTX statCtx = { 0 };
-    STATUS status;
+    PPROCESS pProcess;
     PID pid;
 
     ASSERT(NumberOfParameters == 1);
     atoi64(&pid, PidString, BASE_HEXA);
 
-    statCtx.ProcessPid = pid;
-
-    status = ProcessExecuteForEachProcessEntry(_CmdProcessPrint, &statCtx);
-    ASSERT(SUCCEEDED(status));
-
-    if (!statCtx.FoundProcess)
+    pProcess = ProcessRetrieveById(pid);
+    if (pProcess == NULL)
     {
-        pwarn("Process with PID 0x%X does not exist!\n", statCtx.ProcessPid);
+        pwarn("Process with PID 0x%X does not exist!\n", pid);
+        return;
     }
+
+    DumpProcess(pProcess);
+
+    ProcessCloseHandle(pProcess);
 }
 
 void
@@ -115,33 +109,21 @@ STATUS
     )
 {
     PPROCESS pProcess;
+    DWORD cmdLineLength;
 
     ASSERT(NULL != ListEntry);
+    ASSERT(NULL == FunctionContext);
 
     pProcess = CONTAINING_RECORD(ListEntry, PROCESS, NextProcess);
 
-    if (FunctionContext == NULL)
-    {
-        DWORD cmdLineLength = strlen(pProcess->FullCommandLine);
-        ASSERT(cmdLineLength != INVALID_STRING_SIZE);
-
-        printf("%9x%c", pProcess->Id, '|');
-        printf("%9u%c", pProcess->NumberOfArguments, '|');
-        printf(cmdLineLength > 38 ? "%35S...%c" : "%38S%c", pProcess->FullCommandLine, '|');
-        printf("%8U%c", pProcess->NumberOfThreads, '|');
-        printf("%11U%c", pProcess->RefCnt.ReferenceCount, '|');
-    }
-    else
-    {
-        PPROC_STAT_CTX pCtx = (PPROC_STAT_CTX) FunctionContext;
+    cmdLineLength = strlen(pProcess->FullCommandLine);
+    ASSERT(cmdLineLength != INVALID_STRING_SIZE);
 
-        if (pCtx->ProcessPid == pProcess->Id)
-        {
-            pCtx->FoundProcess = TRUE;
-
-            DumpProcess(pProcess);
-        }
-    }
+    printf("%9x%c", pProcess->Id, '|');
+    printf("%9u%c", pProcess->NumberOfArguments, '|');
+    printf(cmdLineLength > 38 ? "%35S...%c" : "%38S%c", pProcess->FullCommandLine, '|');
+    printf("%8U%c", pProcess->NumberOfThreads, '|');
+    printf("%11U%c", pProcess->RefCnt.ReferenceCount, '|');
 
     return STATUS_SUCCESS;
 }
@@ -6,6 +6,17 @@
 #include "strutils.h"
 #include "keyboard.h"
 #include "acpi_interface.h"
+#include "smp.h"
+#include "cpumu.h"
+#include "pmm.h"
+#include "mmu.h"
+#include "vmm.h"
+#include "iomu.h"
+#include "perf_framework.h"
+#include "page_cache.h"
+#include "swap.h"
+#include "process_internal.h"
+#include "profiler.h"
 
 #pragma warning(push)
 
@@ -15,6 +26,18 @@
 // warning C4029: declared formal parameter list different from definition
 #pragma warning(disable:4029)
 
+#define SWITCH_COST_ITERATIONS          1000
+#define SWITCH_COST_PAGES_TOUCHED       64
+
+typedef struct _CMD_SWITCH_COST_CTX
+{
+    PBYTE               Buffer;
+    BOOLEAN             DropGlobalTranslations;
+} CMD_SWITCH_COST_CTX, *PCMD_SWITCH_COST_CTX;
+
+static FUNC_TestPerformance _CmdSwitchCostFunction;
+static FUNC_ListFunction _CmdProcessPagingMemoryPrint;
+
 void
 (__cdecl CmdDisplaySysInfo)(
     IN          QWORD       NumberOfParameters
@@ -39,6 +62,240 @@ void
     printf("Uptime: %u.%03u sec\n", uptimeInMs / 1000, uptimeInMs % 1000 );
 }
 
+void
+(__cdecl CmdDisplayMemoryInfo)(
+    IN          QWORD       NumberOfParameters
+    )
+{
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    QWORD sizeInKB;
+    PAGE_CACHE_STATISTICS cacheStats;
+    SWAP_STATISTICS swapStats;
+    VMM_RECLAIM_STATISTICS reclaimStats;
+    STATUS status;
+
+    ASSERT(NumberOfParameters == 0);
+
+    pCpuListHead = NULL;
+
+    sizeInKB = PmmGetTotalSystemMemory() / KB_SIZE;
+
+    printf("System memory: %U KB (%U MB)\n", sizeInKB, sizeInKB / KB_SIZE);
+    printf("Highest physical memory: 0x%X\n", PmmGetHighestPhysicalMemoryAddressPresent());
+    printf("Zeroed frames available: %u\n", MmuGetNumberOfZeroedFrames());
+
+    PageCacheGetStatistics(&cacheStats);
+    printf("Page cache: %u files (%u referenced), %U pages\n",
+           cacheStats.NumberOfFiles, cacheStats.NumberOfReferencedFiles, cacheStats.NumberOfPages);
+    printf("Page cache hits: %U, misses: %U, evicted pages: %U\n",
+           cacheStats.Hits, cacheStats.Misses, cacheStats.NumberOfEvictedPages);
+    printf("Copy-on-write faults: %U\n", VmmGetNumberOfCopyOnWriteFaults());
+
+    VmmGetReclaimStatistics(&reclaimStats);
+    printf("Pages swapped out: %U, swapped in: %U, discarded: %U\n",
+           reclaimStats.PagesSwappedOut, reclaimStats.PagesSwappedIn, reclaimStats.PagesDiscarded);
+    printf("Empty paging structures freed: %U\n", reclaimStats.PagingStructuresFreed);
+    if (SwapIsAvailable())
+    {
+        SwapGetStatistics(&swapStats);
+        printf("Swap slots: %U used out of %U, pages written: %U in %U writes, pages read: %U\n",
+               swapStats.NumberOfUsedSlots, swapStats.NumberOfSlots,
+               swapStats.PagesWritten, swapStats.NumberOfWrites, swapStats.PagesRead);
+        printf("Compressed pool: %U KB used out of %U KB, compressed pages: %U, zero pages: %U\n",
+               swapStats.CompressedPoolUsed / KB_SIZE, swapStats.CompressedPoolSize / KB_SIZE,
+               swapStats.NumberOfCompressedPages, swapStats.NumberOfZeroPages);
+    }
+
+    printf("\n");
+
+    printColor(MAGENTA_COLOR, "%6s", "Node|");
+    printColor(MAGENTA_COLOR, "%13s", "Total KB|");
+    printColor(MAGENTA_COLOR, "%13s", "Free KB|");
+    printColor(MAGENTA_COLOR, "%13s", "Used KB|");
+    printColor(MAGENTA_COLOR, "%s", " Distances");
+    printf("\n");
+
+    for (DWORD i = 0; i < NumaGetNumberOfNodes(); ++i)
+    {
+        PMM_NODE_STATISTICS nodeStats;
+
+        status = PmmGetNodeStatistics((NUMA_NODE) i, &nodeStats);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PmmGetNodeStatistics", status);
+            continue;
+        }
+
+        printf("%5u%c", i, '|');
+        printf("%12U%c", nodeStats.TotalFrames * PAGE_SIZE / KB_SIZE, '|');
+        printf("%12U%c", nodeStats.FreeFrames * PAGE_SIZE / KB_SIZE, '|');
+        printf("%12U%c", (nodeStats.TotalFrames - nodeStats.FreeFrames) * PAGE_SIZE / KB_SIZE, '|');
+        for (DWORD j = 0; j < NumaGetNumberOfNodes(); ++j)
+        {
+            printf(" %3u", NumaGetDistance((NUMA_NODE) i, (NUMA_NODE) j));
+        }
+        printf("\n");
+    }
+
+    SmpGetCpuList(&pCpuListHead);
+
+    printf("\n");
+
+    printColor(MAGENTA_COLOR, "%8s", "Apic ID|");
+    printColor(MAGENTA_COLOR, "%6s", "Node|");
+    printColor(MAGENTA_COLOR, "%7s", "Cached|");
+    printColor(MAGENTA_COLOR, "%13s", "Hits|");
+    printColor(MAGENTA_COLOR, "%13s", "Misses|");
+    printColor(MAGENTA_COLOR, "%7s", "%|");
+    printColor(MAGENTA_COLOR, "%10s", "Refills|");
+    printColor(MAGENTA_COLOR, "%10s", "Drains|");
+    printf("\n");
+
+    for (pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+        PPMM_CPU_CACHE pCache = &pCpu->FrameCache;
+        QWORD totalRequests = pCache->Hits + pCache->Misses;
+
+        // we can't do division by 0 => we only divide by totalRequests if the
+        // request count is different from 0
+        QWORD percentage = 0 != totalRequests ? (pCache->Hits * 10000) / totalRequests : 0;
+
+        printf("%7x%c", pCpu->ApicId, '|');
+        printf("%5u%c", pCpu->NumaNode, '|');
+        printf("%6u%c", pCache->NumberOfFrames, '|');
+        printf("%12U%c", pCache->Hits, '|');
+        printf("%12U%c", pCache->Misses, '|');
+        printf("%3d.%02d%c", percentage / 100, percentage % 100, '|');
+        printf("%9U%c", pCache->Refills, '|');
+        printf("%9U%c", pCache->Drains, '|');
+        printf("\n");
+    }
+
+    printf("\n");
+
+    printColor(MAGENTA_COLOR, "%8s", "Apic ID|");
+    printColor(MAGENTA_COLOR, "%10s", "Sent|");
+    printColor(MAGENTA_COLOR, "%10s", "Received|");
+    printColor(MAGENTA_COLOR, "%13s", "Pages|");
+    printColor(MAGENTA_COLOR, "%10s", "Flushes|");
+    printColor(MAGENTA_COLOR, "%10s", "Avg us|");
+    printColor(MAGENTA_COLOR, "%10s", "Max us|");
+    printf("\n");
+
+    for (pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+        PVMM_TLB_CPU_DATA pTlbData = &pCpu->TlbData;
+        QWORD averageTicks = 0 != pTlbData->ShootdownsSent ? pTlbData->RoundTripTicks / pTlbData->ShootdownsSent : 0;
+
+        printf("%7x%c", pCpu->ApicId, '|');
+        printf("%9U%c", pTlbData->ShootdownsSent, '|');
+        printf("%9U%c", pTlbData->ShootdownsReceived, '|');
+        printf("%12U%c", pTlbData->PagesInvalidated, '|');
+        printf("%9U%c", pTlbData->FullFlushes, '|');
+        printf("%9U%c", IomuTickCountToUs(averageTicks), '|');
+        printf("%9U%c", IomuTickCountToUs(pTlbData->MaxRoundTripTicks), '|');
+        printf("\n");
+    }
+
+    printf("\n");
+
+    printColor(MAGENTA_COLOR, "%10s", "PID|");
+    printColor(MAGENTA_COLOR, "%13s", "Paging KB|");
+    printColor(MAGENTA_COLOR, "%10s", "Pool KB|");
+    printColor(MAGENTA_COLOR, "%14s", "Reserved KB|");
+    printf("\n");
+
+    ProcessExecuteForEachProcessEntry(_CmdProcessPagingMemoryPrint, NULL);
+}
+
+void
+(__cdecl CmdSetZeroBudget)(
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       BytesString
+    )
+{
+    DWORD bytesPerTick;
+    DWORD previousBudget;
+
+    ASSERT(NumberOfParameters == 1);
+
+    atoi32(&bytesPerTick, BytesString, BASE_TEN);
+
+    previousBudget = MmuSetZeroWorkerBudget(bytesPerTick);
+    printf("Zero worker budget changed from %u to %u bytes per tick\n", previousBudget, bytesPerTick);
+}
+
+void
+(__cdecl CmdSetFaultAround)(
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       PagesString
+    )
+{
+    DWORD noOfPages;
+    DWORD previousPages;
+
+    ASSERT(NumberOfParameters == 1);
+
+    atoi32(&noOfPages, PagesString, BASE_TEN);
+
+    if (0 == noOfPages)
+    {
+        pwarn("The fault-around window must contain at least one page\n");
+        return;
+    }
+
+    previousPages = VmmSetFaultAroundPages(noOfPages);
+    printf("Fault-around window changed from %u to %u pages\n",
+           previousPages, min(noOfPages, VMM_MAX_FAULT_AROUND_PAGES));
+}
+
+void
+(__cdecl CmdMeasureSwitchCost)(
+    IN          QWORD       NumberOfParameters
+    )
+{
+    static char* STAT_NAMES[] = { "Non-global kernel mappings", "Global kernel mappings" };
+
+    CMD_SWITCH_COST_CTX ctx;
+    PERFORMANCE_STATS perfStats[ARRAYSIZE(STAT_NAMES)];
+
+    ASSERT(NumberOfParameters == 0);
+
+    ctx.Buffer = ExAllocatePoolWithTag(0, SWITCH_COST_PAGES_TOUCHED * PAGE_SIZE, HEAP_TEST_TAG, 0);
+    if (NULL == ctx.Buffer)
+    {
+        perror("Failed to allocate %u pages\n", SWITCH_COST_PAGES_TOUCHED);
+        return;
+    }
+
+    MmuProbeMemory(ctx.Buffer, SWITCH_COST_PAGES_TOUCHED * PAGE_SIZE);
+
+    // dropping every translation gives the cost paid by each switch before
+    // the kernel mappings were global
+    for (DWORD i = 0; i < ARRAYSIZE(STAT_NAMES); ++i)
+    {
+        ctx.DropGlobalTranslations = (0 == i);
+
+        RunPerformanceFunction(_CmdSwitchCostFunction,
+                               &ctx,
+                               SWITCH_COST_ITERATIONS,
+                               FALSE,
+                               &perfStats[i]);
+    }
+
+    printf("TLB refill cost for %u kernel pages after a CR3 switch (ticks)\n", SWITCH_COST_PAGES_TOUCHED);
+    DisplayPerformanceStats(perfStats, ARRAYSIZE(STAT_NAMES), STAT_NAMES);
+
+    ExFreePoolWithTag(ctx.Buffer, HEAP_TEST_TAG);
+}
+
 void
 (__cdecl CmdSetIdle)(
     IN          QWORD       NumberOfParameters,
@@ -94,4 +351,167 @@ void
     AcpiShutdown();
 }
 
+void
+(__cdecl CmdProfilerStart)(
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       PeriodString
+    )
+{
+    STATUS status;
+    DWORD periodUs;
+
+    ASSERT(NumberOfParameters <= 1);
+
+    periodUs = PROFILER_DEFAULT_PERIOD_US;
+    if (NumberOfParameters == 1)
+    {
+        atoi32(&periodUs, PeriodString, BASE_TEN);
+    }
+
+    if (periodUs < PROFILER_MIN_PERIOD_US || periodUs > PROFILER_MAX_PERIOD_US)
+    {
+        pwarn("The sampling period must be between %u and %u us\n",
+              PROFILER_MIN_PERIOD_US, PROFILER_MAX_PERIOD_US);
+        return;
+    }
+
+    status = ProfilerStart(periodUs);
+    if (STATUS_ALREADY_INITIALIZED == status)
+    {
+        pwarn("The profiler is already running\n");
+    }
+    else if (!SUCCEEDED(status))
+    {
+        perror("ProfilerStart failed with status 0x%x\n", status);
+    }
+}
+
+void
+(__cdecl CmdProfilerStop)(
+    IN          QWORD       NumberOfParameters
+    )
+{
+    STATUS status;
+
+    ASSERT(NumberOfParameters == 0);
+
+    status = ProfilerStop();
+    if (STATUS_NOT_INITIALIZED == status)
+    {
+        pwarn("The profiler is not running\n");
+    }
+    else if (!SUCCEEDED(status))
+    {
+        perror("ProfilerStop failed with status 0x%x\n", status);
+    }
+    else
+    {
+        printf("Profiler stopped, use profdump to display the samples\n");
+    }
+}
+
+void
+(__cdecl CmdProfilerDump)(
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       FunctionsString
+    )
+{
+    STATUS status;
+    DWORD noOfFunctions;
+
+    ASSERT(NumberOfParameters <= 1);
+
+    noOfFunctions = PROFILER_DEFAULT_FUNCTIONS;
+    if (NumberOfParameters == 1)
+    {
+        atoi32(&noOfFunctions, FunctionsString, BASE_TEN);
+    }
+
+    if (0 == noOfFunctions)
+    {
+        pwarn("At least one function must be displayed\n");
+        return;
+    }
+
+    status = ProfilerDump(noOfFunctions);
+    if (STATUS_DEVICE_BUSY == status)
+    {
+        pwarn("The profiler must be stopped before its samples are displayed\n");
+    }
+    else if (STATUS_NO_DATA_AVAILABLE == status)
+    {
+        pwarn("No samples were taken, use profstart and profstop first\n");
+    }
+    else if (!SUCCEEDED(status))
+    {
+        perror("ProfilerDump failed with status 0x%x\n", status);
+    }
+}
+
+static
+void
+(__cdecl _CmdSwitchCostFunction)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PCMD_SWITCH_COST_CTX pCtx;
+    INTR_STATE oldState;
+    volatile BYTE value;
+
+    ASSERT(NULL != Context);
+
+    pCtx = (PCMD_SWITCH_COST_CTX) Context;
+
+    oldState = CpuIntrDisable();
+
+    if (pCtx->DropGlobalTranslations)
+    {
+        VmmInvalidateAllTranslations();
+    }
+    else
+    {
+        // this is what a switch to a PCID which must be invalidated does
+        __writecr3(__readcr3());
+    }
+
+    for (DWORD i = 0; i < SWITCH_COST_PAGES_TOUCHED; ++i)
+    {
+        value = pCtx->Buffer[i * PAGE_SIZE];
+    }
+
+    CpuIntrSetState(oldState);
+}
+
+static
+STATUS
+(__cdecl _CmdProcessPagingMemoryPrint)(
+    IN      PLIST_ENTRY     ListEntry,
+    IN_OPT  PVOID           FunctionContext
+    )
+{
+    PPROCESS pProcess;
+    VMM_PAGING_STRUCTURES_STATISTICS stats;
+
+    ASSERT(NULL != ListEntry);
+    ASSERT(NULL == FunctionContext);
+
+    pProcess = CONTAINING_RECORD(ListEntry, PROCESS, NextProcess);
+
+    // the process is still being created or is being destroyed
+    if (NULL == pProcess->PagingData)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    VmmGetPagingStructuresStatistics(&pProcess->PagingData->Data, &stats);
+
+    printf("%9x%c", pProcess->Id, '|');
+    printf("%12U%c", (QWORD) stats.FramesInUse * PAGE_SIZE / KB_SIZE, '|');
+    printf("%9U%c", (QWORD) stats.FramesInPool * PAGE_SIZE / KB_SIZE, '|');
+    printf("%13U%c", (QWORD) stats.NumberOfFrames * PAGE_SIZE / KB_SIZE, '|');
+    printf("\n");
+
+    return STATUS_SUCCESS;
+}
+
 #pragma warning(pop)
@@ -0,0 +1,276 @@
+#include "HAL9000.h"
+#include "conc_hash_table.h"
+
+#define IS_POWER_OF_2(x)                (((x) != 0) && (((x) & ((x) - 1)) == 0))
+
+// 2^64 / golden ratio, multiplying by it spreads keys which follow a pattern
+// (TIDs are multiples of 4) over all the buckets
+#define CONC_HASH_MULTIPLIER            0x9E3779B97F4A7C15ULL
+
+__forceinline
+static
+DWORD
+_ConcHashTableBucketIndex(
+    IN      PCONC_HASH_TABLE        HashTable,
+    IN      QWORD                   Key
+    )
+{
+    // the high bits of the product are the best mixed
+    return (DWORD) ((Key * CONC_HASH_MULTIPLIER) >> 32) & (HashTable->NumberOfBuckets - 1);
+}
+
+__forceinline
+static
+QWORD
+_ConcHashTableObtainKey(
+    IN      PCONC_HASH_TABLE        HashTable,
+    IN      PCONC_HASH_ENTRY        Element
+    )
+{
+    return *(PQWORD) ((PBYTE)Element + HashTable->OffsetToKey);
+}
+
+__forceinline
+static
+PLOCK
+_ConcHashTableBucketLock(
+    IN      PCONC_HASH_TABLE        HashTable,
+    IN      DWORD                   BucketIndex
+    )
+{
+    return &HashTable->Locks[BucketIndex & (HashTable->NumberOfLocks - 1)];
+}
+
+static
+void
+_ConcHashTableWaitForReaders(
+    INOUT   PCONC_HASH_TABLE        HashTable
+    )
+{
+    INTR_STATE oldState;
+
+    LockAcquire(&HashTable->PhaseLock, &oldState);
+
+    // A reader may have read the phase just before it was flipped and
+    // incremented the counter of the old phase after it drained => it is
+    // waited for on the second flip. Any reader which still sees the removed
+    // element incremented a counter before the unlink, so it is waited for
+    // on one of the two flips.
+    for (DWORD i = 0; i < ARRAYSIZE(HashTable->ActiveReaders); ++i)
+    {
+        DWORD phase = HashTable->ReaderPhase;
+
+        _InterlockedExchange(&HashTable->ReaderPhase, phase ^ 1);
+
+        while (HashTable->ActiveReaders[phase] != 0)
+        {
+            _mm_pause();
+        }
+    }
+
+    LockRelease(&HashTable->PhaseLock, oldState);
+}
+
+SAL_SUCCESS
+STATUS
+ConcHashTableInit(
+    OUT                         PCONC_HASH_TABLE        HashTable,
+    OUT_WRITES(NumberOfBuckets) PCONC_HASH_ENTRY*       Buckets,
+    IN                          DWORD                   NumberOfBuckets,
+    OUT_WRITES(NumberOfLocks)   PLOCK                   Locks,
+    IN                          DWORD                   NumberOfLocks,
+    IN                          INT32                   OffsetToKey
+    )
+{
+    if (HashTable == NULL)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (Buckets == NULL)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (!IS_POWER_OF_2(NumberOfBuckets))
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (Locks == NULL)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (!IS_POWER_OF_2(NumberOfLocks) || NumberOfLocks > NumberOfBuckets)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    memzero(HashTable, sizeof(CONC_HASH_TABLE));
+    memzero(Buckets, NumberOfBuckets * sizeof(PCONC_HASH_ENTRY));
+
+    for (DWORD i = 0; i < NumberOfLocks; ++i)
+    {
+        LockInit(&Locks[i]);
+    }
+
+    LockInit(&HashTable->PhaseLock);
+
+    HashTable->OffsetToKey = OffsetToKey;
+    HashTable->NumberOfBuckets = NumberOfBuckets;
+    HashTable->NumberOfLocks = NumberOfLocks;
+    HashTable->Buckets = Buckets;
+    HashTable->Locks = Locks;
+
+    return STATUS_SUCCESS;
+}
+
+DWORD
+ConcHashTableSize(
+    IN      PCONC_HASH_TABLE        HashTable
+    )
+{
+    ASSERT(HashTable != NULL);
+
+    return HashTable->NumberOfElements;
+}
+
+SAL_SUCCESS
+STATUS
+ConcHashTableInsert(
+    INOUT   PCONC_HASH_TABLE        HashTable,
+    INOUT   PCONC_HASH_ENTRY        Element
+    )
+{
+    QWORD key;
+    PCONC_HASH_ENTRY pEntry;
+    PLOCK pLock;
+    INTR_STATE oldState;
+    DWORD index;
+    STATUS status;
+
+    ASSERT(HashTable != NULL);
+    ASSERT(Element != NULL);
+
+    key = _ConcHashTableObtainKey(HashTable, Element);
+    index = _ConcHashTableBucketIndex(HashTable, key);
+    pLock = _ConcHashTableBucketLock(HashTable, index);
+    status = STATUS_SUCCESS;
+
+    LockAcquire(pLock, &oldState);
+
+    for (pEntry = HashTable->Buckets[index]; pEntry != NULL; pEntry = pEntry->Next)
+    {
+        if (_ConcHashTableObtainKey(HashTable, pEntry) == key)
+        {
+            status = STATUS_ELEMENT_FOUND;
+            break;
+        }
+    }
+
+    if (SUCCEEDED(status))
+    {
+        // the element must be complete before it is published, x64 does not
+        // reorder stores and volatile stores are not reordered by the compiler
+        Element->Next = HashTable->Buckets[index];
+        HashTable->Buckets[index] = Element;
+
+        _InterlockedIncrement(&HashTable->NumberOfElements);
+    }
+
+    LockRelease(pLock, oldState);
+
+    return status;
+}
+
+BOOLEAN
+ConcHashTableRemoveEntry(
+    INOUT   PCONC_HASH_TABLE        HashTable,
+    IN      PCONC_HASH_ENTRY        Element
+    )
+{
+    PCONC_HASH_ENTRY volatile* ppLink;
+    PLOCK pLock;
+    INTR_STATE oldState;
+    DWORD index;
+    BOOLEAN bFound;
+
+    ASSERT(HashTable != NULL);
+    ASSERT(Element != NULL);
+
+    index = _ConcHashTableBucketIndex(HashTable, _ConcHashTableObtainKey(HashTable, Element));
+    pLock = _ConcHashTableBucketLock(HashTable, index);
+    bFound = FALSE;
+
+    LockAcquire(pLock, &oldState);
+
+    for (ppLink = &HashTable->Buckets[index]; *ppLink != NULL; ppLink = &(*ppLink)->Next)
+    {
+        if (*ppLink == Element)
+        {
+            // Element->Next stays valid for the readers currently on Element
+            *ppLink = Element->Next;
+            bFound = TRUE;
+            break;
+        }
+    }
+
+    if (bFound)
+    {
+        _InterlockedDecrement(&HashTable->NumberOfElements);
+    }
+
+    LockRelease(pLock, oldState);
+
+    if (bFound)
+    {
+        _ConcHashTableWaitForReaders(HashTable);
+    }
+
+    return bFound;
+}
+
+PTR_SUCCESS
+PCONC_HASH_ENTRY
+ConcHashTableLookup(
+    IN      PCONC_HASH_TABLE                    HashTable,
+    IN      QWORD                               Key,
+    IN_OPT  PFUNC_ConcHashReferenceFunction     ReferenceFunction
+    )
+{
+    PCONC_HASH_ENTRY pEntry;
+    INTR_STATE oldState;
+    DWORD phase;
+    DWORD index;
+
+    ASSERT(HashTable != NULL);
+
+    index = _ConcHashTableBucketIndex(HashTable, Key);
+
+    // a reader is never preempted => removals wait for it only for the
+    // duration of the bucket walk
+    oldState = CpuIntrDisable();
+
+    phase = HashTable->ReaderPhase;
+    _InterlockedIncrement(&HashTable->ActiveReaders[phase]);
+
+    for (pEntry = HashTable->Buckets[index]; pEntry != NULL; pEntry = pEntry->Next)
+    {
+        if (_ConcHashTableObtainKey(HashTable, pEntry) == Key)
+        {
+            break;
+        }
+    }
+
+    if (pEntry != NULL && ReferenceFunction != NULL && !ReferenceFunction(pEntry))
+    {
+        pEntry = NULL;
+    }
+
+    _InterlockedDecrement(&HashTable->ActiveReaders[phase]);
+
+    CpuIntrSetState(oldState);
+
+    return pEntry;
+}
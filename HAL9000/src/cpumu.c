@@ -50,6 +50,10 @@ _CpuActivateAvailableFeatures(
     // CR4
     cr4FlagsToActivate |= ((m_cpuMuData.StructuredExtendedFeatures.ebx.SMEP) ? CR4_SMEP : 0);
 
+    // the kernel mappings are marked global => their translations are shared by
+    // all the PCIDs and are not dropped on CR3 switches
+    cr4FlagsToActivate |= ((m_cpuMuData.FeatureInformation.edx.PGE) ? CR4_PGE : 0);
+
     __writecr4(__readcr4() | cr4FlagsToActivate);
 
     LOGL("CR4 is 0x%X\n", __readcr4());
@@ -153,6 +157,22 @@ CpuMuSetMonitorFilterSize(
     return STATUS_SUCCESS;
 }
 
+BOOLEAN
+CpuMuIsEnhancedFastStringSupported(
+    void
+    )
+{
+    return (BOOLEAN) m_cpuMuData.StructuredExtendedFeatures.ebx.EnhancedRepMovsb;
+}
+
+BOOLEAN
+CpuMuIsInvpcidSupported(
+    void
+    )
+{
+    return (BOOLEAN) m_cpuMuData.StructuredExtendedFeatures.ebx.INVPCID;
+}
+
 STATUS
 CpuMuAllocAndInitCpu(
     OUT_PTR     PPCPU*      PhysicalCpu,
@@ -221,8 +241,9 @@ CpuMuAllocCpu(
 
     pPcpu->ApicId = ApicId;
     pPcpu->LogicalApicId = ( 1U << ApicId );
+    pPcpu->NumaNode = NumaGetNodeOfCpu(ApicId);
 
-    LOG("APIC ID: 0x%02x, logical ID: 0x%02x\n", pPcpu->ApicId, pPcpu->LogicalApicId );
+    LOG("APIC ID: 0x%02x, logical ID: 0x%02x, NUMA node: %u\n", pPcpu->ApicId, pPcpu->LogicalApicId, pPcpu->NumaNode );
 
     pPcpu->StackTop = MmuAllocStack(StackSize, TRUE, FALSE, NULL);
     if (NULL == pPcpu->StackTop)
@@ -254,6 +275,27 @@ CpuMuAllocCpu(
     LockInit(&pPcpu->EventListLock);
     pPcpu->NoOfEventsInList = 0;
 
+    PmmInitCpuCache(&pPcpu->FrameCache);
+
+    VmmInitCpuTlbData(&pPcpu->TlbData);
+
+    // only the VA range is reserved, the frames are mapped directly in the
+    // paging structures when needed
+    pPcpu->MappingWindow = VmmAllocRegionEx(NULL,
+                                            MMU_CPU_WINDOW_FRAMES * PAGE_SIZE,
+                                            VMM_ALLOC_TYPE_RESERVE,
+                                            PAGE_RIGHTS_READWRITE,
+                                            FALSE,
+                                            NULL,
+                                            NULL,
+                                            NULL,
+                                            NULL);
+    if (NULL == pPcpu->MappingWindow)
+    {
+        LOG_FUNC_ERROR_ALLOC("VmmAllocRegionEx", MMU_CPU_WINDOW_FRAMES * PAGE_SIZE);
+        return STATUS_MEMORY_CANNOT_BE_RESERVED;
+    }
+
     *PhysicalCpu = pPcpu;
 
     LOG_FUNC_END;
@@ -11,6 +11,7 @@
 #include "ata.h"
 #include "filesystem.h"
 #include "fat32.h"
+#include "swapfs.h"
 #include "lapic_system.h"
 #include "dmp_io.h"
 #include "isr.h"
@@ -112,6 +113,7 @@ static const DRIVER_DECLARATION DRIVER_NAMES[] = {
     DECLARE_DRIVER("disk", DiskDriverEntry, FALSE),
     DECLARE_DRIVER("vol", VolDriverEntry, FALSE),
     DECLARE_DRIVER("fat", FatDriverEntry, FALSE),
+    DECLARE_DRIVER("swapfs", SwapFsDriverEntry, FALSE),
     DECLARE_DRIVER("eth82574L", Eth82574LDriverEntry, FALSE)
 };
 
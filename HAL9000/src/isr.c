@@ -8,6 +8,7 @@
 #include "cpumu.h"
 #include "dmp_cpu.h"
 #include "process.h"
+#include "profiler.h"
 
 #define UNDEFINED_INTERRUPT_TEXT                "UNKNOWN INTERRUPT"
 #define STACK_BYTES_TO_DUMP_ON_EXCEPTION        0x100
@@ -75,6 +76,9 @@ IsrCommonHandler(
     }
     else
     {
+        // the sample must be taken before the handler may switch the thread
+        ProfilerRecordSample(InterruptIndex, StackPointer, ProcessorState);
+
         _IsrInterruptHandler(InterruptIndex);
     }
 }
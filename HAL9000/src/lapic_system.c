@@ -201,6 +201,17 @@ LapicSystemEnableTimer(
     LapicEnableTimer(m_apicData.LocalApicAddress, timerCount );
 }
 
+void
+LapicSystemDisableTimer(
+    void
+    )
+{
+    ASSERT( NULL != m_apicData.LocalApicAddress );
+
+    // an initial count of 0 stops the timer even in periodic mode
+    LapicEnableTimer(m_apicData.LocalApicAddress, 0 );
+}
+
 void
 LapicSystemSendIpi(
     _When_(ApicDestinationShorthandNone == DeliveryMode, IN)
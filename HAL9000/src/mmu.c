@@ -15,6 +15,9 @@
 #include "thread_internal.h"
 #include "io.h"
 #include "mdl.h"
+#include "iomu.h"
+#include "ex_timer.h"
+#include "vm_reservation_space.h"
 
 #define PAGING_STRUCTURES_BASE_MEMORY                           (128*KB_SIZE)
 
@@ -29,6 +32,20 @@
 #define HEAP_SPECIAL_BASE_MEMORY                                (128 * KB_SIZE)
 #define HEAP_SPECIAL_PERCENTAGE                                 25
 
+// Maximum number of zeroed frames kept by the zero worker thread
+#define MMU_ZERO_POOL_CAPACITY                                  512
+
+// When the number of zeroed frames drops below the low watermark the zero
+// worker is woken up to bring it back to the high watermark
+#define MMU_ZERO_POOL_LOW_WATERMARK                             128
+#define MMU_ZERO_POOL_HIGH_WATERMARK                            384
+
+// Number of frames the zero worker can map at once in its mapping window
+#define MMU_ZERO_WINDOW_FRAMES                                  16
+
+// Default number of bytes the zero worker may clear in a scheduler tick
+#define MMU_ZERO_WORKER_DEFAULT_BYTES_PER_TICK                  (4 * MB_SIZE)
+
 #define TEMP_STACK_SIZE                                         (2*PAGE_SIZE)
 
 #define VA_METADATA_SIZE_FOR_UM_PROCESS                         (5*GB_SIZE)
@@ -88,6 +105,29 @@ typedef struct _MMU_ZERO_THREAD_DATA
     EX_EVENT                        NewPagesEvent;
     LOCK                            PagesLock;
     LIST_ENTRY                      PagesToZeroList;
+
+    // Frames which are known to contain only zeroes, these are handed out to
+    // page faults so they don't have to clear the memory themselves
+    LOCK                            ZeroedFramesLock;
+
+    _Guarded_by_(ZeroedFramesLock)
+    DWORD                           NumberOfZeroedFrames;
+
+    _Guarded_by_(ZeroedFramesLock)
+    PHYSICAL_ADDRESS                ZeroedFrames[MMU_ZERO_POOL_CAPACITY];
+
+    // Virtual range reserved once in which the worker maps the frames it zeroes,
+    // this is used only by the worker thread
+    PVOID                           MappingWindow;
+
+    // Rate limiting of the worker, 0 means unlimited
+    volatile DWORD                  BytesPerTick;
+    QWORD                           CurrentTickStartUs;
+    DWORD                           BytesZeroedInTick;
+
+    // Set if REP STOSB is the preferred way for clearing memory, else we use
+    // non-temporal stores
+    BOOLEAN                         UseFastStrings;
 } MMU_ZERO_THREAD_DATA, *PMMU_ZERO_THREAD_DATA;
 
 typedef struct _MMU_HEAP_DATA
@@ -153,14 +193,73 @@ _MmuMapKernelMemory(
     IN          PPE_NT_HEADER_INFO      KernelInfo
     );
 
+//******************************************************************************
+// Function:     _MmuMapPeInMemory
+// Description:  Maps the headers and the sections of an image already present
+//               in memory at HeaderInfo->ImageBase.
+// Returns:      STATUS
+// Parameter:    IN PPAGING_DATA PagingData
+// Parameter:    IN PPE_NT_HEADER_INFO HeaderInfo
+// Parameter:    IN PVOID AddressToMap
+// Parameter:    IN BOOLEAN SharedFrames - TRUE if the frames of the image belong
+//               to the page cache, the writable sections are copied on write.
+//******************************************************************************
 static
 STATUS
 _MmuMapPeInMemory(
     IN          PPAGING_DATA            PagingData,
     IN          PPE_NT_HEADER_INFO      HeaderInfo,
-    IN          PVOID                   AddressToMap
+    IN          PVOID                   AddressToMap,
+    IN          BOOLEAN                 SharedFrames
+    );
+
+//******************************************************************************
+// Function:     _MmuMapPeSectionsFromFile
+// Description:  Creates a lazily mapped region for the headers and for each
+//               section of the image at its preferred address. Nothing is read
+//               from the disk here, the pages are brought in on the first
+//               access and the part of a section past its raw data is backed
+//               by zeroed frames.
+// Returns:      STATUS
+// Parameter:    IN PPE_NT_HEADER_INFO HeaderInfo
+// Parameter:    IN PFILE_OBJECT ImageFile
+// Parameter:    IN PVMM_RESERVATION_SPACE VaSpace
+// Parameter:    IN PPAGING_LOCK_DATA PagingData
+// NOTE:         The file and section alignments must be multiples of PAGE_SIZE.
+//               On failure the regions already created are released together
+//               with the address space.
+//******************************************************************************
+static
+SAL_SUCCESS
+STATUS
+_MmuMapPeSectionsFromFile(
+    IN          PPE_NT_HEADER_INFO      HeaderInfo,
+    IN          PFILE_OBJECT            ImageFile,
+    IN          PVMM_RESERVATION_SPACE  VaSpace,
+    IN          PPAGING_LOCK_DATA       PagingData
     );
 
+__forceinline
+static
+void
+_MmuMapPePage(
+    IN          PPAGING_DATA            PagingData,
+    IN          PHYSICAL_ADDRESS        PhysicalAddress,
+    IN          PVOID                   VirtualAddress,
+    IN          PAGE_RIGHTS             PageRights,
+    IN          BOOLEAN                 SharedFrames
+    )
+{
+    if (SharedFrames)
+    {
+        VmmMapSharedMemory(PagingData, PhysicalAddress, PAGE_SIZE, VirtualAddress, PageRights, TRUE, FALSE);
+    }
+    else
+    {
+        VmmMapMemoryInternal(PagingData, PhysicalAddress, PAGE_SIZE, VirtualAddress, PageRights, TRUE, FALSE);
+    }
+}
+
 static
 SAL_SUCCESS
 STATUS
@@ -224,6 +323,55 @@ _MmuDestroyPagingTables(
 
 static FUNC_ThreadStart                 _MmuZeroWorkerThreadFunction;
 
+static
+DWORD
+_MmuZeroPoolInsertFrames(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr,
+    IN          DWORD                   NoOfFrames
+    );
+
+static
+void
+_MmuZeroPoolRefill(
+    void
+    );
+
+static
+void
+_MmuZeroWorkerChargeBudget(
+    IN          DWORD                   NoOfBytes
+    );
+
+static
+void
+_MmuZeroWorkerClearFrames(
+    IN_READS(NoOfFrames)
+                PHYSICAL_ADDRESS*       Frames,
+    IN          DWORD                   NoOfFrames
+    );
+
+static
+void
+_MmuZeroWorkerClearRange(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr,
+    IN          DWORD                   NoOfFrames
+    );
+
+static
+void
+_MmuUnmapLocalWindow(
+    IN          PVOID                   Window,
+    IN          DWORD                   Size
+    );
+
+static
+void
+_MmuClearPages(
+    OUT_WRITES_BYTES_ALL(Size)
+                PVOID                   Address,
+    IN          DWORD                   Size
+    );
+
 __forceinline
 static
 DWORD
@@ -253,6 +401,8 @@ MmuPreinitSystem(
 
     InitializeListHead(&m_mmuData.ZeroThreadData.PagesToZeroList);
     LockInit(&m_mmuData.ZeroThreadData.PagesLock);
+    LockInit(&m_mmuData.ZeroThreadData.ZeroedFramesLock);
+    m_mmuData.ZeroThreadData.BytesPerTick = MMU_ZERO_WORKER_DEFAULT_BYTES_PER_TICK;
     DWORD z = *((PBYTE)NULL);z;
 
     PmmPreinitSystem();
@@ -519,8 +669,28 @@ MmuInitThreadingSystem(
     pCtx->PagesToZeroList = &m_mmuData.ZeroThreadData.PagesToZeroList;
     pCtx->PagesLock = &m_mmuData.ZeroThreadData.PagesLock;
 
+    m_mmuData.ZeroThreadData.UseFastStrings = CpuMuIsEnhancedFastStringSupported();
+
     __try
     {
+        // only the VA range is reserved, the worker maps the frames it zeroes
+        // directly in the paging structures
+        m_mmuData.ZeroThreadData.MappingWindow = VmmAllocRegionEx(NULL,
+                                                                  MMU_ZERO_WINDOW_FRAMES * PAGE_SIZE,
+                                                                  VMM_ALLOC_TYPE_RESERVE,
+                                                                  PAGE_RIGHTS_READWRITE,
+                                                                  FALSE,
+                                                                  NULL,
+                                                                  NULL,
+                                                                  NULL,
+                                                                  NULL);
+        if (NULL == m_mmuData.ZeroThreadData.MappingWindow)
+        {
+            LOG_FUNC_ERROR_ALLOC("VmmAllocRegionEx", MMU_ZERO_WINDOW_FRAMES * PAGE_SIZE);
+            status = STATUS_MEMORY_CANNOT_BE_RESERVED;
+            __leave;
+        }
+
         status = ThreadCreate("Page Zeroer Thread",
                               ThreadPriorityLowest,
                               _MmuZeroWorkerThreadFunction,
@@ -544,6 +714,17 @@ MmuInitThreadingSystem(
             pCtx = NULL;
         }
 
+        if (!SUCCEEDED(status) && (NULL != m_mmuData.ZeroThreadData.MappingWindow))
+        {
+            VmmFreeRegionEx(m_mmuData.ZeroThreadData.MappingWindow,
+                            0,
+                            VMM_FREE_TYPE_RELEASE,
+                            FALSE,
+                            NULL,
+                            NULL);
+            m_mmuData.ZeroThreadData.MappingWindow = NULL;
+        }
+
         LOG_FUNC_END;
     }
 
@@ -623,6 +804,36 @@ MmuMapMemoryEx(
     return PtrOffset(pCurPointer,alignmentDifferences);
 }
 
+PTR_SUCCESS
+PVOID
+MmuMapSystemFrames(
+    IN_READS(NoOfFrames)
+            PHYSICAL_ADDRESS*       Frames,
+    IN      DWORD                   NoOfFrames
+    )
+{
+    PVOID pMapping;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Frames);
+    ASSERT(0 != NoOfFrames);
+
+    RecRwSpinlockAcquireExclusive(&m_mmuData.PagingData.Lock, &oldState);
+    pMapping = VmmMapFramesEx(&m_mmuData.PagingData.Data,
+                              Frames,
+                              NoOfFrames,
+                              PAGE_RIGHTS_READWRITE
+                              );
+    RecRwSpinlockReleaseExclusive(&m_mmuData.PagingData.Lock, oldState);
+    if (NULL == pMapping)
+    {
+        LOG_ERROR("VmmMapFramesEx failed!\n");
+        return NULL;
+    }
+
+    return pMapping;
+}
+
 void
 MmuMapMemoryInternal(
     IN      PHYSICAL_ADDRESS        PhysicalAddress,
@@ -657,6 +868,38 @@ MmuMapMemoryInternal(
     RecRwSpinlockReleaseExclusive(&pPagingData->Lock, oldState);
 }
 
+void
+MmuMapAnonymousMemory(
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      QWORD                   Size,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      PVOID                   VirtualAddress,
+    IN      BOOLEAN                 Uncacheable,
+    IN_OPT  PPAGING_LOCK_DATA       PagingData
+    )
+{
+    INTR_STATE oldState;
+    PPAGING_LOCK_DATA pPagingData;
+
+    ASSERT( 0 != Size );
+    ASSERT( IsAddressAligned(Size, PAGE_SIZE));
+
+    ASSERT( NULL != VirtualAddress );
+    ASSERT( IsAddressAligned(VirtualAddress, PAGE_SIZE));
+
+    pPagingData = (PagingData == NULL) ? &m_mmuData.PagingData : PagingData;
+
+    RecRwSpinlockAcquireExclusive(&pPagingData->Lock, &oldState );
+    VmmMapAnonymousMemory(&pPagingData->Data,
+                          PhysicalAddress,
+                          Size,
+                          VirtualAddress,
+                          PageRights,
+                          Uncacheable
+                          );
+    RecRwSpinlockReleaseExclusive(&pPagingData->Lock, oldState);
+}
+
 void
 MmuUnmapMemoryEx(
     IN      PVOID                   VirtualAddress,
@@ -668,9 +911,11 @@ MmuUnmapMemoryEx(
     QWORD alignedVirtualAddress;
     DWORD alignmentDifferences;
     DWORD alignedSize;
-    PML4 cr3;
+    QWORD offset;
+    QWORD bytesUnmapped;
     INTR_STATE oldState;
     PPAGING_LOCK_DATA pPagingData;
+    VMM_UNMAP_BATCH batch;
 
     ASSERT(VirtualAddress != NULL);
     ASSERT(Size != 0);
@@ -681,14 +926,72 @@ MmuUnmapMemoryEx(
     alignmentDifferences = (DWORD)((QWORD)VirtualAddress - alignedVirtualAddress);
     alignedSize = AlignAddressUpper(Size + alignmentDifferences, PAGE_SIZE);
 
-    RecRwSpinlockAcquireExclusive(&pPagingData->Lock, &oldState);
-    cr3.Raw = (QWORD) pPagingData->Data.BasePhysicalAddress;
-    VmmUnmapMemoryEx(cr3,
-                    (PVOID) alignedVirtualAddress,
-                     alignedSize,
-                     ReleaseMemory
-                    );
-    RecRwSpinlockReleaseExclusive(&pPagingData->Lock, oldState);
+    VmmInitUnmapBatch(&batch, &pPagingData->Data);
+
+    for (offset = 0;
+         offset < alignedSize;
+         offset = offset + bytesUnmapped)
+    {
+        RecRwSpinlockAcquireExclusive(&pPagingData->Lock, &oldState);
+        bytesUnmapped = VmmUnmapMemoryEx(&pPagingData->Data,
+                                         (PVOID) (alignedVirtualAddress + offset),
+                                         alignedSize - offset,
+                                         ReleaseMemory,
+                                         &batch
+                                         );
+        RecRwSpinlockReleaseExclusive(&pPagingData->Lock, oldState);
+
+        ASSERT(0 != bytesUnmapped);
+
+        // the other CPUs are notified only after the lock is released, CPUs
+        // spinning on it with the interrupts disabled can't acknowledge IPIs
+        VmmFlushUnmapBatch(&batch, FALSE);
+    }
+}
+
+PVOID
+MmuMapFramesOnCurrentCpu(
+    IN_READS(NoOfFrames)
+            PHYSICAL_ADDRESS*       Frames,
+    IN      DWORD                   NoOfFrames
+    )
+{
+    PPCPU pCpu;
+    DWORD i;
+
+    ASSERT(NULL != Frames);
+    ASSERT(0 != NoOfFrames && NoOfFrames <= MMU_CPU_WINDOW_FRAMES);
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pCpu = GetCurrentPcpu();
+    ASSERT(NULL != pCpu && NULL != pCpu->MappingWindow);
+
+    for (i = 0; i < NoOfFrames; ++i)
+    {
+        MmuMapMemoryInternal(Frames[i],
+                             PAGE_SIZE,
+                             PAGE_RIGHTS_READWRITE,
+                             PtrOffset(pCpu->MappingWindow, (QWORD) i * PAGE_SIZE),
+                             TRUE,
+                             FALSE,
+                             NULL
+                             );
+    }
+
+    return pCpu->MappingWindow;
+}
+
+void
+MmuUnmapFramesOnCurrentCpu(
+    IN      PVOID                   Window,
+    IN      DWORD                   NoOfFrames
+    )
+{
+    ASSERT(INTR_OFF == CpuIntrGetState());
+    ASSERT(Window == GetCurrentPcpu()->MappingWindow);
+    ASSERT(0 != NoOfFrames && NoOfFrames <= MMU_CPU_WINDOW_FRAMES);
+
+    _MmuUnmapLocalWindow(Window, NoOfFrames * PAGE_SIZE);
 }
 
 void
@@ -731,6 +1034,88 @@ MmuReleaseMemory(
     LOG_FUNC_END_CPU;
 }
 
+PTR_SUCCESS
+PHYSICAL_ADDRESS
+MmuReserveZeroedFrame(
+    void
+    )
+{
+    PHYSICAL_ADDRESS pa;
+    BOOLEAN bSignalWorker;
+    INTR_STATE oldState;
+
+    pa = NULL;
+
+    LockAcquire(&m_mmuData.ZeroThreadData.ZeroedFramesLock, &oldState);
+    if (0 != m_mmuData.ZeroThreadData.NumberOfZeroedFrames)
+    {
+        m_mmuData.ZeroThreadData.NumberOfZeroedFrames--;
+        pa = m_mmuData.ZeroThreadData.ZeroedFrames[m_mmuData.ZeroThreadData.NumberOfZeroedFrames];
+    }
+    bSignalWorker = m_mmuData.ZeroThreadData.NumberOfZeroedFrames < MMU_ZERO_POOL_LOW_WATERMARK;
+    LockRelease(&m_mmuData.ZeroThreadData.ZeroedFramesLock, oldState);
+
+    // the event is valid only after the worker thread was created
+    if (bSignalWorker && (NULL != m_mmuData.ZeroThreadData.WorkerThread))
+    {
+        ExEventSignal(&m_mmuData.ZeroThreadData.NewPagesEvent);
+    }
+
+    return pa;
+}
+
+DWORD
+MmuGetNumberOfZeroedFrames(
+    void
+    )
+{
+    return m_mmuData.ZeroThreadData.NumberOfZeroedFrames;
+}
+
+DWORD
+MmuDrainZeroedFrames(
+    void
+    )
+{
+    PMMU_ZERO_THREAD_DATA pZeroData;
+    PHYSICAL_ADDRESS pa;
+    DWORD noOfFrames;
+    INTR_STATE oldState;
+
+    pZeroData = &m_mmuData.ZeroThreadData;
+
+    // the worker refills the pool with frames reserved from the PMM, if it
+    // emptied the pool when memory is scarce it would only fill it back
+    if ((NULL != pZeroData->WorkerThread) && (GetCurrentThread() == pZeroData->WorkerThread))
+    {
+        return 0;
+    }
+
+    // the frames are released one at a time without holding the pool lock, the
+    // worker may add frames in the meantime => never take more than the capacity
+    for (noOfFrames = 0; noOfFrames < MMU_ZERO_POOL_CAPACITY; ++noOfFrames)
+    {
+        pa = NULL;
+
+        LockAcquire(&pZeroData->ZeroedFramesLock, &oldState);
+        if (0 != pZeroData->NumberOfZeroedFrames)
+        {
+            pZeroData->NumberOfZeroedFrames--;
+            pa = pZeroData->ZeroedFrames[pZeroData->NumberOfZeroedFrames];
+        }
+        LockRelease(&pZeroData->ZeroedFramesLock, oldState);
+
+        if (NULL == pa)
+        {
+            break;
+        }
+
+        PmmReleaseMemory(pa, 1);
+    }
+
+    return noOfFrames;
+}
+
 PTR_SUCCESS
 PHYSICAL_ADDRESS
 MmuGetPhysicalAddress(
@@ -851,24 +1236,44 @@ MmuSolvePageFault(
 {
     PAGE_RIGHTS rightsRequested;
     PAGE_FAULT_ERR_CODE pfErrCode;
+    PPROCESS pProcess;
+    BOOLEAN bSolved;
 
     ASSERT( INTR_OFF == CpuIntrGetState() );
 
     pfErrCode.Raw = ErrorCode;
     rightsRequested = PAGE_RIGHTS_READ;
+    pProcess = pfErrCode.Usermode ? GetCurrentThread()->Process : NULL;
 
     rightsRequested |= ( pfErrCode.Write ? PAGE_RIGHTS_WRITE : 0 );
     rightsRequested |= ( pfErrCode.Execution ? PAGE_RIGHTS_EXECUTE : 0 );
 
-    return VmmSolvePageFault(FaultingAddress,
-                             rightsRequested,
-                             pfErrCode.Usermode ? GetCurrentThread()->Process->PagingData : &m_mmuData.PagingData
-                             );
+    bSolved = VmmSolvePageFault(FaultingAddress,
+                                rightsRequested,
+                                pfErrCode.Usermode ? pProcess->PagingData : &m_mmuData.PagingData
+                                );
+
+    // The image is mapped lazily => nothing touches the page of the entry point before the
+    // main thread tries to execute its first instruction
+    if (bSolved
+        && pfErrCode.Usermode
+        && pfErrCode.Execution
+        && 0 == pProcess->TimeToFirstInstructionUs
+        && AlignAddressLower(FaultingAddress, PAGE_SIZE) == AlignAddressLower(pProcess->HeaderInfo->Preferred.AddressOfEntryPoint, PAGE_SIZE))
+    {
+        _InterlockedCompareExchange64(&pProcess->TimeToFirstInstructionUs,
+                                      IomuGetSystemTimeUs() - pProcess->CreationTimeUs,
+                                      0);
+    }
+
+    return bSolved;
 }
 
 STATUS
 MmuLoadPe(
     IN      PPE_NT_HEADER_INFO      NtHeader,
+    IN      PFILE_OBJECT            ImageFile,
+    IN      PVMM_RESERVATION_SPACE  VaSpace,
     IN      PPAGING_LOCK_DATA       PagingData
     )
 {
@@ -880,17 +1285,41 @@ MmuLoadPe(
         return STATUS_INVALID_PARAMETER1;
     }
 
-    if (PagingData == NULL)
+    if (ImageFile == NULL)
     {
         return STATUS_INVALID_PARAMETER2;
     }
 
+    if (VaSpace == NULL)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (PagingData == NULL)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
     status = STATUS_SUCCESS;
 
+    // If each section starts on a page boundary both in the file and in memory there's no
+    // need to read anything now, the process will fault in only the pages it touches
+    if (IsAddressAligned(NtHeader->FileAlignment, PAGE_SIZE)
+        && IsAddressAligned(NtHeader->ImageAlignment, PAGE_SIZE))
+    {
+        return _MmuMapPeSectionsFromFile(NtHeader, ImageFile, VaSpace, PagingData);
+    }
+
+    // Else the whole file must be brought in memory before its frames can be mapped
+    MmuProbeMemory(NtHeader->ImageBase, (DWORD) min(ImageFile->FileSize, NtHeader->Size));
+
     RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
+    // the image was read through the page cache, its frames are shared by all
+    // the processes running it
     status = _MmuMapPeInMemory(&PagingData->Data,
                                NtHeader,
-                               NtHeader->Preferred.ImageBase);
+                               NtHeader->Preferred.ImageBase,
+                               TRUE);
     RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
 
     return status;
@@ -922,20 +1351,26 @@ MmuCreateAddressSpaceForProcess(
             LOG_FUNC_ERROR("_MmuCreatePagingTables", status);
             __leave;
         }
+        Process->PagingData->Data.Pcid = (WORD) Process->Id;
 
         LOG_TRACE_MMU("Successfully created paging tables for process [%s]\n", ProcessGetName(Process));
 
         // Create the VMM management structures (VMM_RESERVATION_SPACE) to describe the processes
         // virtual memory allocations
+        // The VA space starts at the image base because the PE sections are reserved at their
+        // preferred addresses when the image is loaded
         status = VmmCreateVirtualAddressSpace(&Process->VaSpace,
                                               VA_METADATA_SIZE_FOR_UM_PROCESS,
-                                              PtrOffset(Process->HeaderInfo->Preferred.ImageBase, VA_ALLOCATIONS_START_OFFSET_FROM_IMAGE_BASE));
+                                              Process->HeaderInfo->Preferred.ImageBase);
         if(!SUCCEEDED(status))
         {
             LOG_FUNC_ERROR("VmmCreateVirtualAddressSpace", status);
             __leave;
         }
 
+        // The rest of the allocations start after the image
+        VmReservationSpaceDetermineNextFreeVirtualAddress(Process->VaSpace, VA_ALLOCATIONS_START_OFFSET_FROM_IMAGE_BASE);
+
         LOG_TRACE_MMU("Successfully initialized VA space for process [%s]\n", ProcessGetName(Process));
     }
     __finally
@@ -959,7 +1394,7 @@ MmuDestroyAddressSpaceForProcess(
 
     if (Process->VaSpace != NULL)
     {
-        VmmDestroyVirtualAddressSpace(Process->VaSpace);
+        VmmDestroyVirtualAddressSpace(Process->VaSpace, Process->PagingData);
         Process->VaSpace = NULL;
     }
 
@@ -999,6 +1434,7 @@ MmuInitAddressSpaceForSystemProcess(
     // The system process is special, we will not allocate paging data or a VA space
     // because we already have one
     pProcess->PagingData = &m_mmuData.PagingData;
+    pProcess->PagingData->Data.Pcid = (WORD) pProcess->Id;
     pProcess->VaSpace = VmmRetrieveReservationSpaceForSystemProcess();
 
     /// TODO: I have no idea why the PE_NT_HEADER_INFO is allocated dynamically
@@ -1536,7 +1972,8 @@ STATUS
 _MmuMapPeInMemory(
     IN          PPAGING_DATA            PagingData,
     IN          PPE_NT_HEADER_INFO      HeaderInfo,
-    IN          PVOID                   AddressToMap
+    IN          PVOID                   AddressToMap,
+    IN          BOOLEAN                 SharedFrames
     )
 {
     STATUS status;
@@ -1581,14 +2018,12 @@ _MmuMapPeInMemory(
          pHeaderPage < (PVOID) PtrDiff(PtrOffset(AddressToMap, HeaderInfo->SizeOfHeaders), PAGE_SIZE);
          pHeaderPage = PtrOffset(pHeaderPage, PAGE_SIZE))
     {
-        VmmMapMemoryInternal(PagingData,
-                             MmuGetPhysicalAddress(PtrOffset(HeaderInfo->ImageBase, PtrDiff(pHeaderPage, AddressToMap))),
-                             PAGE_SIZE,
-                             pHeaderPage,
-                             PAGE_RIGHTS_READ,
-                             TRUE,
-                             FALSE
-                             );
+        _MmuMapPePage(PagingData,
+                      MmuGetPhysicalAddress(PtrOffset(HeaderInfo->ImageBase, PtrDiff(pHeaderPage, AddressToMap))),
+                      pHeaderPage,
+                      PAGE_RIGHTS_READ,
+                      SharedFrames
+                      );
     }
 
     // map each section
@@ -1667,14 +2102,12 @@ _MmuMapPeInMemory(
                 LOG_WARNING("Section rights will be Write + Execute!!\n");
             }
 
-            VmmMapMemoryInternal(PagingData,
-                                 MmuGetPhysicalAddress(PtrOffset(HeaderInfo->ImageBase, PtrDiff(pAlignedAddress,AddressToMap))),
-                                 PAGE_SIZE,
-                                 pAlignedAddress,
-                                 prevSectionRequiredRights | curSectionRequiredRights,
-                                 TRUE,
-                                 FALSE
-                                 );
+            _MmuMapPePage(PagingData,
+                          MmuGetPhysicalAddress(PtrOffset(HeaderInfo->ImageBase, PtrDiff(pAlignedAddress,AddressToMap))),
+                          pAlignedAddress,
+                          prevSectionRequiredRights | curSectionRequiredRights,
+                          SharedFrames
+                          );
 
             // advance to next page
             pAlignedAddress = PtrOffset(pAlignedAddress, PAGE_SIZE);
@@ -1696,14 +2129,12 @@ _MmuMapPeInMemory(
                           pPage,
                           curSectionRequiredRights);
 
-            VmmMapMemoryInternal(PagingData,
-                                 MmuGetPhysicalAddress(PtrOffset(HeaderInfo->ImageBase, PtrDiff(pPage,AddressToMap))),
-                                 PAGE_SIZE,
-                                 pPage,
-                                 curSectionRequiredRights,
-                                 TRUE,
-                                 FALSE
-                                 );
+            _MmuMapPePage(PagingData,
+                          MmuGetPhysicalAddress(PtrOffset(HeaderInfo->ImageBase, PtrDiff(pPage,AddressToMap))),
+                          pPage,
+                          curSectionRequiredRights,
+                          SharedFrames
+                          );
         }
 
         // we certainly mapped all the memory related to the previous sections
@@ -1727,14 +2158,12 @@ _MmuMapPeInMemory(
             LOG_WARNING("Section rights will be Write + Execute!!\n");
         }
 
-        VmmMapMemoryInternal(PagingData,
-                             MmuGetPhysicalAddress(PtrOffset(HeaderInfo->ImageBase, PtrDiff(pAlignedAddress, AddressToMap))),
-                             PAGE_SIZE,
-                             pAlignedAddress,
-                             prevSectionRequiredRights,
-                             TRUE,
-                             FALSE
-        );
+        _MmuMapPePage(PagingData,
+                      MmuGetPhysicalAddress(PtrOffset(HeaderInfo->ImageBase, PtrDiff(pAlignedAddress, AddressToMap))),
+                      pAlignedAddress,
+                      prevSectionRequiredRights,
+                      SharedFrames
+                      );
     }
 
     LOG_TRACE_MMU("PE mapped succeesfully\n");
@@ -1743,6 +2172,121 @@ _MmuMapPeInMemory(
 
 }
 
+static
+SAL_SUCCESS
+STATUS
+_MmuMapPeSectionsFromFile(
+    IN          PPE_NT_HEADER_INFO      HeaderInfo,
+    IN          PFILE_OBJECT            ImageFile,
+    IN          PVMM_RESERVATION_SPACE  VaSpace,
+    IN          PPAGING_LOCK_DATA       PagingData
+    )
+{
+    STATUS status;
+    PVOID pRegion;
+
+    ASSERT(NULL != HeaderInfo);
+    ASSERT(NULL != ImageFile);
+    ASSERT(NULL != VaSpace);
+    ASSERT(NULL != PagingData);
+
+    status = STATUS_SUCCESS;
+
+    LOG_TRACE_MMU("PE image will be mapped lazily at 0x%X\n", HeaderInfo->Preferred.ImageBase);
+
+    pRegion = VmmMapFileRegion(HeaderInfo->Preferred.ImageBase,
+                               HeaderInfo->SizeOfHeaders,
+                               PAGE_RIGHTS_READ,
+                               ImageFile,
+                               0,
+                               VaSpace,
+                               PagingData);
+    if (NULL == pRegion)
+    {
+        LOG_FUNC_ERROR_ALLOC("VmmMapFileRegion", HeaderInfo->SizeOfHeaders);
+        return STATUS_MEMORY_CANNOT_BE_RESERVED;
+    }
+
+    for (DWORD i = 0; i < HeaderInfo->NumberOfSections; ++i)
+    {
+        PE_SECTION_INFO section;
+        PAGE_RIGHTS sectionRights;
+        PVOID pSectionAddress;
+        QWORD sectionSize;
+        QWORD fileBackedSize;
+
+        status = PeRetrieveSection(HeaderInfo,
+                                   i,
+                                   &section
+                                   );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PeRetrieveSection", status);
+            return status;
+        }
+
+        if (0 == section.Size)
+        {
+            continue;
+        }
+
+        sectionRights  = IsBooleanFlagOn( section.Characteristics, IMAGE_SCN_MEM_READ ) ? PAGE_RIGHTS_READ : 0;
+        sectionRights |= IsBooleanFlagOn( section.Characteristics, IMAGE_SCN_MEM_WRITE ) ? PAGE_RIGHTS_WRITE : 0;
+        sectionRights |= IsBooleanFlagOn( section.Characteristics, IMAGE_SCN_MEM_EXECUTE ) ? PAGE_RIGHTS_EXECUTE : 0;
+
+        // same as for the images mapped from memory
+        ASSERT(!IsBooleanFlagOn(sectionRights, PAGE_RIGHTS_WRITE | PAGE_RIGHTS_EXECUTE));
+
+        pSectionAddress = PtrOffset(HeaderInfo->Preferred.ImageBase, PtrDiff(section.BaseAddress, HeaderInfo->ImageBase));
+        sectionSize = AlignAddressUpper(section.Size, PAGE_SIZE);
+
+        // Only the raw data is found in the file, the rest of the section (i.e. .bss) must
+        // be zero => it's backed by anonymous memory
+        fileBackedSize = min(AlignAddressUpper(section.RawDataSize, PAGE_SIZE), sectionSize);
+
+        LOG_TRACE_MMU("Section %u at 0x%X of size 0x%X, 0x%X bytes from file offset 0x%x, rights 0x%x\n",
+                      i, pSectionAddress, sectionSize, fileBackedSize, section.RawDataOffset, sectionRights);
+
+        if (0 != fileBackedSize)
+        {
+            pRegion = VmmMapFileRegion(pSectionAddress,
+                                       fileBackedSize,
+                                       sectionRights,
+                                       ImageFile,
+                                       section.RawDataOffset,
+                                       VaSpace,
+                                       PagingData);
+            if (NULL == pRegion)
+            {
+                LOG_FUNC_ERROR_ALLOC("VmmMapFileRegion", fileBackedSize);
+                return STATUS_MEMORY_CANNOT_BE_RESERVED;
+            }
+        }
+
+        if (fileBackedSize < sectionSize)
+        {
+            pRegion = VmmAllocRegionEx(PtrOffset(pSectionAddress, fileBackedSize),
+                                       sectionSize - fileBackedSize,
+                                       VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT,
+                                       sectionRights,
+                                       FALSE,
+                                       NULL,
+                                       VaSpace,
+                                       PagingData,
+                                       NULL);
+            if (NULL == pRegion)
+            {
+                LOG_FUNC_ERROR_ALLOC("VmmAllocRegionEx", sectionSize - fileBackedSize);
+                return STATUS_MEMORY_CANNOT_BE_RESERVED;
+            }
+        }
+    }
+
+    LOG_TRACE_MMU("PE sections reserved successfully\n");
+
+    return status;
+}
+
 static
 SAL_SUCCESS
 STATUS
@@ -1771,7 +2315,7 @@ _MmuMapKernelMemory(
         return STATUS_PHYSICAL_MEMORY_NOT_AVAILABLE;
     }
 
-    status = _MmuMapPeInMemory(PagingData, KernelInfo, KernelInfo->ImageBase);
+    status = _MmuMapPeInMemory(PagingData, KernelInfo, KernelInfo->ImageBase, FALSE);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("_MmuMapPeInMemory", status);
@@ -1781,7 +2325,7 @@ _MmuMapKernelMemory(
 
     // Perform identity mapping - needed by APs
     // Will be discarded after all the APs get in 64-bit mode
-    status = _MmuMapPeInMemory(PagingData, KernelInfo, VA2PA(KernelInfo->ImageBase));
+    status = _MmuMapPeInMemory(PagingData, KernelInfo, VA2PA(KernelInfo->ImageBase), FALSE);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("_MmuMapPeInMemory", status);
@@ -1985,18 +2529,19 @@ _MmuZeroWorkerThreadFunction(
     ExFreePoolWithTag(pCtx, HEAP_MMU_TAG);
     pCtx = NULL;
 
+    // have some zeroed frames ready before the first page faults come in
+    _MmuZeroPoolRefill();
+
     // warning C4127: conditional expression is constant
 #pragma warning(suppress:4127)
     while (TRUE)
     {
         PMMU_ZERO_WORKER_ITEM pItem;
         INTR_STATE oldState;
-        DWORD noOfBytes;
-        PVOID pAddr;
+        DWORD framesKept;
 
         pItem = NULL;
-        noOfBytes = 0;
-        pAddr = NULL;
+        framesKept = 0;
 
         // may use executive timer in the future
         ExEventWaitForSignal(pEvent);
@@ -2007,7 +2552,10 @@ _MmuZeroWorkerThreadFunction(
 
         if (pCurrentEntry == pListHead)
         {
-            // list is empty :(
+            // list is empty :(, we were probably woken up because the pool of
+            // zeroed frames is running low
+            _MmuZeroPoolRefill();
+
             ExEventClearSignal(pEvent);
 
             // wait for another signal
@@ -2016,24 +2564,17 @@ _MmuZeroWorkerThreadFunction(
 
         pItem = CONTAINING_RECORD(pCurrentEntry, MMU_ZERO_WORKER_ITEM, ListEntry);
 
-        noOfBytes = pItem->NumberOfFrames * PAGE_SIZE;
-        pAddr = MmuMapMemoryEx(pItem->PhysicalAddress,
-                               noOfBytes,
-                               PAGE_RIGHTS_READWRITE,
-                               FALSE,
-                               FALSE,
-                               NULL
-                               );
-        ASSERT( NULL != pAddr );
-
         // zero the memory, that's our job :)
-        memzero(pAddr, noOfBytes);
-
-        // truly release physical addresses
-        PmmReleaseMemory(pItem->PhysicalAddress, pItem->NumberOfFrames );
+        _MmuZeroWorkerClearRange(pItem->PhysicalAddress, pItem->NumberOfFrames);
 
-        // it's ok, this does not release memory => no oo loop
-        MmuUnmapSystemMemory(pAddr, noOfBytes);
+        // the frames are already zeroed, keep as many as we can for page
+        // faults and truly release the rest
+        framesKept = _MmuZeroPoolInsertFrames(pItem->PhysicalAddress, pItem->NumberOfFrames);
+        if (framesKept < pItem->NumberOfFrames)
+        {
+            PmmReleaseMemory(PtrOffset(pItem->PhysicalAddress, (QWORD) framesKept * PAGE_SIZE),
+                             pItem->NumberOfFrames - framesKept);
+        }
 
         _MmuFreeFromPoolWithTag(MmuHeapIndexSpecial, pItem, HEAP_MMU_TAG );
         pItem = NULL;
@@ -2044,4 +2585,279 @@ _MmuZeroWorkerThreadFunction(
     NOT_REACHED;
 
     return status;
-}
\ No newline at end of file
+}
+
+static
+DWORD
+_MmuZeroPoolInsertFrames(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr,
+    IN          DWORD                   NoOfFrames
+    )
+{
+    DWORD i;
+    INTR_STATE oldState;
+    PMMU_ZERO_THREAD_DATA pZeroData;
+
+    ASSERT(IsAddressAligned(PhysicalAddr, PAGE_SIZE));
+
+    pZeroData = &m_mmuData.ZeroThreadData;
+
+    LockAcquire(&pZeroData->ZeroedFramesLock, &oldState);
+    for (i = 0;
+         (i < NoOfFrames) && (pZeroData->NumberOfZeroedFrames < MMU_ZERO_POOL_CAPACITY);
+         ++i)
+    {
+        pZeroData->ZeroedFrames[pZeroData->NumberOfZeroedFrames] = PtrOffset(PhysicalAddr, (QWORD) i * PAGE_SIZE);
+        pZeroData->NumberOfZeroedFrames++;
+    }
+    LockRelease(&pZeroData->ZeroedFramesLock, oldState);
+
+    return i;
+}
+
+static
+void
+_MmuZeroPoolRefill(
+    void
+    )
+{
+    PHYSICAL_ADDRESS frames[MMU_ZERO_WINDOW_FRAMES];
+    DWORD noOfFrames;
+    DWORD i;
+
+    // NumberOfZeroedFrames is read without the lock, we are the only ones adding
+    // frames to the pool => in the worst case we stop a few frames short
+    while (m_mmuData.ZeroThreadData.NumberOfZeroedFrames < MMU_ZERO_POOL_HIGH_WATERMARK)
+    {
+        for (noOfFrames = 0;
+             (noOfFrames < MMU_ZERO_WINDOW_FRAMES)
+             && (m_mmuData.ZeroThreadData.NumberOfZeroedFrames + noOfFrames < MMU_ZERO_POOL_HIGH_WATERMARK);
+             ++noOfFrames)
+        {
+            frames[noOfFrames] = PmmReserveMemory(1);
+            if (NULL == frames[noOfFrames])
+            {
+                break;
+            }
+        }
+
+        if (0 == noOfFrames)
+        {
+            // we won't keep frames zeroed if memory is scarce
+            break;
+        }
+
+        _MmuZeroWorkerClearFrames(frames, noOfFrames);
+
+        for (i = 0; i < noOfFrames; ++i)
+        {
+            if (0 == _MmuZeroPoolInsertFrames(frames[i], 1))
+            {
+                PmmReleaseMemory(frames[i], 1);
+            }
+        }
+
+        if (noOfFrames < MMU_ZERO_WINDOW_FRAMES)
+        {
+            break;
+        }
+    }
+}
+
+DWORD
+MmuSetZeroWorkerBudget(
+    IN          DWORD                   BytesPerTick
+    )
+{
+    return _InterlockedExchange(&m_mmuData.ZeroThreadData.BytesPerTick, BytesPerTick);
+}
+
+static
+void
+_MmuZeroWorkerChargeBudget(
+    IN          DWORD                   NoOfBytes
+    )
+{
+    PMMU_ZERO_THREAD_DATA pZeroData;
+    QWORD tickTimeUs;
+    QWORD currentTimeUs;
+    DWORD bytesPerTick;
+
+    pZeroData = &m_mmuData.ZeroThreadData;
+    bytesPerTick = pZeroData->BytesPerTick;
+
+    if (0 == bytesPerTick)
+    {
+        return;
+    }
+
+    tickTimeUs = IomuGetTimerInterrupTimeUs();
+    currentTimeUs = IomuGetSystemTimeUs();
+
+    if (currentTimeUs - pZeroData->CurrentTickStartUs >= tickTimeUs)
+    {
+        pZeroData->CurrentTickStartUs = currentTimeUs;
+        pZeroData->BytesZeroedInTick = 0;
+    }
+
+    // we always let at least one batch through in a tick, else a budget smaller
+    // than the window would stop the worker forever
+    if ((0 != pZeroData->BytesZeroedInTick)
+        && (pZeroData->BytesZeroedInTick + NoOfBytes > bytesPerTick))
+    {
+        EX_TIMER timer;
+        STATUS status;
+
+        // budget exhausted, give up the CPU until the next tick starts
+        status = ExTimerInit(&timer, ExTimerTypeAbsolute, pZeroData->CurrentTickStartUs + tickTimeUs);
+        ASSERT(SUCCEEDED(status));
+
+        ExTimerStart(&timer);
+        ExTimerWait(&timer);
+        ExTimerUninit(&timer);
+
+        pZeroData->CurrentTickStartUs = IomuGetSystemTimeUs();
+        pZeroData->BytesZeroedInTick = 0;
+    }
+
+    pZeroData->BytesZeroedInTick = pZeroData->BytesZeroedInTick + NoOfBytes;
+}
+
+static
+void
+_MmuZeroWorkerClearFrames(
+    IN_READS(NoOfFrames)
+                PHYSICAL_ADDRESS*       Frames,
+    IN          DWORD                   NoOfFrames
+    )
+{
+    PVOID pWindow;
+    INTR_STATE oldState;
+    DWORD i;
+
+    ASSERT(NULL != Frames);
+    ASSERT(0 != NoOfFrames && NoOfFrames <= MMU_ZERO_WINDOW_FRAMES);
+
+    pWindow = m_mmuData.ZeroThreadData.MappingWindow;
+    ASSERT(NULL != pWindow);
+
+    _MmuZeroWorkerChargeBudget(NoOfFrames * PAGE_SIZE);
+
+    // The worker may be moved to another CPU each time it is preempted, by keeping
+    // interrupts disabled while the window is mapped no other CPU can ever cache
+    // a translation for it => the local invalidation done on unmap is enough
+    oldState = CpuIntrDisable();
+
+    for (i = 0; i < NoOfFrames; ++i)
+    {
+        MmuMapMemoryInternal(Frames[i],
+                             PAGE_SIZE,
+                             PAGE_RIGHTS_READWRITE,
+                             PtrOffset(pWindow, (QWORD) i * PAGE_SIZE),
+                             TRUE,
+                             FALSE,
+                             NULL
+                             );
+    }
+
+    _MmuClearPages(pWindow, NoOfFrames * PAGE_SIZE);
+
+    // it's ok, this does not release memory => no oo loop
+    _MmuUnmapLocalWindow(pWindow, NoOfFrames * PAGE_SIZE);
+
+    CpuIntrSetState(oldState);
+}
+
+static
+void
+_MmuUnmapLocalWindow(
+    IN          PVOID                   Window,
+    IN          DWORD                   Size
+    )
+{
+    INTR_STATE oldState;
+    VMM_UNMAP_BATCH batch;
+    QWORD bytesUnmapped;
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    VmmInitUnmapBatch(&batch, &m_mmuData.PagingData.Data);
+
+    RecRwSpinlockAcquireExclusive(&m_mmuData.PagingData.Lock, &oldState);
+    bytesUnmapped = VmmUnmapMemoryEx(&m_mmuData.PagingData.Data, Window, Size, FALSE, &batch);
+    RecRwSpinlockReleaseExclusive(&m_mmuData.PagingData.Lock, oldState);
+
+    // the window pages are contiguous => they always fit in a single range
+    ASSERT(bytesUnmapped == Size);
+
+    // the window was mapped only on this CPU => no IPIs are needed
+    VmmFlushUnmapBatch(&batch, TRUE);
+}
+
+static
+void
+_MmuZeroWorkerClearRange(
+    IN          PHYSICAL_ADDRESS        PhysicalAddr,
+    IN          DWORD                   NoOfFrames
+    )
+{
+    PHYSICAL_ADDRESS frames[MMU_ZERO_WINDOW_FRAMES];
+    DWORD noOfFrames;
+    DWORD i;
+    DWORD j;
+
+    ASSERT(IsAddressAligned(PhysicalAddr, PAGE_SIZE));
+
+    for (i = 0; i < NoOfFrames; i = i + noOfFrames)
+    {
+        noOfFrames = min(NoOfFrames - i, MMU_ZERO_WINDOW_FRAMES);
+
+        for (j = 0; j < noOfFrames; ++j)
+        {
+            frames[j] = PtrOffset(PhysicalAddr, (QWORD) (i + j) * PAGE_SIZE);
+        }
+
+        _MmuZeroWorkerClearFrames(frames, noOfFrames);
+    }
+}
+
+static
+void
+_MmuClearPages(
+    OUT_WRITES_BYTES_ALL(Size)
+                PVOID                   Address,
+    IN          DWORD                   Size
+    )
+{
+    PQWORD pQwords;
+    DWORD i;
+
+    ASSERT(IsAddressAligned(Address, PAGE_SIZE));
+    ASSERT(IsAddressAligned(Size, PAGE_SIZE));
+
+    if (m_mmuData.ZeroThreadData.UseFastStrings)
+    {
+        CpuClearDirectionFlag();
+
+        __stosb(Address, 0, Size);
+
+        return;
+    }
+
+    // The frames we clear will most likely not be accessed soon (and when they are
+    // it will be from another virtual address) => there's no point in bringing them
+    // into the cache. MOVNTI works on general purpose registers so we don't need to
+    // worry about the FPU/SSE state.
+    pQwords = (PQWORD) Address;
+    for (i = 0; i < Size / sizeof(QWORD); i = i + 4)
+    {
+        _mm_stream_si64x((__int64*) &pQwords[i], 0);
+        _mm_stream_si64x((__int64*) &pQwords[i + 1], 0);
+        _mm_stream_si64x((__int64*) &pQwords[i + 2], 0);
+        _mm_stream_si64x((__int64*) &pQwords[i + 3], 0);
+    }
+
+    // non-temporal stores are weakly ordered, make sure they are globally visible
+    // before the frames are handed out
+    _mm_sfence();
+}
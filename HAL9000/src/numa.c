@@ -0,0 +1,432 @@
+#include "HAL9000.h"
+#include "numa.h"
+#include "acpi_interface.h"
+#include "pmm.h"
+
+// xAPIC IDs fit in a byte, the CPUs described only by x2APIC affinity
+// structures with larger IDs cannot be used by the system anyway
+#define NUMA_MAX_APIC_IDS               (MAX_BYTE + 1)
+
+typedef struct _NUMA_DATA
+{
+    DWORD                   NumberOfNodes;
+
+    // The ACPI proximity domain each node was created for
+    DWORD                   ProximityDomains[NUMA_MAX_NODES];
+
+    BYTE                    Distances[NUMA_MAX_NODES][NUMA_MAX_NODES];
+
+    NUMA_NODE               FallbackOrder[NUMA_MAX_NODES][NUMA_MAX_NODES];
+
+    NUMA_NODE               NodeOfApicId[NUMA_MAX_APIC_IDS];
+
+    DWORD                   NumberOfMemoryRanges;
+    NUMA_MEMORY_RANGE       MemoryRanges[NUMA_MAX_MEMORY_RANGES];
+} NUMA_DATA, *PNUMA_DATA;
+
+static NUMA_DATA m_numaData;
+
+static
+SAL_SUCCESS
+STATUS
+_NumaGetNodeForDomain(
+    IN          DWORD                   ProximityDomain,
+    OUT         PNUMA_NODE              Node
+    );
+
+static
+STATUS
+_NumaParseAffinities(
+    void
+    );
+
+static
+void
+_NumaAddMemoryRange(
+    IN          QWORD                   BaseAddress,
+    IN          QWORD                   Length,
+    IN          NUMA_NODE               Node
+    );
+
+static
+void
+_NumaSetSingleNode(
+    void
+    );
+
+static
+void
+_NumaComputeDistances(
+    void
+    );
+
+_No_competing_thread_
+void
+NumaPreinit(
+    void
+    )
+{
+    memzero(&m_numaData, sizeof(NUMA_DATA));
+}
+
+_No_competing_thread_
+STATUS
+NumaInit(
+    void
+    )
+{
+    STATUS status;
+
+    memset(m_numaData.NodeOfApicId, NUMA_INVALID_NODE, sizeof(m_numaData.NodeOfApicId));
+
+    status = _NumaParseAffinities();
+    if (!SUCCEEDED(status))
+    {
+        // a topology we cannot describe is no reason to fail booting, the
+        // system works just as well if we consider it a single node
+        LOG_WARNING("_NumaParseAffinities failed with status 0x%x, using a single node\n", status);
+        _NumaSetSingleNode();
+    }
+
+    _NumaComputeDistances();
+
+    LOGL("System has %u NUMA node(s) and %u memory range(s)\n",
+         m_numaData.NumberOfNodes, m_numaData.NumberOfMemoryRanges);
+
+    for (DWORD i = 0; i < m_numaData.NumberOfMemoryRanges; ++i)
+    {
+        LOG("Node %u: [0x%X, 0x%X)\n",
+            m_numaData.MemoryRanges[i].Node,
+            m_numaData.MemoryRanges[i].BaseAddress,
+            PtrOffset(m_numaData.MemoryRanges[i].BaseAddress, m_numaData.MemoryRanges[i].Length));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+DWORD
+NumaGetNumberOfNodes(
+    void
+    )
+{
+    return m_numaData.NumberOfNodes;
+}
+
+NUMA_NODE
+NumaGetNodeOfCpu(
+    IN          APIC_ID                 ApicId
+    )
+{
+    NUMA_NODE node;
+
+    node = m_numaData.NodeOfApicId[ApicId];
+
+    return (NUMA_INVALID_NODE == node) ? 0 : node;
+}
+
+NUMA_NODE
+NumaGetNodeOfAddress(
+    IN          PHYSICAL_ADDRESS        PhysicalAddress
+    )
+{
+    PNUMA_MEMORY_RANGE pRange;
+
+    for (DWORD i = 0; i < m_numaData.NumberOfMemoryRanges; ++i)
+    {
+        pRange = &m_numaData.MemoryRanges[i];
+
+        if (PhysicalAddress < pRange->BaseAddress)
+        {
+            // the ranges are sorted
+            break;
+        }
+
+        if ((QWORD) PhysicalAddress - (QWORD) pRange->BaseAddress < pRange->Length)
+        {
+            return pRange->Node;
+        }
+    }
+
+    return NUMA_INVALID_NODE;
+}
+
+BYTE
+NumaGetDistance(
+    IN          NUMA_NODE               FromNode,
+    IN          NUMA_NODE               ToNode
+    )
+{
+    ASSERT(FromNode < m_numaData.NumberOfNodes);
+    ASSERT(ToNode < m_numaData.NumberOfNodes);
+
+    return m_numaData.Distances[FromNode][ToNode];
+}
+
+const NUMA_NODE*
+NumaGetFallbackOrder(
+    IN          NUMA_NODE               Node
+    )
+{
+    ASSERT(Node < m_numaData.NumberOfNodes);
+
+    return m_numaData.FallbackOrder[Node];
+}
+
+const NUMA_MEMORY_RANGE*
+NumaGetMemoryRanges(
+    OUT         DWORD*                  NumberOfRanges
+    )
+{
+    ASSERT(NULL != NumberOfRanges);
+
+    *NumberOfRanges = m_numaData.NumberOfMemoryRanges;
+
+    return m_numaData.MemoryRanges;
+}
+
+static
+SAL_SUCCESS
+STATUS
+_NumaGetNodeForDomain(
+    IN          DWORD                   ProximityDomain,
+    OUT         PNUMA_NODE              Node
+    )
+{
+    DWORD i;
+
+    ASSERT(NULL != Node);
+
+    for (i = 0; i < m_numaData.NumberOfNodes; ++i)
+    {
+        if (m_numaData.ProximityDomains[i] == ProximityDomain)
+        {
+            *Node = (NUMA_NODE) i;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    if (NUMA_MAX_NODES == m_numaData.NumberOfNodes)
+    {
+        LOG_ERROR("Proximity domain %u does not fit, there are already %u nodes\n",
+                  ProximityDomain, m_numaData.NumberOfNodes);
+        return STATUS_LIMIT_REACHED;
+    }
+
+    m_numaData.ProximityDomains[i] = ProximityDomain;
+    m_numaData.NumberOfNodes++;
+
+    *Node = (NUMA_NODE) i;
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_NumaParseAffinities(
+    void
+    )
+{
+    STATUS status;
+    ACPI_SUBTABLE_HEADER* pHeader;
+    NUMA_NODE node;
+    DWORD domain;
+    DWORD apicId;
+
+    for (status = AcpiRetrieveNextSratEntry(TRUE, &pHeader);
+         SUCCEEDED(status);
+         status = AcpiRetrieveNextSratEntry(FALSE, &pHeader))
+    {
+        if (ACPI_SRAT_TYPE_MEMORY_AFFINITY == pHeader->Type)
+        {
+            ACPI_SRAT_MEM_AFFINITY* pMemory = (ACPI_SRAT_MEM_AFFINITY*) pHeader;
+
+            if (!IsBooleanFlagOn(pMemory->Flags, ACPI_SRAT_MEM_ENABLED) || 0 == pMemory->Length)
+            {
+                continue;
+            }
+
+            if (NUMA_MAX_MEMORY_RANGES == m_numaData.NumberOfMemoryRanges)
+            {
+                LOG_ERROR("There are more than %u memory ranges\n", NUMA_MAX_MEMORY_RANGES);
+                return STATUS_LIMIT_REACHED;
+            }
+
+            status = _NumaGetNodeForDomain(pMemory->ProximityDomain, &node);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_NumaGetNodeForDomain", status);
+                return status;
+            }
+
+            _NumaAddMemoryRange(pMemory->BaseAddress, pMemory->Length, node);
+
+            continue;
+        }
+
+        if (ACPI_SRAT_TYPE_CPU_AFFINITY == pHeader->Type)
+        {
+            ACPI_SRAT_CPU_AFFINITY* pCpu = (ACPI_SRAT_CPU_AFFINITY*) pHeader;
+
+            if (!IsBooleanFlagOn(pCpu->Flags, ACPI_SRAT_CPU_USE_AFFINITY))
+            {
+                continue;
+            }
+
+            domain = pCpu->ProximityDomainLo
+                | ((DWORD) pCpu->ProximityDomainHi[0] << 8)
+                | ((DWORD) pCpu->ProximityDomainHi[1] << 16)
+                | ((DWORD) pCpu->ProximityDomainHi[2] << 24);
+            apicId = pCpu->ApicId;
+        }
+        else if (ACPI_SRAT_TYPE_X2APIC_CPU_AFFINITY == pHeader->Type)
+        {
+            ACPI_SRAT_X2APIC_CPU_AFFINITY* pCpu = (ACPI_SRAT_X2APIC_CPU_AFFINITY*) pHeader;
+
+            if (!IsBooleanFlagOn(pCpu->Flags, ACPI_SRAT_CPU_USE_AFFINITY))
+            {
+                continue;
+            }
+
+            domain = pCpu->ProximityDomain;
+            apicId = pCpu->ApicId;
+        }
+        else
+        {
+            continue;
+        }
+
+        if (apicId >= NUMA_MAX_APIC_IDS)
+        {
+            LOG_WARNING("Ignoring the affinity of the CPU with APIC ID 0x%x\n", apicId);
+            continue;
+        }
+
+        status = _NumaGetNodeForDomain(domain, &node);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_NumaGetNodeForDomain", status);
+            return status;
+        }
+
+        m_numaData.NodeOfApicId[apicId] = node;
+    }
+
+    if (STATUS_NO_MORE_OBJECTS != status)
+    {
+        LOG_FUNC_ERROR("AcpiRetrieveNextSratEntry", status);
+        return status;
+    }
+
+    if (0 == m_numaData.NumberOfMemoryRanges)
+    {
+        // no SRAT or a SRAT without any memory, either way we have no idea
+        // where the memory is
+        _NumaSetSingleNode();
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_NumaAddMemoryRange(
+    IN          QWORD                   BaseAddress,
+    IN          QWORD                   Length,
+    IN          NUMA_NODE               Node
+    )
+{
+    DWORD i;
+
+    ASSERT(m_numaData.NumberOfMemoryRanges < NUMA_MAX_MEMORY_RANGES);
+
+    // keep the ranges sorted by their base address, there are only a few of
+    // them => insertion sort is enough
+    for (i = m_numaData.NumberOfMemoryRanges;
+         i > 0 && (QWORD) m_numaData.MemoryRanges[i - 1].BaseAddress > BaseAddress;
+         --i)
+    {
+        m_numaData.MemoryRanges[i] = m_numaData.MemoryRanges[i - 1];
+    }
+
+    m_numaData.MemoryRanges[i].BaseAddress = (PHYSICAL_ADDRESS) BaseAddress;
+    m_numaData.MemoryRanges[i].Length = Length;
+    m_numaData.MemoryRanges[i].Node = Node;
+
+    m_numaData.NumberOfMemoryRanges++;
+}
+
+static
+void
+_NumaSetSingleNode(
+    void
+    )
+{
+    m_numaData.NumberOfNodes = 1;
+    m_numaData.ProximityDomains[0] = 0;
+
+    // all the CPUs default to node 0
+    memset(m_numaData.NodeOfApicId, NUMA_INVALID_NODE, sizeof(m_numaData.NodeOfApicId));
+
+    m_numaData.NumberOfMemoryRanges = 0;
+    _NumaAddMemoryRange(0, (QWORD) PmmGetHighestPhysicalMemoryAddressPresent(), 0);
+}
+
+static
+void
+_NumaComputeDistances(
+    void
+    )
+{
+    STATUS status;
+    DWORD i;
+    DWORD j;
+    DWORD k;
+    BYTE distance;
+    NUMA_NODE* pOrder;
+
+    for (i = 0; i < m_numaData.NumberOfNodes; ++i)
+    {
+        for (j = 0; j < m_numaData.NumberOfNodes; ++j)
+        {
+            status = AcpiRetrieveLocalityDistance(m_numaData.ProximityDomains[i],
+                                                  m_numaData.ProximityDomains[j],
+                                                  &distance);
+            if (!SUCCEEDED(status))
+            {
+                distance = (i == j) ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+            }
+
+            m_numaData.Distances[i][j] = distance;
+        }
+    }
+
+    // sort the nodes by their distance, on equal distances the lower node
+    // comes first, the node itself is always the closest one
+    for (i = 0; i < m_numaData.NumberOfNodes; ++i)
+    {
+        pOrder = m_numaData.FallbackOrder[i];
+
+        pOrder[0] = (NUMA_NODE) i;
+        k = 1;
+
+        for (j = 0; j < m_numaData.NumberOfNodes; ++j)
+        {
+            DWORD pos;
+
+            if (j == i)
+            {
+                continue;
+            }
+
+            for (pos = k;
+                 pos > 1 && m_numaData.Distances[i][pOrder[pos - 1]] > m_numaData.Distances[i][j];
+                 --pos)
+            {
+                pOrder[pos] = pOrder[pos - 1];
+            }
+
+            pOrder[pos] = (NUMA_NODE) j;
+            k++;
+        }
+    }
+}
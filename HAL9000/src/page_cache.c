@@ -0,0 +1,573 @@
+#include "HAL9000.h"
+#include "page_cache.h"
+#include "pmm.h"
+#include "io.h"
+#include "ex.h"
+#include "lock_common.h"
+
+typedef struct _PAGE_CACHE_FILE
+{
+    LIST_ENTRY              NextFile;
+
+    // A FILE_OBJECT is created each time a file is opened, i.e. two processes
+    // running the same executable have different file objects => the cache
+    // is identified by the file itself: its file system, path and size
+    struct _DEVICE_OBJECT*  FileSystemDevice;
+    char*                   FileName;
+    QWORD                   FileSize;
+
+    _Guarded_by_(m_pageCacheData.FileListLock)
+    DWORD                   ReferenceCount;
+
+    DWORD                   NumberOfPages;
+
+    LOCK                    PagesLock;
+
+    // A NULL entry means the page was not yet read from the disk, once set
+    // an entry never changes until the file is evicted
+    _Guarded_by_(PagesLock)
+    PHYSICAL_ADDRESS*       Pages;
+} PAGE_CACHE_FILE;
+
+typedef struct _PAGE_CACHE_DATA
+{
+    LOCK                    FileListLock;
+
+    _Guarded_by_(FileListLock)
+    LIST_ENTRY              FileList;
+
+    _Guarded_by_(FileListLock)
+    DWORD                   NumberOfFiles;
+
+    volatile QWORD          NumberOfPages;
+
+    volatile QWORD          Hits;
+    volatile QWORD          Misses;
+    volatile QWORD          NumberOfEvictedPages;
+} PAGE_CACHE_DATA, *PPAGE_CACHE_DATA;
+
+static PAGE_CACHE_DATA m_pageCacheData;
+
+REQUIRES_EXCL_LOCK(m_pageCacheData.FileListLock)
+static
+PTR_SUCCESS
+PPAGE_CACHE_FILE
+_PageCacheFindFile(
+    IN          PFILE_OBJECT            FileObject
+    );
+
+REQUIRES_EXCL_LOCK(m_pageCacheData.FileListLock)
+static
+void
+_PageCacheEvictUnreferencedFiles(
+    OUT         PLIST_ENTRY             EvictedFiles
+    );
+
+static
+void
+_PageCacheDestroyFile(
+    _Pre_notnull_ _Post_ptr_invalid_
+                PPAGE_CACHE_FILE        CacheFile
+    );
+
+//******************************************************************************
+// Function:     _PageCacheReadPages
+// Description:  Reads NumberOfPages pages starting with FirstPage from the
+//               disk and places them in the cache. If another CPU cached
+//               some of the pages in the meantime its frames are used.
+// Returns:      STATUS
+// Parameter:    INOUT PPAGE_CACHE_FILE CacheFile
+// Parameter:    IN PFILE_OBJECT FileObject
+// Parameter:    IN DWORD FirstPage
+// Parameter:    IN DWORD NumberOfPages
+// Parameter:    OUT_WRITES(NumberOfPages) PHYSICAL_ADDRESS* Frames
+//******************************************************************************
+static
+STATUS
+_PageCacheReadPages(
+    INOUT       PPAGE_CACHE_FILE        CacheFile,
+    IN          PFILE_OBJECT            FileObject,
+    IN          DWORD                   FirstPage,
+    IN          DWORD                   NumberOfPages,
+    OUT_WRITES(NumberOfPages)
+                PHYSICAL_ADDRESS*       Frames
+    );
+
+_No_competing_thread_
+void
+PageCachePreinit(
+    void
+    )
+{
+    memzero(&m_pageCacheData, sizeof(PAGE_CACHE_DATA));
+
+    LockInit(&m_pageCacheData.FileListLock);
+    InitializeListHead(&m_pageCacheData.FileList);
+}
+
+STATUS
+PageCacheOpenFile(
+    IN          PFILE_OBJECT            FileObject,
+    OUT_PTR     PPAGE_CACHE_FILE*       CacheFile
+    )
+{
+    PPAGE_CACHE_FILE pCacheFile;
+    PPAGE_CACHE_FILE pNewCacheFile;
+    INTR_STATE oldState;
+    LIST_ENTRY evictedFiles;
+    QWORD noOfPages;
+    DWORD nameLength;
+    DWORD allocationSize;
+
+    if (NULL == FileObject)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == CacheFile)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if ((NULL == FileObject->FileName) || (0 == FileObject->FileSize))
+    {
+        return STATUS_UNSUPPORTED;
+    }
+
+    noOfPages = AlignAddressUpper(FileObject->FileSize, PAGE_SIZE) / PAGE_SIZE;
+    if (noOfPages > MAX_DWORD / sizeof(PHYSICAL_ADDRESS) / 2)
+    {
+        LOG_WARNING("File %s is too large to be cached!\n", FileObject->FileName);
+        return STATUS_UNSUPPORTED;
+    }
+
+    InitializeListHead(&evictedFiles);
+
+    LockAcquire(&m_pageCacheData.FileListLock, &oldState);
+    pCacheFile = _PageCacheFindFile(FileObject);
+    if (NULL != pCacheFile)
+    {
+        pCacheFile->ReferenceCount++;
+    }
+    LockRelease(&m_pageCacheData.FileListLock, oldState);
+
+    if (NULL != pCacheFile)
+    {
+        *CacheFile = pCacheFile;
+        return STATUS_SUCCESS;
+    }
+
+    // the file was not yet cached, the structure, the page array and the file name
+    // are allocated at once without holding the lock
+    nameLength = strlen(FileObject->FileName);
+    allocationSize = sizeof(PAGE_CACHE_FILE) + (DWORD) noOfPages * sizeof(PHYSICAL_ADDRESS) + nameLength + 1;
+
+    pNewCacheFile = ExAllocatePoolWithTag(PoolAllocateZeroMemory, allocationSize, HEAP_PAGE_CACHE_TAG, 0);
+    if (NULL == pNewCacheFile)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", allocationSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    pNewCacheFile->Pages = (PHYSICAL_ADDRESS*) PtrOffset(pNewCacheFile, sizeof(PAGE_CACHE_FILE));
+    pNewCacheFile->FileName = (char*) PtrOffset(pNewCacheFile->Pages, noOfPages * sizeof(PHYSICAL_ADDRESS));
+    strcpy(pNewCacheFile->FileName, FileObject->FileName);
+
+    pNewCacheFile->FileSystemDevice = FileObject->FileSystemDevice;
+    pNewCacheFile->FileSize = FileObject->FileSize;
+    pNewCacheFile->NumberOfPages = (DWORD) noOfPages;
+    pNewCacheFile->ReferenceCount = 1;
+    LockInit(&pNewCacheFile->PagesLock);
+
+    LockAcquire(&m_pageCacheData.FileListLock, &oldState);
+
+    // someone else may have cached the same file while we were allocating
+    pCacheFile = _PageCacheFindFile(FileObject);
+    if (NULL != pCacheFile)
+    {
+        pCacheFile->ReferenceCount++;
+    }
+    else
+    {
+        if (m_pageCacheData.NumberOfPages > PAGE_CACHE_TRIM_THRESHOLD_PAGES)
+        {
+            _PageCacheEvictUnreferencedFiles(&evictedFiles);
+        }
+
+        InsertTailList(&m_pageCacheData.FileList, &pNewCacheFile->NextFile);
+        m_pageCacheData.NumberOfFiles++;
+
+        pCacheFile = pNewCacheFile;
+        pNewCacheFile = NULL;
+    }
+
+    LockRelease(&m_pageCacheData.FileListLock, oldState);
+
+    if (NULL != pNewCacheFile)
+    {
+        ExFreePoolWithTag(pNewCacheFile, HEAP_PAGE_CACHE_TAG);
+        pNewCacheFile = NULL;
+    }
+
+    while (!IsListEmpty(&evictedFiles))
+    {
+        PLIST_ENTRY pEntry = RemoveHeadList(&evictedFiles);
+
+        _PageCacheDestroyFile(CONTAINING_RECORD(pEntry, PAGE_CACHE_FILE, NextFile));
+    }
+
+    *CacheFile = pCacheFile;
+
+    return STATUS_SUCCESS;
+}
+
+void
+PageCacheCloseFile(
+    INOUT       PPAGE_CACHE_FILE        CacheFile
+    )
+{
+    INTR_STATE oldState;
+
+    ASSERT(NULL != CacheFile);
+
+    LockAcquire(&m_pageCacheData.FileListLock, &oldState);
+
+    ASSERT(CacheFile->ReferenceCount > 0);
+    CacheFile->ReferenceCount--;
+
+    LockRelease(&m_pageCacheData.FileListLock, oldState);
+}
+
+STATUS
+PageCacheGetPages(
+    IN          PPAGE_CACHE_FILE        CacheFile,
+    IN          PFILE_OBJECT            FileObject,
+    IN          QWORD                   FileOffset,
+    IN          DWORD                   NumberOfPages,
+    OUT_WRITES(NumberOfPages)
+                PHYSICAL_ADDRESS*       Frames
+    )
+{
+    STATUS status;
+    INTR_STATE oldState;
+    QWORD firstPage;
+    DWORD i;
+    DWORD noOfMissingPages;
+    DWORD noOfHits;
+
+    if (NULL == CacheFile)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == FileObject)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (!IsAddressAligned(FileOffset, PAGE_SIZE))
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    firstPage = FileOffset / PAGE_SIZE;
+
+    if ((0 == NumberOfPages) || (firstPage + NumberOfPages > CacheFile->NumberOfPages))
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (NULL == Frames)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    status = STATUS_SUCCESS;
+    noOfHits = 0;
+
+    for (i = 0; i < NumberOfPages; i = i + noOfMissingPages)
+    {
+        DWORD pageIndex;
+
+        noOfMissingPages = 0;
+
+        LockAcquire(&CacheFile->PagesLock, &oldState);
+
+        // take all the pages already cached
+        for (pageIndex = (DWORD) firstPage + i;
+             (i < NumberOfPages) && (NULL != CacheFile->Pages[pageIndex]);
+             ++i, ++pageIndex)
+        {
+            Frames[i] = CacheFile->Pages[pageIndex];
+            noOfHits++;
+        }
+
+        // followed by the run of pages we must read from the disk
+        while ((i + noOfMissingPages < NumberOfPages)
+               && (noOfMissingPages < PAGE_CACHE_MAX_READ_PAGES)
+               && (NULL == CacheFile->Pages[pageIndex + noOfMissingPages]))
+        {
+            noOfMissingPages++;
+        }
+
+        LockRelease(&CacheFile->PagesLock, oldState);
+
+        if (0 == noOfMissingPages)
+        {
+            ASSERT(i == NumberOfPages);
+            break;
+        }
+
+        // the disk I/O is done without holding the lock
+        status = _PageCacheReadPages(CacheFile,
+                                     FileObject,
+                                     pageIndex,
+                                     noOfMissingPages,
+                                     &Frames[i]);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_PageCacheReadPages", status);
+            break;
+        }
+    }
+
+    _InterlockedExchangeAdd64(&m_pageCacheData.Hits, noOfHits);
+
+    return status;
+}
+
+void
+PageCacheGetStatistics(
+    OUT         PPAGE_CACHE_STATISTICS  Statistics
+    )
+{
+    INTR_STATE oldState;
+    PLIST_ENTRY pEntry;
+
+    ASSERT(NULL != Statistics);
+
+    memzero(Statistics, sizeof(PAGE_CACHE_STATISTICS));
+
+    LockAcquire(&m_pageCacheData.FileListLock, &oldState);
+
+    Statistics->NumberOfFiles = m_pageCacheData.NumberOfFiles;
+
+    for (pEntry = m_pageCacheData.FileList.Flink;
+         pEntry != &m_pageCacheData.FileList;
+         pEntry = pEntry->Flink)
+    {
+        PPAGE_CACHE_FILE pCacheFile = CONTAINING_RECORD(pEntry, PAGE_CACHE_FILE, NextFile);
+
+        if (0 != pCacheFile->ReferenceCount)
+        {
+            Statistics->NumberOfReferencedFiles++;
+        }
+    }
+
+    LockRelease(&m_pageCacheData.FileListLock, oldState);
+
+    Statistics->NumberOfPages = m_pageCacheData.NumberOfPages;
+    Statistics->Hits = m_pageCacheData.Hits;
+    Statistics->Misses = m_pageCacheData.Misses;
+    Statistics->NumberOfEvictedPages = m_pageCacheData.NumberOfEvictedPages;
+}
+
+REQUIRES_EXCL_LOCK(m_pageCacheData.FileListLock)
+static
+PTR_SUCCESS
+PPAGE_CACHE_FILE
+_PageCacheFindFile(
+    IN          PFILE_OBJECT            FileObject
+    )
+{
+    PLIST_ENTRY pEntry;
+
+    ASSERT(NULL != FileObject);
+    ASSERT(NULL != FileObject->FileName);
+
+    for (pEntry = m_pageCacheData.FileList.Flink;
+         pEntry != &m_pageCacheData.FileList;
+         pEntry = pEntry->Flink)
+    {
+        PPAGE_CACHE_FILE pCacheFile = CONTAINING_RECORD(pEntry, PAGE_CACHE_FILE, NextFile);
+
+        if ((pCacheFile->FileSystemDevice == FileObject->FileSystemDevice)
+            && (pCacheFile->FileSize == FileObject->FileSize)
+            && (0 == stricmp(pCacheFile->FileName, FileObject->FileName)))
+        {
+            return pCacheFile;
+        }
+    }
+
+    return NULL;
+}
+
+REQUIRES_EXCL_LOCK(m_pageCacheData.FileListLock)
+static
+void
+_PageCacheEvictUnreferencedFiles(
+    OUT         PLIST_ENTRY             EvictedFiles
+    )
+{
+    PLIST_ENTRY pEntry;
+
+    ASSERT(NULL != EvictedFiles);
+
+    pEntry = m_pageCacheData.FileList.Flink;
+    while (pEntry != &m_pageCacheData.FileList)
+    {
+        PPAGE_CACHE_FILE pCacheFile = CONTAINING_RECORD(pEntry, PAGE_CACHE_FILE, NextFile);
+
+        pEntry = pEntry->Flink;
+
+        // nobody has the frames of an unreferenced file mapped anymore
+        if (0 == pCacheFile->ReferenceCount)
+        {
+            RemoveEntryList(&pCacheFile->NextFile);
+            m_pageCacheData.NumberOfFiles--;
+
+            InsertTailList(EvictedFiles, &pCacheFile->NextFile);
+        }
+    }
+}
+
+static
+void
+_PageCacheDestroyFile(
+    _Pre_notnull_ _Post_ptr_invalid_
+                PPAGE_CACHE_FILE        CacheFile
+    )
+{
+    DWORD noOfReleasedPages;
+
+    ASSERT(NULL != CacheFile);
+    ASSERT(0 == CacheFile->ReferenceCount);
+
+    noOfReleasedPages = 0;
+
+    for (DWORD i = 0; i < CacheFile->NumberOfPages; ++i)
+    {
+        if (NULL != CacheFile->Pages[i])
+        {
+            PmmReleaseMemory(CacheFile->Pages[i], 1);
+            noOfReleasedPages++;
+        }
+    }
+
+    LOG_TRACE_VMM("Evicted %u pages of file %s from the page cache\n", noOfReleasedPages, CacheFile->FileName);
+
+    _InterlockedExchangeAdd64(&m_pageCacheData.NumberOfPages, -(INT64)noOfReleasedPages);
+    _InterlockedExchangeAdd64(&m_pageCacheData.NumberOfEvictedPages, noOfReleasedPages);
+
+    ExFreePoolWithTag(CacheFile, HEAP_PAGE_CACHE_TAG);
+}
+
+static
+STATUS
+_PageCacheReadPages(
+    INOUT       PPAGE_CACHE_FILE        CacheFile,
+    IN          PFILE_OBJECT            FileObject,
+    IN          DWORD                   FirstPage,
+    IN          DWORD                   NumberOfPages,
+    OUT_WRITES(NumberOfPages)
+                PHYSICAL_ADDRESS*       Frames
+    )
+{
+    STATUS status;
+    PHYSICAL_ADDRESS pa;
+    PVOID pMapping;
+    QWORD fileOffset;
+    QWORD bytesRead;
+    QWORD size;
+    INTR_STATE oldState;
+    DWORD noOfInstalledPages;
+
+    ASSERT(NULL != CacheFile);
+    ASSERT(NULL != FileObject);
+    ASSERT(0 != NumberOfPages && NumberOfPages <= PAGE_CACHE_MAX_READ_PAGES);
+    ASSERT(FirstPage + NumberOfPages <= CacheFile->NumberOfPages);
+    ASSERT(NULL != Frames);
+
+    pa = PmmReserveMemory(NumberOfPages);
+    if (NULL == pa)
+    {
+        if (1 == NumberOfPages)
+        {
+            LOG_ERROR("PmmReserveMemory failed!\n");
+            return STATUS_INSUFFICIENT_MEMORY;
+        }
+
+        // the physical memory is too fragmented for a single read, do it page by page
+        for (DWORD i = 0; i < NumberOfPages; ++i)
+        {
+            status = _PageCacheReadPages(CacheFile, FileObject, FirstPage + i, 1, &Frames[i]);
+            if (!SUCCEEDED(status))
+            {
+                return status;
+            }
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    size = (QWORD) NumberOfPages * PAGE_SIZE;
+    fileOffset = (QWORD) FirstPage * PAGE_SIZE;
+    bytesRead = 0;
+    noOfInstalledPages = 0;
+
+    pMapping = MmuMapSystemMemory(pa, size);
+    if (NULL == pMapping)
+    {
+        LOG_FUNC_ERROR_ALLOC("MmuMapSystemMemory", size);
+        PmmReleaseMemory(pa, NumberOfPages);
+        return STATUS_INSUFFICIENT_MEMORY;
+    }
+
+    status = IoReadFile(FileObject, size, &fileOffset, pMapping, &bytesRead);
+    if (SUCCEEDED(status))
+    {
+        ASSERT(bytesRead <= size);
+
+        // the part of the last page past the end of the file must not contain garbage
+        memzero(PtrOffset(pMapping, bytesRead), (DWORD)(size - bytesRead));
+    }
+    else
+    {
+        LOG_FUNC_ERROR("IoReadFile", status);
+    }
+
+    MmuUnmapSystemMemory(pMapping, size);
+    pMapping = NULL;
+
+    if (!SUCCEEDED(status))
+    {
+        PmmReleaseMemory(pa, NumberOfPages);
+        return status;
+    }
+
+    LockAcquire(&CacheFile->PagesLock, &oldState);
+    for (DWORD i = 0; i < NumberOfPages; ++i)
+    {
+        PHYSICAL_ADDRESS frame = PtrOffset(pa, (QWORD) i * PAGE_SIZE);
+
+        if (NULL == CacheFile->Pages[FirstPage + i])
+        {
+            CacheFile->Pages[FirstPage + i] = frame;
+            noOfInstalledPages++;
+        }
+        else
+        {
+            // another CPU read the same page in the meantime, use its frame so
+            // all the mappings will share it
+            PmmReleaseMemory(frame, 1);
+        }
+
+        Frames[i] = CacheFile->Pages[FirstPage + i];
+    }
+    LockRelease(&CacheFile->PagesLock, oldState);
+
+    _InterlockedExchangeAdd64(&m_pageCacheData.NumberOfPages, noOfInstalledPages);
+    _InterlockedExchangeAdd64(&m_pageCacheData.Misses, NumberOfPages);
+
+    return STATUS_SUCCESS;
+}
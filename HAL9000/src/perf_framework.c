@@ -2,6 +2,286 @@
 #include "perf_framework.h"
 #include "iomu.h"
 #include "rtc.h"
+#include "smp.h"
+#include "cpumu.h"
+#include "serial_comm.h"
+
+// Log-linear histogram: the values below 2 * PERF_HISTOGRAM_SUB_BUCKETS are
+// recorded exactly, each of the following powers of two is split in
+// PERF_HISTOGRAM_SUB_BUCKETS equal buckets => the relative error of a
+// recorded value is below 1 / PERF_HISTOGRAM_SUB_BUCKETS
+#define PERF_HISTOGRAM_PRECISION_BITS       7
+#define PERF_HISTOGRAM_SUB_BUCKETS          (1UL << PERF_HISTOGRAM_PRECISION_BITS)
+#define PERF_HISTOGRAM_BUCKETS              ((BITS_FOR_STRUCTURE(QWORD) + 1 - PERF_HISTOGRAM_PRECISION_BITS) * PERF_HISTOGRAM_SUB_BUCKETS)
+
+// percentiles are expressed in hundredths of a percent
+#define PERF_PERCENTILE_BASE                10000
+
+#define PERF_RECORD_BUFFER_SIZE             512
+
+typedef struct _PERF_HISTOGRAM
+{
+    QWORD               Total;
+    QWORD               Min;
+    QWORD               Max;
+    DWORD               Samples;
+
+    DWORD               Counts[PERF_HISTOGRAM_BUCKETS];
+} PERF_HISTOGRAM, *PPERF_HISTOGRAM;
+
+typedef struct _PERF_RUN_CTX
+{
+    PFUNC_TestPerformance   Function;
+    PVOID                   Context;
+    DWORD                   IterationCount;
+    DWORD                   WarmupIterations;
+    DWORD                   NumberOfCpus;
+
+    // one histogram for each CPU => the CPUs never write the same cache lines
+    // while measuring
+    PPERF_HISTOGRAM         Histograms;
+
+    // the CPUs take their histogram in the order they arrive and start the
+    // measurement only after all of them arrived
+    volatile DWORD          CpusArrived;
+    volatile DWORD          CpusFinished;
+} PERF_RUN_CTX, *PPERF_RUN_CTX;
+
+static FUNC_IpcProcessEvent _PerfRunOnCpu;
+
+static
+DWORD
+_PerfHistogramIndex(
+    IN      QWORD               Value
+    )
+{
+    unsigned long msb;
+    DWORD shift;
+
+    if (Value < 2 * PERF_HISTOGRAM_SUB_BUCKETS)
+    {
+        return (DWORD) Value;
+    }
+
+    _BitScanReverse64(&msb, Value);
+
+    // the value is shifted until only PERF_HISTOGRAM_PRECISION_BITS + 1 bits
+    // remain, the top bit is always set => each shift owns SUB_BUCKETS buckets
+    shift = msb - PERF_HISTOGRAM_PRECISION_BITS;
+
+    return shift * PERF_HISTOGRAM_SUB_BUCKETS + (DWORD) (Value >> shift);
+}
+
+static
+QWORD
+_PerfHistogramHighestValue(
+    IN      DWORD               Index
+    )
+{
+    DWORD shift;
+    QWORD top;
+
+    if (Index < 2 * PERF_HISTOGRAM_SUB_BUCKETS)
+    {
+        return Index;
+    }
+
+    shift = Index / PERF_HISTOGRAM_SUB_BUCKETS - 1;
+    top = Index - shift * PERF_HISTOGRAM_SUB_BUCKETS;
+
+    return ((top + 1) << shift) - 1;
+}
+
+static
+void
+_PerfHistogramRecord(
+    INOUT   PPERF_HISTOGRAM     Histogram,
+    IN      QWORD               Value
+    )
+{
+    Histogram->Counts[_PerfHistogramIndex(Value)]++;
+    Histogram->Total = Histogram->Total + Value;
+    Histogram->Min = min(Histogram->Min, Value);
+    Histogram->Max = max(Histogram->Max, Value);
+    Histogram->Samples++;
+}
+
+static
+QWORD
+_PerfHistogramsPercentile(
+    IN_READS(NumberOfHistograms)
+            PPERF_HISTOGRAM     Histograms,
+    IN      DWORD               NumberOfHistograms,
+    IN      QWORD               Samples,
+    IN      QWORD               MaxValue,
+    IN      DWORD               Percentile
+    )
+{
+    QWORD rank;
+    QWORD seen;
+
+    ASSERT(Samples != 0);
+
+    // nearest rank
+    rank = max(1, (Samples * Percentile + PERF_PERCENTILE_BASE - 1) / PERF_PERCENTILE_BASE);
+    seen = 0;
+
+    for (DWORD i = 0; i < PERF_HISTOGRAM_BUCKETS; ++i)
+    {
+        for (DWORD j = 0; j < NumberOfHistograms; ++j)
+        {
+            seen = seen + Histograms[j].Counts[i];
+        }
+
+        if (seen >= rank)
+        {
+            // the bucket may extend past the largest value recorded
+            return min(_PerfHistogramHighestValue(i), MaxValue);
+        }
+    }
+
+    NOT_REACHED;
+    return MaxValue;
+}
+
+static
+void
+_PerfRunIterations(
+    IN      PPERF_RUN_CTX       RunContext,
+    INOUT   PPERF_HISTOGRAM     Histogram
+    )
+{
+    QWORD startTick;
+    QWORD endTick;
+
+    for (DWORD i = 0; i < RunContext->WarmupIterations; ++i)
+    {
+        RunContext->Function(RunContext->Context);
+    }
+
+    for (DWORD i = 0; i < RunContext->IterationCount; ++i)
+    {
+        startTick = RtcGetTickCount();
+        RunContext->Function(RunContext->Context);
+        endTick = RtcGetTickCount();
+
+        ASSERT_INFO(endTick >= startTick,
+                    "End tick: 0x%X\nStart tick: 0x%X\n", endTick, startTick);
+
+        _PerfHistogramRecord(Histogram, endTick - startTick);
+    }
+}
+
+static
+STATUS
+(__cdecl _PerfRunOnCpu)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPERF_RUN_CTX pRunContext;
+    DWORD slot;
+
+    ASSERT(NULL != Context);
+
+    pRunContext = (PPERF_RUN_CTX) Context;
+
+    slot = _InterlockedIncrement(&pRunContext->CpusArrived) - 1;
+    ASSERT(slot < pRunContext->NumberOfCpus);
+
+    // start together => each CPU measures while all the others run the function
+    while (pRunContext->CpusArrived < pRunContext->NumberOfCpus)
+    {
+        _mm_pause();
+    }
+
+    _PerfRunIterations(pRunContext, &pRunContext->Histograms[slot]);
+
+    _InterlockedIncrement(&pRunContext->CpusFinished);
+
+    return STATUS_SUCCESS;
+}
+
+static
+SAL_SUCCESS
+STATUS
+_PerfRunOnMultipleCpus(
+    INOUT   PPERF_RUN_CTX       RunContext
+    )
+{
+    STATUS status;
+    INTR_STATE oldState;
+    BOOLEAN logState;
+    PPCPU pCurrentCpu;
+    PLIST_ENTRY pCpuListHead;
+    SMP_DESTINATION destination = { 0 };
+    DWORD selectedCpus;
+
+    // the current CPU must stay the same until the other CPUs finish and it
+    // must not be interrupted while measuring, just like them
+    oldState = CpuIntrDisable();
+
+    pCurrentCpu = GetCurrentPcpu();
+    ASSERT(NULL != pCurrentCpu);
+
+    SmpGetCpuList(&pCpuListHead);
+
+    selectedCpus = 1;
+    for (PLIST_ENTRY pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead && selectedCpus < RunContext->NumberOfCpus;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+
+        if (pCpu == pCurrentCpu || !pCpu->ApicInitialized || 0 == pCpu->LogicalApicId)
+        {
+            continue;
+        }
+
+        destination.Group.Affinity = destination.Group.Affinity | pCpu->LogicalApicId;
+        selectedCpus++;
+    }
+
+    if (selectedCpus < RunContext->NumberOfCpus)
+    {
+        CpuIntrSetState(oldState);
+
+        LOG_ERROR("Only %u CPUs can be addressed, %u were requested\n", selectedCpus, RunContext->NumberOfCpus);
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    // we do not wait for the handling, the current CPU has to join the others
+    // which are spinning until it arrives
+    status = SmpSendGenericIpiEx(_PerfRunOnCpu,
+                                 RunContext,
+                                 NULL,
+                                 NULL,
+                                 FALSE,
+                                 SmpIpiSendToGroup,
+                                 destination);
+    if (!SUCCEEDED(status))
+    {
+        CpuIntrSetState(oldState);
+
+        LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+        return status;
+    }
+
+    // the messages logged by the function would be measured as well
+    logState = LogSetState(FALSE);
+
+    _PerfRunOnCpu(RunContext);
+
+    while (RunContext->CpusFinished < RunContext->NumberOfCpus)
+    {
+        _mm_pause();
+    }
+
+    LogSetState(logState);
+
+    CpuIntrSetState(oldState);
+
+    return STATUS_SUCCESS;
+}
 
 void
 RunPerformanceFunction(
@@ -12,78 +292,138 @@ RunPerformanceFunction(
     OUT     PPERFORMANCE_STATS      PerfStats
     )
 {
-    QWORD startTick;
-    QWORD endTick;
-    QWORD* allTimes;
+    PERFORMANCE_OPTIONS options;
+    STATUS status;
+
+    options.IterationCount = IterationCount;
+    options.WarmupIterations = 0;
+    options.NumberOfCpus = 1;
+    options.MeasureInUs = MeasureInUs;
+
+    status = RunPerformanceFunctionEx(Function, Context, &options, PerfStats);
+    ASSERT_INFO(SUCCEEDED(status), "Status: 0x%x\n", status);
+}
+
+SAL_SUCCESS
+STATUS
+RunPerformanceFunctionEx(
+    IN      PFUNC_TestPerformance   Function,
+    IN_OPT  PVOID                   Context,
+    IN      PPERFORMANCE_OPTIONS    Options,
+    OUT     PPERFORMANCE_STATS      PerfStats
+    )
+{
+    STATUS status;
+    PERF_RUN_CTX runContext;
+    BOOLEAN logState;
+    QWORD samples;
     QWORD totalTime;
     QWORD minTime;
     QWORD maxTime;
-    QWORD meanTime;
-    DWORD i;
+    QWORD p50Time;
+    QWORD p90Time;
+    QWORD p99Time;
+    QWORD p999Time;
+
+    if (NULL == Function)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
 
-    ASSERT( NULL != Function );
-    ASSERT( NULL != PerfStats );
+    if (NULL == Options || 0 == Options->IterationCount)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (NULL == PerfStats)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
 
-    allTimes = NULL;
+    memzero(&runContext, sizeof(PERF_RUN_CTX));
 
-    allTimes = ExAllocatePoolWithTag(PoolAllocateZeroMemory | PoolAllocatePanicIfFail,
-                                     sizeof(QWORD) * IterationCount,
-                                     HEAP_TEST_TAG,
-                                     0
-                                     );
+    runContext.Function = Function;
+    runContext.Context = Context;
+    runContext.IterationCount = Options->IterationCount;
+    runContext.WarmupIterations = Options->WarmupIterations;
+    runContext.NumberOfCpus = max(1, Options->NumberOfCpus);
 
-    for (i = 0; i < IterationCount; ++i)
+    if (runContext.NumberOfCpus > 1 && runContext.NumberOfCpus > SmpGetNumberOfActiveCpus())
     {
-        BOOLEAN logState;
+        LOG_ERROR("%u CPUs requested, only %u are active\n", runContext.NumberOfCpus, SmpGetNumberOfActiveCpus());
+        return STATUS_INVALID_PARAMETER3;
+    }
 
+    runContext.Histograms = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                                  sizeof(PERF_HISTOGRAM) * runContext.NumberOfCpus,
+                                                  HEAP_TEST_TAG,
+                                                  0);
+    if (NULL == runContext.Histograms)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PERF_HISTOGRAM) * runContext.NumberOfCpus);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    for (DWORD i = 0; i < runContext.NumberOfCpus; ++i)
+    {
+        runContext.Histograms[i].Min = MAX_QWORD;
+    }
+
+    if (runContext.NumberOfCpus == 1)
+    {
+        // the messages logged by the function would be measured as well
         logState = LogSetState(FALSE);
-        startTick = RtcGetTickCount();
-        Function(Context);
-        endTick = RtcGetTickCount();
+        _PerfRunIterations(&runContext, &runContext.Histograms[0]);
         LogSetState(logState);
 
-        if (endTick == startTick)
-        {
-            /// TODO: why the fuck does this happen?
-            LOG_ERROR("End tick: 0x%X\nStart tick: 0x%X\n", endTick, startTick);
-            endTick = endTick + 1;
-        }
-        ASSERT_INFO( endTick > startTick, 
-                    "End tick: 0x%X\nStart tick: 0x%X\n", endTick, startTick );
-        allTimes[i] = endTick - startTick;
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        status = _PerfRunOnMultipleCpus(&runContext);
     }
 
+    if (SUCCEEDED(status))
+    {
+        samples = totalTime = maxTime = 0;
+        minTime = MAX_QWORD;
 
-    ASSERT(NULL != allTimes);
+        for (DWORD i = 0; i < runContext.NumberOfCpus; ++i)
+        {
+            PPERF_HISTOGRAM pHistogram = &runContext.Histograms[i];
 
-    totalTime = minTime = maxTime = allTimes[0];
+            ASSERT(MAX_QWORD - pHistogram->Total >= totalTime);
 
-    for (i = 1; i < IterationCount; ++i)
-    {
-        if (allTimes[i] < minTime)
-        {
-            minTime = allTimes[i];
-        }
-        else if (allTimes[i] > maxTime)
-        {
-            maxTime = allTimes[i];
+            samples = samples + pHistogram->Samples;
+            totalTime = totalTime + pHistogram->Total;
+            minTime = min(minTime, pHistogram->Min);
+            maxTime = max(maxTime, pHistogram->Max);
         }
 
-        ASSERT (MAX_QWORD - allTimes[i] >= totalTime);
+        p50Time = _PerfHistogramsPercentile(runContext.Histograms, runContext.NumberOfCpus, samples, maxTime, 5000);
+        p90Time = _PerfHistogramsPercentile(runContext.Histograms, runContext.NumberOfCpus, samples, maxTime, 9000);
+        p99Time = _PerfHistogramsPercentile(runContext.Histograms, runContext.NumberOfCpus, samples, maxTime, 9900);
+        p999Time = _PerfHistogramsPercentile(runContext.Histograms, runContext.NumberOfCpus, samples, maxTime, 9990);
+
+#define PERF_CONVERT(x)     (Options->MeasureInUs ? IomuTickCountToUs(x) : (x))
+        PerfStats->Mean = PERF_CONVERT(totalTime / samples);
+        PerfStats->Min = PERF_CONVERT(minTime);
+        PerfStats->Max = PERF_CONVERT(maxTime);
+        PerfStats->P50 = PERF_CONVERT(p50Time);
+        PerfStats->P90 = PERF_CONVERT(p90Time);
+        PerfStats->P99 = PERF_CONVERT(p99Time);
+        PerfStats->P999 = PERF_CONVERT(p999Time);
+#undef PERF_CONVERT
 
-        totalTime = totalTime + allTimes[i];
+        PerfStats->Samples = samples;
+        PerfStats->NumberOfCpus = runContext.NumberOfCpus;
+        PerfStats->MeasuredInUs = Options->MeasureInUs;
     }
-    meanTime = totalTime / IterationCount;
 
-    PerfStats->Min = MeasureInUs ? IomuTickCountToUs(minTime) : minTime;
-    PerfStats->Max = MeasureInUs ? IomuTickCountToUs(maxTime) : maxTime;
-    PerfStats->Mean = MeasureInUs ? IomuTickCountToUs(meanTime) : meanTime;
+    ExFreePoolWithTag(runContext.Histograms, HEAP_TEST_TAG);
+    runContext.Histograms = NULL;
 
-    if (NULL != allTimes)
-    {
-        ExFreePoolWithTag(allTimes, HEAP_TEST_TAG);
-        allTimes = NULL;
-    }
+    return status;
 }
 
 void
@@ -102,10 +442,17 @@ DisplayPerformanceStats(
     for (DWORD i = 0; i < NumberOfStats; ++i)
     {
         LOG("%s performance\n", StatNames[i]);
+        LOG("Samples: %U on %u CPU(s)\n", PerfStats[i].Samples, PerfStats[i].NumberOfCpus);
         LOG("Mean time: 0x%X\n", PerfStats[i].Mean);
         LOG("Min time: 0x%X\n", PerfStats[i].Min);
+        LOG("p50 time: 0x%X\n", PerfStats[i].P50);
+        LOG("p90 time: 0x%X\n", PerfStats[i].P90);
+        LOG("p99 time: 0x%X\n", PerfStats[i].P99);
+        LOG("p99.9 time: 0x%X\n", PerfStats[i].P999);
         LOG("Max time: 0x%X\n", PerfStats[i].Max);
 
+        PerfWriteStatsRecord(StatNames[i], &PerfStats[i]);
+
         if ((PerfStats[i].Mean == 0)
             || (PerfStats[i].Min == 0)
             || (PerfStats[i].Max == 0)
@@ -135,4 +482,40 @@ DisplayPerformanceStats(
         speedUp = (PerfStats[0].Min * 1000) / PerfStats[1].Max;
         LOG("Lowest speed-up: %2u.%03u\n", speedUp / 1000, speedUp % 1000);
     }
-}
\ No newline at end of file
+}
+
+void
+PerfWriteStatsRecord(
+    IN_Z    char*                   Name,
+    IN      PPERFORMANCE_STATS      PerfStats
+    )
+{
+    char buffer[PERF_RECORD_BUFFER_SIZE];
+    STATUS status;
+
+    ASSERT(NULL != Name);
+    ASSERT(NULL != PerfStats);
+
+    status = snprintf(buffer,
+                      PERF_RECORD_BUFFER_SIZE,
+                      "PERF {\"name\":\"%s\",\"cpus\":%u,\"samples\":%U,\"unit\":\"%s\","
+                      "\"mean\":%U,\"min\":%U,\"p50\":%U,\"p90\":%U,\"p99\":%U,\"p999\":%U,\"max\":%U}\n",
+                      Name,
+                      PerfStats->NumberOfCpus,
+                      PerfStats->Samples,
+                      PerfStats->MeasuredInUs ? "us" : "ticks",
+                      PerfStats->Mean,
+                      PerfStats->Min,
+                      PerfStats->P50,
+                      PerfStats->P90,
+                      PerfStats->P99,
+                      PerfStats->P999,
+                      PerfStats->Max);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("snprintf", status);
+        return;
+    }
+
+    SerialCommWriteBuffer(buffer);
+}
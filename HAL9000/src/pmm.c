@@ -3,6 +3,9 @@
 #include "int15.h"
 #include "bitmap.h"
 #include "synch.h"
+#include "cpumu.h"
+#include "smp.h"
+#include "mmu.h"
 
 typedef struct _MEMORY_REGION_LIST
 {
@@ -10,6 +13,15 @@ typedef struct _MEMORY_REGION_LIST
     DWORD               NumberOfEntries;
 } MEMORY_REGION_LIST, *PMEMORY_REGION_LIST;
 
+// Only used to determine how many usable frames each NUMA node has
+#define PMM_MAX_USABLE_RANGES           64
+
+typedef struct _PMM_USABLE_RANGE
+{
+    DWORD               FirstIndex;
+    DWORD               NumberOfFrames;
+} PMM_USABLE_RANGE, *PPMM_USABLE_RANGE;
+
 typedef struct _PMM_DATA
 {
     // Both of the highest physical address values are setup on initialization and
@@ -32,10 +44,20 @@ typedef struct _PMM_DATA
 
     MEMORY_REGION_LIST  MemoryRegionList[MemoryMapTypeMax];
 
+    // The ranges released to the allocator on initialization
+    DWORD               NumberOfUsableRanges;
+    PMM_USABLE_RANGE    UsableRanges[PMM_MAX_USABLE_RANGES];
+
     LOCK                AllocationLock;
 
     _Guarded_by_(AllocationLock)
     BITMAP              AllocationBitmap;
+
+    // Set by PmmInitNuma, before that frames are not accounted per node
+    BOOLEAN             NumaEnabled;
+
+    _Guarded_by_(AllocationLock)
+    PMM_NODE_STATISTICS NodeStatistics[NUMA_MAX_NODES];
 } PMM_DATA, *PPMM_DATA;
 
 static PMM_DATA m_pmmData;
@@ -62,6 +84,128 @@ _PmmInitializeAllocationBitmap(
     OUT                         DWORD*                      SizeReserved
     );
 
+static
+PTR_SUCCESS
+PHYSICAL_ADDRESS
+_PmmCpuCacheReserveFrame(
+    INOUT                       PPMM_CPU_CACHE              Cache,
+    IN                          NUMA_NODE                   Node
+    );
+
+static
+void
+_PmmCpuCacheReleaseFrame(
+    INOUT                       PPMM_CPU_CACHE              Cache,
+    IN                          PHYSICAL_ADDRESS            PhysicalAddr
+    );
+
+REQUIRES_EXCL_LOCK(Cache->Lock)
+static
+void
+_PmmCpuCacheRefill(
+    INOUT                       PPMM_CPU_CACHE              Cache,
+    IN                          NUMA_NODE                   Node
+    );
+
+REQUIRES_EXCL_LOCK(Cache->Lock)
+static
+void
+_PmmCpuCacheDrain(
+    INOUT                       PPMM_CPU_CACHE              Cache,
+    IN                          DWORD                       NoOfFrames
+    );
+
+//******************************************************************************
+// Function:     _PmmCpuCacheDrainAll
+// Description:  Returns all the frames of a CPU cache to the global allocator,
+//               the cache may belong to another CPU.
+// Returns:      DWORD - number of frames returned to the global allocator
+// Parameter:    INOUT PPMM_CPU_CACHE Cache
+//******************************************************************************
+static
+DWORD
+_PmmCpuCacheDrainAll(
+    INOUT                       PPMM_CPU_CACHE              Cache
+    );
+
+//******************************************************************************
+// Function:     _PmmDrainCpuCaches
+// Description:  Returns the frames cached by all the CPUs to the global
+//               allocator.
+// Returns:      DWORD - number of frames returned to the global allocator
+// Parameter:    void
+//******************************************************************************
+static
+DWORD
+_PmmDrainCpuCaches(
+    void
+    );
+
+//******************************************************************************
+// Function:     _PmmReclaimIdleFrames
+// Description:  Returns the frames held by the zero pool of the MMU and by the
+//               CPU caches to the global allocator, a reservation which cannot
+//               be satisfied from the bitmap is retried after this.
+// Returns:      DWORD - number of frames returned to the global allocator
+// Parameter:    void
+//******************************************************************************
+static
+DWORD
+_PmmReclaimIdleFrames(
+    void
+    );
+
+REQUIRES_EXCL_LOCK(m_pmmData.AllocationLock)
+static
+SIZE_SUCCESS
+DWORD
+_PmmScanAndFlipAligned(
+    IN                          DWORD                       NoOfFrames,
+    IN                          DWORD                       AlignmentInFrames
+    );
+
+//******************************************************************************
+// Function:     _PmmScanAndFlipPreferred
+// Description:  Reserves NoOfFrames continuous frames, looking first in the
+//               memory of Node and then in the memory of the other nodes in
+//               the order of their distance from Node.
+// Returns:      DWORD - index of the first frame, MAX_DWORD on failure
+// Parameter:    IN NUMA_NODE Node
+// Parameter:    IN DWORD NoOfFrames
+//******************************************************************************
+REQUIRES_EXCL_LOCK(m_pmmData.AllocationLock)
+static
+SIZE_SUCCESS
+DWORD
+_PmmScanAndFlipPreferred(
+    IN                          NUMA_NODE                   Node,
+    IN                          DWORD                       NoOfFrames
+    );
+
+//******************************************************************************
+// Function:     _PmmNumaAccountFrames
+// Description:  Updates the free frame counters of the nodes to which the
+//               frames belong after they were reserved or released.
+// Returns:      void
+// Parameter:    IN DWORD Index
+// Parameter:    IN DWORD NoOfFrames
+// Parameter:    IN BOOLEAN Reserved
+//******************************************************************************
+REQUIRES_EXCL_LOCK(m_pmmData.AllocationLock)
+static
+void
+_PmmNumaAccountFrames(
+    IN                          DWORD                       Index,
+    IN                          DWORD                       NoOfFrames,
+    IN                          BOOLEAN                     Reserved
+    );
+
+static
+NUMA_NODE
+_PmmGetCurrentNode(
+    void
+    );
+
 _No_competing_thread_
 void
 PmmPreinitSystem(
@@ -142,6 +286,55 @@ PmmInitSystem(
     return STATUS_SUCCESS;
 }
 
+_No_competing_thread_
+void
+PmmInitNuma(
+    void
+    )
+{
+    const NUMA_MEMORY_RANGE* pRanges;
+    DWORD noOfRanges;
+    DWORD maxIdx;
+    INTR_STATE oldState;
+
+    ASSERT(!m_pmmData.NumaEnabled);
+
+    pRanges = NumaGetMemoryRanges(&noOfRanges);
+    maxIdx = BitmapGetMaxElementCount(&m_pmmData.AllocationBitmap);
+
+    LockAcquire(&m_pmmData.AllocationLock, &oldState);
+    for (DWORD i = 0; i < noOfRanges; ++i)
+    {
+        PPMM_NODE_STATISTICS pStats = &m_pmmData.NodeStatistics[pRanges[i].Node];
+        QWORD rangeFirstIdx = AlignAddressUpper(pRanges[i].BaseAddress, PAGE_SIZE) / PAGE_SIZE;
+        QWORD rangeEndIdx = min(((QWORD) pRanges[i].BaseAddress + pRanges[i].Length) / PAGE_SIZE, maxIdx);
+
+        // only the usable RAM is ever handed out, the frames the kernel
+        // already reserved are part of the node but are not free
+        for (DWORD j = 0; j < m_pmmData.NumberOfUsableRanges; ++j)
+        {
+            QWORD firstIdx = max(rangeFirstIdx, m_pmmData.UsableRanges[j].FirstIndex);
+            QWORD endIdx = min(rangeEndIdx, (QWORD) m_pmmData.UsableRanges[j].FirstIndex + m_pmmData.UsableRanges[j].NumberOfFrames);
+
+            for (QWORD idx = firstIdx; idx < endIdx; ++idx)
+            {
+                pStats->TotalFrames++;
+                if (!BitmapGetBitValue(&m_pmmData.AllocationBitmap, (DWORD) idx))
+                {
+                    pStats->FreeFrames++;
+                }
+            }
+        }
+    }
+    m_pmmData.NumaEnabled = TRUE;
+    LockRelease(&m_pmmData.AllocationLock, oldState);
+
+    for (DWORD i = 0; i < NumaGetNumberOfNodes(); ++i)
+    {
+        LOG("Node %u has %U free frames\n", i, m_pmmData.NodeStatistics[i].FreeFrames);
+    }
+}
+
 PTR_SUCCESS
 PHYSICAL_ADDRESS
 PmmReserveMemoryEx(
@@ -151,6 +344,7 @@ PmmReserveMemoryEx(
 {
     DWORD idx;
     QWORD startIdx;
+    NUMA_NODE node;
 
     INTR_STATE oldState;
 
@@ -170,16 +364,106 @@ PmmReserveMemoryEx(
         return NULL;
     }
 
+    // Single frame requests with no placement constraints (page faults, paging
+    // structures) are served from the current CPU's cache
+    if ((1 == NoOfFrames) && (NULL == MinPhysAddr))
+    {
+        PPCPU pCpu;
+        PHYSICAL_ADDRESS pa;
+
+        oldState = CpuIntrDisable();
+        pCpu = GetCurrentPcpu();
+        pa = (NULL != pCpu) ? _PmmCpuCacheReserveFrame(&pCpu->FrameCache, pCpu->NumaNode) : NULL;
+        CpuIntrSetState(oldState);
+
+        if (NULL != pa)
+        {
+            return pa;
+        }
+
+        // the global allocator could not refill the cache, the frames we need
+        // may still be sitting in the caches of the other CPUs
+    }
+
+    // the node only matters for requests with no placement constraints
+    node = (NULL == MinPhysAddr) ? _PmmGetCurrentNode() : NUMA_INVALID_NODE;
+
     LockAcquire( &m_pmmData.AllocationLock, &oldState);
-    idx = BitmapScanFromAndFlip(&m_pmmData.AllocationBitmap, (DWORD) startIdx, NoOfFrames, FALSE );
+    idx = (NUMA_INVALID_NODE != node)
+        ? _PmmScanAndFlipPreferred(node, NoOfFrames)
+        : BitmapScanFromAndFlip(&m_pmmData.AllocationBitmap, (DWORD) startIdx, NoOfFrames, FALSE );
+    _PmmNumaAccountFrames(idx, NoOfFrames, TRUE);
+    LockRelease( &m_pmmData.AllocationLock, oldState);
+
     if (MAX_DWORD == idx)
     {
+        // The frames we need may be sitting in the zero pool or in the CPU
+        // caches, give them back and try once more
+        if (0 == _PmmReclaimIdleFrames())
+        {
+            return NULL;
+        }
+
+        LockAcquire( &m_pmmData.AllocationLock, &oldState);
+        idx = (NUMA_INVALID_NODE != node)
+            ? _PmmScanAndFlipPreferred(node, NoOfFrames)
+            : BitmapScanFromAndFlip(&m_pmmData.AllocationBitmap, (DWORD) startIdx, NoOfFrames, FALSE );
+        _PmmNumaAccountFrames(idx, NoOfFrames, TRUE);
         LockRelease( &m_pmmData.AllocationLock, oldState);
+
+        if (MAX_DWORD == idx)
+        {
+            return NULL;
+        }
+    }
+
+    return (PHYSICAL_ADDRESS) ( (QWORD) idx * PAGE_SIZE );
+}
+
+PTR_SUCCESS
+PHYSICAL_ADDRESS
+PmmReserveAlignedMemory(
+    IN          DWORD                   NoOfFrames,
+    IN          DWORD                   AlignmentInFrames
+    )
+{
+    DWORD idx;
+    INTR_STATE oldState;
+
+    if (0 == NoOfFrames)
+    {
+        return NULL;
+    }
+
+    if ((0 == AlignmentInFrames) || (0 != (AlignmentInFrames & (AlignmentInFrames - 1))))
+    {
         return NULL;
     }
 
+    LockAcquire( &m_pmmData.AllocationLock, &oldState);
+    idx = _PmmScanAndFlipAligned(NoOfFrames, AlignmentInFrames);
+    _PmmNumaAccountFrames(idx, NoOfFrames, TRUE);
     LockRelease( &m_pmmData.AllocationLock, oldState);
 
+    if (MAX_DWORD == idx)
+    {
+        // The frames cached by the CPUs may be breaking up an aligned range
+        if (0 == _PmmReclaimIdleFrames())
+        {
+            return NULL;
+        }
+
+        LockAcquire( &m_pmmData.AllocationLock, &oldState);
+        idx = _PmmScanAndFlipAligned(NoOfFrames, AlignmentInFrames);
+        _PmmNumaAccountFrames(idx, NoOfFrames, TRUE);
+        LockRelease( &m_pmmData.AllocationLock, oldState);
+
+        if (MAX_DWORD == idx)
+        {
+            return NULL;
+        }
+    }
+
     return (PHYSICAL_ADDRESS) ( (QWORD) idx * PAGE_SIZE );
 }
 
@@ -198,11 +482,96 @@ PmmReleaseMemory(
 
     ASSERT( index <= MAX_DWORD);
 
+    if (1 == NoOfFrames)
+    {
+        PPCPU pCpu;
+
+        oldState = CpuIntrDisable();
+        pCpu = GetCurrentPcpu();
+
+        // a frame of another node would be handed out by this CPU's cache
+        // to threads running on this node => it goes back to the bitmap
+        if ((NULL != pCpu)
+            && (!m_pmmData.NumaEnabled
+                || (1 == NumaGetNumberOfNodes())
+                || (NumaGetNodeOfAddress(PhysicalAddr) == pCpu->NumaNode)))
+        {
+            _PmmCpuCacheReleaseFrame(&pCpu->FrameCache, PhysicalAddr);
+            CpuIntrSetState(oldState);
+
+            return;
+        }
+        CpuIntrSetState(oldState);
+    }
+
     LockAcquire( &m_pmmData.AllocationLock, &oldState);
     BitmapClearBits(&m_pmmData.AllocationBitmap, (DWORD) index, NoOfFrames);
+    _PmmNumaAccountFrames((DWORD) index, NoOfFrames, FALSE);
     LockRelease( &m_pmmData.AllocationLock, oldState);
 }
 
+STATUS
+PmmGetNodeStatistics(
+    IN          NUMA_NODE               Node,
+    OUT         PPMM_NODE_STATISTICS    Statistics
+    )
+{
+    INTR_STATE oldState;
+    PLIST_ENTRY pCpuListHead;
+
+    if (Node >= NumaGetNumberOfNodes())
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Statistics)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    LockAcquire(&m_pmmData.AllocationLock, &oldState);
+    *Statistics = m_pmmData.NodeStatistics[Node];
+    LockRelease(&m_pmmData.AllocationLock, oldState);
+
+    // the cached frames were accounted as reserved when they were taken from
+    // the bitmap, but they are still free for anyone asking for them
+    SmpGetCpuList(&pCpuListHead);
+    for (PLIST_ENTRY pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPMM_CPU_CACHE pCache = &CONTAINING_RECORD(pCurEntry, PCPU, ListEntry)->FrameCache;
+
+        LockAcquire(&pCache->Lock, &oldState);
+        for (DWORD i = 0; i < pCache->NumberOfFrames; ++i)
+        {
+            if ((1 == NumaGetNumberOfNodes()) || (NumaGetNodeOfAddress(pCache->Frames[i]) == Node))
+            {
+                Statistics->FreeFrames++;
+            }
+        }
+        LockRelease(&pCache->Lock, oldState);
+    }
+
+    // a frame moving between a cache and the bitmap while we walk the caches
+    // may be counted twice
+    Statistics->FreeFrames = min(Statistics->FreeFrames, Statistics->TotalFrames);
+
+    return STATUS_SUCCESS;
+}
+
+void
+PmmInitCpuCache(
+    OUT         PPMM_CPU_CACHE          Cache
+    )
+{
+    ASSERT(NULL != Cache);
+
+    memzero(Cache, sizeof(PMM_CPU_CACHE));
+
+    LockInit(&Cache->Lock);
+}
+
 QWORD
 PmmGetTotalSystemMemory(
     void
@@ -363,8 +732,427 @@ _PmmInitializeAllocationBitmap(
         // here it is necessary to use PmmReleaseMemory
         PmmReleaseMemory(physAddr, (DWORD) noOfFrames );
 
+        if (m_pmmData.NumberOfUsableRanges < PMM_MAX_USABLE_RANGES)
+        {
+            m_pmmData.UsableRanges[m_pmmData.NumberOfUsableRanges].FirstIndex = (DWORD) ((QWORD) physAddr / PAGE_SIZE);
+            m_pmmData.UsableRanges[m_pmmData.NumberOfUsableRanges].NumberOfFrames = (DWORD) noOfFrames;
+            m_pmmData.NumberOfUsableRanges++;
+        }
+        else
+        {
+            LOG_WARNING("Too many usable memory ranges, the NUMA statistics will be incomplete\n");
+        }
+
         LOG("Releasing %d frames of memory starting from PA 0x%X\n", noOfFrames, physAddr );
     }
 
     LOG_FUNC_END;
-}
\ No newline at end of file
+}
+
+static
+PTR_SUCCESS
+PHYSICAL_ADDRESS
+_PmmCpuCacheReserveFrame(
+    INOUT                       PPMM_CPU_CACHE              Cache,
+    IN                          NUMA_NODE                   Node
+    )
+{
+    PHYSICAL_ADDRESS pa;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Cache);
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pa = NULL;
+
+    LockAcquire(&Cache->Lock, &oldState);
+    if (0 != Cache->NumberOfFrames)
+    {
+        Cache->Hits++;
+    }
+    else
+    {
+        Cache->Misses++;
+
+        _PmmCpuCacheRefill(Cache, Node);
+    }
+
+    // if the cache is still empty the global allocator is depleted as well
+    if (0 != Cache->NumberOfFrames)
+    {
+        Cache->NumberOfFrames--;
+        pa = Cache->Frames[Cache->NumberOfFrames];
+    }
+    LockRelease(&Cache->Lock, oldState);
+
+    return pa;
+}
+
+static
+void
+_PmmCpuCacheReleaseFrame(
+    INOUT                       PPMM_CPU_CACHE              Cache,
+    IN                          PHYSICAL_ADDRESS            PhysicalAddr
+    )
+{
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Cache);
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    LockAcquire(&Cache->Lock, &oldState);
+    if (PMM_CPU_CACHE_CAPACITY == Cache->NumberOfFrames)
+    {
+        _PmmCpuCacheDrain(Cache, PMM_CPU_CACHE_BATCH_SIZE);
+    }
+
+    ASSERT(Cache->NumberOfFrames < PMM_CPU_CACHE_CAPACITY);
+
+    // the most recently freed frame will be the first one handed out => it is
+    // the most likely to still be in the CPU's caches
+    Cache->Frames[Cache->NumberOfFrames] = PhysicalAddr;
+    Cache->NumberOfFrames++;
+    LockRelease(&Cache->Lock, oldState);
+}
+
+REQUIRES_EXCL_LOCK(Cache->Lock)
+static
+void
+_PmmCpuCacheRefill(
+    INOUT                       PPMM_CPU_CACHE              Cache,
+    IN                          NUMA_NODE                   Node
+    )
+{
+    DWORD idx;
+    DWORD i;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Cache);
+    ASSERT(0 == Cache->NumberOfFrames);
+
+    LockAcquire(&m_pmmData.AllocationLock, &oldState);
+
+    // try to take the whole batch with a single bitmap scan, we place the frames
+    // in reverse order so the lowest address is the first one handed out
+    idx = _PmmScanAndFlipPreferred(Node, PMM_CPU_CACHE_BATCH_SIZE);
+    if (MAX_DWORD != idx)
+    {
+        _PmmNumaAccountFrames(idx, PMM_CPU_CACHE_BATCH_SIZE, TRUE);
+
+        for (i = 0; i < PMM_CPU_CACHE_BATCH_SIZE; ++i)
+        {
+            Cache->Frames[i] = (PHYSICAL_ADDRESS) ((QWORD) (idx + PMM_CPU_CACHE_BATCH_SIZE - 1 - i) * PAGE_SIZE);
+        }
+        Cache->NumberOfFrames = PMM_CPU_CACHE_BATCH_SIZE;
+    }
+    else
+    {
+        // memory is fragmented, pick up whatever frames we can find
+        for (i = 0; i < PMM_CPU_CACHE_BATCH_SIZE; ++i)
+        {
+            idx = _PmmScanAndFlipPreferred(Node, 1);
+            if (MAX_DWORD == idx)
+            {
+                break;
+            }
+            _PmmNumaAccountFrames(idx, 1, TRUE);
+
+            Cache->Frames[Cache->NumberOfFrames] = (PHYSICAL_ADDRESS) ((QWORD) idx * PAGE_SIZE);
+            Cache->NumberOfFrames++;
+        }
+    }
+
+    LockRelease(&m_pmmData.AllocationLock, oldState);
+
+    Cache->Refills++;
+}
+
+REQUIRES_EXCL_LOCK(Cache->Lock)
+static
+void
+_PmmCpuCacheDrain(
+    INOUT                       PPMM_CPU_CACHE              Cache,
+    IN                          DWORD                       NoOfFrames
+    )
+{
+    DWORD i;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Cache);
+    ASSERT(NoOfFrames <= Cache->NumberOfFrames);
+
+    // the oldest frames are at the bottom of the cache, these are the ones we
+    // return to the global allocator
+    LockAcquire(&m_pmmData.AllocationLock, &oldState);
+    for (i = 0; i < NoOfFrames; ++i)
+    {
+        DWORD idx = (DWORD) ((QWORD) Cache->Frames[i] / PAGE_SIZE);
+
+        BitmapClearBit(&m_pmmData.AllocationBitmap, idx);
+        _PmmNumaAccountFrames(idx, 1, FALSE);
+    }
+    LockRelease(&m_pmmData.AllocationLock, oldState);
+
+    Cache->NumberOfFrames = Cache->NumberOfFrames - NoOfFrames;
+    memmove(&Cache->Frames[0], &Cache->Frames[NoOfFrames], Cache->NumberOfFrames * sizeof(PHYSICAL_ADDRESS));
+
+    Cache->Drains++;
+}
+
+static
+DWORD
+_PmmCpuCacheDrainAll(
+    INOUT                       PPMM_CPU_CACHE              Cache
+    )
+{
+    DWORD noOfFrames;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Cache);
+
+    LockAcquire(&Cache->Lock, &oldState);
+    noOfFrames = Cache->NumberOfFrames;
+    if (0 != noOfFrames)
+    {
+        _PmmCpuCacheDrain(Cache, noOfFrames);
+    }
+    LockRelease(&Cache->Lock, oldState);
+
+    return noOfFrames;
+}
+
+static
+DWORD
+_PmmDrainCpuCaches(
+    void
+    )
+{
+    PLIST_ENTRY pCpuListHead;
+    DWORD noOfFrames;
+    PPCPU pCpu;
+    INTR_STATE oldState;
+
+    pCpuListHead = NULL;
+    noOfFrames = 0;
+
+    // the BSP uses its cache before it is placed in the CPU list
+    oldState = CpuIntrDisable();
+    pCpu = GetCurrentPcpu();
+    CpuIntrSetState(oldState);
+
+    if (NULL != pCpu)
+    {
+        noOfFrames = noOfFrames + _PmmCpuCacheDrainAll(&pCpu->FrameCache);
+    }
+
+    SmpGetCpuList(&pCpuListHead);
+    for (PLIST_ENTRY pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        noOfFrames = noOfFrames + _PmmCpuCacheDrainAll(&CONTAINING_RECORD(pCurEntry, PCPU, ListEntry)->FrameCache);
+    }
+
+    return noOfFrames;
+}
+
+static
+DWORD
+_PmmReclaimIdleFrames(
+    void
+    )
+{
+    DWORD noOfFrames;
+
+    // the zero pool goes first, the frames it releases land in the cache of
+    // this CPU and are returned to the bitmap together with the others
+    noOfFrames = MmuDrainZeroedFrames();
+    noOfFrames = noOfFrames + _PmmDrainCpuCaches();
+
+    return noOfFrames;
+}
+
+REQUIRES_EXCL_LOCK(m_pmmData.AllocationLock)
+static
+SIZE_SUCCESS
+DWORD
+_PmmScanAndFlipAligned(
+    IN                          DWORD                       NoOfFrames,
+    IN                          DWORD                       AlignmentInFrames
+    )
+{
+    DWORD idx;
+    DWORD maxIdx;
+
+    ASSERT(0 != NoOfFrames);
+    ASSERT(0 != AlignmentInFrames);
+
+    maxIdx = BitmapGetMaxElementCount(&m_pmmData.AllocationBitmap);
+    idx = 0;
+
+    // each scan returns the first free range at or after idx, if it does not
+    // start on an aligned frame no aligned range can start before the next
+    // alignment boundary
+    while (idx < maxIdx)
+    {
+        idx = BitmapScanFrom(&m_pmmData.AllocationBitmap, idx, NoOfFrames, FALSE);
+        if (MAX_DWORD == idx)
+        {
+            return MAX_DWORD;
+        }
+
+        if (IsAddressAligned(idx, AlignmentInFrames))
+        {
+            BitmapSetBits(&m_pmmData.AllocationBitmap, idx, NoOfFrames);
+            return idx;
+        }
+
+        idx = (DWORD) AlignAddressUpper(idx, AlignmentInFrames);
+    }
+
+    return MAX_DWORD;
+}
+
+REQUIRES_EXCL_LOCK(m_pmmData.AllocationLock)
+static
+SIZE_SUCCESS
+DWORD
+_PmmScanAndFlipPreferred(
+    IN                          NUMA_NODE                   Node,
+    IN                          DWORD                       NoOfFrames
+    )
+{
+    const NUMA_NODE* pOrder;
+    const NUMA_MEMORY_RANGE* pRanges;
+    DWORD noOfRanges;
+    DWORD noOfNodes;
+    DWORD maxIdx;
+    DWORD idx;
+
+    ASSERT(0 != NoOfFrames);
+
+    noOfNodes = NumaGetNumberOfNodes();
+    if (!m_pmmData.NumaEnabled || noOfNodes <= 1)
+    {
+        return BitmapScanAndFlip(&m_pmmData.AllocationBitmap, NoOfFrames, FALSE);
+    }
+
+    pOrder = NumaGetFallbackOrder(Node);
+    pRanges = NumaGetMemoryRanges(&noOfRanges);
+    maxIdx = BitmapGetMaxElementCount(&m_pmmData.AllocationBitmap);
+
+    for (DWORD i = 0; i < noOfNodes; ++i)
+    {
+        // don't bother scanning the nodes which cannot satisfy the request
+        if (m_pmmData.NodeStatistics[pOrder[i]].FreeFrames < NoOfFrames)
+        {
+            continue;
+        }
+
+        for (DWORD j = 0; j < noOfRanges; ++j)
+        {
+            QWORD firstIdx;
+            QWORD endIdx;
+
+            if (pRanges[j].Node != pOrder[i])
+            {
+                continue;
+            }
+
+            firstIdx = AlignAddressUpper(pRanges[j].BaseAddress, PAGE_SIZE) / PAGE_SIZE;
+            endIdx = min(((QWORD) pRanges[j].BaseAddress + pRanges[j].Length) / PAGE_SIZE, maxIdx);
+            if (firstIdx + NoOfFrames > endIdx)
+            {
+                continue;
+            }
+
+            idx = BitmapScanFromToAndFlip(&m_pmmData.AllocationBitmap, (DWORD) firstIdx, (DWORD) endIdx, NoOfFrames, FALSE);
+            if (MAX_DWORD != idx)
+            {
+                return idx;
+            }
+        }
+    }
+
+    // the free frames of each node are too fragmented, but the request may
+    // still be satisfied by frames which straddle two ranges
+    return BitmapScanAndFlip(&m_pmmData.AllocationBitmap, NoOfFrames, FALSE);
+}
+
+REQUIRES_EXCL_LOCK(m_pmmData.AllocationLock)
+static
+void
+_PmmNumaAccountFrames(
+    IN                          DWORD                       Index,
+    IN                          DWORD                       NoOfFrames,
+    IN                          BOOLEAN                     Reserved
+    )
+{
+    const NUMA_MEMORY_RANGE* pRanges;
+    DWORD noOfRanges;
+    QWORD endIdx;
+
+    if (!m_pmmData.NumaEnabled || MAX_DWORD == Index)
+    {
+        return;
+    }
+
+    pRanges = NumaGetMemoryRanges(&noOfRanges);
+    endIdx = (QWORD) Index + NoOfFrames;
+
+    // frames outside all the ranges were never counted, and neither were the
+    // frames of a range which are not usable RAM (see PmmInitNuma)
+    for (DWORD i = 0; i < noOfRanges; ++i)
+    {
+        QWORD rangeFirstIdx = AlignAddressUpper(pRanges[i].BaseAddress, PAGE_SIZE) / PAGE_SIZE;
+        QWORD rangeEndIdx = ((QWORD) pRanges[i].BaseAddress + pRanges[i].Length) / PAGE_SIZE;
+        PPMM_NODE_STATISTICS pStats = &m_pmmData.NodeStatistics[pRanges[i].Node];
+
+        rangeFirstIdx = max(rangeFirstIdx, Index);
+        rangeEndIdx = min(rangeEndIdx, endIdx);
+        if (rangeFirstIdx >= rangeEndIdx)
+        {
+            continue;
+        }
+
+        for (DWORD j = 0; j < m_pmmData.NumberOfUsableRanges; ++j)
+        {
+            QWORD firstIdx = max(rangeFirstIdx, m_pmmData.UsableRanges[j].FirstIndex);
+            QWORD lastIdx = min(rangeEndIdx, (QWORD) m_pmmData.UsableRanges[j].FirstIndex + m_pmmData.UsableRanges[j].NumberOfFrames);
+
+            if (firstIdx >= lastIdx)
+            {
+                continue;
+            }
+
+            if (Reserved)
+            {
+                ASSERT(pStats->FreeFrames >= lastIdx - firstIdx);
+                pStats->FreeFrames = pStats->FreeFrames - (lastIdx - firstIdx);
+            }
+            else
+            {
+                pStats->FreeFrames = pStats->FreeFrames + (lastIdx - firstIdx);
+                ASSERT(pStats->FreeFrames <= pStats->TotalFrames);
+            }
+        }
+    }
+}
+
+static
+NUMA_NODE
+_PmmGetCurrentNode(
+    void
+    )
+{
+    PPCPU pCpu;
+    NUMA_NODE node;
+    INTR_STATE oldState;
+
+    oldState = CpuIntrDisable();
+    pCpu = GetCurrentPcpu();
+    node = (NULL != pCpu) ? pCpu->NumaNode : 0;
+    CpuIntrSetState(oldState);
+
+    return node;
+}
@@ -7,6 +7,11 @@
 #include "bitmap.h"
 #include "pte.h"
 #include "pe_exports.h"
+#include "io.h"
+#include "iomu.h"
+
+#define PROCESS_PID_TABLE_BUCKETS       64
+#define PROCESS_PID_TABLE_LOCKS         8
 
 typedef struct _PROCESS_SYSTEM_DATA
 {
@@ -20,6 +25,11 @@ typedef struct _PROCESS_SYSTEM_DATA
 
     LIST_ENTRY      ProcessList;
     MUTEX           ProcessListLock;
+
+    // Finds a process by its PID without taking ProcessListLock
+    CONC_HASH_TABLE     PidTable;
+    PCONC_HASH_ENTRY    PidTableBuckets[PROCESS_PID_TABLE_BUCKETS];
+    LOCK                PidTableLocks[PROCESS_PID_TABLE_LOCKS];
 } PROCESS_SYSTEM_DATA, *PPROCESS_SYSTEM_DATA;
 
 static PROCESS_SYSTEM_DATA m_processData;
@@ -101,12 +111,16 @@ _ProcessParseCommandLine(
 // Called when the reference count reaches zero
 static FUNC_FreeFunction            _ProcessDestroy;
 
+static FUNC_ConcHashReferenceFunction   _ProcessTryReference;
+
 _No_competing_thread_
 void
 ProcessSystemPreinit(
     void
     )
 {
+    STATUS status;
+
     memzero(&m_processData, sizeof(PROCESS_SYSTEM_DATA));
 
     ASSERT(ARRAYSIZE(m_processData.PidBitmapBuffer) == BitmapPreinit(&m_processData.PidBitmap, PCID_TOTAL_NO_OF_VALUES));
@@ -120,6 +134,14 @@ ProcessSystemPreinit(
 
     MutexInit(&m_processData.ProcessListLock, FALSE);
     InitializeListHead(&m_processData.ProcessList);
+
+    status = ConcHashTableInit(&m_processData.PidTable,
+                               m_processData.PidTableBuckets,
+                               ARRAYSIZE(m_processData.PidTableBuckets),
+                               m_processData.PidTableLocks,
+                               ARRAYSIZE(m_processData.PidTableLocks),
+                               FIELD_OFFSET(PROCESS, Id) - FIELD_OFFSET(PROCESS, PidTableEntry));
+    ASSERT(SUCCEEDED(status));
 }
 
 _No_competing_thread_
@@ -161,6 +183,19 @@ ProcessRetrieveSystemProcess(
     return m_processData.SystemProcess;
 }
 
+PTR_SUCCESS
+PPROCESS
+ProcessRetrieveById(
+    IN      PID                 ProcessId
+    )
+{
+    PCONC_HASH_ENTRY pEntry;
+
+    pEntry = ConcHashTableLookup(&m_processData.PidTable, ProcessId, _ProcessTryReference);
+
+    return (pEntry != NULL) ? CONTAINING_RECORD(pEntry, PROCESS, PidTableEntry) : NULL;
+}
+
 STATUS
 ProcessExecuteForEachProcessEntry(
     IN      PFUNC_ListFunction  Function,
@@ -197,7 +232,7 @@ ProcessActivatePagingTables(
 
     ASSERT(PCID_IS_VALID(Process->Id));
 
-    VmmChangeCr3(Process->PagingData->Data.BasePhysicalAddress,
+    VmmChangeCr3(&Process->PagingData->Data,
                  (PCID)Process->Id,
                  InvalidateAddressSpace);
 }
@@ -211,6 +246,7 @@ ProcessCreate(
 {
     STATUS status;
     PPROCESS pProcess;
+    QWORD startTimeUs;
 
     if (PathToExe == NULL)
     {
@@ -226,6 +262,7 @@ ProcessCreate(
 
     status = STATUS_SUCCESS;
     pProcess = NULL;
+    startTimeUs = IomuGetSystemTimeUs();
 
     __try
     {
@@ -244,10 +281,12 @@ ProcessCreate(
         }
         LOG_TRACE_PROCESS("Successfully initialized process!\n");
 
+        pProcess->CreationTimeUs = startTimeUs;
+
         // This function must be called before MmuCreateAddressSpaceForProcess to be able to
         // determine the address from which the VA allocations should start (so they'll not
         // conflict with the PE image)
-        status = UmApplicationRetrieveHeader(PathToExe, pProcess->HeaderInfo);
+        status = UmApplicationRetrieveHeader(PathToExe, pProcess->HeaderInfo, &pProcess->ImageFile);
         if (!SUCCEEDED(status))
         {
             LOG_FUNC_ERROR("UmApplicationRetrieveHeader", status);
@@ -352,6 +391,16 @@ ProcessIsSystem(
     return m_processData.SystemProcess->Id == pid;
 }
 
+QWORD
+ProcessGetTimeToFirstInstruction(
+    IN          PPROCESS    Process
+    )
+{
+    ASSERT(Process != NULL);
+
+    return Process->TimeToFirstInstructionUs;
+}
+
 void
 ProcessTerminate(
     INOUT       PPROCESS    Process
@@ -504,6 +553,10 @@ _ProcessInit(
         InsertTailList(&m_processData.ProcessList, &pProcess->NextProcess);
         MutexRelease(&m_processData.ProcessListLock);
 
+        // a PID is freed only after its previous process left the table
+        status = ConcHashTableInsert(&m_processData.PidTable, &pProcess->PidTableEntry);
+        ASSERT(SUCCEEDED(status));
+
         LOG_TRACE_PROCESS("Process with PID 0x%X created\n", pProcess->Id);
     }
     __finally
@@ -692,6 +745,15 @@ ProcessRemoveThreadFromList(
     }
 }
 
+static
+BOOLEAN
+(__cdecl _ProcessTryReference)(
+    IN      PCONC_HASH_ENTRY        Entry
+    )
+{
+    return RfcTryReference(&CONTAINING_RECORD(Entry, PROCESS, PidTableEntry)->RefCnt);
+}
+
 static
 void
 _ProcessDestroy(
@@ -718,6 +780,10 @@ _ProcessDestroy(
     RemoveEntryList(&Process->NextProcess);
     MutexRelease(&m_processData.ProcessListLock);
 
+    // Must be done before the PID is freed, the processes which failed
+    // initialization were never inserted
+    ConcHashTableRemoveEntry(&m_processData.PidTable, &Process->PidTableEntry);
+
     if (NULL != Process->FullCommandLine)
     {
         ExFreePoolWithTag(Process->FullCommandLine, HEAP_PROCESS_TAG);
@@ -740,6 +806,17 @@ _ProcessDestroy(
     // these memory addresses unconditionally
     MmuDestroyAddressSpaceForProcess(Process);
 
+    // The image sections were released together with the address space
+    if (NULL != Process->ImageFile)
+    {
+        STATUS status = IoCloseFile(Process->ImageFile);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCloseFile", status);
+        }
+        Process->ImageFile = NULL;
+    }
+
     if (Process->Id != 0)
     {
         // This should be done only after MmuDestroyVirtualSpaceForProcess, that
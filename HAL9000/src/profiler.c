@@ -0,0 +1,704 @@
+#include "HAL9000.h"
+#include "profiler.h"
+#include "smp.h"
+#include "cpumu.h"
+#include "lapic_system.h"
+#include "thread_internal.h"
+#include "process_internal.h"
+#include "pe_parser.h"
+#include "hash_table.h"
+#include "bin_heap.h"
+
+// distinct functions aggregated by ProfilerDump, the frames of the functions
+// found after the table filled up are not attributed
+#define PROFILER_MAX_FUNCTIONS              4096
+
+// no kernel function starts at address 0 => all the user-mode samples are
+// attributed to this key
+#define PROFILER_USER_MODE_KEY              0
+
+#define PROFILER_FUNCTION_NAME_MAX_CHARS    32
+
+STATIC_ASSERT(RegisterRsp == PE_UNWIND_REGISTER_RSP);
+STATIC_ASSERT(RegisterR15 + 1 == PE_UNWIND_NUMBER_OF_REGISTERS);
+
+typedef struct _PROFILER_CPU_DATA
+{
+    APIC_ID                 ApicId;
+
+    // Samples[SamplesTaken % PROFILER_SAMPLES_PER_CPU] is the next slot
+    // written => once the buffer is full the oldest samples are overwritten
+    QWORD                   SamplesTaken;
+    PROFILER_SAMPLE         Samples[PROFILER_SAMPLES_PER_CPU];
+} PROFILER_CPU_DATA, *PPROFILER_CPU_DATA;
+
+typedef struct _PROFILER_DATA
+{
+    // Serializes ProfilerStart, ProfilerStop and ProfilerDump
+    volatile BOOLEAN        Busy;
+
+    // Checked by ProfilerRecordSample on each interrupt, the buffers and the
+    // fields below are valid while it is set
+    volatile BOOLEAN        Running;
+
+    BYTE                    TimerVector;
+    PPE_NT_HEADER_INFO      KernelInfo;
+
+    // Indexed by APIC ID, the buffers are kept after the profiler is stopped
+    // so the samples can be dumped
+    PPROFILER_CPU_DATA      Cpus[MAX_BYTE + 1];
+} PROFILER_DATA, *PPROFILER_DATA;
+
+typedef struct _PROFILER_FUNCTION
+{
+    // The start of the function, the address itself for the leaf functions
+    // and the addresses outside the kernel image
+    QWORD                   Key;
+    HASH_ENTRY              HashEntry;
+
+    BIN_HEAP_ENTRY          HeapEntry;
+
+    QWORD                   SelfSamples;
+    QWORD                   TotalSamples;
+} PROFILER_FUNCTION, *PPROFILER_FUNCTION;
+
+static PROFILER_DATA m_profilerData;
+
+static FUNC_IpcProcessEvent         _ProfilerEnableTimer;
+static FUNC_IpcProcessEvent         _ProfilerDisableTimer;
+static FUNC_BinHeapCompareFunction  _ProfilerCompareFunctions;
+static FUNC_BinHeapAllocFunction    _ProfilerAllocHeap;
+static FUNC_FreeFunction            _ProfilerFreeHeap;
+
+static
+void
+_ProfilerFreeBuffers(
+    void
+    );
+
+static
+QWORD
+_ProfilerFunctionKey(
+    IN      QWORD                   Address
+    );
+
+static
+void
+_ProfilerLogFunction(
+    IN      PPROFILER_FUNCTION      Function,
+    IN      QWORD                   NumberOfSamples
+    );
+
+SAL_SUCCESS
+STATUS
+ProfilerStart(
+    IN      DWORD                           PeriodUs
+    )
+{
+    STATUS status;
+    PLIST_ENTRY pCpuListHead;
+    SMP_DESTINATION destination = { 0 };
+
+    if (PeriodUs < PROFILER_MIN_PERIOD_US || PeriodUs > PROFILER_MAX_PERIOD_US)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (TRUE == _InterlockedCompareExchange8(&m_profilerData.Busy, TRUE, FALSE))
+    {
+        return STATUS_DEVICE_BUSY;
+    }
+
+    status = STATUS_SUCCESS;
+
+    __try
+    {
+        if (m_profilerData.Running)
+        {
+            status = STATUS_ALREADY_INITIALIZED;
+            __leave;
+        }
+
+        _ProfilerFreeBuffers();
+
+        SmpGetCpuList(&pCpuListHead);
+
+        for (PLIST_ENTRY pCurEntry = pCpuListHead->Flink;
+             pCurEntry != pCpuListHead;
+             pCurEntry = pCurEntry->Flink)
+        {
+            PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+            PPROFILER_CPU_DATA pCpuData;
+
+            pCpuData = ExAllocatePoolWithTag(0, sizeof(PROFILER_CPU_DATA), HEAP_PROFILER_TAG, 0);
+            if (NULL == pCpuData)
+            {
+                LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PROFILER_CPU_DATA));
+                status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
+
+            pCpuData->ApicId = pCpu->ApicId;
+            pCpuData->SamplesTaken = 0;
+
+            m_profilerData.Cpus[pCpu->ApicId] = pCpuData;
+        }
+
+        m_profilerData.KernelInfo = ProcessRetrieveSystemProcess()->HeaderInfo;
+        m_profilerData.TimerVector = SmpGetApicTimerVector();
+
+        // the buffers must be visible before the first sample is recorded
+        _InterlockedExchange8(&m_profilerData.Running, TRUE);
+
+        status = SmpSendGenericIpiEx(_ProfilerEnableTimer,
+                                     (PVOID) (QWORD) PeriodUs,
+                                     NULL,
+                                     NULL,
+                                     TRUE,
+                                     SmpIpiSendToAllIncludingSelf,
+                                     destination);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+
+            // some of the CPUs may have armed their timers
+            _InterlockedExchange8(&m_profilerData.Running, FALSE);
+            SmpSendGenericIpiEx(_ProfilerDisableTimer,
+                                NULL,
+                                NULL,
+                                NULL,
+                                TRUE,
+                                SmpIpiSendToAllIncludingSelf,
+                                destination);
+            __leave;
+        }
+
+        LOG("Profiler started, each CPU is sampled every %u us\n", PeriodUs);
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status) && STATUS_ALREADY_INITIALIZED != status)
+        {
+            _ProfilerFreeBuffers();
+        }
+
+        _InterlockedExchange8(&m_profilerData.Busy, FALSE);
+    }
+
+    return status;
+}
+
+SAL_SUCCESS
+STATUS
+ProfilerStop(
+    void
+    )
+{
+    STATUS status;
+    SMP_DESTINATION destination = { 0 };
+
+    if (TRUE == _InterlockedCompareExchange8(&m_profilerData.Busy, TRUE, FALSE))
+    {
+        return STATUS_DEVICE_BUSY;
+    }
+
+    if (!m_profilerData.Running)
+    {
+        _InterlockedExchange8(&m_profilerData.Busy, FALSE);
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    _InterlockedExchange8(&m_profilerData.Running, FALSE);
+
+    // each CPU handles the IPI after the timer interrupt it may be handling
+    // => once all of them handled it no more samples are written
+    status = SmpSendGenericIpiEx(_ProfilerDisableTimer,
+                                 NULL,
+                                 NULL,
+                                 NULL,
+                                 TRUE,
+                                 SmpIpiSendToAllIncludingSelf,
+                                 destination);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+    }
+
+    _InterlockedExchange8(&m_profilerData.Busy, FALSE);
+
+    return status;
+}
+
+void
+ProfilerRecordSample(
+    IN      BYTE                            InterruptIndex,
+    IN      PINTERRUPT_STACK_COMPLETE       StackPointer,
+    IN      PROCESSOR_STATE*                ProcessorState
+    )
+{
+    PPROFILER_CPU_DATA pCpuData;
+    PPROFILER_SAMPLE pSample;
+    PTHREAD pThread;
+    PE_UNWIND_CONTEXT unwindContext;
+
+    ASSERT(CpuIntrGetState() == INTR_OFF);
+
+    if (!m_profilerData.Running || m_profilerData.TimerVector != InterruptIndex)
+    {
+        return;
+    }
+
+    ASSERT(NULL != StackPointer);
+    ASSERT(NULL != ProcessorState);
+
+    pCpuData = m_profilerData.Cpus[CpuGetApicId()];
+    if (NULL == pCpuData)
+    {
+        // the CPU was woken up after the profiler started
+        return;
+    }
+
+    pThread = GetCurrentThread();
+
+    pSample = &pCpuData->Samples[pCpuData->SamplesTaken % PROFILER_SAMPLES_PER_CPU];
+    pCpuData->SamplesTaken++;
+
+    pSample->ThreadId = (NULL != pThread) ? pThread->Id : 0;
+    pSample->CpuId = pCpuData->ApicId;
+    pSample->UserMode = (StackPointer->Registers.CS & RING_THREE_PL) == RING_THREE_PL;
+    pSample->Frames[0] = StackPointer->Registers.Rip;
+    pSample->NumberOfFrames = 1;
+
+    if (pSample->UserMode || NULL == pThread)
+    {
+        return;
+    }
+
+    // the kernel is built without frame pointers => the callers are found by
+    // the unwind information of the image
+    unwindContext.Rip = StackPointer->Registers.Rip;
+    memcpy(unwindContext.Registers, ProcessorState->RegisterValues, sizeof(unwindContext.Registers));
+    unwindContext.Registers[PE_UNWIND_REGISTER_RSP] = StackPointer->Registers.Rsp;
+    unwindContext.StackHigh = (QWORD) pThread->InitialStackBase;
+    unwindContext.StackLow = unwindContext.StackHigh - pThread->StackSize;
+
+    while (pSample->NumberOfFrames < PROFILER_MAX_FRAMES)
+    {
+        if (!SUCCEEDED(PeVirtualUnwind(m_profilerData.KernelInfo, &unwindContext)))
+        {
+            break;
+        }
+
+        if (!CHECK_BOUNDS(unwindContext.Rip, 1, m_profilerData.KernelInfo->ImageBase, m_profilerData.KernelInfo->Size))
+        {
+            // we reached the thread start function or a corrupted frame
+            break;
+        }
+
+        pSample->Frames[pSample->NumberOfFrames] = unwindContext.Rip;
+        pSample->NumberOfFrames++;
+    }
+}
+
+SAL_SUCCESS
+STATUS
+ProfilerDump(
+    IN      DWORD                           MaxFunctions
+    )
+{
+    STATUS status;
+    HASH_TABLE hashTable;
+    PHASH_TABLE_DATA pHashData;
+    DWORD hashDataSize;
+    PPROFILER_FUNCTION pFunctions;
+    PPROFILER_FUNCTION* pTopFunctions;
+    DWORD noOfFunctions;
+    DWORD noOfTopFunctions;
+    QWORD totalSamples;
+    QWORD userSamples;
+    QWORD unattributedFrames;
+    BIN_HEAP heap;
+    BOOLEAN bHeapInitialized;
+
+    if (0 == MaxFunctions)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (TRUE == _InterlockedCompareExchange8(&m_profilerData.Busy, TRUE, FALSE))
+    {
+        return STATUS_DEVICE_BUSY;
+    }
+
+    status = STATUS_SUCCESS;
+    pHashData = NULL;
+    pFunctions = NULL;
+    pTopFunctions = NULL;
+    noOfFunctions = 0;
+    totalSamples = 0;
+    userSamples = 0;
+    unattributedFrames = 0;
+    bHeapInitialized = FALSE;
+
+    __try
+    {
+        // the samples are written without any lock => they may only be read
+        // after the timers are stopped
+        if (m_profilerData.Running)
+        {
+            status = STATUS_DEVICE_BUSY;
+            __leave;
+        }
+
+        for (DWORD i = 0; i < ARRAYSIZE(m_profilerData.Cpus); ++i)
+        {
+            if (NULL != m_profilerData.Cpus[i])
+            {
+                totalSamples += min(m_profilerData.Cpus[i]->SamplesTaken, PROFILER_SAMPLES_PER_CPU);
+            }
+        }
+
+        if (0 == totalSamples)
+        {
+            status = STATUS_NO_DATA_AVAILABLE;
+            __leave;
+        }
+
+        pFunctions = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                           PROFILER_MAX_FUNCTIONS * sizeof(PROFILER_FUNCTION),
+                                           HEAP_PROFILER_TAG,
+                                           0);
+        if (NULL == pFunctions)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", PROFILER_MAX_FUNCTIONS * sizeof(PROFILER_FUNCTION));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        hashDataSize = HashTablePreinit(&hashTable, PROFILER_MAX_FUNCTIONS, sizeof(QWORD));
+
+        pHashData = ExAllocatePoolWithTag(0, hashDataSize, HEAP_PROFILER_TAG, 0);
+        if (NULL == pHashData)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", hashDataSize);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        HashTableInit(&hashTable,
+                      pHashData,
+                      HashFuncUniversal,
+                      (INT32) (FIELD_OFFSET(PROFILER_FUNCTION, Key) - FIELD_OFFSET(PROFILER_FUNCTION, HashEntry)));
+
+        for (DWORD i = 0; i < ARRAYSIZE(m_profilerData.Cpus); ++i)
+        {
+            PPROFILER_CPU_DATA pCpuData = m_profilerData.Cpus[i];
+            DWORD noOfSamples;
+
+            if (NULL == pCpuData)
+            {
+                continue;
+            }
+
+            noOfSamples = (DWORD) min(pCpuData->SamplesTaken, PROFILER_SAMPLES_PER_CPU);
+
+            for (DWORD j = 0; j < noOfSamples; ++j)
+            {
+                PPROFILER_SAMPLE pSample = &pCpuData->Samples[j];
+                QWORD keys[PROFILER_MAX_FRAMES];
+
+                if (pSample->UserMode)
+                {
+                    userSamples++;
+                }
+
+                for (BYTE frame = 0; frame < pSample->NumberOfFrames; ++frame)
+                {
+                    PHASH_ENTRY pHashEntry;
+                    PPROFILER_FUNCTION pFunction;
+                    BOOLEAN bCalledRecursively;
+
+                    keys[frame] = pSample->UserMode ? PROFILER_USER_MODE_KEY : _ProfilerFunctionKey(pSample->Frames[frame]);
+
+                    pHashEntry = HashTableLookup(&hashTable, (PHASH_KEY) &keys[frame]);
+                    if (NULL != pHashEntry)
+                    {
+                        pFunction = CONTAINING_RECORD(pHashEntry, PROFILER_FUNCTION, HashEntry);
+                    }
+                    else if (noOfFunctions < PROFILER_MAX_FUNCTIONS)
+                    {
+                        pFunction = &pFunctions[noOfFunctions];
+                        noOfFunctions++;
+
+                        pFunction->Key = keys[frame];
+                        HashTableInsert(&hashTable, &pFunction->HashEntry);
+                    }
+                    else
+                    {
+                        unattributedFrames++;
+                        continue;
+                    }
+
+                    if (0 == frame)
+                    {
+                        pFunction->SelfSamples++;
+                    }
+
+                    // a recursive function is counted once for each sample
+                    bCalledRecursively = FALSE;
+                    for (BYTE k = 0; k < frame; ++k)
+                    {
+                        if (keys[k] == keys[frame])
+                        {
+                            bCalledRecursively = TRUE;
+                            break;
+                        }
+                    }
+
+                    if (!bCalledRecursively)
+                    {
+                        pFunction->TotalSamples++;
+                    }
+                }
+            }
+        }
+
+        // the heap keeps the MaxFunctions functions with the most samples, its
+        // minimum is the first one evicted
+        status = BinHeapInit(&heap, MaxFunctions + 1, _ProfilerCompareFunctions, _ProfilerAllocHeap, _ProfilerFreeHeap, NULL);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("BinHeapInit", status);
+            __leave;
+        }
+        bHeapInitialized = TRUE;
+
+        for (DWORD i = 0; i < noOfFunctions; ++i)
+        {
+            status = BinHeapInsert(&heap, &pFunctions[i].HeapEntry);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("BinHeapInsert", status);
+                __leave;
+            }
+
+            if (BinHeapSize(&heap) > MaxFunctions)
+            {
+                BinHeapExtractMin(&heap);
+            }
+        }
+
+        noOfTopFunctions = BinHeapSize(&heap);
+
+        pTopFunctions = ExAllocatePoolWithTag(0, noOfTopFunctions * sizeof(PPROFILER_FUNCTION), HEAP_PROFILER_TAG, 0);
+        if (NULL == pTopFunctions)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", noOfTopFunctions * sizeof(PPROFILER_FUNCTION));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        // the functions are extracted in increasing order
+        for (DWORD i = noOfTopFunctions; i > 0; --i)
+        {
+            pTopFunctions[i - 1] = CONTAINING_RECORD(BinHeapExtractMin(&heap), PROFILER_FUNCTION, HeapEntry);
+        }
+
+        LOG("Samples: %U, user-mode: %U, distinct functions: %u\n", totalSamples, userSamples, noOfFunctions);
+        for (DWORD i = 0; i < ARRAYSIZE(m_profilerData.Cpus); ++i)
+        {
+            if (NULL != m_profilerData.Cpus[i])
+            {
+                LOG("CPU 0x%02x: %U samples taken, %U dropped\n",
+                    i,
+                    m_profilerData.Cpus[i]->SamplesTaken,
+                    m_profilerData.Cpus[i]->SamplesTaken - min(m_profilerData.Cpus[i]->SamplesTaken, PROFILER_SAMPLES_PER_CPU));
+            }
+        }
+
+        if (0 != unattributedFrames)
+        {
+            LOG_WARNING("%U frames were not attributed, more than %u functions were found\n",
+                        unattributedFrames, PROFILER_MAX_FUNCTIONS);
+        }
+
+        LOG("%10s%8s%8s  %s\n", "Self", "Self%", "Total%", "Function");
+        for (DWORD i = 0; i < noOfTopFunctions; ++i)
+        {
+            _ProfilerLogFunction(pTopFunctions[i], totalSamples);
+        }
+    }
+    __finally
+    {
+        if (NULL != pTopFunctions)
+        {
+            ExFreePoolWithTag(pTopFunctions, HEAP_PROFILER_TAG);
+            pTopFunctions = NULL;
+        }
+
+        if (bHeapInitialized)
+        {
+            BinHeapUninit(&heap);
+            bHeapInitialized = FALSE;
+        }
+
+        if (NULL != pHashData)
+        {
+            ExFreePoolWithTag(pHashData, HEAP_PROFILER_TAG);
+            pHashData = NULL;
+        }
+
+        if (NULL != pFunctions)
+        {
+            ExFreePoolWithTag(pFunctions, HEAP_PROFILER_TAG);
+            pFunctions = NULL;
+        }
+
+        _InterlockedExchange8(&m_profilerData.Busy, FALSE);
+    }
+
+    return status;
+}
+
+static
+STATUS
+(__cdecl _ProfilerEnableTimer)(
+    IN_OPT  PVOID       Context
+    )
+{
+    LapicSystemEnableTimer((DWORD) (QWORD) Context);
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _ProfilerDisableTimer)(
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    LapicSystemDisableTimer();
+
+    return STATUS_SUCCESS;
+}
+
+static
+INT64
+(__cdecl _ProfilerCompareFunctions)(
+    IN      PBIN_HEAP_ENTRY     FirstElem,
+    IN      PBIN_HEAP_ENTRY     SecondElem
+    )
+{
+    PPROFILER_FUNCTION pFirst = CONTAINING_RECORD(FirstElem, PROFILER_FUNCTION, HeapEntry);
+    PPROFILER_FUNCTION pSecond = CONTAINING_RECORD(SecondElem, PROFILER_FUNCTION, HeapEntry);
+
+    if (pFirst->SelfSamples != pSecond->SelfSamples)
+    {
+        return (INT64) (pFirst->SelfSamples - pSecond->SelfSamples);
+    }
+
+    return (INT64) (pFirst->TotalSamples - pSecond->TotalSamples);
+}
+
+static
+PVOID
+(__cdecl _ProfilerAllocHeap)(
+    IN      DWORD       Size,
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    return ExAllocatePoolWithTag(0, Size, HEAP_PROFILER_TAG, 0);
+}
+
+static
+void
+(__cdecl _ProfilerFreeHeap)(
+    IN      PVOID       Object,
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    ExFreePoolWithTag(Object, HEAP_PROFILER_TAG);
+}
+
+static
+void
+_ProfilerFreeBuffers(
+    void
+    )
+{
+    ASSERT(!m_profilerData.Running);
+
+    for (DWORD i = 0; i < ARRAYSIZE(m_profilerData.Cpus); ++i)
+    {
+        if (NULL != m_profilerData.Cpus[i])
+        {
+            ExFreePoolWithTag(m_profilerData.Cpus[i], HEAP_PROFILER_TAG);
+            m_profilerData.Cpus[i] = NULL;
+        }
+    }
+}
+
+static
+QWORD
+_ProfilerFunctionKey(
+    IN      QWORD                   Address
+    )
+{
+    PE_FUNCTION_INFO functionInfo;
+
+    if (SUCCEEDED(PeRetrieveFunction(m_profilerData.KernelInfo, (PVOID) Address, &functionInfo)))
+    {
+        return (QWORD) functionInfo.BaseAddress;
+    }
+
+    return Address;
+}
+
+static
+void
+_ProfilerLogFunction(
+    IN      PPROFILER_FUNCTION      Function,
+    IN      QWORD                   NumberOfSamples
+    )
+{
+    QWORD selfPercentage;
+    QWORD totalPercentage;
+    char* pName;
+    char nameBuffer[PROFILER_FUNCTION_NAME_MAX_CHARS];
+
+    ASSERT(NULL != Function);
+    ASSERT(0 != NumberOfSamples);
+
+    selfPercentage = (Function->SelfSamples * 10000) / NumberOfSamples;
+    totalPercentage = (Function->TotalSamples * 10000) / NumberOfSamples;
+
+    pName = nameBuffer;
+    if (PROFILER_USER_MODE_KEY == Function->Key)
+    {
+        pName = "[user-mode]";
+    }
+    else if (SUCCEEDED(PeRetrieveExportName(m_profilerData.KernelInfo, (PVOID) Function->Key, &pName)))
+    {
+        // the name points inside the kernel image
+    }
+    else if (CHECK_BOUNDS(Function->Key, 1, m_profilerData.KernelInfo->ImageBase, m_profilerData.KernelInfo->Size))
+    {
+        snprintf(nameBuffer, sizeof(nameBuffer), "HAL9000+0x%X", PtrDiff(Function->Key, m_profilerData.KernelInfo->ImageBase));
+    }
+    else
+    {
+        snprintf(nameBuffer, sizeof(nameBuffer), "0x%X", Function->Key);
+    }
+
+    LOG("%10U%5d.%02d%5d.%02d  %s\n",
+        Function->SelfSamples,
+        (DWORD) (selfPercentage / 100), (DWORD) (selfPercentage % 100),
+        (DWORD) (totalPercentage / 100), (DWORD) (totalPercentage % 100),
+        pName);
+}
@@ -35,6 +35,7 @@ typedef struct _SMP_DATA
     BYTE                    ApicTimerVector;
     BYTE                    IpcIpiVector;
     BYTE                    AssertIpiVector;
+    BYTE                    TlbIpiVector;
 } SMP_DATA, *PSMP_DATA;
 
 static SMP_DATA m_smpData;
@@ -147,6 +148,7 @@ _SmpRetrieveMatchingCpus(
 static FUNC_InterruptFunction       _SmpApicTimerIsr;
 static FUNC_InterruptFunction       _SmpAssertIpiIsr;
 static FUNC_InterruptFunction       _SmpIpcIpiIsr;
+static FUNC_InterruptFunction       _SmpTlbIpiIsr;
 
 _No_competing_thread_
 void
@@ -592,6 +594,26 @@ SmpGetNumberOfActiveCpus(
     return m_smpData.NoOfActiveCpus;
 }
 
+BYTE
+SmpGetApicTimerVector(
+    void
+    )
+{
+    return m_smpData.ApicTimerVector;
+}
+
+void
+SmpSendTlbShootdownIpi(
+    IN      CPU_AFFINITY    Affinity
+    )
+{
+    BYTE vector = m_smpData.TlbIpiVector;
+
+    ASSERT(0 != Affinity);
+
+    LapicSystemSendIpi(Affinity, ApicDeliveryModeFixed, ApicDestinationShorthandNone, ApicDestinationModeLogical, &vector);
+}
+
 void
 SmpNotifyCpuWakeup(
     void
@@ -665,6 +687,13 @@ _SmpInstallInterruptRoutines(
         return status;
     }
 
+    status = _SmpInstallInterruptRoutine(_SmpTlbIpiIsr, IrqlIpiLevel, &m_smpData.TlbIpiVector );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_SmpInstallInterruptRoutine", status);
+        return status;
+    }
+
     LOG_FUNC_END;
 
     return status;
@@ -731,9 +760,24 @@ BOOLEAN
 {
     ASSERT( NULL != Device );
 
-    LOGPL("What are we doing here??\n");
+    // the timer is armed only by the profiler which records its samples in
+    // IsrCommonHandler, it needs the interrupted context
+    return TRUE;
+}
 
-    return FALSE;
+static
+BOOLEAN
+(__cdecl _SmpTlbIpiIsr)(
+    IN        PDEVICE_OBJECT           Device
+    )
+{
+    ASSERT( NULL != Device );
+
+    // the requests were queued by the senders in the PCPU => nothing is
+    // allocated or freed on this path
+    VmmProcessTlbShootdown();
+
+    return TRUE;
 }
 
 static
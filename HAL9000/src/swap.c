@@ -0,0 +1,934 @@
+#include "HAL9000.h"
+#include "swap.h"
+#include "iomu.h"
+#include "io.h"
+#include "filesystem.h"
+#include "bitmap.h"
+#include "lock_common.h"
+#include "ex.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "lz.h"
+
+// The upper bits of a handle describe where the page is, the lower ones are
+// the index of its slot or of its first chunk. The whole handle must fit in
+// the MAXPHYADDR - 12 bits of a PTE.
+#define SWAP_HANDLE_TYPE_SHIFT              36
+#define SWAP_HANDLE_INDEX_MASK              (((QWORD)1 << SWAP_HANDLE_TYPE_SHIFT) - 1)
+
+typedef enum _SWAP_HANDLE_TYPE
+{
+    SwapHandleTypeDisk                      = 0,
+    SwapHandleTypeCompressed,
+    SwapHandleTypeZero,
+} SWAP_HANDLE_TYPE;
+
+#define SwapMakeHandle(Type,Index)          (((QWORD)(Type) << SWAP_HANDLE_TYPE_SHIFT) | (QWORD)(Index))
+#define SwapHandleGetType(Handle)           ((SWAP_HANDLE_TYPE)((Handle) >> SWAP_HANDLE_TYPE_SHIFT))
+#define SwapHandleGetIndex(Handle)          ((Handle) & SWAP_HANDLE_INDEX_MASK)
+
+// Each page in the compressed pool starts with the size of its data
+typedef struct _SWAP_COMPRESSED_HEADER
+{
+    WORD                    CompressedSize;
+} SWAP_COMPRESSED_HEADER, *PSWAP_COMPRESSED_HEADER;
+
+#define SwapChunksForSize(Size)             ((DWORD)(((Size) + sizeof(SWAP_COMPRESSED_HEADER) + SWAP_COMPRESSED_CHUNK_SIZE - 1) / SWAP_COMPRESSED_CHUNK_SIZE))
+
+typedef struct _SWAP_DATA
+{
+    PFILE_OBJECT            SwapFile;
+
+    LOCK                    SlotsLock;
+
+    _Guarded_by_(SlotsLock)
+    BITMAP                  SlotsBitmap;
+
+    _Guarded_by_(SlotsLock)
+    QWORD                   NumberOfUsedSlots;
+
+    // The evicted pages are gathered here so that they can be written with
+    // a single request
+    LOCK                    StagingLock;
+
+    _Guarded_by_(StagingLock)
+    PBYTE                   StagingBuffer;
+
+    volatile QWORD          PagesWritten;
+    volatile QWORD          PagesRead;
+    volatile QWORD          NumberOfWrites;
+
+    // Compressed tier, the pool is allocated once and never grows
+    PBYTE                   Pool;
+    QWORD                   PoolSize;
+
+    LOCK                    PoolLock;
+
+    _Guarded_by_(PoolLock)
+    BITMAP                  ChunksBitmap;
+
+    _Guarded_by_(PoolLock)
+    QWORD                   NumberOfUsedChunks;
+
+    _Guarded_by_(PoolLock)
+    QWORD                   NumberOfCompressedPages;
+
+    // Scratch buffers used by LzCompress
+    _Guarded_by_(PoolLock)
+    PBYTE                   CompressBuffer;
+
+    _Guarded_by_(PoolLock)
+    PBYTE                   CompressWorkBuffer;
+
+    volatile QWORD          NumberOfZeroPages;
+} SWAP_DATA, *PSWAP_DATA;
+
+static SWAP_DATA m_swapData;
+
+static FUNC_ListFunction _SwapFindVolume;
+
+static
+STATUS
+_SwapCreateCompressedPool(
+    void
+    );
+
+static
+STATUS
+_SwapOpenPartition(
+    void
+    );
+
+__forceinline
+static
+BOOLEAN
+_SwapIsPartitionAvailable(
+    void
+    )
+{
+    return NULL != m_swapData.SwapFile;
+}
+
+__forceinline
+static
+BOOLEAN
+_SwapIsPageZeroFilled(
+    IN_READS_BYTES(PAGE_SIZE)
+                PVOID                   Page
+    )
+{
+    QWORD* pData = (QWORD*) Page;
+
+    for (DWORD i = 0; i < PAGE_SIZE / sizeof(QWORD); ++i)
+    {
+        if (0 != pData[i])
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+//******************************************************************************
+// Function:     _SwapCompressPage
+// Description:  Stores a compressed copy of Page in the compressed pool.
+// Returns:      STATUS - STATUS_INSUFFICIENT_MEMORY if the page does not
+//               compress well enough or the pool is full
+// Parameter:    IN_READS_BYTES(PAGE_SIZE) PVOID Page
+// Parameter:    OUT SWAP_HANDLE* Handle
+//******************************************************************************
+static
+STATUS
+_SwapCompressPage(
+    IN_READS_BYTES(PAGE_SIZE)
+                PVOID                   Page,
+    OUT         SWAP_HANDLE*            Handle
+    );
+
+static
+STATUS
+_SwapDecompressPage(
+    IN          DWORD                   FirstChunk,
+    OUT_WRITES_BYTES(PAGE_SIZE)
+                PVOID                   Page
+    );
+
+static
+STATUS
+_SwapReserveSlots(
+    IN          DWORD                   NumberOfSlots,
+    OUT         QWORD*                  FirstSlot
+    );
+
+static
+void
+_SwapReleaseSlots(
+    IN          QWORD                   FirstSlot,
+    IN          DWORD                   NumberOfSlots
+    );
+
+//******************************************************************************
+// Function:     _SwapWritePages
+// Description:  Writes the contents of NumberOfPages pages to the consecutive
+//               slots starting at FirstSlot using a single request.
+// Returns:      STATUS
+// Parameter:    IN QWORD FirstSlot
+// Parameter:    IN DWORD NumberOfPages - at most SWAP_MAX_PAGES_PER_IO
+// Parameter:    IN_READS(NumberOfPages) PVOID* Pages
+//******************************************************************************
+static
+STATUS
+_SwapWritePages(
+    IN          QWORD                   FirstSlot,
+    IN          DWORD                   NumberOfPages,
+    IN_READS(NumberOfPages)
+                PVOID*                  Pages
+    );
+
+static
+STATUS
+_SwapReadPage(
+    IN          QWORD                   Slot,
+    OUT_WRITES_BYTES(PAGE_SIZE)
+                PVOID                   Page
+    );
+
+_No_competing_thread_
+void
+SwapPreinit(
+    void
+    )
+{
+    memzero(&m_swapData, sizeof(SWAP_DATA));
+
+    LockInit(&m_swapData.SlotsLock);
+    LockInit(&m_swapData.StagingLock);
+    LockInit(&m_swapData.PoolLock);
+}
+
+STATUS
+SwapInit(
+    void
+    )
+{
+    STATUS status;
+
+    LOG_FUNC_START;
+
+    // the tiers are independent, either one is enough to evict dirty pages
+    status = _SwapCreateCompressedPool();
+    if (!SUCCEEDED(status))
+    {
+        LOG_WARNING("_SwapCreateCompressedPool failed with status 0x%x, pages will not be compressed\n", status);
+    }
+
+    status = _SwapOpenPartition();
+    if (!SUCCEEDED(status) && (STATUS_DEVICE_DOES_NOT_EXIST != status))
+    {
+        LOG_FUNC_ERROR("_SwapOpenPartition", status);
+    }
+
+    LOG_FUNC_END;
+
+    return SwapIsAvailable() ? STATUS_SUCCESS : STATUS_DEVICE_DOES_NOT_EXIST;
+}
+
+BOOLEAN
+SwapIsAvailable(
+    void
+    )
+{
+    return (NULL != m_swapData.Pool) || _SwapIsPartitionAvailable();
+}
+
+STATUS
+SwapStorePages(
+    IN          DWORD                   NumberOfPages,
+    IN_READS(NumberOfPages)
+                PVOID*                  Pages,
+    OUT_WRITES(NumberOfPages)
+                SWAP_HANDLE*            Handles
+    )
+{
+    STATUS status;
+    PVOID pagesToWrite[SWAP_MAX_PAGES_PER_IO];
+    DWORD indexesToWrite[SWAP_MAX_PAGES_PER_IO];
+    DWORD noOfPagesToWrite;
+    QWORD firstSlot;
+
+    if ((0 == NumberOfPages) || (NumberOfPages > SWAP_MAX_PAGES_PER_IO))
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Pages)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Handles)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    status = STATUS_SUCCESS;
+    noOfPagesToWrite = 0;
+    firstSlot = 0;
+
+    // 1. Zero filled and compressible pages never reach the disk
+    for (DWORD i = 0; i < NumberOfPages; ++i)
+    {
+        if (_SwapIsPageZeroFilled(Pages[i]))
+        {
+            Handles[i] = SwapMakeHandle(SwapHandleTypeZero, 0);
+            _InterlockedIncrement64(&m_swapData.NumberOfZeroPages);
+            continue;
+        }
+
+        if (NULL != m_swapData.Pool
+            && SUCCEEDED(_SwapCompressPage(Pages[i], &Handles[i])))
+        {
+            continue;
+        }
+
+        Handles[i] = SWAP_INVALID_HANDLE;
+
+        pagesToWrite[noOfPagesToWrite] = Pages[i];
+        indexesToWrite[noOfPagesToWrite] = i;
+        noOfPagesToWrite++;
+    }
+
+    if (0 == noOfPagesToWrite)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    // 2. Spill the rest to the swap partition with a single write
+    if (!_SwapIsPartitionAvailable())
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    status = _SwapReserveSlots(noOfPagesToWrite, &firstSlot);
+    if (!SUCCEEDED(status))
+    {
+        LOG_TRACE_VMM("_SwapReserveSlots failed with status 0x%x\n", status);
+        return status;
+    }
+
+    status = _SwapWritePages(firstSlot, noOfPagesToWrite, pagesToWrite);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_SwapWritePages", status);
+        _SwapReleaseSlots(firstSlot, noOfPagesToWrite);
+        return status;
+    }
+
+    for (DWORD i = 0; i < noOfPagesToWrite; ++i)
+    {
+        Handles[indexesToWrite[i]] = SwapMakeHandle(SwapHandleTypeDisk, firstSlot + i);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+SwapLoadPage(
+    IN          SWAP_HANDLE             Handle,
+    OUT_WRITES_BYTES(PAGE_SIZE)
+                PVOID                   Page
+    )
+{
+    ASSERT(SWAP_INVALID_HANDLE != Handle);
+    ASSERT(NULL != Page);
+
+    switch (SwapHandleGetType(Handle))
+    {
+    case SwapHandleTypeZero:
+        memzero(Page, PAGE_SIZE);
+        return STATUS_SUCCESS;
+    case SwapHandleTypeCompressed:
+        return _SwapDecompressPage((DWORD) SwapHandleGetIndex(Handle), Page);
+    case SwapHandleTypeDisk:
+        return _SwapReadPage(SwapHandleGetIndex(Handle), Page);
+    default:
+        NOT_REACHED;
+        return STATUS_UNSUCCESSFUL;
+    }
+}
+
+BOOLEAN
+SwapIsPageInMemory(
+    IN          SWAP_HANDLE             Handle
+    )
+{
+    ASSERT(SWAP_INVALID_HANDLE != Handle);
+
+    return SwapHandleTypeDisk != SwapHandleGetType(Handle);
+}
+
+void
+SwapFreePage(
+    IN          SWAP_HANDLE             Handle
+    )
+{
+    PSWAP_COMPRESSED_HEADER pHeader;
+    DWORD firstChunk;
+    DWORD noOfChunks;
+    INTR_STATE oldState;
+
+    ASSERT(SWAP_INVALID_HANDLE != Handle);
+
+    switch (SwapHandleGetType(Handle))
+    {
+    case SwapHandleTypeZero:
+        ASSERT(m_swapData.NumberOfZeroPages > 0);
+        _InterlockedDecrement64(&m_swapData.NumberOfZeroPages);
+        break;
+    case SwapHandleTypeCompressed:
+        firstChunk = (DWORD) SwapHandleGetIndex(Handle);
+        pHeader = (PSWAP_COMPRESSED_HEADER) (m_swapData.Pool + (QWORD) firstChunk * SWAP_COMPRESSED_CHUNK_SIZE);
+
+        LockAcquire(&m_swapData.PoolLock, &oldState);
+        noOfChunks = SwapChunksForSize(pHeader->CompressedSize);
+        BitmapClearBits(&m_swapData.ChunksBitmap, firstChunk, noOfChunks);
+        ASSERT(m_swapData.NumberOfUsedChunks >= noOfChunks);
+        m_swapData.NumberOfUsedChunks -= noOfChunks;
+        m_swapData.NumberOfCompressedPages--;
+        LockRelease(&m_swapData.PoolLock, oldState);
+        break;
+    case SwapHandleTypeDisk:
+        _SwapReleaseSlots(SwapHandleGetIndex(Handle), 1);
+        break;
+    default:
+        NOT_REACHED;
+        break;
+    }
+}
+
+void
+SwapGetStatistics(
+    OUT         PSWAP_STATISTICS        Statistics
+    )
+{
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Statistics);
+
+    memzero(Statistics, sizeof(SWAP_STATISTICS));
+
+    if (_SwapIsPartitionAvailable())
+    {
+        LockAcquire(&m_swapData.SlotsLock, &oldState);
+        Statistics->NumberOfSlots = BitmapGetMaxElementCount(&m_swapData.SlotsBitmap);
+        Statistics->NumberOfUsedSlots = m_swapData.NumberOfUsedSlots;
+        LockRelease(&m_swapData.SlotsLock, oldState);
+
+        Statistics->PagesWritten = m_swapData.PagesWritten;
+        Statistics->PagesRead = m_swapData.PagesRead;
+        Statistics->NumberOfWrites = m_swapData.NumberOfWrites;
+    }
+
+    if (NULL != m_swapData.Pool)
+    {
+        LockAcquire(&m_swapData.PoolLock, &oldState);
+        Statistics->CompressedPoolSize = m_swapData.PoolSize;
+        Statistics->CompressedPoolUsed = m_swapData.NumberOfUsedChunks * SWAP_COMPRESSED_CHUNK_SIZE;
+        Statistics->NumberOfCompressedPages = m_swapData.NumberOfCompressedPages;
+        LockRelease(&m_swapData.PoolLock, oldState);
+    }
+
+    Statistics->NumberOfZeroPages = m_swapData.NumberOfZeroPages;
+}
+
+static
+STATUS
+_SwapCreateCompressedPool(
+    void
+    )
+{
+    STATUS status;
+    QWORD poolSize;
+    DWORD noOfChunks;
+    DWORD bitmapSize;
+    PBYTE pPool;
+    PBYTE pBitmapBuffer;
+    PBYTE pCompressBuffer;
+    PBYTE pWorkBuffer;
+
+    if (0 == SWAP_COMPRESSED_POOL_RATIO)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    status = STATUS_SUCCESS;
+    pPool = NULL;
+    pBitmapBuffer = NULL;
+    pCompressBuffer = NULL;
+    pWorkBuffer = NULL;
+
+    poolSize = min(PmmGetTotalSystemMemory() / SWAP_COMPRESSED_POOL_RATIO, SWAP_COMPRESSED_POOL_MAX_SIZE);
+    poolSize = AlignAddressLower(poolSize, PAGE_SIZE);
+    if (0 == poolSize)
+    {
+        return STATUS_INSUFFICIENT_MEMORY;
+    }
+
+    noOfChunks = (DWORD) (poolSize / SWAP_COMPRESSED_CHUNK_SIZE);
+
+    __try
+    {
+        // the pool must be backed by frames from the start, it is used exactly
+        // when there are no free frames left
+        pPool = VmmAllocRegionEx(NULL,
+                                 poolSize,
+                                 VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT | VMM_ALLOC_TYPE_NOT_LAZY,
+                                 PAGE_RIGHTS_READWRITE,
+                                 FALSE,
+                                 NULL,
+                                 NULL,
+                                 NULL,
+                                 NULL);
+        if (NULL == pPool)
+        {
+            LOG_FUNC_ERROR_ALLOC("VmmAllocRegionEx", poolSize);
+            status = STATUS_INSUFFICIENT_MEMORY;
+            __leave;
+        }
+
+        bitmapSize = BitmapPreinit(&m_swapData.ChunksBitmap, noOfChunks);
+
+        pBitmapBuffer = ExAllocatePoolWithTag(PoolAllocateZeroMemory, bitmapSize, HEAP_SWAP_TAG, 0);
+        if (NULL == pBitmapBuffer)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", bitmapSize);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        pCompressBuffer = ExAllocatePoolWithTag(0, SWAP_COMPRESSED_MAX_PAGE_SIZE, HEAP_SWAP_TAG, 0);
+        if (NULL == pCompressBuffer)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", SWAP_COMPRESSED_MAX_PAGE_SIZE);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        pWorkBuffer = ExAllocatePoolWithTag(0, LZ_WORK_BUFFER_SIZE, HEAP_SWAP_TAG, 0);
+        if (NULL == pWorkBuffer)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", LZ_WORK_BUFFER_SIZE);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        BitmapInit(&m_swapData.ChunksBitmap, pBitmapBuffer);
+        m_swapData.CompressBuffer = pCompressBuffer;
+        m_swapData.CompressWorkBuffer = pWorkBuffer;
+        m_swapData.PoolSize = poolSize;
+
+        // the pool is set last, once it is visible pages will be compressed
+        m_swapData.Pool = pPool;
+
+        LOGL("Compressing swapped pages in a pool of %U KB\n", poolSize / KB_SIZE);
+
+        pPool = NULL;
+        pBitmapBuffer = NULL;
+        pCompressBuffer = NULL;
+        pWorkBuffer = NULL;
+    }
+    __finally
+    {
+        if (NULL != pWorkBuffer)
+        {
+            ExFreePoolWithTag(pWorkBuffer, HEAP_SWAP_TAG);
+            pWorkBuffer = NULL;
+        }
+
+        if (NULL != pCompressBuffer)
+        {
+            ExFreePoolWithTag(pCompressBuffer, HEAP_SWAP_TAG);
+            pCompressBuffer = NULL;
+        }
+
+        if (NULL != pBitmapBuffer)
+        {
+            ExFreePoolWithTag(pBitmapBuffer, HEAP_SWAP_TAG);
+            pBitmapBuffer = NULL;
+        }
+
+        if (NULL != pPool)
+        {
+            VmmFreeRegion(pPool, 0, VMM_FREE_TYPE_RELEASE);
+            pPool = NULL;
+        }
+    }
+
+    return status;
+}
+
+static
+STATUS
+_SwapOpenPartition(
+    void
+    )
+{
+    STATUS status;
+    PVPB pSwapVpb;
+    char swapRoot[4];
+    PFILE_OBJECT pSwapFile;
+    QWORD noOfSlots;
+    DWORD bitmapSize;
+    PBYTE pBitmapBuffer;
+    PBYTE pStagingBuffer;
+
+    status = STATUS_SUCCESS;
+    pSwapVpb = NULL;
+    pSwapFile = NULL;
+    pBitmapBuffer = NULL;
+    pStagingBuffer = NULL;
+
+    IomuExecuteForEachVpb(_SwapFindVolume, &pSwapVpb, FALSE);
+    if (NULL == pSwapVpb)
+    {
+        LOG_WARNING("There is no swap partition, memory will not be paged out to disk!\n");
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    __try
+    {
+        // SwapFS exposes the whole partition as its root file
+        snprintf(swapRoot, sizeof(swapRoot), "%c:\\", pSwapVpb->VolumeLetter);
+
+        status = IoCreateFile(&pSwapFile, swapRoot, FALSE, FALSE, TRUE);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCreateFile", status);
+            __leave;
+        }
+
+        noOfSlots = min(pSwapFile->FileSize / PAGE_SIZE, MAX_DWORD);
+        if (0 == noOfSlots)
+        {
+            LOG_WARNING("Swap partition %s is too small to hold a page!\n", swapRoot);
+            status = STATUS_DISK_FULL;
+            __leave;
+        }
+
+        bitmapSize = BitmapPreinit(&m_swapData.SlotsBitmap, (DWORD) noOfSlots);
+
+        pBitmapBuffer = ExAllocatePoolWithTag(PoolAllocateZeroMemory, bitmapSize, HEAP_SWAP_TAG, 0);
+        if (NULL == pBitmapBuffer)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", bitmapSize);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        pStagingBuffer = ExAllocatePoolWithTag(0, SWAP_MAX_PAGES_PER_IO * PAGE_SIZE, HEAP_SWAP_TAG, PAGE_SIZE);
+        if (NULL == pStagingBuffer)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", SWAP_MAX_PAGES_PER_IO * PAGE_SIZE);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        BitmapInit(&m_swapData.SlotsBitmap, pBitmapBuffer);
+        m_swapData.StagingBuffer = pStagingBuffer;
+
+        // the file is set last, once it is visible the VMM will start evicting pages
+        m_swapData.SwapFile = pSwapFile;
+
+        LOGL("Swapping to %s with %U slots\n", swapRoot, noOfSlots);
+
+        pSwapFile = NULL;
+        pBitmapBuffer = NULL;
+        pStagingBuffer = NULL;
+    }
+    __finally
+    {
+        if (NULL != pStagingBuffer)
+        {
+            ExFreePoolWithTag(pStagingBuffer, HEAP_SWAP_TAG);
+            pStagingBuffer = NULL;
+        }
+
+        if (NULL != pBitmapBuffer)
+        {
+            ExFreePoolWithTag(pBitmapBuffer, HEAP_SWAP_TAG);
+            pBitmapBuffer = NULL;
+        }
+
+        if (NULL != pSwapFile)
+        {
+            IoCloseFile(pSwapFile);
+            pSwapFile = NULL;
+        }
+    }
+
+    return status;
+}
+
+static
+STATUS
+_SwapCompressPage(
+    IN_READS_BYTES(PAGE_SIZE)
+                PVOID                   Page,
+    OUT         SWAP_HANDLE*            Handle
+    )
+{
+    DWORD compressedSize;
+    DWORD noOfChunks;
+    DWORD firstChunk;
+    PSWAP_COMPRESSED_HEADER pHeader;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Page);
+    ASSERT(NULL != Handle);
+
+    firstChunk = MAX_DWORD;
+
+    // the scratch buffers are shared => the pool lock is held during the compression
+    LockAcquire(&m_swapData.PoolLock, &oldState);
+
+    compressedSize = LzCompress(Page,
+                                PAGE_SIZE,
+                                m_swapData.CompressBuffer,
+                                SWAP_COMPRESSED_MAX_PAGE_SIZE,
+                                m_swapData.CompressWorkBuffer);
+    if (0 != compressedSize)
+    {
+        noOfChunks = SwapChunksForSize(compressedSize);
+
+        firstChunk = BitmapScanAndFlip(&m_swapData.ChunksBitmap, noOfChunks, FALSE);
+        if (MAX_DWORD != firstChunk)
+        {
+            pHeader = (PSWAP_COMPRESSED_HEADER) (m_swapData.Pool + (QWORD) firstChunk * SWAP_COMPRESSED_CHUNK_SIZE);
+
+            pHeader->CompressedSize = (WORD) compressedSize;
+            memcpy(pHeader + 1, m_swapData.CompressBuffer, compressedSize);
+
+            m_swapData.NumberOfUsedChunks += noOfChunks;
+            m_swapData.NumberOfCompressedPages++;
+        }
+    }
+
+    LockRelease(&m_swapData.PoolLock, oldState);
+
+    if (MAX_DWORD == firstChunk)
+    {
+        return STATUS_INSUFFICIENT_MEMORY;
+    }
+
+    *Handle = SwapMakeHandle(SwapHandleTypeCompressed, firstChunk);
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_SwapDecompressPage(
+    IN          DWORD                   FirstChunk,
+    OUT_WRITES_BYTES(PAGE_SIZE)
+                PVOID                   Page
+    )
+{
+    STATUS status;
+    PSWAP_COMPRESSED_HEADER pHeader;
+    DWORD bytesDecompressed;
+
+    ASSERT(NULL != m_swapData.Pool);
+    ASSERT(NULL != Page);
+
+    // the chunks belong to the page until SwapFreePage is called => there is
+    // no need to take the pool lock
+    pHeader = (PSWAP_COMPRESSED_HEADER) (m_swapData.Pool + (QWORD) FirstChunk * SWAP_COMPRESSED_CHUNK_SIZE);
+    bytesDecompressed = 0;
+
+    status = LzDecompress(pHeader + 1, pHeader->CompressedSize, Page, PAGE_SIZE, &bytesDecompressed);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("LzDecompress", status);
+        return status;
+    }
+
+    if (PAGE_SIZE != bytesDecompressed)
+    {
+        LOG_ERROR("Chunk 0x%x decompressed to 0x%x bytes instead of a page\n", FirstChunk, bytesDecompressed);
+        return STATUS_INVALID_BUFFER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_SwapReserveSlots(
+    IN          DWORD                   NumberOfSlots,
+    OUT         QWORD*                  FirstSlot
+    )
+{
+    DWORD idx;
+    INTR_STATE oldState;
+
+    ASSERT(0 != NumberOfSlots && NumberOfSlots <= SWAP_MAX_PAGES_PER_IO);
+    ASSERT(NULL != FirstSlot);
+    ASSERT(_SwapIsPartitionAvailable());
+
+    LockAcquire(&m_swapData.SlotsLock, &oldState);
+    idx = BitmapScanAndFlip(&m_swapData.SlotsBitmap, NumberOfSlots, FALSE);
+    if (MAX_DWORD != idx)
+    {
+        m_swapData.NumberOfUsedSlots += NumberOfSlots;
+    }
+    LockRelease(&m_swapData.SlotsLock, oldState);
+
+    if (MAX_DWORD == idx)
+    {
+        return STATUS_DISK_FULL;
+    }
+
+    *FirstSlot = idx;
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_SwapReleaseSlots(
+    IN          QWORD                   FirstSlot,
+    IN          DWORD                   NumberOfSlots
+    )
+{
+    INTR_STATE oldState;
+
+    ASSERT(_SwapIsPartitionAvailable());
+    ASSERT(FirstSlot + NumberOfSlots <= BitmapGetMaxElementCount(&m_swapData.SlotsBitmap));
+
+    LockAcquire(&m_swapData.SlotsLock, &oldState);
+    BitmapClearBits(&m_swapData.SlotsBitmap, (DWORD) FirstSlot, NumberOfSlots);
+    ASSERT(m_swapData.NumberOfUsedSlots >= NumberOfSlots);
+    m_swapData.NumberOfUsedSlots -= NumberOfSlots;
+    LockRelease(&m_swapData.SlotsLock, oldState);
+}
+
+static
+STATUS
+_SwapWritePages(
+    IN          QWORD                   FirstSlot,
+    IN          DWORD                   NumberOfPages,
+    IN_READS(NumberOfPages)
+                PVOID*                  Pages
+    )
+{
+    STATUS status;
+    QWORD fileOffset;
+    QWORD size;
+    QWORD bytesWritten;
+    INTR_STATE oldState;
+
+    ASSERT(_SwapIsPartitionAvailable());
+    ASSERT(0 != NumberOfPages && NumberOfPages <= SWAP_MAX_PAGES_PER_IO);
+    ASSERT(NULL != Pages);
+
+    fileOffset = FirstSlot * PAGE_SIZE;
+    size = (QWORD) NumberOfPages * PAGE_SIZE;
+    bytesWritten = 0;
+
+    LockAcquire(&m_swapData.StagingLock, &oldState);
+
+    for (DWORD i = 0; i < NumberOfPages; ++i)
+    {
+        memcpy(m_swapData.StagingBuffer + (QWORD) i * PAGE_SIZE, Pages[i], PAGE_SIZE);
+    }
+
+    status = IoWriteFile(m_swapData.SwapFile,
+                         size,
+                         &fileOffset,
+                         m_swapData.StagingBuffer,
+                         &bytesWritten);
+
+    LockRelease(&m_swapData.StagingLock, oldState);
+
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoWriteFile", status);
+        return status;
+    }
+
+    if (bytesWritten != size)
+    {
+        LOG_ERROR("Only 0x%X bytes out of 0x%X were written to the swap partition\n", bytesWritten, size);
+        return STATUS_DISK_FULL;
+    }
+
+    _InterlockedExchangeAdd64(&m_swapData.PagesWritten, NumberOfPages);
+    _InterlockedIncrement64(&m_swapData.NumberOfWrites);
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_SwapReadPage(
+    IN          QWORD                   Slot,
+    OUT_WRITES_BYTES(PAGE_SIZE)
+                PVOID                   Page
+    )
+{
+    STATUS status;
+    QWORD fileOffset;
+    QWORD bytesRead;
+
+    ASSERT(_SwapIsPartitionAvailable());
+    ASSERT(NULL != Page);
+
+    fileOffset = Slot * PAGE_SIZE;
+    bytesRead = 0;
+
+    status = IoReadFile(m_swapData.SwapFile,
+                        PAGE_SIZE,
+                        &fileOffset,
+                        Page,
+                        &bytesRead);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoReadFile", status);
+        return status;
+    }
+
+    if (PAGE_SIZE != bytesRead)
+    {
+        LOG_ERROR("Only 0x%X bytes were read from swap slot 0x%X\n", bytesRead, Slot);
+        return STATUS_DEVICE_SPACE_RANGE_EXCEEDED;
+    }
+
+    _InterlockedIncrement64(&m_swapData.PagesRead);
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _SwapFindVolume)(
+    IN      PLIST_ENTRY     ListEntry,
+    IN_OPT  PVOID           FunctionContext
+    )
+{
+    PVPB pVpb;
+    PVPB* pSwapVpb;
+
+    ASSERT(NULL != ListEntry);
+    ASSERT(NULL != FunctionContext);
+
+    pVpb = CONTAINING_RECORD(ListEntry, VPB, NextVpb);
+    pSwapVpb = (PVPB*) FunctionContext;
+
+    if ((NULL == *pSwapVpb) && pVpb->Flags.Mounted && pVpb->Flags.SwapSpace)
+    {
+        *pSwapVpb = pVpb;
+    }
+
+    return STATUS_SUCCESS;
+}
@@ -21,6 +21,9 @@
 #include "ex_system.h"
 #include "process_internal.h"
 #include "boot_module.h"
+#include "page_cache.h"
+#include "swap.h"
+#include "numa.h"
 
 #define NO_OF_TSS_STACKS             7
 STATIC_ASSERT(NO_OF_TSS_STACKS <= NO_OF_IST);
@@ -50,8 +53,11 @@ SystemPreinit(
     LogSystemPreinit();
     OsInfoPreinit();
     MmuPreinitSystem();
+    PageCachePreinit();
+    SwapPreinit();
     IomuPreinitSystem();
     AcpiInterfacePreinit();
+    NumaPreinit();
     SmpPreinit();
     PciSystemPreinit();
     CorePreinit();
@@ -166,6 +172,17 @@ SystemInit(
     }
     LOGL("AcpiInterfaceInit suceeded\n");
 
+    status = NumaInit();
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NumaInit", status);
+        return status;
+    }
+    LOGL("NumaInit suceeded\n");
+
+    // no PCPU exists yet => no frames are cached by any CPU
+    PmmInitNuma();
+
     status = LapicSystemInit();
     if (!SUCCEEDED(status))
     {
@@ -300,6 +317,14 @@ SystemInit(
 
     LOGL("IOMU late initialization successfully completed\n");
 
+    // the swap partition is found only after the volumes are mounted, without
+    // one pages are only compressed in memory
+    status = SwapInit();
+    if (!SUCCEEDED(status) && (STATUS_DEVICE_DOES_NOT_EXIST != status))
+    {
+        LOG_FUNC_ERROR("SwapInit", status);
+    }
+
     status = NetworkStackInit(FALSE);
     if (!SUCCEEDED(status))
     {
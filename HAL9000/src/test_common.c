@@ -5,6 +5,7 @@
 #include "test_vmm.h"
 #include "test_file_io.h"
 #include "test_dma.h"
+#include "test_perf.h"
 #include "test_thread.h"
 #include "smp.h"
 
@@ -29,4 +30,5 @@ TestRunAllPerformance(
 {
     TestFileReadPerformance();
     TestDmaPerformance();
+    TestPerfRunAll(0);
 }
\ No newline at end of file
@@ -0,0 +1,880 @@
+#include "test_common.h"
+#include "test_perf.h"
+#include "perf_framework.h"
+#include "thread.h"
+#include "ex_event.h"
+#include "mutex.h"
+#include "vmm.h"
+#include "smp.h"
+#include "cpumu.h"
+#include "io.h"
+#include "network.h"
+
+// the warm-up iterations are not recorded, they are a fraction of the
+// measured ones but at least one
+#define PERF_TEST_WARMUP_ITERATIONS(Iterations)     ((Iterations) / 10 + 1)
+
+#define PERF_TEST_READ_FILE                         "C:\\WINLOA~1.RAR"
+
+#define PERF_TEST_NAME_MAX_CHARS                    32
+
+static const DWORD PERF_POOL_SIZES[] = { 16, 256, PAGE_SIZE, 16 * PAGE_SIZE };
+
+static const DWORD PERF_READ_SIZES[] = { SECTOR_SIZE, PAGE_SIZE, 16 * PAGE_SIZE };
+
+// the smallest and the largest frame without a VLAN tag or the FCS
+static const DWORD PERF_FRAME_SIZES[] = { 64, 1514 };
+
+typedef struct _PERF_POOL_CTX
+{
+    DWORD                   Size;
+    DWORD                   Failures;
+} PERF_POOL_CTX, *PPERF_POOL_CTX;
+
+typedef struct _PERF_PING_PONG_CTX
+{
+    EX_EVENT                PingEvent;
+    EX_EVENT                PongEvent;
+
+    volatile BOOLEAN        Stop;
+} PERF_PING_PONG_CTX, *PPERF_PING_PONG_CTX;
+
+typedef struct _PERF_PAGE_FAULT_CTX
+{
+    PBYTE                   BaseAddress;
+    DWORD                   NextPage;
+} PERF_PAGE_FAULT_CTX, *PPERF_PAGE_FAULT_CTX;
+
+typedef struct _PERF_IPI_CTX
+{
+    SMP_DESTINATION         Destination;
+    DWORD                   Failures;
+} PERF_IPI_CTX, *PPERF_IPI_CTX;
+
+typedef struct _PERF_READ_CTX
+{
+    PFILE_OBJECT            File;
+    PVOID                   Buffer;
+    DWORD                   Size;
+    DWORD                   Failures;
+} PERF_READ_CTX, *PPERF_READ_CTX;
+
+typedef struct _PERF_SEND_CTX
+{
+    DEVICE_ID               DeviceId;
+    MAC_ADDRESS             Destination;
+    PETHERNET_FRAME         Frame;
+    DWORD                   Size;
+    DWORD                   Failures;
+} PERF_SEND_CTX, *PPERF_SEND_CTX;
+
+static FUNC_PerfTest        _TestPerfPool;
+static FUNC_PerfTest        _TestPerfLock;
+static FUNC_PerfTest        _TestPerfLockContended;
+static FUNC_PerfTest        _TestPerfMutex;
+static FUNC_PerfTest        _TestPerfYield;
+static FUNC_PerfTest        _TestPerfPingPong;
+static FUNC_PerfTest        _TestPerfCreateJoin;
+static FUNC_PerfTest        _TestPerfPageFault;
+static FUNC_PerfTest        _TestPerfIpi;
+static FUNC_PerfTest        _TestPerfRead;
+static FUNC_PerfTest        _TestPerfSend;
+
+const PERF_TEST PERF_TESTS[] =
+{
+    { "pool", "Pool allocation and free for several sizes", _TestPerfPool, 10000 },
+    { "lock", "Uncontended lock acquire and release", _TestPerfLock, 100000 },
+    { "lockcontended", "Lock acquire and release on all the CPUs", _TestPerfLockContended, 10000 },
+    { "mutex", "Uncontended mutex acquire and release", _TestPerfMutex, 100000 },
+    { "yield", "Thread yield", _TestPerfYield, 10000 },
+    { "pingpong", "Context switch between two threads signaling each other", _TestPerfPingPong, 10000 },
+    { "createjoin", "Thread creation and wait for termination", _TestPerfCreateJoin, 1000 },
+    { "pagefault", "First write to a lazily mapped page", _TestPerfPageFault, 1000 },
+    { "ipi", "IPI round-trip to another CPU", _TestPerfIpi, 10000 },
+    { "ioread", "Synchronous file reads of several sizes", _TestPerfRead, 100 },
+    { "netsend", "Network frame send to the device's own address", _TestPerfSend, 1000 },
+};
+
+const DWORD PERF_TOTAL_NO_OF_TESTS = ARRAYSIZE(PERF_TESTS);
+
+static
+SAL_SUCCESS
+STATUS
+_TestPerfMeasure(
+    IN_Z    char*                   Name,
+    IN      PFUNC_TestPerformance   Function,
+    IN_OPT  PVOID                   Context,
+    IN      DWORD                   IterationCount,
+    IN      DWORD                   NumberOfCpus
+    )
+{
+    STATUS status;
+    PERFORMANCE_OPTIONS options;
+    PERFORMANCE_STATS stats;
+
+    ASSERT(NULL != Name);
+    ASSERT(NULL != Function);
+
+    options.IterationCount = IterationCount;
+    options.WarmupIterations = PERF_TEST_WARMUP_ITERATIONS(IterationCount);
+    options.NumberOfCpus = NumberOfCpus;
+    options.MeasureInUs = FALSE;
+
+    status = RunPerformanceFunctionEx(Function, Context, &options, &stats);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("RunPerformanceFunctionEx", status);
+        return status;
+    }
+
+    DisplayPerformanceStats(&stats, 1, (char**) &Name);
+
+    return STATUS_SUCCESS;
+}
+
+static
+SAL_SUCCESS
+STATUS
+_TestPerfCheckFailures(
+    IN_Z    char*                   Name,
+    IN      DWORD                   Failures
+    )
+{
+    if (0 != Failures)
+    {
+        LOG_ERROR("%u operations failed while measuring [%s]\n", Failures, Name);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static FUNC_TestPerformance _TestPerfPoolIteration;
+
+static
+void
+(__cdecl _TestPerfPoolIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPERF_POOL_CTX pCtx = (PPERF_POOL_CTX) Context;
+    PVOID pMemory;
+
+    ASSERT(NULL != pCtx);
+
+    pMemory = ExAllocatePoolWithTag(0, pCtx->Size, HEAP_TEST_TAG, 0);
+    if (NULL == pMemory)
+    {
+        pCtx->Failures++;
+        return;
+    }
+
+    ExFreePoolWithTag(pMemory, HEAP_TEST_TAG);
+}
+
+static
+STATUS
+(__cdecl _TestPerfPool)(
+    IN      DWORD       IterationCount
+    )
+{
+    STATUS status;
+    PERF_POOL_CTX ctx;
+    char name[PERF_TEST_NAME_MAX_CHARS];
+
+    for (DWORD i = 0; i < ARRAYSIZE(PERF_POOL_SIZES); ++i)
+    {
+        ctx.Size = PERF_POOL_SIZES[i];
+        ctx.Failures = 0;
+
+        snprintf(name, PERF_TEST_NAME_MAX_CHARS, "pool/%u", ctx.Size);
+
+        status = _TestPerfMeasure(name, _TestPerfPoolIteration, &ctx, IterationCount, 1);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+
+        status = _TestPerfCheckFailures(name, ctx.Failures);
+        if (!SUCCEEDED(status))
+        {
+            return status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static FUNC_TestPerformance _TestPerfLockIteration;
+
+static
+void
+(__cdecl _TestPerfLockIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PLOCK pLock = (PLOCK) Context;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != pLock);
+
+    LockAcquire(pLock, &oldState);
+    LockRelease(pLock, oldState);
+}
+
+static
+STATUS
+(__cdecl _TestPerfLock)(
+    IN      DWORD       IterationCount
+    )
+{
+    LOCK lock;
+
+    LockInit(&lock);
+
+    return _TestPerfMeasure("lock/uncontended", _TestPerfLockIteration, &lock, IterationCount, 1);
+}
+
+static
+STATUS
+(__cdecl _TestPerfLockContended)(
+    IN      DWORD       IterationCount
+    )
+{
+    LOCK lock;
+    DWORD noOfCpus;
+
+    noOfCpus = SmpGetNumberOfActiveCpus();
+    if (noOfCpus < 2)
+    {
+        LOG_WARNING("The lock cannot be contended with a single CPU\n");
+        return STATUS_SUCCESS;
+    }
+
+    LockInit(&lock);
+
+    // the other CPUs run from an IPI with the interrupts disabled, the lock
+    // only spins => it never blocks
+    return _TestPerfMeasure("lock/contended", _TestPerfLockIteration, &lock, IterationCount, noOfCpus);
+}
+
+static FUNC_TestPerformance _TestPerfMutexIteration;
+
+static
+void
+(__cdecl _TestPerfMutexIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PMUTEX pMutex = (PMUTEX) Context;
+
+    ASSERT(NULL != pMutex);
+
+    MutexAcquire(pMutex);
+    MutexRelease(pMutex);
+}
+
+static
+STATUS
+(__cdecl _TestPerfMutex)(
+    IN      DWORD       IterationCount
+    )
+{
+    MUTEX mutex;
+
+    MutexInit(&mutex, FALSE);
+
+    return _TestPerfMeasure("mutex/uncontended", _TestPerfMutexIteration, &mutex, IterationCount, 1);
+}
+
+static FUNC_TestPerformance _TestPerfYieldIteration;
+
+static
+void
+(__cdecl _TestPerfYieldIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    ThreadYield();
+}
+
+static
+STATUS
+(__cdecl _TestPerfYield)(
+    IN      DWORD       IterationCount
+    )
+{
+    return _TestPerfMeasure("thread/yield", _TestPerfYieldIteration, NULL, IterationCount, 1);
+}
+
+static FUNC_ThreadStart _TestPerfPongThread;
+
+static
+STATUS
+(__cdecl _TestPerfPongThread)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPERF_PING_PONG_CTX pCtx = (PPERF_PING_PONG_CTX) Context;
+
+    ASSERT(NULL != pCtx);
+
+    for (;;)
+    {
+        ExEventWaitForSignal(&pCtx->PingEvent);
+
+        if (pCtx->Stop)
+        {
+            break;
+        }
+
+        ExEventSignal(&pCtx->PongEvent);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static FUNC_TestPerformance _TestPerfPingPongIteration;
+
+static
+void
+(__cdecl _TestPerfPingPongIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPERF_PING_PONG_CTX pCtx = (PPERF_PING_PONG_CTX) Context;
+
+    ASSERT(NULL != pCtx);
+
+    // each iteration measures two context switches
+    ExEventSignal(&pCtx->PingEvent);
+    ExEventWaitForSignal(&pCtx->PongEvent);
+}
+
+static
+STATUS
+(__cdecl _TestPerfPingPong)(
+    IN      DWORD       IterationCount
+    )
+{
+    STATUS status;
+    STATUS exitStatus;
+    PERF_PING_PONG_CTX ctx;
+    PTHREAD pThread;
+
+    ctx.Stop = FALSE;
+
+    status = ExEventInit(&ctx.PingEvent, ExEventTypeSynchronization, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        return status;
+    }
+
+    status = ExEventInit(&ctx.PongEvent, ExEventTypeSynchronization, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        return status;
+    }
+
+    status = ThreadCreate("PerfPong", ThreadPriorityDefault, _TestPerfPongThread, &ctx, &pThread);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ThreadCreate", status);
+        return status;
+    }
+
+    status = _TestPerfMeasure("thread/pingpong", _TestPerfPingPongIteration, &ctx, IterationCount, 1);
+
+    ctx.Stop = TRUE;
+    ExEventSignal(&ctx.PingEvent);
+
+    ThreadWaitForTermination(pThread, &exitStatus);
+    ThreadCloseHandle(pThread);
+
+    return status;
+}
+
+static FUNC_ThreadStart _TestPerfEmptyThread;
+
+static
+STATUS
+(__cdecl _TestPerfEmptyThread)(
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    return STATUS_SUCCESS;
+}
+
+static FUNC_TestPerformance _TestPerfCreateJoinIteration;
+
+static
+void
+(__cdecl _TestPerfCreateJoinIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    DWORD* pFailures = (DWORD*) Context;
+    PTHREAD pThread;
+    STATUS status;
+    STATUS exitStatus;
+
+    ASSERT(NULL != pFailures);
+
+    status = ThreadCreate("PerfEmpty", ThreadPriorityDefault, _TestPerfEmptyThread, NULL, &pThread);
+    if (!SUCCEEDED(status))
+    {
+        (*pFailures)++;
+        return;
+    }
+
+    ThreadWaitForTermination(pThread, &exitStatus);
+    ThreadCloseHandle(pThread);
+}
+
+static
+STATUS
+(__cdecl _TestPerfCreateJoin)(
+    IN      DWORD       IterationCount
+    )
+{
+    STATUS status;
+    DWORD failures;
+
+    failures = 0;
+
+    status = _TestPerfMeasure("thread/createjoin", _TestPerfCreateJoinIteration, &failures, IterationCount, 1);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    return _TestPerfCheckFailures("thread/createjoin", failures);
+}
+
+static FUNC_TestPerformance _TestPerfPageFaultIteration;
+
+static
+void
+(__cdecl _TestPerfPageFaultIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPERF_PAGE_FAULT_CTX pCtx = (PPERF_PAGE_FAULT_CTX) Context;
+
+    ASSERT(NULL != pCtx);
+
+    // each iteration touches a page which was never accessed
+    *((volatile BYTE*) PtrOffset(pCtx->BaseAddress, (QWORD) pCtx->NextPage * PAGE_SIZE)) = 1;
+    pCtx->NextPage++;
+}
+
+static
+STATUS
+(__cdecl _TestPerfPageFault)(
+    IN      DWORD       IterationCount
+    )
+{
+    STATUS status;
+    PERF_PAGE_FAULT_CTX ctx;
+    QWORD regionSize;
+    DWORD oldFaultAroundPages;
+
+    regionSize = ((QWORD) IterationCount + PERF_TEST_WARMUP_ITERATIONS(IterationCount)) * PAGE_SIZE;
+
+    ctx.NextPage = 0;
+    ctx.BaseAddress = VmmAllocRegion(NULL,
+                                     regionSize,
+                                     VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT,
+                                     PAGE_RIGHTS_READWRITE);
+    if (NULL == ctx.BaseAddress)
+    {
+        LOG_FUNC_ERROR_ALLOC("VmmAllocRegion", regionSize);
+        return STATUS_MEMORY_CANNOT_BE_COMMITED;
+    }
+
+    // the neighbouring pages must not be mapped by the previous faults
+    oldFaultAroundPages = VmmSetFaultAroundPages(1);
+
+    status = _TestPerfMeasure("vmm/pagefault", _TestPerfPageFaultIteration, &ctx, IterationCount, 1);
+
+    VmmSetFaultAroundPages(oldFaultAroundPages);
+
+    VmmFreeRegion(ctx.BaseAddress, 0, VMM_FREE_TYPE_RELEASE);
+
+    return status;
+}
+
+static FUNC_IpcProcessEvent _TestPerfEmptyIpi;
+
+static
+STATUS
+(__cdecl _TestPerfEmptyIpi)(
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    return STATUS_SUCCESS;
+}
+
+static FUNC_TestPerformance _TestPerfIpiIteration;
+
+static
+void
+(__cdecl _TestPerfIpiIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPERF_IPI_CTX pCtx = (PPERF_IPI_CTX) Context;
+    STATUS status;
+
+    ASSERT(NULL != pCtx);
+
+    status = SmpSendGenericIpiEx(_TestPerfEmptyIpi,
+                                 NULL,
+                                 NULL,
+                                 NULL,
+                                 TRUE,
+                                 SmpIpiSendToCpu,
+                                 pCtx->Destination);
+    if (!SUCCEEDED(status))
+    {
+        pCtx->Failures++;
+    }
+}
+
+static
+STATUS
+(__cdecl _TestPerfIpi)(
+    IN      DWORD       IterationCount
+    )
+{
+    STATUS status;
+    PERF_IPI_CTX ctx;
+    PLIST_ENTRY pCpuListHead;
+    APIC_ID currentApicId;
+    BOOLEAN bFoundCpu;
+
+    memzero(&ctx, sizeof(PERF_IPI_CTX));
+    bFoundCpu = FALSE;
+
+    // the thread may be moved to the destination CPU later, the IPI is still
+    // delivered but the measurement would not be a round-trip
+    currentApicId = CpuGetApicId();
+
+    SmpGetCpuList(&pCpuListHead);
+
+    for (PLIST_ENTRY pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+
+        if (pCpu->ApicId != currentApicId && pCpu->ApicInitialized)
+        {
+            ctx.Destination.Cpu.ApicId = pCpu->ApicId;
+            bFoundCpu = TRUE;
+            break;
+        }
+    }
+
+    if (!bFoundCpu)
+    {
+        LOG_WARNING("There is no other CPU to send IPIs to\n");
+        return STATUS_SUCCESS;
+    }
+
+    status = _TestPerfMeasure("ipi/roundtrip", _TestPerfIpiIteration, &ctx, IterationCount, 1);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    return _TestPerfCheckFailures("ipi/roundtrip", ctx.Failures);
+}
+
+static FUNC_TestPerformance _TestPerfReadIteration;
+
+static
+void
+(__cdecl _TestPerfReadIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPERF_READ_CTX pCtx = (PPERF_READ_CTX) Context;
+    STATUS status;
+    QWORD fileOffset;
+    QWORD bytesRead;
+
+    ASSERT(NULL != pCtx);
+
+    fileOffset = 0;
+
+    status = IoReadFile(pCtx->File, pCtx->Size, &fileOffset, pCtx->Buffer, &bytesRead);
+    if (!SUCCEEDED(status) || bytesRead != pCtx->Size)
+    {
+        pCtx->Failures++;
+    }
+}
+
+static
+STATUS
+(__cdecl _TestPerfRead)(
+    IN      DWORD       IterationCount
+    )
+{
+    STATUS status;
+    PERF_READ_CTX ctx;
+    char name[PERF_TEST_NAME_MAX_CHARS];
+
+    memzero(&ctx, sizeof(PERF_READ_CTX));
+
+    status = IoCreateFile(&ctx.File, PERF_TEST_READ_FILE, FALSE, FALSE, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoCreateFile", status);
+        return status;
+    }
+
+    __try
+    {
+        ctx.Buffer = ExAllocatePoolWithTag(0, PERF_READ_SIZES[ARRAYSIZE(PERF_READ_SIZES) - 1], HEAP_TEST_TAG, 0);
+        if (NULL == ctx.Buffer)
+        {
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", PERF_READ_SIZES[ARRAYSIZE(PERF_READ_SIZES) - 1]);
+            __leave;
+        }
+
+        for (DWORD i = 0; i < ARRAYSIZE(PERF_READ_SIZES); ++i)
+        {
+            ctx.Size = PERF_READ_SIZES[i];
+            ctx.Failures = 0;
+
+            snprintf(name, PERF_TEST_NAME_MAX_CHARS, "io/read/%u", ctx.Size);
+
+            status = _TestPerfMeasure(name, _TestPerfReadIteration, &ctx, IterationCount, 1);
+            if (!SUCCEEDED(status))
+            {
+                __leave;
+            }
+
+            status = _TestPerfCheckFailures(name, ctx.Failures);
+            if (!SUCCEEDED(status))
+            {
+                __leave;
+            }
+        }
+    }
+    __finally
+    {
+        if (NULL != ctx.Buffer)
+        {
+            ExFreePoolWithTag(ctx.Buffer, HEAP_TEST_TAG);
+            ctx.Buffer = NULL;
+        }
+
+        IoCloseFile(ctx.File);
+        ctx.File = NULL;
+    }
+
+    return status;
+}
+
+static FUNC_TestPerformance _TestPerfSendIteration;
+
+static
+void
+(__cdecl _TestPerfSendIteration)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPERF_SEND_CTX pCtx = (PPERF_SEND_CTX) Context;
+
+    ASSERT(NULL != pCtx);
+
+    if (!SUCCEEDED(NetSendFrame(FALSE, pCtx->DeviceId, pCtx->Frame, pCtx->Size, pCtx->Destination)))
+    {
+        pCtx->Failures++;
+    }
+}
+
+static
+STATUS
+(__cdecl _TestPerfSend)(
+    IN      DWORD       IterationCount
+    )
+{
+    STATUS status;
+    PERF_SEND_CTX ctx;
+    PNETWORK_DEVICE_INFO pNetDevices;
+    DWORD noOfDevices;
+    DWORD temp;
+    PNETWORK_DEVICE_INFO pDevice;
+    char name[PERF_TEST_NAME_MAX_CHARS];
+
+    memzero(&ctx, sizeof(PERF_SEND_CTX));
+    pNetDevices = NULL;
+    pDevice = NULL;
+
+    status = NetGetNetworkDevices(NULL, &noOfDevices);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetGetNetworkDevices", status);
+        return status;
+    }
+
+    if (0 == noOfDevices)
+    {
+        LOG_WARNING("No network devices found!\n");
+        return STATUS_SUCCESS;
+    }
+
+    __try
+    {
+        pNetDevices = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(NETWORK_DEVICE_INFO) * noOfDevices, HEAP_TEST_TAG, 0);
+        if (NULL == pNetDevices)
+        {
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(NETWORK_DEVICE_INFO) * noOfDevices);
+            __leave;
+        }
+
+        temp = noOfDevices;
+        status = NetGetNetworkDevices(pNetDevices, &temp);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("NetGetNetworkDevices", status);
+            __leave;
+        }
+
+        for (DWORD i = 0; i < min(temp, noOfDevices); ++i)
+        {
+            if (pNetDevices[i].DeviceStatus.TxEnabled && pNetDevices[i].LinkStatus)
+            {
+                pDevice = &pNetDevices[i];
+                break;
+            }
+        }
+
+        if (NULL == pDevice)
+        {
+            LOG_WARNING("There is no network device which can transmit!\n");
+            __leave;
+        }
+
+        ctx.Frame = ExAllocatePoolWithTag(PoolAllocateZeroMemory, PERF_FRAME_SIZES[ARRAYSIZE(PERF_FRAME_SIZES) - 1], HEAP_TEST_TAG, 0);
+        if (NULL == ctx.Frame)
+        {
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", PERF_FRAME_SIZES[ARRAYSIZE(PERF_FRAME_SIZES) - 1]);
+            __leave;
+        }
+
+        // there is no loopback device => the frames are addressed to the
+        // device itself, the cost measured is the one of the transmit path
+        ctx.DeviceId = pDevice->DeviceId;
+        ctx.Destination = pDevice->PhysicalAddress;
+        ctx.Frame->Destination = pDevice->PhysicalAddress;
+        ctx.Frame->Source = pDevice->PhysicalAddress;
+        ctx.Frame->Type = htonw(ETHERNET_FRAME_TYPE_IP4);
+
+        for (DWORD i = 0; i < ARRAYSIZE(PERF_FRAME_SIZES); ++i)
+        {
+            ctx.Size = PERF_FRAME_SIZES[i];
+            ctx.Failures = 0;
+
+            snprintf(name, PERF_TEST_NAME_MAX_CHARS, "net/send/%u", ctx.Size);
+
+            status = _TestPerfMeasure(name, _TestPerfSendIteration, &ctx, IterationCount, 1);
+            if (!SUCCEEDED(status))
+            {
+                __leave;
+            }
+
+            status = _TestPerfCheckFailures(name, ctx.Failures);
+            if (!SUCCEEDED(status))
+            {
+                __leave;
+            }
+        }
+    }
+    __finally
+    {
+        if (NULL != ctx.Frame)
+        {
+            ExFreePoolWithTag(ctx.Frame, HEAP_TEST_TAG);
+            ctx.Frame = NULL;
+        }
+
+        if (NULL != pNetDevices)
+        {
+            ExFreePoolWithTag(pNetDevices, HEAP_TEST_TAG);
+            pNetDevices = NULL;
+        }
+    }
+
+    return status;
+}
+
+static
+STATUS
+_TestPerfRunTest(
+    IN      const PERF_TEST*    Test,
+    IN      DWORD               IterationCount
+    )
+{
+    STATUS status;
+    DWORD iterations;
+
+    ASSERT(NULL != Test);
+
+    iterations = (0 != IterationCount) ? IterationCount : Test->DefaultIterations;
+
+    LOG("Running performance test [%s] with %u iterations\n", Test->TestName, iterations);
+
+    status = Test->TestFunction(iterations);
+    if (!SUCCEEDED(status))
+    {
+        LOG_ERROR("Performance test [%s] failed with status 0x%x\n", Test->TestName, status);
+    }
+
+    return status;
+}
+
+STATUS
+TestPerfRun(
+    IN_Z    char*           TestName,
+    IN      DWORD           IterationCount
+    )
+{
+    ASSERT(NULL != TestName);
+
+    for (DWORD i = 0; i < PERF_TOTAL_NO_OF_TESTS; ++i)
+    {
+        if (0 == stricmp(PERF_TESTS[i].TestName, TestName))
+        {
+            return _TestPerfRunTest(&PERF_TESTS[i], IterationCount);
+        }
+    }
+
+    return STATUS_ELEMENT_NOT_FOUND;
+}
+
+void
+TestPerfRunAll(
+    IN      DWORD           IterationCount
+    )
+{
+    for (DWORD i = 0; i < PERF_TOTAL_NO_OF_TESTS; ++i)
+    {
+        // a failed test does not prevent the others from running
+        _TestPerfRunTest(&PERF_TESTS[i], IterationCount);
+    }
+}
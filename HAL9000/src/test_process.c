@@ -129,6 +129,8 @@ TestProcessFunctionality(
 
         ProcessWaitForTermination(pProcess, &terminationStatus);
 
+        LOG_TEST_LOG("Time to first instruction: %U us\n", ProcessGetTimeToFirstInstruction(pProcess));
+
         ProcessCloseHandle(pProcess);
         pProcess = NULL;
     }
@@ -14,6 +14,9 @@
 
 #define THREAD_TIME_SLICE           1
 
+#define THREAD_TID_TABLE_BUCKETS    256
+#define THREAD_TID_TABLE_LOCKS      16
+
 extern void ThreadStart();
 
 typedef
@@ -36,6 +39,11 @@ typedef struct _THREAD_SYSTEM_DATA
 
     _Guarded_by_(ReadyThreadsLock)
     LIST_ENTRY          ReadyThreadsList;
+
+    // Finds a thread by its TID without walking AllThreadsList
+    CONC_HASH_TABLE     TidTable;
+    PCONC_HASH_ENTRY    TidTableBuckets[THREAD_TID_TABLE_BUCKETS];
+    LOCK                TidTableLocks[THREAD_TID_TABLE_LOCKS];
 } THREAD_SYSTEM_DATA, *PTHREAD_SYSTEM_DATA;
 
 static THREAD_SYSTEM_DATA m_threadSystemData;
@@ -121,6 +129,8 @@ _ThreadDereference(
 
 static FUNC_FreeFunction            _ThreadDestroy;
 
+static FUNC_ConcHashReferenceFunction   _ThreadTryReference;
+
 static
 void
 _ThreadKernelFunction(
@@ -136,6 +146,8 @@ ThreadSystemPreinit(
     void
     )
 {
+    STATUS status;
+
     memzero(&m_threadSystemData, sizeof(THREAD_SYSTEM_DATA));
 
     InitializeListHead(&m_threadSystemData.AllThreadsList);
@@ -143,6 +155,14 @@ ThreadSystemPreinit(
 
     InitializeListHead(&m_threadSystemData.ReadyThreadsList);
     LockInit(&m_threadSystemData.ReadyThreadsLock);
+
+    status = ConcHashTableInit(&m_threadSystemData.TidTable,
+                               m_threadSystemData.TidTableBuckets,
+                               ARRAYSIZE(m_threadSystemData.TidTableBuckets),
+                               m_threadSystemData.TidTableLocks,
+                               ARRAYSIZE(m_threadSystemData.TidTableLocks),
+                               FIELD_OFFSET(THREAD, Id) - FIELD_OFFSET(THREAD, TidTableEntry));
+    ASSERT(SUCCEEDED(status));
 }
 
 STATUS
@@ -654,6 +674,19 @@ ThreadSetPriority(
     GetCurrentThread()->Priority = NewPriority;
 }
 
+PTR_SUCCESS
+PTHREAD
+ThreadRetrieveById(
+    IN      TID                 ThreadId
+    )
+{
+    PCONC_HASH_ENTRY pEntry;
+
+    pEntry = ConcHashTableLookup(&m_threadSystemData.TidTable, ThreadId, _ThreadTryReference);
+
+    return (pEntry != NULL) ? CONTAINING_RECORD(pEntry, THREAD, TidTableEntry) : NULL;
+}
+
 STATUS
 ThreadExecuteForEachThreadEntry(
     IN      PFUNC_ListFunction  Function,
@@ -790,6 +823,10 @@ _ThreadInit(
         LockAcquire(&m_threadSystemData.AllThreadsLock, &oldIntrState);
         InsertTailList(&m_threadSystemData.AllThreadsList, &pThread->AllList);
         LockRelease(&m_threadSystemData.AllThreadsLock, oldIntrState);
+
+        // the TIDs are never reused => the insertion cannot collide
+        status = ConcHashTableInsert(&m_threadSystemData.TidTable, &pThread->TidTableEntry);
+        ASSERT(SUCCEEDED(status));
     }
     __finally
     {
@@ -1192,6 +1229,15 @@ _ThreadDereference(
     RfcDereference(&Thread->RefCnt);
 }
 
+static
+BOOLEAN
+(__cdecl _ThreadTryReference)(
+    IN      PCONC_HASH_ENTRY        Entry
+    )
+{
+    return RfcTryReference(&CONTAINING_RECORD(Entry, THREAD, TidTableEntry)->RefCnt);
+}
+
 static
 void
 _ThreadDestroy(
@@ -1204,6 +1250,10 @@ _ThreadDestroy(
     ASSERT(NULL != Thread);
     ASSERT(NULL == Context);
 
+    // Nothing can find the thread by its TID after this, the threads which
+    // failed initialization were never inserted
+    ConcHashTableRemoveEntry(&m_threadSystemData.TidTable, &Thread->TidTableEntry);
+
     // This must be done before removing the thread from the process list, else
     // this may be the last thread and the process VAS will be freed by the time
     // ProcessRemoveThreadFromList - this function also dereferences the process
@@ -12,7 +12,8 @@ _UmApplicationReadExecutableContents(
     IN_Z        char*       FullPath,
     _Outptr_result_buffer_(*BufferSize)
                 PVOID*      Buffer,
-    OUT         QWORD*      BufferSize
+    OUT         QWORD*      BufferSize,
+    OUT_PTR     PFILE_OBJECT*       ImageFile
     );
 
 static
@@ -24,12 +25,14 @@ _UmApplicationDiscardKernelExecutableMapping(
 STATUS
 UmApplicationRetrieveHeader(
     IN_Z        char*                   Path,
-    OUT         PPE_NT_HEADER_INFO      NtHeaderInfo
+    OUT         PPE_NT_HEADER_INFO      NtHeaderInfo,
+    OUT_PTR     PFILE_OBJECT*           ImageFile
     )
 {
     STATUS status;
     QWORD peSize;
     PVOID pBuffer;
+    PFILE_OBJECT pImageFile;
 
     if (Path == NULL)
     {
@@ -41,9 +44,15 @@ UmApplicationRetrieveHeader(
         return STATUS_INVALID_PARAMETER2;
     }
 
+    if (ImageFile == NULL)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
     LOG_FUNC_START;
 
     pBuffer = NULL;
+    pImageFile = NULL;
     status = STATUS_SUCCESS;
     peSize = 0;
     memzero(NtHeaderInfo, sizeof(PE_NT_HEADER_INFO));
@@ -54,7 +63,8 @@ UmApplicationRetrieveHeader(
 
         status = _UmApplicationReadExecutableContents(Path,
                                                       &pBuffer,
-                                                      &peSize);
+                                                      &peSize,
+                                                      &pImageFile);
         if (!SUCCEEDED(status))
         {
             LOG_FUNC_ERROR("_UmApplicationReadExecutableContents", status);
@@ -77,13 +87,24 @@ UmApplicationRetrieveHeader(
     }
     __finally
     {
-        if (!SUCCEEDED(status))
+        if (SUCCEEDED(status))
+        {
+            *ImageFile = pImageFile;
+        }
+        else
         {
             if (pBuffer != NULL)
             {
                 _UmApplicationDiscardKernelExecutableMapping(pBuffer);
                 pBuffer = NULL;
             }
+
+            // the file can be closed only after the mapping is gone
+            if (pImageFile != NULL)
+            {
+                IoCloseFile(pImageFile);
+                pImageFile = NULL;
+            }
         }
     }
 
@@ -114,6 +135,8 @@ UmApplicationRun(
     {
         // Loads the kernel image at the preferred image dictated by the NT header
         status = MmuLoadPe(Process->HeaderInfo,
+                           Process->ImageFile,
+                           Process->VaSpace,
                            Process->PagingData);
         if (!SUCCEEDED(status))
         {
@@ -167,7 +190,8 @@ _UmApplicationReadExecutableContents(
     IN_Z        char*       FullPath,
     _Outptr_result_buffer_(*BufferSize)
                 PVOID*      Buffer,
-    OUT         QWORD*      BufferSize
+    OUT         QWORD*      BufferSize,
+    OUT_PTR     PFILE_OBJECT*       ImageFile
     )
 {
     PFILE_OBJECT pExecutableFile;
@@ -210,19 +234,21 @@ _UmApplicationReadExecutableContents(
         LOG_TRACE_USERMODE("Executable has %U bytes length, file object at 0x%X!\n", fileInfo.FileSize, pExecutableFile);
         ASSERT(fileInfo.FileSize <= MAX_DWORD);
 
-        // Allocate a memory region backed up by a file and bring it eagerly into memory
-        pBuffer = VmmAllocRegionEx(NULL,
+        // Map the file lazily, only the pages touched while parsing the headers
+        // are read, the sections are brought in by the process itself. The pages
+        // come from the page cache, so an executable already loaded by another
+        // process is not read again from the disk
+        pBuffer = VmmMapFileRegion(NULL,
                                    fileInfo.FileSize,
-                                   VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT | VMM_ALLOC_TYPE_NOT_LAZY,
-                                   PAGE_RIGHTS_READWRITE,
-                                   FALSE,
+                                   PAGE_RIGHTS_READ,
                                    pExecutableFile,
-                                   NULL,
+                                   0,
                                    NULL,
                                    NULL);
         if (pBuffer == NULL)
         {
-            LOG_FUNC_ERROR_ALLOC("VmmAllocRegionEx", fileInfo.FileSize);
+            status = STATUS_INSUFFICIENT_MEMORY;
+            LOG_FUNC_ERROR_ALLOC("VmmMapFileRegion", fileInfo.FileSize);
             __leave;
         }
 
@@ -234,6 +260,7 @@ _UmApplicationReadExecutableContents(
         {
             *BufferSize = fileInfo.FileSize;
             *Buffer = pBuffer;
+            *ImageFile = pExecutableFile;
         }
         else
         {
@@ -4,27 +4,71 @@
 #include "bitmap.h"
 #include "lock_common.h"
 #include "io.h"
+#include "page_cache.h"
 
 typedef enum _VMM_RESERVATION_STATE
 {
     VmmReservationStateFree     = 0x0,
     VmmReservationStateUsed     = 0x1,
-    VmmReservationStateLast     = 0x2,
+
+    // The entry describes a free range of VA left behind by released reservations
+    VmmReservationStateGap      = 0x2,
 } VMM_RESERVATION_STATE;
 
+// AVL tree node, the trees are intrusive and the nodes are embedded in the
+// reservation entries
+typedef struct _VMM_RESERVATION_NODE
+{
+    struct _VMM_RESERVATION_NODE*   Left;
+    struct _VMM_RESERVATION_NODE*   Right;
+    struct _VMM_RESERVATION_NODE*   Parent;
+
+    DWORD                           Height;
+} VMM_RESERVATION_NODE, *PVMM_RESERVATION_NODE;
+
+typedef
+INT32
+(__cdecl FUNC_VmTreeCompare)(
+    IN      PVMM_RESERVATION_NODE   First,
+    IN      PVMM_RESERVATION_NODE   Second
+    );
+
+typedef FUNC_VmTreeCompare*     PFUNC_VmTreeCompare;
+
 typedef struct _VMM_RESERVATION
 {
     PVOID                   StartVa;
     QWORD                   Size;
 
+    // Links the used and gap entries in VMM_RESERVATION_SPACE.AddressTreeRoot
+    VMM_RESERVATION_NODE    AddressNode;
+
+    // Links the gap entries in VMM_RESERVATION_SPACE.GapTreeRoot
+    VMM_RESERVATION_NODE    GapNode;
+
+    // Links the free entries in VMM_RESERVATION_SPACE.FreeReservationList
+    struct _VMM_RESERVATION* NextFree;
+
     PAGE_RIGHTS             PageRights;
     VMM_RESERVATION_STATE   State;
 
     BOOLEAN                 Uncacheable;
 
-    // Used for memory backed up by files
+    // The reservation is 2MB aligned and its committed memory is backed by
+    // large pages when possible
+    BOOLEAN                 LargePages;
+
+    // Used for memory backed up by files, the file object is not owned by the
+    // reservation, it must be kept open until the reservation is released
     PFILE_OBJECT            BackingFile;
 
+    // Offset in BackingFile of the data found at StartVa
+    QWORD                   FileOffset;
+
+    // If non-NULL the pages of BackingFile are taken from the page cache and
+    // shared with the other mappings of the same file
+    PPAGE_CACHE_FILE        CacheFile;
+
     BITMAP                  CommitBitmap;
 } VMM_RESERVATION, *PVMM_RESERVATION;
 
@@ -34,12 +78,12 @@ typedef struct _VMM_RESERVATION
 
 //******************************************************************************
 // Function:     _VmFindFirstFreeReservation
-// Description:  Returns the first free reservation entry or NULL if the whole
-//               region was exhausted.
+// Description:  Returns a free reservation entry or NULL if the whole region
+//               was exhausted. Released entries are reused first.
 // Returns:      PVMM_RESERVATION
 // Parameter:    void
 //******************************************************************************
-REQUIRES_SHARED_LOCK(ReservationSpace->ReservationLock)
+REQUIRES_EXCL_LOCK(ReservationSpace->ReservationLock)
 static
 PTR_SUCCESS
 PVMM_RESERVATION
@@ -87,7 +131,10 @@ _VmInitializeReservation(
     IN      QWORD                   Size,
     IN      PAGE_RIGHTS             PageRights,
     IN      BOOLEAN                 Uncacheable,
+    IN      BOOLEAN                 LargePages,
     IN_OPT  PFILE_OBJECT            FileObject,
+    IN      QWORD                   FileOffset,
+    IN_OPT  PPAGE_CACHE_FILE        CacheFile,
     OUT     PVMM_RESERVATION        VmmReservation
     );
 
@@ -111,7 +158,10 @@ _VmChangeVaReservationState(
     IN      VMM_ALLOC_TYPE          AllocationType,
     IN      PAGE_RIGHTS             PageRights,
     IN      BOOLEAN                 Uncacheable,
-    IN_OPT  PFILE_OBJECT            FileObject
+    IN      BOOLEAN                 LargePages,
+    IN_OPT  PFILE_OBJECT            FileObject,
+    IN      QWORD                   FileOffset,
+    IN_OPT  PPAGE_CACHE_FILE        CacheFile
     );
 
 // This function should be called only on a copy of the reservation to be uninitialized
@@ -167,65 +217,781 @@ _VmIsVaCommited(
     IN      PVOID                   Address
     );
 
+//******************************************************************************
+// Function:     _VmDetermineCommittedRange
+// Description:  Determines the run of committed pages which contains Address
+//               without leaving the WindowPages aligned window around it.
+// Returns:      void
+// Parameter:    IN PVMM_RESERVATION VmmReservation
+// Parameter:    IN PVOID Address - must be committed
+// Parameter:    IN DWORD WindowPages
+// Parameter:    OUT PVOID* RangeStart
+// Parameter:    OUT DWORD* RangePages
+//******************************************************************************
+/// REQUIRES_SHARED_LOCK(m_vmmData.ReservationLock)
+static
+void
+_VmDetermineCommittedRange(
+    IN      PVMM_RESERVATION        VmmReservation,
+    IN      PVOID                   Address,
+    IN      DWORD                   WindowPages,
+    OUT     PVOID*                  RangeStart,
+    OUT     DWORD*                  RangePages
+    );
+
+static FUNC_VmTreeCompare _VmCompareReservationAddress;
+
+static FUNC_VmTreeCompare _VmCompareGapSize;
+
+//******************************************************************************
+// Function:     _VmTreeInsert
+// Description:  Inserts Node in the AVL tree ordered by Compare and rebalances
+//               the tree.
+// Returns:      void
+// Parameter:    INOUT PVMM_RESERVATION_NODE* Root
+// Parameter:    INOUT PVMM_RESERVATION_NODE Node
+// Parameter:    IN PFUNC_VmTreeCompare Compare
+//******************************************************************************
+static
+void
+_VmTreeInsert(
+    INOUT   PVMM_RESERVATION_NODE*  Root,
+    INOUT   PVMM_RESERVATION_NODE   Node,
+    IN      PFUNC_VmTreeCompare     Compare
+    );
+
+//******************************************************************************
+// Function:     _VmTreeRemove
+// Description:  Removes Node from the AVL tree and rebalances the tree.
+// Returns:      void
+// Parameter:    INOUT PVMM_RESERVATION_NODE* Root
+// Parameter:    INOUT PVMM_RESERVATION_NODE Node
+//******************************************************************************
+static
+void
+_VmTreeRemove(
+    INOUT   PVMM_RESERVATION_NODE*  Root,
+    INOUT   PVMM_RESERVATION_NODE   Node
+    );
+
+//******************************************************************************
+// Function:     _VmFindEntryFloor
+// Description:  Returns the used or gap entry with the greatest start VA which
+//               is lower or equal to Address.
+// Returns:      PVMM_RESERVATION - NULL if there is no such entry
+// Parameter:    IN PVOID Address
+//******************************************************************************
+REQUIRES_SHARED_LOCK(ReservationSpace->ReservationLock)
+static
+PVMM_RESERVATION
+_VmFindEntryFloor(
+    IN      PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address
+    );
+
+//******************************************************************************
+// Function:     _VmFindEntryCeiling
+// Description:  Returns the used or gap entry with the lowest start VA which
+//               is greater or equal to Address.
+// Returns:      PVMM_RESERVATION - NULL if there is no such entry
+// Parameter:    IN PVOID Address
+//******************************************************************************
+REQUIRES_SHARED_LOCK(ReservationSpace->ReservationLock)
+static
+PVMM_RESERVATION
+_VmFindEntryCeiling(
+    IN      PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address
+    );
+
+//******************************************************************************
+// Function:     _VmFindBestFitGap
+// Description:  Returns the smallest gap of at least Size bytes.
+// Returns:      PVMM_RESERVATION - NULL if no gap is large enough
+// Parameter:    IN QWORD Size
+//******************************************************************************
+REQUIRES_SHARED_LOCK(ReservationSpace->ReservationLock)
+static
+PVMM_RESERVATION
+_VmFindBestFitGap(
+    IN      PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      QWORD                   Size
+    );
+
+//******************************************************************************
+// Function:     _VmClaimVirtualRange
+// Description:  Makes sure the range does not overlap any reservation and
+//               removes it from the gaps it intersects.
+// Returns:      STATUS - STATUS_MEMORY_ALREADY_RESERVED if a reservation
+//               overlaps the range.
+// Parameter:    IN PVOID Address
+// Parameter:    IN QWORD Size
+//******************************************************************************
+REQUIRES_EXCL_LOCK(ReservationSpace->ReservationLock)
+static
+STATUS
+_VmClaimVirtualRange(
+    INOUT   PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address,
+    IN      QWORD                   Size
+    );
+
+REQUIRES_EXCL_LOCK(ReservationSpace->ReservationLock)
+static
+void
+_VmInitializeGap(
+    INOUT   PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address,
+    IN      QWORD                   Size,
+    OUT     PVMM_RESERVATION        Gap
+    );
+
+// The entry must have already been removed from the trees
+REQUIRES_EXCL_LOCK(ReservationSpace->ReservationLock)
+static
+void
+_VmReleaseReservationEntry(
+    INOUT   PVMM_RESERVATION_SPACE  ReservationSpace,
+    INOUT   PVMM_RESERVATION        Reservation
+    );
+
+
+// We have the following virtual memory layout
+// --------------------------------------------------------------------------------------------------------------
+// |          ReservationMetadataBaseAddress  | + ReservationMetadataSize or at ReservationBaseAddress          |
+// --------------------------------------------------------------------------------------------------------------
+// | ReservationList | Commit Bitmap Buffers  | VmmAllocRegionEx allocates Virtual Addresses starting from here |
+// --------------------------------------------------------------------------------------------------------------
+// |       20%       |          80%           |                                                                 |
+// --------------------------------------------------------------------------------------------------------------
+_No_competing_thread_
+void
+VmReservationSpaceInit(
+    IN          PVOID                   ReservationMetadataBaseAddress,
+    IN_OPT      PVOID                   ReservationBaseAddress,
+    IN          QWORD                   ReservationMetadataSize,
+    OUT         PVMM_RESERVATION_SPACE  ReservationSpace
+    )
+{
+    QWORD sizeForReservationList;
+
+    ASSERT(NULL != ReservationMetadataBaseAddress );
+    ASSERT(IsAddressAligned(ReservationMetadataBaseAddress, PAGE_SIZE));
+    ASSERT(ReservationMetadataSize != 0);
+    ASSERT(NULL != ReservationSpace);
+
+    LOG_TRACE_VMM("VMM reservation space base address at 0x%X\n", ReservationMetadataBaseAddress);
+
+    sizeForReservationList = CalculatePercentage(ReservationMetadataSize, RESERVATION_LIST_PERCENTAGE_IN_HUNDREDS);
+
+    ReservationSpace->ReservationList = (PVMM_RESERVATION) ReservationMetadataBaseAddress;
+    ReservationSpace->BitmapAddressStart = PtrOffset(ReservationMetadataBaseAddress, sizeForReservationList);
+    ReservationSpace->FreeBitmapAddress = ReservationSpace->BitmapAddressStart;
+
+    LOG_TRACE_VMM("Start of bitmap address: 0x%X\n", ReservationSpace->BitmapAddressStart);
+
+    ReservationSpace->FreeVirtualAddressPointer = (ReservationBaseAddress == NULL) ?
+                    (PVOID)PtrOffset(ReservationMetadataBaseAddress, ReservationMetadataSize) :
+                    ReservationBaseAddress;
+    ReservationSpace->StartOfVirtualAddressSpace = ReservationSpace->FreeVirtualAddressPointer;
+    ReservationSpace->ReservedAreaSize = ReservationMetadataSize;
+
+    ReservationSpace->NextUnusedReservation = ReservationSpace->ReservationList;
+    ReservationSpace->FreeReservationList = NULL;
+    ReservationSpace->AddressTreeRoot = NULL;
+    ReservationSpace->GapTreeRoot = NULL;
+
+    LOG_TRACE_VMM("First virtual address is 0x%X\n", ReservationSpace->FreeVirtualAddressPointer);
+    LOG_TRACE_VMM("Start of reserved VA: 0x%X\n", ReservationMetadataBaseAddress );
+    LOG_TRACE_VMM("End of reserved VA: 0x%X\n", PtrOffset(ReservationMetadataBaseAddress, ReservationSpace->ReservedAreaSize));
+
+    LOG_TRACE_VMM("Reserved area size: %U KB\n", ReservationMetadataSize / KB_SIZE );
+
+    RwSpinlockInit(&ReservationSpace->ReservationLock);
+}
+
+_No_competing_thread_
+void
+VmReservationSpaceFinishInit(
+    INOUT       PVMM_RESERVATION_SPACE  ReservationSpace
+    )
+{
+    ASSERT(ReservationSpace != NULL);
+
+    // Entries are handed out through NextUnusedReservation so the list itself
+    // needs no initialization, this is the first point where it could be accessed
+    ASSERT(ReservationSpace->NextUnusedReservation == ReservationSpace->ReservationList);
+    ASSERT(ReservationSpace->AddressTreeRoot == NULL);
+}
+
+static
+DWORD
+_VmTreeNodeHeight(
+    IN_OPT  PVMM_RESERVATION_NODE   Node
+    )
+{
+    return (Node == NULL) ? 0 : Node->Height;
+}
+
+static
+void
+_VmTreeUpdateHeight(
+    INOUT   PVMM_RESERVATION_NODE   Node
+    )
+{
+    Node->Height = 1 + max(_VmTreeNodeHeight(Node->Left), _VmTreeNodeHeight(Node->Right));
+}
+
+static
+void
+_VmTreeReplaceChild(
+    INOUT   PVMM_RESERVATION_NODE*  Root,
+    INOUT_OPT PVMM_RESERVATION_NODE Parent,
+    IN      PVMM_RESERVATION_NODE   OldChild,
+    INOUT_OPT PVMM_RESERVATION_NODE NewChild
+    )
+{
+    if (Parent == NULL)
+    {
+        *Root = NewChild;
+    }
+    else if (Parent->Left == OldChild)
+    {
+        Parent->Left = NewChild;
+    }
+    else
+    {
+        ASSERT(Parent->Right == OldChild);
+        Parent->Right = NewChild;
+    }
+
+    if (NewChild != NULL)
+    {
+        NewChild->Parent = Parent;
+    }
+}
+
+static
+PVMM_RESERVATION_NODE
+_VmTreeRotateLeft(
+    INOUT   PVMM_RESERVATION_NODE*  Root,
+    INOUT   PVMM_RESERVATION_NODE   Node
+    )
+{
+    PVMM_RESERVATION_NODE pPivot = Node->Right;
+
+    Node->Right = pPivot->Left;
+    if (pPivot->Left != NULL)
+    {
+        pPivot->Left->Parent = Node;
+    }
+
+    _VmTreeReplaceChild(Root, Node->Parent, Node, pPivot);
+
+    pPivot->Left = Node;
+    Node->Parent = pPivot;
+
+    _VmTreeUpdateHeight(Node);
+    _VmTreeUpdateHeight(pPivot);
+
+    return pPivot;
+}
+
+static
+PVMM_RESERVATION_NODE
+_VmTreeRotateRight(
+    INOUT   PVMM_RESERVATION_NODE*  Root,
+    INOUT   PVMM_RESERVATION_NODE   Node
+    )
+{
+    PVMM_RESERVATION_NODE pPivot = Node->Left;
+
+    Node->Left = pPivot->Right;
+    if (pPivot->Right != NULL)
+    {
+        pPivot->Right->Parent = Node;
+    }
+
+    _VmTreeReplaceChild(Root, Node->Parent, Node, pPivot);
+
+    pPivot->Right = Node;
+    Node->Parent = pPivot;
+
+    _VmTreeUpdateHeight(Node);
+    _VmTreeUpdateHeight(pPivot);
+
+    return pPivot;
+}
+
+// Walks from Node up to the root restoring the heights and the AVL invariant
+static
+void
+_VmTreeRebalance(
+    INOUT   PVMM_RESERVATION_NODE*  Root,
+    INOUT_OPT PVMM_RESERVATION_NODE Node
+    )
+{
+    while (Node != NULL)
+    {
+        INT32 balance;
+
+        _VmTreeUpdateHeight(Node);
+
+        balance = (INT32) _VmTreeNodeHeight(Node->Left) - (INT32) _VmTreeNodeHeight(Node->Right);
+        if (balance > 1)
+        {
+            if (_VmTreeNodeHeight(Node->Left->Left) < _VmTreeNodeHeight(Node->Left->Right))
+            {
+                _VmTreeRotateLeft(Root, Node->Left);
+            }
+            Node = _VmTreeRotateRight(Root, Node);
+        }
+        else if (balance < -1)
+        {
+            if (_VmTreeNodeHeight(Node->Right->Right) < _VmTreeNodeHeight(Node->Right->Left))
+            {
+                _VmTreeRotateRight(Root, Node->Right);
+            }
+            Node = _VmTreeRotateLeft(Root, Node);
+        }
+
+        Node = Node->Parent;
+    }
+}
+
+static
+void
+_VmTreeInsert(
+    INOUT   PVMM_RESERVATION_NODE*  Root,
+    INOUT   PVMM_RESERVATION_NODE   Node,
+    IN      PFUNC_VmTreeCompare     Compare
+    )
+{
+    PVMM_RESERVATION_NODE pParent;
+    PVMM_RESERVATION_NODE* pLink;
+
+    ASSERT(Root != NULL);
+    ASSERT(Node != NULL);
+    ASSERT(Compare != NULL);
+
+    pParent = NULL;
+    pLink = Root;
+
+    while (*pLink != NULL)
+    {
+        pParent = *pLink;
+        pLink = (Compare(Node, pParent) < 0) ? &pParent->Left : &pParent->Right;
+    }
+
+    Node->Left = NULL;
+    Node->Right = NULL;
+    Node->Parent = pParent;
+    Node->Height = 1;
+
+    *pLink = Node;
+
+    _VmTreeRebalance(Root, pParent);
+}
+
+static
+void
+_VmTreeRemove(
+    INOUT   PVMM_RESERVATION_NODE*  Root,
+    INOUT   PVMM_RESERVATION_NODE   Node
+    )
+{
+    PVMM_RESERVATION_NODE pRebalanceFrom;
+
+    ASSERT(Root != NULL);
+    ASSERT(Node != NULL);
+
+    if (Node->Left == NULL || Node->Right == NULL)
+    {
+        pRebalanceFrom = Node->Parent;
+
+        _VmTreeReplaceChild(Root, Node->Parent, Node, (Node->Left != NULL) ? Node->Left : Node->Right);
+    }
+    else
+    {
+        PVMM_RESERVATION_NODE pSuccessor;
+
+        // the in-order successor takes the place of the node
+        for (pSuccessor = Node->Right; pSuccessor->Left != NULL; pSuccessor = pSuccessor->Left);
+
+        if (pSuccessor->Parent == Node)
+        {
+            pRebalanceFrom = pSuccessor;
+        }
+        else
+        {
+            pRebalanceFrom = pSuccessor->Parent;
+
+            _VmTreeReplaceChild(Root, pSuccessor->Parent, pSuccessor, pSuccessor->Right);
+
+            pSuccessor->Right = Node->Right;
+            pSuccessor->Right->Parent = pSuccessor;
+        }
+
+        pSuccessor->Left = Node->Left;
+        pSuccessor->Left->Parent = pSuccessor;
+
+        _VmTreeReplaceChild(Root, Node->Parent, Node, pSuccessor);
+        pSuccessor->Height = Node->Height;
+    }
+
+    Node->Left = Node->Right = Node->Parent = NULL;
+    Node->Height = 0;
+
+    _VmTreeRebalance(Root, pRebalanceFrom);
+}
+
+static
+PVMM_RESERVATION_NODE
+_VmTreePrevious(
+    IN      PVMM_RESERVATION_NODE   Node
+    )
+{
+    PVMM_RESERVATION_NODE pCurrent;
+    PVMM_RESERVATION_NODE pParent;
+
+    ASSERT(Node != NULL);
+
+    if (Node->Left != NULL)
+    {
+        for (pCurrent = Node->Left; pCurrent->Right != NULL; pCurrent = pCurrent->Right);
+
+        return pCurrent;
+    }
+
+    pCurrent = Node;
+    for (pParent = Node->Parent; pParent != NULL && pCurrent == pParent->Left; pParent = pParent->Parent)
+    {
+        pCurrent = pParent;
+    }
+
+    return pParent;
+}
+
+static
+PVMM_RESERVATION
+_VmPreviousEntry(
+    IN      PVMM_RESERVATION        Reservation
+    )
+{
+    PVMM_RESERVATION_NODE pNode = _VmTreePrevious(&Reservation->AddressNode);
+
+    return (pNode == NULL) ? NULL : CONTAINING_RECORD(pNode, VMM_RESERVATION, AddressNode);
+}
+
+static
+INT32
+(__cdecl _VmCompareReservationAddress)(
+    IN      PVMM_RESERVATION_NODE   First,
+    IN      PVMM_RESERVATION_NODE   Second
+    )
+{
+    PVMM_RESERVATION pFirst = CONTAINING_RECORD(First, VMM_RESERVATION, AddressNode);
+    PVMM_RESERVATION pSecond = CONTAINING_RECORD(Second, VMM_RESERVATION, AddressNode);
+
+    if (pFirst->StartVa == pSecond->StartVa)
+    {
+        return 0;
+    }
+
+    return (pFirst->StartVa < pSecond->StartVa) ? -1 : 1;
+}
+
+static
+INT32
+(__cdecl _VmCompareGapSize)(
+    IN      PVMM_RESERVATION_NODE   First,
+    IN      PVMM_RESERVATION_NODE   Second
+    )
+{
+    PVMM_RESERVATION pFirst = CONTAINING_RECORD(First, VMM_RESERVATION, GapNode);
+    PVMM_RESERVATION pSecond = CONTAINING_RECORD(Second, VMM_RESERVATION, GapNode);
+
+    if (pFirst->Size != pSecond->Size)
+    {
+        return (pFirst->Size < pSecond->Size) ? -1 : 1;
+    }
+
+    // gaps of equal size are ordered by their address so that the lowest one is used first
+    if (pFirst->StartVa == pSecond->StartVa)
+    {
+        return 0;
+    }
+
+    return (pFirst->StartVa < pSecond->StartVa) ? -1 : 1;
+}
+
+REQUIRES_SHARED_LOCK(ReservationSpace->ReservationLock)
+static
+PVMM_RESERVATION
+_VmFindEntryFloor(
+    IN      PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address
+    )
+{
+    PVMM_RESERVATION pResult;
+    PVMM_RESERVATION_NODE pNode;
+
+    ASSERT(ReservationSpace != NULL);
+
+    pResult = NULL;
+    pNode = ReservationSpace->AddressTreeRoot;
+
+    while (pNode != NULL)
+    {
+        PVMM_RESERVATION pEntry = CONTAINING_RECORD(pNode, VMM_RESERVATION, AddressNode);
+
+        if (pEntry->StartVa <= Address)
+        {
+            pResult = pEntry;
+            pNode = pNode->Right;
+        }
+        else
+        {
+            pNode = pNode->Left;
+        }
+    }
+
+    return pResult;
+}
+
+REQUIRES_SHARED_LOCK(ReservationSpace->ReservationLock)
+static
+PVMM_RESERVATION
+_VmFindEntryCeiling(
+    IN      PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address
+    )
+{
+    PVMM_RESERVATION pResult;
+    PVMM_RESERVATION_NODE pNode;
+
+    ASSERT(ReservationSpace != NULL);
+
+    pResult = NULL;
+    pNode = ReservationSpace->AddressTreeRoot;
+
+    while (pNode != NULL)
+    {
+        PVMM_RESERVATION pEntry = CONTAINING_RECORD(pNode, VMM_RESERVATION, AddressNode);
+
+        if (pEntry->StartVa >= Address)
+        {
+            pResult = pEntry;
+            pNode = pNode->Left;
+        }
+        else
+        {
+            pNode = pNode->Right;
+        }
+    }
+
+    return pResult;
+}
+
+REQUIRES_SHARED_LOCK(ReservationSpace->ReservationLock)
+static
+PVMM_RESERVATION
+_VmFindBestFitGap(
+    IN      PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      QWORD                   Size
+    )
+{
+    PVMM_RESERVATION pResult;
+    PVMM_RESERVATION_NODE pNode;
+
+    ASSERT(ReservationSpace != NULL);
+    ASSERT(Size != 0);
+
+    pResult = NULL;
+    pNode = ReservationSpace->GapTreeRoot;
+
+    while (pNode != NULL)
+    {
+        PVMM_RESERVATION pGap = CONTAINING_RECORD(pNode, VMM_RESERVATION, GapNode);
+
+        if (pGap->Size >= Size)
+        {
+            pResult = pGap;
+            pNode = pNode->Left;
+        }
+        else
+        {
+            pNode = pNode->Right;
+        }
+    }
+
+    return pResult;
+}
+
+REQUIRES_EXCL_LOCK(ReservationSpace->ReservationLock)
+static
+void
+_VmInitializeGap(
+    INOUT   PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address,
+    IN      QWORD                   Size,
+    OUT     PVMM_RESERVATION        Gap
+    )
+{
+    ASSERT(ReservationSpace != NULL);
+    ASSERT(Address != NULL);
+    ASSERT(Size != 0);
+    ASSERT(Gap != NULL);
+
+    memzero(Gap, sizeof(VMM_RESERVATION));
 
-// We have the following virtual memory layout
-// --------------------------------------------------------------------------------------------------------------
-// |          ReservationMetadataBaseAddress  | + ReservationMetadataSize or at ReservationBaseAddress          |
-// --------------------------------------------------------------------------------------------------------------
-// | ReservationList | Commit Bitmap Buffers  | VmmAllocRegionEx allocates Virtual Addresses starting from here |
-// --------------------------------------------------------------------------------------------------------------
-// |       20%       |          80%           |                                                                 |
-// --------------------------------------------------------------------------------------------------------------
-_No_competing_thread_
+    Gap->State = VmmReservationStateGap;
+    Gap->StartVa = Address;
+    Gap->Size = Size;
+
+    _VmTreeInsert(&ReservationSpace->AddressTreeRoot, &Gap->AddressNode, _VmCompareReservationAddress);
+    _VmTreeInsert(&ReservationSpace->GapTreeRoot, &Gap->GapNode, _VmCompareGapSize);
+}
+
+REQUIRES_EXCL_LOCK(ReservationSpace->ReservationLock)
+static
 void
-VmReservationSpaceInit(
-    IN          PVOID                   ReservationMetadataBaseAddress,
-    IN_OPT      PVOID                   ReservationBaseAddress,
-    IN          QWORD                   ReservationMetadataSize,
-    OUT         PVMM_RESERVATION_SPACE  ReservationSpace
+_VmReleaseReservationEntry(
+    INOUT   PVMM_RESERVATION_SPACE  ReservationSpace,
+    INOUT   PVMM_RESERVATION        Reservation
     )
 {
-    QWORD sizeForReservationList;
+    ASSERT(ReservationSpace != NULL);
+    ASSERT(Reservation != NULL);
 
-    ASSERT(NULL != ReservationMetadataBaseAddress );
-    ASSERT(IsAddressAligned(ReservationMetadataBaseAddress, PAGE_SIZE));
-    ASSERT(ReservationMetadataSize != 0);
-    ASSERT(NULL != ReservationSpace);
+    memzero(Reservation, sizeof(VMM_RESERVATION));
+    Reservation->State = VmmReservationStateFree;
 
-    LOG_TRACE_VMM("VMM reservation space base address at 0x%X\n", ReservationMetadataBaseAddress);
+    Reservation->NextFree = ReservationSpace->FreeReservationList;
+    ReservationSpace->FreeReservationList = Reservation;
+}
 
-    sizeForReservationList = CalculatePercentage(ReservationMetadataSize, RESERVATION_LIST_PERCENTAGE_IN_HUNDREDS);
+// Removes the intersection of [Address, Address + Size) with the gap
+REQUIRES_EXCL_LOCK(ReservationSpace->ReservationLock)
+static
+STATUS
+_VmCarveGap(
+    INOUT   PVMM_RESERVATION_SPACE  ReservationSpace,
+    INOUT   PVMM_RESERVATION        Gap,
+    IN      PVOID                   Address,
+    IN      QWORD                   Size
+    )
+{
+    QWORD gapStart;
+    QWORD gapEnd;
+    QWORD carveStart;
+    QWORD carveEnd;
 
-    ReservationSpace->ReservationList = (PVMM_RESERVATION) ReservationMetadataBaseAddress;
-    ReservationSpace->BitmapAddressStart = PtrOffset(ReservationMetadataBaseAddress, sizeForReservationList);
-    ReservationSpace->FreeBitmapAddress = ReservationSpace->BitmapAddressStart;
+    ASSERT(ReservationSpace != NULL);
+    ASSERT(Gap != NULL);
+    ASSERT(VmmReservationStateGap == Gap->State);
 
-    LOG_TRACE_VMM("Start of bitmap address: 0x%X\n", ReservationSpace->BitmapAddressStart);
+    gapStart = (QWORD) Gap->StartVa;
+    gapEnd = gapStart + Gap->Size;
+    carveStart = max(gapStart, (QWORD) Address);
+    carveEnd = min(gapEnd, (QWORD) Address + Size);
 
-    ReservationSpace->FreeVirtualAddressPointer = (ReservationBaseAddress == NULL) ?
-                    (PVOID)PtrOffset(ReservationMetadataBaseAddress, ReservationMetadataSize) :
-                    ReservationBaseAddress;
-    ReservationSpace->StartOfVirtualAddressSpace = ReservationSpace->FreeVirtualAddressPointer;
-    ReservationSpace->ReservedAreaSize = ReservationMetadataSize;
+    ASSERT(carveStart < carveEnd);
 
-    LOG_TRACE_VMM("First virtual address is 0x%X\n", ReservationSpace->FreeVirtualAddressPointer);
-    LOG_TRACE_VMM("Start of reserved VA: 0x%X\n", ReservationMetadataBaseAddress );
-    LOG_TRACE_VMM("End of reserved VA: 0x%X\n", PtrOffset(ReservationMetadataBaseAddress, ReservationSpace->ReservedAreaSize));
+    if (carveStart > gapStart && carveEnd < gapEnd)
+    {
+        PVMM_RESERVATION pTail;
 
-    LOG_TRACE_VMM("Reserved area size: %U KB\n", ReservationMetadataSize / KB_SIZE );
+        // the range is inside the gap, whatever follows it becomes a new gap
+        pTail = _VmFindFirstFreeReservation(ReservationSpace);
+        if (NULL == pTail)
+        {
+            LOG_ERROR("There is no reservation entry left to split the gap at 0x%X\n", Gap->StartVa);
+            return STATUS_INSUFFICIENT_MEMORY;
+        }
 
-    RwSpinlockInit(&ReservationSpace->ReservationLock);
+        _VmInitializeGap(ReservationSpace, (PVOID) carveEnd, gapEnd - carveEnd, pTail);
+        gapEnd = carveEnd;
+    }
+
+    _VmTreeRemove(&ReservationSpace->GapTreeRoot, &Gap->GapNode);
+
+    if (carveStart == gapStart && carveEnd == gapEnd)
+    {
+        _VmTreeRemove(&ReservationSpace->AddressTreeRoot, &Gap->AddressNode);
+        _VmReleaseReservationEntry(ReservationSpace, Gap);
+
+        return STATUS_SUCCESS;
+    }
+
+    // the gaps never overlap anything else so moving the start of the gap inside its
+    // own range does not change its position in the address tree
+    if (carveStart == gapStart)
+    {
+        Gap->StartVa = (PVOID) carveEnd;
+        Gap->Size = gapEnd - carveEnd;
+    }
+    else
+    {
+        Gap->Size = carveStart - gapStart;
+    }
+
+    _VmTreeInsert(&ReservationSpace->GapTreeRoot, &Gap->GapNode, _VmCompareGapSize);
+
+    return STATUS_SUCCESS;
 }
 
-_No_competing_thread_
-void
-VmReservationSpaceFinishInit(
-    INOUT       PVMM_RESERVATION_SPACE  ReservationSpace
+REQUIRES_EXCL_LOCK(ReservationSpace->ReservationLock)
+static
+STATUS
+_VmClaimVirtualRange(
+    INOUT   PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address,
+    IN      QWORD                   Size
     )
 {
+    PVMM_RESERVATION pEntry;
+    PVOID pLastByte;
+    STATUS status;
+
     ASSERT(ReservationSpace != NULL);
+    ASSERT(Address != NULL);
+    ASSERT(Size != 0);
+
+    pLastByte = PtrOffset(Address, Size - 1);
+
+    // walk backwards over all the entries intersecting the range, first to make sure we won't
+    // fail after we have already modified some of the gaps
+    for (pEntry = _VmFindEntryFloor(ReservationSpace, pLastByte);
+         pEntry != NULL && PtrOffset(pEntry->StartVa, pEntry->Size) > Address;
+         pEntry = _VmPreviousEntry(pEntry))
+    {
+        if (VmmReservationStateUsed == pEntry->State)
+        {
+            LOG_ERROR("Range 0x%X of size 0x%X overlaps the reservation at 0x%X of size 0x%X\n",
+                      Address, Size, pEntry->StartVa, pEntry->Size);
+            return STATUS_MEMORY_ALREADY_RESERVED;
+        }
+    }
+
+    pEntry = _VmFindEntryFloor(ReservationSpace, pLastByte);
+    while (pEntry != NULL && PtrOffset(pEntry->StartVa, pEntry->Size) > Address)
+    {
+        PVMM_RESERVATION pPrevious = _VmPreviousEntry(pEntry);
+
+        // only a range strictly inside a single gap can make the split fail and
+        // in that case nothing was changed yet
+        status = _VmCarveGap(ReservationSpace, pEntry, Address, Size);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_VmCarveGap", status);
+            return status;
+        }
+
+        pEntry = pPrevious;
+    }
 
-    ReservationSpace->ReservationList[0].State = VmmReservationStateLast;
+    return STATUS_SUCCESS;
 }
 
 REQUIRES_SHARED_LOCK(ReservationSpace->ReservationLock)
@@ -248,26 +1014,14 @@ _VmFindReservation(
     ASSERT(Reservation != NULL);
 
     status = STATUS_SUCCESS;
-    bFound = FALSE;
 
-    for(pCurrentReservation = ReservationSpace->ReservationList;
-            VmmReservationStateLast != pCurrentReservation->State &&
-            (PVOID) pCurrentReservation < ReservationSpace->BitmapAddressStart;
-        pCurrentReservation = pCurrentReservation + 1
-        )
-    {
-        if (VmmReservationStateFree == pCurrentReservation->State)
-        {
-            // skip free entries
-            continue;
-        }
+    // the entries never overlap => the only one which may contain the range
+    // is the last one starting at or before it
+    pCurrentReservation = _VmFindEntryFloor(ReservationSpace, Address);
 
-        if (CHECK_BOUNDS(Address, Size, pCurrentReservation->StartVa, pCurrentReservation->Size))
-        {
-            bFound = TRUE;
-            break;
-        }
-    }
+    bFound = (NULL != pCurrentReservation)
+          && (VmmReservationStateUsed == pCurrentReservation->State)
+          && CHECK_BOUNDS(Address, Size, pCurrentReservation->StartVa, pCurrentReservation->Size);
 
     if (!bFound)
     {
@@ -294,7 +1048,10 @@ _VmInitializeReservation(
     IN      QWORD                   Size,
     IN      PAGE_RIGHTS             PageRights,
     IN      BOOLEAN                 Uncacheable,
+    IN      BOOLEAN                 LargePages,
     IN_OPT  PFILE_OBJECT            FileObject,
+    IN      QWORD                   FileOffset,
+    IN_OPT  PPAGE_CACHE_FILE        CacheFile,
     OUT     PVMM_RESERVATION        VmmReservation
     )
 {
@@ -316,7 +1073,10 @@ _VmInitializeReservation(
     VmmReservation->Size = Size;
     VmmReservation->PageRights = PageRights;
     VmmReservation->Uncacheable = Uncacheable;
+    VmmReservation->LargePages = LargePages;
     VmmReservation->BackingFile = FileObject;
+    VmmReservation->FileOffset = FileOffset;
+    VmmReservation->CacheFile = CacheFile;
 
     LOG_TRACE_VMM("StartVa: 0x%X\n", Address );
     LOG_TRACE_VMM("Size: 0x%X\n", Size );
@@ -359,7 +1119,10 @@ _VmChangeVaReservationState(
     IN      VMM_ALLOC_TYPE          AllocationType,
     IN      PAGE_RIGHTS             PageRights,
     IN      BOOLEAN                 Uncacheable,
-    IN_OPT  PFILE_OBJECT            FileObject
+    IN      BOOLEAN                 LargePages,
+    IN_OPT  PFILE_OBJECT            FileObject,
+    IN      QWORD                   FileOffset,
+    IN_OPT  PPAGE_CACHE_FILE        CacheFile
     )
 {
     PVMM_RESERVATION pReservation;
@@ -410,6 +1173,15 @@ _VmChangeVaReservationState(
     switch (AllocationType)
     {
     case VMM_ALLOC_TYPE_RESERVE:
+        // _VmFindReservation only finds reservations containing the whole range, we
+        // also need to reject partial overlaps and take the range out of the free gaps
+        status = _VmClaimVirtualRange(ReservationSpace, Address, Size);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_VmClaimVirtualRange", status);
+            return status;
+        }
+
         pReservation = _VmFindFirstFreeReservation(ReservationSpace);
         ASSERT( NULL != pReservation );
 
@@ -423,9 +1195,14 @@ _VmChangeVaReservationState(
                                 Size,
                                 PageRights,
                                 Uncacheable,
+                                LargePages,
                                 FileObject,
+                                FileOffset,
+                                CacheFile,
                                 pReservation
                                 );
+
+        _VmTreeInsert(&ReservationSpace->AddressTreeRoot, &pReservation->AddressNode, _VmCompareReservationAddress);
         break;
     case VMM_ALLOC_TYPE_COMMIT:
         ASSERT( NULL != pReservation );
@@ -459,7 +1236,7 @@ _VmChangeVaReservationState(
     return status;
 }
 
-REQUIRES_SHARED_LOCK(ReservationSpace->ReservationLock)
+REQUIRES_EXCL_LOCK(ReservationSpace->ReservationLock)
 static
 PTR_SUCCESS
 PVMM_RESERVATION
@@ -471,31 +1248,19 @@ _VmFindFirstFreeReservation(
 
     ASSERT(ReservationSpace != NULL);
 
-    pResult = NULL;
+    pResult = ReservationSpace->FreeReservationList;
 
-    for (PVMM_RESERVATION pCurrentReservation = ReservationSpace->ReservationList;
-        (PVOID)pCurrentReservation < ReservationSpace->BitmapAddressStart;
-         pCurrentReservation = pCurrentReservation + 1
-         )
+    if (NULL != pResult)
     {
-        if (VmmReservationStateFree == pCurrentReservation->State)
-        {
-            pResult = pCurrentReservation;
-
-            break;
-        }
-
-        if (VmmReservationStateLast == pCurrentReservation->State)
-        {
-            pCurrentReservation->State = VmmReservationStateFree;
-
-            // set the next reservation as the last one
-            (pCurrentReservation + 1)->State = VmmReservationStateLast;
+        ASSERT(VmmReservationStateFree == pResult->State);
 
-            pResult = pCurrentReservation;
-
-            break;
-        }
+        ReservationSpace->FreeReservationList = pResult->NextFree;
+        pResult->NextFree = NULL;
+    }
+    else if ((PVOID)(ReservationSpace->NextUnusedReservation + 1) <= ReservationSpace->BitmapAddressStart)
+    {
+        pResult = ReservationSpace->NextUnusedReservation;
+        ReservationSpace->NextUnusedReservation = pResult + 1;
     }
 
     return pResult;
@@ -521,19 +1286,8 @@ _VmUninitializeReservation(
 
     MmuUnmapMemoryEx(pBitmapBuffer, bitmapSize, TRUE, NULL );
 
-    if (VmmReservation->BackingFile != NULL)
-    {
-        STATUS status;
-
-        // this is a memory mapped file
-        status = IoCloseFile(VmmReservation->BackingFile);
-        if (!SUCCEEDED(status))
-        {
-            LOG_FUNC_ERROR("IoCloseFile", status);
-        }
-
-        VmmReservation->BackingFile = NULL;
-    }
+    // the file object belongs to whoever mapped the file
+    VmmReservation->BackingFile = NULL;
 }
 
 /// REQUIRES_EXCL_LOCK(m_vmmData.ReservationLock)
@@ -608,6 +1362,51 @@ _VmIsVaCommited(
     return BitmapGetBitValue(&VmmReservation->CommitBitmap, (DWORD) pageNo );
 }
 
+/// REQUIRES_SHARED_LOCK(m_vmmData.ReservationLock)
+static
+void
+_VmDetermineCommittedRange(
+    IN      PVMM_RESERVATION        VmmReservation,
+    IN      PVOID                   Address,
+    IN      DWORD                   WindowPages,
+    OUT     PVOID*                  RangeStart,
+    OUT     DWORD*                  RangePages
+    )
+{
+    DWORD pageNo;
+    DWORD firstPage;
+    DWORD windowStart;
+    DWORD windowEnd;
+    DWORD lastPage;
+
+    ASSERT(NULL != VmmReservation);
+    ASSERT(0 != WindowPages);
+    ASSERT(NULL != RangeStart);
+    ASSERT(NULL != RangePages);
+    ASSERT(_VmIsVaCommited(VmmReservation, Address));
+
+    pageNo = (DWORD) (PtrDiff(Address, VmmReservation->StartVa) / PAGE_SIZE);
+
+    windowStart = pageNo - (pageNo % WindowPages);
+    windowEnd = min(windowStart + WindowPages, BitmapGetMaxElementCount(&VmmReservation->CommitBitmap));
+
+    // extend in both directions while the neighbouring pages are committed
+    firstPage = pageNo;
+    while (firstPage > windowStart && BitmapGetBitValue(&VmmReservation->CommitBitmap, firstPage - 1))
+    {
+        firstPage--;
+    }
+
+    lastPage = pageNo + 1;
+    while (lastPage < windowEnd && BitmapGetBitValue(&VmmReservation->CommitBitmap, lastPage))
+    {
+        lastPage++;
+    }
+
+    *RangeStart = PtrOffset(VmmReservation->StartVa, (QWORD) firstPage * PAGE_SIZE);
+    *RangePages = lastPage - firstPage;
+}
+
 BOOLEAN
 VmReservationCanAddressBeAccessed(
     INOUT                   PVMM_RESERVATION_SPACE  ReservationSpace,
@@ -616,7 +1415,12 @@ VmReservationCanAddressBeAccessed(
     OUT                     PAGE_RIGHTS*            MemoryRights,
     OUT                     BOOLEAN*                Uncacheable,
     OUT_PTR_MAYBE_NULL      PFILE_OBJECT*           BackingFile,
-    OUT                     QWORD*                  FileOffset
+    OUT_PTR_MAYBE_NULL      PPAGE_CACHE_FILE*       CacheFile,
+    OUT                     QWORD*                  FileOffset,
+    OUT                     BOOLEAN*                LargePage,
+    IN                      DWORD                   FaultAroundPages,
+    OUT                     PVOID*                  RangeStart,
+    OUT                     DWORD*                  RangePages
     )
 {
     BOOLEAN bSolvedPageFault;
@@ -625,7 +1429,11 @@ VmReservationCanAddressBeAccessed(
     PAGE_RIGHTS pageRights;
     BOOLEAN uncacheable;
     PFILE_OBJECT pBackingFile;
+    PPAGE_CACHE_FILE pCacheFile;
     QWORD fileOffset;
+    BOOLEAN largePage;
+    PVOID rangeStart;
+    DWORD rangePages;
     PCPU* pCpu;
     STATUS status;
 
@@ -633,7 +1441,12 @@ VmReservationCanAddressBeAccessed(
     ASSERT(MemoryRights != NULL);
     ASSERT(Uncacheable != NULL);
     ASSERT(BackingFile != NULL);
+    ASSERT(CacheFile != NULL);
     ASSERT(FileOffset != NULL);
+    ASSERT(LargePage != NULL);
+    ASSERT(FaultAroundPages != 0);
+    ASSERT(RangeStart != NULL);
+    ASSERT(RangePages != NULL);
     ASSERT(INTR_OFF == CpuIntrGetState());
 
     if (NULL == FaultingAddress)
@@ -646,7 +1459,11 @@ VmReservationCanAddressBeAccessed(
     pageRights = 0;
     uncacheable = FALSE;
     pBackingFile = NULL;
+    pCacheFile = NULL;
     fileOffset = 0;
+    largePage = FALSE;
+    rangeStart = (PVOID)AlignAddressLower(FaultingAddress, PAGE_SIZE);
+    rangePages = 1;
     pCpu = GetCurrentPcpu();
     status = STATUS_SUCCESS;
 
@@ -700,9 +1517,24 @@ VmReservationCanAddressBeAccessed(
             uncacheable = pReservation->Uncacheable;
 
             pBackingFile = pReservation->BackingFile;
+            pCacheFile = pReservation->CacheFile;
             if (pBackingFile != NULL)
             {
-                fileOffset = AlignAddressLower(PtrDiff(FaultingAddress, pReservation->StartVa), PAGE_SIZE);
+                fileOffset = pReservation->FileOffset
+                           + AlignAddressLower(PtrDiff(FaultingAddress, pReservation->StartVa), PAGE_SIZE);
+            }
+
+            if (pReservation->LargePages)
+            {
+                DWORD firstPage = (DWORD)(AlignAddressLower(PtrDiff(FaultingAddress, pReservation->StartVa),
+                                                            VMM_LARGE_PAGE_SIZE) / PAGE_SIZE);
+
+                // a large page can be used only if all the 4KB pages it covers are committed
+                largePage = firstPage == BitmapScanFromTo(&pReservation->CommitBitmap,
+                                                          firstPage,
+                                                          firstPage + VMM_FRAMES_PER_LARGE_PAGE,
+                                                          VMM_FRAMES_PER_LARGE_PAGE,
+                                                          TRUE);
             }
 
             // to solve the page fault we must have the VA already committed
@@ -710,6 +1542,15 @@ VmReservationCanAddressBeAccessed(
             // reservation rights
             bSolvedPageFault = bIsVaCommited && (IsBooleanFlagOn(pageRights, RightsRequested));
 
+            if (bSolvedPageFault && FaultAroundPages > 1)
+            {
+                _VmDetermineCommittedRange(pReservation,
+                                           FaultingAddress,
+                                           FaultAroundPages,
+                                           &rangeStart,
+                                           &rangePages);
+            }
+
             __leave;
         }
     }
@@ -729,7 +1570,11 @@ VmReservationCanAddressBeAccessed(
             *Uncacheable = uncacheable;
 
             *BackingFile = pBackingFile;
+            *CacheFile = pCacheFile;
             *FileOffset = fileOffset;
+            *LargePage = largePage;
+            *RangeStart = rangeStart;
+            *RangePages = rangePages;
         }
     }
 
@@ -745,6 +1590,7 @@ VmReservationSpaceAllocRegion(
     IN      PAGE_RIGHTS             Rights,
     IN      BOOLEAN                 Uncacheable,
     IN_OPT  PFILE_OBJECT            FileObject,
+    IN      QWORD                   FileOffset,
     OUT     PVOID*                  MappedAddress,
     OUT     QWORD*                  MappedSize
     )
@@ -754,6 +1600,9 @@ VmReservationSpaceAllocRegion(
     STATUS status;
     QWORD alignedSize;
     PPCPU pCpu;
+    BOOLEAN bLargePages;
+    QWORD alignment;
+    PPAGE_CACHE_FILE pCacheFile;
 
     ASSERT(ReservationSpace != NULL);
     ASSERT(Size != 0);
@@ -763,12 +1612,16 @@ VmReservationSpaceAllocRegion(
 
     status = STATUS_SUCCESS;
 
+    // large page regions are only supported for anonymous memory
+    bLargePages = IsBooleanFlagOn(AllocType, VMM_ALLOC_TYPE_LARGE_PAGES) && (NULL == FileObject);
+    alignment = bLargePages ? VMM_LARGE_PAGE_SIZE : PAGE_SIZE;
+
     if (NULL != BaseAddress)
     {
         // if we received BaseAddress as input we need
         // to align the address
-        pBaseAddress = (PVOID)AlignAddressLower(BaseAddress, PAGE_SIZE);
-        alignedSize = AlignAddressUpper(Size + PtrDiff(BaseAddress, pBaseAddress), PAGE_SIZE);
+        pBaseAddress = (PVOID)AlignAddressLower(BaseAddress, alignment);
+        alignedSize = AlignAddressUpper(Size + PtrDiff(BaseAddress, pBaseAddress), alignment);
 
         if (pBaseAddress < ReservationSpace->StartOfVirtualAddressSpace)
         {
@@ -782,8 +1635,29 @@ VmReservationSpaceAllocRegion(
         // if we're generating the virtual address =>
         // we can make sure it is aligned and we only
         // need to align the size
-        alignedSize = AlignAddressUpper(Size, PAGE_SIZE);
-        pBaseAddress = VmReservationSpaceDetermineNextFreeVirtualAddress(ReservationSpace, alignedSize);
+        alignedSize = AlignAddressUpper(Size, alignment);
+
+        // the address is chosen once we hold the reservation lock
+        pBaseAddress = NULL;
+    }
+
+    // Lazily mapped files take their pages from the page cache, the cache must be opened
+    // before taking the lock because it may need to allocate memory. If the cache can't
+    // be used the pages will simply be read into private frames
+    pCacheFile = NULL;
+    if ((NULL != FileObject)
+        && IsBooleanFlagOn(AllocType, VMM_ALLOC_TYPE_RESERVE)
+        && !IsBooleanFlagOn(AllocType, VMM_ALLOC_TYPE_NOT_LAZY)
+        && IsAddressAligned(FileOffset, PAGE_SIZE)
+        && (FileOffset + alignedSize <= AlignAddressUpper(FileObject->FileSize, PAGE_SIZE)))
+    {
+        status = PageCacheOpenFile(FileObject, &pCacheFile);
+        if (!SUCCEEDED(status))
+        {
+            LOG_TRACE_VMM("PageCacheOpenFile failed with status 0x%x\n", status);
+            pCacheFile = NULL;
+            status = STATUS_SUCCESS;
+        }
     }
 
     RwSpinlockAcquireExclusive(&ReservationSpace->ReservationLock, &oldState);
@@ -796,6 +1670,29 @@ VmReservationSpaceAllocRegion(
 
     __try
     {
+        if (NULL == pBaseAddress)
+        {
+            PVMM_RESERVATION pGap;
+
+            // prefer the smallest gap left by a released reservation which can hold the region,
+            // there's no point in consuming a gap if we're not going to reserve it
+            pGap = IsBooleanFlagOn(AllocType, VMM_ALLOC_TYPE_RESERVE)
+                ? _VmFindBestFitGap(ReservationSpace, alignedSize + alignment - PAGE_SIZE)
+                : NULL;
+            if (NULL != pGap)
+            {
+                pBaseAddress = (PVOID)AlignAddressUpper(pGap->StartVa, alignment);
+            }
+            else
+            {
+                // the free VA pointer is only PAGE_SIZE aligned, for larger alignments
+                // we waste at most the alignment of VA space (which is plenty)
+                pBaseAddress = VmReservationSpaceDetermineNextFreeVirtualAddress(ReservationSpace,
+                                                                                 alignedSize + alignment - PAGE_SIZE);
+                pBaseAddress = (PVOID)AlignAddressUpper(pBaseAddress, alignment);
+            }
+        }
+
         if (IsBooleanFlagOn(AllocType, VMM_ALLOC_TYPE_RESERVE))
         {
             // reserve area
@@ -805,13 +1702,19 @@ VmReservationSpaceAllocRegion(
                                                 VMM_ALLOC_TYPE_RESERVE,
                                                 Rights,
                                                 Uncacheable,
-                                                FileObject
+                                                bLargePages,
+                                                FileObject,
+                                                FileOffset,
+                                                pCacheFile
             );
             if (!SUCCEEDED(status))
             {
                 LOG_FUNC_ERROR("_VmChangeVaReservationState", status);
                 __leave;
             }
+
+            // the reference now belongs to the reservation
+            pCacheFile = NULL;
         }
         // these 2 are independent of each other and can be both active
         // so no if else
@@ -825,7 +1728,10 @@ VmReservationSpaceAllocRegion(
                                                  VMM_ALLOC_TYPE_COMMIT,
                                                  Rights,
                                                  Uncacheable,
-                                                 FileObject
+                                                 bLargePages,
+                                                 FileObject,
+                                                 FileOffset,
+                                                 NULL
             );
             if (!SUCCEEDED(status))
             {
@@ -842,6 +1748,12 @@ VmReservationSpaceAllocRegion(
         }
         RwSpinlockReleaseExclusive(&ReservationSpace->ReservationLock, oldState);
 
+        if (NULL != pCacheFile)
+        {
+            PageCacheCloseFile(pCacheFile);
+            pCacheFile = NULL;
+        }
+
         if (SUCCEEDED(status))
         {
             *MappedAddress = pBaseAddress;
@@ -861,7 +1773,9 @@ VmReservationSpaceFreeRegion(
             QWORD                   Size,
     IN      VMM_FREE_TYPE           FreeType,
     OUT     PVOID*                  AlignedAddress,
-    OUT     QWORD*                  AlignedSize
+    OUT     QWORD*                  AlignedSize,
+    OUT_PTR_MAYBE_NULL
+            PPAGE_CACHE_FILE*       CacheFile
     )
 {
     INTR_STATE oldState;
@@ -871,6 +1785,7 @@ VmReservationSpaceFreeRegion(
     BOOLEAN lockHeld;
     PVOID alignedAddress;
     QWORD alignedSize;
+    PPAGE_CACHE_FILE pCacheFile;
 
     ASSERT(Address != NULL);
     ASSERT(   (IsBooleanFlagOn(FreeType,VMM_FREE_TYPE_RELEASE) && (Size == 0))
@@ -878,12 +1793,14 @@ VmReservationSpaceFreeRegion(
             );
     ASSERT(AlignedAddress != NULL);
     ASSERT(AlignedSize != NULL);
+    ASSERT(CacheFile != NULL);
 
     status = STATUS_SUCCESS;
     lockHeld = FALSE;
     pReservation = NULL;
     alignedAddress = NULL;
     alignedSize = 0;
+    pCacheFile = NULL;
 
     // they cannot both be used at the same time
     ASSERT( IsBooleanFlagOn( FreeType, VMM_FREE_TYPE_RELEASE ) ^ IsBooleanFlagOn(FreeType, VMM_FREE_TYPE_DECOMMIT ));
@@ -904,10 +1821,12 @@ VmReservationSpaceFreeRegion(
     {
         VMM_RESERVATION reservationCopy;
 
-        // remove reservation
+        // remove reservation, its VA range becomes available again only after the caller
+        // unmaps it and calls VmReservationSpaceReturnRegion
+        _VmTreeRemove(&ReservationSpace->AddressTreeRoot, &pReservation->AddressNode);
+
         memcpy( &reservationCopy, pReservation, sizeof(VMM_RESERVATION));
-        memzero( pReservation, sizeof(VMM_RESERVATION));
-        pReservation->State = VmmReservationStateFree;
+        _VmReleaseReservationEntry(ReservationSpace, pReservation);
 
         _Analysis_assume_lock_held_(ReservationSpace->ReservationLock);
         RwSpinlockReleaseExclusive(&ReservationSpace->ReservationLock, oldState);
@@ -917,6 +1836,9 @@ VmReservationSpaceFreeRegion(
         alignedAddress = reservationCopy.StartVa;
         alignedSize = reservationCopy.Size;
 
+        // the shared frames may be still mapped, the caller closes the cache after unmapping them
+        pCacheFile = reservationCopy.CacheFile;
+
         // _VmUninitializeReservation actually acts on a copy
         // of the reservation, this is so that we can call the function
         // without holding the reservation lock
@@ -942,6 +1864,95 @@ VmReservationSpaceFreeRegion(
 
     *AlignedAddress = alignedAddress;
     *AlignedSize = alignedSize;
+    *CacheFile = pCacheFile;
+}
+
+void
+VmReservationSpaceReturnRegion(
+    INOUT   PVMM_RESERVATION_SPACE  ReservationSpace,
+    IN      PVOID                   Address,
+    IN      QWORD                   Size
+    )
+{
+    INTR_STATE oldState;
+    PPCPU pCpu;
+    PVMM_RESERVATION pPrevious;
+    PVMM_RESERVATION pNext;
+
+    ASSERT(ReservationSpace != NULL);
+    ASSERT(Address != NULL);
+    ASSERT(Size != 0);
+    ASSERT(IsAddressAligned(Address, PAGE_SIZE));
+    ASSERT(IsAddressAligned(Size, PAGE_SIZE));
+
+    RwSpinlockAcquireExclusive(&ReservationSpace->ReservationLock, &oldState);
+    pCpu = GetCurrentPcpu();
+
+    if (NULL != pCpu)
+    {
+        pCpu->VmmMemoryAccess = TRUE;
+    }
+
+    // merge the range with the gaps ending right before it and starting right after it
+    pPrevious = _VmFindEntryFloor(ReservationSpace, Address);
+    if (NULL != pPrevious
+        && (VmmReservationStateGap != pPrevious->State || PtrOffset(pPrevious->StartVa, pPrevious->Size) != Address))
+    {
+        pPrevious = NULL;
+    }
+
+    pNext = _VmFindEntryCeiling(ReservationSpace, Address);
+    if (NULL != pNext
+        && (VmmReservationStateGap != pNext->State || pNext->StartVa != PtrOffset(Address, Size)))
+    {
+        pNext = NULL;
+    }
+
+    if (NULL != pPrevious)
+    {
+        _VmTreeRemove(&ReservationSpace->GapTreeRoot, &pPrevious->GapNode);
+        pPrevious->Size = pPrevious->Size + Size;
+
+        if (NULL != pNext)
+        {
+            pPrevious->Size = pPrevious->Size + pNext->Size;
+
+            _VmTreeRemove(&ReservationSpace->GapTreeRoot, &pNext->GapNode);
+            _VmTreeRemove(&ReservationSpace->AddressTreeRoot, &pNext->AddressNode);
+            _VmReleaseReservationEntry(ReservationSpace, pNext);
+        }
+
+        _VmTreeInsert(&ReservationSpace->GapTreeRoot, &pPrevious->GapNode, _VmCompareGapSize);
+    }
+    else if (NULL != pNext)
+    {
+        // the gap only grows downwards into the free range => its place in the address tree stays the same
+        _VmTreeRemove(&ReservationSpace->GapTreeRoot, &pNext->GapNode);
+        pNext->StartVa = Address;
+        pNext->Size = pNext->Size + Size;
+
+        _VmTreeInsert(&ReservationSpace->GapTreeRoot, &pNext->GapNode, _VmCompareGapSize);
+    }
+    else
+    {
+        PVMM_RESERVATION pGap = _VmFindFirstFreeReservation(ReservationSpace);
+
+        if (NULL != pGap)
+        {
+            _VmInitializeGap(ReservationSpace, Address, Size, pGap);
+        }
+        else
+        {
+            LOG_WARNING("No reservation entry left to describe the free range at 0x%X of size 0x%X, it will not be reused\n",
+                        Address, Size);
+        }
+    }
+
+    if (NULL != pCpu)
+    {
+        pCpu->VmmMemoryAccess = FALSE;
+    }
+    RwSpinlockReleaseExclusive(&ReservationSpace->ReservationLock, oldState);
 }
 
 STATUS
@@ -1001,3 +2012,36 @@ VmReservationReturnRightsForAddress(
 
     return bFullyCommited ? STATUS_SUCCESS : STATUS_MEMORY_IS_NOT_COMMITED;
 }
+
+PTR_SUCCESS
+PVOID
+VmReservationSpaceRetrieveLastRegion(
+    IN      PVMM_RESERVATION_SPACE  ReservationSpace
+    )
+{
+    PVMM_RESERVATION pEntry;
+    INTR_STATE oldState;
+    PVOID pResult;
+
+    ASSERT(ReservationSpace != NULL);
+
+    pResult = NULL;
+
+    RwSpinlockAcquireShared(&ReservationSpace->ReservationLock, &oldState);
+
+    // the gaps and the reservations are kept in the same tree, skip the gaps
+    for (pEntry = _VmFindEntryFloor(ReservationSpace, (PVOID)MAX_QWORD);
+         pEntry != NULL;
+         pEntry = _VmPreviousEntry(pEntry))
+    {
+        if (VmmReservationStateUsed == pEntry->State)
+        {
+            pResult = pEntry->StartVa;
+            break;
+        }
+    }
+
+    RwSpinlockReleaseShared(&ReservationSpace->ReservationLock, oldState);
+
+    return pResult;
+}
@@ -10,9 +10,30 @@
 #include "thread_internal.h"
 #include "process_internal.h"
 #include "mdl.h"
+#include "smp.h"
+#include "iomu.h"
+#include "page_cache.h"
+#include "swap.h"
 
 #define VMM_SIZE_FOR_RESERVATION_METADATA            (5*TB_SIZE)
 
+// Size of the VA ranges described by a single PML4 entry and PDPT entry, the
+// reclaim scan skips them at once if they are not present
+#define VMM_PML4_ENTRY_RANGE_SIZE                    (512*GB_SIZE)
+#define VMM_PDPT_ENTRY_RANGE_SIZE                    (GB_SIZE)
+
+// The lower half of the address space which belongs to the processes
+#define VMM_USER_SPACE_SIZE                          (128*TB_SIZE)
+
+// Eviction tags are stored in the swap slot field of the PTEs
+#define VMM_EVICTION_TAG_MASK                        ((1ULL << (MAXPHYADDR - PAGE_SHIFT)) - 1)
+
+// The page tables, directories and PDPTs of the processes are freed once empty,
+// the PML4 lives as long as the process
+#define VMM_NO_OF_RECLAIMABLE_LEVELS                 3
+
+#define VMM_NO_OF_ENTRIES_PER_TABLE                  (PAGE_SIZE / sizeof(PT_ENTRY))
+
 typedef struct _VMM_DATA
 {
     VMM_RESERVATION_SPACE   VmmReservationSpace;
@@ -22,8 +43,36 @@ typedef struct _VMM_DATA
     // No matter what CR3 we're using the same WB and UC indexes will be used
     BYTE                    WriteBackIndex;
     BYTE                    UncacheableIndex;
+
+    // Size of the window of pages mapped together on a #PF
+    volatile DWORD          FaultAroundPages;
+
+    volatile QWORD          NumberOfCopyOnWriteFaults;
+
+    volatile QWORD          PagesSwappedOut;
+    volatile QWORD          PagesSwappedIn;
+    volatile QWORD          PagesDiscarded;
+
+    volatile QWORD          PagingStructuresFreed;
+
+    // Identifies the PTEs of the pages being evicted until the swap module
+    // returns their handles
+    volatile QWORD          NextEvictionTag;
 } VMM_DATA, *PVMM_DATA;
 
+// A page picked by the reclaim scan, its PTE was already cleared
+typedef struct _VMM_RECLAIM_VICTIM
+{
+    PVOID                   Address;
+
+    // The translation before eviction, used to recover the frame and to
+    // restore the page if it can't be stored by the swap module
+    PT_ENTRY                OldEntry;
+
+    // Placed in the PTE while the page is being stored
+    QWORD                   EvictionTag;
+} VMM_RECLAIM_VICTIM, *PVMM_RECLAIM_VICTIM;
+
 static VMM_DATA m_vmmData;
 
 static
@@ -33,6 +82,37 @@ _VmSetupPagingStructure(
     IN      PVOID                   PagingStructure
     );
 
+static
+void
+_VmMapMemory(
+    IN      PPAGING_DATA            PagingData,
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      QWORD                   Size,
+    IN      PVOID                   BaseAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Invalidate,
+    IN      BOOLEAN                 Uncacheable,
+    IN      BOOLEAN                 SharedFrames,
+    IN      BOOLEAN                 Pageable,
+    IN      BOOLEAN                 LargePages
+    );
+
+static
+PTR_SUCCESS
+PVOID
+_VmAllocRegion(
+    IN_OPT  PVOID                   BaseAddress,
+    IN      QWORD                   Size,
+    IN      VMM_ALLOC_TYPE          AllocType,
+    IN      PAGE_RIGHTS             Rights,
+    IN      BOOLEAN                 Uncacheable,
+    IN_OPT  PFILE_OBJECT            FileObject,
+    IN      QWORD                   FileOffset,
+    IN_OPT  PVMM_RESERVATION_SPACE  VaSpace,
+    IN_OPT  PPAGING_LOCK_DATA       PagingData,
+    IN_OPT  PMDL                    Mdl
+    );
+
 static
 BOOL_SUCCESS
 BOOLEAN
@@ -42,26 +122,293 @@ _VmDeterminePatIndices(
     OUT     PBYTE                   UcIndex
     );
 
+//******************************************************************************
+// Function:     _VmSolvePageFaultWithLargePage
+// Description:  Maps a zeroed 2MB page over the region containing
+//               FaultingAddress. Fails if the region is already partially
+//               mapped with 4KB pages or if no aligned frames are available.
+// Returns:      BOOLEAN - TRUE if the page fault was solved
+// Parameter:    IN PVOID FaultingAddress
+// Parameter:    IN PAGE_RIGHTS PageRights
+// Parameter:    IN BOOLEAN Uncacheable
+// Parameter:    IN PPAGING_LOCK_DATA PagingData
+//******************************************************************************
+static
+BOOL_SUCCESS
+BOOLEAN
+_VmSolvePageFaultWithLargePage(
+    IN      PVOID                   FaultingAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Uncacheable,
+    IN      PPAGING_LOCK_DATA       PagingData
+    );
+
+//******************************************************************************
+// Function:     _VmDetermineUnmappedRange
+// Description:  Shrinks the range [RangeStart, RangeStart + RangePages) to the
+//               run of unmapped pages containing Address. If Address itself
+//               is mapped RangePages will be 0.
+// Returns:      void
+// Parameter:    IN PPAGING_DATA PagingData
+// Parameter:    IN PVOID Address
+// Parameter:    INOUT PVOID* RangeStart
+// Parameter:    INOUT DWORD* RangePages
+//******************************************************************************
+static
+void
+_VmDetermineUnmappedRange(
+    IN      PPAGING_DATA            PagingData,
+    IN      PVOID                   Address,
+    INOUT   PVOID*                  RangeStart,
+    INOUT   DWORD*                  RangePages
+    );
+
+//******************************************************************************
+// Function:     _VmSplitLargePage
+// Description:  Replaces a 2MB mapping with a page table describing the same
+//               translations using 4KB pages.
+// Returns:      void
+// Parameter:    IN PPAGING_DATA PagingData
+// Parameter:    INOUT PVOID PageDirectoryEntry - PDE mapping a large page
+// Parameter:    IN PVOID LargePageAddress - VA mapped by the large page
+//******************************************************************************
+static
+void
+_VmSplitLargePage(
+    IN      PPAGING_DATA            PagingData,
+    INOUT   PVOID                   PageDirectoryEntry,
+    IN      PVOID                   LargePageAddress
+    );
+
+//******************************************************************************
+// Function:     _VmRetrievePageDirectoryEntry
+// Description:  Walks the paging structures and returns the PDE which
+//               describes VirtualAddress or NULL if the upper level paging
+//               structures are not present.
+// Returns:      PVOID
+// Parameter:    IN PPAGING_DATA PagingData
+// Parameter:    IN PVOID VirtualAddress
+//******************************************************************************
+static
+PTR_SUCCESS
+PVOID
+_VmRetrievePageDirectoryEntry(
+    IN      PPAGING_DATA            PagingData,
+    IN      PVOID                   VirtualAddress
+    );
+
+//******************************************************************************
+// Function:     _VmRetrievePageTableEntry
+// Description:  Same as _VmRetrievePageDirectoryEntry but returns the PTE, NULL
+//               if the address is not described by a page table.
+// Returns:      PT_ENTRY*
+// Parameter:    IN PPAGING_DATA PagingData
+// Parameter:    IN PVOID VirtualAddress
+//******************************************************************************
+static
+PTR_SUCCESS
+PT_ENTRY*
+_VmRetrievePageTableEntry(
+    IN      PPAGING_DATA            PagingData,
+    IN      PVOID                   VirtualAddress
+    );
+
+//******************************************************************************
+// Function:     _VmSolveCopyOnWriteFault
+// Description:  If FaultingAddress is mapped by a copy-on-write PTE gives the
+//               address space its own writable copy of the shared frame.
+// Returns:      BOOLEAN - TRUE if the write can be retried
+// Parameter:    IN PVOID FaultingAddress
+// Parameter:    IN PPAGING_LOCK_DATA PagingData
+//******************************************************************************
+static
+BOOL_SUCCESS
+BOOLEAN
+_VmSolveCopyOnWriteFault(
+    IN      PVOID                   FaultingAddress,
+    IN      PPAGING_LOCK_DATA       PagingData
+    );
+
+//******************************************************************************
+// Function:     _VmSwapInPage
+// Description:  If the page at Address was evicted by the swap module loads
+//               it back in a new frame and maps it.
+// Returns:      STATUS - STATUS_ELEMENT_NOT_FOUND if the page is not swapped
+//               out, STATUS_INSUFFICIENT_MEMORY if there is no frame to read
+//               it in. On success the access can be retried.
+// Parameter:    IN PVOID Address - page aligned
+// Parameter:    IN PAGE_RIGHTS PageRights
+// Parameter:    IN BOOLEAN Uncacheable
+// Parameter:    IN PPAGING_LOCK_DATA PagingData
+//******************************************************************************
+static
+STATUS
+_VmSwapInPage(
+    IN      PVOID                   Address,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Uncacheable,
+    IN      PPAGING_LOCK_DATA       PagingData
+    );
+
+//******************************************************************************
+// Function:     _VmSelectPagesToEvict
+// Description:  Advances the clock hand of the address space over the 4KB
+//               pageable pages. The pages accessed since the last pass get a
+//               second chance, the others are unmapped and returned to the
+//               caller. Large pages are never evicted.
+// Returns:      DWORD - Number of victims
+// Parameter:    INOUT PPAGING_DATA PagingData
+// Parameter:    IN DWORD MaxPages
+// Parameter:    IN BOOLEAN CanWriteDirtyPages - if FALSE only clean pages
+//               are evicted
+// Parameter:    OUT_WRITES(MaxPages) PVMM_RECLAIM_VICTIM Victims
+// NOTE:         The paging lock must be held exclusively, the translations
+//               are not invalidated.
+//******************************************************************************
+static
+DWORD
+_VmSelectPagesToEvict(
+    INOUT   PPAGING_DATA            PagingData,
+    IN      DWORD                   MaxPages,
+    IN      BOOLEAN                 CanWriteDirtyPages,
+    OUT_WRITES(MaxPages)
+            PVMM_RECLAIM_VICTIM     Victims
+    );
+
 __forceinline
 static
-PHYSICAL_ADDRESS
-_VmRetrieveNextPhysicalAddressForPagingStructure(
-    IN      PPAGING_DATA            PagingData
+BOOLEAN
+_VmIsPageInUse(
+    IN      PPAGING_DATA            PagingData,
+    IN      PVOID                   Address
     )
 {
-    QWORD nextAddress;
-    DWORD currentIndex;
+    PML4 cr3;
+    PT_ENTRY* pPtEntry;
 
-    ASSERT( NULL != PagingData );
+    cr3.Raw = (QWORD) PagingData->BasePhysicalAddress;
+
+    if (NULL != VmmGetPhysicalAddress(cr3, Address))
+    {
+        return TRUE;
+    }
+
+    // a page in the swap partition is still in use even if it is not present
+    pPtEntry = _VmRetrievePageTableEntry(PagingData, Address);
+    return (NULL != pPtEntry) && PteIsSwappedOut(pPtEntry);
+}
+
+__forceinline
+static
+BOOLEAN
+_VmCanMapLargePage(
+    IN      PVOID                   VirtualAddress,
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      QWORD                   RemainingSize
+    )
+{
+    // Only the caller knows the frames are usable RAM, see _VmMapMemory. The
+    // first 2MB of physical memory are described by the fixed range MTRRs
+    // which have different memory types, a large page must not span them
+    return IsAddressAligned(VirtualAddress, VMM_LARGE_PAGE_SIZE)
+        && IsAddressAligned(PhysicalAddress, VMM_LARGE_PAGE_SIZE)
+        && (NULL != PhysicalAddress)
+        && (RemainingSize >= VMM_LARGE_PAGE_SIZE);
+}
+
+static
+void
+_VmTlbShootdown(
+    IN      PPAGING_DATA            PagingData,
+    IN_READS(NumberOfRanges)
+            PVMM_TLB_RANGE          Ranges,
+    IN      DWORD                   NumberOfRanges
+    );
+
+static
+void
+_VmTlbProcessPendingRanges(
+    INOUT   PPCPU                   Cpu
+    );
+
+__forceinline
+static
+BOOLEAN
+_VmUnmapBatchIsFull(
+    IN      PVMM_UNMAP_BATCH        Batch
+    )
+{
+    // a page adds one range and one frame run, freeing the structures above it
+    // one more range and a structure for each level
+    return (Batch->NumberOfRanges + 2 > VMM_UNMAP_BATCH_MAX_RANGES)
+        || (Batch->NumberOfFrameRuns == VMM_UNMAP_BATCH_MAX_FRAME_RUNS)
+        || (Batch->NumberOfStructures + VMM_NO_OF_RECLAIMABLE_LEVELS > VMM_UNMAP_BATCH_MAX_STRUCTURES);
+}
+
+static
+void
+_VmUnmapBatchAddRange(
+    INOUT   PVMM_UNMAP_BATCH        Batch,
+    IN      PVOID                   Address,
+    IN      DWORD                   NumberOfPages
+    );
+
+static
+void
+_VmUnmapBatchAddFrames(
+    INOUT   PVMM_UNMAP_BATCH        Batch,
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      DWORD                   NumberOfFrames
+    );
 
-    currentIndex = PagingData->CurrentIndex;
+//******************************************************************************
+// Function:     _VmRetrieveNextPhysicalAddressForPagingStructure
+// Description:  Takes a zeroed frame for a new paging structure, the frames
+//               freed by unmapping are reused before the ones never touched.
+// Returns:      PHYSICAL_ADDRESS
+// Parameter:    IN PPAGING_DATA PagingData
+//******************************************************************************
+static
+PHYSICAL_ADDRESS
+_VmRetrieveNextPhysicalAddressForPagingStructure(
+    IN      PPAGING_DATA            PagingData
+    );
 
-    ASSERT( currentIndex < PagingData->NumberOfFrames );
+//******************************************************************************
+// Function:     _VmFreeEmptyPagingStructures
+// Description:  Unlinks the page table covering Address if it has no entry
+//               left, and then the upper level structures which become empty.
+//               The frames are added to Batch and return to the pool when it
+//               is flushed.
+// Returns:      void
+// Parameter:    IN PPAGING_DATA PagingData - a process address space
+// Parameter:    IN PVOID Address - user address
+// Parameter:    INOUT PVMM_UNMAP_BATCH Batch
+//******************************************************************************
+static
+void
+_VmFreeEmptyPagingStructures(
+    IN      PPAGING_DATA            PagingData,
+    IN      PVOID                   Address,
+    INOUT   PVMM_UNMAP_BATCH        Batch
+    );
 
-    nextAddress = (QWORD) PagingData->BasePhysicalAddress + currentIndex * PAGE_SIZE;
-    PagingData->CurrentIndex++;
+__forceinline
+static
+BOOLEAN
+_VmIsPagingStructureEmpty(
+    IN      QWORD*                  Entries
+    )
+{
+    for (DWORD i = 0; i < VMM_NO_OF_ENTRIES_PER_TABLE; ++i)
+    {
+        if (0 != Entries[i])
+        {
+            return FALSE;
+        }
+    }
 
-    return (PHYSICAL_ADDRESS) nextAddress;
+    return TRUE;
 }
 
 __forceinline
@@ -123,6 +470,75 @@ VmmPreinit(
     )
 {
     memzero(&m_vmmData, sizeof(VMM_DATA));
+
+    m_vmmData.FaultAroundPages = VMM_DEFAULT_FAULT_AROUND_PAGES;
+}
+
+void
+VmmInitCpuTlbData(
+    OUT     PVMM_TLB_CPU_DATA       TlbData
+    )
+{
+    ASSERT(NULL != TlbData);
+
+    memzero(TlbData, sizeof(VMM_TLB_CPU_DATA));
+
+    LockInit(&TlbData->PendingLock);
+
+    BitmapPreinit(&TlbData->StalePcids, PCID_TOTAL_NO_OF_VALUES);
+    ASSERT(BitmapGetMaxElementCount(&TlbData->StalePcids) <= sizeof(TlbData->StalePcidsBuffer));
+    BitmapInit(&TlbData->StalePcids, TlbData->StalePcidsBuffer);
+}
+
+DWORD
+VmmSetFaultAroundPages(
+    IN      DWORD                   NumberOfPages
+    )
+{
+    DWORD noOfPages;
+
+    noOfPages = min(max(NumberOfPages, 1), VMM_MAX_FAULT_AROUND_PAGES);
+
+    return _InterlockedExchange(&m_vmmData.FaultAroundPages, noOfPages);
+}
+
+QWORD
+VmmGetNumberOfCopyOnWriteFaults(
+    void
+    )
+{
+    return m_vmmData.NumberOfCopyOnWriteFaults;
+}
+
+void
+VmmGetReclaimStatistics(
+    OUT     PVMM_RECLAIM_STATISTICS Statistics
+    )
+{
+    ASSERT(NULL != Statistics);
+
+    Statistics->PagesSwappedOut = m_vmmData.PagesSwappedOut;
+    Statistics->PagesDiscarded = m_vmmData.PagesDiscarded;
+    Statistics->PagesSwappedIn = m_vmmData.PagesSwappedIn;
+    Statistics->PagingStructuresFreed = m_vmmData.PagingStructuresFreed;
+}
+
+void
+VmmGetPagingStructuresStatistics(
+    IN      PPAGING_DATA                        PagingData,
+    OUT     PVMM_PAGING_STRUCTURES_STATISTICS   Statistics
+    )
+{
+    INTR_STATE oldState;
+
+    ASSERT(NULL != PagingData);
+    ASSERT(NULL != Statistics);
+
+    LockAcquire(&PagingData->StructuresLock, &oldState);
+    Statistics->NumberOfFrames = PagingData->NumberOfFrames;
+    Statistics->FramesInUse = PagingData->CurrentIndex - PagingData->NumberOfFreeStructures;
+    Statistics->FramesInPool = PagingData->NumberOfFreeStructures;
+    LockRelease(&PagingData->StructuresLock, oldState);
 }
 
 _No_competing_thread_
@@ -188,6 +604,45 @@ VmmMapMemoryEx(
     return pVirtualAddress;
 }
 
+PTR_SUCCESS
+PVOID
+VmmMapFramesEx(
+    IN      PPAGING_DATA            PagingData,
+    IN_READS(NumberOfFrames)
+            PHYSICAL_ADDRESS*       Frames,
+    IN      DWORD                   NumberOfFrames,
+    IN      PAGE_RIGHTS             PageRights
+    )
+{
+    PVOID pVirtualAddress;
+
+    if ((PagingData == NULL) || (Frames == NULL) || (0 == NumberOfFrames))
+    {
+        return NULL;
+    }
+
+    pVirtualAddress = VmReservationSpaceDetermineNextFreeVirtualAddress(&m_vmmData.VmmReservationSpace,
+                                                                        (QWORD) NumberOfFrames * PAGE_SIZE);
+    LOG_TRACE_VMM("Virtual address: 0x%X\n", pVirtualAddress);
+    ASSERT(IsAddressAligned(pVirtualAddress, PAGE_SIZE));
+
+    for (DWORD i = 0; i < NumberOfFrames; ++i)
+    {
+        ASSERT(IsAddressAligned(Frames[i], PAGE_SIZE));
+
+        VmmMapMemoryInternal(PagingData,
+                             Frames[i],
+                             PAGE_SIZE,
+                             PtrOffset(pVirtualAddress, (QWORD) i * PAGE_SIZE),
+                             PageRights,
+                             TRUE,
+                             FALSE
+                             );
+    }
+
+    return pVirtualAddress;
+}
+
 void
 VmmMapMemoryInternal(
     IN      PPAGING_DATA            PagingData,
@@ -198,6 +653,51 @@ VmmMapMemoryInternal(
     IN      BOOLEAN                 Invalidate,
     IN      BOOLEAN                 Uncacheable
     )
+{
+    _VmMapMemory(PagingData, PhysicalAddress, Size, BaseAddress, PageRights, Invalidate, Uncacheable, FALSE, FALSE, FALSE);
+}
+
+void
+VmmMapAnonymousMemory(
+    IN      PPAGING_DATA            PagingData,
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      QWORD                   Size,
+    IN      PVOID                   BaseAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Uncacheable
+    )
+{
+    _VmMapMemory(PagingData, PhysicalAddress, Size, BaseAddress, PageRights, TRUE, Uncacheable, FALSE, FALSE, TRUE);
+}
+
+void
+VmmMapSharedMemory(
+    IN      PPAGING_DATA            PagingData,
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      QWORD                   Size,
+    IN      PVOID                   BaseAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Invalidate,
+    IN      BOOLEAN                 Uncacheable
+    )
+{
+    _VmMapMemory(PagingData, PhysicalAddress, Size, BaseAddress, PageRights, Invalidate, Uncacheable, TRUE, FALSE, FALSE);
+}
+
+static
+void
+_VmMapMemory(
+    IN      PPAGING_DATA            PagingData,
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      QWORD                   Size,
+    IN      PVOID                   BaseAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Invalidate,
+    IN      BOOLEAN                 Uncacheable,
+    IN      BOOLEAN                 SharedFrames,
+    IN      BOOLEAN                 Pageable,
+    IN      BOOLEAN                 LargePages
+    )
 {
     PML4_ENTRY* pml4Entries;
     PDPT_ENTRY_PD* pdptEntries;
@@ -211,20 +711,47 @@ VmmMapMemoryInternal(
     WORD pml4Offset;
 
     QWORD offset;
+    QWORD mappingSize;
     PVOID tempAddress;
+    PVOID currentAddress;
+    PHYSICAL_ADDRESS physAddr;
+    PTE_MAP_FLAGS flags = { 0 };
 
     ASSERT(PagingData != NULL);
     ASSERT(IsAddressAligned(PhysicalAddress, PAGE_SIZE));
     ASSERT(0 != Size && IsAddressAligned(Size, PAGE_SIZE));
+    ASSERT(!LargePages || (!SharedFrames && !Pageable));
+
+    flags.Executable = IsBooleanFlagOn(PageRights, PAGE_RIGHTS_EXECUTE);
+    flags.Writable = IsBooleanFlagOn(PageRights, PAGE_RIGHTS_WRITE);
+    flags.PatIndex = Uncacheable ? m_vmmData.UncacheableIndex : m_vmmData.WriteBackIndex;
+    // only the kernel half is identical in all the address spaces, anything
+    // mapped below it in the kernel tables (e.g. the identity mappings used for
+    // AP startup) must not leak into the processes' TLB entries
+    flags.GlobalPage = PagingData->KernelSpace && _VmIsKernelAddress(BaseAddress);
+    flags.UserAccess = !PagingData->KernelSpace;
+
+    // the shared frames must never be written, the first write will fault and
+    // the page will be copied
+    flags.SharedFrame = SharedFrames;
+    flags.CopyOnWrite = SharedFrames && flags.Writable;
+    flags.Writable = flags.Writable && !SharedFrames;
+
+    // large pages are never evicted, see _VmSelectPagesToEvict
+    flags.Pageable = Pageable && !SharedFrames;
 
     // we may need to map multiple pages => we iterate until we map all the
     // addresses
     for(offset = 0;
         offset < Size;
-        offset = offset + PAGE_SIZE)
+        offset = offset + mappingSize)
     {
+        mappingSize = PAGE_SIZE;
+
         // address to map
-        tempAddress = (PBYTE)BaseAddress + offset;
+        currentAddress = (PBYTE)BaseAddress + offset;
+        physAddr = (PHYSICAL_ADDRESS)((PBYTE)PhysicalAddress + offset);
+        tempAddress = currentAddress;
 
         // these are the offsets to the corresponding structures
         pml4Offset = MASK_PML4_OFFSET(tempAddress);
@@ -257,12 +784,41 @@ VmmMapMemoryInternal(
         pdEntries = (PD_ENTRY_PT*)PA2VA(tempAddress);
 
         pdEntries = &(pdEntries[pdeOffset]);
-        if (!PteIsPresent(pdEntries))
+
+        // if the whole 2MB described by this entry needs to be mapped and the
+        // entry does not already point to a page table we can map it with a
+        // single large page. Only the frames the PMM reserved for anonymous
+        // memory are known to be usable RAM with a single memory type, the
+        // device and identity mappings may cross MTRR ranges or MMIO holes
+        if (LargePages
+            && _VmCanMapLargePage(currentAddress, physAddr, Size - offset)
+            && (!PteIsPresent(pdEntries) || (Invalidate && PteIsLargePage(pdEntries))))
         {
-            _VmSetupPagingStructure(PagingData, pdEntries);
-        }
+            PteMapLargePage(pdEntries, physAddr, flags);
 
-        ASSERT(0 == pdEntries->PageSize);
+            __invlpg(currentAddress);
+
+            mappingSize = VMM_LARGE_PAGE_SIZE;
+            continue;
+        }
+
+        if (!PteIsPresent(pdEntries))
+        {
+            _VmSetupPagingStructure(PagingData, pdEntries);
+        }
+        else if (PteIsLargePage(pdEntries))
+        {
+            if (!Invalidate)
+            {
+                // already mapped
+                continue;
+            }
+
+            // only a part of the large page changes, we need a page table
+            _VmSplitLargePage(PagingData, pdEntries, (PVOID)AlignAddressLower(currentAddress, VMM_LARGE_PAGE_SIZE));
+        }
+
+        ASSERT(0 == pdEntries->PageSize);
 
         tempAddress = PteGetPhysicalAddress(pdEntries);
         ptEntries = (PT_ENTRY*)PA2VA(tempAddress);
@@ -273,28 +829,20 @@ VmmMapMemoryInternal(
         // if we must invalidate the entry or the entry is not present, map it
         if (Invalidate || (!PteIsPresent(ptEntries)))
         {
-            PHYSICAL_ADDRESS physAddr = (PHYSICAL_ADDRESS)((PBYTE)PhysicalAddress + offset);
-            PTE_MAP_FLAGS flags = { 0 };
-
-            flags.Executable = IsBooleanFlagOn(PageRights, PAGE_RIGHTS_EXECUTE);
-            flags.Writable = IsBooleanFlagOn(PageRights, PAGE_RIGHTS_WRITE);
-            flags.PatIndex = Uncacheable ? m_vmmData.UncacheableIndex : m_vmmData.WriteBackIndex;
-            flags.GlobalPage = PagingData->KernelSpace;
-            flags.UserAccess = !PagingData->KernelSpace;
-
             PteMap(ptEntries, physAddr, flags );
 
-            __invlpg((PBYTE) BaseAddress + offset );
+            __invlpg(currentAddress);
         }
     }
 }
 
-void
+QWORD
 VmmUnmapMemoryEx(
-    IN      PML4                    Cr3,
+    IN      PPAGING_DATA            PagingData,
     IN      PVOID                   VirtualAddress,
     IN      QWORD                   Size,
-    IN      BOOLEAN                 ReleaseMemory
+    IN      BOOLEAN                 ReleaseMemory,
+    INOUT   PVMM_UNMAP_BATCH        Batch
     )
 {
     PML4_ENTRY* pml4Entries;
@@ -309,26 +857,44 @@ VmmUnmapMemoryEx(
     WORD pml4Offset;
 
     QWORD offset;
+    QWORD mappingSize;
     PVOID tempAddress;
+    BOOLEAN bFreeStructures;
+
+    ASSERT(PagingData != NULL);
+    ASSERT(Batch != NULL && Batch->PagingData == PagingData);
 
     if ((NULL == VirtualAddress) || (!IsAddressAligned(VirtualAddress, PAGE_SIZE)))
     {
-        return;
+        return 0;
     }
 
     if ((0 == Size) || (!IsAddressAligned(Size, PAGE_SIZE)))
     {
-        return;
+        return 0;
     }
 
     offset = 0;
 
+    // the kernel structures are shared by all the address spaces => they are
+    // never freed
+    bFreeStructures = !PagingData->KernelSpace && !_VmIsKernelAddress(VirtualAddress);
+
     // we may need to map multiple pages => we iterate until we map all the
     // addresses
     for(offset = 0;
         offset < Size;
-        offset = offset + PAGE_SIZE)
+        offset = offset + mappingSize)
     {
+        mappingSize = PAGE_SIZE;
+
+        // the batch must have room for the page and for the structures which
+        // become empty, else the caller must flush it before we can continue
+        if (_VmUnmapBatchIsFull(Batch))
+        {
+            break;
+        }
+
         // address to ummap
         tempAddress = (PVOID)((BYTE*)VirtualAddress + offset);
 
@@ -339,7 +905,7 @@ VmmUnmapMemoryEx(
         pteOffset = MASK_PTE_OFFSET(tempAddress);
         pageOffset = MASK_PAGE_OFFSET(tempAddress);
 
-        pml4Entries = (PML4_ENTRY*)PA2VA(Cr3.Pcide.PhysicalAddress << SHIFT_FOR_PHYSICAL_ADDR);
+        pml4Entries = (PML4_ENTRY*)PA2VA(PagingData->BasePhysicalAddress);
         pml4Entries = &(pml4Entries[pml4Offset]);
 
         if (!PteIsPresent(pml4Entries))
@@ -374,6 +940,37 @@ VmmUnmapMemoryEx(
             continue;
         }
 
+        if (PteIsLargePage(pdEntries))
+        {
+            tempAddress = PtrOffset(VirtualAddress, offset);
+
+            if (IsAddressAligned(tempAddress, VMM_LARGE_PAGE_SIZE) && (Size - offset >= VMM_LARGE_PAGE_SIZE))
+            {
+                PHYSICAL_ADDRESS pa = PteLargePageGetPhysicalAddress(pdEntries);
+
+                // the whole large page goes away
+                PteUnmap(pdEntries);
+
+                _VmUnmapBatchAddRange(Batch, tempAddress, VMM_FRAMES_PER_LARGE_PAGE);
+
+                if (ReleaseMemory)
+                {
+                    _VmUnmapBatchAddFrames(Batch, pa, VMM_FRAMES_PER_LARGE_PAGE);
+                }
+
+                if (bFreeStructures)
+                {
+                    _VmFreeEmptyPagingStructures(PagingData, tempAddress, Batch);
+                }
+
+                mappingSize = VMM_LARGE_PAGE_SIZE;
+                continue;
+            }
+
+            // only a part of the large page is unmapped, the rest must remain valid
+            _VmSplitLargePage(PagingData, pdEntries, (PVOID)AlignAddressLower(tempAddress, VMM_LARGE_PAGE_SIZE));
+        }
+
         ASSERT(0 == pdEntries->PageSize);
 
         tempAddress = PteGetPhysicalAddress(pdEntries);
@@ -382,28 +979,116 @@ VmmUnmapMemoryEx(
 
         ptEntries = &(ptEntries[pteOffset]);
 
-        if (!PteIsPresent(ptEntries))
+        if (PteIsSwappedOut(ptEntries))
         {
-            // it was never allocated
-            // go to next PAGE
-            continue;
+            // while the page is being stored its frame and handle belong to
+            // VmmReclaimMemory, it will notice the page is gone
+            if (!((PT_ENTRY_SWAPPED*)ptEntries)->WriteInProgress)
+            {
+                SwapFreePage(PteGetSwapSlot(ptEntries));
+            }
+
+            PteUnmap(ptEntries);
         }
-        else
+        else if (PteIsPresent(ptEntries))
         {
             PHYSICAL_ADDRESS pa = PteGetPhysicalAddress(ptEntries);
+            BOOLEAN bSharedFrame = PteIsSharedFrame(ptEntries);
 
             PteUnmap(ptEntries);
 
-            __invlpg((QWORD)VirtualAddress + offset);
+            _VmUnmapBatchAddRange(Batch, PtrOffset(VirtualAddress, offset), 1);
+
+            // the shared frames belong to the page cache
+            if (ReleaseMemory && !bSharedFrame)
+            {
+                _VmUnmapBatchAddFrames(Batch, pa, 1);
+            }
+        }
+
+        // once we are done with a page table check if anything is left in it,
+        // even if this page was never allocated the previous ones may have been
+        tempAddress = PtrOffset(VirtualAddress, offset);
+        if (bFreeStructures
+            && ((offset + PAGE_SIZE >= Size) || (MASK_PTE_OFFSET(tempAddress) == VMM_NO_OF_ENTRIES_PER_TABLE - 1)))
+        {
+            _VmFreeEmptyPagingStructures(PagingData, tempAddress, Batch);
+        }
+    }
+
+    return offset;
+}
+
+void
+VmmInitUnmapBatch(
+    OUT     PVMM_UNMAP_BATCH        Batch,
+    IN      PPAGING_DATA            PagingData
+    )
+{
+    ASSERT(NULL != Batch);
+    ASSERT(NULL != PagingData);
+
+    Batch->PagingData = PagingData;
+    Batch->NumberOfRanges = 0;
+    Batch->NumberOfFrameRuns = 0;
+    Batch->NumberOfStructures = 0;
+}
+
+void
+VmmFlushUnmapBatch(
+    INOUT   PVMM_UNMAP_BATCH        Batch,
+    IN      BOOLEAN                 LocalOnly
+    )
+{
+    DWORD i;
+
+    ASSERT(NULL != Batch);
 
-            if (ReleaseMemory)
+    if (0 != Batch->NumberOfRanges)
+    {
+        if (LocalOnly)
+        {
+            for (i = 0; i < Batch->NumberOfRanges; ++i)
             {
-                MmuReleaseMemory(pa, 1);
+                for (DWORD j = 0; j < Batch->Ranges[i].NumberOfPages; ++j)
+                {
+                    __invlpg(PtrOffset(Batch->Ranges[i].Address, (QWORD) j * PAGE_SIZE));
+                }
             }
+        }
+        else
+        {
+            _VmTlbShootdown(Batch->PagingData, Batch->Ranges, Batch->NumberOfRanges);
+        }
+    }
+
+    // no CPU can reach these frames through a stale translation anymore
+    for (i = 0; i < Batch->NumberOfFrameRuns; ++i)
+    {
+        MmuReleaseMemory(Batch->FrameRuns[i].Address, Batch->FrameRuns[i].NumberOfFrames);
+    }
+
+    // the invalidations also dropped the paging-structure caches => no CPU
+    // can walk the freed structures anymore
+    if (0 != Batch->NumberOfStructures)
+    {
+        INTR_STATE oldState;
 
-            /// TODO: signal other processors to invalidate the mapping
+        LockAcquire(&Batch->PagingData->StructuresLock, &oldState);
+        for (i = 0; i < Batch->NumberOfStructures; ++i)
+        {
+            *((PHYSICAL_ADDRESS*)PA2VA(Batch->Structures[i])) = Batch->PagingData->FreeStructuresHead;
+            Batch->PagingData->FreeStructuresHead = Batch->Structures[i];
         }
+        Batch->PagingData->NumberOfFreeStructures += Batch->NumberOfStructures;
+        LockRelease(&Batch->PagingData->StructuresLock, oldState);
+
+        _InterlockedExchangeAdd64(&m_vmmData.PagingStructuresFreed, Batch->NumberOfStructures);
     }
+
+    Batch->NumberOfRanges = 0;
+    Batch->NumberOfFrameRuns = 0;
+    Batch->NumberOfStructures = 0;
 }
 
 PTR_SUCCESS
@@ -549,6 +1234,10 @@ VmmSetupPageTables(
     PagingData->NumberOfFrames = FramesReserved;
     PagingData->BasePhysicalAddress = BasePhysicalAddress;
     PagingData->KernelSpace = KernelStructures;
+    PagingData->ReclaimClockHand = NULL;
+    PagingData->FreeStructuresHead = NULL;
+    PagingData->NumberOfFreeStructures = 0;
+    LockInit(&PagingData->StructuresLock);
 
     sizeReservedForPagingStructures = FramesReserved * PAGE_SIZE;
 
@@ -585,15 +1274,39 @@ VmmSetupPageTables(
 
 void
 VmmChangeCr3(
-    IN      PHYSICAL_ADDRESS        Pml4Base,
+    IN      PPAGING_DATA            PagingData,
     IN_RANGE(PCID_FIRST_VALID_VALUE, PCID_TOTAL_NO_OF_VALUES - 1)
             PCID                    Pcid,
     IN      BOOLEAN                 Invalidate
     )
 {
-    ASSERT(IsAddressAligned(Pml4Base,PAGE_SIZE));
+    PPCPU pCpu;
+    INTR_STATE oldState;
+    BOOLEAN bInvalidate;
+
+    ASSERT(NULL != PagingData);
+    ASSERT(IsAddressAligned(PagingData->BasePhysicalAddress,PAGE_SIZE));
     ASSERT(PCID_IS_VALID(Pcid));
 
+    bInvalidate = Invalidate;
+
+    oldState = CpuIntrDisable();
+
+    pCpu = GetCurrentPcpu();
+    if (NULL != pCpu)
+    {
+        // The CPU must be seen as a user of the tables before it can cache any
+        // translation, else an unmap could miss it
+        _InterlockedOr8((volatile char*) &PagingData->ActiveCpus, pCpu->LogicalApicId);
+
+        if (BitmapGetBitValue(&pCpu->TlbData.StalePcids, Pcid))
+        {
+            // mappings were removed while we were using other tables
+            BitmapSetBitValue(&pCpu->TlbData.StalePcids, Pcid, FALSE);
+            bInvalidate = TRUE;
+        }
+    }
+
     // Intel System Programming Manual Vol 3C
     // Section 4.10.4.1 Operations that Invalidate TLBs and Paging-Structure Caches
 
@@ -604,9 +1317,53 @@ VmmChangeCr3(
 
     // If CR4.PCIDE = 1 and bit 63 of the instructions source operand is 1, the instruction is not required to
     // invalidate any TLB entries or entries in paging - structure caches.
-    __writecr3((Invalidate ? 0 : MOV_TO_CR3_DO_NOT_INVALIDATE_PCID_MAPPINGS) | (QWORD)Pml4Base | Pcid);
+    __writecr3((bInvalidate ? 0 : MOV_TO_CR3_DO_NOT_INVALIDATE_PCID_MAPPINGS) | (QWORD)PagingData->BasePhysicalAddress | Pcid);
+
+    if (Invalidate && (NULL != pCpu))
+    {
+        VMM_TLB_RANGE range;
+
+        // the PCID may be reused for other tables => no CPU may keep any
+        // translation made with it
+        range.PagingData = PagingData;
+        range.Address = NULL;
+        range.NumberOfPages = 0;
+
+        _VmTlbShootdown(PagingData, &range, 1);
+    }
 
-    /// TODO: This should be broadcast on all CPUs to invalidate their mappings for PCID Pcid
+    CpuIntrSetState(oldState);
+}
+
+void
+VmmInvalidateAllTranslations(
+    void
+    )
+{
+    INTR_STATE oldState;
+
+    oldState = CpuIntrDisable();
+
+    if (CpuMuIsInvpcidSupported())
+    {
+        INVPCID_DESCRIPTOR descriptor = { 0 };
+
+        _invpcid(InvpcidAllContextsIncludingGlobal, &descriptor);
+    }
+    else
+    {
+        QWORD cr4 = __readcr4();
+
+        // Intel System Programming Manual Vol 3A
+        // 4.10.4.1 Operations that Invalidate TLBs and Paging-Structure Caches
+        // MOV to CR4 which changes the value of CR4.PGE invalidates all TLB
+        // entries (including global entries) and all entries in all
+        // paging-structure caches (for all PCIDs)
+        __writecr4(cr4 ^ CR4_PGE);
+        __writecr4(cr4);
+    }
+
+    CpuIntrSetState(oldState);
 }
 
 _No_competing_thread_
@@ -672,12 +1429,59 @@ VmmAllocRegionEx(
     IN_OPT  PPAGING_LOCK_DATA       PagingData,
     IN_OPT  PMDL                    Mdl
     )
+{
+    return _VmAllocRegion(BaseAddress, Size, AllocType, Rights, Uncacheable, FileObject, 0, VaSpace, PagingData, Mdl);
+}
+
+PTR_SUCCESS
+PVOID
+VmmMapFileRegion(
+    IN_OPT  PVOID                   BaseAddress,
+    IN      QWORD                   Size,
+    IN      PAGE_RIGHTS             Rights,
+    IN      PFILE_OBJECT            FileObject,
+    IN      QWORD                   FileOffset,
+    IN_OPT  PVMM_RESERVATION_SPACE  VaSpace,
+    IN_OPT  PPAGING_LOCK_DATA       PagingData
+    )
+{
+    ASSERT(FileObject != NULL);
+    ASSERT(IsAddressAligned(FileOffset, PAGE_SIZE));
+
+    return _VmAllocRegion(BaseAddress,
+                          Size,
+                          VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT,
+                          Rights,
+                          FALSE,
+                          FileObject,
+                          FileOffset,
+                          VaSpace,
+                          PagingData,
+                          NULL);
+}
+
+static
+PTR_SUCCESS
+PVOID
+_VmAllocRegion(
+    IN_OPT  PVOID                   BaseAddress,
+    IN      QWORD                   Size,
+    IN      VMM_ALLOC_TYPE          AllocType,
+    IN      PAGE_RIGHTS             Rights,
+    IN      BOOLEAN                 Uncacheable,
+    IN_OPT  PFILE_OBJECT            FileObject,
+    IN      QWORD                   FileOffset,
+    IN_OPT  PVMM_RESERVATION_SPACE  VaSpace,
+    IN_OPT  PPAGING_LOCK_DATA       PagingData,
+    IN_OPT  PMDL                    Mdl
+    )
 {
     PVOID pBaseAddress;
     QWORD alignedSize;
     STATUS status;
     PVMM_RESERVATION_SPACE pVaSpace;
     PHYSICAL_ADDRESS pa;
+    DWORD noOfPoolFrames;
 
     ASSERT(Size != 0);
 
@@ -695,6 +1499,7 @@ VmmAllocRegionEx(
     status = STATUS_SUCCESS;
     pBaseAddress = NULL;
     pa = NULL;
+    noOfPoolFrames = 0;
     alignedSize = 0;
 
     pVaSpace = (VaSpace == NULL) ? &m_vmmData.VmmReservationSpace : VaSpace;
@@ -709,6 +1514,7 @@ VmmAllocRegionEx(
                                                Rights,
                                                Uncacheable,
                                                FileObject,
+                                               FileOffset,
                                                &pBaseAddress,
                                                &alignedSize);
         if (!SUCCEEDED(status))
@@ -733,29 +1539,83 @@ VmmAllocRegionEx(
             else
             {
                 // This area is not described by an MDL, we need to reserve it now
-                // We will ask for a continuous number of frames, we have no way of
-                // asking for discontinuous frames - even if we call the function multiple
-                // times with 1 frame we probably will receive a continuous mapping because
-                // there is noone else requesting physical frames in the meantime
 
                 ASSERT(alignedSize / PAGE_SIZE <= MAX_DWORD);
                 DWORD noOfFrames = (DWORD)(alignedSize / PAGE_SIZE);
 
-                pa = PmmReserveMemory(noOfFrames);
+                // Anonymous memory mapped with 4KB pages has no continuity requirements
+                // => we can take the frames the zero worker thread has already cleared
+                // one by one, only what the pool can't cover is reserved from the PMM
+                if ((FileObject == NULL) && !IsBooleanFlagOn(AllocType, VMM_ALLOC_TYPE_LARGE_PAGES))
+                {
+                    for (; noOfPoolFrames < noOfFrames; ++noOfPoolFrames)
+                    {
+                        PHYSICAL_ADDRESS poolFrame = MmuReserveZeroedFrame();
+                        if (NULL == poolFrame)
+                        {
+                            break;
+                        }
+
+                        MmuMapAnonymousMemory(poolFrame,
+                                              PAGE_SIZE,
+                                              Rights,
+                                              PtrOffset(pBaseAddress, (QWORD) noOfPoolFrames * PAGE_SIZE),
+                                              Uncacheable,
+                                              PagingData
+                                              );
+                    }
+
+                    if (noOfPoolFrames == noOfFrames)
+                    {
+                        // the whole region is mapped, nothing is left to reserve
+                        __leave;
+                    }
+                }
+
+                // The rest of the region is backed by continuous frames
+                noOfFrames = noOfFrames - noOfPoolFrames;
+
+                // For large pages the frames must also be 2MB aligned, if we can't find such
+                // a range the region will simply be mapped using 4KB pages
+                if (IsBooleanFlagOn(AllocType, VMM_ALLOC_TYPE_LARGE_PAGES) && (FileObject == NULL))
+                {
+                    pa = PmmReserveAlignedMemory(noOfFrames, VMM_FRAMES_PER_LARGE_PAGE);
+                }
+
+                if (NULL == pa)
+                {
+                    pa = PmmReserveMemory(noOfFrames);
+                }
                 if (NULL == pa)
                 {
+                    status = STATUS_INSUFFICIENT_MEMORY;
                     LOG_ERROR("PmmReserverMemory failed!\n");
                     __leave;
                 }
 
-                MmuMapMemoryInternal(pa,
-                                     alignedSize,
-                                     Rights,
-                                     pBaseAddress,
-                                     TRUE,
-                                     Uncacheable,
-                                     PagingData
-                );
+                // the frames of anonymous memory are usable RAM => they can be
+                // mapped using large pages
+                if (FileObject == NULL)
+                {
+                    MmuMapAnonymousMemory(pa,
+                                          (QWORD) noOfFrames * PAGE_SIZE,
+                                          Rights,
+                                          PtrOffset(pBaseAddress, (QWORD) noOfPoolFrames * PAGE_SIZE),
+                                          Uncacheable,
+                                          PagingData
+                                          );
+                }
+                else
+                {
+                    MmuMapMemoryInternal(pa,
+                                         alignedSize,
+                                         Rights,
+                                         pBaseAddress,
+                                         TRUE,
+                                         Uncacheable,
+                                         PagingData
+                    );
+                }
 
                 // Check if the mapping is backed up by a file
                 if (FileObject != NULL)
@@ -763,8 +1623,8 @@ VmmAllocRegionEx(
                     QWORD fileOffset;
                     QWORD bytesRead;
 
-                    // make sure we read from the start of the file
-                    fileOffset = 0;
+                    // the offset is updated by IoReadFile => use a copy
+                    fileOffset = FileOffset;
 
                     status = IoReadFile(FileObject,
                                         alignedSize,
@@ -799,22 +1659,34 @@ VmmAllocRegionEx(
             if (pBaseAddress != NULL)
             {
                 PVOID pAlignedAddress;
+                PPAGE_CACHE_FILE pCacheFile;
 
                 VmReservationSpaceFreeRegion(pVaSpace,
                                              pBaseAddress,
                                              0,
                                              VMM_FREE_TYPE_RELEASE,
                                              &pAlignedAddress,
-                                             &alignedSize
+                                             &alignedSize,
+                                             &pCacheFile
                                              );
                 ASSERT(pAlignedAddress == pBaseAddress);
                 pBaseAddress = NULL;
 
-                if (pa != NULL)
+                if ((pa != NULL) || (0 != noOfPoolFrames))
                 {
                     MmuUnmapMemoryEx(pAlignedAddress, (DWORD) alignedSize, TRUE, PagingData);
                     pa = NULL;
+                    noOfPoolFrames = 0;
+                }
+
+                // nothing was mapped lazily yet, but keep the same order as VmmFreeRegionEx
+                if (pCacheFile != NULL)
+                {
+                    PageCacheCloseFile(pCacheFile);
+                    pCacheFile = NULL;
                 }
+
+                VmReservationSpaceReturnRegion(pVaSpace, pAlignedAddress, alignedSize);
             }
             ASSERT(pa == NULL);
         }
@@ -845,6 +1717,8 @@ VmmFreeRegionEx(
 {
     PVOID alignedAddress;
     QWORD alignedSize;
+    PVMM_RESERVATION_SPACE pVaSpace;
+    PPAGE_CACHE_FILE pCacheFile;
 
     ASSERT(Address != NULL);
     ASSERT(IsBooleanFlagOn( FreeType, VMM_FREE_TYPE_RELEASE ) ^ IsBooleanFlagOn(FreeType, VMM_FREE_TYPE_DECOMMIT ));
@@ -853,13 +1727,16 @@ VmmFreeRegionEx(
 
     alignedAddress = NULL;
     alignedSize = 0;
+    pVaSpace = (VaSpace == NULL) ? &m_vmmData.VmmReservationSpace : VaSpace;
+    pCacheFile = NULL;
 
-    VmReservationSpaceFreeRegion((VaSpace == NULL) ? &m_vmmData.VmmReservationSpace : VaSpace,
+    VmReservationSpaceFreeRegion(pVaSpace,
                                  Address,
                                  Size,
                                  FreeType,
                                  &alignedAddress,
-                                 &alignedSize);
+                                 &alignedSize,
+                                 &pCacheFile);
 
     if (IsFlagOn(FreeType, VMM_FREE_TYPE_DECOMMIT | VMM_FREE_TYPE_RELEASE ))
     {
@@ -875,6 +1752,20 @@ VmmFreeRegionEx(
                          Release,
                          PagingData);
     }
+
+    if (IsBooleanFlagOn(FreeType, VMM_FREE_TYPE_RELEASE))
+    {
+        // the cached frames may be evicted once no mapping of them remains
+        if (pCacheFile != NULL)
+        {
+            PageCacheCloseFile(pCacheFile);
+            pCacheFile = NULL;
+        }
+
+        // the stale translations are gone only after the unmap finished, until then the
+        // range must not be handed out to another reservation
+        VmReservationSpaceReturnRegion(pVaSpace, alignedAddress, alignedSize);
+    }
 }
 
 BOOLEAN
@@ -891,9 +1782,21 @@ VmmSolvePageFault(
     PAGE_RIGHTS pageRights;
     BOOLEAN uncacheable;
     PFILE_OBJECT pBackingFile;
+    PPAGE_CACHE_FILE pCacheFile;
+    PHYSICAL_ADDRESS cachedFrames[VMM_MAX_FAULT_AROUND_PAGES];
+    PVOID cachedRangeStart;
+    PHYSICAL_ADDRESS fileFrames[VMM_MAX_FAULT_AROUND_PAGES];
+    PVOID pFileMapping;
+    DWORD noOfFileFrames;
     QWORD fileOffset;
     BOOLEAN bKernelAddress;
     QWORD bytesReadFromFile;
+    BOOLEAN bFrameZeroed;
+    BOOLEAN bLargePage;
+    PVOID rangeStart;
+    DWORD rangePages;
+    BOOLEAN bReclaimMemory;
+    INTR_STATE oldState;
 
     ASSERT(INTR_OFF == CpuIntrGetState());
     ASSERT(PagingData != NULL);
@@ -924,18 +1827,45 @@ VmmSolvePageFault(
     pageRights = 0;
     uncacheable = FALSE;
     pBackingFile = NULL;
+    pCacheFile = NULL;
+    cachedRangeStart = NULL;
+    pFileMapping = NULL;
+    noOfFileFrames = 0;
     fileOffset = 0;
     bytesReadFromFile = 0;
+    bFrameZeroed = FALSE;
+    bLargePage = FALSE;
+    rangeStart = NULL;
+    rangePages = 0;
+    bReclaimMemory = FALSE;
+
+    // A write to a page shared through the page cache only needs a private copy of the frame,
+    // the page is already mapped so there's nothing to do for the reservation
+    if (IsBooleanFlagOn(RightsRequested, PAGE_RIGHTS_WRITE)
+        && _VmSolveCopyOnWriteFault(FaultingAddress, PagingData))
+    {
+        if (NULL != pCpu)
+        {
+            pCpu->PageFaults = pCpu->PageFaults + 1;
+        }
+        return TRUE;
+    }
 
     // See if the VA is already committed and retrieve its description (the page rights with which it was mapped,
-    // cacheability and for memory backed by files the FILE_OBJECT and corresponding offset in file)
+    // cacheability and for memory backed by files the FILE_OBJECT and corresponding offset in file) together
+    // with the committed pages surrounding it which we may map at the same time
     bAccessValid = VmReservationCanAddressBeAccessed(_VmmRetrieveReservationSpaceForAddress(FaultingAddress),
                                                      FaultingAddress,
                                                      RightsRequested,
                                                      &pageRights,
                                                      &uncacheable,
                                                      &pBackingFile,
-                                                     &fileOffset);
+                                                     &pCacheFile,
+                                                     &fileOffset,
+                                                     &bLargePage,
+                                                     m_vmmData.FaultAroundPages,
+                                                     &rangeStart,
+                                                     &rangePages);
 
     __try
     {
@@ -946,91 +1876,485 @@ VmmSolvePageFault(
 
             // solve #PF
 
-            // 1. Reserve one frame of physical memory
-            pa = PmmReserveMemory(1);
-            ASSERT(NULL != pa);
-
             alignedAddress = (PVOID)AlignAddressLower(FaultingAddress, PAGE_SIZE);
 
-            // 2. Map the aligned faulting address to the newly acquired physical frame
-            MmuMapMemoryInternal(pa,
-                                 PAGE_SIZE,
-                                 pageRights,
-                                 alignedAddress,
-                                 TRUE,
-                                 uncacheable,
-                                 PagingData
-                                 );
+            // The page may have been evicted, in which case it is loaded back by the swap module
+            status = _VmSwapInPage(alignedAddress, pageRights, uncacheable, PagingData);
+            if (SUCCEEDED(status))
+            {
+                if (NULL != pCpu)
+                {
+                    pCpu->PageFaults = pCpu->PageFaults + 1;
+                }
+                bSolvedPageFault = TRUE;
+                __leave;
+            }
+            else if (STATUS_INSUFFICIENT_MEMORY == status)
+            {
+                // swapped out pages exist only in the processes' address spaces
+                bSolvedPageFault = (0 != VmmReclaimMemory(PagingData, VMM_RECLAIM_BATCH_PAGES));
+                if (!bSolvedPageFault)
+                {
+                    LOG_ERROR("There is no physical memory left to swap in the page at 0x%X\n", alignedAddress);
+                }
+                __leave;
+            }
+            else if (STATUS_ELEMENT_NOT_FOUND != status)
+            {
+                LOG_FUNC_ERROR("_VmSwapInPage", status);
+                __leave;
+            }
+            status = STATUS_SUCCESS;
+
+            // If the whole 2MB around the faulting address is committed try to solve
+            // it at once using a large page
+            if (bLargePage && _VmSolvePageFaultWithLargePage(FaultingAddress, pageRights, uncacheable, PagingData))
+            {
+                if (NULL != pCpu)
+                {
+                    pCpu->PageFaults = pCpu->PageFaults + 1;
+                }
+                bSolvedPageFault = TRUE;
+                __leave;
+            }
 
-            // 3. If the virtual address is backed by a file read its contents
-            if (pBackingFile != NULL)
+            // Pages shared through the page cache are retrieved before taking the paging lock
+            // because they may need to be read from the disk
+            if (pCacheFile != NULL)
             {
-                LOGL("Will read data from file 0x%X and offset 0x%X\n", pBackingFile, fileOffset);
+                ASSERT(rangePages <= ARRAYSIZE(cachedFrames));
 
-                status = IoReadFile(pBackingFile,
-                                    PAGE_SIZE,
-                                    &fileOffset,
-                                    alignedAddress,
-                                    &bytesReadFromFile);
+                cachedRangeStart = rangeStart;
+
+                status = PageCacheGetPages(pCacheFile,
+                                           pBackingFile,
+                                           fileOffset - PtrDiff(alignedAddress, rangeStart),
+                                           rangePages,
+                                           cachedFrames);
                 if (!SUCCEEDED(status))
                 {
-                    LOG_FUNC_ERROR("IoReadFile", status);
+                    LOG_FUNC_ERROR("PageCacheGetPages", status);
                     __leave;
                 }
-
-                LOGL("Bytes read 0x%X\n", bytesReadFromFile);
-                ASSERT(bytesReadFromFile <= PAGE_SIZE);
             }
 
-            // 4. Zero the rest of the memory (in case the remaining file size was smaller than a page
-            /// TODO: check if this is really necessary (we have a ZERO worker thread already!)
-            if (bytesReadFromFile != PAGE_SIZE)
-            {
-                /// TODO: Check if we really need to remove the WP (I'd rather not do this)
-                /// According to the Intel manual the WP flag has nothing to do with accessing UM pages
-                /// It is more generic, if WP is set => supervisor accesses can write to any virtual address
-                /// even if it is read-only
-                __writecr0(__readcr0() & ~CR0_WP);
-                memzero(PtrOffset(alignedAddress, bytesReadFromFile), PAGE_SIZE - (DWORD)bytesReadFromFile);
-                __writecr0(__readcr0() | CR0_WP);
-            }
+            // 1. Drop the neighbouring pages which are already mapped, the paging lock is held until
+            // all the pages are mapped so no other CPU can map them in the meantime. The pages read
+            // from a file are an exception, step 5 maps only the ones still unmapped after the read
+            RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
 
-            if (NULL != pCpu)
+            _VmDetermineUnmappedRange(&PagingData->Data, alignedAddress, &rangeStart, &rangePages);
+            if (0 == rangePages)
             {
-                // solved another page fault :)
-                pCpu->PageFaults = pCpu->PageFaults + 1;
+                // another CPU solved this #PF before we took the lock
+                __invlpg(alignedAddress);
             }
-            bSolvedPageFault = TRUE;
-        }
-    }
-    __finally
-    {
 
-    }
+            for (DWORD i = 0; i < rangePages; ++i)
+            {
+                PVOID pageAddress = PtrOffset(rangeStart, (QWORD) i * PAGE_SIZE);
 
-    return bSolvedPageFault;
-}
+                if (pCacheFile != NULL)
+                {
+                    // the frame is shared with all the other mappings of the file, the paging
+                    // lock is already held => map it directly
+                    VmmMapSharedMemory(&PagingData->Data,
+                                       cachedFrames[PtrDiff(pageAddress, cachedRangeStart) / PAGE_SIZE],
+                                       PAGE_SIZE,
+                                       pageAddress,
+                                       pageRights,
+                                       TRUE,
+                                       uncacheable
+                                       );
+                    continue;
+                }
 
-PVMM_RESERVATION_SPACE
-VmmRetrieveReservationSpaceForSystemProcess(
-    void
-    )
-{
-    return &m_vmmData.VmmReservationSpace;
-}
+                // 2. Reserve one frame of physical memory, for anonymous memory try to take
+                // a frame already zeroed by the zero worker thread
+                pa = NULL;
+                bFrameZeroed = FALSE;
+                if (pBackingFile == NULL)
+                {
+                    pa = MmuReserveZeroedFrame();
+                    bFrameZeroed = (NULL != pa);
+                }
 
-STATUS
-VmmCreateVirtualAddressSpace(
-    OUT_PTR struct _VMM_RESERVATION_SPACE** ReservationSpace,
-    IN      QWORD                           ReservationMetadataSize,
-    IN      PVOID                           StartOfVirtualAddressSpace
-    )
-{
-    STATUS status;
-    PVMM_RESERVATION_SPACE pProcessVaHeader;
-    PVOID pReservationMetadataStart;
+                if (NULL == pa)
+                {
+                    pa = PmmReserveMemory(1);
+                }
 
-    if (ReservationSpace == NULL)
+                if (NULL == pa)
+                {
+                    // the pages mapped until now remain valid, the faulting access will be
+                    // retried after some memory is reclaimed
+                    rangePages = i;
+                    bReclaimMemory = TRUE;
+                    break;
+                }
+
+                if (pBackingFile != NULL)
+                {
+                    // The frame still holds the data of its previous owner, it is mapped
+                    // only after the file contents were read in it, see step 5
+                    ASSERT(noOfFileFrames < ARRAYSIZE(fileFrames));
+
+                    fileFrames[noOfFileFrames] = pa;
+                    noOfFileFrames++;
+                    continue;
+                }
+
+                // 3. Frames coming directly from the PMM are not guaranteed to be zeroed, clear
+                // them through the window of this CPU before they become visible in the address
+                // space. Interrupts are disabled for the whole #PF handling
+                if (!bFrameZeroed)
+                {
+                    PVOID pMapping = MmuMapFramesOnCurrentCpu(&pa, 1);
+
+                    memzero(pMapping, PAGE_SIZE);
+
+                    MmuUnmapFramesOnCurrentCpu(pMapping, 1);
+                }
+
+                // 4. Map the page to the newly acquired physical frame, the paging lock is already
+                // held. Anonymous memory of the processes may be evicted to the swap partition
+                _VmMapMemory(&PagingData->Data,
+                             pa,
+                             PAGE_SIZE,
+                             pageAddress,
+                             pageRights,
+                             TRUE,
+                             uncacheable,
+                             FALSE,
+                             !PagingData->Data.KernelSpace,
+                             FALSE
+                             );
+                if (!PagingData->Data.KernelSpace)
+                {
+                    // the page is about to be used, don't let the next reclaim pick it
+                    // before the faulting access is retried
+                    _VmRetrievePageTableEntry(&PagingData->Data, pageAddress)->Accessed = 1;
+                }
+            }
+
+            RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
+
+            // 5. If the virtual address is backed by a file read the contents of all the pages
+            // with a single I/O through a kernel mapping of the frames. The pages are mapped in
+            // the address space only after this, else the other threads of the process could
+            // see the previous contents of the frames while the read is in progress
+            if (0 != noOfFileFrames)
+            {
+                QWORD rangeSize = (QWORD) noOfFileFrames * PAGE_SIZE;
+
+                ASSERT(noOfFileFrames == rangePages);
+
+                fileOffset = fileOffset - PtrDiff(alignedAddress, rangeStart);
+
+                pFileMapping = MmuMapSystemFrames(fileFrames, noOfFileFrames);
+                if (NULL == pFileMapping)
+                {
+                    LOG_FUNC_ERROR_ALLOC("MmuMapSystemFrames", rangeSize);
+                    status = STATUS_INSUFFICIENT_MEMORY;
+                    __leave;
+                }
+
+                LOGL("Will read 0x%X bytes from file 0x%X and offset 0x%X\n", rangeSize, pBackingFile, fileOffset);
+
+                status = IoReadFile(pBackingFile,
+                                    rangeSize,
+                                    &fileOffset,
+                                    pFileMapping,
+                                    &bytesReadFromFile);
+                if (SUCCEEDED(status))
+                {
+                    LOGL("Bytes read 0x%X\n", bytesReadFromFile);
+                    ASSERT(bytesReadFromFile <= rangeSize);
+
+                    // Zero the rest of the memory (in case the remaining file size was smaller than the range)
+                    if (bytesReadFromFile != rangeSize)
+                    {
+                        memzero(PtrOffset(pFileMapping, bytesReadFromFile), (DWORD)(rangeSize - bytesReadFromFile));
+                    }
+                }
+                else
+                {
+                    LOG_FUNC_ERROR("IoReadFile", status);
+                }
+
+                // a single invalidation request for all the frames
+                MmuUnmapSystemMemory(pFileMapping, rangeSize);
+                pFileMapping = NULL;
+
+                if (!SUCCEEDED(status))
+                {
+                    __leave;
+                }
+
+                // The pages mapped by another CPU while the paging lock was released keep their
+                // frames, the frames read for them are released below
+                RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
+                for (DWORD i = 0; i < noOfFileFrames; ++i)
+                {
+                    PVOID pageAddress = PtrOffset(rangeStart, (QWORD) i * PAGE_SIZE);
+
+                    if (_VmIsPageInUse(&PagingData->Data, pageAddress))
+                    {
+                        continue;
+                    }
+
+                    _VmMapMemory(&PagingData->Data,
+                                 fileFrames[i],
+                                 PAGE_SIZE,
+                                 pageAddress,
+                                 pageRights,
+                                 TRUE,
+                                 uncacheable,
+                                 FALSE,
+                                 FALSE,
+                                 FALSE
+                                 );
+                    if (!PagingData->Data.KernelSpace)
+                    {
+                        _VmRetrievePageTableEntry(&PagingData->Data, pageAddress)->Accessed = 1;
+                    }
+
+                    fileFrames[i] = NULL;
+                }
+                RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
+            }
+
+            // 6. There was no free frame, evict some of the pages of this process and retry the
+            // access. Reclaiming needs the paging lock released because the other CPUs must
+            // drop the evicted translations
+            if (bReclaimMemory)
+            {
+                if (PagingData->Data.KernelSpace
+                    || 0 == VmmReclaimMemory(PagingData, VMM_RECLAIM_BATCH_PAGES))
+                {
+                    LOG_ERROR("There is no physical memory left to solve the #PF at 0x%X\n", FaultingAddress);
+                    __leave;
+                }
+            }
+
+            if (NULL != pCpu)
+            {
+                // solved another page fault :)
+                pCpu->PageFaults = pCpu->PageFaults + 1;
+            }
+            bSolvedPageFault = TRUE;
+        }
+    }
+    __finally
+    {
+        // the frames which were not mapped in the address space
+        for (DWORD i = 0; i < noOfFileFrames; ++i)
+        {
+            if (NULL != fileFrames[i])
+            {
+                PmmReleaseMemory(fileFrames[i], 1);
+                fileFrames[i] = NULL;
+            }
+        }
+    }
+
+    return bSolvedPageFault;
+}
+
+DWORD
+VmmReclaimMemory(
+    IN      PPAGING_LOCK_DATA       PagingData,
+    IN      DWORD                   NumberOfPages
+    )
+{
+    VMM_RECLAIM_VICTIM victims[VMM_RECLAIM_BATCH_PAGES];
+    PHYSICAL_ADDRESS freedFrames[VMM_RECLAIM_BATCH_PAGES];
+    PHYSICAL_ADDRESS dirtyFrames[VMM_RECLAIM_BATCH_PAGES];
+    PVOID dirtyPages[VMM_RECLAIM_BATCH_PAGES];
+    PVOID pDirtyMapping;
+    SWAP_HANDLE handles[VMM_RECLAIM_BATCH_PAGES];
+    VMM_UNMAP_BATCH batch;
+    DWORD noOfPages;
+    DWORD noOfVictims;
+    DWORD noOfDirtyPages;
+    DWORD noOfFreedFrames;
+    DWORD noOfSwappedOut;
+    DWORD noOfDiscarded;
+    DWORD dirtyIndex;
+    STATUS status;
+    PT_ENTRY* pPtEntry;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != PagingData);
+    ASSERT(!PagingData->Data.KernelSpace);
+
+    noOfPages = min(NumberOfPages, VMM_RECLAIM_BATCH_PAGES);
+    if (0 == noOfPages)
+    {
+        return 0;
+    }
+
+    noOfDirtyPages = 0;
+    noOfFreedFrames = 0;
+    noOfSwappedOut = 0;
+    noOfDiscarded = 0;
+    status = STATUS_SUCCESS;
+
+    for (DWORD i = 0; i < noOfPages; ++i)
+    {
+        handles[i] = SWAP_INVALID_HANDLE;
+    }
+
+    VmmInitUnmapBatch(&batch, &PagingData->Data);
+
+    // 1. Pick the pages not accessed recently, if there is nowhere to store them
+    // only the clean pages can be evicted. The dirty ones are tagged so a fault
+    // on them waits until they are stored
+    RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
+
+    noOfVictims = _VmSelectPagesToEvict(&PagingData->Data, noOfPages, SwapIsAvailable(), victims);
+    for (DWORD i = 0; i < noOfVictims; ++i)
+    {
+        if (victims[i].OldEntry.Dirty)
+        {
+            victims[i].EvictionTag = _InterlockedIncrement64(&m_vmmData.NextEvictionTag) & VMM_EVICTION_TAG_MASK;
+            dirtyFrames[noOfDirtyPages] = PteGetPhysicalAddress(&victims[i].OldEntry);
+            noOfDirtyPages++;
+
+            PteMapSwapped(_VmRetrievePageTableEntry(&PagingData->Data, victims[i].Address),
+                          victims[i].EvictionTag,
+                          TRUE);
+        }
+
+        _VmUnmapBatchAddRange(&batch, victims[i].Address, 1);
+    }
+
+    RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
+
+    if (0 == noOfVictims)
+    {
+        LOG_TRACE_VMM("No page can be evicted from address space 0x%X\n", PagingData->Data.BasePhysicalAddress);
+        return 0;
+    }
+
+    // 2. After the shootdown no CPU can modify the evicted frames anymore
+    VmmFlushUnmapBatch(&batch, FALSE);
+
+    // 3. Store all the dirty pages at once, the swap module compresses what it
+    // can and writes the rest with a single I/O. The pages are mapped one after
+    // another in a single range => a single invalidation request drops them all
+    if (0 != noOfDirtyPages)
+    {
+        pDirtyMapping = MmuMapSystemFrames(dirtyFrames, noOfDirtyPages);
+        if (NULL == pDirtyMapping)
+        {
+            LOG_FUNC_ERROR_ALLOC("MmuMapSystemFrames", noOfDirtyPages * PAGE_SIZE);
+            status = STATUS_INSUFFICIENT_MEMORY;
+        }
+        else
+        {
+            for (DWORD i = 0; i < noOfDirtyPages; ++i)
+            {
+                dirtyPages[i] = PtrOffset(pDirtyMapping, (QWORD) i * PAGE_SIZE);
+            }
+
+            // even if it fails some of the pages may have been stored, only the
+            // ones without a handle are mapped back
+            status = SwapStorePages(noOfDirtyPages, dirtyPages, handles);
+            if (!SUCCEEDED(status))
+            {
+                LOG_TRACE_VMM("SwapStorePages failed with status 0x%x\n", status);
+            }
+
+            MmuUnmapSystemMemory(pDirtyMapping, (QWORD) noOfDirtyPages * PAGE_SIZE);
+            pDirtyMapping = NULL;
+        }
+    }
+
+    // 4. Complete the eviction of the stored pages, the others are mapped back. A
+    // page freed while it was stored no longer needs its handle
+    dirtyIndex = 0;
+
+    RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
+
+    for (DWORD i = 0; i < noOfVictims; ++i)
+    {
+        SWAP_HANDLE handle;
+
+        if (!victims[i].OldEntry.Dirty)
+        {
+            freedFrames[noOfFreedFrames++] = PteGetPhysicalAddress(&victims[i].OldEntry);
+            noOfDiscarded++;
+            continue;
+        }
+
+        handle = handles[dirtyIndex++];
+
+        pPtEntry = _VmRetrievePageTableEntry(&PagingData->Data, victims[i].Address);
+        if ((NULL == pPtEntry)
+            || !PteIsSwappedOut(pPtEntry)
+            || !((PT_ENTRY_SWAPPED*)pPtEntry)->WriteInProgress
+            || (PteGetSwapSlot(pPtEntry) != victims[i].EvictionTag))
+        {
+            if (SWAP_INVALID_HANDLE != handle)
+            {
+                SwapFreePage(handle);
+            }
+            freedFrames[noOfFreedFrames++] = PteGetPhysicalAddress(&victims[i].OldEntry);
+        }
+        else if (SWAP_INVALID_HANDLE != handle)
+        {
+            PteMapSwapped(pPtEntry, handle, FALSE);
+            freedFrames[noOfFreedFrames++] = PteGetPhysicalAddress(&victims[i].OldEntry);
+            noOfSwappedOut++;
+        }
+        else
+        {
+            // nothing was cached while the PTE was not present => no invalidation is needed
+            *pPtEntry = victims[i].OldEntry;
+        }
+    }
+
+    RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
+
+    ASSERT(dirtyIndex == noOfDirtyPages);
+
+    // 5. The frames are not zeroed, the #PF handler zeroes any frame it takes
+    // directly from the PMM
+    for (DWORD i = 0; i < noOfFreedFrames; ++i)
+    {
+        PmmReleaseMemory(freedFrames[i], 1);
+    }
+
+    _InterlockedExchangeAdd64(&m_vmmData.PagesSwappedOut, noOfSwappedOut);
+    _InterlockedExchangeAdd64(&m_vmmData.PagesDiscarded, noOfDiscarded);
+
+    LOG_TRACE_VMM("Evicted %u pages, %u stored in swap and %u discarded\n",
+                  noOfFreedFrames, noOfSwappedOut, noOfDiscarded);
+
+    return noOfFreedFrames;
+}
+
+PVMM_RESERVATION_SPACE
+VmmRetrieveReservationSpaceForSystemProcess(
+    void
+    )
+{
+    return &m_vmmData.VmmReservationSpace;
+}
+
+STATUS
+VmmCreateVirtualAddressSpace(
+    OUT_PTR struct _VMM_RESERVATION_SPACE** ReservationSpace,
+    IN      QWORD                           ReservationMetadataSize,
+    IN      PVOID                           StartOfVirtualAddressSpace
+    )
+{
+    STATUS status;
+    PVMM_RESERVATION_SPACE pProcessVaHeader;
+    PVOID pReservationMetadataStart;
+
+    if (ReservationSpace == NULL)
     {
         return STATUS_INVALID_PARAMETER1;
     }
@@ -1109,16 +2433,26 @@ VmmCreateVirtualAddressSpace(
 void
 VmmDestroyVirtualAddressSpace(
     _Pre_valid_ _Post_ptr_invalid_
-        struct _VMM_RESERVATION_SPACE*      ReservationSpace
+        struct _VMM_RESERVATION_SPACE*      ReservationSpace,
+    IN      PPAGING_LOCK_DATA               PagingData
     )
 {
+    PVOID pRegion;
+
     ASSERT(ReservationSpace != NULL);
+    ASSERT(PagingData != NULL);
 
-    if (ReservationSpace->ReservationList != NULL)
+    // Release the reservations still left, this also drops the page cache references of the
+    // mapped files (i.e. the image sections)
+    for (pRegion = VmReservationSpaceRetrieveLastRegion(ReservationSpace);
+         pRegion != NULL;
+         pRegion = VmReservationSpaceRetrieveLastRegion(ReservationSpace))
     {
-        /// TODO: go through each reservation belonging to the process and
-        /// release all the physical frames used (else we have physical memory leaks :) - not fun)
+        VmmFreeRegionEx(pRegion, 0, VMM_FREE_TYPE_RELEASE, TRUE, ReservationSpace, PagingData);
+    }
 
+    if (ReservationSpace->ReservationList != NULL)
+    {
         VmmFreeRegion(ReservationSpace->ReservationList, 0, VMM_FREE_TYPE_RELEASE);
         ReservationSpace->ReservationList = NULL;
     }
@@ -1191,12 +2525,8 @@ _VmSetupPagingStructure(
     flags.UserAccess = !PagingData->KernelSpace;
 
     // for paging structure PA2VA can always be used :)
+    // the frame is already zeroed => we cannot get stray memory accesses
     PteMap(PagingStructure, physicalAddr, flags);
-
-    __invlpg((PVOID)PA2VA(physicalAddr));
-
-    // Zero the current paging structure entry => we cannot get stray memory accesses
-    memzero((PVOID)PA2VA(physicalAddr), PAGE_SIZE);
 }
 
 static
@@ -1239,4 +2569,1119 @@ _VmDeterminePatIndices(
     }
 
     return bFoundWb && bFoundUc;
-}
\ No newline at end of file
+}
+
+static
+void
+_VmSplitLargePage(
+    IN      PPAGING_DATA            PagingData,
+    INOUT   PVOID                   PageDirectoryEntry,
+    IN      PVOID                   LargePageAddress
+    )
+{
+    PD_ENTRY_2MB largePage;
+    PHYSICAL_ADDRESS basePhysicalAddress;
+    PHYSICAL_ADDRESS ptPhysicalAddress;
+    PT_ENTRY* ptEntries;
+    PTE_MAP_FLAGS flags = { 0 };
+    PTE_MAP_FLAGS ptFlags = { 0 };
+
+    ASSERT(NULL != PagingData);
+    ASSERT(NULL != PageDirectoryEntry);
+    ASSERT(PteIsLargePage(PageDirectoryEntry));
+    ASSERT(IsAddressAligned(LargePageAddress, VMM_LARGE_PAGE_SIZE));
+
+    largePage = *((PD_ENTRY_2MB*)PageDirectoryEntry);
+    basePhysicalAddress = PteLargePageGetPhysicalAddress(&largePage);
+
+    // keep the exact same attributes for each of the 4KB pages
+    flags.Writable = largePage.ReadWrite;
+    flags.Executable = !largePage.XD;
+    flags.UserAccess = largePage.UserSupervisor;
+    flags.GlobalPage = largePage.Global;
+    flags.PatIndex = (WORD) ((largePage.PAT << 2) | (largePage.PCD << 1) | largePage.PWT);
+
+    ptPhysicalAddress = _VmRetrieveNextPhysicalAddressForPagingStructure(PagingData);
+    ptEntries = (PT_ENTRY*) PA2VA(ptPhysicalAddress);
+
+    __invlpg(ptEntries);
+
+    for (DWORD i = 0; i < VMM_FRAMES_PER_LARGE_PAGE; ++i)
+    {
+        PteMap(&ptEntries[i], PtrOffset(basePhysicalAddress, (QWORD) i * PAGE_SIZE), flags);
+    }
+
+    // the PDE is switched only after the page table is fully populated
+    ptFlags.Writable = TRUE;
+    ptFlags.Executable = TRUE;
+    ptFlags.PagingStructure = TRUE;
+    ptFlags.UserAccess = !PagingData->KernelSpace;
+
+    PteMap(PageDirectoryEntry, ptPhysicalAddress, ptFlags);
+
+    // INVLPG on any address covered by the large page drops its TLB entry
+    __invlpg(LargePageAddress);
+}
+
+static
+PTR_SUCCESS
+PVOID
+_VmRetrievePageDirectoryEntry(
+    IN      PPAGING_DATA            PagingData,
+    IN      PVOID                   VirtualAddress
+    )
+{
+    PML4_ENTRY* pml4Entries;
+    PDPT_ENTRY_PD* pdptEntries;
+    PD_ENTRY_PT* pdEntries;
+
+    ASSERT(NULL != PagingData);
+
+    pml4Entries = (PML4_ENTRY*)PA2VA(PagingData->BasePhysicalAddress);
+    pml4Entries = &(pml4Entries[MASK_PML4_OFFSET(VirtualAddress)]);
+    if (!PteIsPresent(pml4Entries))
+    {
+        return NULL;
+    }
+
+    pdptEntries = (PDPT_ENTRY_PD*)PA2VA(PteGetPhysicalAddress(pml4Entries));
+    pdptEntries = &(pdptEntries[MASK_PDPTE_OFFSET(VirtualAddress)]);
+    if (!PteIsPresent(pdptEntries))
+    {
+        return NULL;
+    }
+
+    ASSERT(0 == pdptEntries->PageSize);
+
+    pdEntries = (PD_ENTRY_PT*)PA2VA(PteGetPhysicalAddress(pdptEntries));
+
+    return &(pdEntries[MASK_PDE_OFFSET(VirtualAddress)]);
+}
+
+static
+BOOL_SUCCESS
+BOOLEAN
+_VmSolvePageFaultWithLargePage(
+    IN      PVOID                   FaultingAddress,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Uncacheable,
+    IN      PPAGING_LOCK_DATA       PagingData
+    )
+{
+    PVOID alignedAddress;
+    PVOID pPdEntry;
+    PHYSICAL_ADDRESS pa;
+    INTR_STATE oldState;
+    BOOLEAN bMapped;
+
+    ASSERT(NULL != PagingData);
+
+    alignedAddress = (PVOID)AlignAddressLower(FaultingAddress, VMM_LARGE_PAGE_SIZE);
+    pa = NULL;
+    bMapped = FALSE;
+
+    // The paging lock is recursive, we hold it from the moment we check the PDE
+    // until the large page is mapped so no other CPU can populate the region
+    RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
+    __try
+    {
+        pPdEntry = _VmRetrievePageDirectoryEntry(&PagingData->Data, alignedAddress);
+        if ((NULL != pPdEntry) && PteIsPresent(pPdEntry))
+        {
+            // some 4KB pages are already mapped, we can't discard them
+            __leave;
+        }
+
+        pa = PmmReserveAlignedMemory(VMM_FRAMES_PER_LARGE_PAGE, VMM_FRAMES_PER_LARGE_PAGE);
+        if (NULL == pa)
+        {
+            LOG_TRACE_VMM("No 2MB aligned physical range is available\n");
+            __leave;
+        }
+
+        VmmMapAnonymousMemory(&PagingData->Data,
+                              pa,
+                              VMM_LARGE_PAGE_SIZE,
+                              alignedAddress,
+                              PageRights,
+                              Uncacheable
+                              );
+
+        // same reasoning as for the 4KB case, the page may be read-only
+        __writecr0(__readcr0() & ~CR0_WP);
+        memzero(alignedAddress, VMM_LARGE_PAGE_SIZE);
+        __writecr0(__readcr0() | CR0_WP);
+
+        bMapped = TRUE;
+    }
+    __finally
+    {
+        RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
+    }
+
+    return bMapped;
+}
+
+static
+BOOL_SUCCESS
+BOOLEAN
+_VmSolveCopyOnWriteFault(
+    IN      PVOID                   FaultingAddress,
+    IN      PPAGING_LOCK_DATA       PagingData
+    )
+{
+    PVOID alignedAddress;
+    PT_ENTRY* pPtEntry;
+    PHYSICAL_ADDRESS sharedFrame;
+    PHYSICAL_ADDRESS privateFrame;
+    PHYSICAL_ADDRESS frames[2];
+    PVOID pMapping;
+    INTR_STATE oldState;
+    BOOLEAN bSolved;
+    BOOLEAN bRemapped;
+    VMM_TLB_RANGE range;
+    PTE_MAP_FLAGS flags = { 0 };
+
+    ASSERT(NULL != PagingData);
+
+    alignedAddress = (PVOID)AlignAddressLower(FaultingAddress, PAGE_SIZE);
+    sharedFrame = NULL;
+    privateFrame = NULL;
+    bSolved = FALSE;
+    bRemapped = FALSE;
+
+    // 1. Check if the write was done to a copy-on-write page
+    RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
+    pPtEntry = _VmRetrievePageTableEntry(&PagingData->Data, alignedAddress);
+    if ((NULL != pPtEntry) && PteIsCopyOnWrite(pPtEntry))
+    {
+        sharedFrame = PteGetPhysicalAddress(pPtEntry);
+    }
+    else
+    {
+        // another CPU already made the copy, our TLB still had the read-only translation; the
+        // user access check keeps a UM write to a kernel page from faulting forever
+        bSolved = (NULL != pPtEntry) && PteIsPresent(pPtEntry) && pPtEntry->ReadWrite
+                  && (PagingData->Data.KernelSpace || pPtEntry->UserSupervisor);
+    }
+    RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
+
+    if (NULL == sharedFrame)
+    {
+        if (bSolved)
+        {
+            __invlpg(alignedAddress);
+        }
+
+        return bSolved;
+    }
+
+    // 2. Copy the page without holding the paging lock. Both frames are mapped in the window
+    // of this CPU with the interrupts disabled => no other CPU can cache these translations
+    // and no IPI is needed to drop them, the copy does not block
+    privateFrame = PmmReserveMemory(1);
+    if (NULL == privateFrame)
+    {
+        // the write is retried after some pages of the process are evicted, the shared frame
+        // itself is never evicted
+        if (PagingData->Data.KernelSpace
+            || 0 == VmmReclaimMemory(PagingData, VMM_RECLAIM_BATCH_PAGES))
+        {
+            LOG_ERROR("PmmReserveMemory failed!\n");
+            return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    frames[0] = privateFrame;
+    frames[1] = sharedFrame;
+
+    oldState = CpuIntrDisable();
+
+    pMapping = MmuMapFramesOnCurrentCpu(frames, ARRAYSIZE(frames));
+
+    memcpy(pMapping, PtrOffset(pMapping, PAGE_SIZE), PAGE_SIZE);
+
+    MmuUnmapFramesOnCurrentCpu(pMapping, ARRAYSIZE(frames));
+    pMapping = NULL;
+
+    CpuIntrSetState(oldState);
+
+    // 3. Replace the shared frame with the copy unless another CPU did it in the meantime
+    RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
+    pPtEntry = _VmRetrievePageTableEntry(&PagingData->Data, alignedAddress);
+    if ((NULL != pPtEntry) && PteIsCopyOnWrite(pPtEntry) && (PteGetPhysicalAddress(pPtEntry) == sharedFrame))
+    {
+        flags.Writable = TRUE;
+        flags.Executable = !pPtEntry->XD;
+        flags.UserAccess = pPtEntry->UserSupervisor;
+        flags.GlobalPage = pPtEntry->Global;
+        flags.PatIndex = (WORD) ((pPtEntry->PAT << 2) | (pPtEntry->PCD << 1) | pPtEntry->PWT);
+        flags.Pageable = !PagingData->Data.KernelSpace;
+
+        PteMap(pPtEntry, privateFrame, flags);
+        privateFrame = NULL;
+
+        bRemapped = TRUE;
+        bSolved = TRUE;
+    }
+    else
+    {
+        bSolved = (NULL != pPtEntry) && PteIsPresent(pPtEntry) && pPtEntry->ReadWrite
+                  && (PagingData->Data.KernelSpace || pPtEntry->UserSupervisor);
+    }
+    RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
+
+    if (NULL != privateFrame)
+    {
+        PmmReleaseMemory(privateFrame, 1);
+        privateFrame = NULL;
+    }
+
+    if (bRemapped)
+    {
+        // the other CPUs running in this address space may have cached the read-only translation
+        range.PagingData = &PagingData->Data;
+        range.Address = alignedAddress;
+        range.NumberOfPages = 1;
+
+        _VmTlbShootdown(&PagingData->Data, &range, 1);
+
+        _InterlockedIncrement64(&m_vmmData.NumberOfCopyOnWriteFaults);
+    }
+    else if (bSolved)
+    {
+        __invlpg(alignedAddress);
+    }
+
+    return bSolved;
+}
+
+static
+PTR_SUCCESS
+PT_ENTRY*
+_VmRetrievePageTableEntry(
+    IN      PPAGING_DATA            PagingData,
+    IN      PVOID                   VirtualAddress
+    )
+{
+    PVOID pPdEntry;
+    PT_ENTRY* ptEntries;
+
+    ASSERT(NULL != PagingData);
+
+    pPdEntry = _VmRetrievePageDirectoryEntry(PagingData, VirtualAddress);
+    if ((NULL == pPdEntry) || !PteIsPresent(pPdEntry) || PteIsLargePage(pPdEntry))
+    {
+        return NULL;
+    }
+
+    ptEntries = (PT_ENTRY*)PA2VA(PteGetPhysicalAddress(pPdEntry));
+
+    return &(ptEntries[MASK_PTE_OFFSET(VirtualAddress)]);
+}
+
+static
+void
+_VmDetermineUnmappedRange(
+    IN      PPAGING_DATA            PagingData,
+    IN      PVOID                   Address,
+    INOUT   PVOID*                  RangeStart,
+    INOUT   DWORD*                  RangePages
+    )
+{
+    PVOID pStart;
+    PVOID pEnd;
+    PVOID pRangeEnd;
+
+    ASSERT(NULL != PagingData);
+    ASSERT(IsAddressAligned(Address, PAGE_SIZE));
+    ASSERT(NULL != RangeStart);
+    ASSERT(NULL != RangePages);
+    ASSERT(CHECK_BOUNDS(Address, PAGE_SIZE, *RangeStart, (QWORD) *RangePages * PAGE_SIZE));
+
+    if (_VmIsPageInUse(PagingData, Address))
+    {
+        *RangePages = 0;
+        return;
+    }
+
+    pRangeEnd = PtrOffset(*RangeStart, (QWORD) *RangePages * PAGE_SIZE);
+
+    pStart = Address;
+    while (pStart > *RangeStart && !_VmIsPageInUse(PagingData, (PBYTE)pStart - PAGE_SIZE))
+    {
+        pStart = (PBYTE)pStart - PAGE_SIZE;
+    }
+
+    pEnd = PtrOffset(Address, PAGE_SIZE);
+    while (pEnd < pRangeEnd && !_VmIsPageInUse(PagingData, pEnd))
+    {
+        pEnd = PtrOffset(pEnd, PAGE_SIZE);
+    }
+
+    *RangeStart = pStart;
+    *RangePages = (DWORD) (PtrDiff(pEnd, pStart) / PAGE_SIZE);
+}
+
+static
+void
+_VmUnmapBatchAddRange(
+    INOUT   PVMM_UNMAP_BATCH        Batch,
+    IN      PVOID                   Address,
+    IN      DWORD                   NumberOfPages
+    )
+{
+    PVMM_TLB_RANGE pRange;
+
+    ASSERT(NULL != Batch);
+    ASSERT(0 != NumberOfPages);
+
+    if (0 != Batch->NumberOfRanges)
+    {
+        pRange = &Batch->Ranges[Batch->NumberOfRanges - 1];
+
+        if (PtrOffset(pRange->Address, (QWORD) pRange->NumberOfPages * PAGE_SIZE) == Address)
+        {
+            pRange->NumberOfPages = pRange->NumberOfPages + NumberOfPages;
+            return;
+        }
+    }
+
+    ASSERT(Batch->NumberOfRanges < VMM_UNMAP_BATCH_MAX_RANGES);
+
+    pRange = &Batch->Ranges[Batch->NumberOfRanges];
+
+    pRange->PagingData = Batch->PagingData;
+    pRange->Address = Address;
+    pRange->NumberOfPages = NumberOfPages;
+
+    Batch->NumberOfRanges++;
+}
+
+static
+void
+_VmUnmapBatchAddFrames(
+    INOUT   PVMM_UNMAP_BATCH        Batch,
+    IN      PHYSICAL_ADDRESS        PhysicalAddress,
+    IN      DWORD                   NumberOfFrames
+    )
+{
+    PVMM_FRAME_RUN pRun;
+
+    ASSERT(NULL != Batch);
+    ASSERT(0 != NumberOfFrames);
+
+    if (0 != Batch->NumberOfFrameRuns)
+    {
+        pRun = &Batch->FrameRuns[Batch->NumberOfFrameRuns - 1];
+
+        if (PtrOffset(pRun->Address, (QWORD) pRun->NumberOfFrames * PAGE_SIZE) == PhysicalAddress)
+        {
+            pRun->NumberOfFrames = pRun->NumberOfFrames + NumberOfFrames;
+            return;
+        }
+    }
+
+    ASSERT(Batch->NumberOfFrameRuns < VMM_UNMAP_BATCH_MAX_FRAME_RUNS);
+
+    pRun = &Batch->FrameRuns[Batch->NumberOfFrameRuns];
+
+    pRun->Address = PhysicalAddress;
+    pRun->NumberOfFrames = NumberOfFrames;
+
+    Batch->NumberOfFrameRuns++;
+}
+
+static
+void
+_VmTlbMarkPcidsStale(
+    INOUT   PPCPU                   Cpu,
+    IN      PCID                    CurrentPcid
+    )
+{
+    ASSERT(NULL != Cpu);
+
+    // the translations of the current PCID were already invalidated
+    BitmapSetBitsValue(&Cpu->TlbData.StalePcids, 0, PCID_TOTAL_NO_OF_VALUES, TRUE);
+    BitmapSetBitValue(&Cpu->TlbData.StalePcids, CurrentPcid, FALSE);
+}
+
+static
+void
+_VmTlbInvalidateRange(
+    INOUT   PPCPU                   Cpu,
+    IN      PVMM_TLB_RANGE          Range
+    )
+{
+    PPAGING_DATA pPagingData;
+    PCID currentPcid;
+
+    ASSERT(NULL != Cpu);
+    ASSERT(NULL != Range);
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pPagingData = Range->PagingData;
+    currentPcid = (PCID) MASK_PAGE_OFFSET(__readcr3());
+
+    if (!pPagingData->KernelSpace && (pPagingData->Pcid != currentPcid))
+    {
+        // We are not using these tables now, the translations cached with their
+        // PCID are dropped when we switch back to them and until then we no
+        // longer need to be notified about changes
+        BitmapSetBitValue(&Cpu->TlbData.StalePcids, pPagingData->Pcid, TRUE);
+        _InterlockedAnd8((volatile char*) &pPagingData->ActiveCpus, (char) ~Cpu->LogicalApicId);
+
+        return;
+    }
+
+    if ((0 == Range->NumberOfPages) || (Range->NumberOfPages > VMM_TLB_FULL_FLUSH_THRESHOLD))
+    {
+        Cpu->TlbData.FullFlushes++;
+
+        if (pPagingData->KernelSpace)
+        {
+            // a CR3 load does not touch global translations
+            VmmInvalidateAllTranslations();
+            return;
+        }
+
+        // MOV to CR3 with bit 63 clear drops all the translations of the current PCID
+        __writecr3(__readcr3());
+    }
+    else
+    {
+        // INVLPG also drops the global translation of the address, no matter
+        // which PCID is active
+        for (DWORD i = 0; i < Range->NumberOfPages; ++i)
+        {
+            __invlpg(PtrOffset(Range->Address, (QWORD) i * PAGE_SIZE));
+        }
+
+        Cpu->TlbData.PagesInvalidated = Cpu->TlbData.PagesInvalidated + Range->NumberOfPages;
+    }
+
+    if (pPagingData->KernelSpace && !IsBooleanFlagOn(__readcr4(), CR4_PGE))
+    {
+        // Without global pages the kernel translations may also be cached with
+        // the PCID of each process which ran on this CPU
+        _VmTlbMarkPcidsStale(Cpu, currentPcid);
+    }
+}
+
+static
+QWORD
+_VmTlbQueueRanges(
+    INOUT   PPCPU                   Cpu,
+    IN_READS(NumberOfRanges)
+            PVMM_TLB_RANGE          Ranges,
+    IN      DWORD                   NumberOfRanges
+    )
+{
+    PVMM_TLB_CPU_DATA pTlbData;
+    INTR_STATE oldState;
+    QWORD generation;
+
+    ASSERT(NULL != Cpu);
+    ASSERT(NULL != Ranges);
+
+    pTlbData = &Cpu->TlbData;
+
+    LockAcquire(&pTlbData->PendingLock, &oldState);
+
+    if (!pTlbData->FlushAllPending)
+    {
+        if (pTlbData->NumberOfPendingRanges + NumberOfRanges > VMM_TLB_MAX_PENDING_RANGES)
+        {
+            // too many requests are waiting, it's cheaper to drop everything
+            pTlbData->FlushAllPending = TRUE;
+            pTlbData->NumberOfPendingRanges = 0;
+        }
+        else
+        {
+            memcpy(&pTlbData->PendingRanges[pTlbData->NumberOfPendingRanges],
+                   Ranges,
+                   NumberOfRanges * sizeof(VMM_TLB_RANGE));
+            pTlbData->NumberOfPendingRanges = pTlbData->NumberOfPendingRanges + NumberOfRanges;
+        }
+    }
+
+    pTlbData->RequestedGeneration++;
+    generation = pTlbData->RequestedGeneration;
+
+    LockRelease(&pTlbData->PendingLock, oldState);
+
+    return generation;
+}
+
+static
+void
+_VmTlbProcessPendingRanges(
+    INOUT   PPCPU                   Cpu
+    )
+{
+    PVMM_TLB_CPU_DATA pTlbData;
+    VMM_TLB_RANGE ranges[VMM_TLB_MAX_PENDING_RANGES];
+    DWORD noOfRanges;
+    BOOLEAN bFlushAll;
+    QWORD generation;
+    INTR_STATE oldState;
+    DWORD i;
+
+    ASSERT(NULL != Cpu);
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pTlbData = &Cpu->TlbData;
+
+    LockAcquire(&pTlbData->PendingLock, &oldState);
+
+    generation = pTlbData->RequestedGeneration;
+    noOfRanges = pTlbData->NumberOfPendingRanges;
+    bFlushAll = pTlbData->FlushAllPending;
+
+    memcpy(ranges, pTlbData->PendingRanges, noOfRanges * sizeof(VMM_TLB_RANGE));
+
+    pTlbData->NumberOfPendingRanges = 0;
+    pTlbData->FlushAllPending = FALSE;
+
+    LockRelease(&pTlbData->PendingLock, oldState);
+
+    if (generation == pTlbData->CompletedGeneration)
+    {
+        // already handled while we were waiting for our own requests
+        return;
+    }
+
+    if (bFlushAll)
+    {
+        VmmInvalidateAllTranslations();
+
+        pTlbData->FullFlushes++;
+    }
+    else
+    {
+        for (i = 0; i < noOfRanges; ++i)
+        {
+            _VmTlbInvalidateRange(Cpu, &ranges[i]);
+        }
+    }
+
+    // the requesters may now reuse the frames
+    pTlbData->CompletedGeneration = generation;
+}
+
+void
+VmmProcessTlbShootdown(
+    void
+    )
+{
+    PPCPU pCpu;
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pCpu = GetCurrentPcpu();
+    ASSERT(NULL != pCpu);
+
+    pCpu->TlbData.ShootdownsReceived++;
+
+    _VmTlbProcessPendingRanges(pCpu);
+}
+
+static
+void
+_VmTlbShootdown(
+    IN      PPAGING_DATA            PagingData,
+    IN_READS(NumberOfRanges)
+            PVMM_TLB_RANGE          Ranges,
+    IN      DWORD                   NumberOfRanges
+    )
+{
+    PPCPU pCpu;
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    INTR_STATE oldState;
+    CPU_AFFINITY activeCpus;
+    CPU_AFFINITY destination;
+    QWORD generations[BITS_FOR_STRUCTURE(CPU_AFFINITY)];
+    unsigned long cpuIndex;
+    QWORD startTicks;
+    QWORD elapsedTicks;
+    DWORD i;
+
+    ASSERT(NULL != PagingData);
+    ASSERT(NULL != Ranges && 0 != NumberOfRanges);
+
+    // The targets process the request from their interrupt handler. A target
+    // spinning with the interrupts disabled on a lock held by the caller would
+    // never do it and the wait below would never end => the caller must not
+    // hold any lock other CPUs may spin on, the paging locks included. Only
+    // the targets waiting for their own shootdowns are served while we wait.
+
+    // we must stay on the same CPU until all the other CPUs acknowledge the
+    // request
+    oldState = CpuIntrDisable();
+
+    pCpu = GetCurrentPcpu();
+    if (NULL == pCpu)
+    {
+        // the CPU structures are not yet initialized => we're the only CPU running
+        for (i = 0; i < NumberOfRanges; ++i)
+        {
+            for (DWORD j = 0; j < Ranges[i].NumberOfPages; ++j)
+            {
+                __invlpg(PtrOffset(Ranges[i].Address, (QWORD) j * PAGE_SIZE));
+            }
+        }
+
+        CpuIntrSetState(oldState);
+        return;
+    }
+
+    for (i = 0; i < NumberOfRanges; ++i)
+    {
+        _VmTlbInvalidateRange(pCpu, &Ranges[i]);
+    }
+
+    // The PTEs were changed before reading the CPUs using the tables while the
+    // CPUs set their bit before loading CR3, without a full barrier the load
+    // could pass the stores and a CPU would be missed
+    _mm_mfence();
+    activeCpus = PagingData->ActiveCpus;
+    destination = 0;
+
+    SmpGetCpuList(&pCpuListHead);
+
+    for (pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pTargetCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+
+        if ((pTargetCpu == pCpu) || (!pTargetCpu->ApicInitialized))
+        {
+            continue;
+        }
+
+        // the kernel tables are shared by all the address spaces => all the CPUs
+        // may cache these translations
+        if (!PagingData->KernelSpace && !IsBooleanFlagOn(activeCpus, pTargetCpu->LogicalApicId))
+        {
+            continue;
+        }
+
+        // the logical APIC IDs are single bits of a CPU_AFFINITY => their
+        // positions are always valid indices, unlike the APIC IDs. A CPU
+        // without one could not be reached by the logical destination IPI
+        ASSERT(0 != pTargetCpu->LogicalApicId);
+        _BitScanForward(&cpuIndex, pTargetCpu->LogicalApicId);
+        ASSERT(cpuIndex < ARRAYSIZE(generations));
+
+        generations[cpuIndex] = _VmTlbQueueRanges(pTargetCpu, Ranges, NumberOfRanges);
+        destination = destination | pTargetCpu->LogicalApicId;
+    }
+
+    if (0 != destination)
+    {
+        startTicks = IomuGetSystemTicks(NULL);
+
+        // a single IPI for all the ranges, each CPU drains its own queue. The
+        // requests were already queued in the PCPUs => nothing is allocated
+        SmpSendTlbShootdownIpi(destination);
+
+        for (pCurEntry = pCpuListHead->Flink;
+             pCurEntry != pCpuListHead;
+             pCurEntry = pCurEntry->Flink)
+        {
+            PPCPU pTargetCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+
+            if (!IsBooleanFlagOn(destination, pTargetCpu->LogicalApicId))
+            {
+                continue;
+            }
+
+            _BitScanForward(&cpuIndex, pTargetCpu->LogicalApicId);
+
+            while (pTargetCpu->TlbData.CompletedGeneration < generations[cpuIndex])
+            {
+                // the target may be waiting for us in the same way with the
+                // interrupts disabled => we must serve its requests too
+                _VmTlbProcessPendingRanges(pCpu);
+
+                _mm_pause();
+            }
+        }
+
+        elapsedTicks = IomuGetSystemTicks(NULL) - startTicks;
+
+        pCpu->TlbData.ShootdownsSent++;
+        pCpu->TlbData.RoundTripTicks = pCpu->TlbData.RoundTripTicks + elapsedTicks;
+        pCpu->TlbData.MaxRoundTripTicks = max(pCpu->TlbData.MaxRoundTripTicks, elapsedTicks);
+    }
+
+    CpuIntrSetState(oldState);
+}
+
+static
+STATUS
+_VmSwapInPage(
+    IN      PVOID                   Address,
+    IN      PAGE_RIGHTS             PageRights,
+    IN      BOOLEAN                 Uncacheable,
+    IN      PPAGING_LOCK_DATA       PagingData
+    )
+{
+    PT_ENTRY* pPtEntry;
+    SWAP_HANDLE handle;
+    BOOLEAN bSwappedOut;
+    BOOLEAN bWriteInProgress;
+    BOOLEAN bMapped;
+    PHYSICAL_ADDRESS pa;
+    PVOID pMapping;
+    STATUS status;
+    INTR_STATE oldState;
+
+    ASSERT(IsAddressAligned(Address, PAGE_SIZE));
+    ASSERT(NULL != PagingData);
+
+    handle = SWAP_INVALID_HANDLE;
+    bWriteInProgress = FALSE;
+    bMapped = FALSE;
+
+    // 1. Check if the page was stored by the swap module
+    RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
+    pPtEntry = _VmRetrievePageTableEntry(&PagingData->Data, Address);
+    bSwappedOut = (NULL != pPtEntry) && PteIsSwappedOut(pPtEntry);
+    if (bSwappedOut)
+    {
+        handle = PteGetSwapSlot(pPtEntry);
+        bWriteInProgress = (BOOLEAN) ((PT_ENTRY_SWAPPED*)pPtEntry)->WriteInProgress;
+    }
+    RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
+
+    if (!bSwappedOut)
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    if (bWriteInProgress)
+    {
+        // the CPU evicting the page will finish soon, the access is simply retried
+        return STATUS_SUCCESS;
+    }
+
+    // 2. Load the page without holding the paging lock
+    pa = PmmReserveMemory(1);
+    if (NULL == pa)
+    {
+        return STATUS_INSUFFICIENT_MEMORY;
+    }
+
+    if (SwapIsPageInMemory(handle))
+    {
+        // the page is only decompressed or zeroed, this never blocks => the frame is
+        // mapped in the window of this CPU and no IPI is needed to unmap it
+        oldState = CpuIntrDisable();
+
+        pMapping = MmuMapFramesOnCurrentCpu(&pa, 1);
+
+        status = SwapLoadPage(handle, pMapping);
+
+        MmuUnmapFramesOnCurrentCpu(pMapping, 1);
+        pMapping = NULL;
+
+        CpuIntrSetState(oldState);
+    }
+    else
+    {
+        // the thread may block and continue on another CPU while the page is read
+        pMapping = MmuMapSystemMemory(pa, PAGE_SIZE);
+        if (NULL == pMapping)
+        {
+            LOG_FUNC_ERROR_ALLOC("MmuMapSystemMemory", PAGE_SIZE);
+            PmmReleaseMemory(pa, 1);
+            return STATUS_INSUFFICIENT_MEMORY;
+        }
+
+        status = SwapLoadPage(handle, pMapping);
+
+        MmuUnmapSystemMemory(pMapping, PAGE_SIZE);
+        pMapping = NULL;
+    }
+
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("SwapLoadPage", status);
+        PmmReleaseMemory(pa, 1);
+        return status;
+    }
+
+    // 3. Map the frame unless another CPU already brought the page back or freed it
+    RecRwSpinlockAcquireExclusive(&PagingData->Lock, &oldState);
+    pPtEntry = _VmRetrievePageTableEntry(&PagingData->Data, Address);
+    if ((NULL != pPtEntry)
+        && PteIsSwappedOut(pPtEntry)
+        && (PteGetSwapSlot(pPtEntry) == handle)
+        && !((PT_ENTRY_SWAPPED*)pPtEntry)->WriteInProgress)
+    {
+        _VmMapMemory(&PagingData->Data, pa, PAGE_SIZE, Address, PageRights, TRUE, Uncacheable, FALSE, TRUE, FALSE);
+
+        // the handle is freed below => the page must be stored again if it is
+        // evicted, even if it is not modified until then
+        pPtEntry->Dirty = 1;
+        pPtEntry->Accessed = 1;
+
+        pa = NULL;
+        bMapped = TRUE;
+    }
+    RecRwSpinlockReleaseExclusive(&PagingData->Lock, oldState);
+
+    if (bMapped)
+    {
+        SwapFreePage(handle);
+        _InterlockedIncrement64(&m_vmmData.PagesSwappedIn);
+    }
+
+    if (NULL != pa)
+    {
+        PmmReleaseMemory(pa, 1);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+DWORD
+_VmSelectPagesToEvict(
+    INOUT   PPAGING_DATA            PagingData,
+    IN      DWORD                   MaxPages,
+    IN      BOOLEAN                 CanWriteDirtyPages,
+    OUT_WRITES(MaxPages)
+            PVMM_RECLAIM_VICTIM     Victims
+    )
+{
+    PML4_ENTRY* pml4Entries;
+    PDPT_ENTRY_PD* pdptEntries;
+    PD_ENTRY_PT* pdEntries;
+    PT_ENTRY* ptEntries;
+    PT_ENTRY oldEntry;
+    PT_ENTRY newEntry;
+    PVOID pAddress;
+    QWORD stepSize;
+    QWORD bytesScanned;
+    DWORD noOfVictims;
+
+    ASSERT(NULL != PagingData);
+    ASSERT(!PagingData->KernelSpace);
+    ASSERT(NULL != Victims);
+
+    pAddress = PagingData->ReclaimClockHand;
+    bytesScanned = 0;
+    noOfVictims = 0;
+
+    // The first turn of the clock hand may only clear the accessed bits, by the
+    // end of the second one any page not used in the meantime is a victim
+    while ((noOfVictims < MaxPages) && (bytesScanned < 2 * VMM_USER_SPACE_SIZE))
+    {
+        if (_VmIsKernelAddress(pAddress))
+        {
+            pAddress = NULL;
+        }
+
+        // the ranges whose paging structures are missing are skipped at once
+        stepSize = PAGE_SIZE;
+
+        pml4Entries = (PML4_ENTRY*)PA2VA(PagingData->BasePhysicalAddress);
+        pml4Entries = &(pml4Entries[MASK_PML4_OFFSET(pAddress)]);
+
+        if (!PteIsPresent(pml4Entries))
+        {
+            stepSize = VMM_PML4_ENTRY_RANGE_SIZE;
+            goto next_address;
+        }
+
+        pdptEntries = (PDPT_ENTRY_PD*)PA2VA(PteGetPhysicalAddress(pml4Entries));
+        pdptEntries = &(pdptEntries[MASK_PDPTE_OFFSET(pAddress)]);
+
+        if (!PteIsPresent(pdptEntries))
+        {
+            stepSize = VMM_PDPT_ENTRY_RANGE_SIZE;
+            goto next_address;
+        }
+
+        pdEntries = (PD_ENTRY_PT*)PA2VA(PteGetPhysicalAddress(pdptEntries));
+        pdEntries = &(pdEntries[MASK_PDE_OFFSET(pAddress)]);
+
+        if (!PteIsPresent(pdEntries) || PteIsLargePage(pdEntries))
+        {
+            stepSize = VMM_LARGE_PAGE_SIZE;
+            goto next_address;
+        }
+
+        ptEntries = (PT_ENTRY*)PA2VA(PteGetPhysicalAddress(pdEntries));
+        ptEntries = &(ptEntries[MASK_PTE_OFFSET(pAddress)]);
+
+        if (!PteIsPresent(ptEntries) || !PteIsPageable(ptEntries))
+        {
+            goto next_address;
+        }
+
+        oldEntry = *ptEntries;
+        if (oldEntry.Accessed)
+        {
+            // second chance, if the CPU sets the dirty bit in the meantime the
+            // exchange fails and the page stays hot until the next turn
+            newEntry = oldEntry;
+            newEntry.Accessed = 0;
+
+            _InterlockedCompareExchange64((volatile QWORD*) ptEntries,
+                                          *((QWORD*) &newEntry),
+                                          *((QWORD*) &oldEntry));
+            goto next_address;
+        }
+
+        if (oldEntry.Dirty && !CanWriteDirtyPages)
+        {
+            goto next_address;
+        }
+
+        // the entry is cleared atomically, the dirty bit read here is final: a
+        // write through a translation without it must walk the paging structures
+        // again and will find the page not present
+        *((QWORD*) &oldEntry) = _InterlockedExchange64((volatile QWORD*) ptEntries, 0);
+        if (oldEntry.Dirty && !CanWriteDirtyPages)
+        {
+            *ptEntries = oldEntry;
+            goto next_address;
+        }
+
+        Victims[noOfVictims].Address = pAddress;
+        Victims[noOfVictims].OldEntry = oldEntry;
+        Victims[noOfVictims].EvictionTag = 0;
+        noOfVictims++;
+
+next_address:
+        pAddress = (PVOID) (AlignAddressLower(pAddress, stepSize) + stepSize);
+        bytesScanned = bytesScanned + stepSize;
+    }
+
+    PagingData->ReclaimClockHand = pAddress;
+
+    return noOfVictims;
+}
+
+static
+PHYSICAL_ADDRESS
+_VmRetrieveNextPhysicalAddressForPagingStructure(
+    IN      PPAGING_DATA            PagingData
+    )
+{
+    PHYSICAL_ADDRESS pa;
+    BOOLEAN bFromPool;
+    INTR_STATE oldState;
+
+    ASSERT( NULL != PagingData );
+
+    LockAcquire(&PagingData->StructuresLock, &oldState);
+
+    pa = PagingData->FreeStructuresHead;
+    bFromPool = (NULL != pa);
+    if (bFromPool)
+    {
+        // only the link must be cleared, the rest of the frame is zero
+        PagingData->FreeStructuresHead = *((PHYSICAL_ADDRESS*)PA2VA(pa));
+        *((PHYSICAL_ADDRESS*)PA2VA(pa)) = NULL;
+        PagingData->NumberOfFreeStructures--;
+    }
+    else
+    {
+        ASSERT( PagingData->CurrentIndex < PagingData->NumberOfFrames );
+
+        pa = PtrOffset(PagingData->BasePhysicalAddress, (QWORD) PagingData->CurrentIndex * PAGE_SIZE);
+        PagingData->CurrentIndex++;
+    }
+
+    LockRelease(&PagingData->StructuresLock, oldState);
+
+    if (!bFromPool)
+    {
+        // the frames reserved for the paging structures can't be zeroed before
+        // they are mapped, this is the first time this one is used
+        __invlpg((PVOID)PA2VA(pa));
+        memzero((PVOID)PA2VA(pa), PAGE_SIZE);
+    }
+
+    return pa;
+}
+
+static
+void
+_VmFreeEmptyPagingStructures(
+    IN      PPAGING_DATA            PagingData,
+    IN      PVOID                   Address,
+    INOUT   PVMM_UNMAP_BATCH        Batch
+    )
+{
+    PVOID pEntries[VMM_NO_OF_RECLAIMABLE_LEVELS];
+    PML4_ENTRY* pml4Entry;
+    PDPT_ENTRY_PD* pdptEntry;
+    PD_ENTRY_PT* pdEntry;
+    PHYSICAL_ADDRESS pa;
+    DWORD noOfLevels;
+    DWORD noOfFreed;
+
+    ASSERT(NULL != PagingData);
+    ASSERT(!PagingData->KernelSpace);
+    ASSERT(!_VmIsKernelAddress(Address));
+    ASSERT(NULL != Batch);
+
+    // 1. Find the entries pointing to the PDPT, the PD and the PT of Address
+    noOfLevels = 0;
+
+    pml4Entry = (PML4_ENTRY*)PA2VA(PagingData->BasePhysicalAddress);
+    pml4Entry = &(pml4Entry[MASK_PML4_OFFSET(Address)]);
+    if (PteIsPresent(pml4Entry))
+    {
+        pEntries[noOfLevels++] = pml4Entry;
+
+        pdptEntry = (PDPT_ENTRY_PD*)PA2VA(PteGetPhysicalAddress(pml4Entry));
+        pdptEntry = &(pdptEntry[MASK_PDPTE_OFFSET(Address)]);
+        if (PteIsPresent(pdptEntry))
+        {
+            pEntries[noOfLevels++] = pdptEntry;
+
+            pdEntry = (PD_ENTRY_PT*)PA2VA(PteGetPhysicalAddress(pdptEntry));
+            pdEntry = &(pdEntry[MASK_PDE_OFFSET(Address)]);
+            if (PteIsPresent(pdEntry) && !PteIsLargePage(pdEntry))
+            {
+                pEntries[noOfLevels++] = pdEntry;
+            }
+        }
+    }
+
+    // 2. Free the structures bottom up while they are empty, swapped out pages
+    // leave non-zero entries behind so their tables are kept
+    noOfFreed = 0;
+
+    for (DWORD level = noOfLevels; level > 0; --level)
+    {
+        pa = PteGetPhysicalAddress(pEntries[level - 1]);
+        if (!_VmIsPagingStructureEmpty((QWORD*)PA2VA(pa)))
+        {
+            break;
+        }
+
+        PteUnmap(pEntries[level - 1]);
+
+        ASSERT(Batch->NumberOfStructures < VMM_UNMAP_BATCH_MAX_STRUCTURES);
+        Batch->Structures[Batch->NumberOfStructures++] = pa;
+        noOfFreed++;
+    }
+
+    // the CPUs may have cached the unlinked entries in their paging-structure
+    // caches, the invalidation of any address drops them
+    if (0 != noOfFreed)
+    {
+        _VmUnmapBatchAddRange(Batch, (PVOID)AlignAddressLower(Address, PAGE_SIZE), 1);
+    }
+}
@@ -153,4 +153,73 @@ typedef struct _IMAGE_SECTION_HEADER {
     WORD    NumberOfLinenumbers;
     DWORD   Characteristics;
 } IMAGE_SECTION_HEADER, *PIMAGE_SECTION_HEADER;
-#pragma pack(pop)
\ No newline at end of file
+#pragma pack(pop)
+
+typedef struct _IMAGE_EXPORT_DIRECTORY {
+    DWORD   Characteristics;
+    DWORD   TimeDateStamp;
+    WORD    MajorVersion;
+    WORD    MinorVersion;
+    DWORD   Name;
+    DWORD   Base;
+    DWORD   NumberOfFunctions;
+    DWORD   NumberOfNames;
+    DWORD   AddressOfFunctions;     // RVA from base of image
+    DWORD   AddressOfNames;         // RVA from base of image
+    DWORD   AddressOfNameOrdinals;  // RVA from base of image
+} IMAGE_EXPORT_DIRECTORY, *PIMAGE_EXPORT_DIRECTORY;
+
+// The exception directory is an array of these entries sorted by
+// BeginAddress, each one describes a function or a chunk of a function
+typedef struct _IMAGE_RUNTIME_FUNCTION_ENTRY {
+    DWORD   BeginAddress;
+    DWORD   EndAddress;
+
+    // If RUNTIME_FUNCTION_INDIRECT is set the RVA is the one of another entry
+    // + 1 instead of the one of an UNWIND_INFO
+    DWORD   UnwindInfoAddress;
+} IMAGE_RUNTIME_FUNCTION_ENTRY, *PIMAGE_RUNTIME_FUNCTION_ENTRY;
+
+#define RUNTIME_FUNCTION_INDIRECT           0x1
+
+#define UNW_FLAG_EHANDLER                   0x1
+#define UNW_FLAG_UHANDLER                   0x2
+#define UNW_FLAG_CHAININFO                  0x4
+
+typedef enum _UNWIND_OP_CODES
+{
+    UWOP_PUSH_NONVOL = 0,
+    UWOP_ALLOC_LARGE,
+    UWOP_ALLOC_SMALL,
+    UWOP_SET_FPREG,
+    UWOP_SAVE_NONVOL,
+    UWOP_SAVE_NONVOL_FAR,
+    UWOP_EPILOG,
+    UWOP_SPARE_CODE,
+    UWOP_SAVE_XMM128,
+    UWOP_SAVE_XMM128_FAR,
+    UWOP_PUSH_MACHFRAME
+} UNWIND_OP_CODES;
+
+// An unwind code slot: the low byte is the offset of the end of the prolog
+// instruction, the high byte holds the operation and its information
+#define UNWIND_CODE_OFFSET(Code)            ((BYTE)((Code) & 0xFF))
+#define UNWIND_CODE_OP(Code)                ((BYTE)(((Code) >> 8) & 0xF))
+#define UNWIND_CODE_INFO(Code)              ((BYTE)((Code) >> 12))
+
+typedef struct _UNWIND_INFO {
+    BYTE    VersionAndFlags;
+    BYTE    SizeOfProlog;
+    BYTE    CountOfCodes;
+    BYTE    FrameRegisterAndOffset;
+
+    // The codes describe the prolog operations in the reverse order of their
+    // execution. If UNW_FLAG_CHAININFO is set the codes are followed by an
+    // IMAGE_RUNTIME_FUNCTION_ENTRY aligned to an even number of slots.
+    WORD    UnwindCode[0];
+} UNWIND_INFO, *PUNWIND_INFO;
+
+#define UNWIND_INFO_VERSION(Info)           ((Info)->VersionAndFlags & 0x7)
+#define UNWIND_INFO_FLAGS(Info)             ((Info)->VersionAndFlags >> 3)
+#define UNWIND_INFO_FRAME_REGISTER(Info)    ((Info)->FrameRegisterAndOffset & 0xF)
+#define UNWIND_INFO_FRAME_OFFSET(Info)      ((Info)->FrameRegisterAndOffset >> 4)
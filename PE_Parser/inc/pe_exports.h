@@ -93,6 +93,11 @@ typedef struct _PE_SECTION_INFO
     PVOID               BaseAddress;
     DWORD               Size;
     DWORD               Characteristics;
+
+    // Location of the section's initialized data in the file, the part of the
+    // section past RawDataSize is zero filled
+    DWORD               RawDataOffset;
+    DWORD               RawDataSize;
 } PE_SECTION_INFO, *PPE_SECTION_INFO;
 
 #define IMAGE_DIRECTORY_ENTRY_EXPORT          0   // Export Directory
@@ -115,4 +120,27 @@ typedef struct _PE_DATA_DIRECTORY
 {
     PVOID               BaseAddress;
     DWORD               Size;
-} PE_DATA_DIRECTORY, *PPE_DATA_DIRECTORY;
\ No newline at end of file
+} PE_DATA_DIRECTORY, *PPE_DATA_DIRECTORY;
+
+typedef struct _PE_FUNCTION_INFO
+{
+    // For a function split in several chunks these describe the chunk which
+    // holds the entry point
+    PVOID               BaseAddress;
+    DWORD               Size;
+} PE_FUNCTION_INFO, *PPE_FUNCTION_INFO;
+
+// The x64 unwind codes index the general purpose registers in their encoding
+// order: RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8 - R15
+#define PE_UNWIND_REGISTER_RSP              4
+#define PE_UNWIND_NUMBER_OF_REGISTERS       16
+
+typedef struct _PE_UNWIND_CONTEXT
+{
+    QWORD               Rip;
+    QWORD               Registers[PE_UNWIND_NUMBER_OF_REGISTERS];
+
+    // The unwinder only reads the stack in the [StackLow, StackHigh) range
+    QWORD               StackLow;
+    QWORD               StackHigh;
+} PE_UNWIND_CONTEXT, *PPE_UNWIND_CONTEXT;
\ No newline at end of file
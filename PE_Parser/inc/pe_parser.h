@@ -24,4 +24,60 @@ PeRetrieveDataDirectory(
     IN                          PPE_NT_HEADER_INFO      NtInfo,
     IN                          BYTE                    DataDirectory,
     OUT                         PPE_DATA_DIRECTORY      DataDirectoryInfo
+    );
+
+//******************************************************************************
+// Function:     PeRetrieveFunction
+// Description:  Finds the function containing Address in the exception
+//               directory of the image.
+// Returns:      STATUS - STATUS_ELEMENT_NOT_FOUND if the address is not
+//               covered by the directory, leaf functions have no entries.
+// Parameter:    IN PPE_NT_HEADER_INFO NtInfo
+// Parameter:    IN PVOID Address
+// Parameter:    OUT PPE_FUNCTION_INFO FunctionInfo
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+PeRetrieveFunction(
+    IN                          PPE_NT_HEADER_INFO      NtInfo,
+    IN                          PVOID                   Address,
+    OUT                         PPE_FUNCTION_INFO       FunctionInfo
+    );
+
+//******************************************************************************
+// Function:     PeRetrieveExportName
+// Description:  Retrieves the name under which the function starting at
+//               Address is exported.
+// Returns:      STATUS - STATUS_ELEMENT_NOT_FOUND if the function is not
+//               exported by name.
+// Parameter:    IN PPE_NT_HEADER_INFO NtInfo
+// Parameter:    IN PVOID Address
+// Parameter:    OUT_PTR char** Name - Points inside the image
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+PeRetrieveExportName(
+    IN                          PPE_NT_HEADER_INFO      NtInfo,
+    IN                          PVOID                   Address,
+    OUT_PTR                     char**                  Name
+    );
+
+//******************************************************************************
+// Function:     PeVirtualUnwind
+// Description:  Unwinds a frame of a function of the image using the unwind
+//               information of the exception directory, no frame pointers
+//               are needed. If Rip is inside an epilog the remaining epilog
+//               instructions are emulated instead.
+// Returns:      STATUS - STATUS_ELEMENT_NOT_FOUND if Rip is outside the image,
+//               STATUS_INVALID_POINTER if the stack range would be exceeded.
+// Parameter:    IN PPE_NT_HEADER_INFO NtInfo
+// Parameter:    INOUT PPE_UNWIND_CONTEXT Context - Describes the CPU state
+//               inside the function, on success it describes the state after
+//               the function returns to its caller.
+//******************************************************************************
+SAL_SUCCESS
+STATUS
+PeVirtualUnwind(
+    IN                          PPE_NT_HEADER_INFO      NtInfo,
+    INOUT                       PPE_UNWIND_CONTEXT      Context
     );
\ No newline at end of file
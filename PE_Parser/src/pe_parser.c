@@ -2,6 +2,16 @@
 #include "pe_parser.h"
 #include "pe_structures.h"
 
+// protects against malformed images whose chained unwind information loops
+#define PE_MAX_CHAINED_UNWIND_INFO              32
+
+// protects against the jumps inside an epilog which loop
+#define PE_MAX_EPILOG_INSTRUCTIONS              32
+
+// the number of slots used by each unwind operation, UWOP_ALLOC_LARGE uses an
+// additional one if its operation information is not 0
+static const BYTE UNWIND_OP_SLOTS[] = { 1, 2, 1, 1, 2, 3, 2, 3, 2, 3, 1 };
+
 SAL_SUCCESS
 STATUS
 PeRetrieveNtHeader(
@@ -110,6 +120,8 @@ PeRetrieveSection(
     SectionInfo->BaseAddress = (PBYTE)NtInfo->ImageBase + pSections[SectionIndex].VirtualAddress;
     SectionInfo->Size = pSections[SectionIndex].Misc.VirtualSize;
     SectionInfo->Characteristics = pSections[SectionIndex].Characteristics;
+    SectionInfo->RawDataOffset = pSections[SectionIndex].PointerToRawData;
+    SectionInfo->RawDataSize = pSections[SectionIndex].SizeOfRawData;
 
     if (!CHECK_BOUNDS(SectionInfo->BaseAddress, SectionInfo->Size, NtInfo->ImageBase, NtInfo->Size))
     {
@@ -172,5 +184,681 @@ PeRetrieveDataDirectory(
         return STATUS_INVALID_IMAGE_SIZE;
     }
 
+    return STATUS_SUCCESS;
+}
+
+static
+PIMAGE_RUNTIME_FUNCTION_ENTRY
+_PeLookupRuntimeFunction(
+    IN                          PPE_NT_HEADER_INFO      NtInfo,
+    IN                          DWORD                   Rva
+    )
+{
+    PE_DATA_DIRECTORY exceptionDirectory;
+    PIMAGE_RUNTIME_FUNCTION_ENTRY pEntries;
+    PIMAGE_RUNTIME_FUNCTION_ENTRY pEntry;
+    DWORD left;
+    DWORD right;
+
+    if (!SUCCEEDED(PeRetrieveDataDirectory(NtInfo, IMAGE_DIRECTORY_ENTRY_EXCEPTION, &exceptionDirectory)))
+    {
+        return NULL;
+    }
+
+    if (!CHECK_BOUNDS(exceptionDirectory.BaseAddress, exceptionDirectory.Size, NtInfo->ImageBase, NtInfo->Size))
+    {
+        return NULL;
+    }
+
+    pEntries = (PIMAGE_RUNTIME_FUNCTION_ENTRY) exceptionDirectory.BaseAddress;
+    pEntry = NULL;
+    left = 0;
+    right = exceptionDirectory.Size / sizeof(IMAGE_RUNTIME_FUNCTION_ENTRY);
+
+    while (left < right)
+    {
+        DWORD middle = left + (right - left) / 2;
+
+        if (Rva < pEntries[middle].BeginAddress)
+        {
+            right = middle;
+        }
+        else if (Rva >= pEntries[middle].EndAddress)
+        {
+            left = middle + 1;
+        }
+        else
+        {
+            pEntry = &pEntries[middle];
+            break;
+        }
+    }
+
+    if (NULL != pEntry && IsBooleanFlagOn(pEntry->UnwindInfoAddress, RUNTIME_FUNCTION_INDIRECT))
+    {
+        pEntry = (PIMAGE_RUNTIME_FUNCTION_ENTRY) PtrOffset(NtInfo->ImageBase, pEntry->UnwindInfoAddress - RUNTIME_FUNCTION_INDIRECT);
+        if (!CHECK_BOUNDS(pEntry, sizeof(IMAGE_RUNTIME_FUNCTION_ENTRY), NtInfo->ImageBase, NtInfo->Size))
+        {
+            return NULL;
+        }
+    }
+
+    return pEntry;
+}
+
+static
+PUNWIND_INFO
+_PeRetrieveUnwindInfo(
+    IN                          PPE_NT_HEADER_INFO              NtInfo,
+    IN                          PIMAGE_RUNTIME_FUNCTION_ENTRY   Function
+    )
+{
+    PUNWIND_INFO pUnwindInfo;
+    DWORD unwindInfoSize;
+
+    pUnwindInfo = (PUNWIND_INFO) PtrOffset(NtInfo->ImageBase, Function->UnwindInfoAddress);
+    if (!CHECK_BOUNDS(pUnwindInfo, sizeof(UNWIND_INFO), NtInfo->ImageBase, NtInfo->Size))
+    {
+        return NULL;
+    }
+
+    unwindInfoSize = sizeof(UNWIND_INFO) + ((pUnwindInfo->CountOfCodes + 1) & ~1) * sizeof(WORD);
+    if (IsBooleanFlagOn(UNWIND_INFO_FLAGS(pUnwindInfo), UNW_FLAG_CHAININFO))
+    {
+        unwindInfoSize = unwindInfoSize + sizeof(IMAGE_RUNTIME_FUNCTION_ENTRY);
+    }
+
+    if (!CHECK_BOUNDS(pUnwindInfo, unwindInfoSize, NtInfo->ImageBase, NtInfo->Size))
+    {
+        return NULL;
+    }
+
+    return pUnwindInfo;
+}
+
+__forceinline
+static
+PIMAGE_RUNTIME_FUNCTION_ENTRY
+_PeChainedFunction(
+    IN                          PUNWIND_INFO            UnwindInfo
+    )
+{
+    ASSERT(IsBooleanFlagOn(UNWIND_INFO_FLAGS(UnwindInfo), UNW_FLAG_CHAININFO));
+
+    return (PIMAGE_RUNTIME_FUNCTION_ENTRY) &UnwindInfo->UnwindCode[(UnwindInfo->CountOfCodes + 1) & ~1];
+}
+
+// Returns 0 if the unwind code at Index is malformed
+static
+DWORD
+_PeUnwindCodeSlots(
+    IN                          PUNWIND_INFO            UnwindInfo,
+    IN                          DWORD                   Index
+    )
+{
+    WORD code;
+    DWORD slots;
+
+    code = UnwindInfo->UnwindCode[Index];
+
+    if (UNWIND_CODE_OP(code) >= ARRAYSIZE(UNWIND_OP_SLOTS))
+    {
+        return 0;
+    }
+
+    slots = UNWIND_OP_SLOTS[UNWIND_CODE_OP(code)];
+    if (UWOP_ALLOC_LARGE == UNWIND_CODE_OP(code) && 0 != UNWIND_CODE_INFO(code))
+    {
+        slots = slots + 1;
+    }
+
+    return (Index + slots <= UnwindInfo->CountOfCodes) ? slots : 0;
+}
+
+// Once the frame register is set the function body may move RSP (e.g. by
+// calling alloca) => the stack locations of the unwind codes are relative to
+// the frame register and not to RSP
+static
+BOOLEAN
+_PeIsFrameRegisterEstablished(
+    IN                          PUNWIND_INFO            UnwindInfo,
+    IN                          DWORD                   OffsetInFunction
+    )
+{
+    DWORD slots;
+
+    if (0 == UNWIND_INFO_FRAME_REGISTER(UnwindInfo))
+    {
+        return FALSE;
+    }
+
+    for (DWORD i = 0; i < UnwindInfo->CountOfCodes; i += slots)
+    {
+        slots = _PeUnwindCodeSlots(UnwindInfo, i);
+        if (0 == slots)
+        {
+            return FALSE;
+        }
+
+        if (UWOP_SET_FPREG == UNWIND_CODE_OP(UnwindInfo->UnwindCode[i]))
+        {
+            return OffsetInFunction >= UNWIND_CODE_OFFSET(UnwindInfo->UnwindCode[i]);
+        }
+    }
+
+    return FALSE;
+}
+
+static
+BOOLEAN
+_PeReadStack(
+    IN                          PPE_UNWIND_CONTEXT      Context,
+    IN                          QWORD                   Address,
+    OUT                         QWORD*                  Value
+    )
+{
+    if (!CHECK_BOUNDS(Address, sizeof(QWORD), Context->StackLow, Context->StackHigh - Context->StackLow))
+    {
+        return FALSE;
+    }
+
+    *Value = *((QWORD*) Address);
+
+    return TRUE;
+}
+
+// The instructions of an epilog already executed have undone a part of the
+// prolog => applying the unwind codes would undo it once more. An epilog is
+// recognized the same way RtlVirtualUnwind does it: an optional add rsp or
+// lea rsp, followed by pops of the nonvolatile registers and by a ret or a
+// jmp outside the function. The remaining instructions are emulated.
+// Returns STATUS_ELEMENT_NOT_FOUND if Rip is not inside an epilog, Context is
+// changed only on success.
+static
+STATUS
+_PeUnwindEpilog(
+    IN                          PPE_NT_HEADER_INFO              NtInfo,
+    IN                          PIMAGE_RUNTIME_FUNCTION_ENTRY   Function,
+    INOUT                       PPE_UNWIND_CONTEXT              Context
+    )
+{
+    PE_UNWIND_CONTEXT epilogContext;
+    QWORD* pRegisters;
+    PBYTE pc;
+    BYTE rex;
+    DWORD targetRva;
+    DWORD releasedBytes;
+    BOOLEAN bReturn;
+    BOOLEAN bEpilogStarted;
+
+    epilogContext = *Context;
+    pRegisters = epilogContext.Registers;
+    pc = (PBYTE) Context->Rip;
+    bEpilogStarted = FALSE;
+
+    // only the first instruction of the epilog may release the fixed stack
+    // allocation, it always has a REX.W prefix
+    if (CHECK_BOUNDS(pc, 3, NtInfo->ImageBase, NtInfo->Size) && (0x48 == (pc[0] & 0xF8)))
+    {
+        rex = pc[0] & 0xF;
+
+        if ((0x48 == pc[0]) && (0x83 == pc[1]) && (0xC4 == pc[2]))
+        {
+            // add rsp, imm8
+            if (!CHECK_BOUNDS(pc, 4, NtInfo->ImageBase, NtInfo->Size))
+            {
+                return STATUS_ELEMENT_NOT_FOUND;
+            }
+            pRegisters[PE_UNWIND_REGISTER_RSP] = pRegisters[PE_UNWIND_REGISTER_RSP] + (INT8) pc[3];
+            pc = pc + 4;
+        }
+        else if ((0x48 == pc[0]) && (0x81 == pc[1]) && (0xC4 == pc[2]))
+        {
+            // add rsp, imm32
+            if (!CHECK_BOUNDS(pc, 7, NtInfo->ImageBase, NtInfo->Size))
+            {
+                return STATUS_ELEMENT_NOT_FOUND;
+            }
+            pRegisters[PE_UNWIND_REGISTER_RSP] = pRegisters[PE_UNWIND_REGISTER_RSP] + *((INT32*) &pc[3]);
+            pc = pc + 7;
+        }
+        else if (0x8D == pc[1])
+        {
+            // lea rsp, [frame register + disp], the destination must be RSP
+            // (REX.R clear) and the addressing cannot use a SIB byte
+            BYTE modRm = pc[2];
+            QWORD frameRegister = pRegisters[(modRm & 7) + (rex & 1) * 8];
+
+            if ((0 != (rex & 0x6)) || (4 != ((modRm >> 3) & 7)) || (4 == (modRm & 7)))
+            {
+                return STATUS_ELEMENT_NOT_FOUND;
+            }
+
+            if ((1 == (modRm >> 6)) && CHECK_BOUNDS(pc, 4, NtInfo->ImageBase, NtInfo->Size))
+            {
+                pRegisters[PE_UNWIND_REGISTER_RSP] = frameRegister + (INT8) pc[3];
+                pc = pc + 4;
+            }
+            else if ((2 == (modRm >> 6)) && CHECK_BOUNDS(pc, 7, NtInfo->ImageBase, NtInfo->Size))
+            {
+                pRegisters[PE_UNWIND_REGISTER_RSP] = frameRegister + *((INT32*) &pc[3]);
+                pc = pc + 7;
+            }
+            else
+            {
+                return STATUS_ELEMENT_NOT_FOUND;
+            }
+        }
+
+        bEpilogStarted = (PBYTE) Context->Rip != pc;
+    }
+
+    for (DWORD i = 0; i < PE_MAX_EPILOG_INSTRUCTIONS; ++i)
+    {
+        rex = 0;
+        if (CHECK_BOUNDS(pc, 1, NtInfo->ImageBase, NtInfo->Size) && (0x40 == (pc[0] & 0xF0)))
+        {
+            rex = pc[0] & 0xF;
+            pc = pc + 1;
+        }
+
+        if (!CHECK_BOUNDS(pc, 1, NtInfo->ImageBase, NtInfo->Size))
+        {
+            return STATUS_ELEMENT_NOT_FOUND;
+        }
+
+        bReturn = FALSE;
+        releasedBytes = 0;
+
+        switch (pc[0])
+        {
+        case 0x58: case 0x59: case 0x5A: case 0x5B:
+        case 0x5C: case 0x5D: case 0x5E: case 0x5F:
+            // pop r64
+            if (!_PeReadStack(&epilogContext,
+                              pRegisters[PE_UNWIND_REGISTER_RSP],
+                              &pRegisters[(pc[0] - 0x58) + (rex & 1) * 8]))
+            {
+                return STATUS_INVALID_POINTER;
+            }
+            pRegisters[PE_UNWIND_REGISTER_RSP] = pRegisters[PE_UNWIND_REGISTER_RSP] + sizeof(QWORD);
+            pc = pc + 1;
+            bEpilogStarted = TRUE;
+            break;
+        case 0xC2:
+            // ret imm16, the released bytes belong to the caller
+            if (!CHECK_BOUNDS(pc, 3, NtInfo->ImageBase, NtInfo->Size))
+            {
+                return STATUS_ELEMENT_NOT_FOUND;
+            }
+            releasedBytes = *((WORD*) &pc[1]);
+            bReturn = TRUE;
+            break;
+        case 0xC3:
+            bReturn = TRUE;
+            break;
+        case 0xF3:
+            // rep ret
+            if (!CHECK_BOUNDS(pc, 2, NtInfo->ImageBase, NtInfo->Size) || (0xC3 != pc[1]))
+            {
+                return STATUS_ELEMENT_NOT_FOUND;
+            }
+            bReturn = TRUE;
+            break;
+        case 0xE9:
+        case 0xEB:
+            // jmp rel32, jmp rel8: a jump inside the function continues the
+            // epilog. A jump outside of it is a tail call only if it follows
+            // other epilog instructions, otherwise it most likely goes to a
+            // separate chunk of the function
+            if (!CHECK_BOUNDS(pc, (0xE9 == pc[0]) ? 5 : 2, NtInfo->ImageBase, NtInfo->Size))
+            {
+                return STATUS_ELEMENT_NOT_FOUND;
+            }
+
+            targetRva = (DWORD) PtrDiff(pc, NtInfo->ImageBase)
+                      + ((0xE9 == pc[0]) ? 5 + *((INT32*) &pc[1]) : 2 + (INT8) pc[1]);
+            if ((targetRva >= Function->BeginAddress) && (targetRva < Function->EndAddress))
+            {
+                pc = (PBYTE) PtrOffset(NtInfo->ImageBase, targetRva);
+                break;
+            }
+
+            if (!bEpilogStarted)
+            {
+                return STATUS_ELEMENT_NOT_FOUND;
+            }
+            bReturn = TRUE;
+            break;
+        case 0xFF:
+            // jmp qword ptr [rip + disp32], a tail call through the IAT
+            if (!CHECK_BOUNDS(pc, 2, NtInfo->ImageBase, NtInfo->Size) || (0x25 != pc[1]))
+            {
+                return STATUS_ELEMENT_NOT_FOUND;
+            }
+            bReturn = TRUE;
+            break;
+        default:
+            return STATUS_ELEMENT_NOT_FOUND;
+        }
+
+        if (bReturn)
+        {
+            if (!_PeReadStack(&epilogContext, pRegisters[PE_UNWIND_REGISTER_RSP], &epilogContext.Rip))
+            {
+                return STATUS_INVALID_POINTER;
+            }
+            pRegisters[PE_UNWIND_REGISTER_RSP] = pRegisters[PE_UNWIND_REGISTER_RSP] + sizeof(QWORD) + releasedBytes;
+
+            *Context = epilogContext;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return STATUS_ELEMENT_NOT_FOUND;
+}
+
+SAL_SUCCESS
+STATUS
+PeRetrieveFunction(
+    IN                          PPE_NT_HEADER_INFO      NtInfo,
+    IN                          PVOID                   Address,
+    OUT                         PPE_FUNCTION_INFO       FunctionInfo
+    )
+{
+    PIMAGE_RUNTIME_FUNCTION_ENTRY pFunction;
+    PUNWIND_INFO pUnwindInfo;
+    DWORD chainDepth;
+
+    if (NULL == NtInfo)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == FunctionInfo)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (!CHECK_BOUNDS(Address, 1, NtInfo->ImageBase, NtInfo->Size))
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    pFunction = _PeLookupRuntimeFunction(NtInfo, (DWORD) PtrDiff(Address, NtInfo->ImageBase));
+    if (NULL == pFunction)
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    // the chunks of a function point to the unwind information of the chunk
+    // holding the entry point
+    for (chainDepth = 0; chainDepth < PE_MAX_CHAINED_UNWIND_INFO; ++chainDepth)
+    {
+        pUnwindInfo = _PeRetrieveUnwindInfo(NtInfo, pFunction);
+        if (NULL == pUnwindInfo)
+        {
+            return STATUS_INVALID_IMAGE_SIZE;
+        }
+
+        if (!IsBooleanFlagOn(UNWIND_INFO_FLAGS(pUnwindInfo), UNW_FLAG_CHAININFO))
+        {
+            break;
+        }
+
+        pFunction = _PeChainedFunction(pUnwindInfo);
+    }
+
+    if (PE_MAX_CHAINED_UNWIND_INFO == chainDepth)
+    {
+        return STATUS_INVALID_PE_IMAGE;
+    }
+
+    FunctionInfo->BaseAddress = PtrOffset(NtInfo->ImageBase, pFunction->BeginAddress);
+    FunctionInfo->Size = pFunction->EndAddress - pFunction->BeginAddress;
+
+    return STATUS_SUCCESS;
+}
+
+SAL_SUCCESS
+STATUS
+PeRetrieveExportName(
+    IN                          PPE_NT_HEADER_INFO      NtInfo,
+    IN                          PVOID                   Address,
+    OUT_PTR                     char**                  Name
+    )
+{
+    STATUS status;
+    PE_DATA_DIRECTORY exportDirectory;
+    PIMAGE_EXPORT_DIRECTORY pExports;
+    DWORD* pFunctions;
+    DWORD* pNames;
+    WORD* pOrdinals;
+    DWORD rva;
+
+    if (NULL == NtInfo)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Name)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (!CHECK_BOUNDS(Address, 1, NtInfo->ImageBase, NtInfo->Size))
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    status = PeRetrieveDataDirectory(NtInfo, IMAGE_DIRECTORY_ENTRY_EXPORT, &exportDirectory);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    if (0 == exportDirectory.Size)
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    pExports = (PIMAGE_EXPORT_DIRECTORY) exportDirectory.BaseAddress;
+    if (!CHECK_BOUNDS(pExports, sizeof(IMAGE_EXPORT_DIRECTORY), NtInfo->ImageBase, NtInfo->Size))
+    {
+        return STATUS_INVALID_IMAGE_SIZE;
+    }
+
+    pFunctions = (DWORD*) PtrOffset(NtInfo->ImageBase, pExports->AddressOfFunctions);
+    pNames = (DWORD*) PtrOffset(NtInfo->ImageBase, pExports->AddressOfNames);
+    pOrdinals = (WORD*) PtrOffset(NtInfo->ImageBase, pExports->AddressOfNameOrdinals);
+
+    if (!CHECK_BOUNDS(pFunctions, (QWORD) pExports->NumberOfFunctions * sizeof(DWORD), NtInfo->ImageBase, NtInfo->Size) ||
+        !CHECK_BOUNDS(pNames, (QWORD) pExports->NumberOfNames * sizeof(DWORD), NtInfo->ImageBase, NtInfo->Size) ||
+        !CHECK_BOUNDS(pOrdinals, (QWORD) pExports->NumberOfNames * sizeof(WORD), NtInfo->ImageBase, NtInfo->Size))
+    {
+        return STATUS_INVALID_IMAGE_SIZE;
+    }
+
+    rva = (DWORD) PtrDiff(Address, NtInfo->ImageBase);
+
+    for (DWORD i = 0; i < pExports->NumberOfNames; ++i)
+    {
+        if (pOrdinals[i] < pExports->NumberOfFunctions && pFunctions[pOrdinals[i]] == rva)
+        {
+            if (!CHECK_BOUNDS(PtrOffset(NtInfo->ImageBase, pNames[i]), sizeof(char), NtInfo->ImageBase, NtInfo->Size))
+            {
+                return STATUS_INVALID_IMAGE_SIZE;
+            }
+
+            *Name = (char*) PtrOffset(NtInfo->ImageBase, pNames[i]);
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return STATUS_ELEMENT_NOT_FOUND;
+}
+
+SAL_SUCCESS
+STATUS
+PeVirtualUnwind(
+    IN                          PPE_NT_HEADER_INFO      NtInfo,
+    INOUT                       PPE_UNWIND_CONTEXT      Context
+    )
+{
+    PIMAGE_RUNTIME_FUNCTION_ENTRY pFunction;
+    PUNWIND_INFO pUnwindInfo;
+    QWORD* pRegisters;
+    DWORD offsetInFunction;
+    DWORD chainDepth;
+    DWORD slots;
+    STATUS status;
+
+    if (NULL == NtInfo)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Context)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (!CHECK_BOUNDS(Context->Rip, 1, NtInfo->ImageBase, NtInfo->Size))
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    pRegisters = Context->Registers;
+
+    // leaf functions have no entry, they do not touch the stack => the return
+    // address is on top of it
+    pFunction = _PeLookupRuntimeFunction(NtInfo, (DWORD) PtrDiff(Context->Rip, NtInfo->ImageBase));
+    if (NULL != pFunction)
+    {
+        offsetInFunction = (DWORD) (PtrDiff(Context->Rip, NtInfo->ImageBase) - pFunction->BeginAddress);
+
+        for (chainDepth = 0; ; ++chainDepth)
+        {
+            if (PE_MAX_CHAINED_UNWIND_INFO == chainDepth)
+            {
+                return STATUS_INVALID_PE_IMAGE;
+            }
+
+            pUnwindInfo = _PeRetrieveUnwindInfo(NtInfo, pFunction);
+            if (NULL == pUnwindInfo)
+            {
+                return STATUS_INVALID_IMAGE_SIZE;
+            }
+
+            if (1 != UNWIND_INFO_VERSION(pUnwindInfo) && 2 != UNWIND_INFO_VERSION(pUnwindInfo))
+            {
+                return STATUS_UNSUPPORTED;
+            }
+
+            // an epilog can only follow the prolog
+            if ((0 == chainDepth) && (offsetInFunction >= pUnwindInfo->SizeOfProlog))
+            {
+                status = _PeUnwindEpilog(NtInfo, pFunction, Context);
+                if (STATUS_ELEMENT_NOT_FOUND != status)
+                {
+                    return status;
+                }
+            }
+
+            // the prologs described by the chained information were executed
+            // entirely
+            if (0 != chainDepth)
+            {
+                offsetInFunction = MAX_DWORD;
+            }
+
+            if (_PeIsFrameRegisterEstablished(pUnwindInfo, offsetInFunction))
+            {
+                pRegisters[PE_UNWIND_REGISTER_RSP] = pRegisters[UNWIND_INFO_FRAME_REGISTER(pUnwindInfo)] - UNWIND_INFO_FRAME_OFFSET(pUnwindInfo) * 16;
+            }
+
+            for (DWORD i = 0; i < pUnwindInfo->CountOfCodes; i += slots)
+            {
+                WORD code = pUnwindInfo->UnwindCode[i];
+                BYTE info = UNWIND_CODE_INFO(code);
+                QWORD rsp = pRegisters[PE_UNWIND_REGISTER_RSP];
+                QWORD frameAddress;
+
+                slots = _PeUnwindCodeSlots(pUnwindInfo, i);
+                if (0 == slots)
+                {
+                    return STATUS_INVALID_PE_IMAGE;
+                }
+
+                // the prolog instruction was not executed yet
+                if (offsetInFunction < UNWIND_CODE_OFFSET(code))
+                {
+                    continue;
+                }
+
+                switch (UNWIND_CODE_OP(code))
+                {
+                case UWOP_PUSH_NONVOL:
+                    if (!_PeReadStack(Context, rsp, &pRegisters[info]))
+                    {
+                        return STATUS_INVALID_POINTER;
+                    }
+                    pRegisters[PE_UNWIND_REGISTER_RSP] = rsp + sizeof(QWORD);
+                    break;
+                case UWOP_ALLOC_LARGE:
+                    pRegisters[PE_UNWIND_REGISTER_RSP] = rsp + ((0 == info) ? pUnwindInfo->UnwindCode[i + 1] * 8ULL
+                                                                            : pUnwindInfo->UnwindCode[i + 1] | ((QWORD) pUnwindInfo->UnwindCode[i + 2] << 16));
+                    break;
+                case UWOP_ALLOC_SMALL:
+                    pRegisters[PE_UNWIND_REGISTER_RSP] = rsp + info * 8ULL + 8;
+                    break;
+                case UWOP_SAVE_NONVOL:
+                    if (!_PeReadStack(Context, rsp + pUnwindInfo->UnwindCode[i + 1] * 8ULL, &pRegisters[info]))
+                    {
+                        return STATUS_INVALID_POINTER;
+                    }
+                    break;
+                case UWOP_SAVE_NONVOL_FAR:
+                    if (!_PeReadStack(Context,
+                                      rsp + (pUnwindInfo->UnwindCode[i + 1] | ((QWORD) pUnwindInfo->UnwindCode[i + 2] << 16)),
+                                      &pRegisters[info]))
+                    {
+                        return STATUS_INVALID_POINTER;
+                    }
+                    break;
+                case UWOP_PUSH_MACHFRAME:
+                    // the function was interrupted: the CPU pushed SS, RSP,
+                    // RFLAGS, CS and RIP, optionally followed by an error code
+                    frameAddress = rsp + ((0 != info) ? sizeof(QWORD) : 0);
+
+                    if (!_PeReadStack(Context, frameAddress, &Context->Rip) ||
+                        !_PeReadStack(Context, frameAddress + 3 * sizeof(QWORD), &pRegisters[PE_UNWIND_REGISTER_RSP]))
+                    {
+                        return STATUS_INVALID_POINTER;
+                    }
+                    return STATUS_SUCCESS;
+                default:
+                    // UWOP_SET_FPREG was handled before, the XMM registers
+                    // and the epilog descriptions are not needed to find the
+                    // caller
+                    break;
+                }
+            }
+
+            if (!IsBooleanFlagOn(UNWIND_INFO_FLAGS(pUnwindInfo), UNW_FLAG_CHAININFO))
+            {
+                break;
+            }
+
+            pFunction = _PeChainedFunction(pUnwindInfo);
+        }
+    }
+
+    if (!_PeReadStack(Context, pRegisters[PE_UNWIND_REGISTER_RSP], &Context->Rip))
+    {
+        return STATUS_INVALID_POINTER;
+    }
+    pRegisters[PE_UNWIND_REGISTER_RSP] = pRegisters[PE_UNWIND_REGISTER_RSP] + sizeof(QWORD);
+
     return STATUS_SUCCESS;
 }
\ No newline at end of file
@@ -262,10 +262,23 @@ STATUS
     {
         bytesRead = pStackLocation->Parameters.ReadWrite.Length;
 
-        if (bytesRead != PAGE_SIZE)
+        // the VMM swaps whole pages, possibly more of them at once
+        if ((0 == bytesRead) || !IsAddressAligned(bytesRead, PAGE_SIZE)
+            || !IsAddressAligned(pStackLocation->Parameters.ReadWrite.Offset, PAGE_SIZE))
         {
-            LOG_ERROR("We cannot read more than a page at time!Bytes requested: %U\n", bytesRead);
+            LOG_ERROR("We can only read whole pages! Bytes requested: %U at offset 0x%X\n",
+                      bytesRead, pStackLocation->Parameters.ReadWrite.Offset);
             status = STATUS_DEVICE_NOT_SUPPORTED;
+            bytesRead = 0;
+            __leave;
+        }
+
+        if (pStackLocation->Parameters.ReadWrite.Offset + bytesRead > pSwapFsData->FileSystemSize)
+        {
+            LOG_ERROR("Cannot read 0x%X bytes from offset 0x%X, the swap partition has only 0x%X bytes\n",
+                      bytesRead, pStackLocation->Parameters.ReadWrite.Offset, pSwapFsData->FileSystemSize);
+            status = STATUS_DEVICE_SPACE_RANGE_EXCEEDED;
+            bytesRead = 0;
             __leave;
         }
 
@@ -325,10 +338,22 @@ STATUS
     {
         bytesWritten = pStackLocation->Parameters.ReadWrite.Length;
 
-        if (bytesWritten != PAGE_SIZE)
+        if ((0 == bytesWritten) || !IsAddressAligned(bytesWritten, PAGE_SIZE)
+            || !IsAddressAligned(pStackLocation->Parameters.ReadWrite.Offset, PAGE_SIZE))
         {
-            LOG_ERROR("We cannot write more than a page at time!Bytes requested: %U\n", bytesWritten);
+            LOG_ERROR("We can only write whole pages! Bytes requested: %U at offset 0x%X\n",
+                      bytesWritten, pStackLocation->Parameters.ReadWrite.Offset);
             status = STATUS_DEVICE_NOT_SUPPORTED;
+            bytesWritten = 0;
+            __leave;
+        }
+
+        if (pStackLocation->Parameters.ReadWrite.Offset + bytesWritten > pSwapFsData->FileSystemSize)
+        {
+            LOG_ERROR("Cannot write 0x%X bytes at offset 0x%X, the swap partition has only 0x%X bytes\n",
+                      bytesWritten, pStackLocation->Parameters.ReadWrite.Offset, pSwapFsData->FileSystemSize);
+            status = STATUS_DEVICE_SPACE_RANGE_EXCEEDED;
+            bytesWritten = 0;
             __leave;
         }
 
@@ -15,6 +15,8 @@ typedef DWORD                       VMM_ALLOC_TYPE;
 #define VMM_ALLOC_TYPE_RESERVE      0x1
 #define VMM_ALLOC_TYPE_COMMIT       0x2
 #define VMM_ALLOC_TYPE_NOT_LAZY     0x4
+// The region is aligned to 2MB and backed by 2MB pages whenever possible
+#define VMM_ALLOC_TYPE_LARGE_PAGES  0x8
 
 typedef DWORD                       VMM_FREE_TYPE;
 
@@ -38,7 +38,9 @@ typedef struct _FILE_OBJECT
 typedef struct _VPB_FLAGS
 {
     DWORD               Mounted     :    1;
-    DWORD               Reserved    :   31;
+    // The volume is used by the VMM for paging out memory
+    DWORD               SwapSpace   :    1;
+    DWORD               Reserved    :   30;
 } VPB_FLAGS, *PVPB_FLAGS;
 
 // Provides an association between a logical volume
@@ -32,4 +32,7 @@
 #define HEAP_PORT_TAG                   ':TRP'
 #define HEAP_EXECUTIVE_TAG              ':XE '
 #define HEAP_PROCESS_TAG                ':CRP'
-#define HEAP_BOOT_TAG                   'TOOB'
\ No newline at end of file
+#define HEAP_BOOT_TAG                   'TOOB'
+#define HEAP_PAGE_CACHE_TAG             ':CGP'
+#define HEAP_SWAP_TAG                   ':PWS'
+#define HEAP_PROFILER_TAG               ':FRP'
\ No newline at end of file
@@ -273,6 +273,16 @@ IoReadFile(
     OUT         QWORD*                  BytesRead
     );
 
+SAL_SUCCESS
+STATUS
+IoWriteFile(
+    IN          PFILE_OBJECT            FileHandle,
+    IN          QWORD                   BytesToWrite,
+    IN_OPT      QWORD*                  FileOffset,
+    IN          PVOID                   Buffer,
+    OUT         QWORD*                  BytesWritten
+    );
+
 SAL_SUCCESS
 STATUS
 IoQueryInformationFile(